@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#include "parser/lexer.h"
+#include "parser/parser.h"
+#include "binary/cof.h"
+#include "target/target.h"
+#include "util/diagnostic.h"
+#include "util/logger.h"
+
+using namespace coil;
+
+/**
+ * @brief Shape of the generated input and how often to run it
+ */
+struct BenchOptions {
+    size_t functions;        // Functions in the generated source
+    size_t instructions;     // Instructions per function (not counting the final RET)
+    unsigned mix[4];         // Relative weights of MATH, MEM, BIT and branch instructions
+    size_t repeats;          // Runs per phase; the fastest one is reported
+    size_t jobs;             // Threads for code generation
+    uint64_t seed;           // Generator seed
+    bool native;             // Also lower to x86-64 machine code in generateCof
+
+    BenchOptions()
+        : functions(1000), instructions(100), mix{40, 30, 20, 10}, repeats(3), jobs(1), seed(1), native(false) {}
+};
+
+/**
+ * @brief Result of one benchmarked phase
+ */
+struct PhaseResult {
+    const char* name;        // Phase name
+    double seconds;          // Fastest run
+    size_t bytes;            // Bytes the phase consumes
+};
+
+static const char* const mixNames[] = {"math", "mem", "bit", "branch"};
+
+/**
+ * @brief Print usage information
+ *
+ * @param programName Name of the program
+ */
+static void printUsage(const char* programName) {
+    std::cout << "COIL throughput benchmark\n";
+    std::cout << "Usage: " << programName << " [options]\n";
+    std::cout << "Options:\n";
+    std::cout << "  -f <count>         Functions to generate (default: 1000)\n";
+    std::cout << "  -i <count>         Instructions per function (default: 100)\n";
+    std::cout << "  --mix <weights>    Instruction mix, e.g. math=40,mem=30,bit=20,branch=10\n";
+    std::cout << "  -r <count>         Runs per phase, the fastest is reported (default: 3)\n";
+    std::cout << "  -j <jobs>          Threads for code generation (default: 1)\n";
+    std::cout << "  --seed <n>         Generator seed (default: 1)\n";
+    std::cout << "  --native           Include x86-64 lowering in code generation\n";
+    std::cout << "  --emit <file>      Write the generated source to <file> and exit\n";
+    std::cout << "  -h, --help         Display this help message\n";
+    std::cout << "Results are printed as one JSON object.\n";
+}
+
+/**
+ * @brief Generate a COIL source with the requested shape
+ *
+ * The same options and seed always produce the same source.
+ *
+ * @param options Benchmark options
+ * @param instructionCount Number of instructions generated (output parameter)
+ * @return Generated source
+ */
+static std::string generateSource(const BenchOptions& options, size_t& instructionCount) {
+    static const char* const mathOps[] = {"ADD", "SUB", "MUL"};
+    static const char* const bitOps[] = {"AND", "OR", "XOR", "SHL", "SHR"};
+    static const char* const conditions[] = {"EQ", "NE", "LT", "GE"};
+
+    std::mt19937_64 random(options.seed);
+    std::discrete_distribution<unsigned> pickKind(std::begin(options.mix), std::end(options.mix));
+    auto pick = [&random](size_t count) { return static_cast<size_t>(random() % count); };
+    auto reg = [&pick]() { return "R" + std::to_string(pick(8)); };
+
+    std::string source = "DIR SECT text READ EXEC\n";
+    source.reserve(options.functions * (options.instructions * 24 + 96));
+    instructionCount = 0;
+
+    for (size_t f = 0; f < options.functions; f++) {
+        std::string name = "f" + std::to_string(f);
+        source += "DIR HINT " + name + " FUNC GLOBAL\n";
+        source += "DIR LABEL " + name + "\n";
+        source += "DIR LABEL top\n";
+
+        for (size_t i = 0; i < options.instructions; i++) {
+            switch (pickKind(random)) {
+                case 0:
+                    source += "  MATH " + std::string(mathOps[pick(3)]) + " " + reg() + ", " + reg() + ", " +
+                              (pick(2) ? reg() : std::to_string(pick(1000))) + "\n";
+                    break;
+                case 1:
+                    if (pick(2)) {
+                        source += "  MEM LOAD " + reg() + ", [" + reg() + " + " + std::to_string(pick(32) * 8) + "]\n";
+                    } else {
+                        source += "  MEM STORE [" + reg() + " + " + std::to_string(pick(32) * 8) + "], " + reg() + "\n";
+                    }
+                    break;
+                case 2:
+                    source += "  BIT " + std::string(bitOps[pick(5)]) + " " + reg() + ", " + reg() + ", " +
+                              std::to_string(pick(63) + 1) + "\n";
+                    break;
+                default:
+                    source += "  CF BRC " + std::string(conditions[pick(4)]) + " top\n";
+                    break;
+            }
+        }
+
+        source += "  CF RET\n";
+        source += "DIR HINT " + name + " ENDFUNC\n";
+        instructionCount += options.instructions + 1;
+    }
+
+    return source;
+}
+
+/**
+ * @brief Get the peak resident set size of the process
+ *
+ * @return Peak RSS in kilobytes, or 0 where it cannot be measured
+ */
+static long peakRssKilobytes() {
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+#endif
+    return 0;
+}
+
+/**
+ * @brief Run a phase several times and keep the fastest run
+ *
+ * @param repeats Number of runs
+ * @param run Phase body, called with the start time, which it moves past
+ *            any setup it does not want timed; returns false if the phase
+ *            failed
+ * @param seconds Fastest run time (output parameter)
+ * @return true if every run succeeded
+ */
+template <typename Run>
+static bool timePhase(size_t repeats, Run run, double& seconds) {
+    seconds = 0;
+    for (size_t i = 0; i < repeats; i++) {
+        auto start = std::chrono::steady_clock::now();
+        if (!run(start)) {
+            return false;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (i == 0 || elapsed.count() < seconds) {
+            seconds = elapsed.count();
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Parse a non-negative integer argument
+ *
+ * @param text Argument text
+ * @param value Parsed value (output parameter)
+ * @return true if the whole argument is a number
+ */
+static bool parseCount(const char* text, unsigned long long& value) {
+    char* end = nullptr;
+    value = strtoull(text, &end, 10);
+    return *text != '\0' && *end == '\0';
+}
+
+/**
+ * @brief Parse an instruction mix such as math=40,mem=30
+ *
+ * Kinds that are not listed get no weight.
+ *
+ * @param text Mix specification
+ * @param mix Weights per kind (output parameter)
+ * @return true if the mix is valid and not all zero
+ */
+static bool parseMix(const std::string& text, unsigned mix[4]) {
+    std::fill(mix, mix + 4, 0u);
+    unsigned total = 0;
+
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t comma = text.find(',', start);
+        std::string item = text.substr(start, comma - start);
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            return false;
+        }
+
+        size_t kind = 0;
+        while (kind < 4 && item.compare(0, equals, mixNames[kind]) != 0) {
+            kind++;
+        }
+        unsigned long long weight;
+        if (kind == 4 || !parseCount(item.c_str() + equals + 1, weight) || weight > 1000000) {
+            return false;
+        }
+        mix[kind] = static_cast<unsigned>(weight);
+        total += mix[kind];
+
+        if (comma == std::string::npos) {
+            break;
+        }
+        start = comma + 1;
+    }
+
+    return total > 0;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    std::string emitFile;
+
+    for (int i = 1; i < argc; i++) {
+        unsigned long long value = 0;
+        bool hasValue = i + 1 < argc;
+
+        if (strcmp(argv[i], "-f") == 0 && hasValue && parseCount(argv[i + 1], value) && value > 0) {
+            options.functions = static_cast<size_t>(value);
+            i++;
+        } else if (strcmp(argv[i], "-i") == 0 && hasValue && parseCount(argv[i + 1], value)) {
+            options.instructions = static_cast<size_t>(value);
+            i++;
+        } else if (strcmp(argv[i], "-r") == 0 && hasValue && parseCount(argv[i + 1], value) && value > 0) {
+            options.repeats = static_cast<size_t>(value);
+            i++;
+        } else if (strcmp(argv[i], "-j") == 0 && hasValue && parseCount(argv[i + 1], value)) {
+            options.jobs = static_cast<size_t>(value);
+            i++;
+        } else if (strcmp(argv[i], "--seed") == 0 && hasValue && parseCount(argv[i + 1], value)) {
+            options.seed = value;
+            i++;
+        } else if (strcmp(argv[i], "--mix") == 0 && hasValue) {
+            if (!parseMix(argv[++i], options.mix)) {
+                std::cerr << "Error: Invalid instruction mix: " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--emit") == 0 && hasValue) {
+            emitFile = argv[++i];
+        } else if (strcmp(argv[i], "--native") == 0) {
+            options.native = true;
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printUsage(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Error: Invalid argument: " << argv[i] << "\n";
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Diagnostics would only measure the console
+    GlobalLogger::setInstance(std::make_unique<ConsoleLogger>(LOG_ERROR));
+
+    size_t instructionCount = 0;
+    std::string source = generateSource(options, instructionCount);
+    if (!emitFile.empty()) {
+        FILE* file = fopen(emitFile.c_str(), "wb");
+        if (!file || fwrite(source.data(), 1, source.size(), file) != source.size()) {
+            std::cerr << "Error: Could not write " << emitFile << "\n";
+            if (file) {
+                fclose(file);
+            }
+            return 1;
+        }
+        fclose(file);
+        return 0;
+    }
+
+    std::string cofPath = (std::filesystem::temp_directory_path() /
+                           ("coil_bench_" + std::to_string(options.seed) + ".cof")).string();
+    std::vector<PhaseResult> results;
+    double seconds;
+
+    // Each phase starts from the output of the previous one, so only its
+    // own work is timed
+    std::vector<Token> tokens;
+    bool ok = timePhase(options.repeats, [&](auto&) {
+        DiagnosticEngine diag;
+        Lexer lexer(source, "bench.coil", diag);
+        tokens = lexer.tokenize();
+        return !diag.hasErrorDiagnostics();
+    }, seconds);
+    results.push_back({"lex", seconds, source.size()});
+
+    std::unique_ptr<Module> module;
+    ok = ok && timePhase(options.repeats, [&](auto& start) {
+        DiagnosticEngine diag;
+        Parser parser(tokens, diag);
+        start = std::chrono::steady_clock::now();
+        module = parser.parse();
+        return module != nullptr;
+    }, seconds);
+    results.push_back({"parse", seconds, source.size()});
+
+    std::unique_ptr<Target> target = Target::createFromName(1, "x86-64");
+    std::unique_ptr<CofFile> cof;
+    ok = ok && timePhase(options.repeats, [&](auto&) {
+        cof = module->generateCof(options.jobs, nullptr, ENCODING_STANDARD, {target.get()}, options.native);
+        return cof != nullptr;
+    }, seconds);
+    results.push_back({"generate", seconds, source.size()});
+
+    ok = ok && timePhase(options.repeats, [&](auto&) { return cof->write(cofPath); }, seconds);
+    std::error_code error;
+    size_t cofSize = static_cast<size_t>(std::filesystem::file_size(cofPath, error));
+    results.push_back({"write", seconds, cofSize});
+
+    ok = ok && timePhase(options.repeats, [&](auto&) { return CofFile::read(cofPath) != nullptr; }, seconds);
+    results.push_back({"read", seconds, cofSize});
+
+    std::remove(cofPath.c_str());
+    if (!ok) {
+        std::cerr << "Error: Phase " << results.back().name << " failed\n";
+        return 1;
+    }
+
+    // One JSON object, so runs can be collected and compared over time
+    std::cout << "{\"functions\":" << options.functions << ",\"instructions\":" << instructionCount
+              << ",\"source_bytes\":" << source.size() << ",\"cof_bytes\":" << cofSize
+              << ",\"repeats\":" << options.repeats << ",\"jobs\":" << options.jobs
+              << ",\"native\":" << (options.native ? "true" : "false") << ",\"mix\":{";
+    for (size_t kind = 0; kind < 4; kind++) {
+        std::cout << (kind ? "," : "") << "\"" << mixNames[kind] << "\":" << options.mix[kind];
+    }
+    std::cout << "},\"phases\":[";
+    for (size_t i = 0; i < results.size(); i++) {
+        const PhaseResult& phase = results[i];
+        double elapsed = phase.seconds > 0 ? phase.seconds : 1e-9;
+        char line[256];
+        snprintf(line, sizeof(line),
+                 "%s{\"name\":\"%s\",\"seconds\":%.6f,\"mb_per_s\":%.2f,\"instructions_per_s\":%.0f}",
+                 i ? "," : "", phase.name, phase.seconds, phase.bytes / elapsed / 1e6,
+                 instructionCount / elapsed);
+        std::cout << line;
+    }
+    std::cout << "],\"peak_rss_kb\":" << peakRssKilobytes() << "}\n";
+
+    return 0;
+}
@@ -1,15 +1,35 @@
 #include "binary/cof.h"
+#include "binary/cof_view.h"
+#include "binary/compression.h"
+#include "binary/function_cache.h"
+#include "util/thread_pool.h"
 #include "util/logger.h"
 #include <ctime>
 #include <cstring>
 #include <fstream>
 #include <algorithm>
 #include <random>
+#include <cerrno>
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <climits>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+#endif
 
 namespace coil {
 
-CofFile::CofFile() {
-    // Initialize header
+CofFile::CofFile()
+    : compressionJobs(1), compressionPool(nullptr), deterministic(false), fixedTimestamp(0),
+      identityAssigned(false) {
+    // Initialize header (padding included, so it is written as zeros)
+    std::memset(&header, 0, sizeof(header));
     header.magic = COF_MAGIC;
     header.version_major = COF_VERSION_MAJOR;
     header.version_minor = COF_VERSION_MINOR;
@@ -19,21 +39,11 @@ CofFile::CofFile() {
     header.symbol_count = 0;
     header.string_table_size = 0;
     header.entry_point = 0;
-    header.timestamp = static_cast<uint64_t>(std::time(nullptr));
-    std::memset(header.uuid, 0, sizeof(header.uuid));
-    
-    // Generate a random UUID
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<uint8_t> dist(0, 255);
     
-    for (int i = 0; i < 16; i++) {
-        header.uuid[i] = dist(gen);
-    }
-    
-    // Set version 4 UUID (random)
-    header.uuid[6] = (header.uuid[6] & 0x0F) | 0x40;
-    header.uuid[8] = (header.uuid[8] & 0x3F) | 0x80;
+    // The timestamp and UUID are assigned when the file is laid out, so
+    // files that are only read never set up a random number generator
+    header.timestamp = 0;
+    std::memset(header.uuid, 0, sizeof(header.uuid));
     
     // Initialize header with default offsets
     header.header_size = sizeof(CofHeader);
@@ -42,8 +52,8 @@ CofFile::CofFile() {
     header.string_table_offset = 0;
     header.target_table_offset = 0;
     
-    // Add empty string to string table (index 0)
-    addString("");
+    // The string table starts out holding the empty string (offset 0)
+    header.string_table_size = static_cast<uint32_t>(strings.size());
 }
 
 uint32_t CofFile::addTarget(uint32_t archType, uint32_t features, const std::string& name) {
@@ -63,6 +73,24 @@ uint32_t CofFile::addTarget(uint32_t archType, uint32_t features, const std::str
     return targetId;
 }
 
+const TargetEntry& CofFile::getTarget(size_t index) const {
+    if (index >= targets.size()) {
+        throw std::out_of_range("Target index out of range");
+    }
+    
+    return targets[index];
+}
+
+std::string_view CofFile::getString(uint32_t offset) const {
+    const auto& data = strings.getData();
+    if (offset >= data.size()) {
+        return std::string_view();
+    }
+    
+    // Every string in the table ends with a NUL character
+    return std::string_view(reinterpret_cast<const char*>(data.data()) + offset);
+}
+
 Section& CofFile::addSection(const std::string& name, uint32_t type, uint32_t flags, uint32_t targetId) {
     auto section = std::make_unique<Section>(name, type, flags, targetId);
     Section& sectionRef = *section;
@@ -75,35 +103,26 @@ Section& CofFile::addSection(const std::string& name, uint32_t type, uint32_t fl
 
 uint32_t CofFile::addSymbol(const std::string& name, uint32_t sectionIndex, uint64_t value, 
                           uint64_t size, uint16_t type, uint16_t flags, uint32_t targetId) {
-    uint32_t symbolIndex = static_cast<uint32_t>(symbols.size());
+    uint32_t index = static_cast<uint32_t>(symbols.size());
     
     auto symbol = std::make_unique<Symbol>(name, sectionIndex, value, size, type, flags, targetId);
+    symbolIndex.add(symbol->getName(), index);
     symbols.push_back(std::move(symbol));
     header.symbol_count = static_cast<uint32_t>(symbols.size());
     
-    return symbolIndex;
+    return index;
 }
 
-uint32_t CofFile::addString(const std::string& str) {
-    // Check if the string already exists in the string table
-    auto it = stringTable.find(str);
-    if (it != stringTable.end()) {
-        return it->second;
-    }
-    
-    // Add the string to the string table
-    uint32_t offset = static_cast<uint32_t>(stringTableData.size());
-    stringTable[str] = offset;
-    
-    // Append the string to the string table data (including null terminator)
-    stringTableData.insert(stringTableData.end(), str.begin(), str.end());
-    stringTableData.push_back(0);
-    
-    header.string_table_size = static_cast<uint32_t>(stringTableData.size());
-    
+uint32_t CofFile::addString(std::string_view str) {
+    uint32_t offset = strings.add(str);
+    header.string_table_size = static_cast<uint32_t>(strings.size());
     return offset;
 }
 
+void CofFile::setStringMerging(bool merge) {
+    strings.setTailMerging(merge);
+}
+
 Section& CofFile::getSection(size_t index) {
     if (index >= sections.size()) {
         throw std::out_of_range("Section index out of range");
@@ -121,13 +140,60 @@ Symbol& CofFile::getSymbol(size_t index) {
 }
 
 Symbol* CofFile::getSymbolByName(const std::string& name) {
-    for (const auto& symbol : symbols) {
-        if (symbol->getName() == name) {
-            return symbol.get();
-        }
+    uint32_t index;
+    if (!symbolIndex.find(name, index)) {
+        return nullptr;
+    }
+    
+    return symbols[index].get();
+}
+
+const std::vector<std::unique_ptr<Symbol>>& CofFile::getSymbols() const {
+    return symbols;
+}
+
+const SymbolIndex& CofFile::getSymbolIndex() const {
+    return symbolIndex;
+}
+
+Section& CofFile::addHashSection() {
+    Section& section = addSection("hash", SECTION_HASH, SECTION_FLAG_NONE);
+    section.addData(SymbolIndex::buildSection(symbols));
+    return section;
+}
+
+bool CofFile::setCompression(uint32_t type, int level) {
+    if (type != COMPRESSION_NONE && !Compression::isSupported(type)) {
+        LOG_ERROR("Compression format not supported in this build: {}", Compression::getName(type));
+        return false;
     }
     
-    return nullptr;
+    for (auto& section : sections) {
+        if (section->getType() != SECTION_HASH && !section->getData().empty()) {
+            section->setCompression(type, level);
+        }
+    }
+    return true;
+}
+
+void CofFile::setCompressionJobs(size_t jobs) {
+    compressionJobs = jobs;
+}
+
+void CofFile::setCompressionPool(ThreadPool* pool) {
+    compressionPool = pool;
+}
+
+void CofFile::setInstructionEncoding(InstructionEncoding encoding) {
+    if (encoding == ENCODING_COMPACT) {
+        header.flags |= COF_FLAG_COMPACT_ENCODING;
+    } else {
+        header.flags &= ~COF_FLAG_COMPACT_ENCODING;
+    }
+}
+
+InstructionEncoding CofFile::getInstructionEncoding() const {
+    return (header.flags & COF_FLAG_COMPACT_ENCODING) ? ENCODING_COMPACT : ENCODING_STANDARD;
 }
 
 void CofFile::setEntryPoint(uint64_t entryPoint) {
@@ -146,208 +212,507 @@ size_t CofFile::getTargetCount() const {
     return targets.size();
 }
 
-void CofFile::updateOffsets() {
+void CofFile::setDeterministic(bool enable, uint64_t timestamp) {
+    deterministic = enable;
+    fixedTimestamp = enable ? timestamp : 0;
+}
+
+bool CofFile::isDeterministic() const {
+    return deterministic;
+}
+
+const CofHeader& CofFile::getHeader() const {
+    return header;
+}
+
+bool CofFile::getSourceDateEpoch(uint64_t& timestamp) {
+    const char* value = std::getenv("SOURCE_DATE_EPOCH");
+    if (!value || *value == '\0') {
+        return false;
+    }
+    
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long seconds = std::strtoull(value, &end, 10);
+    if (*end != '\0' || *value == '-' || errno == ERANGE) {
+        return false;
+    }
+    
+    timestamp = static_cast<uint64_t>(seconds);
+    return true;
+}
+
+void CofFile::assignIdentity(const Layout& layout) {
+    if (!deterministic) {
+        // A file keeps the identity it was first given, or read with
+        if (identityAssigned) {
+            return;
+        }
+        
+        std::random_device rd;
+        std::mt19937 gen(rd());
+        std::uniform_int_distribution<uint32_t> dist(0, 255);
+        for (int i = 0; i < 16; i++) {
+            header.uuid[i] = static_cast<uint8_t>(dist(gen));
+        }
+        
+        // Set version 4 UUID (random)
+        header.uuid[6] = (header.uuid[6] & 0x0F) | 0x40;
+        header.uuid[8] = (header.uuid[8] & 0x3F) | 0x80;
+        header.timestamp = static_cast<uint64_t>(std::time(nullptr));
+        identityAssigned = true;
+        return;
+    }
+    
+    // Hash everything the file holds apart from the header. The tables
+    // are final here and section data is hashed uncompressed, so the UUID
+    // does not depend on the compression library either.
+    uint64_t hash = FunctionCache::hash(&header.flags, sizeof(header.flags));
+    hash = FunctionCache::hash(&header.entry_point, sizeof(header.entry_point), hash);
+    hash = FunctionCache::hash(targets.data(), targets.size() * sizeof(TargetEntry), hash);
+    hash = FunctionCache::hash(strings.getData().data(), strings.size(), hash);
+    for (size_t i = 0; i < sections.size(); i++) {
+        const Section& section = *sections[i];
+        SectionEntry entry = section.createEntry(layout.sectionEntries[i].name_offset, 0, 0);
+        hash = FunctionCache::hash(&entry, sizeof(entry), hash);
+        const auto& relocations = section.getRelocations();
+        hash = FunctionCache::hash(section.getData().data(), section.getData().size(), hash);
+        hash = FunctionCache::hash(relocations.data(), relocations.size() * sizeof(RelocationEntry), hash);
+    }
+    for (size_t i = 0; i < symbols.size(); i++) {
+        SymbolEntry entry = symbols[i]->createEntry(layout.symbolNames[i]);
+        hash = FunctionCache::hash(&entry, sizeof(entry), hash);
+    }
+    
+    // Stretch the hash over the UUID: the second half is the first one
+    // hashed again from another seed
+    uint64_t second = FunctionCache::hash(&hash, sizeof(hash), hash ^ 0x9E3779B97F4A7C15ull);
+    for (int i = 0; i < 8; i++) {
+        header.uuid[i] = static_cast<uint8_t>(hash >> (56 - i * 8));
+        header.uuid[8 + i] = static_cast<uint8_t>(second >> (56 - i * 8));
+    }
+    
+    // Set version 8 UUID (custom)
+    header.uuid[6] = (header.uuid[6] & 0x0F) | 0x80;
+    header.uuid[8] = (header.uuid[8] & 0x3F) | 0x80;
+    header.timestamp = fixedTimestamp;
+    identityAssigned = true;
+}
+
+void CofFile::compressSections(Layout& layout) const {
+    layout.payloads.assign(sections.size(), std::vector<uint8_t>());
+    
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < sections.size(); i++) {
+        if (sections[i]->getCompression() != COMPRESSION_NONE && !sections[i]->getData().empty()) {
+            pending.push_back(i);
+        }
+    }
+    if (pending.empty()) {
+        return;
+    }
+    
+    // Sections compress independently, so each one is a task of its own
+    std::vector<char> failed(sections.size(), 0);
+    {
+        std::unique_ptr<ThreadPool> ownPool;
+        ThreadPool* pool = pending.size() > 1 ? compressionPool : nullptr;
+        if (!pool) {
+            ownPool = std::make_unique<ThreadPool>(pending.size() > 1 ? compressionJobs : 1);
+            pool = ownPool.get();
+        }
+        for (size_t i : pending) {
+            pool->submit([this, &layout, &failed, i] {
+                const Section& section = *sections[i];
+                std::vector<uint8_t>& payload = layout.payloads[i];
+                
+                if (!Compression::compress(section.getCompression(), section.getCompressionLevel(),
+                                           section.getData().data(), section.getData().size(), payload)) {
+                    failed[i] = 1;
+                    payload.clear();
+                } else if (payload.size() >= section.getData().size()) {
+                    // Not worth it; store the section as is
+                    std::vector<uint8_t>().swap(payload);
+                }
+            });
+        }
+        pool->wait();
+    }
+    
+    for (size_t i : pending) {
+        if (failed[i]) {
+            LOG_WARNING("Could not compress section {} with {}, storing it uncompressed", sections[i]->getName(),
+                        Compression::getName(sections[i]->getCompression()));
+        }
+    }
+}
+
+const std::vector<uint8_t>& CofFile::getStoredData(const Layout& layout, size_t index) const {
+    const auto& payload = layout.payloads[index];
+    return payload.empty() ? sections[index]->getData() : payload;
+}
+
+CofFile::Layout CofFile::computeLayout() {
+    Layout layout;
+    layout.valid = true;
+    
+    // Compressed sizes decide where everything after the tables goes
+    compressSections(layout);
+    
+    // With tail merging, intern the longest names first so that shorter
+    // names can point into them
+    if (strings.isTailMerging()) {
+        std::vector<std::string_view> names;
+        names.reserve(sections.size() + symbols.size());
+        for (const auto& section : sections) {
+            names.push_back(section->getName());
+        }
+        for (const auto& symbol : symbols) {
+            names.push_back(symbol->getName());
+        }
+        
+        std::stable_sort(names.begin(), names.end(), [](std::string_view a, std::string_view b) {
+            return a.size() > b.size();
+        });
+        for (std::string_view name : names) {
+            addString(name);
+        }
+    }
+    
+    // Intern every name first so the string table is final before any
+    // offset that depends on its size is computed
+    std::vector<uint32_t> sectionNames;
+    sectionNames.reserve(sections.size());
+    for (const auto& section : sections) {
+        sectionNames.push_back(addString(section->getName()));
+    }
+    
+    layout.symbolNames.reserve(symbols.size());
+    for (const auto& symbol : symbols) {
+        layout.symbolNames.push_back(addString(symbol->getName()));
+    }
+    
     // Calculate offsets
-    uint32_t offset = header.header_size;
+    uint64_t offset = header.header_size;
     
     // Target table
-    header.target_table_offset = offset;
-    offset += static_cast<uint32_t>(targets.size() * sizeof(TargetEntry));
+    header.target_table_offset = static_cast<uint32_t>(offset);
+    offset += targets.size() * sizeof(TargetEntry);
     
     // Section table
-    header.section_table_offset = offset;
-    offset += static_cast<uint32_t>(sections.size() * sizeof(SectionEntry));
+    header.section_table_offset = static_cast<uint32_t>(offset);
+    offset += sections.size() * sizeof(SectionEntry);
     
     // Symbol table
-    header.symbol_table_offset = offset;
-    offset += static_cast<uint32_t>(symbols.size() * sizeof(SymbolEntry));
+    header.symbol_table_offset = static_cast<uint32_t>(offset);
+    offset += symbols.size() * sizeof(SymbolEntry);
     
-    // String table
-    header.string_table_offset = offset;
+    // String table; the table offsets are 32-bit and this one is the last
+    if (offset > UINT32_MAX) {
+        LOG_ERROR("Tables too large for a COF file: string table at offset {}", offset);
+        layout.valid = false;
+    }
+    header.string_table_offset = static_cast<uint32_t>(offset);
     offset += header.string_table_size;
     
     // Section data and relocations
-    for (auto& section : sections) {
+    layout.sectionEntries.reserve(sections.size());
+    for (size_t i = 0; i < sections.size(); i++) {
+        const Section& section = *sections[i];
+        
         // Align section data
-        offset = (offset + section->getAlignment() - 1) & ~(section->getAlignment() - 1);
+        uint64_t alignment = section.getAlignment() ? section.getAlignment() : 1;
+        offset = (offset + alignment - 1) / alignment * alignment;
         
-        // Update section offset and calculate relocation offset
         uint64_t sectionOffset = offset;
-        offset += static_cast<uint32_t>(section->getSize());
+        offset += getStoredData(layout, i).size();
+        
+        uint64_t relocOffset = offset;
+        offset += section.getRelocations().size() * sizeof(RelocationEntry);
         
-        uint32_t relocOffset = offset;
-        offset += static_cast<uint32_t>(section->getRelocations().size() * sizeof(RelocationEntry));
+        // Section entries only have room for a 32-bit relocation offset
+        if (relocOffset > UINT32_MAX) {
+            LOG_ERROR("Section {} ends beyond 4 GiB: relocation offset {} does not fit a COF file",
+                      section.getName(), relocOffset);
+            layout.valid = false;
+        }
         
-        // Update section entry
-        uint32_t nameOffset = addString(section->getName());
-        section->createEntry(nameOffset, sectionOffset, relocOffset);
+        SectionEntry entry = section.createEntry(sectionNames[i], sectionOffset, static_cast<uint32_t>(relocOffset));
+        if (!layout.payloads[i].empty()) {
+            entry.size = layout.payloads[i].size();
+            entry.flags |= SECTION_FLAG_COMPRESSED;
+        }
+        layout.sectionEntries.push_back(entry);
     }
+    
+    layout.fileSize = static_cast<size_t>(offset);
+    assignIdentity(layout);
+    return layout;
 }
 
-bool CofFile::write(const std::string& filename) {
-    // Update offsets and finalize sections
-    updateOffsets();
-    
-    // Open the output file
-    std::ofstream outFile(filename, std::ios::binary);
-    if (!outFile) {
-        LOG_ERROR("Failed to open output file: " + filename);
-        return false;
-    }
-    
+void CofFile::serializeTables(const Layout& layout, ByteWriter& writer) const {
     // Write the header
-    outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writer.writeBytes(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
     
     // Write the target table
-    for (const auto& target : targets) {
-        outFile.write(reinterpret_cast<const char*>(&target), sizeof(target));
-    }
+    writer.writeBytes(reinterpret_cast<const uint8_t*>(targets.data()), targets.size() * sizeof(TargetEntry));
     
     // Write the section table
-    for (const auto& section : sections) {
-        SectionEntry entry = section->createEntry(
-            addString(section->getName()),
-            0, // Will be updated in final write
-            0  // Will be updated in final write
-        );
-        outFile.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
-    }
+    writer.writeBytes(reinterpret_cast<const uint8_t*>(layout.sectionEntries.data()),
+                      layout.sectionEntries.size() * sizeof(SectionEntry));
     
     // Write the symbol table
-    for (const auto& symbol : symbols) {
-        SymbolEntry entry = symbol->createEntry(addString(symbol->getName()));
-        outFile.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+    for (size_t i = 0; i < symbols.size(); i++) {
+        SymbolEntry entry = symbols[i]->createEntry(layout.symbolNames[i]);
+        writer.writeBytes(reinterpret_cast<const uint8_t*>(&entry), sizeof(entry));
     }
     
     // Write the string table
-    outFile.write(reinterpret_cast<const char*>(stringTableData.data()), stringTableData.size());
+    writer.writeBytes(strings.getData().data(), strings.size());
+}
+
+CofFile::Layout CofFile::takeLayout() {
+    if (!finalLayout) {
+        return computeLayout();
+    }
+    
+    Layout layout = std::move(*finalLayout);
+    finalLayout.reset();
+    return layout;
+}
+
+void CofFile::finalize() {
+    finalLayout = std::make_unique<Layout>(computeLayout());
+}
+
+std::vector<uint8_t> CofFile::serialize() {
+    Layout layout = takeLayout();
+    if (!layout.valid) {
+        return {};
+    }
+    
+    std::vector<uint8_t> buffer;
+    buffer.reserve(layout.fileSize);
+    ByteWriter writer(buffer);
+    
+    serializeTables(layout, writer);
     
     // Write the section data and relocations
-    for (const auto& section : sections) {
-        // Align section data
-        std::streampos pos = outFile.tellp();
-        size_t padding = (section->getAlignment() - (pos % section->getAlignment())) % section->getAlignment();
-        for (size_t i = 0; i < padding; i++) {
-            outFile.put(0);
+    for (size_t i = 0; i < sections.size(); i++) {
+        // Pad up to the offset the layout gave the section
+        writer.writeZeros(layout.sectionEntries[i].offset - writer.size());
+        
+        const auto& data = getStoredData(layout, i);
+        writer.writeBytes(data.data(), data.size());
+        
+        const auto& relocations = sections[i]->getRelocations();
+        writer.writeBytes(reinterpret_cast<const uint8_t*>(relocations.data()),
+                          relocations.size() * sizeof(RelocationEntry));
+    }
+    
+    return buffer;
+}
+
+#ifndef _WIN32
+/**
+ * @brief Write a list of buffers to a file descriptor, resuming after short writes
+ * 
+ * @param fd File descriptor
+ * @param buffers Buffers to write (consumed)
+ * @return true if everything was written
+ */
+static bool writeBuffers(int fd, std::vector<iovec>& buffers) {
+    size_t next = 0;
+    while (next < buffers.size()) {
+        // Empty buffers are skipped so that writing nothing means no progress
+        if (buffers[next].iov_len == 0) {
+            next++;
+            continue;
         }
         
-        // Write section data
-        const auto& data = section->getData();
-        outFile.write(reinterpret_cast<const char*>(data.data()), data.size());
+        int count = static_cast<int>(std::min<size_t>(buffers.size() - next, IOV_MAX));
+        ssize_t written = ::writev(fd, buffers.data() + next, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("writev failed: {}", std::strerror(errno));
+            return false;
+        }
+        if (written == 0) {
+            // Retrying would spin forever; treat it like a failed short write
+            LOG_ERROR("writev made no progress with {} buffers left to write", buffers.size() - next);
+            return false;
+        }
         
-        // Write relocations
-        const auto& relocations = section->getRelocations();
-        for (const auto& relocation : relocations) {
-            outFile.write(reinterpret_cast<const char*>(&relocation), sizeof(relocation));
+        // Skip what was written, possibly stopping inside a buffer
+        size_t remaining = static_cast<size_t>(written);
+        while (next < buffers.size() && remaining >= buffers[next].iov_len) {
+            remaining -= buffers[next].iov_len;
+            next++;
+        }
+        if (remaining > 0) {
+            buffers[next].iov_base = static_cast<uint8_t*>(buffers[next].iov_base) + remaining;
+            buffers[next].iov_len -= remaining;
         }
     }
+    return true;
+}
+#endif
+
+bool CofFile::write(const std::string& filename) {
+#ifndef _WIN32
+    Layout layout = takeLayout();
+    if (!layout.valid) {
+        LOG_ERROR("Cannot write output file: {}", filename);
+        return false;
+    }
+    
+    // The tables go into one buffer; section data and relocations are
+    // written from where they already are, all in a single writev
+    std::vector<uint8_t> tables;
+    tables.reserve(header.string_table_offset + strings.size());
+    ByteWriter writer(tables);
+    serializeTables(layout, writer);
+    
+    // Padding before each section is written from one zero buffer, sized
+    // for the largest gap, so every gap is a single iovec
+    std::vector<size_t> padding(sections.size());
+    size_t maxPadding = 0;
+    uint64_t offset = tables.size();
+    for (size_t i = 0; i < sections.size(); i++) {
+        padding[i] = static_cast<size_t>(layout.sectionEntries[i].offset - offset);
+        maxPadding = std::max(maxPadding, padding[i]);
+        offset = layout.sectionEntries[i].offset + getStoredData(layout, i).size() +
+                 sections[i]->getRelocations().size() * sizeof(RelocationEntry);
+    }
+    std::vector<uint8_t> zeros(maxPadding);
+    
+    std::vector<iovec> buffers;
+    buffers.reserve(1 + sections.size() * 3);
+    buffers.push_back({ tables.data(), tables.size() });
+    
+    for (size_t i = 0; i < sections.size(); i++) {
+        const auto& data = getStoredData(layout, i);
+        const auto& relocations = sections[i]->getRelocations();
+        buffers.push_back({ zeros.data(), padding[i] });
+        buffers.push_back({ const_cast<uint8_t*>(data.data()), data.size() });
+        buffers.push_back({ const_cast<RelocationEntry*>(relocations.data()),
+                            relocations.size() * sizeof(RelocationEntry) });
+    }
+    
+    // Open the output file
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        LOG_ERROR("Failed to open output file: {}", filename);
+        return false;
+    }
+    
+    bool written = writeBuffers(fd, buffers);
+    
+    // Check for errors
+    if (::close(fd) != 0 || !written) {
+        LOG_ERROR("Error writing to output file: {}", filename);
+        return false;
+    }
+#else
+    std::vector<uint8_t> buffer = serialize();
+    
+    // Open the output file
+    std::ofstream outFile(filename, std::ios::binary);
+    if (!outFile) {
+        LOG_ERROR("Failed to open output file: {}", filename);
+        return false;
+    }
+    
+    outFile.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
     
     // Check for errors
     if (!outFile) {
-        LOG_ERROR("Error writing to output file: " + filename);
+        LOG_ERROR("Error writing to output file: {}", filename);
         return false;
     }
+#endif
     
     return true;
 }
 
 std::unique_ptr<CofFile> CofFile::read(const std::string& filename) {
-    // Open the input file
-    std::ifstream inFile(filename, std::ios::binary);
-    if (!inFile) {
-        LOG_ERROR("Failed to open input file: " + filename);
+    // Map and validate the file; everything below reads through the view
+    auto view = CofView::open(filename);
+    if (!view) {
         return nullptr;
     }
     
     // Create a new CofFile
     auto cof = std::make_unique<CofFile>();
-    
-    // Read the header
-    inFile.read(reinterpret_cast<char*>(&cof->header), sizeof(cof->header));
-    
-    // Check the magic number
-    if (cof->header.magic != COF_MAGIC) {
-        LOG_ERROR("Invalid COF file format");
-        return nullptr;
-    }
+    cof->header = view->getHeader();
+    cof->identityAssigned = true;
     
     // Read the target table
-    inFile.seekg(cof->header.target_table_offset);
-    cof->targets.resize(cof->header.target_count);
-    for (uint32_t i = 0; i < cof->header.target_count; i++) {
-        inFile.read(reinterpret_cast<char*>(&cof->targets[i]), sizeof(TargetEntry));
-    }
-    
-    // Read the section table
-    inFile.seekg(cof->header.section_table_offset);
-    std::vector<SectionEntry> sectionEntries(cof->header.section_count);
-    for (uint32_t i = 0; i < cof->header.section_count; i++) {
-        inFile.read(reinterpret_cast<char*>(&sectionEntries[i]), sizeof(SectionEntry));
+    cof->targets.reserve(view->getTargetCount());
+    for (size_t i = 0; i < view->getTargetCount(); i++) {
+        cof->targets.push_back(view->getTarget(i));
     }
     
-    // Read the symbol table
-    inFile.seekg(cof->header.symbol_table_offset);
-    std::vector<SymbolEntry> symbolEntries(cof->header.symbol_count);
-    for (uint32_t i = 0; i < cof->header.symbol_count; i++) {
-        inFile.read(reinterpret_cast<char*>(&symbolEntries[i]), sizeof(SymbolEntry));
-    }
-    
-    // Read the string table
-    inFile.seekg(cof->header.string_table_offset);
-    cof->stringTableData.resize(cof->header.string_table_size);
-    inFile.read(reinterpret_cast<char*>(cof->stringTableData.data()), cof->header.string_table_size);
-    
-    // Build the string table map
-    for (uint32_t i = 0; i < cof->header.string_table_size; ) {
-        const char* str = reinterpret_cast<const char*>(cof->stringTableData.data() + i);
-        std::string strObj(str);
-        cof->stringTable[strObj] = i;
-        i += static_cast<uint32_t>(strObj.size() + 1); // Include null terminator
-    }
+    // Read the string table; every string in it is indexed, so names
+    // already present are not added again when the file is written
+    const uint8_t* stringData = reinterpret_cast<const uint8_t*>(view->getString(0).data());
+    cof->strings.assign(stringData, cof->header.string_table_size);
+    cof->header.string_table_size = static_cast<uint32_t>(cof->strings.size());
     
     // Create sections
-    for (uint32_t i = 0; i < cof->header.section_count; i++) {
-        const SectionEntry& entry = sectionEntries[i];
-        
-        // Get the section name
-        const char* namePtr = reinterpret_cast<const char*>(cof->stringTableData.data() + entry.name_offset);
-        std::string name(namePtr);
+    cof->sections.reserve(view->getSectionCount());
+    for (size_t i = 0; i < view->getSectionCount(); i++) {
+        SectionEntry entry = view->getSection(i);
         
-        // Create the section
-        auto section = std::make_unique<Section>(name, entry.type, entry.flags, entry.target_id, entry.alignment);
+        // Create the section; its data is kept uncompressed in memory and
+        // compressed the same way again when the file is written
+        auto section = std::make_unique<Section>(std::string(view->getSectionName(i)), entry.type,
+                                                 entry.flags & ~SECTION_FLAG_COMPRESSED, entry.target_id,
+                                                 entry.alignment);
         section->setAddress(entry.address);
         
-        // Read section data
-        if (entry.size > 0) {
-            std::vector<uint8_t> data(entry.size);
-            inFile.seekg(entry.offset);
-            inFile.read(reinterpret_cast<char*>(data.data()), entry.size);
-            section->addData(data);
+        if (entry.flags & SECTION_FLAG_COMPRESSED) {
+            CompressionHeader compression;
+            ByteSpan stored = view->getStoredSectionData(i);
+            Compression::readHeader(stored.data, stored.size, compression);
+            section->setCompression(compression.type);
+        }
+        
+        // A BSS section has nothing stored to copy
+        if (entry.type == SECTION_BSS) {
+            section->fillZero(static_cast<size_t>(entry.size));
+        }
+        
+        // Copy the section data
+        ByteSpan data = view->getSectionData(i);
+        if (data.empty() && entry.type != SECTION_BSS && view->getSectionSize(i) > 0) {
+            LOG_ERROR("Failed to decompress section: {}", section->getName());
+            return nullptr;
+        }
+        if (!data.empty()) {
+            section->addData(std::vector<uint8_t>(data.begin(), data.end()));
         }
         
         // Read relocations
-        if (entry.relocation_count > 0) {
-            inFile.seekg(entry.relocation_offset);
-            for (uint32_t j = 0; j < entry.relocation_count; j++) {
-                RelocationEntry reloc;
-                inFile.read(reinterpret_cast<char*>(&reloc), sizeof(reloc));
-                section->addRelocation(reloc.offset, reloc.symbol_index, reloc.type, reloc.addend, reloc.target_id);
-            }
+        for (uint32_t j = 0; j < entry.relocation_count; j++) {
+            RelocationEntry reloc = view->getRelocation(i, j);
+            section->addRelocation(reloc.offset, reloc.symbol_index, reloc.type, reloc.addend, reloc.target_id);
         }
         
         cof->sections.push_back(std::move(section));
     }
     
     // Create symbols
-    for (uint32_t i = 0; i < cof->header.symbol_count; i++) {
-        const SymbolEntry& entry = symbolEntries[i];
-        
-        // Get the symbol name
-        const char* namePtr = reinterpret_cast<const char*>(cof->stringTableData.data() + entry.name_offset);
-        std::string name(namePtr);
+    cof->symbols.reserve(view->getSymbolCount());
+    for (size_t i = 0; i < view->getSymbolCount(); i++) {
+        SymbolEntry entry = view->getSymbol(i);
         
         // Create the symbol
-        auto symbol = std::make_unique<Symbol>(name, entry.section_index, entry.value, entry.size, entry.type, entry.flags, entry.target_id);
+        auto symbol = std::make_unique<Symbol>(std::string(view->getSymbolName(i)), entry.section_index, entry.value,
+                                               entry.size, entry.type, entry.flags, entry.target_id);
+        cof->symbolIndex.add(symbol->getName(), static_cast<uint32_t>(i));
         cof->symbols.push_back(std::move(symbol));
     }
     
@@ -5,13 +5,17 @@
 #include <vector>
 #include <string>
 #include <memory>
-#include <map>
+#include <string_view>
 #include "core/defs.h"
 #include "binary/section.h"
 #include "binary/symbol.h"
+#include "binary/string_table.h"
+#include "binary/symbol_index.h"
 
 namespace coil {
 
+class ThreadPool;
+
 // Magic number for COF files ("COIL")
 constexpr uint32_t COF_MAGIC = 0x434F494C;
 
@@ -19,6 +23,9 @@ constexpr uint32_t COF_MAGIC = 0x434F494C;
 constexpr uint16_t COF_VERSION_MAJOR = 1;
 constexpr uint16_t COF_VERSION_MINOR = 0;
 
+// Header flags
+constexpr uint32_t COF_FLAG_COMPACT_ENCODING = 0x00000001; // Code sections use ENCODING_COMPACT
+
 /**
  * @brief COIL Object Format header
  */
@@ -64,11 +71,34 @@ private:
     std::vector<TargetEntry> targets;
     std::vector<std::unique_ptr<Section>> sections;
     std::vector<std::unique_ptr<Symbol>> symbols;
-    std::map<std::string, uint32_t> stringTable;
-    std::vector<uint8_t> stringTableData;
+    SymbolIndex symbolIndex;     // Symbol name -> index
+    StringTable strings;         // Interned names
+    size_t compressionJobs;      // Threads to compress sections on when writing
+    ThreadPool* compressionPool; // Pool to compress sections on (nullptr to start one)
+    bool deterministic;          // Derive the UUID from the contents
+    uint64_t fixedTimestamp;     // Timestamp recorded when deterministic
+    bool identityAssigned;       // true once the header has a UUID and timestamp
+    
+    /**
+     * @brief File layout computed before serializing
+     */
+    struct Layout {
+        std::vector<SectionEntry> sectionEntries; // Section table, offsets filled in
+        std::vector<uint32_t> symbolNames;        // Name offset of each symbol
+        std::vector<std::vector<uint8_t>> payloads; // Compressed section data (empty if stored as is)
+        size_t fileSize;                          // Total size of the file
+        bool valid;                               // false if an offset does not fit its 32-bit field
+    };
+    
+    std::unique_ptr<Layout> finalLayout; // Layout from finalize(), taken by the next write
     
     // Utility methods
-    void updateOffsets();
+    Layout computeLayout();
+    Layout takeLayout();
+    void assignIdentity(const Layout& layout);
+    void compressSections(Layout& layout) const;
+    void serializeTables(const Layout& layout, ByteWriter& writer) const;
+    const std::vector<uint8_t>& getStoredData(const Layout& layout, size_t index) const;
 
 public:
     /**
@@ -86,6 +116,22 @@ public:
      */
     uint32_t addTarget(uint32_t archType, uint32_t features, const std::string& name);
     
+    /**
+     * @brief Get a target architecture by index
+     * 
+     * @param index Target index (the target ID minus one)
+     * @return Target entry
+     */
+    const TargetEntry& getTarget(size_t index) const;
+    
+    /**
+     * @brief Get a string from the string table
+     * 
+     * @param offset Offset of the string
+     * @return The string, or an empty string if the offset is out of range
+     */
+    std::string_view getString(uint32_t offset) const;
+    
     /**
      * @brief Add a section
      * 
@@ -118,7 +164,19 @@ public:
      * @param str String to add
      * @return Offset to the string in the string table
      */
-    uint32_t addString(const std::string& str);
+    uint32_t addString(std::string_view str);
+    
+    /**
+     * @brief Enable or disable tail merging in the string table
+     * 
+     * With tail merging, a name that is the suffix of another name is
+     * stored as a pointer into the longer one. Section and symbol names
+     * are interned longest first when the file is laid out, so they share
+     * as much as possible. Strings already in the table are not moved.
+     * 
+     * @param merge Enable tail merging
+     */
+    void setStringMerging(bool merge);
     
     /**
      * @brief Get a section by index
@@ -144,6 +202,112 @@ public:
      */
     Symbol* getSymbolByName(const std::string& name);
     
+    /**
+     * @brief Get all symbols
+     * 
+     * @return Vector of symbols
+     */
+    const std::vector<std::unique_ptr<Symbol>>& getSymbols() const;
+    
+    /**
+     * @brief Get the index over the symbol names
+     * 
+     * @return Symbol index
+     */
+    const SymbolIndex& getSymbolIndex() const;
+    
+    /**
+     * @brief Add a hash section indexing the current symbol table
+     * 
+     * Lets readers such as CofView look symbols up by name without
+     * building an index first. Call it after the last symbol is added.
+     * 
+     * @return Reference to the new section
+     */
+    Section& addHashSection();
+    
+    /**
+     * @brief Compress the contents of every section when writing
+     * 
+     * Applies to the sections added so far, except for hash sections
+     * (which readers use in place) and sections without data. Use
+     * Section::setCompression to pick a format per section.
+     * 
+     * @param type Compression format (COMPRESSION_NONE to store as is)
+     * @param level Compression level (0 for the format's default)
+     * @return true if the format is supported, false otherwise
+     */
+    bool setCompression(uint32_t type, int level = 0);
+    
+    /**
+     * @brief Set how many threads compress sections when writing
+     * 
+     * @param jobs Number of threads (0 picks one per hardware thread)
+     */
+    void setCompressionJobs(size_t jobs);
+    
+    /**
+     * @brief Compress sections on an existing pool rather than starting one
+     * 
+     * @param pool Thread pool (must outlive the next write), or nullptr
+     */
+    void setCompressionPool(ThreadPool* pool);
+    
+    /**
+     * @brief Record the encoding the code sections are in
+     * 
+     * Sets or clears COF_FLAG_COMPACT_ENCODING; the instructions
+     * themselves must be encoded with the same encoding.
+     * 
+     * @param encoding Instruction encoding
+     */
+    void setInstructionEncoding(InstructionEncoding encoding);
+    
+    /**
+     * @brief Get the encoding the code sections are in
+     * 
+     * @return Instruction encoding
+     */
+    InstructionEncoding getInstructionEncoding() const;
+    
+    /**
+     * @brief Make the header depend only on the contents of the file
+     * 
+     * By default a file gets a random (version 4) UUID and the current
+     * time when it is first laid out. A deterministic file instead gets a
+     * UUID derived from a hash of its targets, sections and symbols, and
+     * the given timestamp, so identical inputs give identical bytes.
+     * 
+     * @param enable Enable deterministic output
+     * @param timestamp Timestamp to record (e.g. from SOURCE_DATE_EPOCH)
+     */
+    void setDeterministic(bool enable, uint64_t timestamp = 0);
+    
+    /**
+     * @brief Check if the header depends only on the contents of the file
+     * 
+     * @return true if deterministic
+     */
+    bool isDeterministic() const;
+    
+    /**
+     * @brief Get the file header
+     * 
+     * The UUID and timestamp are assigned by finalize(), serialize() or
+     * write(); until then, both are zero unless the file was read.
+     * 
+     * @return File header
+     */
+    const CofHeader& getHeader() const;
+    
+    /**
+     * @brief Read the timestamp reproducible builds ask for
+     * 
+     * @param timestamp Seconds since the epoch from SOURCE_DATE_EPOCH (output)
+     * @return true if SOURCE_DATE_EPOCH is set to a valid value
+     */
+    static bool getSourceDateEpoch(uint64_t& timestamp);
+    
     /**
      * @brief Set the entry point
      * 
@@ -172,9 +336,33 @@ public:
      */
     size_t getTargetCount() const;
     
+    /**
+     * @brief Serialize the COF file into memory
+     * 
+     * Sections are compressed first, then every offset is computed up
+     * front, so the file is built in a single buffer of exactly the right
+     * size.
+     * 
+     * @return File contents, or an empty buffer if an offset does not fit
+     *         the format
+     */
+    std::vector<uint8_t> serialize();
+    
+    /**
+     * @brief Compress the sections and compute the layout ahead of writing
+     * 
+     * Optional: the next serialize() or write() picks up the result
+     * instead of doing the work itself, so the file must not change in
+     * between.
+     */
+    void finalize();
+    
     /**
      * @brief Write the COF file to disk
      * 
+     * The layout is computed first and the whole file is then written
+     * with a single vectored write.
+     * 
      * @param filename Output filename
      * @return true if successful, false otherwise
      */
@@ -183,6 +371,9 @@ public:
     /**
      * @brief Read a COF file from disk
      * 
+     * The whole file is decoded into an editable CofFile; use CofView to
+     * inspect a file without copying it.
+     * 
      * @param filename Input filename
      * @return CofFile object, or nullptr if failed
      */
@@ -0,0 +1,283 @@
+#include "binary/cof_view.h"
+#include "binary/compression.h"
+#include "util/logger.h"
+#include <cstring>
+
+namespace coil {
+
+/**
+ * @brief Check that a table lies inside the file
+ *
+ * @param offset Table offset
+ * @param count Number of entries
+ * @param entrySize Size of one entry
+ * @param fileSize Size of the file
+ * @return true if the whole table is inside the file
+ */
+static bool tableInBounds(uint64_t offset, uint64_t count, uint64_t entrySize, uint64_t fileSize) {
+    // Counts are 32-bit and entries small, so this cannot overflow
+    return offset <= fileSize && count * entrySize <= fileSize - offset;
+}
+
+/**
+ * @brief Read a little-endian 32-bit value
+ *
+ * @param bytes First byte
+ * @return Value
+ */
+static uint32_t readU32(const uint8_t* bytes) {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+CofView::CofView()
+    : data(nullptr), size(0), hashBuckets(0) {
+    std::memset(&header, 0, sizeof(header));
+}
+
+std::unique_ptr<CofView> CofView::open(const std::string& filename) {
+    auto file = MappedFile::open(filename);
+    if (!file) {
+        LOG_ERROR("Failed to open input file: {}", filename);
+        return nullptr;
+    }
+
+    std::unique_ptr<CofView> view(new CofView());
+    view->data = reinterpret_cast<const uint8_t*>(file->getData());
+    view->size = file->getSize();
+    view->file = std::move(file);
+
+    if (!view->validate()) {
+        LOG_ERROR("Invalid COF file: {}", filename);
+        return nullptr;
+    }
+
+    return view;
+}
+
+std::unique_ptr<CofView> CofView::fromBuffer(const uint8_t* bytes, size_t count) {
+    std::unique_ptr<CofView> view(new CofView());
+    view->data = bytes;
+    view->size = count;
+
+    if (!view->validate()) {
+        LOG_ERROR("Invalid COF data");
+        return nullptr;
+    }
+
+    return view;
+}
+
+bool CofView::validate() {
+    // Header
+    if (size < sizeof(CofHeader)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+
+    if (header.magic != COF_MAGIC || header.version_major > COF_VERSION_MAJOR) {
+        return false;
+    }
+    if (header.header_size < sizeof(CofHeader) || header.header_size > size) {
+        return false;
+    }
+
+    // Tables
+    if (!tableInBounds(header.target_table_offset, header.target_count, sizeof(TargetEntry), size) ||
+        !tableInBounds(header.section_table_offset, header.section_count, sizeof(SectionEntry), size) ||
+        !tableInBounds(header.symbol_table_offset, header.symbol_count, sizeof(SymbolEntry), size) ||
+        !tableInBounds(header.string_table_offset, header.string_table_size, 1, size)) {
+        return false;
+    }
+
+    // Every string must be terminated inside the table
+    if (header.string_table_size > 0 && data[header.string_table_offset + header.string_table_size - 1] != 0) {
+        return false;
+    }
+
+    // Section contents and relocations
+    for (size_t i = 0; i < header.section_count; i++) {
+        SectionEntry entry = getSection(i);
+        if (!tableInBounds(entry.relocation_offset, entry.relocation_count, sizeof(RelocationEntry), size)) {
+            return false;
+        }
+
+        // A BSS section only has a size; nothing of it is stored
+        if (entry.type == SECTION_BSS) {
+            if (entry.flags & SECTION_FLAG_COMPRESSED) {
+                return false;
+            }
+            continue;
+        }
+        if (!tableInBounds(entry.offset, entry.size, 1, size)) {
+            return false;
+        }
+
+        // Compressed data starts with its header
+        CompressionHeader compression;
+        if ((entry.flags & SECTION_FLAG_COMPRESSED) &&
+            !Compression::readHeader(data + entry.offset, static_cast<size_t>(entry.size), compression)) {
+            return false;
+        }
+
+        // Use the first hash section that covers the whole symbol table
+        if (entry.type == SECTION_HASH && !(entry.flags & SECTION_FLAG_COMPRESSED) && hashTable.empty() &&
+            entry.size >= sizeof(SymbolHashHeader)) {
+            const uint8_t* table = data + entry.offset;
+            uint32_t buckets = readU32(table);
+            uint32_t symbols = readU32(table + 4);
+            uint64_t needed = sizeof(SymbolHashHeader) + (static_cast<uint64_t>(buckets) + symbols) * 4;
+
+            if (buckets > 0 && symbols == header.symbol_count && needed <= entry.size) {
+                hashTable = ByteSpan(table, static_cast<size_t>(needed));
+                hashBuckets = buckets;
+            }
+        }
+    }
+
+    decompressed.resize(header.section_count);
+    return true;
+}
+
+template <typename T>
+T CofView::readEntry(uint64_t offset) const {
+    // Entries are not necessarily aligned in the file
+    T entry;
+    std::memcpy(&entry, data + offset, sizeof(T));
+    return entry;
+}
+
+const CofHeader& CofView::getHeader() const {
+    return header;
+}
+
+InstructionEncoding CofView::getInstructionEncoding() const {
+    return (header.flags & COF_FLAG_COMPACT_ENCODING) ? ENCODING_COMPACT : ENCODING_STANDARD;
+}
+
+size_t CofView::getTargetCount() const {
+    return header.target_count;
+}
+
+size_t CofView::getSectionCount() const {
+    return header.section_count;
+}
+
+size_t CofView::getSymbolCount() const {
+    return header.symbol_count;
+}
+
+TargetEntry CofView::getTarget(size_t index) const {
+    return readEntry<TargetEntry>(header.target_table_offset + index * sizeof(TargetEntry));
+}
+
+SectionEntry CofView::getSection(size_t index) const {
+    return readEntry<SectionEntry>(header.section_table_offset + index * sizeof(SectionEntry));
+}
+
+SymbolEntry CofView::getSymbol(size_t index) const {
+    return readEntry<SymbolEntry>(header.symbol_table_offset + index * sizeof(SymbolEntry));
+}
+
+std::string_view CofView::getString(uint32_t offset) const {
+    if (offset >= header.string_table_size) {
+        return std::string_view();
+    }
+
+    // validate() checked that the table ends with a terminator
+    const char* str = reinterpret_cast<const char*>(data + header.string_table_offset + offset);
+    return std::string_view(str, std::strlen(str));
+}
+
+std::string_view CofView::getSectionName(size_t index) const {
+    return getString(getSection(index).name_offset);
+}
+
+std::string_view CofView::getSymbolName(size_t index) const {
+    return getString(getSymbol(index).name_offset);
+}
+
+ByteSpan CofView::getSectionData(size_t index) const {
+    SectionEntry entry = getSection(index);
+    if (entry.type == SECTION_BSS) {
+        return ByteSpan();
+    }
+    if (!(entry.flags & SECTION_FLAG_COMPRESSED)) {
+        return ByteSpan(data + entry.offset, static_cast<size_t>(entry.size));
+    }
+
+    std::lock_guard<std::mutex> lock(decompressMutex);
+    auto& contents = decompressed[index];
+    if (!contents) {
+        auto buffer = std::make_unique<std::vector<uint8_t>>();
+        if (!Compression::decompress(data + entry.offset, static_cast<size_t>(entry.size), *buffer)) {
+            LOG_ERROR("Failed to decompress section {}", getSectionName(index));
+            return ByteSpan();
+        }
+        contents = std::move(buffer);
+    }
+    return ByteSpan(contents->data(), contents->size());
+}
+
+ByteSpan CofView::getStoredSectionData(size_t index) const {
+    SectionEntry entry = getSection(index);
+    if (entry.type == SECTION_BSS) {
+        return ByteSpan();
+    }
+    return ByteSpan(data + entry.offset, static_cast<size_t>(entry.size));
+}
+
+uint64_t CofView::getSectionSize(size_t index) const {
+    SectionEntry entry = getSection(index);
+    if (!(entry.flags & SECTION_FLAG_COMPRESSED)) {
+        return entry.size;
+    }
+
+    // validate() checked the header
+    CompressionHeader compression;
+    Compression::readHeader(data + entry.offset, static_cast<size_t>(entry.size), compression);
+    return compression.size;
+}
+
+bool CofView::isSectionCompressed(size_t index) const {
+    return (getSection(index).flags & SECTION_FLAG_COMPRESSED) != 0;
+}
+
+RelocationEntry CofView::getRelocation(size_t sectionIndex, size_t index) const {
+    SectionEntry entry = getSection(sectionIndex);
+    return readEntry<RelocationEntry>(entry.relocation_offset + index * sizeof(RelocationEntry));
+}
+
+bool CofView::hasHashSection() const {
+    return !hashTable.empty();
+}
+
+bool CofView::findSymbol(std::string_view name, size_t& index) const {
+    if (!hashTable.empty()) {
+        const uint8_t* buckets = hashTable.data + sizeof(SymbolHashHeader);
+        const uint8_t* chains = buckets + static_cast<size_t>(hashBuckets) * 4;
+
+        uint32_t entry = readU32(buckets + (SymbolIndex::hash(name) % hashBuckets) * 4);
+
+        // A well-formed chain visits each symbol at most once
+        for (size_t steps = 0; entry != 0 && entry <= header.symbol_count && steps < header.symbol_count; steps++) {
+            if (getSymbolName(entry - 1) == name) {
+                index = entry - 1;
+                return true;
+            }
+            entry = readU32(chains + (entry - 1) * 4);
+        }
+
+        return false;
+    }
+
+    for (size_t i = 0; i < header.symbol_count; i++) {
+        if (getSymbolName(i) == name) {
+            index = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+} // namespace coil
@@ -0,0 +1,234 @@
+#ifndef COIL_BINARY_COF_VIEW_H
+#define COIL_BINARY_COF_VIEW_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "binary/cof.h"
+#include "binary/symbol_index.h"
+#include "util/mapped_file.h"
+
+namespace coil {
+
+/**
+ * @brief Read-only view of a range of bytes
+ */
+struct ByteSpan {
+    const uint8_t* data;  // First byte
+    size_t size;          // Number of bytes
+
+    ByteSpan() : data(nullptr), size(0) {}
+    ByteSpan(const uint8_t* bytes, size_t count) : data(bytes), size(count) {}
+
+    bool empty() const { return size == 0; }
+    const uint8_t* begin() const { return data; }
+    const uint8_t* end() const { return data + size; }
+};
+
+/**
+ * @brief Read-only, lazily decoded view of a COF file
+ *
+ * Unlike CofFile::read, nothing is copied when the file is opened: the
+ * file is memory-mapped, the header and table bounds are checked once,
+ * and table entries, names and section contents are decoded only when
+ * they are asked for. Spans and string views point into the mapping and
+ * stay valid for as long as the view is alive.
+ *
+ * Compressed sections are decompressed the first time their contents
+ * are asked for, and the result is kept for the lifetime of the view.
+ */
+class CofView {
+private:
+    std::unique_ptr<MappedFile> file; // Mapped file (null for borrowed buffers)
+    const uint8_t* data;              // Start of the file contents
+    size_t size;                      // Size of the file contents
+    CofHeader header;                 // Copy of the validated header
+    ByteSpan hashTable;               // Hash section contents (empty if none)
+    uint32_t hashBuckets;             // Number of buckets in the hash section
+    mutable std::mutex decompressMutex; // Guards decompressed
+    mutable std::vector<std::unique_ptr<std::vector<uint8_t>>> decompressed; // Contents of compressed sections, once read
+
+    CofView();
+
+    bool validate();
+
+    template <typename T>
+    T readEntry(uint64_t offset) const;
+
+public:
+    CofView(const CofView&) = delete;
+    CofView& operator=(const CofView&) = delete;
+
+    /**
+     * @brief Open and validate a COF file
+     *
+     * @param filename File to open
+     * @return View of the file, or nullptr if it cannot be read or is malformed
+     */
+    static std::unique_ptr<CofView> open(const std::string& filename);
+
+    /**
+     * @brief Validate a COF file that is already in memory
+     *
+     * @param bytes File contents (must outlive the view)
+     * @param count Size of the contents
+     * @return View of the contents, or nullptr if they are malformed
+     */
+    static std::unique_ptr<CofView> fromBuffer(const uint8_t* bytes, size_t count);
+
+    /**
+     * @brief Get the file header
+     *
+     * @return File header
+     */
+    const CofHeader& getHeader() const;
+
+    /**
+     * @brief Get the encoding the code sections are in
+     *
+     * @return Instruction encoding (see COF_FLAG_COMPACT_ENCODING)
+     */
+    InstructionEncoding getInstructionEncoding() const;
+
+    /**
+     * @brief Get number of targets
+     *
+     * @return Number of targets
+     */
+    size_t getTargetCount() const;
+
+    /**
+     * @brief Get number of sections
+     *
+     * @return Number of sections
+     */
+    size_t getSectionCount() const;
+
+    /**
+     * @brief Get number of symbols
+     *
+     * @return Number of symbols
+     */
+    size_t getSymbolCount() const;
+
+    /**
+     * @brief Get a target entry
+     *
+     * @param index Target index (must be less than getTargetCount())
+     * @return Target entry
+     */
+    TargetEntry getTarget(size_t index) const;
+
+    /**
+     * @brief Get a section table entry
+     *
+     * @param index Section index (must be less than getSectionCount())
+     * @return Section entry
+     */
+    SectionEntry getSection(size_t index) const;
+
+    /**
+     * @brief Get a symbol table entry
+     *
+     * @param index Symbol index (must be less than getSymbolCount())
+     * @return Symbol entry
+     */
+    SymbolEntry getSymbol(size_t index) const;
+
+    /**
+     * @brief Get a string from the string table
+     *
+     * @param offset Offset into the string table
+     * @return String, or an empty view if the offset is out of range
+     */
+    std::string_view getString(uint32_t offset) const;
+
+    /**
+     * @brief Get the name of a section
+     *
+     * @param index Section index
+     * @return Section name
+     */
+    std::string_view getSectionName(size_t index) const;
+
+    /**
+     * @brief Get the name of a symbol
+     *
+     * @param index Symbol index
+     * @return Symbol name
+     */
+    std::string_view getSymbolName(size_t index) const;
+
+    /**
+     * @brief Get the contents of a section
+     *
+     * A compressed section is decompressed on first access; this is safe
+     * to call from several threads.
+     *
+     * @param index Section index
+     * @return Section data, or an empty span for a BSS section or if it cannot
+     *         be decompressed
+     */
+    ByteSpan getSectionData(size_t index) const;
+
+    /**
+     * @brief Get the bytes of a section as stored in the file
+     *
+     * @param index Section index
+     * @return Stored data, starting with a CompressionHeader if the
+     *         section is compressed
+     */
+    ByteSpan getStoredSectionData(size_t index) const;
+
+    /**
+     * @brief Get the size of a section's contents without decompressing it
+     *
+     * @param index Section index
+     * @return Uncompressed size
+     */
+    uint64_t getSectionSize(size_t index) const;
+
+    /**
+     * @brief Check if a section is stored compressed
+     *
+     * @param index Section index
+     * @return true if the section has SECTION_FLAG_COMPRESSED
+     */
+    bool isSectionCompressed(size_t index) const;
+
+    /**
+     * @brief Get a relocation of a section
+     *
+     * @param sectionIndex Section index
+     * @param index Relocation index (must be less than the section's relocation count)
+     * @return Relocation entry
+     */
+    RelocationEntry getRelocation(size_t sectionIndex, size_t index) const;
+
+    /**
+     * @brief Check if the file has a symbol hash section
+     *
+     * @return true if findSymbol can use the hash section
+     */
+    bool hasHashSection() const;
+
+    /**
+     * @brief Find a symbol by name
+     *
+     * Uses the hash section when the file has one, otherwise scans the
+     * symbol table.
+     *
+     * @param name Symbol name
+     * @param index Symbol index (output parameter)
+     * @return true if found, false otherwise
+     */
+    bool findSymbol(std::string_view name, size_t& index) const;
+};
+
+} // namespace coil
+
+#endif // COIL_BINARY_COF_VIEW_H
@@ -0,0 +1,221 @@
+#include "binary/compression.h"
+#include <cstring>
+#include <exception>
+
+#ifdef COIL_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef COIL_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef COIL_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+namespace coil {
+
+/**
+ * @brief Check that compressed data could expand to the size in its header
+ *
+ * Lets a corrupt header be rejected before its size is allocated.
+ *
+ * @param header Compression header
+ * @param payload Compressed bytes
+ * @param payloadSize Number of compressed bytes
+ * @return true if the size is possible for the format
+ */
+static bool plausibleSize(const CompressionHeader& header, const uint8_t* payload, size_t payloadSize) {
+    switch (header.type) {
+#ifdef COIL_HAVE_ZLIB
+        case COMPRESSION_ZLIB:
+            // Deflate expands at most about 1032:1
+            return header.size <= static_cast<uint64_t>(payloadSize) * 1032;
+#endif
+#ifdef COIL_HAVE_ZSTD
+        case COMPRESSION_ZSTD:
+            // ZSTD_compress records the content size in the frame
+            return ZSTD_getFrameContentSize(payload, payloadSize) == header.size;
+#endif
+#ifdef COIL_HAVE_LZ4
+        case COMPRESSION_LZ4:
+            // LZ4 expands at most 255:1 and works on int-sized blocks
+            return header.size <= static_cast<uint64_t>(LZ4_MAX_INPUT_SIZE) &&
+                   payloadSize <= static_cast<size_t>(INT32_MAX) &&
+                   header.size <= static_cast<uint64_t>(payloadSize) * 255 + 16;
+#endif
+        default:
+            (void)payload;
+            (void)payloadSize;
+            return false;
+    }
+}
+
+bool Compression::isSupported(uint32_t type) {
+    switch (type) {
+#ifdef COIL_HAVE_ZLIB
+        case COMPRESSION_ZLIB: return true;
+#endif
+#ifdef COIL_HAVE_ZSTD
+        case COMPRESSION_ZSTD: return true;
+#endif
+#ifdef COIL_HAVE_LZ4
+        case COMPRESSION_LZ4:  return true;
+#endif
+        default:               return false;
+    }
+}
+
+const char* Compression::getName(uint32_t type) {
+    switch (type) {
+        case COMPRESSION_NONE: return "none";
+        case COMPRESSION_ZLIB: return "zlib";
+        case COMPRESSION_ZSTD: return "zstd";
+        case COMPRESSION_LZ4:  return "lz4";
+        default:               return "unknown";
+    }
+}
+
+bool Compression::lookup(std::string_view name, uint32_t& type) {
+    static const uint32_t types[] = { COMPRESSION_NONE, COMPRESSION_ZLIB, COMPRESSION_ZSTD, COMPRESSION_LZ4 };
+    for (uint32_t candidate : types) {
+        if (name == getName(candidate)) {
+            type = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Compression::compress(uint32_t type, int level, const uint8_t* data, size_t size, std::vector<uint8_t>& output) {
+    if (!isSupported(type)) {
+        return false;
+    }
+
+    CompressionHeader header;
+    header.type = type;
+    header.reserved = 0;
+    header.size = size;
+
+    size_t capacity = 0;
+    switch (type) {
+#ifdef COIL_HAVE_ZLIB
+        case COMPRESSION_ZLIB: capacity = compressBound(static_cast<uLong>(size)); break;
+#endif
+#ifdef COIL_HAVE_ZSTD
+        case COMPRESSION_ZSTD: capacity = ZSTD_compressBound(size); break;
+#endif
+#ifdef COIL_HAVE_LZ4
+        case COMPRESSION_LZ4:
+            if (size > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+                return false;
+            }
+            capacity = static_cast<size_t>(LZ4_compressBound(static_cast<int>(size)));
+            break;
+#endif
+        default:
+            return false;
+    }
+
+    output.resize(sizeof(header) + capacity);
+    std::memcpy(output.data(), &header, sizeof(header));
+    uint8_t* payload = output.data() + sizeof(header);
+    size_t compressedSize = 0;
+
+    switch (type) {
+#ifdef COIL_HAVE_ZLIB
+        case COMPRESSION_ZLIB: {
+            uLongf length = static_cast<uLongf>(capacity);
+            if (compress2(payload, &length, data, static_cast<uLong>(size),
+                          level > 0 ? level : Z_DEFAULT_COMPRESSION) != Z_OK) {
+                return false;
+            }
+            compressedSize = length;
+            break;
+        }
+#endif
+#ifdef COIL_HAVE_ZSTD
+        case COMPRESSION_ZSTD: {
+            size_t result = ZSTD_compress(payload, capacity, data, size, level);
+            if (ZSTD_isError(result)) {
+                return false;
+            }
+            compressedSize = result;
+            break;
+        }
+#endif
+#ifdef COIL_HAVE_LZ4
+        case COMPRESSION_LZ4: {
+            // For LZ4 the level is the acceleration; higher is faster
+            int result = LZ4_compress_fast(reinterpret_cast<const char*>(data), reinterpret_cast<char*>(payload),
+                                           static_cast<int>(size), static_cast<int>(capacity), level > 0 ? level : 1);
+            if (result <= 0) {
+                return false;
+            }
+            compressedSize = static_cast<size_t>(result);
+            break;
+        }
+#endif
+        default:
+            return false;
+    }
+
+    output.resize(sizeof(header) + compressedSize);
+    return true;
+}
+
+bool Compression::readHeader(const uint8_t* data, size_t size, CompressionHeader& header) {
+    if (size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    return header.type != COMPRESSION_NONE && header.reserved == 0;
+}
+
+bool Compression::decompress(const uint8_t* data, size_t size, std::vector<uint8_t>& output) {
+    CompressionHeader header;
+    if (!readHeader(data, size, header) || !isSupported(header.type)) {
+        return false;
+    }
+
+    const uint8_t* payload = data + sizeof(header);
+    size_t payloadSize = size - sizeof(header);
+
+    if (!plausibleSize(header, payload, payloadSize)) {
+        return false;
+    }
+
+    // A corrupt size could still ask for more memory than there is
+    try {
+        output.resize(static_cast<size_t>(header.size));
+    } catch (const std::exception&) {
+        return false;
+    }
+
+    switch (header.type) {
+#ifdef COIL_HAVE_ZLIB
+        case COMPRESSION_ZLIB: {
+            uLongf length = static_cast<uLongf>(header.size);
+            return uncompress(output.data(), &length, payload, static_cast<uLong>(payloadSize)) == Z_OK &&
+                   length == header.size;
+        }
+#endif
+#ifdef COIL_HAVE_ZSTD
+        case COMPRESSION_ZSTD: {
+            size_t result = ZSTD_decompress(output.data(), output.size(), payload, payloadSize);
+            return !ZSTD_isError(result) && result == header.size;
+        }
+#endif
+#ifdef COIL_HAVE_LZ4
+        case COMPRESSION_LZ4: {
+            int result = LZ4_decompress_safe(reinterpret_cast<const char*>(payload),
+                                             reinterpret_cast<char*>(output.data()),
+                                             static_cast<int>(payloadSize), static_cast<int>(header.size));
+            return result >= 0 && static_cast<uint64_t>(result) == header.size;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+} // namespace coil
@@ -0,0 +1,95 @@
+#ifndef COIL_BINARY_COMPRESSION_H
+#define COIL_BINARY_COMPRESSION_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+#include "core/defs.h"
+
+namespace coil {
+
+/**
+ * @brief Header at the start of a compressed section's data
+ *
+ * A section with SECTION_FLAG_COMPRESSED stores this header followed by
+ * the compressed bytes, as ELF does with SHF_COMPRESSED. The section
+ * entry's size is the stored size; relocation offsets and symbol values
+ * refer to the uncompressed contents.
+ */
+struct CompressionHeader {
+    uint32_t type;               // Compression format (CompressionType)
+    uint32_t reserved;           // Reserved, must be zero
+    uint64_t size;               // Size of the uncompressed contents
+};
+
+/**
+ * @brief Section payload compression
+ *
+ * Which formats are available depends on the libraries found at build
+ * time (zlib, zstd, LZ4).
+ */
+class Compression {
+public:
+    /**
+     * @brief Check if a format can be compressed and decompressed
+     *
+     * @param type Compression format
+     * @return true if the format was built in
+     */
+    static bool isSupported(uint32_t type);
+
+    /**
+     * @brief Get the name of a format
+     *
+     * @param type Compression format
+     * @return Format name ("zlib", "zstd", "lz4"), or "unknown"
+     */
+    static const char* getName(uint32_t type);
+
+    /**
+     * @brief Look up a format by name
+     *
+     * @param name Format name
+     * @param type Compression format (output parameter)
+     * @return true if the name is known, false otherwise
+     */
+    static bool lookup(std::string_view name, uint32_t& type);
+
+    /**
+     * @brief Compress section contents
+     *
+     * @param type Compression format
+     * @param level Compression level (0 for the format's default)
+     * @param data Uncompressed contents
+     * @param size Size of the contents
+     * @param output Compression header and compressed bytes (output parameter)
+     * @return true on success, false if the format is not supported
+     */
+    static bool compress(uint32_t type, int level, const uint8_t* data, size_t size, std::vector<uint8_t>& output);
+
+    /**
+     * @brief Read the header of compressed section data
+     *
+     * @param data Stored section data
+     * @param size Size of the stored data
+     * @param header Compression header (output parameter)
+     * @return true if the data starts with a well-formed header
+     */
+    static bool readHeader(const uint8_t* data, size_t size, CompressionHeader& header);
+
+    /**
+     * @brief Decompress section data
+     *
+     * @param data Stored section data, starting with its compression header
+     * @param size Size of the stored data
+     * @param output Uncompressed contents (output parameter)
+     * @return true on success, false if the data is malformed or the
+     *         format is not supported
+     */
+    static bool decompress(const uint8_t* data, size_t size, std::vector<uint8_t>& output);
+};
+
+} // namespace coil
+
+#endif // COIL_BINARY_COMPRESSION_H
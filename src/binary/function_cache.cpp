@@ -0,0 +1,217 @@
+#include "binary/function_cache.h"
+#include "util/byte_writer.h"
+#include "util/logger.h"
+#include "util/mapped_file.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace coil {
+
+/**
+ * @brief Bounds-checked little-endian reader over a cache file
+ */
+class CacheReader {
+private:
+    const uint8_t* data;         // File contents
+    size_t size;                 // Size of the contents
+    size_t position;             // Next byte to read
+
+public:
+    CacheReader(const uint8_t* bytes, size_t count) : data(bytes), size(count), position(0) {}
+
+    bool readU32(uint32_t& value) {
+        if (size - position < 4) {
+            return false;
+        }
+        value = data[position] | (data[position + 1] << 8) | (data[position + 2] << 16) |
+                (static_cast<uint32_t>(data[position + 3]) << 24);
+        position += 4;
+        return true;
+    }
+
+    bool readU64(uint64_t& value) {
+        uint32_t low, high;
+        if (!readU32(low) || !readU32(high)) {
+            return false;
+        }
+        value = low | (static_cast<uint64_t>(high) << 32);
+        return true;
+    }
+
+    bool readBytes(size_t count, const uint8_t*& bytes) {
+        if (size - position < count) {
+            return false;
+        }
+        bytes = data + position;
+        position += count;
+        return true;
+    }
+
+    bool atEnd() const { return position == size; }
+};
+
+FunctionCache::FunctionCache(const std::string& file, uint64_t config)
+    : path(file), configHash(config), hits(0), misses(0), modified(false) {
+}
+
+bool FunctionCache::load() {
+    entries.clear();
+
+    auto file = MappedFile::open(path);
+    if (!file) {
+        return false;
+    }
+
+    CacheReader reader(reinterpret_cast<const uint8_t*>(file->getData()), file->getSize());
+
+    uint32_t magic, version, entryCount;
+    uint64_t config;
+    if (!reader.readU32(magic) || magic != FUNCTION_CACHE_MAGIC ||
+        !reader.readU32(version) || version != FUNCTION_CACHE_VERSION ||
+        !reader.readU64(config) || config != configHash ||
+        !reader.readU32(entryCount)) {
+        LOG_DEBUG("Ignoring stale function cache: {}", path);
+        return false;
+    }
+
+    std::unordered_map<uint64_t, Entry> loaded;
+    for (uint32_t i = 0; i < entryCount; i++) {
+        uint64_t key;
+        uint32_t codeSize, relocationCount;
+        const uint8_t* code;
+        if (!reader.readU64(key) || !reader.readU32(codeSize) || !reader.readU32(relocationCount) ||
+            !reader.readBytes(codeSize, code)) {
+            LOG_WARNING("Ignoring malformed function cache: {}", path);
+            return false;
+        }
+
+        Entry entry;
+        entry.used = false;
+        entry.function.code.assign(code, code + codeSize);
+
+        for (uint32_t j = 0; j < relocationCount; j++) {
+            CachedRelocation relocation;
+            uint64_t addend;
+            uint32_t nameSize;
+            const uint8_t* name;
+            if (!reader.readU32(relocation.offset) || !reader.readU32(relocation.type) ||
+                !reader.readU64(addend) || !reader.readU32(nameSize) || !reader.readBytes(nameSize, name) ||
+                relocation.offset >= codeSize) {
+                LOG_WARNING("Ignoring malformed function cache: {}", path);
+                return false;
+            }
+            relocation.addend = static_cast<int64_t>(addend);
+            relocation.symbol.assign(reinterpret_cast<const char*>(name), nameSize);
+            entry.function.relocations.push_back(std::move(relocation));
+        }
+
+        loaded.emplace(key, std::move(entry));
+    }
+
+    if (!reader.atEnd()) {
+        LOG_WARNING("Ignoring malformed function cache: {}", path);
+        return false;
+    }
+
+    entries = std::move(loaded);
+    LOG_DEBUG("Loaded {} cached functions from {}", entries.size(), path);
+    return true;
+}
+
+bool FunctionCache::save() {
+    // Nothing to do if every loaded entry was used and none were added
+    size_t used = 0;
+    for (const auto& [key, entry] : entries) {
+        if (entry.used) {
+            used++;
+        }
+    }
+    if (!modified && used == entries.size()) {
+        return true;
+    }
+
+    std::vector<uint8_t> data;
+    ByteWriter writer(data);
+    writer.writeU32(FUNCTION_CACHE_MAGIC);
+    writer.writeU32(FUNCTION_CACHE_VERSION);
+    writer.writeU64(configHash);
+    writer.writeU32(static_cast<uint32_t>(used));
+
+    for (const auto& [key, entry] : entries) {
+        if (!entry.used) {
+            continue;
+        }
+
+        const CachedFunction& function = entry.function;
+        writer.writeU64(key);
+        writer.writeU32(static_cast<uint32_t>(function.code.size()));
+        writer.writeU32(static_cast<uint32_t>(function.relocations.size()));
+        writer.writeBytes(function.code.data(), function.code.size());
+
+        for (const auto& relocation : function.relocations) {
+            writer.writeU32(relocation.offset);
+            writer.writeU32(relocation.type);
+            writer.writeU64(static_cast<uint64_t>(relocation.addend));
+            writer.writeU32(static_cast<uint32_t>(relocation.symbol.size()));
+            writer.writeBytes(reinterpret_cast<const uint8_t*>(relocation.symbol.data()), relocation.symbol.size());
+        }
+    }
+
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()))) {
+            LOG_ERROR("Failed to write function cache: {}", tempPath);
+            return false;
+        }
+    }
+
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        LOG_ERROR("Failed to replace function cache: {}", path);
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    modified = false;
+    return true;
+}
+
+const CachedFunction* FunctionCache::find(uint64_t key) {
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        misses++;
+        return nullptr;
+    }
+
+    hits++;
+    it->second.used = true;
+    return &it->second.function;
+}
+
+void FunctionCache::store(uint64_t key, CachedFunction function) {
+    Entry& entry = entries[key];
+    entry.function = std::move(function);
+    entry.used = true;
+    modified = true;
+}
+
+size_t FunctionCache::getHitCount() const {
+    return hits;
+}
+
+size_t FunctionCache::getMissCount() const {
+    return misses;
+}
+
+uint64_t FunctionCache::hash(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t value = seed;
+    for (size_t i = 0; i < size; i++) {
+        value ^= bytes[i];
+        value *= 1099511628211ull;
+    }
+    return value;
+}
+
+} // namespace coil
@@ -0,0 +1,142 @@
+#ifndef COIL_BINARY_FUNCTION_CACHE_H
+#define COIL_BINARY_FUNCTION_CACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace coil {
+
+// Magic number for function cache files ("CFNC")
+constexpr uint32_t FUNCTION_CACHE_MAGIC = 0x434E4643;
+
+// Bump whenever the encoding of instructions or their relocations changes,
+// so stale code is never reused
+constexpr uint32_t FUNCTION_CACHE_VERSION = 3;
+
+/**
+ * @brief Relocation inside a cached function
+ */
+struct CachedRelocation {
+    uint32_t offset;             // Offset from the start of the function
+    uint32_t type;               // Relocation type
+    int64_t addend;              // Addend value
+    std::string symbol;          // Name of the referenced symbol
+};
+
+/**
+ * @brief Encoded code of one function
+ */
+struct CachedFunction {
+    std::vector<uint8_t> code;                   // Encoded instructions
+    std::vector<CachedRelocation> relocations;   // Relocations against the code
+};
+
+/**
+ * @brief On-disk cache of encoded functions
+ *
+ * Entries are keyed by a hash of a function's source text (from its
+ * FUNC directive through ENDFUNC) and of the TARGET, ABI, MACRO, CONST
+ * and STRUCT directives and included files in effect, so a function whose text has not changed is neither parsed
+ * nor encoded again. The whole cache is also tied to a configuration
+ * hash (format version, target and code generation options); a file
+ * written with a different configuration is ignored.
+ *
+ * Saving keeps only the entries that were looked up or stored since the
+ * cache was loaded, so code for functions that no longer exist does not
+ * pile up.
+ */
+class FunctionCache {
+private:
+    /**
+     * @brief Cached function and whether this run used it
+     */
+    struct Entry {
+        CachedFunction function;
+        bool used;
+    };
+
+    std::string path;                            // Cache file
+    uint64_t configHash;                         // Configuration the entries are valid for
+    std::unordered_map<uint64_t, Entry> entries; // Key -> cached function
+    size_t hits;                                 // Successful lookups
+    size_t misses;                               // Failed lookups
+    bool modified;                               // Entries were stored since loading
+
+public:
+    /**
+     * @brief Construct an empty cache backed by a file
+     *
+     * @param file Cache file
+     * @param config Configuration hash
+     */
+    FunctionCache(const std::string& file, uint64_t config);
+
+    /**
+     * @brief Load the cache file
+     *
+     * A missing, malformed or stale file leaves the cache empty.
+     *
+     * @return true if entries were loaded, false otherwise
+     */
+    bool load();
+
+    /**
+     * @brief Save the cache file
+     *
+     * The file is written to a temporary name and then renamed, so readers
+     * never see a partly written cache.
+     *
+     * @return true if the file is up to date, false on error
+     */
+    bool save();
+
+    /**
+     * @brief Look up a function
+     *
+     * @param key Function key
+     * @return Cached function (valid for the lifetime of the cache), or nullptr
+     */
+    const CachedFunction* find(uint64_t key);
+
+    /**
+     * @brief Store a function
+     *
+     * @param key Function key
+     * @param function Encoded function
+     */
+    void store(uint64_t key, CachedFunction function);
+
+    /**
+     * @brief Get the number of successful lookups
+     *
+     * @return Number of hits
+     */
+    size_t getHitCount() const;
+
+    /**
+     * @brief Get the number of failed lookups
+     *
+     * @return Number of misses
+     */
+    size_t getMissCount() const;
+
+    /**
+     * @brief Hash a range of bytes
+     *
+     * This is 64-bit FNV-1a; a previous hash can be passed as the seed to
+     * hash several ranges as one.
+     *
+     * @param data First byte
+     * @param size Number of bytes
+     * @param seed Initial hash value
+     * @return Hash value
+     */
+    static uint64_t hash(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+};
+
+} // namespace coil
+
+#endif // COIL_BINARY_FUNCTION_CACHE_H
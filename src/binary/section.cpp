@@ -1,10 +1,13 @@
 #include "binary/section.h"
 #include <algorithm>
+#include <cstring>
+#include <utility>
 
 namespace coil {
 
 Section::Section(const std::string& name, uint32_t type, uint32_t flags, uint32_t targetId, uint32_t alignment)
-    : name(name), type(type), flags(flags), targetId(targetId), address(0), alignment(alignment) {
+    : name(name), type(type), flags(flags), targetId(targetId), address(0), alignment(alignment),
+      compression(COMPRESSION_NONE), compressionLevel(0), bssSize(0) {
 }
 
 const std::string& Section::getName() const {
@@ -35,12 +38,29 @@ uint32_t Section::getAlignment() const {
     return alignment;
 }
 
+void Section::setAlignment(uint32_t align) {
+    alignment = align;
+}
+
+void Section::setCompression(uint32_t type, int level) {
+    compression = type;
+    compressionLevel = level;
+}
+
+uint32_t Section::getCompression() const {
+    return compression;
+}
+
+int Section::getCompressionLevel() const {
+    return compressionLevel;
+}
+
 const std::vector<uint8_t>& Section::getData() const {
     return data;
 }
 
 size_t Section::getSize() const {
-    return data.size();
+    return type == SECTION_BSS ? static_cast<size_t>(bssSize) : data.size();
 }
 
 uint64_t Section::addData(const std::vector<uint8_t>& newData) {
@@ -49,8 +69,33 @@ uint64_t Section::addData(const std::vector<uint8_t>& newData) {
     return offset;
 }
 
+void Section::setData(std::vector<uint8_t> newData) {
+    data = std::move(newData);
+}
+
+uint64_t Section::moveTail(uint64_t offset, Section& target) {
+    offset = std::min<uint64_t>(offset, data.size());
+    uint64_t targetOffset = target.data.size();
+    target.data.insert(target.data.end(), data.begin() + offset, data.end());
+    data.resize(static_cast<size_t>(offset));
+    
+    // Relocations keep their order on both sides
+    auto tail = std::stable_partition(relocations.begin(), relocations.end(),
+                                      [offset](const RelocationEntry& reloc) { return reloc.offset < offset; });
+    for (auto it = tail; it != relocations.end(); ++it) {
+        RelocationEntry reloc = *it;
+        reloc.offset = reloc.offset - offset + targetOffset;
+        target.relocations.push_back(reloc);
+    }
+    relocations.erase(tail, relocations.end());
+    
+    return targetOffset;
+}
+
 void Section::addRelocation(uint64_t offset, uint32_t symbolIndex, uint32_t type, int64_t addend, uint32_t targetId) {
+    // Clear the padding as well; entries are written to disk as they are
     RelocationEntry reloc;
+    std::memset(&reloc, 0, sizeof(reloc));
     reloc.offset = offset;
     reloc.symbol_index = symbolIndex;
     reloc.type = type;
@@ -70,6 +115,22 @@ uint64_t Section::addInstruction(std::unique_ptr<Instruction> instruction) {
     return offset;
 }
 
+uint64_t Section::addInstructions(const std::vector<std::unique_ptr<Instruction>>& code,
+                                  InstructionEncoding encoding) {
+    uint64_t offset = data.size();
+    ByteWriter writer(data);
+    
+    for (const auto& instruction : code) {
+        instruction->encodeInto(writer, encoding);
+    }
+    
+    return offset;
+}
+
+void Section::reserve(size_t size) {
+    data.reserve(data.size() + size);
+}
+
 const std::vector<std::unique_ptr<Instruction>>& Section::getInstructions() const {
     return instructions;
 }
@@ -83,6 +144,12 @@ std::vector<uint8_t> Section::getBytes(uint64_t offset, size_t size) const {
 }
 
 uint64_t Section::fillZero(size_t size) {
+    if (type == SECTION_BSS) {
+        uint64_t offset = bssSize;
+        bssSize += size;
+        return offset;
+    }
+    
     uint64_t offset = data.size();
     data.resize(data.size() + size, 0);
     return offset;
@@ -93,39 +160,37 @@ uint64_t Section::align(uint32_t alignmentValue) {
         alignmentValue = 1;
     }
     
-    uint64_t currentSize = data.size();
+    uint64_t currentSize = getSize();
     uint64_t padding = (alignmentValue - (currentSize % alignmentValue)) % alignmentValue;
     
     if (padding > 0) {
-        data.resize(currentSize + padding, 0);
+        fillZero(static_cast<size_t>(padding));
     }
     
     return currentSize + padding;
 }
 
-void Section::finalize() {
-    // Convert instructions to binary data
-    std::vector<uint8_t> instructionData;
-    
+void Section::finalize(InstructionEncoding encoding) {
+    // Size the section once, then encode every instruction in place
+    size_t instructionSize = 0;
     for (const auto& instruction : instructions) {
-        std::vector<uint8_t> encoded = instruction->encode();
-        instructionData.insert(instructionData.end(), encoded.begin(), encoded.end());
+        instructionSize += instruction->encodedSize(encoding);
     }
     
-    // Append instruction data to section data
-    if (!instructionData.empty()) {
-        addData(instructionData);
-    }
+    reserve(instructionSize);
+    addInstructions(instructions, encoding);
 }
 
 SectionEntry Section::createEntry(uint32_t nameOffset, uint64_t sectionOffset, uint32_t relocOffset) const {
+    // Clear the padding as well; entries are written to disk as they are
     SectionEntry entry;
+    std::memset(&entry, 0, sizeof(entry));
     entry.name_offset = nameOffset;
     entry.type = type;
     entry.flags = flags;
     entry.target_id = targetId;
     entry.address = address;
-    entry.size = static_cast<uint64_t>(data.size());
+    entry.size = static_cast<uint64_t>(getSize());
     entry.offset = sectionOffset;
     entry.alignment = alignment;
     entry.relocation_count = static_cast<uint32_t>(relocations.size());
@@ -50,7 +50,10 @@ private:
     uint32_t targetId;           // Target architecture
     uint64_t address;            // Virtual address
     uint32_t alignment;          // Section alignment
+    uint32_t compression;        // Compression format used when writing (CompressionType)
+    int compressionLevel;        // Compression level (0 for the format's default)
     std::vector<uint8_t> data;   // Section data
+    uint64_t bssSize;            // Size of a BSS section, which stores no data
     std::vector<RelocationEntry> relocations; // Relocations
 
     // For code sections
@@ -117,6 +120,38 @@ public:
      */
     uint32_t getAlignment() const;
     
+    /**
+     * @brief Set the section alignment
+     * 
+     * @param align Alignment boundary (a power of two)
+     */
+    void setAlignment(uint32_t align);
+    
+    /**
+     * @brief Set how the section data is compressed in the file
+     * 
+     * The data stays uncompressed in memory; it is compressed when the
+     * file is written, and stored as is if that does not make it smaller.
+     * 
+     * @param type Compression format (COMPRESSION_NONE to store as is)
+     * @param level Compression level (0 for the format's default)
+     */
+    void setCompression(uint32_t type, int level = 0);
+    
+    /**
+     * @brief Get the compression format
+     * 
+     * @return Compression format
+     */
+    uint32_t getCompression() const;
+    
+    /**
+     * @brief Get the compression level
+     * 
+     * @return Compression level, or 0 for the format's default
+     */
+    int getCompressionLevel() const;
+    
     /**
      * @brief Get the section data
      * 
@@ -125,9 +160,11 @@ public:
     const std::vector<uint8_t>& getData() const;
     
     /**
-     * @brief Get the section data size
+     * @brief Get the section size
      * 
-     * @return Section data size
+     * A BSS section only has a size; its data stays empty.
+     * 
+     * @return Section size
      */
     size_t getSize() const;
     
@@ -139,6 +176,25 @@ public:
      */
     uint64_t addData(const std::vector<uint8_t>& newData);
     
+    /**
+     * @brief Replace the section data
+     * 
+     * @param newData New contents
+     */
+    void setData(std::vector<uint8_t> newData);
+    
+    /**
+     * @brief Move the end of the section to another section
+     * 
+     * The data from an offset on is appended to the other section, along
+     * with the relocations that apply to it.
+     * 
+     * @param offset Offset to split at
+     * @param target Section to move the data to
+     * @return Offset of the moved data in the other section
+     */
+    uint64_t moveTail(uint64_t offset, Section& target);
+    
     /**
      * @brief Add a relocation
      * 
@@ -165,6 +221,26 @@ public:
      */
     uint64_t addInstruction(std::unique_ptr<Instruction> instruction);
     
+    /**
+     * @brief Encode instructions directly into the section data
+     * 
+     * Unlike addInstruction, the instructions are not kept by the section,
+     * so the caller's instructions can be encoded without copying them.
+     * 
+     * @param code Instructions to encode
+     * @param encoding Instruction encoding
+     * @return Offset to the first encoded instruction
+     */
+    uint64_t addInstructions(const std::vector<std::unique_ptr<Instruction>>& code,
+                             InstructionEncoding encoding = ENCODING_STANDARD);
+    
+    /**
+     * @brief Reserve room for data about to be added
+     * 
+     * @param size Number of bytes to reserve beyond the current size
+     */
+    void reserve(size_t size);
+    
     /**
      * @brief Get the instructions in a code section
      * 
@@ -184,6 +260,8 @@ public:
     /**
      * @brief Fill section data to be 0
      * 
+     * A BSS section only grows, without storing the zeros.
+     * 
      * @param size Size to fill
      * @return Offset to the filled data
      */
@@ -199,8 +277,10 @@ public:
     
     /**
      * @brief Finalize the section, converting instructions to binary data
+     * 
+     * @param encoding Instruction encoding
      */
-    void finalize();
+    void finalize(InstructionEncoding encoding = ENCODING_STANDARD);
     
     /**
      * @brief Create a SectionEntry for this section
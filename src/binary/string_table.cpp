@@ -0,0 +1,184 @@
+#include "binary/string_table.h"
+#include <algorithm>
+#include <cstring>
+
+namespace coil {
+
+/**
+ * @brief Add one byte to a string hash
+ *
+ * Strings are hashed (FNV-1a) from their last byte to their first, so
+ * hashing a string also produces the hash of each of its suffixes.
+ *
+ * @param hash Hash so far
+ * @param byte Next byte, going backwards
+ * @return Updated hash
+ */
+static uint32_t hashByte(uint32_t hash, uint8_t byte) {
+    return (hash ^ byte) * 16777619u;
+}
+
+static constexpr uint32_t HASH_SEED = 2166136261u;
+
+/**
+ * @brief Hash a string
+ *
+ * @param str String
+ * @return Hash value
+ */
+static uint32_t hashString(std::string_view str) {
+    uint32_t hash = HASH_SEED;
+    for (size_t i = str.size(); i-- > 0; ) {
+        hash = hashByte(hash, static_cast<uint8_t>(str[i]));
+    }
+    return hash;
+}
+
+StringTable::StringTable(bool merge)
+    : slots(64, Slot{EMPTY, 0, 0}), used(0), tailMerging(merge) {
+    add("");
+}
+
+bool StringTable::lookup(std::string_view str, uint32_t hash, uint32_t& offset) const {
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask; slots[i].offset != EMPTY; i = (i + 1) & mask) {
+        const Slot& slot = slots[i];
+        if (slot.hash == hash && slot.length == str.size() &&
+            std::memcmp(data.data() + slot.offset, str.data(), str.size()) == 0) {
+            offset = slot.offset;
+            return true;
+        }
+    }
+    return false;
+}
+
+void StringTable::insert(uint32_t offset, uint32_t length, uint32_t hash) {
+    // Keep the load factor at or below one half so probe sequences stay short
+    if ((used + 1) * 2 > slots.size()) {
+        grow();
+    }
+
+    size_t mask = slots.size() - 1;
+    size_t i = hash & mask;
+    while (slots[i].offset != EMPTY) {
+        i = (i + 1) & mask;
+    }
+
+    slots[i] = Slot{offset, length, hash};
+    used++;
+}
+
+void StringTable::index(uint32_t offset, uint32_t length) {
+    const char* str = reinterpret_cast<const char*>(data.data() + offset);
+
+    if (!tailMerging || length == 0) {
+        std::string_view view(str, length);
+        uint32_t existing;
+        uint32_t hash = hashString(view);
+        if (!lookup(view, hash, existing)) {
+            insert(offset, length, hash);
+        }
+        return;
+    }
+
+    // Index every non-empty suffix that is not already in the table
+    uint32_t hash = HASH_SEED;
+    for (uint32_t start = length; start-- > 0; ) {
+        hash = hashByte(hash, static_cast<uint8_t>(str[start]));
+
+        std::string_view suffix(str + start, length - start);
+        uint32_t existing;
+        if (!lookup(suffix, hash, existing)) {
+            insert(offset + start, length - start, hash);
+        }
+    }
+}
+
+void StringTable::grow() {
+    std::vector<Slot> old(slots.size() * 2, Slot{EMPTY, 0, 0});
+    old.swap(slots);
+
+    size_t mask = slots.size() - 1;
+    for (const Slot& slot : old) {
+        if (slot.offset == EMPTY) {
+            continue;
+        }
+
+        size_t i = slot.hash & mask;
+        while (slots[i].offset != EMPTY) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+}
+
+uint32_t StringTable::add(std::string_view str) {
+    uint32_t offset;
+    uint32_t hash = hashString(str);
+    if (lookup(str, hash, offset)) {
+        return offset;
+    }
+
+    // Append the string (including null terminator)
+    offset = static_cast<uint32_t>(data.size());
+    data.insert(data.end(), str.begin(), str.end());
+    data.push_back(0);
+
+    if (tailMerging && !str.empty()) {
+        index(offset, static_cast<uint32_t>(str.size()));
+    } else {
+        insert(offset, static_cast<uint32_t>(str.size()), hash);
+    }
+
+    return offset;
+}
+
+void StringTable::reindex() {
+    std::fill(slots.begin(), slots.end(), Slot{EMPTY, 0, 0});
+    used = 0;
+
+    for (size_t start = 0; start < data.size(); ) {
+        const void* end = std::memchr(data.data() + start, 0, data.size() - start);
+        if (!end) {
+            break;
+        }
+
+        size_t length = static_cast<const uint8_t*>(end) - (data.data() + start);
+        index(static_cast<uint32_t>(start), static_cast<uint32_t>(length));
+        start += length + 1;
+    }
+}
+
+void StringTable::assign(const uint8_t* bytes, size_t count) {
+    data.assign(bytes, bytes + count);
+    reindex();
+
+    // The empty string is always available
+    add("");
+}
+
+void StringTable::setTailMerging(bool merge) {
+    if (merge == tailMerging) {
+        return;
+    }
+
+    // Suffixes of the strings already in the table become shareable too
+    tailMerging = merge;
+    if (merge) {
+        reindex();
+    }
+}
+
+bool StringTable::isTailMerging() const {
+    return tailMerging;
+}
+
+const std::vector<uint8_t>& StringTable::getData() const {
+    return data;
+}
+
+size_t StringTable::size() const {
+    return data.size();
+}
+
+} // namespace coil
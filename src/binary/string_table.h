@@ -0,0 +1,108 @@
+#ifndef COIL_BINARY_STRING_TABLE_H
+#define COIL_BINARY_STRING_TABLE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace coil {
+
+/**
+ * @brief Interning builder for a COF string table
+ *
+ * Strings are stored once, NUL-terminated, in the table data. The lookup
+ * table is an open-addressing hash whose slots refer to strings by their
+ * offset into that data, so no string is ever stored a second time.
+ *
+ * With tail merging enabled, a string that is the suffix of one already
+ * in the table is not stored at all; it points into the longer string
+ * instead, as ELF linkers do. Only longer strings added earlier can be
+ * shared, so callers should add the longest names first.
+ */
+class StringTable {
+private:
+    /**
+     * @brief One slot of the lookup table
+     */
+    struct Slot {
+        uint32_t offset;         // Offset of the string in the data, or EMPTY
+        uint32_t length;         // Length of the string
+        uint32_t hash;           // Hash of the string
+    };
+
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    std::vector<uint8_t> data;   // Table contents
+    std::vector<Slot> slots;     // Lookup table (size is a power of two)
+    size_t used;                 // Number of occupied slots
+    bool tailMerging;            // Share suffixes of longer strings
+
+    bool lookup(std::string_view str, uint32_t hash, uint32_t& offset) const;
+    void insert(uint32_t offset, uint32_t length, uint32_t hash);
+    void index(uint32_t offset, uint32_t length);
+    void reindex();
+    void grow();
+
+public:
+    /**
+     * @brief Construct a new string table holding only the empty string
+     *
+     * @param merge Enable tail merging
+     */
+    explicit StringTable(bool merge = false);
+
+    /**
+     * @brief Add a string
+     *
+     * @param str String to add (must not contain NUL characters)
+     * @return Offset of the string in the table
+     */
+    uint32_t add(std::string_view str);
+
+    /**
+     * @brief Replace the contents with an existing table
+     *
+     * Every string that starts after a NUL character is indexed, so
+     * adding one of them again returns its existing offset.
+     *
+     * @param bytes Table contents (must be empty or end with a NUL character)
+     * @param count Size of the contents
+     */
+    void assign(const uint8_t* bytes, size_t count);
+
+    /**
+     * @brief Enable or disable tail merging
+     *
+     * Enabling it also makes the suffixes of strings already in the
+     * table available for sharing.
+     *
+     * @param merge Enable tail merging
+     */
+    void setTailMerging(bool merge);
+
+    /**
+     * @brief Check if tail merging is enabled
+     *
+     * @return true if suffixes are shared
+     */
+    bool isTailMerging() const;
+
+    /**
+     * @brief Get the table contents
+     *
+     * @return Table data
+     */
+    const std::vector<uint8_t>& getData() const;
+
+    /**
+     * @brief Get the size of the table contents
+     *
+     * @return Size in bytes
+     */
+    size_t size() const;
+};
+
+} // namespace coil
+
+#endif // COIL_BINARY_STRING_TABLE_H
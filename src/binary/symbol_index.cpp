@@ -0,0 +1,70 @@
+#include "binary/symbol_index.h"
+#include "util/byte_writer.h"
+
+namespace coil {
+
+void SymbolIndex::add(std::string_view name, uint32_t index) {
+    // Keep the first symbol with a given name
+    indices.emplace(name, index);
+}
+
+bool SymbolIndex::find(std::string_view name, uint32_t& index) const {
+    auto it = indices.find(name);
+    if (it == indices.end()) {
+        return false;
+    }
+
+    index = it->second;
+    return true;
+}
+
+void SymbolIndex::clear() {
+    indices.clear();
+}
+
+size_t SymbolIndex::size() const {
+    return indices.size();
+}
+
+uint32_t SymbolIndex::hash(std::string_view name) {
+    uint32_t value = 2166136261u;
+    for (char c : name) {
+        value ^= static_cast<uint8_t>(c);
+        value *= 16777619u;
+    }
+    return value;
+}
+
+std::vector<uint8_t> SymbolIndex::buildSection(const std::vector<std::unique_ptr<Symbol>>& symbols) {
+    // Roughly one symbol per bucket keeps chains short
+    uint32_t symbolCount = static_cast<uint32_t>(symbols.size());
+    uint32_t bucketCount = symbolCount > 0 ? symbolCount : 1;
+
+    std::vector<uint32_t> buckets(bucketCount, 0);
+    std::vector<uint32_t> chains(symbolCount, 0);
+
+    // Insert in reverse so each chain lists its symbols in table order
+    // and a lookup finds the first of several equal names
+    for (uint32_t i = symbolCount; i-- > 0; ) {
+        uint32_t bucket = hash(symbols[i]->getName()) % bucketCount;
+        chains[i] = buckets[bucket];
+        buckets[bucket] = i + 1;
+    }
+
+    std::vector<uint8_t> data;
+    ByteWriter writer(data);
+    writer.reserve(sizeof(SymbolHashHeader) + (buckets.size() + chains.size()) * sizeof(uint32_t));
+
+    writer.writeU32(bucketCount);
+    writer.writeU32(symbolCount);
+    for (uint32_t value : buckets) {
+        writer.writeU32(value);
+    }
+    for (uint32_t value : chains) {
+        writer.writeU32(value);
+    }
+
+    return data;
+}
+
+} // namespace coil
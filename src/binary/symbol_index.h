@@ -0,0 +1,93 @@
+#ifndef COIL_BINARY_SYMBOL_INDEX_H
+#define COIL_BINARY_SYMBOL_INDEX_H
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "binary/symbol.h"
+
+namespace coil {
+
+/**
+ * @brief Header of a hash section (SECTION_HASH)
+ *
+ * The section maps symbol names to symbol table indices with the same
+ * bucket and chain layout as an ELF hash table:
+ *
+ *   SymbolHashHeader header;
+ *   uint32_t buckets[bucket_count]; // First symbol of each bucket, plus one
+ *   uint32_t chains[symbol_count];  // Next symbol in the same bucket, plus one
+ *
+ * A value of zero ends a chain. Names are hashed with SymbolIndex::hash.
+ */
+struct SymbolHashHeader {
+    uint32_t bucket_count;       // Number of buckets
+    uint32_t symbol_count;       // Number of symbols covered (the whole table)
+};
+
+/**
+ * @brief Name to index lookup for a symbol table
+ *
+ * The index refers to the names of the symbols it was built from, so
+ * those symbols must outlive it and keep their names. When a name is
+ * used more than once the first symbol wins, as with a linear search.
+ */
+class SymbolIndex {
+private:
+    std::unordered_map<std::string_view, uint32_t> indices; // Name -> symbol index
+
+public:
+    /**
+     * @brief Add a symbol
+     *
+     * @param name Symbol name (must outlive the index)
+     * @param index Symbol table index
+     */
+    void add(std::string_view name, uint32_t index);
+
+    /**
+     * @brief Find a symbol by name
+     *
+     * @param name Symbol name
+     * @param index Symbol table index (output parameter)
+     * @return true if found, false otherwise
+     */
+    bool find(std::string_view name, uint32_t& index) const;
+
+    /**
+     * @brief Remove all symbols
+     */
+    void clear();
+
+    /**
+     * @brief Get the number of distinct names
+     *
+     * @return Number of names
+     */
+    size_t size() const;
+
+    /**
+     * @brief Hash a symbol name
+     *
+     * This is 32-bit FNV-1a. It is part of the file format, so it must
+     * never change.
+     *
+     * @param name Symbol name
+     * @return Hash value
+     */
+    static uint32_t hash(std::string_view name);
+
+    /**
+     * @brief Build the contents of a hash section for a symbol table
+     *
+     * @param symbols Symbol table
+     * @return Section data
+     */
+    static std::vector<uint8_t> buildSection(const std::vector<std::unique_ptr<Symbol>>& symbols);
+};
+
+} // namespace coil
+
+#endif // COIL_BINARY_SYMBOL_INDEX_H
@@ -108,6 +108,26 @@ enum BitOp : uint8_t {
   BIT_CMP    = 0x1A   // Compare values and set flags
 };
 
+// Vector operations (bits 4-0); the element type (a BasicType) is the
+// first extended data byte. Vectors are as wide as the target allows.
+enum VectorOp : uint8_t {
+  VEC_MOV    = 0x00,  // Copy a vector
+  VEC_LOAD   = 0x01,  // Load a vector from memory
+  VEC_STORE  = 0x02,  // Store a vector to memory
+  VEC_SPLAT  = 0x03,  // Copy a scalar into every element
+  VEC_ADD    = 0x04,  // Element-wise addition
+  VEC_SUB    = 0x05,  // Element-wise subtraction
+  VEC_MUL    = 0x06,  // Element-wise multiplication
+  VEC_DIV    = 0x07,  // Element-wise division (floating point)
+  VEC_MIN    = 0x08,  // Element-wise minimum
+  VEC_MAX    = 0x09,  // Element-wise maximum
+  VEC_AND    = 0x0A,  // Bitwise AND
+  VEC_OR     = 0x0B,  // Bitwise OR
+  VEC_XOR    = 0x0C,  // Bitwise XOR
+  VEC_SQRT   = 0x0D,  // Element-wise square root (floating point)
+  VEC_LANES  = 0x0E   // Number of elements in a vector
+};
+
 // Variable operations (bits 4-0)
 enum VariableOp : uint8_t {
   VAR_DECL   = 0x00,  // Variable declaration
@@ -173,6 +193,12 @@ enum VariableRefType : uint8_t {
   VAR_FIELD     = 0x03   // Structure field
 };
 
+// Instruction encodings (COF_FLAG_COMPACT_ENCODING selects the compact one)
+enum InstructionEncoding : uint8_t {
+  ENCODING_STANDARD = 0,   // Fixed-size header and operand payloads
+  ENCODING_COMPACT = 1     // Variable-length header and operand payloads
+};
+
 // Predefined virtual register IDs
 enum VirtualRegisterID : uint8_t {
   // General purpose registers
@@ -308,7 +334,8 @@ enum SectionType : uint32_t {
   SECTION_COMMENT = 12,    // Comment section
   SECTION_NOTE = 13,       // Note section
   SECTION_VARIABLE = 14,   // Variable information
-  SECTION_TYPE = 15        // Type information
+  SECTION_TYPE = 15,       // Type information
+  SECTION_HASH = 16        // Symbol name hash index
 };
 
 // Section flags
@@ -326,6 +353,14 @@ enum SectionFlags : uint32_t {
   SECTION_FLAG_ENCRYPTED = 0x00000200  // Encrypted section
 };
 
+// Section compression formats (SECTION_FLAG_COMPRESSED)
+enum CompressionType : uint32_t {
+  COMPRESSION_NONE = 0,    // Stored as is
+  COMPRESSION_ZLIB = 1,    // zlib (deflate)
+  COMPRESSION_ZSTD = 2,    // Zstandard
+  COMPRESSION_LZ4 = 3      // LZ4 block format
+};
+
 // Symbol types
 enum SymbolType : uint16_t {
   SYMBOL_NONE = 0,         // Unspecified symbol type
@@ -354,6 +389,14 @@ enum SymbolFlags : uint16_t {
   SYMBOL_FLAG_DESTRUCTOR = 0x0200  // Destructor function
 };
 
+// Relocation types of COIL instruction sections; they carry a target ID
+// too, so the values stay clear of the targets' own relocation types
+enum CoilRelocationType : uint32_t {
+  RELOC_COIL_NONE = 0,         // No relocation
+  RELOC_COIL_SYMBOL = 0x100,   // Symbol operand naming S (offset of its type byte)
+  RELOC_COIL_LABEL = 0x101     // Local label operand naming S + A (S is the function)
+};
+
 // Architecture types
 enum ArchType : uint8_t {
   ARCH_X86 = 0,            // x86 (32-bit)
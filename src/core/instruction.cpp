@@ -1,21 +1,81 @@
 #include "core/instruction.h"
+#include "core/instruction_decoder.h"
+#include "util/leb128.h"
 #include <sstream>
 #include <iomanip>
+#include <cstring>
+#include <new>
 
 namespace coil {
 
+// Returned for instructions without extended data
+static const std::pmr::vector<uint8_t> noExtendedData;
+
 Instruction::Instruction(uint8_t cat, uint8_t op)
-    : category(cat), operation(op) {
+    : category(cat), operation(op), operandCount(0),
+      resource(Arena::currentResource()), overflow(nullptr) {
+}
+
+Instruction::~Instruction() {
+    if (overflow) {
+        overflow->~Overflow();
+        resource->deallocate(overflow, sizeof(Overflow), alignof(Overflow));
+    }
+}
+
+Instruction::Overflow& Instruction::getOverflow() const {
+    if (!overflow) {
+        void* block = resource->allocate(sizeof(Overflow), alignof(Overflow));
+        overflow = new (block) Overflow(resource);
+    }
+    return *overflow;
 }
 
 void Instruction::addOperand(OperandPtr op) {
     if (op) {
-        operands.push_back(std::move(op));
+        std::vector<uint8_t> encoded = op->encode();
+        addOperand(encoded[0], encoded.data() + 1, encoded.size() - 1);
     }
 }
 
+void Instruction::addOperand(const OperandValue& value) {
+    if (operandCount < INLINE_OPERANDS) {
+        inlineOperands[operandCount] = value;
+    } else {
+        getOverflow().operands.push_back(value);
+    }
+    operandCount++;
+    
+    if (overflow) {
+        overflow->adapters.clear();
+    }
+}
+
+void Instruction::addOperand(uint8_t typeByte, const uint8_t* payload, size_t length) {
+    if (length <= OperandValue::INLINE_SIZE) {
+        addOperand(OperandValue::makeInline(typeByte, payload, length));
+        return;
+    }
+    
+    // Keep the payload out of line and record where it is
+    auto& payloads = getOverflow().payloads;
+    uint32_t offset = static_cast<uint32_t>(payloads.size());
+    uint32_t size = static_cast<uint32_t>(length);
+    payloads.insert(payloads.end(), payload, payload + length);
+    
+    OperandValue value{};
+    value.type = typeByte;
+    value.length = OperandValue::EXTERNAL;
+    std::memcpy(value.payload, &offset, sizeof(offset));
+    std::memcpy(value.payload + sizeof(offset), &size, sizeof(size));
+    addOperand(value);
+}
+
 void Instruction::setExtendedData(const std::vector<uint8_t>& data) {
-    extendedData = data;
+    if (data.empty() && !overflow) {
+        return;
+    }
+    getOverflow().extendedData.assign(data.begin(), data.end());
 }
 
 uint8_t Instruction::getCategory() const {
@@ -30,39 +90,172 @@ uint8_t Instruction::getOpcode() const {
     return category | operation;
 }
 
-const std::vector<OperandPtr>& Instruction::getOperands() const {
-    return operands;
+size_t Instruction::getOperandCount() const {
+    return operandCount;
 }
 
-const std::vector<uint8_t>& Instruction::getExtendedData() const {
-    return extendedData;
+const OperandValue& Instruction::getOperandValue(size_t index) const {
+    if (index < INLINE_OPERANDS) {
+        return inlineOperands[index];
+    }
+    return overflow->operands[index - INLINE_OPERANDS];
 }
 
-std::vector<uint8_t> Instruction::encode() const {
+const uint8_t* Instruction::getOperandPayload(size_t index, size_t& length) const {
+    const OperandValue& value = getOperandValue(index);
+    
+    if (!value.isExternal()) {
+        length = value.length;
+        return value.payload;
+    }
+    
+    uint32_t offset;
+    uint32_t size;
+    std::memcpy(&offset, value.payload, sizeof(offset));
+    std::memcpy(&size, value.payload + sizeof(offset), sizeof(size));
+    length = size;
+    return overflow->payloads.data() + offset;
+}
+
+OperandPtr Instruction::makeOperand(size_t index) const {
+    size_t length;
+    const uint8_t* payload = getOperandPayload(index, length);
+    
+    // Go through the encoded form so the Operand classes stay the only
+    // place that knows how to interpret each payload
+    std::vector<uint8_t> encoded;
+    encoded.reserve(length + 1);
+    encoded.push_back(getOperandValue(index).type);
+    encoded.insert(encoded.end(), payload, payload + length);
+    
+    size_t offset = 0;
+    return Operand::decode(encoded.data(), offset);
+}
+
+const std::pmr::vector<OperandPtr>& Instruction::getOperands() const {
+    auto& adapters = getOverflow().adapters;
+    
+    if (adapters.size() != operandCount) {
+        adapters.clear();
+        for (size_t i = 0; i < operandCount; i++) {
+            adapters.push_back(makeOperand(i));
+        }
+    }
+    
+    return adapters;
+}
+
+const std::pmr::vector<uint8_t>& Instruction::getExtendedData() const {
+    return overflow ? overflow->extendedData : noExtendedData;
+}
+
+std::vector<uint8_t> Instruction::encode(InstructionEncoding encoding) const {
     std::vector<uint8_t> result;
+    result.reserve(encodedSize(encoding));
+    ByteWriter writer(result);
+    encodeInto(writer, encoding);
+    return result;
+}
+
+size_t Instruction::encodedSize(InstructionEncoding encoding) const {
+    size_t extendedSize = getExtendedData().size();
+    
+    if (encoding == ENCODING_COMPACT) {
+        // Header: opcode, operand count with the extended data bit, and
+        // the extended data size if there is any
+        size_t size = 1 + uleb128Size((static_cast<uint64_t>(operandCount) << 1) | (extendedSize != 0));
+        if (extendedSize != 0) {
+            size += uleb128Size(extendedSize);
+        }
+        
+        for (size_t i = 0; i < operandCount; i++) {
+            size_t length;
+            const uint8_t* payload = getOperandPayload(i, length);
+            size += OperandValue::compactSize(getOperandValue(i).type, payload, length);
+        }
+        
+        return size + extendedSize;
+    }
+    
+    // Header: opcode, operand count and extended data size
+    size_t size = 4;
+    
+    for (size_t i = 0; i < operandCount; i++) {
+        const OperandValue& value = getOperandValue(i);
+        size_t length = value.length;
+        if (value.isExternal()) {
+            getOperandPayload(i, length);
+        }
+        size += 1 + length;
+    }
+    
+    return size + extendedSize;
+}
+
+size_t Instruction::operandOffset(size_t index, InstructionEncoding encoding) const {
+    size_t extendedSize = getExtendedData().size();
+    
+    if (encoding == ENCODING_COMPACT) {
+        size_t offset = 1 + uleb128Size((static_cast<uint64_t>(operandCount) << 1) | (extendedSize != 0));
+        if (extendedSize != 0) {
+            offset += uleb128Size(extendedSize);
+        }
+        
+        for (size_t i = 0; i < index; i++) {
+            size_t length;
+            const uint8_t* payload = getOperandPayload(i, length);
+            offset += OperandValue::compactSize(getOperandValue(i).type, payload, length);
+        }
+        return offset;
+    }
+    
+    size_t offset = 4;
+    for (size_t i = 0; i < index; i++) {
+        size_t length;
+        getOperandPayload(i, length);
+        offset += 1 + length;
+    }
+    return offset;
+}
+
+void Instruction::encodeInto(ByteWriter& writer, InstructionEncoding encoding) const {
+    const auto& extendedData = getExtendedData();
+    
+    if (encoding == ENCODING_COMPACT) {
+        writer.writeU8(getOpcode());
+        writer.writeULEB128((static_cast<uint64_t>(operandCount) << 1) | !extendedData.empty());
+        if (!extendedData.empty()) {
+            writer.writeULEB128(extendedData.size());
+        }
+        
+        for (size_t i = 0; i < operandCount; i++) {
+            size_t length;
+            const uint8_t* payload = getOperandPayload(i, length);
+            OperandValue::writeCompact(writer, getOperandValue(i).type, payload, length);
+        }
+        
+        writer.writeBytes(extendedData.data(), extendedData.size());
+        return;
+    }
     
     // Encode the instruction header
-    result.push_back(getOpcode());
-    result.push_back(static_cast<uint8_t>(operands.size()));
-    
-    // Encode the extended data size (little-endian)
-    uint16_t extSize = static_cast<uint16_t>(extendedData.size());
-    result.push_back(extSize & 0xFF);
-    result.push_back((extSize >> 8) & 0xFF);
-    
-    // Encode the operands
-    for (const auto& op : operands) {
-        std::vector<uint8_t> opData = op->encode();
-        result.insert(result.end(), opData.begin(), opData.end());
+    writer.writeU8(getOpcode());
+    writer.writeU8(operandCount);
+    writer.writeU16(static_cast<uint16_t>(extendedData.size()));
+    
+    // Encode the operands: each is its type byte followed by its payload
+    for (size_t i = 0; i < operandCount; i++) {
+        size_t length;
+        const uint8_t* payload = getOperandPayload(i, length);
+        writer.writeU8(getOperandValue(i).type);
+        writer.writeBytes(payload, length);
     }
     
     // Append the extended data
-    result.insert(result.end(), extendedData.begin(), extendedData.end());
-    
-    return result;
+    writer.writeBytes(extendedData.data(), extendedData.size());
 }
 
-std::unique_ptr<Instruction> Instruction::decode(const uint8_t* data, size_t& offset) {
+std::unique_ptr<Instruction> Instruction::decode(const uint8_t* data, size_t& offset, InstructionEncoding encoding) {
     // Check if we have enough data for the instruction header
     if (data == nullptr) {
         return nullptr;
@@ -70,9 +263,17 @@ std::unique_ptr<Instruction> Instruction::decode(const uint8_t* data, size_t& of
     
     // Read the instruction header
     uint8_t opcode = data[offset++];
-    uint8_t operandCount = data[offset++];
-    uint16_t extDataSize = data[offset] | (static_cast<uint16_t>(data[offset + 1]) << 8);
-    offset += 2;
+    size_t operandCount;
+    size_t extDataSize;
+    if (encoding == ENCODING_COMPACT) {
+        uint64_t countAndFlag = readULEB128(data, offset);
+        operandCount = static_cast<size_t>(countAndFlag >> 1);
+        extDataSize = (countAndFlag & 1) ? static_cast<size_t>(readULEB128(data, offset)) : 0;
+    } else {
+        operandCount = data[offset++];
+        extDataSize = data[offset] | (static_cast<uint16_t>(data[offset + 1]) << 8);
+        offset += 2;
+    }
     
     // Create the instruction
     uint8_t category = opcode & 0xE0; // Upper 3 bits
@@ -80,22 +281,55 @@ std::unique_ptr<Instruction> Instruction::decode(const uint8_t* data, size_t& of
     auto instruction = std::make_unique<Instruction>(category, operation);
     
     // Decode the operands
-    for (uint8_t i = 0; i < operandCount; i++) {
-        auto operand = Operand::decode(data, offset);
-        if (operand) {
-            instruction->addOperand(std::move(operand));
+    for (size_t i = 0; i < operandCount; i++) {
+        uint8_t typeByte;
+        const uint8_t* payload;
+        size_t length;
+        if (encoding == ENCODING_COMPACT) {
+            // Transcoded payloads are expanded straight into the value
+            OperandValue value{};
+            if (!OperandValue::readCompact(data, offset, value.type, value.payload, payload, length)) {
+                continue;
+            }
+            if (payload == value.payload) {
+                value.length = static_cast<uint8_t>(length);
+                instruction->addOperand(value);
+            } else {
+                instruction->addOperand(value.type, payload, length);
+            }
+            continue;
+        }
+        
+        typeByte = data[offset++];
+        payload = data + offset;
+        if (OperandValue::payloadSize(typeByte, payload, length)) {
+            instruction->addOperand(typeByte, payload, length);
+            offset += length;
         }
     }
     
     // Read the extended data
     if (extDataSize > 0) {
-        instruction->extendedData.assign(data + offset, data + offset + extDataSize);
+        instruction->getOverflow().extendedData.assign(data + offset, data + offset + extDataSize);
         offset += extDataSize;
     }
     
     return instruction;
 }
 
+std::unique_ptr<Instruction> Instruction::decode(const uint8_t* data, size_t size, size_t& offset,
+                                                 InstructionEncoding encoding) {
+    if (data == nullptr) {
+        return nullptr;
+    }
+    
+    InstructionDecoder decoder(encoding);
+    if (!decoder.decodeNext(data, data + size, offset)) {
+        return nullptr;
+    }
+    return decoder.toInstruction(decoder.getInstructions().front());
+}
+
 std::string Instruction::toString() const {
     std::ostringstream oss;
     
@@ -206,6 +440,25 @@ std::string Instruction::toString() const {
                 case BIT_CMP:    opName = "CMP"; break;
             }
             break;
+        case CAT_VEC:
+            switch (operation) {
+                case VEC_MOV:    opName = "MOV"; break;
+                case VEC_LOAD:   opName = "LOAD"; break;
+                case VEC_STORE:  opName = "STORE"; break;
+                case VEC_SPLAT:  opName = "SPLAT"; break;
+                case VEC_ADD:    opName = "ADD"; break;
+                case VEC_SUB:    opName = "SUB"; break;
+                case VEC_MUL:    opName = "MUL"; break;
+                case VEC_DIV:    opName = "DIV"; break;
+                case VEC_MIN:    opName = "MIN"; break;
+                case VEC_MAX:    opName = "MAX"; break;
+                case VEC_AND:    opName = "AND"; break;
+                case VEC_OR:     opName = "OR"; break;
+                case VEC_XOR:    opName = "XOR"; break;
+                case VEC_SQRT:   opName = "SQRT"; break;
+                case VEC_LANES:  opName = "LANES"; break;
+            }
+            break;
         case CAT_VAR:
             switch (operation) {
                 case VAR_DECL:   opName = "DECL"; break;
@@ -229,17 +482,19 @@ std::string Instruction::toString() const {
     oss << categoryName << " " << opName;
     
     // Add the operands
-    if (!operands.empty()) {
+    if (operandCount > 0) {
         oss << " ";
-        for (size_t i = 0; i < operands.size(); i++) {
+        for (size_t i = 0; i < operandCount; i++) {
             if (i > 0) {
                 oss << ", ";
             }
-            oss << operands[i]->toString();
+            OperandPtr operand = makeOperand(i);
+            oss << (operand ? operand->toString() : "<invalid>");
         }
     }
     
     // Add the extended data if present
+    const auto& extendedData = getExtendedData();
     if (!extendedData.empty()) {
         oss << " ; Extended data: ";
         for (uint8_t byte : extendedData) {
@@ -253,13 +508,18 @@ std::string Instruction::toString() const {
 std::unique_ptr<Instruction> Instruction::clone() const {
     auto cloned = std::make_unique<Instruction>(category, operation);
     
-    // Clone all operands
-    for (const auto& op : operands) {
-        cloned->addOperand(op->clone());
-    }
+    // Operand values are plain bytes; external payload offsets stay valid
+    // because the payload block is copied as a whole
+    cloned->operandCount = operandCount;
+    size_t inlineCount = operandCount < INLINE_OPERANDS ? operandCount : INLINE_OPERANDS;
+    std::memcpy(cloned->inlineOperands, inlineOperands, inlineCount * sizeof(OperandValue));
     
-    // Copy extended data
-    cloned->setExtendedData(extendedData);
+    if (overflow) {
+        Overflow& copy = cloned->getOverflow();
+        copy.operands.assign(overflow->operands.begin(), overflow->operands.end());
+        copy.payloads.assign(overflow->payloads.begin(), overflow->payloads.end());
+        copy.extendedData.assign(overflow->extendedData.begin(), overflow->extendedData.end());
+    }
     
     return cloned;
 }
@@ -7,6 +7,9 @@
 #include <string>
 #include "core/defs.h"
 #include "core/operand.h"
+#include "core/operand_value.h"
+#include "util/arena.h"
+#include "util/byte_writer.h"
 
 namespace coil {
 
@@ -18,14 +21,38 @@ using OperandPtr = std::unique_ptr<Operand>;
  * @brief Instruction representation
  * 
  * Represents a COIL instruction with its category, operation,
- * operands, and extended data.
+ * operands, and extended data. Operands are stored as OperandValues, the
+ * first INLINE_OPERANDS of them inside the instruction itself; anything
+ * else (more operands, long symbol names, extended data) goes into a side
+ * block that is only allocated when needed. Instructions created inside an
+ * ArenaScope are allocated, side block included, from the current arena.
  */
-class Instruction {
+class Instruction : public ArenaObject {
+public:
+    static constexpr size_t INLINE_OPERANDS = 4; // Operands stored inline
+
 private:
+    /**
+     * @brief Storage for the parts most instructions don't have
+     */
+    struct Overflow {
+        std::pmr::vector<OperandValue> operands;   // Operands past INLINE_OPERANDS
+        std::pmr::vector<uint8_t> payloads;        // Out-of-line operand payloads
+        std::pmr::vector<uint8_t> extendedData;    // Extended data
+        std::pmr::vector<OperandPtr> adapters;     // Cache for getOperands()
+        
+        explicit Overflow(std::pmr::memory_resource* resource)
+            : operands(resource), payloads(resource), extendedData(resource), adapters(resource) {}
+    };
+    
     uint8_t category;  // Instruction category (bits 7-5 of opcode)
     uint8_t operation; // Operation within category (bits 4-0 of opcode)
-    std::vector<OperandPtr> operands; // Instruction operands
-    std::vector<uint8_t> extendedData; // Extended data
+    uint8_t operandCount; // Number of operands
+    OperandValue inlineOperands[INLINE_OPERANDS]; // First operands
+    std::pmr::memory_resource* resource; // Resource the side block comes from
+    mutable Overflow* overflow; // Side block, or nullptr
+    
+    Overflow& getOverflow() const;
 
 public:
     /**
@@ -36,6 +63,14 @@ public:
      */
     Instruction(uint8_t cat, uint8_t op);
     
+    /**
+     * @brief Destroy the Instruction
+     */
+    ~Instruction();
+    
+    Instruction(const Instruction&) = delete;
+    Instruction& operator=(const Instruction&) = delete;
+    
     /**
      * @brief Add an operand to the instruction
      * 
@@ -43,6 +78,24 @@ public:
      */
     void addOperand(OperandPtr op);
     
+    /**
+     * @brief Add an operand value to the instruction
+     * 
+     * @param value Operand to add (must not be external)
+     */
+    void addOperand(const OperandValue& value);
+    
+    /**
+     * @brief Add an operand given in encoded form
+     * 
+     * Payloads too long to store inline are kept by the instruction.
+     * 
+     * @param typeByte Operand type byte
+     * @param payload Payload bytes
+     * @param length Payload length
+     */
+    void addOperand(uint8_t typeByte, const uint8_t* payload, size_t length);
+    
     /**
      * @brief Set extended data for the instruction
      * 
@@ -72,34 +125,118 @@ public:
     uint8_t getOpcode() const;
     
     /**
-     * @brief Get the operands
+     * @brief Get the number of operands
+     * 
+     * @return Operand count
+     */
+    size_t getOperandCount() const;
+    
+    /**
+     * @brief Get an operand value
+     * 
+     * @param index Operand index
+     * @return Operand value
+     */
+    const OperandValue& getOperandValue(size_t index) const;
+    
+    /**
+     * @brief Get the payload of an operand, wherever it is stored
+     * 
+     * @param index Operand index
+     * @param length Payload length (output parameter)
+     * @return Pointer to the payload bytes
+     */
+    const uint8_t* getOperandPayload(size_t index, size_t& length) const;
+    
+    /**
+     * @brief Create an Operand object for an operand
+     * 
+     * @param index Operand index
+     * @return Operand object, or nullptr for an unknown operand type
+     */
+    OperandPtr makeOperand(size_t index) const;
+    
+    /**
+     * @brief Get the operands as Operand objects
+     * 
+     * The objects are created on first use and cached; adding an operand
+     * invalidates the returned vector.
      * 
      * @return Vector of operands
      */
-    const std::vector<OperandPtr>& getOperands() const;
+    const std::pmr::vector<OperandPtr>& getOperands() const;
     
     /**
      * @brief Get the extended data
      * 
      * @return Extended data bytes
      */
-    const std::vector<uint8_t>& getExtendedData() const;
+    const std::pmr::vector<uint8_t>& getExtendedData() const;
     
     /**
      * @brief Encode the instruction to binary format
      * 
+     * @param encoding Instruction encoding
      * @return Binary encoding of the instruction
      */
-    std::vector<uint8_t> encode() const;
+    std::vector<uint8_t> encode(InstructionEncoding encoding = ENCODING_STANDARD) const;
+    
+    /**
+     * @brief Get the exact size of the binary encoding
+     * 
+     * @param encoding Instruction encoding
+     * @return Encoded size in bytes
+     */
+    size_t encodedSize(InstructionEncoding encoding = ENCODING_STANDARD) const;
+    
+    /**
+     * @brief Get the offset of an operand within the binary encoding
+     * 
+     * @param index Operand index (must be less than getOperandCount())
+     * @param encoding Instruction encoding
+     * @return Offset of the operand's type byte from the opcode
+     */
+    size_t operandOffset(size_t index, InstructionEncoding encoding = ENCODING_STANDARD) const;
+    
+    /**
+     * @brief Append the binary encoding of the instruction to a buffer
+     * 
+     * The standard encoding starts with the opcode, the operand count and
+     * a 16-bit extended data size. The compact encoding follows the opcode
+     * with a LEB128 value holding the operand count shifted left by one,
+     * its low bit set if a LEB128 extended data size comes next; operands
+     * are then written as OperandValue::writeCompact describes.
+     * 
+     * @param writer Destination writer
+     * @param encoding Instruction encoding
+     */
+    void encodeInto(ByteWriter& writer, InstructionEncoding encoding = ENCODING_STANDARD) const;
     
     /**
      * @brief Decode an instruction from binary data
      * 
      * @param data Binary data pointer
      * @param offset Offset into data (updated on return)
+     * @param encoding Instruction encoding the data is in
      * @return Decoded instruction
      */
-    static std::unique_ptr<Instruction> decode(const uint8_t* data, size_t& offset);
+    static std::unique_ptr<Instruction> decode(const uint8_t* data, size_t& offset,
+                                               InstructionEncoding encoding = ENCODING_STANDARD);
+    
+    /**
+     * @brief Decode an instruction without reading past the end of the data
+     * 
+     * Use InstructionDecoder to decode many instructions without
+     * allocating for each one.
+     * 
+     * @param data Binary data pointer
+     * @param size Size of the data
+     * @param offset Offset into data (updated on success)
+     * @param encoding Instruction encoding the data is in
+     * @return Decoded instruction, or nullptr if it is truncated or malformed
+     */
+    static std::unique_ptr<Instruction> decode(const uint8_t* data, size_t size, size_t& offset,
+                                               InstructionEncoding encoding = ENCODING_STANDARD);
     
     /**
      * @brief Get string representation of the instruction
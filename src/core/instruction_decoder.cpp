@@ -0,0 +1,326 @@
+#include "core/instruction_decoder.h"
+#include "core/instruction.h"
+#include "util/leb128.h"
+#include <cstring>
+
+namespace coil {
+
+/**
+ * @brief How an operand's payload is stored after its type byte
+ */
+enum PayloadKind : uint8_t {
+    PAYLOAD_INVALID,       // Unknown type byte
+    PAYLOAD_FIXED,         // size bytes, copied as is
+    PAYLOAD_STRING,        // NUL-terminated, terminator included
+    PAYLOAD_REGISTER,      // Register ID, then flags if COMPACT_REGISTER_FLAGS is set
+    PAYLOAD_INTEGER,       // Signed LEB128, expanded to size bytes
+    PAYLOAD_DISPLACEMENT,  // Register ID, then signed LEB128 expanded to 4 bytes
+    PAYLOAD_ADDRESS        // Unsigned LEB128, expanded to size bytes
+};
+
+/**
+ * @brief Table entry for one operand type byte
+ */
+struct OperandFormat {
+    uint8_t kind;                // PayloadKind
+    uint8_t size;                // Payload size in the standard encoding
+};
+
+/**
+ * @brief Operand formats for every type byte, per encoding
+ */
+struct OperandFormatTable {
+    OperandFormat formats[2][256];
+};
+
+static OperandFormatTable buildFormatTable() {
+    OperandFormatTable table{};
+
+    for (int type = 0; type < 256; type++) {
+        uint8_t typeByte = static_cast<uint8_t>(type);
+        uint8_t operandClass = typeByte & 0xC0;
+        uint8_t subtype = typeByte & 0x3F;
+
+        // The fixed sizes come from OperandValue so the two never disagree
+        OperandFormat standard = {PAYLOAD_INVALID, 0};
+        static const uint8_t emptyString[1] = {0};
+        size_t size;
+        if (operandClass == OPERAND_IMMEDIATE && subtype == IMM_SYMBOL) {
+            standard.kind = PAYLOAD_STRING;
+        } else if (OperandValue::payloadSize(typeByte, emptyString, size)) {
+            standard.kind = PAYLOAD_FIXED;
+            standard.size = static_cast<uint8_t>(size);
+        }
+        table.formats[ENCODING_STANDARD][type] = standard;
+
+        // Same transcoding as OperandValue::writeCompact
+        OperandFormat compact = standard;
+        if (operandClass == OPERAND_REGISTER) {
+            compact.kind = PAYLOAD_REGISTER;
+        } else if (operandClass == OPERAND_IMMEDIATE &&
+                   (subtype == IMM_INT16 || subtype == IMM_INT32 || subtype == IMM_INT64)) {
+            compact.kind = PAYLOAD_INTEGER;
+        } else if (operandClass == OPERAND_MEMORY && subtype == MEM_REG_DISP) {
+            compact.kind = PAYLOAD_DISPLACEMENT;
+        } else if (operandClass == OPERAND_MEMORY && subtype == MEM_DIRECT) {
+            compact.kind = PAYLOAD_ADDRESS;
+        }
+        table.formats[ENCODING_COMPACT][type] = compact;
+    }
+
+    return table;
+}
+
+static const OperandFormatTable formatTable = buildFormatTable();
+
+static void writeLittleEndian(uint8_t* bytes, size_t size, uint64_t value) {
+    for (size_t i = 0; i < size; i++) {
+        bytes[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+InstructionDecoder::InstructionDecoder(InstructionEncoding enc)
+    : encoding(enc), input(nullptr), inputSize(0), errorOffset(SIZE_MAX) {
+}
+
+bool InstructionDecoder::decodeOperand(size_t& offset, OperandValue& value) const {
+    if (offset >= inputSize) {
+        return false;
+    }
+
+    uint8_t typeByte = input[offset++];
+    const OperandFormat& format = formatTable.formats[encoding][typeByte];
+    value.type = typeByte;
+    value.length = format.size;
+
+    switch (format.kind) {
+        case PAYLOAD_FIXED:
+            if (inputSize - offset < format.size) {
+                return false;
+            }
+            // Payloads are at most 8 bytes; a loop beats calling memcpy
+            for (size_t i = 0; i < format.size; i++) {
+                value.payload[i] = input[offset + i];
+            }
+            offset += format.size;
+            return true;
+
+        case PAYLOAD_STRING: {
+            const void* terminator = std::memchr(input + offset, 0, inputSize - offset);
+            if (!terminator) {
+                return false;
+            }
+            size_t length = static_cast<const uint8_t*>(terminator) - (input + offset) + 1;
+            if (length <= OperandValue::INLINE_SIZE) {
+                std::memcpy(value.payload, input + offset, length);
+                value.length = static_cast<uint8_t>(length);
+            } else {
+                // Refer to the name in the input instead of copying it
+                uint32_t start = static_cast<uint32_t>(offset);
+                uint32_t size = static_cast<uint32_t>(length);
+                value.length = OperandValue::EXTERNAL;
+                std::memcpy(value.payload, &start, sizeof(start));
+                std::memcpy(value.payload + sizeof(start), &size, sizeof(size));
+            }
+            offset += length;
+            return true;
+        }
+
+        case PAYLOAD_REGISTER: {
+            bool hasFlags = (typeByte & OperandValue::COMPACT_REGISTER_FLAGS) != 0;
+            if (inputSize - offset < (hasFlags ? 2u : 1u)) {
+                return false;
+            }
+            value.type = typeByte & ~OperandValue::COMPACT_REGISTER_FLAGS;
+            value.payload[0] = input[offset++];
+            value.payload[1] = hasFlags ? input[offset++] : 0;
+            return true;
+        }
+
+        case PAYLOAD_INTEGER: {
+            int64_t integer;
+            if (!readSLEB128(input, inputSize, offset, integer)) {
+                return false;
+            }
+            writeLittleEndian(value.payload, format.size, static_cast<uint64_t>(integer));
+            return true;
+        }
+
+        case PAYLOAD_DISPLACEMENT: {
+            int64_t displacement;
+            if (offset >= inputSize) {
+                return false;
+            }
+            value.payload[0] = input[offset++];
+            if (!readSLEB128(input, inputSize, offset, displacement)) {
+                return false;
+            }
+            writeLittleEndian(value.payload + 1, format.size - 1, static_cast<uint64_t>(displacement));
+            return true;
+        }
+
+        case PAYLOAD_ADDRESS: {
+            uint64_t address;
+            if (!readULEB128(input, inputSize, offset, address)) {
+                return false;
+            }
+            writeLittleEndian(value.payload, format.size, address);
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+bool InstructionDecoder::decode(const uint8_t* begin, const uint8_t* end) {
+    clear();
+
+    size_t size = static_cast<size_t>(end - begin);
+
+    // Instructions take at least two bytes; reserving for that many
+    // would waste memory, so guess from a typical size instead
+    instructions.reserve(size / 8);
+    operands.reserve(size / 4);
+
+    size_t offset = 0;
+    while (offset < size) {
+        if (!decodeNext(begin, end, offset)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool InstructionDecoder::decodeNext(const uint8_t* begin, const uint8_t* end, size_t& offset) {
+    input = begin;
+    inputSize = static_cast<size_t>(end - begin);
+    errorOffset = offset;
+
+    // Offsets are stored in 32 bits
+    if (inputSize > UINT32_MAX || offset >= inputSize) {
+        return false;
+    }
+
+    size_t position = offset;
+    uint8_t opcode = input[position++];
+    uint64_t operandCount;
+    uint64_t extendedSize;
+
+    if (encoding == ENCODING_COMPACT) {
+        uint64_t countAndFlag;
+        if (!readULEB128(input, inputSize, position, countAndFlag)) {
+            return false;
+        }
+        operandCount = countAndFlag >> 1;
+        extendedSize = 0;
+        if ((countAndFlag & 1) && !readULEB128(input, inputSize, position, extendedSize)) {
+            return false;
+        }
+    } else {
+        if (inputSize - position < 3) {
+            return false;
+        }
+        operandCount = input[position];
+        extendedSize = input[position + 1] | (static_cast<uint16_t>(input[position + 2]) << 8);
+        position += 3;
+    }
+
+    // Instructions hold at most 255 operands
+    if (operandCount > UINT8_MAX) {
+        return false;
+    }
+
+    size_t firstOperand = operands.size();
+    operands.resize(firstOperand + operandCount);
+    for (size_t i = 0; i < operandCount; i++) {
+        if (!decodeOperand(position, operands[firstOperand + i])) {
+            operands.resize(firstOperand);
+            return false;
+        }
+    }
+
+    if (inputSize - position < extendedSize) {
+        operands.resize(firstOperand);
+        return false;
+    }
+
+    DecodedInstruction decoded;
+    decoded.offset = static_cast<uint32_t>(offset);
+    decoded.firstOperand = static_cast<uint32_t>(firstOperand);
+    decoded.extendedOffset = static_cast<uint32_t>(position);
+    decoded.extendedSize = static_cast<uint32_t>(extendedSize);
+    decoded.opcode = opcode;
+    decoded.operandCount = static_cast<uint8_t>(operandCount);
+    position += extendedSize;
+    decoded.size = static_cast<uint32_t>(position - offset);
+    instructions.push_back(decoded);
+
+    offset = position;
+    errorOffset = SIZE_MAX;
+    return true;
+}
+
+void InstructionDecoder::clear() {
+    instructions.clear();
+    operands.clear();
+    errorOffset = SIZE_MAX;
+}
+
+const std::vector<DecodedInstruction>& InstructionDecoder::getInstructions() const {
+    return instructions;
+}
+
+const OperandValue& InstructionDecoder::getOperand(const DecodedInstruction& instruction, size_t index) const {
+    return operands[instruction.firstOperand + index];
+}
+
+const uint8_t* InstructionDecoder::getOperandPayload(const DecodedInstruction& instruction, size_t index,
+                                                     size_t& length) const {
+    const OperandValue& value = getOperand(instruction, index);
+
+    if (!value.isExternal()) {
+        length = value.length;
+        return value.payload;
+    }
+
+    uint32_t start;
+    uint32_t size;
+    std::memcpy(&start, value.payload, sizeof(start));
+    std::memcpy(&size, value.payload + sizeof(start), sizeof(size));
+    length = size;
+    return input + start;
+}
+
+const uint8_t* InstructionDecoder::getExtendedData(const DecodedInstruction& instruction) const {
+    return input + instruction.extendedOffset;
+}
+
+std::unique_ptr<Instruction> InstructionDecoder::toInstruction(const DecodedInstruction& instruction) const {
+    auto result = std::make_unique<Instruction>(instruction.getCategory(), instruction.getOperation());
+
+    for (size_t i = 0; i < instruction.operandCount; i++) {
+        const OperandValue& value = getOperand(instruction, i);
+        if (value.isExternal()) {
+            size_t length;
+            const uint8_t* payload = getOperandPayload(instruction, i, length);
+            result->addOperand(value.type, payload, length);
+        } else {
+            result->addOperand(value);
+        }
+    }
+
+    if (instruction.extendedSize > 0) {
+        const uint8_t* data = getExtendedData(instruction);
+        result->setExtendedData(std::vector<uint8_t>(data, data + instruction.extendedSize));
+    }
+
+    return result;
+}
+
+size_t InstructionDecoder::getErrorOffset() const {
+    return errorOffset;
+}
+
+} // namespace coil
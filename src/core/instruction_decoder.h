@@ -0,0 +1,151 @@
+#ifndef COIL_CORE_INSTRUCTION_DECODER_H
+#define COIL_CORE_INSTRUCTION_DECODER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "core/defs.h"
+#include "core/operand_value.h"
+
+namespace coil {
+
+class Instruction;
+
+/**
+ * @brief One instruction decoded by an InstructionDecoder
+ *
+ * Refers to the decoder's operand array and to the decoded input rather
+ * than owning anything, so decoding a section allocates nothing per
+ * instruction.
+ */
+struct DecodedInstruction {
+    uint32_t offset;             // Offset of the instruction in the input
+    uint32_t size;               // Encoded size
+    uint32_t firstOperand;       // Index of the first operand in the decoder
+    uint32_t extendedOffset;     // Offset of the extended data in the input
+    uint32_t extendedSize;       // Size of the extended data
+    uint8_t opcode;              // Combined category and operation
+    uint8_t operandCount;        // Number of operands
+
+    uint8_t getCategory() const { return opcode & 0xE0; }
+    uint8_t getOperation() const { return opcode & 0x1F; }
+};
+
+/**
+ * @brief Allocation-free, bounds-checked decoder for encoded instructions
+ *
+ * Decodes a whole code section into flat arrays that are reused from one
+ * call to the next. Operand payloads are looked up in a 256-entry table
+ * indexed by the operand type byte instead of by switching on the
+ * operand class, and nothing past the end of the input is ever read: a
+ * truncated or malformed instruction stops decoding and is reported
+ * through getErrorOffset().
+ *
+ * Operands are stored in the standard encoding as OperandValues; symbol
+ * names are not copied but refer into the input (see getOperandPayload).
+ */
+class InstructionDecoder {
+private:
+    InstructionEncoding encoding;            // Encoding of the input
+    const uint8_t* input;                    // Last decoded input
+    size_t inputSize;                        // Size of the last decoded input
+    size_t errorOffset;                      // Offset of the bad instruction, or SIZE_MAX
+    std::vector<DecodedInstruction> instructions; // Decoded instructions
+    std::vector<OperandValue> operands;      // Operands of all instructions
+
+    bool decodeOperand(size_t& offset, OperandValue& value) const;
+
+public:
+    /**
+     * @brief Construct a new decoder
+     *
+     * @param enc Encoding of the data to decode
+     */
+    explicit InstructionDecoder(InstructionEncoding enc = ENCODING_STANDARD);
+
+    /**
+     * @brief Decode every instruction in a range
+     *
+     * Replaces the results of any earlier call. The input has to stay
+     * alive while the results are used.
+     *
+     * @param begin First byte
+     * @param end One past the last byte (at most 4 GiB after begin)
+     * @return true if the whole range decoded, false if decoding stopped
+     *         at a malformed instruction (the ones before it are kept)
+     */
+    bool decode(const uint8_t* begin, const uint8_t* end);
+
+    /**
+     * @brief Decode the instruction at an offset
+     *
+     * Appends to the results of earlier calls on the same input.
+     *
+     * @param begin First byte of the input
+     * @param end One past the last byte of the input
+     * @param offset Offset of the instruction (advanced past it on success)
+     * @return true on success, false if the instruction is truncated or
+     *         malformed
+     */
+    bool decodeNext(const uint8_t* begin, const uint8_t* end, size_t& offset);
+
+    /**
+     * @brief Drop the results, keeping the memory for reuse
+     */
+    void clear();
+
+    /**
+     * @brief Get the decoded instructions
+     *
+     * @return Instructions in input order
+     */
+    const std::vector<DecodedInstruction>& getInstructions() const;
+
+    /**
+     * @brief Get an operand of a decoded instruction
+     *
+     * @param instruction Decoded instruction
+     * @param index Operand index (must be less than its operand count)
+     * @return Operand value (external payloads refer into the input)
+     */
+    const OperandValue& getOperand(const DecodedInstruction& instruction, size_t index) const;
+
+    /**
+     * @brief Get the payload of an operand, wherever it is stored
+     *
+     * @param instruction Decoded instruction
+     * @param index Operand index (must be less than its operand count)
+     * @param length Payload length (output parameter)
+     * @return Pointer to the payload bytes
+     */
+    const uint8_t* getOperandPayload(const DecodedInstruction& instruction, size_t index, size_t& length) const;
+
+    /**
+     * @brief Get the extended data of a decoded instruction
+     *
+     * @param instruction Decoded instruction
+     * @return Pointer into the input (extendedSize bytes)
+     */
+    const uint8_t* getExtendedData(const DecodedInstruction& instruction) const;
+
+    /**
+     * @brief Build an Instruction from a decoded instruction
+     *
+     * @param instruction Decoded instruction
+     * @return Instruction owning copies of its operands
+     */
+    std::unique_ptr<Instruction> toInstruction(const DecodedInstruction& instruction) const;
+
+    /**
+     * @brief Get where decoding stopped
+     *
+     * @return Offset of the malformed instruction, or SIZE_MAX if the
+     *         last decode succeeded
+     */
+    size_t getErrorOffset() const;
+};
+
+} // namespace coil
+
+#endif // COIL_CORE_INSTRUCTION_DECODER_H
@@ -1,15 +1,52 @@
 #include "core/operand.h"
+#include "core/operand_value.h"
 #include <sstream>
 #include <iomanip>
 #include <cstring>
 
 namespace coil {
 
-std::unique_ptr<Operand> Operand::decode(const uint8_t* data, size_t& offset) {
+std::vector<uint8_t> Operand::encode(InstructionEncoding encoding) const {
+    std::vector<uint8_t> result;
+    result.reserve(encodedSize());
+    ByteWriter writer(result);
+    encodeInto(writer);
+    
+    if (encoding == ENCODING_COMPACT) {
+        // The operand classes only know the standard form; transcode it
+        std::vector<uint8_t> compact;
+        ByteWriter compactWriter(compact);
+        OperandValue::writeCompact(compactWriter, result[0], result.data() + 1, result.size() - 1);
+        return compact;
+    }
+    
+    return result;
+}
+
+std::unique_ptr<Operand> Operand::decode(const uint8_t* data, size_t& offset, InstructionEncoding encoding) {
     if (data == nullptr) {
         return nullptr;
     }
     
+    if (encoding == ENCODING_COMPACT) {
+        // Expand to the standard form and decode that
+        uint8_t typeByte;
+        uint8_t buffer[OperandValue::INLINE_SIZE];
+        const uint8_t* payload;
+        size_t length;
+        if (!OperandValue::readCompact(data, offset, typeByte, buffer, payload, length)) {
+            return nullptr;
+        }
+        
+        std::vector<uint8_t> standard;
+        standard.reserve(length + 1);
+        standard.push_back(typeByte);
+        standard.insert(standard.end(), payload, payload + length);
+        
+        size_t standardOffset = 0;
+        return decode(standard.data(), standardOffset);
+    }
+    
     uint8_t typeByte = data[offset];
     uint8_t operandClass = typeByte & 0xC0; // Upper 2 bits
     
@@ -40,12 +77,14 @@ uint8_t RegisterOperand::getTypeByte() const {
     return OPERAND_REGISTER | regType;
 }
 
-std::vector<uint8_t> RegisterOperand::encode() const {
-    std::vector<uint8_t> result;
-    result.push_back(getTypeByte());
-    result.push_back(regId);
-    result.push_back(flags);
-    return result;
+size_t RegisterOperand::encodedSize() const {
+    return 3;
+}
+
+void RegisterOperand::encodeInto(ByteWriter& writer) const {
+    writer.writeU8(getTypeByte());
+    writer.writeU8(regId);
+    writer.writeU8(flags);
 }
 
 std::string RegisterOperand::toString() const {
@@ -120,11 +159,11 @@ std::unique_ptr<RegisterOperand> RegisterOperand::decode(const uint8_t* data, si
 //
 
 ImmediateOperand::ImmediateOperand(uint8_t type, const std::vector<uint8_t>& val)
-    : immType(type), value(val) {
+    : immType(type), value(val.begin(), val.end(), Arena::currentResource()) {
 }
 
 ImmediateOperand::ImmediateOperand(int32_t val) 
-    : immType(IMM_INT32), value(4) {
+    : immType(IMM_INT32), value(4, Arena::currentResource()) {
     // Store as little-endian bytes
     value[0] = val & 0xFF;
     value[1] = (val >> 8) & 0xFF;
@@ -133,7 +172,7 @@ ImmediateOperand::ImmediateOperand(int32_t val)
 }
 
 ImmediateOperand::ImmediateOperand(int64_t val)
-    : immType(IMM_INT64), value(8) {
+    : immType(IMM_INT64), value(8, Arena::currentResource()) {
     // Store as little-endian bytes
     value[0] = val & 0xFF;
     value[1] = (val >> 8) & 0xFF;
@@ -146,19 +185,19 @@ ImmediateOperand::ImmediateOperand(int64_t val)
 }
 
 ImmediateOperand::ImmediateOperand(float val)
-    : immType(IMM_FLOAT32), value(4) {
+    : immType(IMM_FLOAT32), value(4, Arena::currentResource()) {
     // Copy raw bytes
     std::memcpy(value.data(), &val, 4);
 }
 
 ImmediateOperand::ImmediateOperand(double val)
-    : immType(IMM_FLOAT64), value(8) {
+    : immType(IMM_FLOAT64), value(8, Arena::currentResource()) {
     // Copy raw bytes
     std::memcpy(value.data(), &val, 8);
 }
 
 ImmediateOperand::ImmediateOperand(const std::string& symbol)
-    : immType(IMM_SYMBOL), value(symbol.begin(), symbol.end()) {
+    : immType(IMM_SYMBOL), value(symbol.begin(), symbol.end(), Arena::currentResource()) {
     // Add null terminator
     value.push_back(0);
 }
@@ -167,11 +206,13 @@ uint8_t ImmediateOperand::getTypeByte() const {
     return OPERAND_IMMEDIATE | immType;
 }
 
-std::vector<uint8_t> ImmediateOperand::encode() const {
-    std::vector<uint8_t> result;
-    result.push_back(getTypeByte());
-    result.insert(result.end(), value.begin(), value.end());
-    return result;
+size_t ImmediateOperand::encodedSize() const {
+    return 1 + value.size();
+}
+
+void ImmediateOperand::encodeInto(ByteWriter& writer) const {
+    writer.writeU8(getTypeByte());
+    writer.writeBytes(value.data(), value.size());
 }
 
 std::string ImmediateOperand::toString() const {
@@ -210,14 +251,14 @@ std::string ImmediateOperand::toString() const {
 }
 
 std::unique_ptr<Operand> ImmediateOperand::clone() const {
-    return std::make_unique<ImmediateOperand>(immType, value);
+    return std::make_unique<ImmediateOperand>(immType, std::vector<uint8_t>(value.begin(), value.end()));
 }
 
 uint8_t ImmediateOperand::getImmType() const {
     return immType;
 }
 
-const std::vector<uint8_t>& ImmediateOperand::getValue() const {
+const std::pmr::vector<uint8_t>& ImmediateOperand::getValue() const {
     return value;
 }
 
@@ -326,16 +367,16 @@ std::unique_ptr<ImmediateOperand> ImmediateOperand::decode(const uint8_t* data,
 //
 
 MemoryOperand::MemoryOperand(uint8_t type, const std::vector<uint8_t>& opData)
-    : memType(type), data(opData) {
+    : memType(type), data(opData.begin(), opData.end(), Arena::currentResource()) {
 }
 
 MemoryOperand::MemoryOperand(uint8_t regId)
-    : memType(MEM_REG), data(1) {
+    : memType(MEM_REG), data(1, Arena::currentResource()) {
     data[0] = regId;
 }
 
 MemoryOperand::MemoryOperand(uint8_t regId, int32_t disp)
-    : memType(MEM_REG_DISP), data(5) {
+    : memType(MEM_REG_DISP), data(5, Arena::currentResource()) {
     data[0] = regId;
     data[1] = disp & 0xFF;
     data[2] = (disp >> 8) & 0xFF;
@@ -344,13 +385,13 @@ MemoryOperand::MemoryOperand(uint8_t regId, int32_t disp)
 }
 
 MemoryOperand::MemoryOperand(uint8_t regId1, uint8_t regId2)
-    : memType(MEM_REG_REG), data(2) {
+    : memType(MEM_REG_REG), data(2, Arena::currentResource()) {
     data[0] = regId1;
     data[1] = regId2;
 }
 
 MemoryOperand::MemoryOperand(uint8_t regId1, uint8_t regId2, uint8_t scale)
-    : memType(MEM_REG_REG_SCALE), data(3) {
+    : memType(MEM_REG_REG_SCALE), data(3, Arena::currentResource()) {
     data[0] = regId1;
     data[1] = regId2;
     data[2] = scale;
@@ -360,11 +401,13 @@ uint8_t MemoryOperand::getTypeByte() const {
     return OPERAND_MEMORY | memType;
 }
 
-std::vector<uint8_t> MemoryOperand::encode() const {
-    std::vector<uint8_t> result;
-    result.push_back(getTypeByte());
-    result.insert(result.end(), data.begin(), data.end());
-    return result;
+size_t MemoryOperand::encodedSize() const {
+    return 1 + data.size();
+}
+
+void MemoryOperand::encodeInto(ByteWriter& writer) const {
+    writer.writeU8(getTypeByte());
+    writer.writeBytes(data.data(), data.size());
 }
 
 std::string MemoryOperand::toString() const {
@@ -449,14 +492,14 @@ std::string MemoryOperand::toString() const {
 }
 
 std::unique_ptr<Operand> MemoryOperand::clone() const {
-    return std::make_unique<MemoryOperand>(memType, data);
+    return std::make_unique<MemoryOperand>(memType, std::vector<uint8_t>(data.begin(), data.end()));
 }
 
 uint8_t MemoryOperand::getMemType() const {
     return memType;
 }
 
-const std::vector<uint8_t>& MemoryOperand::getData() const {
+const std::pmr::vector<uint8_t>& MemoryOperand::getData() const {
     return data;
 }
 
@@ -518,11 +561,13 @@ uint8_t VariableOperand::getTypeByte() const {
     return OPERAND_VARIABLE | varType;
 }
 
-std::vector<uint8_t> VariableOperand::encode() const {
-    std::vector<uint8_t> result;
-    result.push_back(getTypeByte());
-    result.push_back(varId);
-    return result;
+size_t VariableOperand::encodedSize() const {
+    return 2;
+}
+
+void VariableOperand::encodeInto(ByteWriter& writer) const {
+    writer.writeU8(getTypeByte());
+    writer.writeU8(varId);
 }
 
 std::string VariableOperand::toString() const {
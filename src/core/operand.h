@@ -5,14 +5,19 @@
 #include <vector>
 #include <memory>
 #include <string>
+#include <memory_resource>
 #include "core/defs.h"
+#include "util/arena.h"
+#include "util/byte_writer.h"
 
 namespace coil {
 
 /**
  * @brief Base class for all operand types
+ *
+ * Operands created inside an ArenaScope live in the current arena.
  */
-class Operand {
+class Operand : public ArenaObject {
 public:
     virtual ~Operand() = default;
     
@@ -26,9 +31,24 @@ public:
     /**
      * @brief Encode the operand to binary format
      * 
+     * @param encoding Instruction encoding
      * @return Binary encoding of the operand
      */
-    virtual std::vector<uint8_t> encode() const = 0;
+    std::vector<uint8_t> encode(InstructionEncoding encoding = ENCODING_STANDARD) const;
+    
+    /**
+     * @brief Get the exact size of the binary encoding
+     * 
+     * @return Encoded size in bytes, including the type byte
+     */
+    virtual size_t encodedSize() const = 0;
+    
+    /**
+     * @brief Append the binary encoding of the operand to a buffer
+     * 
+     * @param writer Destination writer
+     */
+    virtual void encodeInto(ByteWriter& writer) const = 0;
     
     /**
      * @brief Get string representation of the operand
@@ -49,9 +69,11 @@ public:
      * 
      * @param data Binary data pointer
      * @param offset Offset into data (updated on return)
+     * @param encoding Instruction encoding the data is in
      * @return Decoded operand
      */
-    static std::unique_ptr<Operand> decode(const uint8_t* data, size_t& offset);
+    static std::unique_ptr<Operand> decode(const uint8_t* data, size_t& offset,
+                                           InstructionEncoding encoding = ENCODING_STANDARD);
 };
 
 /**
@@ -74,7 +96,8 @@ public:
     RegisterOperand(uint8_t type, uint8_t id, uint8_t flg = 0);
     
     uint8_t getTypeByte() const override;
-    std::vector<uint8_t> encode() const override;
+    size_t encodedSize() const override;
+    void encodeInto(ByteWriter& writer) const override;
     std::string toString() const override;
     std::unique_ptr<Operand> clone() const override;
     
@@ -115,7 +138,7 @@ public:
 class ImmediateOperand : public Operand {
 private:
     uint8_t immType;             // Immediate type
-    std::vector<uint8_t> value;  // Immediate value
+    std::pmr::vector<uint8_t> value;  // Immediate value
 
 public:
     /**
@@ -162,7 +185,8 @@ public:
     explicit ImmediateOperand(const std::string& symbol);
     
     uint8_t getTypeByte() const override;
-    std::vector<uint8_t> encode() const override;
+    size_t encodedSize() const override;
+    void encodeInto(ByteWriter& writer) const override;
     std::string toString() const override;
     std::unique_ptr<Operand> clone() const override;
     
@@ -178,7 +202,7 @@ public:
      * 
      * @return Immediate value bytes
      */
-    const std::vector<uint8_t>& getValue() const;
+    const std::pmr::vector<uint8_t>& getValue() const;
     
     /**
      * @brief Get the immediate value as int32
@@ -224,7 +248,7 @@ public:
 class MemoryOperand : public Operand {
 private:
     uint8_t memType;          // Memory access type
-    std::vector<uint8_t> data; // Memory operand data
+    std::pmr::vector<uint8_t> data; // Memory operand data
 
 public:
     /**
@@ -268,7 +292,8 @@ public:
     MemoryOperand(uint8_t regId1, uint8_t regId2, uint8_t scale);
     
     uint8_t getTypeByte() const override;
-    std::vector<uint8_t> encode() const override;
+    size_t encodedSize() const override;
+    void encodeInto(ByteWriter& writer) const override;
     std::string toString() const override;
     std::unique_ptr<Operand> clone() const override;
     
@@ -284,7 +309,7 @@ public:
      * 
      * @return Memory operand data bytes
      */
-    const std::vector<uint8_t>& getData() const;
+    const std::pmr::vector<uint8_t>& getData() const;
     
     /**
      * @brief Decode a memory operand from binary data
@@ -321,7 +346,8 @@ public:
     explicit VariableOperand(uint8_t id);
     
     uint8_t getTypeByte() const override;
-    std::vector<uint8_t> encode() const override;
+    size_t encodedSize() const override;
+    void encodeInto(ByteWriter& writer) const override;
     std::string toString() const override;
     std::unique_ptr<Operand> clone() const override;
     
@@ -0,0 +1,247 @@
+#include "core/operand_value.h"
+#include "util/leb128.h"
+#include <cstring>
+
+namespace coil {
+
+/**
+ * @brief Ways the compact encoding transcodes a standard payload
+ */
+enum CompactForm {
+    COMPACT_RAW,           // Copied as is
+    COMPACT_REGISTER,      // Register ID, flags only if set
+    COMPACT_INTEGER,       // Whole payload as signed LEB128
+    COMPACT_DISPLACEMENT,  // Register ID, then displacement as signed LEB128
+    COMPACT_ADDRESS        // Whole payload as unsigned LEB128
+};
+
+static CompactForm compactForm(uint8_t typeByte) {
+    uint8_t subtype = typeByte & 0x3F;
+    
+    switch (typeByte & 0xC0) {
+        case OPERAND_REGISTER:
+            return COMPACT_REGISTER;
+        case OPERAND_IMMEDIATE:
+            // 8-bit integers gain nothing; floats and symbols stay raw
+            return subtype == IMM_INT16 || subtype == IMM_INT32 || subtype == IMM_INT64
+                ? COMPACT_INTEGER : COMPACT_RAW;
+        case OPERAND_MEMORY:
+            return subtype == MEM_REG_DISP ? COMPACT_DISPLACEMENT
+                 : subtype == MEM_DIRECT ? COMPACT_ADDRESS : COMPACT_RAW;
+        default:
+            return COMPACT_RAW;
+    }
+}
+
+static uint64_t readUnsigned(const uint8_t* bytes, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value |= static_cast<uint64_t>(bytes[i]) << (i * 8);
+    }
+    return value;
+}
+
+static int64_t readSigned(const uint8_t* bytes, size_t size) {
+    uint64_t value = readUnsigned(bytes, size);
+    if (size < 8 && (bytes[size - 1] & 0x80)) {
+        value |= ~0ull << (size * 8);
+    }
+    return static_cast<int64_t>(value);
+}
+
+static void writeUnsigned(uint8_t* bytes, size_t size, uint64_t value) {
+    for (size_t i = 0; i < size; i++) {
+        bytes[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+OperandValue OperandValue::makeInline(uint8_t typeByte, const uint8_t* bytes, size_t size) {
+    OperandValue value{};
+    value.type = typeByte;
+    value.length = static_cast<uint8_t>(size);
+    if (size > 0) {
+        std::memcpy(value.payload, bytes, size);
+    }
+    return value;
+}
+
+OperandValue OperandValue::makeRegister(uint8_t regType, uint8_t regId, uint8_t flags) {
+    const uint8_t bytes[2] = {regId, flags};
+    return makeInline(OPERAND_REGISTER | regType, bytes, sizeof(bytes));
+}
+
+OperandValue OperandValue::makeImmediate(int64_t value) {
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = static_cast<uint8_t>(static_cast<uint64_t>(value) >> (i * 8));
+    }
+    return makeInline(OPERAND_IMMEDIATE | IMM_INT64, bytes, sizeof(bytes));
+}
+
+OperandValue OperandValue::makeImmediate(double value) {
+    uint8_t bytes[8];
+    std::memcpy(bytes, &value, sizeof(bytes));
+    return makeInline(OPERAND_IMMEDIATE | IMM_FLOAT64, bytes, sizeof(bytes));
+}
+
+OperandValue OperandValue::makeVariable(uint8_t varId, uint8_t varType) {
+    return makeInline(OPERAND_VARIABLE | varType, &varId, 1);
+}
+
+OperandValue OperandValue::makeMemory(uint8_t regId) {
+    return makeInline(OPERAND_MEMORY | MEM_REG, &regId, 1);
+}
+
+OperandValue OperandValue::makeMemory(uint8_t regId, int32_t disp) {
+    const uint8_t bytes[5] = {
+        regId,
+        static_cast<uint8_t>(disp & 0xFF),
+        static_cast<uint8_t>((disp >> 8) & 0xFF),
+        static_cast<uint8_t>((disp >> 16) & 0xFF),
+        static_cast<uint8_t>((disp >> 24) & 0xFF)
+    };
+    return makeInline(OPERAND_MEMORY | MEM_REG_DISP, bytes, sizeof(bytes));
+}
+
+OperandValue OperandValue::makeMemory(uint8_t regId1, uint8_t regId2) {
+    const uint8_t bytes[2] = {regId1, regId2};
+    return makeInline(OPERAND_MEMORY | MEM_REG_REG, bytes, sizeof(bytes));
+}
+
+OperandValue OperandValue::makeMemory(uint8_t regId1, uint8_t regId2, uint8_t scale) {
+    const uint8_t bytes[3] = {regId1, regId2, scale};
+    return makeInline(OPERAND_MEMORY | MEM_REG_REG_SCALE, bytes, sizeof(bytes));
+}
+
+bool OperandValue::payloadSize(uint8_t typeByte, const uint8_t* payload, size_t& size) {
+    uint8_t subtype = typeByte & 0x3F;
+    
+    switch (typeByte & 0xC0) {
+        case OPERAND_REGISTER:
+            size = 2; // Register ID + flags
+            return true;
+        case OPERAND_IMMEDIATE:
+            switch (subtype) {
+                case IMM_INT8:    size = 1; return true;
+                case IMM_INT16:   size = 2; return true;
+                case IMM_INT32:
+                case IMM_FLOAT32: size = 4; return true;
+                case IMM_INT64:
+                case IMM_FLOAT64: size = 8; return true;
+                case IMM_SYMBOL:
+                    // Null-terminated string, terminator included
+                    size = std::strlen(reinterpret_cast<const char*>(payload)) + 1;
+                    return true;
+                default:
+                    return false;
+            }
+        case OPERAND_MEMORY:
+            switch (subtype) {
+                case MEM_DIRECT:        size = 4; return true; // 32-bit address
+                case MEM_REG:
+                case MEM_REG_PRE_INC:
+                case MEM_REG_PRE_DEC:
+                case MEM_REG_POST_INC:
+                case MEM_REG_POST_DEC:  size = 1; return true; // Register ID
+                case MEM_REG_DISP:      size = 5; return true; // Register ID + 32-bit displacement
+                case MEM_REG_REG:       size = 2; return true; // Two register IDs
+                case MEM_REG_REG_SCALE: size = 3; return true; // Two register IDs + scale
+                default:
+                    return false;
+            }
+        case OPERAND_VARIABLE:
+            size = 1; // Variable ID
+            return true;
+    }
+    
+    return false;
+}
+
+size_t OperandValue::compactSize(uint8_t typeByte, const uint8_t* payload, size_t length) {
+    switch (compactForm(typeByte)) {
+        case COMPACT_REGISTER:
+            return payload[1] != 0 ? 3 : 2;
+        case COMPACT_INTEGER:
+            return 1 + sleb128Size(readSigned(payload, length));
+        case COMPACT_DISPLACEMENT:
+            return 2 + sleb128Size(readSigned(payload + 1, length - 1));
+        case COMPACT_ADDRESS:
+            return 1 + uleb128Size(readUnsigned(payload, length));
+        default:
+            return 1 + length;
+    }
+}
+
+void OperandValue::writeCompact(ByteWriter& writer, uint8_t typeByte, const uint8_t* payload, size_t length) {
+    switch (compactForm(typeByte)) {
+        case COMPACT_REGISTER:
+            if (payload[1] != 0) {
+                writer.writeU8(typeByte | COMPACT_REGISTER_FLAGS);
+                writer.writeU8(payload[0]);
+                writer.writeU8(payload[1]);
+            } else {
+                writer.writeU8(typeByte);
+                writer.writeU8(payload[0]);
+            }
+            break;
+        case COMPACT_INTEGER:
+            writer.writeU8(typeByte);
+            writer.writeSLEB128(readSigned(payload, length));
+            break;
+        case COMPACT_DISPLACEMENT:
+            writer.writeU8(typeByte);
+            writer.writeU8(payload[0]);
+            writer.writeSLEB128(readSigned(payload + 1, length - 1));
+            break;
+        case COMPACT_ADDRESS:
+            writer.writeU8(typeByte);
+            writer.writeULEB128(readUnsigned(payload, length));
+            break;
+        default:
+            writer.writeU8(typeByte);
+            writer.writeBytes(payload, length);
+            break;
+    }
+}
+
+bool OperandValue::readCompact(const uint8_t* data, size_t& offset, uint8_t& typeByte,
+                               uint8_t* buffer, const uint8_t*& payload, size_t& length) {
+    typeByte = data[offset++];
+    
+    switch (compactForm(typeByte)) {
+        case COMPACT_REGISTER: {
+            bool hasFlags = (typeByte & COMPACT_REGISTER_FLAGS) != 0;
+            typeByte &= ~COMPACT_REGISTER_FLAGS;
+            buffer[0] = data[offset++];
+            buffer[1] = hasFlags ? data[offset++] : 0;
+            length = 2;
+            break;
+        }
+        case COMPACT_INTEGER:
+            // IMM_INT16, IMM_INT32 and IMM_INT64 are 2, 4 and 8 bytes wide
+            length = size_t(1) << (typeByte & 0x3F);
+            writeUnsigned(buffer, length, static_cast<uint64_t>(readSLEB128(data, offset)));
+            break;
+        case COMPACT_DISPLACEMENT:
+            length = 5;
+            buffer[0] = data[offset++];
+            writeUnsigned(buffer + 1, 4, static_cast<uint64_t>(readSLEB128(data, offset)));
+            break;
+        case COMPACT_ADDRESS:
+            length = 4;
+            writeUnsigned(buffer, 4, readULEB128(data, offset));
+            break;
+        default:
+            if (!payloadSize(typeByte, data + offset, length)) {
+                return false;
+            }
+            payload = data + offset;
+            offset += length;
+            return true;
+    }
+    
+    payload = buffer;
+    return true;
+}
+
+} // namespace coil
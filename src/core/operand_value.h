@@ -0,0 +1,128 @@
+#ifndef COIL_CORE_OPERAND_VALUE_H
+#define COIL_CORE_OPERAND_VALUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "core/defs.h"
+#include "util/byte_writer.h"
+
+namespace coil {
+
+/**
+ * @brief Compact operand stored inline in an Instruction
+ *
+ * Holds an operand the way it is encoded: the type byte followed by its
+ * payload. Every operand except a long symbol name fits in the inline
+ * payload; longer payloads are kept by the owning Instruction and the
+ * value records where (see isExternal()). The struct is trivially
+ * copyable, so operands are copied and encoded with memcpy.
+ *
+ * The payload is always kept in the standard encoding; the compact
+ * encoding (ENCODING_COMPACT) is produced and read by transcoding it:
+ * integer immediates and displacements become LEB128, and a register's
+ * flags byte is only written when it is not zero.
+ */
+struct OperandValue {
+    static constexpr size_t INLINE_SIZE = 14;  // Largest inline payload
+    static constexpr uint8_t EXTERNAL = 0xFF;  // length marker for out-of-line payloads
+    static constexpr uint8_t COMPACT_REGISTER_FLAGS = 0x20; // Compact register type bit: flags byte follows
+
+    uint8_t type;                  // Type byte (operand class in bits 7-6)
+    uint8_t length;                // Payload length, or EXTERNAL
+    uint8_t payload[INLINE_SIZE];  // Payload bytes (little-endian)
+
+    /**
+     * @brief Get the operand class
+     *
+     * @return Operand class (OPERAND_REGISTER, OPERAND_IMMEDIATE, ...)
+     */
+    uint8_t getClass() const { return type & 0xC0; }
+
+    /**
+     * @brief Get the class-specific subtype
+     *
+     * @return Subtype (RegisterType, ImmediateType, MemoryType or VariableRefType)
+     */
+    uint8_t getSubtype() const { return type & 0x3F; }
+
+    /**
+     * @brief Check if the payload is stored by the owning instruction
+     *
+     * @return true if the payload is out of line
+     */
+    bool isExternal() const { return length == EXTERNAL; }
+
+    /**
+     * @brief Create a value from an encoded payload that fits inline
+     *
+     * @param typeByte Operand type byte
+     * @param bytes Payload bytes
+     * @param size Payload size (at most INLINE_SIZE)
+     * @return Operand value
+     */
+    static OperandValue makeInline(uint8_t typeByte, const uint8_t* bytes, size_t size);
+
+    static OperandValue makeRegister(uint8_t regType, uint8_t regId, uint8_t flags = 0);
+    static OperandValue makeImmediate(int64_t value);
+    static OperandValue makeImmediate(double value);
+    static OperandValue makeVariable(uint8_t varId, uint8_t varType = VAR_DIRECT);
+    static OperandValue makeMemory(uint8_t regId);
+    static OperandValue makeMemory(uint8_t regId, int32_t disp);
+    static OperandValue makeMemory(uint8_t regId1, uint8_t regId2);
+    static OperandValue makeMemory(uint8_t regId1, uint8_t regId2, uint8_t scale);
+
+    /**
+     * @brief Get the size of an encoded operand's payload
+     *
+     * @param typeByte Operand type byte
+     * @param payload Encoded payload following the type byte
+     * @param size Payload size (output parameter)
+     * @return true if the type is known, false otherwise
+     */
+    static bool payloadSize(uint8_t typeByte, const uint8_t* payload, size_t& size);
+
+    /**
+     * @brief Get the size of an operand in the compact encoding
+     *
+     * @param typeByte Operand type byte
+     * @param payload Payload in the standard encoding
+     * @param length Payload length
+     * @return Encoded size in bytes, including the type byte
+     */
+    static size_t compactSize(uint8_t typeByte, const uint8_t* payload, size_t length);
+
+    /**
+     * @brief Append an operand in the compact encoding
+     *
+     * @param writer Destination writer
+     * @param typeByte Operand type byte
+     * @param payload Payload in the standard encoding
+     * @param length Payload length
+     */
+    static void writeCompact(ByteWriter& writer, uint8_t typeByte, const uint8_t* payload, size_t length);
+
+    /**
+     * @brief Read an operand in the compact encoding
+     *
+     * Transcoded payloads are expanded back into the standard encoding in
+     * a caller-provided buffer; any other payload is returned in place.
+     *
+     * @param data Binary data pointer
+     * @param offset Offset into data (updated on return)
+     * @param typeByte Operand type byte (output parameter)
+     * @param buffer Scratch space of at least INLINE_SIZE bytes
+     * @param payload Payload in the standard encoding (output parameter)
+     * @param length Payload length (output parameter)
+     * @return true if the type is known, false otherwise
+     */
+    static bool readCompact(const uint8_t* data, size_t& offset, uint8_t& typeByte,
+                            uint8_t* buffer, const uint8_t*& payload, size_t& length);
+};
+
+static_assert(sizeof(OperandValue) == 16, "OperandValue must stay 16 bytes");
+static_assert(std::is_trivially_copyable<OperandValue>::value, "OperandValue must be memcpy-able");
+
+} // namespace coil
+
+#endif // COIL_CORE_OPERAND_VALUE_H
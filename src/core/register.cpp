@@ -41,10 +41,10 @@ std::string Register::getIdString() const {
             oss << "R" << static_cast<int>(regId);
             break;
         case REG_FP:
-            oss << "F" << static_cast<int>(regId);
+            oss << "F" << static_cast<int>(regId - REG_F0);
             break;
         case REG_VEC:
-            oss << "V" << static_cast<int>(regId);
+            oss << "V" << static_cast<int>(regId - REG_V0);
             break;
         case REG_SPECIAL:
             // Special registers have specific names
@@ -0,0 +1,192 @@
+#include "driver/assembler.h"
+#include <cstdio>
+#include <filesystem>
+#include "binary/function_cache.h"
+#include "opt/function_order.h"
+#include "opt/pass.h"
+#include "parser/lexer.h"
+#include "parser/parser.h"
+#include "target/target.h"
+#include "util/logger.h"
+#include "util/mapped_file.h"
+
+namespace coil {
+
+Assembler::Assembler(const AssemblyOptions& assemblyOptions, IncludeCache* sharedIncludeCache)
+    : options(assemblyOptions), includeCache(sharedIncludeCache ? sharedIncludeCache : &ownIncludeCache) {
+    // A pool of one thread would run every task inline anyway
+    if (options.jobs != 1) {
+        pool = std::make_unique<ThreadPool>(options.jobs);
+    }
+}
+
+std::string Assembler::functionCacheFile(const std::string& inputName) const {
+    size_t slashPos = inputName.find_last_of("/\\");
+    std::string baseName = slashPos != std::string::npos ? inputName.substr(slashPos + 1) : inputName;
+
+    char pathHash[17];
+    snprintf(pathHash, sizeof(pathHash), "%016llx",
+             static_cast<unsigned long long>(FunctionCache::hash(inputName.data(), inputName.size())));
+
+    return (std::filesystem::path(options.cacheDir) / (baseName + "." + pathHash + ".fcache")).string();
+}
+
+uint64_t Assembler::functionCacheConfig() const {
+    uint64_t config = 0;
+    for (const auto& targetName : options.targetNames) {
+        config = FunctionCache::hash(targetName.data(), targetName.size() + 1, config);
+    }
+    config = FunctionCache::hash(&options.encoding, sizeof(options.encoding), config);
+    config = FunctionCache::hash(&options.optLevel, sizeof(options.optLevel), config);
+    return FunctionCache::hash(&options.native, sizeof(options.native), config);
+}
+
+std::unique_ptr<CofFile> Assembler::assemble(std::string_view source, const std::string& inputName,
+                                             DiagnosticEngine& diag, TimeReport* report) {
+    diag.setErrorLimit(options.errorLimit);
+
+    // Functions unchanged since the last run are reused from the cache,
+    // which has to outlive the module
+    std::unique_ptr<FunctionCache> cache;
+    if (!options.cacheDir.empty()) {
+        TimeReport::Scope cachePhase(report, "cache");
+        std::error_code error;
+        std::filesystem::create_directories(options.cacheDir, error);
+
+        cache = std::make_unique<FunctionCache>(functionCacheFile(inputName), functionCacheConfig());
+        cache->load();
+    }
+
+    // Tokenize and parse the source code; the parser pulls tokens from the
+    // lexer as it goes, so lexer errors are reported through the same engine
+    // and the lexer's share of the time is split off afterwards
+    Lexer lexer(source, inputName, diag);
+    Parser parser(lexer, diag);
+    parser.setFunctionCache(cache.get());
+    parser.setIncludeCache(includeCache);
+    parser.setTimeReport(report);
+    TimeReport::Scope parsePhase(report, "parse");
+    auto module = parser.parse();
+    parsePhase.end();
+    if (report) {
+        report->splitLast("tokenize", parser.getLexingCost());
+    }
+
+    if (diag.hasErrorDiagnostics() || !module) {
+        return nullptr;
+    }
+
+    // Optimize the parsed functions
+    if (options.optLevel > 0) {
+        TimeReport::Scope optimizePhase(report, "optimize");
+        PassManager passes;
+        passes.addStandardPasses(options.optLevel);
+        passes.run(*module);
+    }
+
+    // The targets know the module's ABIs once they generate code, so each
+    // input gets its own
+    std::vector<std::unique_ptr<Target>> targets;
+    std::vector<Target*> targetList;
+    for (const auto& targetName : options.targetNames) {
+        targets.push_back(Target::createFromName(static_cast<uint32_t>(targets.size() + 1), targetName));
+        targetList.push_back(targets.back().get());
+    }
+
+    // Generate COF file, hot functions first and cold ones apart
+    TimeReport::Scope generatePhase(report, "generate");
+    FunctionOrder(options.profile.get(), options.encoding).run(*module);
+    auto cof = module->generateCof(options.jobs, cache.get(), options.encoding, targetList, options.native,
+                                   pool.get());
+    generatePhase.end();
+    if (!cof) {
+        LOG_ERROR("Failed to generate COF file");
+        return nullptr;
+    }
+
+    // Compression and the file layout are worked out here, so writing the
+    // file is only I/O
+    TimeReport::Scope finalizePhase(report, "finalize");
+    if (options.mergeStrings) {
+        cof->setStringMerging(true);
+    }
+    if (options.compression != COMPRESSION_NONE) {
+        cof->setCompression(options.compression, options.compressionLevel);
+        cof->setCompressionJobs(options.jobs);
+        cof->setCompressionPool(pool.get());
+    }
+    if (options.hashSection) {
+        cof->addHashSection();
+    }
+    cof->setDeterministic(options.deterministic, options.timestamp);
+    cof->finalize();
+    finalizePhase.end();
+
+    // A cache that cannot be saved only costs time on the next run
+    if (cache) {
+        LOG_INFO("Function cache: {} reused, {} assembled", cache->getHitCount(),
+                 module->getFunctions().size() - cache->getHitCount());
+        if (!cache->save()) {
+            LOG_WARNING("Function cache not updated");
+        }
+    }
+
+    return cof;
+}
+
+bool Assembler::assemble(std::string_view source, const std::string& inputName, std::vector<uint8_t>& output,
+                         DiagnosticEngine& diag) {
+    auto cof = assemble(source, inputName, diag);
+    if (!cof) {
+        return false;
+    }
+
+    output = cof->serialize();
+    return !output.empty();
+}
+
+bool Assembler::assembleFile(const std::string& inputFile, const std::string& outputFile, DiagnosticEngine& diag,
+                             TimeReport* report) {
+    // Map the input file; tokens are views into this buffer, so it has to
+    // stay alive until parsing is done
+    TimeReport::Scope mapPhase(report, "read");
+    auto sourceFile = MappedFile::open(inputFile);
+    if (!sourceFile) {
+        LOG_ERROR("Could not open file: {}", inputFile);
+        return false;
+    }
+    if (sourceFile->getSize() == 0) {
+        LOG_ERROR("Input file is empty: {}", inputFile);
+        return false;
+    }
+    mapPhase.end();
+
+    // Process the input file
+    LOG_INFO("Processing input file: {}", inputFile);
+
+    auto cof = assemble(sourceFile->getContents(), inputFile, diag, report);
+    if (!cof) {
+        return false;
+    }
+
+    // Write output file
+    TimeReport::Scope writePhase(report, "write");
+    if (!cof->write(outputFile)) {
+        LOG_ERROR("Failed to write output file: {}", outputFile);
+        return false;
+    }
+    writePhase.end();
+
+    LOG_INFO("Successfully wrote output file: {}", outputFile);
+    return true;
+}
+
+const AssemblyOptions& Assembler::getOptions() const {
+    return options;
+}
+
+IncludeCache& Assembler::getIncludeCache() {
+    return *includeCache;
+}
+
+} // namespace coil
@@ -0,0 +1,151 @@
+#ifndef COIL_DRIVER_ASSEMBLER_H
+#define COIL_DRIVER_ASSEMBLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "binary/cof.h"
+#include "core/defs.h"
+#include "parser/include_cache.h"
+#include "util/diagnostic.h"
+#include "util/thread_pool.h"
+#include "util/time_report.h"
+
+namespace coil {
+
+class FunctionProfile;
+
+/**
+ * @brief Options that apply to every input an assembler is given
+ */
+struct AssemblyOptions {
+    std::vector<std::string> targetNames; // Target architectures (one native section each)
+    size_t jobs;                  // Number of threads to encode functions on
+    bool hashSection;             // Add a symbol hash section
+    bool mergeStrings;            // Tail-merge the string table
+    std::string cacheDir;         // Function cache directory (empty for none)
+    uint32_t compression;         // Section compression format
+    int compressionLevel;         // Compression level (0 for the format's default)
+    InstructionEncoding encoding; // Encoding of the text section
+    unsigned optLevel;            // Optimization level (0 to 2)
+    bool native;                  // Also emit machine code for the target
+    size_t errorLimit;            // Errors after which an input is given up on (0 for no limit)
+    bool deterministic;           // Content-derived UUID and a fixed timestamp
+    uint64_t timestamp;           // Timestamp recorded when deterministic
+    std::shared_ptr<const FunctionProfile> profile; // Profile to order functions by (nullptr for none)
+
+    AssemblyOptions()
+        : targetNames{"x86-64"}, jobs(1), hashSection(false), mergeStrings(false),
+          compression(COMPRESSION_NONE), compressionLevel(0), encoding(ENCODING_STANDARD), optLevel(0),
+          native(false), errorLimit(20), deterministic(false), timestamp(0) {}
+};
+
+/**
+ * @brief Assembles COIL sources into COF files
+ *
+ * The assembler keeps what can be reused from one input to the next: the
+ * tokenized include files and, with more than one job, the thread pool
+ * the functions are encoded on. Targets learn the ABIs of the module
+ * they generate code for, so each input gets targets of its own.
+ *
+ * All output goes through the calling thread's logger and the given
+ * diagnostics engine. An assembler with a single job can assemble inputs
+ * on several threads at once; with more jobs, one input at a time.
+ */
+class Assembler {
+private:
+    AssemblyOptions options;          // Options for every input
+    IncludeCache ownIncludeCache;     // Include files, unless shared with other assemblers
+    IncludeCache* includeCache;       // Include files in use
+    std::unique_ptr<ThreadPool> pool; // Workers for function encoding (nullptr for one job)
+
+    /**
+     * @brief Get the function cache file for an input
+     *
+     * @param inputName Input filename
+     * @return Cache file, unique to the input's path
+     */
+    std::string functionCacheFile(const std::string& inputName) const;
+
+    /**
+     * @brief Hash the options that affect the encoded code
+     *
+     * @return Configuration hash for the function cache
+     */
+    uint64_t functionCacheConfig() const;
+
+public:
+    /**
+     * @brief Construct an assembler
+     *
+     * @param assemblyOptions Options for every input
+     * @param sharedIncludeCache Include files shared with other assemblers
+     *                           (nullptr for the assembler's own)
+     */
+    explicit Assembler(const AssemblyOptions& assemblyOptions, IncludeCache* sharedIncludeCache = nullptr);
+
+    Assembler(const Assembler&) = delete;
+    Assembler& operator=(const Assembler&) = delete;
+
+    /**
+     * @brief Assemble a source held in memory
+     *
+     * The returned file is finalized; serialize() or write() only lay it
+     * out in memory or on disk.
+     *
+     * @param source Source code
+     * @param inputName Filename for diagnostics, relative includes and
+     *                  the function cache
+     * @param diag Diagnostic engine
+     * @param report Report to time the phases in (nullptr for none)
+     * @return COF file, or nullptr on error
+     */
+    std::unique_ptr<CofFile> assemble(std::string_view source, const std::string& inputName,
+                                      DiagnosticEngine& diag, TimeReport* report = nullptr);
+
+    /**
+     * @brief Assemble a source held in memory into COF bytes
+     *
+     * @param source Source code
+     * @param inputName Filename for diagnostics, relative includes and
+     *                  the function cache
+     * @param output Serialized COF file (output parameter)
+     * @param diag Diagnostic engine
+     * @return true on success, false on error
+     */
+    bool assemble(std::string_view source, const std::string& inputName, std::vector<uint8_t>& output,
+                  DiagnosticEngine& diag);
+
+    /**
+     * @brief Assemble one input file into a COF file
+     *
+     * @param inputFile Input file
+     * @param outputFile Output file
+     * @param diag Diagnostic engine
+     * @param report Report to time the phases in (nullptr for none)
+     * @return true if the output file was written
+     */
+    bool assembleFile(const std::string& inputFile, const std::string& outputFile, DiagnosticEngine& diag,
+                      TimeReport* report = nullptr);
+
+    /**
+     * @brief Get the options every input is assembled with
+     *
+     * @return Assembly options
+     */
+    const AssemblyOptions& getOptions() const;
+
+    /**
+     * @brief Get the include files kept between inputs
+     *
+     * @return Include cache
+     */
+    IncludeCache& getIncludeCache();
+};
+
+} // namespace coil
+
+#endif // COIL_DRIVER_ASSEMBLER_H
@@ -0,0 +1,283 @@
+#include "driver/server.h"
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <vector>
+#include "util/diagnostic.h"
+#include "util/logger.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace coil {
+
+/**
+ * @brief Collects the warnings and errors of one request for its response
+ */
+class ResponseLogger : public Logger {
+private:
+    std::string text;  // Messages, one per line
+
+public:
+    void log(LogLevel level, const std::string& message) override {
+        if (level >= LOG_WARNING) {
+            text += message;
+            text += '\n';
+        }
+    }
+
+    bool isEnabled(LogLevel level) const override {
+        return level >= LOG_WARNING;
+    }
+
+    void setMinLevel(LogLevel) override {}
+
+    const std::string& getText() const {
+        return text;
+    }
+};
+
+/**
+ * @brief Build a response
+ *
+ * @param status Status word
+ * @param cof Serialized COF file (empty unless the status is OK)
+ * @param messages Warnings and errors
+ * @return Response header and body
+ */
+static std::string makeResponse(const char* status, const std::vector<uint8_t>& cof, const std::string& messages) {
+    std::string response = std::string(status) + " " + std::to_string(cof.size()) + " " +
+                           std::to_string(messages.size()) + "\n";
+    response.append(reinterpret_cast<const char*>(cof.data()), cof.size());
+    response += messages;
+    return response;
+}
+
+AssemblerServer::AssemblerServer(Assembler& serverAssembler, const std::string& path)
+    : assembler(serverAssembler), socketPath(path), stopping(false) {
+}
+
+std::string AssemblerServer::assemble(const std::string& source, const std::string& name) {
+    auto start = std::chrono::steady_clock::now();
+
+    // Everything the request logs goes into its response
+    ResponseLogger logger;
+    std::vector<uint8_t> cof;
+    bool success;
+    {
+        ThreadLoggerScope loggerScope(&logger);
+        DiagnosticEngine diag(&logger);
+        try {
+            success = assembler.assemble(source, name, cof, diag);
+        } catch (const std::exception& e) {
+            LOG_ERROR("Assembly failed: {}", e.what());
+            success = false;
+        }
+    }
+
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("{}: {} ({} bytes in, {} bytes out, {} ms)", name, success ? "assembled" : "failed", source.size(),
+             cof.size(), milliseconds);
+
+    if (!success) {
+        cof.clear();
+    }
+    return makeResponse(success ? "OK" : "ERROR", cof, logger.getText());
+}
+
+#ifndef _WIN32
+
+// Set by SIGINT and SIGTERM
+static volatile std::sig_atomic_t signalled = 0;
+
+static void handleSignal(int) {
+    signalled = 1;
+}
+
+/**
+ * @brief Read exactly the given number of bytes
+ *
+ * @param fd Socket
+ * @param buffer Buffer (output parameter)
+ * @param size Bytes to read
+ * @return true on success, false if the connection closed or failed first
+ */
+static bool readFully(int fd, char* buffer, size_t size) {
+    while (size > 0) {
+        ssize_t count = recv(fd, buffer, size, 0);
+        if (count < 0 && errno == EINTR && !signalled) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        buffer += count;
+        size -= static_cast<size_t>(count);
+    }
+    return true;
+}
+
+/**
+ * @brief Write the whole buffer
+ *
+ * @param fd Socket
+ * @param data Data to write
+ * @return true on success, false if the connection failed
+ */
+static bool writeFully(int fd, const std::string& data) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+        ssize_t count = send(fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        offset += static_cast<size_t>(count);
+    }
+    return true;
+}
+
+/**
+ * @brief Read a request line
+ *
+ * @param fd Socket
+ * @param maxSize Longest line accepted
+ * @param line Line without its newline (output parameter)
+ * @return true on success, false if the connection closed or the line is too long
+ */
+static bool readLine(int fd, size_t maxSize, std::string& line) {
+    // One byte at a time, so no part of the source after it is consumed
+    line.clear();
+    char c;
+    while (readFully(fd, &c, 1)) {
+        if (c == '\n') {
+            return true;
+        }
+        if (line.size() == maxSize) {
+            return false;
+        }
+        line += c;
+    }
+    return false;
+}
+
+void AssemblerServer::serve(int connection) {
+    std::string line;
+    while (!stopping && !signalled && readLine(connection, MAX_HEADER_SIZE, line)) {
+        if (line == "SHUTDOWN") {
+            stopping = true;
+            writeFully(connection, makeResponse("OK", {}, ""));
+            return;
+        }
+
+        // ASSEMBLE <source-bytes> <name>
+        char* end = nullptr;
+        unsigned long long size = 0;
+        size_t nameStart = 0;
+        if (line.compare(0, 9, "ASSEMBLE ") == 0) {
+            size = strtoull(line.c_str() + 9, &end, 10);
+            nameStart = static_cast<size_t>(end - line.c_str());
+        }
+        if (nameStart <= 9 || nameStart + 1 >= line.size() || line[nameStart] != ' ' || size > MAX_SOURCE_SIZE) {
+            // The rest of the stream cannot be made sense of
+            writeFully(connection, makeResponse("BAD_REQUEST", {}, "Malformed request: " + line + "\n"));
+            return;
+        }
+
+        std::string source(size, '\0');
+        if (!readFully(connection, source.data(), source.size())) {
+            return;
+        }
+
+        if (!writeFully(connection, assemble(source, line.substr(nameStart + 1)))) {
+            return;
+        }
+    }
+}
+
+bool AssemblerServer::run() {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path)) {
+        LOG_ERROR("Invalid socket path: {}", socketPath);
+        return false;
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        LOG_ERROR("Could not create socket: {}", std::strerror(errno));
+        return false;
+    }
+
+    // A socket left behind by a server that is gone is replaced; one that
+    // still accepts connections is not
+    if (connect(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+        LOG_ERROR("Another server is listening on {}", socketPath);
+        close(listener);
+        return false;
+    }
+    close(listener);
+    struct stat existing;
+    if (stat(socketPath.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(socketPath.c_str());
+    }
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        chmod(socketPath.c_str(), S_IRUSR | S_IWUSR) != 0 || listen(listener, 16) != 0) {
+        LOG_ERROR("Could not listen on {}: {}", socketPath, std::strerror(errno));
+        if (listener >= 0) {
+            close(listener);
+        }
+        return false;
+    }
+
+    // No SA_RESTART, so a signal interrupts accept() and the loop ends
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = handleSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    LOG_INFO("Listening on {}", socketPath);
+    bool clean = true;
+    while (!stopping && !signalled) {
+        int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            LOG_ERROR("Could not accept a connection: {}", std::strerror(errno));
+            clean = false;
+            break;
+        }
+        serve(connection);
+        close(connection);
+    }
+
+    close(listener);
+    unlink(socketPath.c_str());
+    LOG_INFO("Server stopped");
+    return clean;
+}
+
+#else
+
+bool AssemblerServer::run() {
+    LOG_ERROR("The server needs Unix sockets, which this platform does not have");
+    return false;
+}
+
+#endif
+
+} // namespace coil
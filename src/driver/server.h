@@ -0,0 +1,78 @@
+#ifndef COIL_DRIVER_SERVER_H
+#define COIL_DRIVER_SERVER_H
+
+#include <cstddef>
+#include <string>
+#include "driver/assembler.h"
+
+namespace coil {
+
+/**
+ * @brief Assembles sources sent over a Unix socket
+ *
+ * The server answers one connection at a time with the same assembler, so
+ * the tokenized include files and the thread pool stay warm between
+ * requests. A connection can send any number of requests, each answered
+ * before the next is read:
+ *
+ *   ASSEMBLE <source-bytes> <name>\n<source>
+ *       Assemble the source; <name> is used for diagnostics, relative
+ *       includes and the function cache.
+ *   SHUTDOWN\n
+ *       Stop the server once the response is sent.
+ *
+ * Every response is
+ *
+ *   <status> <cof-bytes> <message-bytes>\n<cof><messages>
+ *
+ * with status OK, ERROR (the messages say why) or BAD_REQUEST. The
+ * messages are the warnings and errors the request produced, one per
+ * line. The server also stops on SIGINT or SIGTERM, and removes the
+ * socket when it does.
+ */
+class AssemblerServer {
+private:
+    static constexpr size_t MAX_HEADER_SIZE = 4096;      // Longest request line
+    static constexpr size_t MAX_SOURCE_SIZE = 1u << 30;  // Largest source accepted
+
+    Assembler& assembler;    // Assembler for every request
+    std::string socketPath;  // Path of the listening socket
+    bool stopping;           // true once a SHUTDOWN request was answered
+
+    /**
+     * @brief Answer the requests of one connection until it closes
+     *
+     * @param connection Connected socket
+     */
+    void serve(int connection);
+
+    /**
+     * @brief Assemble one source and build the response
+     *
+     * @param source Source code
+     * @param name Source name
+     * @return Response header and body
+     */
+    std::string assemble(const std::string& source, const std::string& name);
+
+public:
+    /**
+     * @brief Construct a server
+     *
+     * @param serverAssembler Assembler for every request
+     * @param path Path of the Unix socket to listen on
+     */
+    AssemblerServer(Assembler& serverAssembler, const std::string& path);
+
+    /**
+     * @brief Listen and answer requests until asked to stop
+     *
+     * @return true if the server stopped cleanly, false if it could not
+     *         listen on the socket or accept connections
+     */
+    bool run();
+};
+
+} // namespace coil
+
+#endif // COIL_DRIVER_SERVER_H
@@ -0,0 +1,646 @@
+#include "link/linker.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <set>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include "target/x86_64.h"
+#include "util/concurrent_hash_map.h"
+#include "util/logger.h"
+#include "util/thread_pool.h"
+
+namespace coil {
+
+static constexpr uint32_t NO_INDEX = UINT32_MAX;
+
+/**
+ * @brief Name qualified by an output section or a target
+ */
+struct LinkKey {
+    std::string_view name;   // Symbol or section name
+    uint32_t scope;          // Output section or target ID
+
+    bool operator==(const LinkKey& other) const {
+        return scope == other.scope && name == other.name;
+    }
+};
+
+struct LinkKeyHash {
+    size_t operator()(const LinkKey& key) const {
+        return std::hash<std::string_view>()(key.name) ^ (static_cast<size_t>(key.scope) * 0x9E3779B97F4A7C15ull);
+    }
+};
+
+/**
+ * @brief A symbol of one input
+ */
+struct LinkSymbol {
+    uint32_t input;          // Input index
+    uint32_t symbol;         // Symbol index in the input
+};
+
+/**
+ * @brief Best definition of a global symbol seen so far
+ */
+struct LinkDefinition {
+    LinkSymbol best;         // Winning definition
+    bool weak;               // true if the winner is weak
+    uint32_t clash;          // First other input with a strong definition (NO_INDEX if none)
+
+    LinkDefinition() : best{NO_INDEX, NO_INDEX}, weak(true), clash(NO_INDEX) {}
+};
+
+/**
+ * @brief One section of the output and what goes into it
+ */
+struct LinkSection {
+    std::string_view name;   // Section name
+    uint32_t type;           // Section type
+    uint32_t flags;          // Union of the input flags
+    uint32_t targetId;       // Output target ID
+    uint32_t alignment;      // Largest input alignment
+    uint64_t size;           // Size so far
+    uint64_t address;        // Address (0 unless allocated)
+    uint32_t firstInput;     // Input it first appears in, for messages
+    std::vector<uint8_t> data; // Contents, filled in per input
+};
+
+/**
+ * @brief Where an input section goes
+ */
+struct LinkPlacement {
+    uint32_t section;        // Output section (NO_INDEX if dropped)
+    uint64_t offset;         // Offset in the output section
+};
+
+/**
+ * @brief Check if a defined symbol takes part in resolution
+ *
+ * @param symbol Symbol
+ * @return true unless the symbol is local to its input
+ */
+static bool isLinkVisible(const Symbol& symbol) {
+    return !symbol.hasFlag(SYMBOL_FLAG_LOCAL) && (symbol.hasFlag(SYMBOL_FLAG_GLOBAL) || symbol.hasFlag(SYMBOL_FLAG_WEAK));
+}
+
+/**
+ * @brief Rank of a section in the output order
+ *
+ * @param type Section type
+ * @return Lower ranks come first
+ */
+static int sectionRank(uint32_t type) {
+    switch (type) {
+        case SECTION_CODE:     return 0;
+        case SECTION_READONLY: return 1;
+        case SECTION_DATA:     return 2;
+        case SECTION_BSS:      return 3;
+        default:               return 4;
+    }
+}
+
+/**
+ * @brief Keep the better of two definitions of the same name
+ *
+ * Strong beats weak and earlier inputs beat later ones. Two strong
+ * definitions are remembered as a clash.
+ *
+ * @param definition Definition so far (updated)
+ * @param candidate New definition
+ * @param weak true if the new definition is weak
+ */
+static void mergeDefinition(LinkDefinition& definition, LinkSymbol candidate, bool weak) {
+    auto earlier = [](LinkSymbol a, LinkSymbol b) {
+        return a.input != b.input ? a.input < b.input : a.symbol < b.symbol;
+    };
+
+    if (definition.best.input == NO_INDEX) {
+        definition.best = candidate;
+        definition.weak = weak;
+        return;
+    }
+
+    if (!weak && !definition.weak) {
+        LinkSymbol later = earlier(candidate, definition.best) ? definition.best : candidate;
+        definition.clash = std::min(definition.clash, later.input);
+    }
+    if (definition.weak != weak ? !weak : earlier(candidate, definition.best)) {
+        definition.best = candidate;
+        definition.weak = weak;
+    }
+}
+
+/**
+ * @brief Outcome of applying a relocation
+ */
+enum LinkRelocationStatus {
+    LINK_RELOC_APPLIED,      // Field patched
+    LINK_RELOC_UNSUPPORTED,  // Type unknown for the architecture
+    LINK_RELOC_OUT_OF_RANGE, // Field lies outside the section
+    LINK_RELOC_OVERFLOW      // Value does not fit the field
+};
+
+/**
+ * @brief Apply a machine code relocation
+ *
+ * @param archType Architecture of the relocation's target
+ * @param type Relocation type
+ * @param data Section contents
+ * @param size Section size
+ * @param offset Offset of the field in the section
+ * @param place Address of the field (P)
+ * @param symbol Address of the symbol (S)
+ * @param addend Addend (A)
+ * @return Outcome
+ */
+static LinkRelocationStatus applyRelocation(uint32_t archType, uint32_t type, uint8_t* data, uint64_t size,
+                                            uint64_t offset, uint64_t place, uint64_t symbol, int64_t addend) {
+    if (archType != ARCH_X86_64) {
+        return LINK_RELOC_UNSUPPORTED;
+    }
+
+    // Fields are little-endian, as the target is
+    switch (type) {
+        case X86_64_RELOC_64: {
+            if (offset > size || size - offset < 8) {
+                return LINK_RELOC_OUT_OF_RANGE;
+            }
+            uint64_t value = symbol + static_cast<uint64_t>(addend);
+            for (int i = 0; i < 8; i++) {
+                data[offset + i] = static_cast<uint8_t>(value >> (i * 8));
+            }
+            return LINK_RELOC_APPLIED;
+        }
+        case X86_64_RELOC_PC32: {
+            if (offset > size || size - offset < 4) {
+                return LINK_RELOC_OUT_OF_RANGE;
+            }
+            int64_t value = static_cast<int64_t>(symbol + static_cast<uint64_t>(addend) - place);
+            if (value < INT32_MIN || value > INT32_MAX) {
+                return LINK_RELOC_OVERFLOW;
+            }
+            for (int i = 0; i < 4; i++) {
+                data[offset + i] = static_cast<uint8_t>(static_cast<uint64_t>(value) >> (i * 8));
+            }
+            return LINK_RELOC_APPLIED;
+        }
+        default:
+            return LINK_RELOC_UNSUPPORTED;
+    }
+}
+
+Linker::Linker(const LinkOptions& linkOptions)
+    : options(linkOptions) {
+}
+
+bool Linker::addFiles(const std::vector<std::string>& filenames) {
+    // Files decode independently; their messages are held back so that
+    // they come out in command-line order
+    std::vector<std::unique_ptr<CofFile>> objects(filenames.size());
+    std::vector<BufferedLogger> loggers(filenames.size(), BufferedLogger(LOG_DEBUG));
+    {
+        ThreadPool pool(filenames.size() > 1 ? options.jobs : 1);
+        for (size_t i = 0; i < filenames.size(); i++) {
+            pool.submit([&filenames, &objects, &loggers, i] {
+                ThreadLoggerScope scope(&loggers[i]);
+                objects[i] = CofFile::read(filenames[i]);
+            });
+        }
+        pool.wait();
+    }
+
+    bool success = true;
+    for (size_t i = 0; i < filenames.size(); i++) {
+        loggers[i].flush(GlobalLogger::getInstance());
+        if (!objects[i]) {
+            LOG_ERROR("Could not read object: {}", filenames[i]);
+            success = false;
+        } else {
+            addObject(filenames[i], std::move(objects[i]));
+        }
+    }
+    return success;
+}
+
+void Linker::addObject(const std::string& name, std::unique_ptr<CofFile> cof) {
+    inputs.push_back({name, std::move(cof)});
+}
+
+size_t Linker::getObjectCount() const {
+    return inputs.size();
+}
+
+std::unique_ptr<CofFile> Linker::link() {
+    if (inputs.empty()) {
+        LOG_ERROR("No objects to link");
+        return nullptr;
+    }
+
+    auto output = std::make_unique<CofFile>();
+    bool success = true;
+
+    // Targets are matched by name, which includes their features
+    InstructionEncoding encoding = inputs.front().cof->getInstructionEncoding();
+    std::unordered_map<std::string_view, uint32_t> targetIds;
+    std::vector<uint32_t> targetArch(1, 0);
+    std::vector<std::vector<uint32_t>> targetMaps(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        const CofFile& cof = *inputs[i].cof;
+        if (cof.getInstructionEncoding() != encoding) {
+            LOG_ERROR("{} uses a different instruction encoding than {}", inputs[i].name, inputs.front().name);
+            success = false;
+        }
+
+        targetMaps[i].assign(cof.getTargetCount() + 1, 0);
+        for (size_t t = 0; t < cof.getTargetCount(); t++) {
+            const TargetEntry& target = cof.getTarget(t);
+            std::string_view name = cof.getString(target.name_offset);
+            auto found = targetIds.find(name);
+            if (found == targetIds.end()) {
+                uint32_t id = output->addTarget(target.arch_type, target.features, std::string(name));
+                found = targetIds.emplace(name, id).first;
+                targetArch.push_back(target.arch_type);
+            }
+            targetMaps[i][t + 1] = found->second;
+        }
+    }
+    output->setInstructionEncoding(encoding);
+    auto mapTarget = [&targetMaps](size_t input, uint32_t targetId) {
+        return targetId < targetMaps[input].size() ? targetMaps[input][targetId] : 0;
+    };
+
+    // Group the input sections by name and target and place each one at
+    // its alignment; hash sections index their own input's symbols, so
+    // they are dropped
+    std::vector<LinkSection> groups;
+    std::unordered_map<LinkKey, uint32_t, LinkKeyHash> groupIndex;
+    std::vector<std::vector<LinkPlacement>> placements(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        CofFile& cof = *inputs[i].cof;
+        placements[i].assign(cof.getSectionCount(), {NO_INDEX, 0});
+        for (size_t s = 0; s < cof.getSectionCount(); s++) {
+            const Section& section = cof.getSection(s);
+            if (section.getType() == SECTION_HASH) {
+                continue;
+            }
+
+            // A corrupt alignment would pad the output without bound
+            uint32_t alignment = section.getAlignment();
+            if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment > MAX_SECTION_ALIGNMENT) {
+                LOG_ERROR("Section {} of {} has an invalid alignment: {} (expected a power of two up to {})",
+                          section.getName(), inputs[i].name, alignment, MAX_SECTION_ALIGNMENT);
+                success = false;
+                continue;
+            }
+
+            LinkKey key{section.getName(), mapTarget(i, section.getTargetId())};
+            auto found = groupIndex.find(key);
+            if (found == groupIndex.end()) {
+                LinkSection group;
+                group.name = section.getName();
+                group.type = section.getType();
+                group.flags = section.getFlags();
+                group.targetId = key.scope;
+                group.alignment = 1;
+                group.size = 0;
+                group.address = 0;
+                group.firstInput = static_cast<uint32_t>(i);
+                found = groupIndex.emplace(key, static_cast<uint32_t>(groups.size())).first;
+                groups.push_back(std::move(group));
+            }
+
+            LinkSection& group = groups[found->second];
+            if (group.type != section.getType()) {
+                LOG_ERROR("Section {} has a different type in {} than in {}", section.getName(), inputs[i].name,
+                          inputs[group.firstInput].name);
+                success = false;
+            }
+
+            uint64_t offset = (group.size + alignment - 1) / alignment * alignment;
+            group.flags |= section.getFlags();
+            group.alignment = std::max(group.alignment, alignment);
+            group.size = offset + section.getSize();
+            placements[i][s] = {found->second, offset};
+        }
+    }
+    if (!success) {
+        return nullptr;
+    }
+
+    // Order the output sections, then give the allocated ones addresses
+    std::vector<uint32_t> order(groups.size());
+    for (uint32_t g = 0; g < groups.size(); g++) {
+        order[g] = g;
+    }
+    std::stable_sort(order.begin(), order.end(), [&groups](uint32_t a, uint32_t b) {
+        return sectionRank(groups[a].type) < sectionRank(groups[b].type);
+    });
+
+    std::vector<uint32_t> sectionOf(groups.size());
+    std::vector<LinkSection> sections;
+    sections.reserve(groups.size());
+    uint64_t address = 0;
+    for (uint32_t g : order) {
+        sectionOf[g] = static_cast<uint32_t>(sections.size());
+        sections.push_back(std::move(groups[g]));
+
+        LinkSection& section = sections.back();
+        if (!options.relocatable && (section.flags & SECTION_FLAG_ALLOC)) {
+            address = (address + section.alignment - 1) / section.alignment * section.alignment;
+            section.address = address;
+            address += section.size;
+        }
+    }
+    for (auto& inputPlacements : placements) {
+        for (LinkPlacement& placement : inputPlacements) {
+            if (placement.section != NO_INDEX) {
+                placement.section = sectionOf[placement.section];
+            }
+        }
+    }
+
+    // Sized up front so that each input can fill its part of a section on
+    // its own thread; what no input covers is alignment padding. BSS
+    // sections only have a size
+    for (size_t s = 0; s < sections.size(); s++) {
+        if (sections[s].type != SECTION_BSS) {
+            sections[s].data.assign(static_cast<size_t>(sections[s].size), 0);
+        }
+    }
+
+    ThreadPool pool(inputs.size() > 1 ? options.jobs : 1);
+
+    // Enter every input's global symbols at once: definitions by the
+    // output section they land in and by name alone, references by name
+    // and target
+    ConcurrentHashMap<LinkKey, LinkDefinition, LinkKeyHash> definitions;
+    ConcurrentHashMap<std::string_view, LinkDefinition> definitionsByName;
+    ConcurrentHashMap<LinkKey, LinkDefinition, LinkKeyHash> references;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        pool.submit([this, &placements, &definitions, &definitionsByName, &references, &mapTarget, i] {
+            const auto& symbols = inputs[i].cof->getSymbols();
+            for (size_t j = 0; j < symbols.size(); j++) {
+                const Symbol& symbol = *symbols[j];
+                LinkSymbol candidate{static_cast<uint32_t>(i), static_cast<uint32_t>(j)};
+                if (symbol.isUndefined()) {
+                    references.update({symbol.getName(), mapTarget(i, symbol.getTargetId())},
+                                      [candidate](LinkDefinition& reference, bool) {
+                                          mergeDefinition(reference, candidate, true);
+                                      });
+                    continue;
+                }
+
+                uint32_t sectionIndex = symbol.getSectionIndex();
+                if (!isLinkVisible(symbol) || sectionIndex >= placements[i].size() ||
+                    placements[i][sectionIndex].section == NO_INDEX) {
+                    continue;
+                }
+
+                bool weak = symbol.hasFlag(SYMBOL_FLAG_WEAK);
+                definitions.update({symbol.getName(), placements[i][sectionIndex].section},
+                                   [candidate, weak](LinkDefinition& definition, bool) {
+                                       mergeDefinition(definition, candidate, weak);
+                                   });
+                definitionsByName.update(symbol.getName(), [candidate, weak](LinkDefinition& definition, bool) {
+                    mergeDefinition(definition, candidate, weak);
+                });
+            }
+        });
+    }
+    pool.wait();
+
+    // Report clashes in input order
+    std::vector<std::pair<LinkSymbol, uint32_t>> clashes;
+    definitions.forEach([&clashes](const LinkKey&, const LinkDefinition& definition) {
+        if (definition.clash != NO_INDEX) {
+            clashes.push_back({definition.best, definition.clash});
+        }
+    });
+    std::sort(clashes.begin(), clashes.end(), [](const auto& a, const auto& b) {
+        return a.first.input != b.first.input ? a.first.input < b.first.input : a.first.symbol < b.first.symbol;
+    });
+    std::set<std::tuple<std::string_view, uint32_t, uint32_t>> reported;
+    for (const auto& clash : clashes) {
+        // Bytecode and machine code define the same names, so report each once
+        const std::string& name = inputs[clash.first.input].cof->getSymbol(clash.first.symbol).getName();
+        if (!reported.insert({name, clash.first.input, clash.second}).second) {
+            continue;
+        }
+        LOG_ERROR("Duplicate symbol: {} (defined in {} and {})", name, inputs[clash.first.input].name,
+                  inputs[clash.second].name);
+        success = false;
+    }
+    if (!success) {
+        return nullptr;
+    }
+
+    // Number the output symbols in input order: every local symbol and
+    // the winning definition of every global one
+    std::vector<std::vector<uint32_t>> symbolMaps(inputs.size());
+    std::vector<uint64_t> symbolAddresses;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        const auto& symbols = inputs[i].cof->getSymbols();
+        symbolMaps[i].assign(symbols.size(), NO_INDEX);
+        for (size_t j = 0; j < symbols.size(); j++) {
+            const Symbol& symbol = *symbols[j];
+            uint32_t sectionIndex = symbol.getSectionIndex();
+            if (symbol.isUndefined() || sectionIndex >= placements[i].size() ||
+                placements[i][sectionIndex].section == NO_INDEX) {
+                continue;
+            }
+
+            const LinkPlacement& placement = placements[i][sectionIndex];
+            if (isLinkVisible(symbol)) {
+                LinkDefinition definition;
+                definitions.find({symbol.getName(), placement.section}, definition);
+                if (definition.best.input != i || definition.best.symbol != j) {
+                    continue;
+                }
+            }
+
+            uint64_t value = placement.offset + symbol.getValue();
+            symbolMaps[i][j] = output->addSymbol(symbol.getName(), placement.section, value, symbol.getSize(),
+                                                 symbol.getType(), symbol.getFlags(),
+                                                 mapTarget(i, symbol.getTargetId()));
+            symbolAddresses.push_back(sections[placement.section].address + value);
+        }
+    }
+
+    // References nothing defines stay undefined in a relocatable link
+    std::vector<std::pair<LinkSymbol, uint32_t>> unresolved;
+    references.forEach([&definitionsByName, &unresolved](const LinkKey& key, const LinkDefinition& reference) {
+        LinkDefinition definition;
+        if (!definitionsByName.find(key.name, definition)) {
+            unresolved.push_back({reference.best, key.scope});
+        }
+    });
+    std::sort(unresolved.begin(), unresolved.end(), [](const auto& a, const auto& b) {
+        return a.first.input != b.first.input ? a.first.input < b.first.input : a.first.symbol < b.first.symbol;
+    });
+    std::unordered_map<LinkKey, uint32_t, LinkKeyHash> undefinedSymbols;
+    for (const auto& reference : unresolved) {
+        const Symbol& symbol = inputs[reference.first.input].cof->getSymbol(reference.first.symbol);
+        if (!options.relocatable) {
+            LOG_ERROR("Undefined symbol: {} (referenced in {})", symbol.getName(), inputs[reference.first.input].name);
+            success = false;
+            continue;
+        }
+        uint32_t index = output->addSymbol(symbol.getName(), 0, 0, 0, SYMBOL_NONE,
+                                           SYMBOL_FLAG_GLOBAL | SYMBOL_FLAG_UNDEFINED, reference.second);
+        undefinedSymbols.emplace(LinkKey{output->getSymbol(index).getName(), reference.second}, index);
+        symbolAddresses.push_back(0);
+    }
+    if (!success) {
+        return nullptr;
+    }
+
+    // A symbol resolves to its own output symbol, else to the definition
+    // in the section it is used from, else to any definition of its name
+    auto resolve = [this, &symbolMaps, &definitions, &definitionsByName, &undefinedSymbols,
+                    &mapTarget](size_t input, uint32_t symbolIndex, uint32_t section) -> uint32_t {
+        if (symbolIndex >= symbolMaps[input].size()) {
+            return NO_INDEX;
+        }
+        if (symbolMaps[input][symbolIndex] != NO_INDEX) {
+            return symbolMaps[input][symbolIndex];
+        }
+
+        const Symbol& symbol = inputs[input].cof->getSymbol(symbolIndex);
+        LinkDefinition definition;
+        if (definitions.find({symbol.getName(), section}, definition) ||
+            definitionsByName.find(symbol.getName(), definition)) {
+            return symbolMaps[definition.best.input][definition.best.symbol];
+        }
+
+        auto undefined = undefinedSymbols.find({symbol.getName(), mapTarget(input, symbol.getTargetId())});
+        return undefined != undefinedSymbols.end() ? undefined->second : NO_INDEX;
+    };
+
+    // Copy and relocate each input's sections; inputs write to disjoint
+    // parts of the output sections, and keep the relocations that remain
+    std::vector<std::vector<std::pair<uint32_t, RelocationEntry>>> kept(inputs.size());
+    std::vector<BufferedLogger> loggers(inputs.size(), BufferedLogger(LOG_DEBUG));
+    std::vector<char> relocated(inputs.size(), 1);
+    for (size_t i = 0; i < inputs.size(); i++) {
+        pool.submit([this, &placements, &sections, &symbolAddresses, &targetArch, &resolve, &mapTarget, &kept,
+                     &loggers, &relocated, i] {
+            ThreadLoggerScope scope(&loggers[i]);
+            CofFile& cof = *inputs[i].cof;
+            for (size_t s = 0; s < cof.getSectionCount(); s++) {
+                const LinkPlacement& placement = placements[i][s];
+                if (placement.section == NO_INDEX) {
+                    continue;
+                }
+
+                const Section& section = cof.getSection(s);
+                LinkSection& target = sections[placement.section];
+                if (!section.getData().empty()) {
+                    std::memcpy(target.data.data() + placement.offset, section.getData().data(),
+                                section.getData().size());
+                }
+
+                for (const RelocationEntry& relocation : section.getRelocations()) {
+                    RelocationEntry entry = relocation;
+                    entry.offset = placement.offset + relocation.offset;
+                    entry.target_id = mapTarget(i, relocation.target_id);
+                    entry.symbol_index = resolve(i, relocation.symbol_index, placement.section);
+                    if (entry.symbol_index == NO_INDEX) {
+                        LOG_ERROR("Relocation in section {} of {} refers to a symbol that is not linked",
+                                  section.getName(), inputs[i].name);
+                        relocated[i] = 0;
+                        continue;
+                    }
+
+                    // COIL operands name their symbol, and a relocatable
+                    // link leaves every field as it is
+                    if (relocation.type == RELOC_COIL_SYMBOL || relocation.type == RELOC_COIL_LABEL ||
+                        options.relocatable) {
+                        kept[i].push_back({placement.section, entry});
+                        continue;
+                    }
+                    if (relocation.type == RELOC_COIL_NONE) {
+                        continue;
+                    }
+
+                    uint32_t archType = entry.target_id < targetArch.size() ? targetArch[entry.target_id] : 0;
+                    switch (applyRelocation(archType, entry.type, target.data.data(), target.data.size(), entry.offset,
+                                            target.address + entry.offset, symbolAddresses[entry.symbol_index],
+                                            entry.addend)) {
+                        case LINK_RELOC_APPLIED:
+                            break;
+                        case LINK_RELOC_UNSUPPORTED:
+                            LOG_ERROR("Unsupported relocation type {} in section {} of {}", entry.type,
+                                      section.getName(), inputs[i].name);
+                            relocated[i] = 0;
+                            break;
+                        case LINK_RELOC_OUT_OF_RANGE:
+                            LOG_ERROR("Relocation at offset {} lies outside section {} of {}", relocation.offset,
+                                      section.getName(), inputs[i].name);
+                            relocated[i] = 0;
+                            break;
+                        case LINK_RELOC_OVERFLOW:
+                            LOG_ERROR("Relocation at offset {} in section {} of {} does not fit its field",
+                                      relocation.offset, section.getName(), inputs[i].name);
+                            relocated[i] = 0;
+                            break;
+                    }
+                }
+            }
+        });
+    }
+    pool.wait();
+
+    for (size_t i = 0; i < inputs.size(); i++) {
+        loggers[i].flush(GlobalLogger::getInstance());
+        success = success && relocated[i];
+    }
+    if (!success) {
+        return nullptr;
+    }
+
+    // Build the output sections in order, relocations in input order
+    for (LinkSection& linked : sections) {
+        Section& section = output->addSection(std::string(linked.name), linked.type, linked.flags, linked.targetId);
+        section.setAlignment(linked.alignment);
+        section.setAddress(linked.address);
+        if (linked.type == SECTION_BSS) {
+            section.fillZero(static_cast<size_t>(linked.size));
+        } else {
+            section.setData(std::move(linked.data));
+        }
+    }
+    for (size_t i = 0; i < inputs.size(); i++) {
+        for (const auto& relocation : kept[i]) {
+            const RelocationEntry& entry = relocation.second;
+            output->getSection(relocation.first).addRelocation(entry.offset, entry.symbol_index, entry.type,
+                                                              entry.addend, entry.target_id);
+        }
+    }
+
+    // The entry point is main unless another symbol is named
+    if (!options.relocatable) {
+        std::string entry = options.entry.empty() ? "main" : options.entry;
+        LinkDefinition definition;
+        if (definitionsByName.find(entry, definition)) {
+            output->setEntryPoint(symbolAddresses[symbolMaps[definition.best.input][definition.best.symbol]]);
+        } else if (!options.entry.empty()) {
+            LOG_ERROR("Entry point symbol not found: {}", options.entry);
+            return nullptr;
+        }
+    }
+
+    if (options.mergeStrings) {
+        output->setStringMerging(true);
+    }
+    if (options.hashSection) {
+        output->addHashSection();
+    }
+    output->setDeterministic(options.deterministic, options.timestamp);
+
+    return output;
+}
+
+} // namespace coil
@@ -0,0 +1,113 @@
+#ifndef COIL_LINK_LINKER_H
+#define COIL_LINK_LINKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "binary/cof.h"
+
+namespace coil {
+
+/**
+ * @brief Options for linking COF objects
+ */
+struct LinkOptions {
+    size_t jobs;              // Threads to read, merge and relocate on (0 for one per core)
+    bool relocatable;         // Keep relocations and undefined symbols for a later link
+    std::string entry;        // Entry point symbol (empty for main, if defined)
+    bool hashSection;         // Add a symbol hash section
+    bool mergeStrings;        // Tail-merge the string table
+    bool deterministic;       // Content-derived UUID and a fixed timestamp
+    uint64_t timestamp;       // Timestamp recorded when deterministic
+
+    LinkOptions()
+        : jobs(0), relocatable(false), hashSection(false), mergeStrings(true), deterministic(false),
+          timestamp(0) {}
+};
+
+/**
+ * @brief Links COF objects into one COF file
+ *
+ * Sections with the same name and target are merged into one output
+ * section, each input placed at its section's alignment. Output sections
+ * are ordered code, read-only data, data, BSS and then the rest, in the
+ * order they first appear, and the allocated ones get addresses from 0,
+ * again aligned to their sections.
+ *
+ * Global symbols are resolved through a concurrent hash map that every
+ * input is entered into in parallel: a strong definition beats a weak
+ * one, two strong definitions in the same output section are an error,
+ * and among weak ones the first input wins. A reference is resolved in
+ * the output section it is made from first, so the machine code of each
+ * target calls its own functions, and to the first definition of the
+ * name anywhere otherwise. Local symbols stay with their input.
+ *
+ * Section data is then copied and relocated in parallel, one task per
+ * input. Machine code relocations against defined symbols are applied
+ * and dropped; COIL symbol operands name their symbol, so those are kept
+ * with the symbol renumbered. Without LinkOptions::relocatable, undefined
+ * symbols are an error.
+ */
+class Linker {
+public:
+    static constexpr uint32_t MAX_SECTION_ALIGNMENT = 4096; // Largest input section alignment (a page)
+
+private:
+    /**
+     * @brief One input object
+     */
+    struct Input {
+        std::string name;              // File name, for messages
+        std::unique_ptr<CofFile> cof;  // Decoded object
+    };
+
+    LinkOptions options;          // Options
+    std::vector<Input> inputs;    // Objects in link order
+
+public:
+    /**
+     * @brief Construct a linker
+     *
+     * @param linkOptions Options
+     */
+    explicit Linker(const LinkOptions& linkOptions);
+
+    /**
+     * @brief Read COF files, all at once, and add them in the given order
+     *
+     * @param filenames Files to read
+     * @return true if every file was read, false otherwise
+     */
+    bool addFiles(const std::vector<std::string>& filenames);
+
+    /**
+     * @brief Add an object that is already in memory
+     *
+     * @param name Name used in messages
+     * @param cof Object
+     */
+    void addObject(const std::string& name, std::unique_ptr<CofFile> cof);
+
+    /**
+     * @brief Get the number of objects added
+     *
+     * @return Number of objects
+     */
+    size_t getObjectCount() const;
+
+    /**
+     * @brief Link the objects added so far
+     *
+     * Errors are logged. The objects are left as they were, so link() can
+     * be called again.
+     *
+     * @return Linked file, or nullptr on error
+     */
+    std::unique_ptr<CofFile> link();
+};
+
+} // namespace coil
+
+#endif // COIL_LINK_LINKER_H
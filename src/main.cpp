@@ -4,16 +4,39 @@
 #include <vector>
 #include <memory>
 #include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <filesystem>
+#include <algorithm>
 #include "core/defs.h"
-#include "parser/lexer.h"
-#include "parser/parser.h"
-#include "binary/cof.h"
+#include "binary/compression.h"
+#include "driver/assembler.h"
+#include "driver/server.h"
+#include "opt/function_order.h"
 #include "target/target.h"
 #include "util/logger.h"
+#include "util/allocation_counter.h"
 #include "util/diagnostic.h"
+#include "util/thread_pool.h"
+#include "util/time_report.h"
 
 using namespace coil;
 
+/**
+ * @brief One input file to assemble
+ */
+struct AssemblyJob {
+    std::string inputFile;              // Input file
+    std::string outputFile;             // Output file
+    BufferedLogger logger;              // Output held back until the job is reported
+    DiagnosticEngine diag;              // Diagnostics for this input only
+    std::unique_ptr<TimeReport> report; // Phase timings (nullptr when not timing)
+    bool success;                       // true if the output file was written
+    
+    AssemblyJob(const std::string& input, const std::string& output, LogLevel level)
+        : inputFile(input), outputFile(output), logger(level), diag(&logger), success(false) {}
+};
+
 /**
  * @brief Print usage information
  * 
@@ -21,28 +44,50 @@ using namespace coil;
  */
 void printUsage(const char* programName) {
     std::cout << "COIL Assembler (coilasm) - First generation implementation\n";
-    std::cout << "Usage: " << programName << " [options] <input_file>\n";
+    std::cout << "Usage: " << programName << " [options] <input_file>...\n";
     std::cout << "Options:\n";
-    std::cout << "  -o <output_file>   Specify output file (default: input.cof)\n";
-    std::cout << "  -t <target>        Specify target architecture (default: x86-64)\n";
+    std::cout << "  -o <output_file>   Specify output file (default: input.cof, single input only)\n";
+    std::cout << "  -t <target>[,...]  Specify target architectures and features (default: x86-64,\n";
+    std::cout << "                     e.g. x86-64-v3 or x86-64+avx2+bmi2); several targets need\n";
+    std::cout << "                     --native and get one code section each\n";
+    std::cout << "  -O<level>          Optimize: 0 none (default), 1 remove no-ops, redundant moves\n";
+    std::cout << "                     and unreachable code, 2 also fold constants\n";
+    std::cout << "  -j <jobs>          Assemble inputs, or the functions of a single input,\n";
+    std::cout << "                     on <jobs> threads (0: one per core, default: 1)\n";
+    std::cout << "  -ferror-limit=<n>  Stop an input after <n> errors (0: no limit, default: 20)\n";
+    std::cout << "  --hash             Add a symbol hash section for fast lookups by name\n";
+    std::cout << "  --merge-strings    Share common name suffixes in the string table\n";
+    std::cout << "  --compact          Use the compact variable-length instruction encoding\n";
+    std::cout << "  --deterministic    Derive the UUID from the contents and record the timestamp\n";
+    std::cout << "                     from SOURCE_DATE_EPOCH (default: 0), so identical inputs\n";
+    std::cout << "                     give identical files\n";
+    std::cout << "  --native           Also emit machine code for the target in its own section\n";
+    std::cout << "  --cache <dir>      Reuse the code of unchanged functions from <dir>\n";
+    std::cout << "  --profile <file>   Order functions by the call counts in <file> and move the\n";
+    std::cout << "                     ones never called to a text.cold section\n";
+    std::cout << "  --compress <fmt>[:<level>]\n";
+    std::cout << "                     Compress section data (zlib, zstd, lz4; as built)\n";
+    std::cout << "  --time-report      Print wall time, CPU time and allocations per phase\n";
+    std::cout << "  --trace-json <file>\n";
+    std::cout << "                     Write the phases in Chrome trace format to <file>\n";
+    std::cout << "  --server <socket>  Keep running and assemble the sources sent to the Unix\n";
+    std::cout << "                     socket <socket> with these options (no input files)\n";
     std::cout << "  -v                 Enable verbose output\n";
     std::cout << "  -h, --help         Display this help message\n";
 }
 
 /**
- * @brief Read file contents into a string
+ * @brief Get the default output file for an input file
  * 
- * @param filename Filename to read
- * @return File contents as a string, or empty string on error
+ * @param inputFile Input file
+ * @return Input file with its extension replaced by .cof
  */
-std::string readFile(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file) {
-        std::cerr << "Error: Could not open file: " << filename << "\n";
-        return "";
+std::string defaultOutputFile(const std::string& inputFile) {
+    size_t dotPos = inputFile.find_last_of('.');
+    if (dotPos != std::string::npos) {
+        return inputFile.substr(0, dotPos) + ".cof";
     }
-    
-    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return inputFile + ".cof";
 }
 
 /**
@@ -54,10 +99,14 @@ std::string readFile(const std::string& filename) {
  */
 int main(int argc, char** argv) {
     // Default options
-    std::string inputFile;
+    std::vector<std::string> inputFiles;
     std::string outputFile;
-    std::string targetName = "x86-64";
+    AssemblyOptions options;
     bool verbose = false;
+    bool timeReport = false;
+    std::string traceFile;
+    std::string serverSocket;
+    std::string profileFile;
     
     // Parse command-line arguments
     for (int i = 1; i < argc; i++) {
@@ -71,96 +120,298 @@ int main(int argc, char** argv) {
             }
         } else if (strcmp(argv[i], "-t") == 0) {
             if (i + 1 < argc) {
-                targetName = argv[++i];
+                // Several targets are separated by commas
+                options.targetNames.clear();
+                std::string list = argv[++i];
+                size_t start = 0;
+                while (true) {
+                    size_t comma = list.find(',', start);
+                    options.targetNames.push_back(list.substr(start, comma - start));
+                    if (comma == std::string::npos) {
+                        break;
+                    }
+                    start = comma + 1;
+                }
             } else {
                 std::cerr << "Error: Missing target after -t\n";
                 printUsage(argv[0]);
                 return 1;
             }
+        } else if (strncmp(argv[i], "-O", 2) == 0) {
+            if (argv[i][2] < '0' || argv[i][2] > '2' || argv[i][3] != '\0') {
+                std::cerr << "Error: Invalid optimization level: " << argv[i] << "\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+            options.optLevel = static_cast<unsigned>(argv[i][2] - '0');
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (i + 1 < argc) {
+                char* end = nullptr;
+                unsigned long value = strtoul(argv[++i], &end, 10);
+                if (*argv[i] == '\0' || *end != '\0') {
+                    std::cerr << "Error: Invalid job count: " << argv[i] << "\n";
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                options.jobs = static_cast<size_t>(value);
+            } else {
+                std::cerr << "Error: Missing job count after -j\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "-ferror-limit=", 14) == 0) {
+            char* end = nullptr;
+            unsigned long value = strtoul(argv[i] + 14, &end, 10);
+            if (argv[i][14] == '\0' || *end != '\0') {
+                std::cerr << "Error: Invalid error limit: " << argv[i] << "\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+            options.errorLimit = static_cast<size_t>(value);
+        } else if (strcmp(argv[i], "--hash") == 0) {
+            options.hashSection = true;
+        } else if (strcmp(argv[i], "--merge-strings") == 0) {
+            options.mergeStrings = true;
+        } else if (strcmp(argv[i], "--compact") == 0) {
+            options.encoding = ENCODING_COMPACT;
+        } else if (strcmp(argv[i], "--native") == 0) {
+            options.native = true;
+        } else if (strcmp(argv[i], "--deterministic") == 0) {
+            options.deterministic = true;
+        } else if (strcmp(argv[i], "--compress") == 0) {
+            if (i + 1 < argc) {
+                std::string_view value = argv[++i];
+                std::string_view format = value.substr(0, value.find(':'));
+                int level = 0;
+                if (format.size() < value.size()) {
+                    char* end = nullptr;
+                    level = static_cast<int>(strtol(argv[i] + format.size() + 1, &end, 10));
+                    if (format.size() + 1 == value.size() || *end != '\0') {
+                        std::cerr << "Error: Invalid compression level: " << value << "\n";
+                        return 1;
+                    }
+                }
+                if (!Compression::lookup(format, options.compression)) {
+                    std::cerr << "Error: Unknown compression format: " << format << "\n";
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                if (options.compression != COMPRESSION_NONE && !Compression::isSupported(options.compression)) {
+                    std::cerr << "Error: Compression format not supported in this build: " << format << "\n";
+                    return 1;
+                }
+                options.compressionLevel = level;
+            } else {
+                std::cerr << "Error: Missing compression format after --compress\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            if (i + 1 < argc) {
+                options.cacheDir = argv[++i];
+            } else {
+                std::cerr << "Error: Missing cache directory after --cache\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            if (i + 1 < argc) {
+                profileFile = argv[++i];
+            } else {
+                std::cerr << "Error: Missing profile file after --profile\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--time-report") == 0) {
+            timeReport = true;
+        } else if (strcmp(argv[i], "--trace-json") == 0) {
+            if (i + 1 < argc) {
+                traceFile = argv[++i];
+            } else {
+                std::cerr << "Error: Missing trace file after --trace-json\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--server") == 0) {
+            if (i + 1 < argc) {
+                serverSocket = argv[++i];
+            } else {
+                std::cerr << "Error: Missing socket path after --server\n";
+                printUsage(argv[0]);
+                return 1;
+            }
         } else if (strcmp(argv[i], "-v") == 0) {
             verbose = true;
         } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
             printUsage(argv[0]);
             return 0;
-        } else if (inputFile.empty()) {
-            inputFile = argv[i];
-        } else {
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
             std::cerr << "Error: Unexpected argument: " << argv[i] << "\n";
             printUsage(argv[0]);
             return 1;
+        } else {
+            inputFiles.push_back(argv[i]);
         }
     }
     
+    if (!serverSocket.empty() && (!inputFiles.empty() || !outputFile.empty())) {
+        std::cerr << "Error: --server takes its sources from the socket, not the command line\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+    
     // Check if input file is specified
-    if (inputFile.empty()) {
+    if (inputFiles.empty() && serverSocket.empty()) {
         std::cerr << "Error: No input file specified\n";
         printUsage(argv[0]);
         return 1;
     }
     
-    // If no output file is specified, use input file with .cof extension
-    if (outputFile.empty()) {
-        size_t dotPos = inputFile.find_last_of('.');
-        if (dotPos != std::string::npos) {
-            outputFile = inputFile.substr(0, dotPos) + ".cof";
-        } else {
-            outputFile = inputFile + ".cof";
-        }
+    if (!outputFile.empty() && inputFiles.size() > 1) {
+        std::cerr << "Error: -o cannot be used with multiple input files\n";
+        printUsage(argv[0]);
+        return 1;
     }
     
-    // Set up logging
-    std::unique_ptr<Logger> logger;
-    if (verbose) {
-        logger = std::make_unique<ConsoleLogger>(LOG_DEBUG);
-    } else {
-        logger = std::make_unique<ConsoleLogger>(LOG_INFO);
+    if (options.deterministic && getenv("SOURCE_DATE_EPOCH") &&
+        !CofFile::getSourceDateEpoch(options.timestamp)) {
+        std::cerr << "Error: Invalid SOURCE_DATE_EPOCH: " << getenv("SOURCE_DATE_EPOCH") << "\n";
+        return 1;
     }
-    GlobalLogger::setInstance(std::move(logger));
     
-    // Create diagnostics engine
-    DiagnosticEngine diag(GlobalLogger::getInstance());
+    for (size_t i = 0; i < options.targetNames.size(); i++) {
+        const std::string& targetName = options.targetNames[i];
+        if (!Target::createFromName(1, targetName)) {
+            std::cerr << "Error: Unknown target or target feature: " << targetName << "\n";
+            return 1;
+        }
+        // Each target's code section is named after it
+        if (std::find(options.targetNames.begin(), options.targetNames.begin() + i, targetName) !=
+            options.targetNames.begin() + i) {
+            std::cerr << "Error: Target listed twice: " << targetName << "\n";
+            return 1;
+        }
+    }
     
-    // Read input file
-    std::string sourceCode = readFile(inputFile);
-    if (sourceCode.empty()) {
+    // Only machine code differs between targets
+    if (options.targetNames.size() > 1 && !options.native) {
+        std::cerr << "Error: Several targets require --native\n";
         return 1;
     }
     
-    // Process the input file
-    LOG_INFO("Processing input file: " + inputFile);
+    // Cached functions are skipped by the parser, so there is nothing to lower
+    if (options.native && !options.cacheDir.empty()) {
+        std::cerr << "Error: --native cannot be used with --cache\n";
+        return 1;
+    }
     
-    // Tokenize the source code
-    Lexer lexer(sourceCode, inputFile, diag);
-    std::vector<Token> tokens = lexer.tokenize();
+    // Set up logging
+    LogLevel logLevel = verbose ? LOG_DEBUG : LOG_INFO;
+    GlobalLogger::setInstance(std::make_unique<ConsoleLogger>(logLevel));
     
-    if (diag.hasErrorDiagnostics()) {
-        diag.printDiagnostics();
-        return 1;
+    // One profile serves every input
+    if (!profileFile.empty()) {
+        auto profile = std::make_shared<FunctionProfile>();
+        if (!profile->load(profileFile)) {
+            return 1;
+        }
+        options.profile = std::move(profile);
     }
     
-    // Parse the tokens
-    Parser parser(tokens, diag);
-    auto module = parser.parse();
+    // The server keeps one assembler, and with it the include files and
+    // the thread pool, for every request
+    if (!serverSocket.empty()) {
+        Assembler assembler(options);
+        AssemblerServer server(assembler, serverSocket);
+        return server.run() ? 0 : 1;
+    }
     
-    if (diag.hasErrorDiagnostics() || !module) {
-        diag.printDiagnostics();
-        return 1;
+    // Reports share one epoch so the inputs line up in the trace
+    bool timing = timeReport || !traceFile.empty();
+    if (timing) {
+        AllocationCounter::enable();
     }
+    TimeReport::Clock::time_point epoch = TimeReport::Clock::now();
+    std::vector<const TimeReport*> reports;
     
-    // Generate COF file
-    auto cof = module->generateCof();
-    if (!cof) {
-        LOG_ERROR("Failed to generate COF file");
-        return 1;
+    // Print and write the reports once every input is done
+    auto finishReports = [&](int result) {
+        if (timeReport) {
+            for (const TimeReport* report : reports) {
+                report->print(std::cerr);
+            }
+        }
+        if (!traceFile.empty() && !TimeReport::writeTrace(traceFile, reports)) {
+            std::cerr << "Error: Could not write trace file: " << traceFile << "\n";
+            return 1;
+        }
+        return result;
+    };
+    
+    // A single input reports as it goes and may use the jobs for its functions
+    if (inputFiles.size() == 1) {
+        // If no output file is specified, use input file with .cof extension
+        if (outputFile.empty()) {
+            outputFile = defaultOutputFile(inputFiles[0]);
+        }
+        
+        // Create diagnostics engine
+        DiagnosticEngine diag(GlobalLogger::getInstance());
+        
+        std::unique_ptr<TimeReport> report;
+        if (timing) {
+            report = std::make_unique<TimeReport>(inputFiles[0], epoch, false);
+            reports.push_back(report.get());
+        }
+        
+        Assembler assembler(options);
+        if (!assembler.assembleFile(inputFiles[0], outputFile, diag, report.get())) {
+            diag.printDiagnostics();
+            return finishReports(1);
+        }
+        return finishReports(0);
     }
     
-    // Write output file
-    if (!cof->write(outputFile)) {
-        LOG_ERROR("Failed to write output file: " + outputFile);
-        return 1;
+    // Several inputs are assembled concurrently, one per thread; each job
+    // buffers its output, which is then reported in command-line order
+    std::vector<std::unique_ptr<AssemblyJob>> assemblyJobs;
+    assemblyJobs.reserve(inputFiles.size());
+    for (const auto& inputFile : inputFiles) {
+        assemblyJobs.push_back(std::make_unique<AssemblyJob>(inputFile, defaultOutputFile(inputFile), logLevel));
+        if (timing) {
+            // Jobs share the process, so each one only counts its own thread
+            assemblyJobs.back()->report = std::make_unique<TimeReport>(inputFile, epoch, true);
+            reports.push_back(assemblyJobs.back()->report.get());
+        }
+    }
+    
+    {
+        // Each input runs on one thread; a file included by several inputs
+        // is tokenized once
+        AssemblyOptions jobOptions = options;
+        jobOptions.jobs = 1;
+        Assembler assembler(jobOptions);
+        
+        ThreadPool pool(options.jobs);
+        for (auto& job : assemblyJobs) {
+            AssemblyJob* current = job.get();
+            pool.submit([current, &assembler] {
+                ThreadLoggerScope loggerScope(&current->logger);
+                current->success = assembler.assembleFile(current->inputFile, current->outputFile, current->diag,
+                                                          current->report.get());
+            });
+        }
+        pool.wait();
     }
     
-    LOG_INFO("Successfully wrote output file: " + outputFile);
+    int result = 0;
+    for (auto& job : assemblyJobs) {
+        job->logger.flush(GlobalLogger::getInstance());
+        if (!job->success) {
+            job->diag.printDiagnostics();
+            result = 1;
+        }
+    }
     
-    return 0;
-}
\ No newline at end of file
+    return finishReports(result);
+}
@@ -0,0 +1,254 @@
+#include "opt/function_order.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <numeric>
+#include "binary/function_cache.h"
+#include "parser/parser.h"
+#include "util/logger.h"
+#include "util/mapped_file.h"
+
+namespace coil {
+
+/**
+ * @brief Parse a count from a profile
+ *
+ * @param text Decimal digits
+ * @param value Parsed value (output)
+ * @return true if the whole text is a count
+ */
+static bool parseCount(std::string_view text, uint64_t& value) {
+    if (text.empty() || text.size() > 20) {
+        return false;
+    }
+    std::string digits(text);
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoull(digits.c_str(), &end, 10);
+    return std::isdigit(static_cast<unsigned char>(digits[0])) && *end == '\0' && errno != ERANGE;
+}
+
+bool FunctionProfile::load(const std::string& filename) {
+    auto file = MappedFile::open(filename);
+    if (!file) {
+        LOG_ERROR("Cannot read profile: {}", filename);
+        return false;
+    }
+    return parse(file->getContents(), filename);
+}
+
+bool FunctionProfile::parse(std::string_view text, const std::string& name) {
+    size_t lineNumber = 0;
+    while (!text.empty()) {
+        size_t lineEnd = text.find('\n');
+        std::string_view line = text.substr(0, lineEnd);
+        text.remove_prefix(lineEnd == std::string_view::npos ? text.size() : lineEnd + 1);
+        lineNumber++;
+
+        // Split the line into at most four fields, the fourth being an error
+        std::string_view fields[4];
+        size_t count = 0;
+        size_t pos = 0;
+        while (count < 4) {
+            pos = line.find_first_not_of(" \t\r", pos);
+            if (pos == std::string_view::npos) {
+                break;
+            }
+            size_t end = line.find_first_of(" \t\r", pos);
+            fields[count++] = line.substr(pos, end == std::string_view::npos ? line.size() - pos : end - pos);
+            pos = end == std::string_view::npos ? line.size() : end;
+        }
+        if (count == 0 || fields[0][0] == '#') {
+            continue;
+        }
+
+        uint64_t value;
+        if (count == 2 && parseCount(fields[1], value)) {
+            addFunction(std::string(fields[0]), value);
+        } else if (count == 3 && parseCount(fields[2], value)) {
+            addCall(std::string(fields[0]), std::string(fields[1]), value);
+        } else {
+            LOG_ERROR("{}:{}: expected '<function> <count>' or '<caller> <callee> <weight>'", name, lineNumber);
+            return false;
+        }
+    }
+    return true;
+}
+
+void FunctionProfile::addFunction(const std::string& function, uint64_t count) {
+    counts[function] += count;
+}
+
+void FunctionProfile::addCall(const std::string& caller, const std::string& callee, uint64_t weight) {
+    auto inserted = callIndex.emplace(caller + ' ' + callee, calls.size());
+    if (inserted.second) {
+        calls.push_back({caller, callee, 0});
+    }
+    calls[inserted.first->second].weight += weight;
+    calledCounts[callee] += weight;
+}
+
+uint64_t FunctionProfile::getCount(const std::string& function) const {
+    auto it = counts.find(function);
+    if (it != counts.end()) {
+        return it->second;
+    }
+
+    // Without a count of its own, a function ran as often as it was called
+    auto called = calledCounts.find(function);
+    return called != calledCounts.end() ? called->second : 0;
+}
+
+const std::vector<FunctionProfile::Call>& FunctionProfile::getCalls() const {
+    return calls;
+}
+
+bool FunctionProfile::empty() const {
+    return counts.empty() && calls.empty();
+}
+
+FunctionOrder::FunctionOrder(const FunctionProfile* functionProfile, InstructionEncoding instructionEncoding)
+    : profile(functionProfile), encoding(instructionEncoding) {
+}
+
+std::vector<size_t> FunctionOrder::compute(const Module& module, size_t& coldCount) const {
+    const auto& functions = module.getFunctions();
+    size_t count = functions.size();
+
+    std::unordered_map<std::string, size_t> index;
+    std::vector<uint64_t> entries(count, 0);
+    std::vector<uint64_t> sizes(count, 0);
+    bool profiled = false;
+    for (size_t i = 0; i < count; i++) {
+        const Function& function = *functions[i];
+        index.emplace(function.getName(), i);
+        if (profile) {
+            entries[i] = profile->getCount(function.getName());
+            profiled = profiled || entries[i] > 0;
+        }
+
+        if (function.getCachedCode()) {
+            sizes[i] = function.getCachedCode()->code.size();
+        }
+        for (const auto& instruction : function.getInstructions()) {
+            sizes[i] += instruction->encodedSize(encoding);
+        }
+    }
+
+    // Functions the profile never saw enter are cold, unless the profile
+    // does not cover the module at all
+    std::vector<size_t> hot, normal, cold;
+    for (size_t i = 0; i < count; i++) {
+        FunctionHeat heat = module.getFunctionHeat(functions[i]->getName());
+        if (heat == FUNCTION_HEAT_COLD) {
+            cold.push_back(i);
+        } else if (heat == FUNCTION_HEAT_HOT || entries[i] > 0) {
+            hot.push_back(i);
+        } else if (profiled) {
+            cold.push_back(i);
+        } else {
+            normal.push_back(i);
+        }
+    }
+
+    // The heaviest call into each hot function from another hot function
+    constexpr size_t NO_CALLER = SIZE_MAX;
+    std::vector<size_t> caller(count, NO_CALLER);
+    std::vector<uint64_t> callerWeight(count, 0);
+    std::vector<char> isHot(count, 0);
+    for (size_t i : hot) {
+        isHot[i] = 1;
+    }
+    if (profile) {
+        for (const auto& call : profile->getCalls()) {
+            auto from = index.find(call.caller);
+            auto to = index.find(call.callee);
+            if (from == index.end() || to == index.end() || from->second == to->second ||
+                !isHot[from->second] || !isHot[to->second] || call.weight <= callerWeight[to->second]) {
+                continue;
+            }
+            caller[to->second] = from->second;
+            callerWeight[to->second] = call.weight;
+        }
+    }
+
+    // Call-chain clustering: from the hottest function down, append each
+    // function's cluster to the cluster of its heaviest caller
+    std::vector<std::vector<size_t>> clusters(count);
+    std::vector<size_t> clusterOf(count);
+    std::vector<uint64_t> clusterSize(count, 0);
+    std::vector<uint64_t> clusterEntries(count, 0);
+    for (size_t i : hot) {
+        clusters[i].push_back(i);
+        clusterOf[i] = i;
+        clusterSize[i] = sizes[i];
+        clusterEntries[i] = entries[i];
+    }
+
+    std::vector<size_t> byEntries = hot;
+    std::stable_sort(byEntries.begin(), byEntries.end(),
+                     [&entries](size_t a, size_t b) { return entries[a] > entries[b]; });
+    for (size_t function : byEntries) {
+        if (caller[function] == NO_CALLER) {
+            continue;
+        }
+        size_t into = clusterOf[caller[function]];
+        size_t from = clusterOf[function];
+        if (into == from || clusterSize[into] + clusterSize[from] > MAX_CLUSTER_SIZE) {
+            continue;
+        }
+
+        for (size_t member : clusters[from]) {
+            clusterOf[member] = into;
+        }
+        clusters[into].insert(clusters[into].end(), clusters[from].begin(), clusters[from].end());
+        clusterSize[into] += clusterSize[from];
+        clusterEntries[into] += clusterEntries[from];
+        clusters[from].clear();
+    }
+
+    // Densest clusters first; clusters of equal density keep source order
+    std::vector<size_t> clusterOrder;
+    for (size_t i : hot) {
+        if (!clusters[i].empty()) {
+            clusterOrder.push_back(i);
+        }
+    }
+    auto density = [&clusterEntries, &clusterSize](size_t cluster) {
+        return static_cast<double>(clusterEntries[cluster]) /
+               static_cast<double>(std::max<uint64_t>(clusterSize[cluster], 1));
+    };
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(),
+                     [&density](size_t a, size_t b) { return density(a) > density(b); });
+
+    std::vector<size_t> order;
+    order.reserve(count);
+    for (size_t cluster : clusterOrder) {
+        order.insert(order.end(), clusters[cluster].begin(), clusters[cluster].end());
+    }
+    order.insert(order.end(), normal.begin(), normal.end());
+    order.insert(order.end(), cold.begin(), cold.end());
+    coldCount = cold.size();
+    return order;
+}
+
+bool FunctionOrder::run(Module& module) const {
+    if ((!profile || profile->empty()) && !module.hasFunctionHeat()) {
+        return false;
+    }
+
+    size_t coldCount;
+    std::vector<size_t> order = compute(module, coldCount);
+    std::vector<size_t> sourceOrder(order.size());
+    std::iota(sourceOrder.begin(), sourceOrder.end(), 0);
+    if (order == sourceOrder && coldCount == module.getColdFunctionCount()) {
+        return false;
+    }
+
+    LOG_DEBUG("Ordered {} functions, {} of them cold", order.size(), coldCount);
+    module.setFunctionOrder(order, coldCount);
+    return true;
+}
+
+} // namespace coil
@@ -0,0 +1,160 @@
+#ifndef COIL_OPT_FUNCTION_ORDER_H
+#define COIL_OPT_FUNCTION_ORDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "core/defs.h"
+
+namespace coil {
+
+class Module;
+
+/**
+ * @brief Call counts and call graph edge weights of a profiled run
+ *
+ * A profile is a text file with one entry per line; empty lines and
+ * lines starting with '#' are ignored:
+ *
+ *     <function> <count>            ; times the function was entered
+ *     <caller> <callee> <weight>    ; times the caller called the callee
+ *
+ * Entries for the same function or edge add up.
+ */
+class FunctionProfile {
+public:
+    /**
+     * @brief Weighted call graph edge
+     */
+    struct Call {
+        std::string caller;    // Calling function
+        std::string callee;    // Called function
+        uint64_t weight;       // Number of calls
+    };
+
+private:
+    std::unordered_map<std::string, uint64_t> counts;       // Function -> entry count
+    std::vector<Call> calls;                                // Edges in order of first appearance
+    std::unordered_map<std::string, size_t> callIndex;      // "caller callee" -> edge
+    std::unordered_map<std::string, uint64_t> calledCounts; // Callee -> total weight of its edges
+
+public:
+    /**
+     * @brief Read a profile file
+     *
+     * @param filename Profile file
+     * @return true on success, false if the file cannot be read or parsed
+     */
+    bool load(const std::string& filename);
+
+    /**
+     * @brief Parse a profile held in memory
+     *
+     * @param text Profile contents
+     * @param name Name for error messages
+     * @return true on success, false on a malformed line
+     */
+    bool parse(std::string_view text, const std::string& name);
+
+    /**
+     * @brief Add to the entry count of a function
+     *
+     * @param function Function name
+     * @param count Entry count
+     */
+    void addFunction(const std::string& function, uint64_t count);
+
+    /**
+     * @brief Add to the weight of a call graph edge
+     *
+     * Calls count as entries of the callee as well when the profile does
+     * not list it on its own.
+     *
+     * @param caller Calling function
+     * @param callee Called function
+     * @param weight Number of calls
+     */
+    void addCall(const std::string& caller, const std::string& callee, uint64_t weight);
+
+    /**
+     * @brief Get the entry count of a function
+     *
+     * @param function Function name
+     * @return Entry count (0 if the function was never entered)
+     */
+    uint64_t getCount(const std::string& function) const;
+
+    /**
+     * @brief Get the call graph edges
+     *
+     * @return Edges in order of first appearance
+     */
+    const std::vector<Call>& getCalls() const;
+
+    /**
+     * @brief Check if the profile has no entries
+     *
+     * @return true if empty
+     */
+    bool empty() const;
+};
+
+/**
+ * @brief Orders the functions of a module for code locality
+ *
+ * Functions are sorted into three groups. Hot functions come first. They
+ * are the ones marked HOT, or entered at least once in the profile.
+ * Cold functions come last and go to their own text.cold section. They
+ * are the ones marked COLD, or never entered while a profile that enters
+ * any function of the module is in use. Everything else stays in
+ * between, in source order.
+ *
+ * Hot functions are placed with call-chain clustering (C3). From the
+ * most frequently entered function down, each function's cluster is
+ * appended to the cluster of its heaviest caller. Clusters may grow up to
+ * one 2 MiB huge page. The clusters are then sorted by entries per byte,
+ * so callers sit next to their hottest callees and the hottest code
+ * shares as few pages and cache lines as possible.
+ */
+class FunctionOrder {
+private:
+    static constexpr uint64_t MAX_CLUSTER_SIZE = 2u << 20; // Largest cluster in bytes
+
+    const FunctionProfile* profile; // Profile (nullptr for none)
+    InstructionEncoding encoding;   // Encoding the sizes are measured in
+
+public:
+    /**
+     * @brief Construct a function order
+     *
+     * @param functionProfile Profile, or nullptr to go by HOT and COLD hints only
+     * @param instructionEncoding Encoding of the code section
+     */
+    FunctionOrder(const FunctionProfile* functionProfile, InstructionEncoding instructionEncoding);
+
+    /**
+     * @brief Compute the order of a module's functions
+     *
+     * @param module Module
+     * @param coldCount Number of cold functions at the end of the order (output)
+     * @return Function indices in their new order
+     */
+    std::vector<size_t> compute(const Module& module, size_t& coldCount) const;
+
+    /**
+     * @brief Reorder a module's functions
+     *
+     * Leaves a module without hints in source order when there is no profile.
+     *
+     * @param module Module to reorder
+     * @return true if the order changed
+     */
+    bool run(Module& module) const;
+};
+
+} // namespace coil
+
+#endif // COIL_OPT_FUNCTION_ORDER_H
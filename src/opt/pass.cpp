@@ -0,0 +1,80 @@
+#include "opt/pass.h"
+#include "opt/passes.h"
+#include "parser/parser.h"
+#include "util/arena.h"
+#include "util/logger.h"
+
+namespace coil {
+
+PassManager::PassManager() : maxIterations(1) {
+}
+
+void PassManager::addPass(std::unique_ptr<Pass> pass) {
+    passes.push_back(std::move(pass));
+}
+
+void PassManager::addStandardPasses(unsigned optLevel) {
+    if (optLevel == 0) {
+        return;
+    }
+
+    // Folding turns arithmetic into moves, which the move pass may then drop
+    if (optLevel >= 2) {
+        addPass(std::make_unique<ConstantFoldingPass>());
+    }
+    addPass(std::make_unique<NopEliminationPass>());
+    addPass(std::make_unique<RedundantMoveEliminationPass>());
+    addPass(std::make_unique<UnreachableCodeEliminationPass>());
+
+    if (optLevel >= 2) {
+        setMaxIterations(8);
+    }
+}
+
+void PassManager::setMaxIterations(size_t iterations) {
+    maxIterations = iterations > 0 ? iterations : 1;
+}
+
+size_t PassManager::getPassCount() const {
+    return passes.size();
+}
+
+bool PassManager::run(Function& func) {
+    bool changed = false;
+
+    for (size_t iteration = 0; iteration < maxIterations; iteration++) {
+        bool changedThisRound = false;
+        for (auto& pass : passes) {
+            changedThisRound |= pass->run(func);
+        }
+        if (!changedThisRound) {
+            break;
+        }
+        changed = true;
+    }
+
+    return changed;
+}
+
+bool PassManager::run(Module& module) {
+    // Instructions made by the passes live as long as the parsed ones
+    ArenaScope arenaScope(module.getArena());
+
+    bool changed = false;
+    size_t before = 0;
+    size_t after = 0;
+
+    for (const auto& function : module.getFunctions()) {
+        if (function->getCachedCode()) {
+            continue;
+        }
+        before += function->getInstructions().size();
+        changed |= run(*function);
+        after += function->getInstructions().size();
+    }
+
+    LOG_DEBUG("Optimization passes: {} -> {} instructions", before, after);
+    return changed;
+}
+
+} // namespace coil
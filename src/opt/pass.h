@@ -0,0 +1,108 @@
+#ifndef COIL_OPT_PASS_H
+#define COIL_OPT_PASS_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace coil {
+
+class Function;
+class Module;
+
+/**
+ * @brief Transformation over the instructions of one function
+ *
+ * Passes run after parsing and before code generation. New instructions
+ * are allocated in the module's arena (the pass manager makes it current),
+ * and instructions are removed through Function::removeInstructions so
+ * that labels stay attached to the right instructions.
+ */
+class Pass {
+public:
+    virtual ~Pass() = default;
+
+    /**
+     * @brief Get the pass name
+     *
+     * @return Name for logging
+     */
+    virtual const char* getName() const = 0;
+
+    /**
+     * @brief Run the pass over a function
+     *
+     * @param func Function to transform
+     * @return true if the function changed
+     */
+    virtual bool run(Function& func) = 0;
+};
+
+/**
+ * @brief Runs a sequence of passes over every function of a module
+ */
+class PassManager {
+private:
+    std::vector<std::unique_ptr<Pass>> passes; // Passes in order
+    size_t maxIterations;                      // Times to repeat the sequence while it changes something
+
+public:
+    /**
+     * @brief Construct an empty pass manager
+     */
+    PassManager();
+
+    /**
+     * @brief Add a pass to the end of the sequence
+     *
+     * @param pass Pass to add
+     */
+    void addPass(std::unique_ptr<Pass> pass);
+
+    /**
+     * @brief Add the passes for an optimization level
+     *
+     * Level 1 removes no-ops, redundant moves and unreachable code once;
+     * level 2 also folds constants and repeats the passes until nothing
+     * changes.
+     *
+     * @param optLevel Optimization level (0 adds nothing)
+     */
+    void addStandardPasses(unsigned optLevel);
+
+    /**
+     * @brief Set how often the sequence may repeat
+     *
+     * @param iterations Maximum number of runs per function (at least 1)
+     */
+    void setMaxIterations(size_t iterations);
+
+    /**
+     * @brief Get the number of passes
+     *
+     * @return Number of passes
+     */
+    size_t getPassCount() const;
+
+    /**
+     * @brief Run the passes over a function
+     *
+     * @param func Function to transform
+     * @return true if any pass changed the function
+     */
+    bool run(Function& func);
+
+    /**
+     * @brief Run the passes over every function of a module
+     *
+     * Functions whose code comes from the function cache are skipped.
+     *
+     * @param module Module to transform
+     * @return true if any function changed
+     */
+    bool run(Module& module);
+};
+
+} // namespace coil
+
+#endif // COIL_OPT_PASS_H
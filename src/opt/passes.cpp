@@ -0,0 +1,304 @@
+#include "opt/passes.h"
+#include "parser/parser.h"
+#include <cstring>
+#include <limits>
+
+namespace coil {
+
+static bool isPlainMove(const Instruction& inst) {
+    return inst.getCategory() == CAT_MEM && inst.getOperation() == MEM_MOV &&
+           inst.getOperandCount() == 2 && inst.getExtendedData().empty();
+}
+
+static bool isRegister(const OperandValue& value) {
+    return value.getClass() == OPERAND_REGISTER;
+}
+
+static bool sameOperand(const OperandValue& a, const OperandValue& b) {
+    return a.type == b.type && a.length == b.length && !a.isExternal() &&
+           std::memcmp(a.payload, b.payload, a.length) == 0;
+}
+
+/**
+ * @brief Check whether an operand reads a register, directly or as an address
+ */
+static bool readsRegister(const OperandValue& value, uint8_t regId) {
+    switch (value.getClass()) {
+        case OPERAND_REGISTER:
+            return value.payload[0] == regId;
+        case OPERAND_MEMORY:
+            switch (value.getSubtype()) {
+                case MEM_DIRECT:
+                    return false;
+                case MEM_REG_REG:
+                case MEM_REG_REG_SCALE:
+                    return value.payload[0] == regId || value.payload[1] == regId;
+                default:
+                    return value.payload[0] == regId;
+            }
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Read an integer immediate
+ *
+ * @param value Operand
+ * @param result Sign-extended value (output parameter)
+ * @return true if the operand is an integer immediate
+ */
+static bool readInteger(const OperandValue& value, int64_t& result) {
+    if (value.getClass() != OPERAND_IMMEDIATE) {
+        return false;
+    }
+
+    size_t size;
+    switch (value.getSubtype()) {
+        case IMM_INT8:  size = 1; break;
+        case IMM_INT16: size = 2; break;
+        case IMM_INT32: size = 4; break;
+        case IMM_INT64: size = 8; break;
+        default:        return false;
+    }
+
+    uint64_t bits = 0;
+    for (size_t i = 0; i < size; i++) {
+        bits |= static_cast<uint64_t>(value.payload[i]) << (i * 8);
+    }
+    if (size < 8 && (bits & (1ull << (size * 8 - 1)))) {
+        bits |= ~0ull << (size * 8);
+    }
+    result = static_cast<int64_t>(bits);
+    return true;
+}
+
+/**
+ * @brief Check whether an instruction sets every flag a branch can test,
+ *        without reading any
+ */
+static bool setsAllFlags(const Instruction& inst) {
+    switch (inst.getCategory()) {
+        case CAT_MEM:
+            return inst.getOperation() == MEM_COMPARE || inst.getOperation() == MEM_TEST;
+        case CAT_MATH:
+            return inst.getOperation() == MATH_ADD || inst.getOperation() == MATH_SUB ||
+                   inst.getOperation() == MATH_NEG;
+        case CAT_BIT:
+            return inst.getOperation() == BIT_AND || inst.getOperation() == BIT_OR ||
+                   inst.getOperation() == BIT_XOR || inst.getOperation() == BIT_CMP;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Check whether the flags after an instruction may be read
+ *
+ * Follows the fall-through path until the flags are set again. Calls and
+ * returns end it, as flags are not part of a calling convention; any
+ * other control flow, and the bit rotations through carry, count as reads.
+ *
+ * @param func Function
+ * @param index Instruction whose flags are in question
+ * @return true unless the flags are certainly overwritten or dropped
+ */
+static bool flagsObserved(const Function& func, size_t index) {
+    const auto& instructions = func.getInstructions();
+    for (size_t i = index + 1; i < instructions.size(); i++) {
+        const Instruction& inst = *instructions[i];
+        if (inst.getCategory() == CAT_CF) {
+            switch (inst.getOperation()) {
+                case CF_NOP:
+                case CF_FENCE:
+                case CF_YIELD:
+                    continue;
+                case CF_CALL:
+                case CF_SYSC:
+                case CF_RET:
+                    return false;
+                default:
+                    return true;
+            }
+        }
+        if (inst.getCategory() == CAT_BIT && (inst.getOperation() == BIT_RCL || inst.getOperation() == BIT_RCR)) {
+            return true;
+        }
+        if (setsAllFlags(inst)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+static std::vector<bool> labelTargets(const Function& func) {
+    std::vector<bool> targets(func.getInstructions().size() + 1, false);
+    for (const auto& [labelName, index] : func.getLabels()) {
+        if (index < targets.size()) {
+            targets[index] = true;
+        }
+    }
+    return targets;
+}
+
+const char* NopEliminationPass::getName() const {
+    return "nop-elimination";
+}
+
+bool NopEliminationPass::run(Function& func) {
+    const auto& instructions = func.getInstructions();
+    std::vector<bool> removed(instructions.size(), false);
+
+    for (size_t i = 0; i < instructions.size(); i++) {
+        const Instruction& inst = *instructions[i];
+        removed[i] = inst.getCategory() == CAT_CF && inst.getOperation() == CF_NOP &&
+                     inst.getExtendedData().empty();
+    }
+
+    return func.removeInstructions(removed) > 0;
+}
+
+const char* RedundantMoveEliminationPass::getName() const {
+    return "redundant-move-elimination";
+}
+
+bool RedundantMoveEliminationPass::run(Function& func) {
+    const auto& instructions = func.getInstructions();
+    std::vector<bool> targets = labelTargets(func);
+    std::vector<bool> removed(instructions.size(), false);
+
+    for (size_t i = 0; i < instructions.size(); i++) {
+        const Instruction& inst = *instructions[i];
+        if (!isPlainMove(inst) || !isRegister(inst.getOperandValue(0))) {
+            continue;
+        }
+
+        const OperandValue& dest = inst.getOperandValue(0);
+        const OperandValue& source = inst.getOperandValue(1);
+
+        // MOV R, R
+        if (sameOperand(dest, source)) {
+            removed[i] = true;
+            continue;
+        }
+
+        if (i + 1 >= instructions.size() || !isPlainMove(*instructions[i + 1])) {
+            continue;
+        }
+        const OperandValue& nextDest = instructions[i + 1]->getOperandValue(0);
+        const OperandValue& nextSource = instructions[i + 1]->getOperandValue(1);
+
+        // MOV A, B then MOV B, A: the second copies back what is already
+        // there, unless it can also be reached by a branch
+        if (isRegister(source) && sameOperand(nextDest, source) && sameOperand(nextSource, dest) &&
+            !targets[i + 1]) {
+            removed[i + 1] = true;
+            continue;
+        }
+
+        // MOV R, x then MOV R, y where y does not read R: the first write is
+        // never seen. Memory sources are kept, since the load may fault.
+        if (source.getClass() != OPERAND_MEMORY && sameOperand(nextDest, dest) &&
+            !readsRegister(nextSource, dest.payload[0])) {
+            removed[i] = true;
+        }
+    }
+
+    return func.removeInstructions(removed) > 0;
+}
+
+const char* ConstantFoldingPass::getName() const {
+    return "constant-folding";
+}
+
+bool ConstantFoldingPass::run(Function& func) {
+    const auto& instructions = func.getInstructions();
+    bool changed = false;
+
+    for (size_t i = 0; i < instructions.size(); i++) {
+        const Instruction& inst = *instructions[i];
+        if (inst.getCategory() != CAT_MATH || !inst.getExtendedData().empty() ||
+            inst.getOperandCount() < 2 || !isRegister(inst.getOperandValue(0))) {
+            continue;
+        }
+
+        int64_t a, b = 0;
+        bool binary = inst.getOperation() != MATH_NEG;
+        if (inst.getOperandCount() != (binary ? 3u : 2u) || !readInteger(inst.getOperandValue(1), a) ||
+            (binary && !readInteger(inst.getOperandValue(2), b))) {
+            continue;
+        }
+
+        // Unsigned arithmetic wraps instead of overflowing
+        uint64_t ua = static_cast<uint64_t>(a);
+        uint64_t ub = static_cast<uint64_t>(b);
+        bool overflowingDivision = b == 0 || (a == std::numeric_limits<int64_t>::min() && b == -1);
+        int64_t result;
+
+        switch (inst.getOperation()) {
+            case MATH_ADD: result = static_cast<int64_t>(ua + ub); break;
+            case MATH_SUB: result = static_cast<int64_t>(ua - ub); break;
+            case MATH_MUL: result = static_cast<int64_t>(ua * ub); break;
+            case MATH_DIV:
+                if (overflowingDivision) {
+                    continue;
+                }
+                result = a / b;
+                break;
+            case MATH_MOD:
+                if (overflowingDivision) {
+                    continue;
+                }
+                result = a % b;
+                break;
+            case MATH_MIN: result = a < b ? a : b; break;
+            case MATH_MAX: result = a > b ? a : b; break;
+            case MATH_NEG: result = static_cast<int64_t>(0 - ua); break;
+            default:
+                continue;
+        }
+
+        // A move leaves the flags alone, so the arithmetic stays when
+        // something may read the flags it sets
+        if (flagsObserved(func, i)) {
+            continue;
+        }
+
+        auto move = std::make_unique<Instruction>(CAT_MEM, MEM_MOV);
+        move->addOperand(inst.getOperandValue(0));
+        move->addOperand(OperandValue::makeImmediate(result));
+        func.replaceInstruction(i, std::move(move));
+        changed = true;
+    }
+
+    return changed;
+}
+
+const char* UnreachableCodeEliminationPass::getName() const {
+    return "unreachable-code-elimination";
+}
+
+bool UnreachableCodeEliminationPass::run(Function& func) {
+    const auto& instructions = func.getInstructions();
+    std::vector<bool> targets = labelTargets(func);
+    std::vector<bool> removed(instructions.size(), false);
+
+    // Only a label makes code after a jump or return reachable again
+    bool reachable = true;
+    for (size_t i = 0; i < instructions.size(); i++) {
+        if (targets[i]) {
+            reachable = true;
+        }
+        removed[i] = !reachable;
+
+        const Instruction& inst = *instructions[i];
+        if (reachable && inst.getCategory() == CAT_CF &&
+            (inst.getOperation() == CF_BR || inst.getOperation() == CF_RET || inst.getOperation() == CF_IRET)) {
+            reachable = false;
+        }
+    }
+
+    return func.removeInstructions(removed) > 0;
+}
+
+} // namespace coil
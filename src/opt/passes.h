@@ -0,0 +1,57 @@
+#ifndef COIL_OPT_PASSES_H
+#define COIL_OPT_PASSES_H
+
+#include "opt/pass.h"
+
+namespace coil {
+
+/**
+ * @brief Removes CF NOP instructions
+ */
+class NopEliminationPass : public Pass {
+public:
+    const char* getName() const override;
+    bool run(Function& func) override;
+};
+
+/**
+ * @brief Removes MEM MOV instructions that have no effect
+ *
+ * Drops moves of a register to itself, moves straight back to the
+ * register just copied from, and register writes that the next
+ * instruction overwrites without reading.
+ */
+class RedundantMoveEliminationPass : public Pass {
+public:
+    const char* getName() const override;
+    bool run(Function& func) override;
+};
+
+/**
+ * @brief Folds MATH instructions whose sources are integer immediates
+ *
+ * The three-operand forms of ADD, SUB, MUL, DIV, MOD, MIN and MAX, and
+ * two-operand NEG, become a MEM MOV of the result. Division by zero and
+ * overflowing division are left for run time. Arithmetic wraps at 64 bits.
+ * A move does not set the flags, so nothing is folded while a branch may
+ * still read the flags the arithmetic sets.
+ */
+class ConstantFoldingPass : public Pass {
+public:
+    const char* getName() const override;
+    bool run(Function& func) override;
+};
+
+/**
+ * @brief Removes instructions that follow an unconditional CF BR, CF RET
+ *        or CF IRET and precede the next label
+ */
+class UnreachableCodeEliminationPass : public Pass {
+public:
+    const char* getName() const override;
+    bool run(Function& func) override;
+};
+
+} // namespace coil
+
+#endif // COIL_OPT_PASSES_H
@@ -0,0 +1,181 @@
+#include "parser/data_builder.h"
+#include <algorithm>
+#include "core/defs.h"
+
+namespace coil {
+
+/**
+ * @brief Round an offset up to an alignment
+ *
+ * @param offset Offset
+ * @param alignment Alignment (a power of two)
+ * @return Aligned offset
+ */
+static uint64_t alignUp(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+uint64_t DataBuilder::Section::size() const {
+    return type == SECTION_BSS ? bssSize : data.size();
+}
+
+DataBuilder::DataBuilder()
+    : current(NO_SECTION), objectLabels(0), objectAlignment(1), objectPlaced(false), objectStart(0),
+      pendingZeros(0) {
+}
+
+size_t DataBuilder::findSection(const std::string& name, uint32_t type, uint32_t flags) {
+    auto found = sectionIndex.find(name);
+    if (found != sectionIndex.end()) {
+        sections[found->second].flags |= flags;
+        return found->second;
+    }
+
+    sections.push_back({name, type, flags, 1, {}, 0});
+    sectionIndex.emplace(name, sections.size() - 1);
+    return sections.size() - 1;
+}
+
+void DataBuilder::setSection(const std::string& name, uint32_t type, uint32_t flags) {
+    finishObject();
+    current = type == SECTION_CODE ? NO_SECTION : findSection(name, type, flags);
+}
+
+bool DataBuilder::hasSection() const {
+    return current != NO_SECTION;
+}
+
+bool DataBuilder::inBss() const {
+    return current != NO_SECTION && sections[current].type == SECTION_BSS;
+}
+
+bool DataBuilder::addLabel(const std::string& name) {
+    if (labelIndex.count(name)) {
+        return false;
+    }
+
+    // Labels with nothing between them name the same object
+    if (objectPlaced || pendingZeros > 0) {
+        finishObject();
+    }
+
+    labelIndex.emplace(name, labels.size());
+    labels.push_back({name, current, 0, 0});
+    return true;
+}
+
+void DataBuilder::placeObject() {
+    Section& section = sections[current];
+    if (section.type == SECTION_BSS) {
+        objectStart = alignUp(section.bssSize, objectAlignment);
+        section.bssSize = objectStart;
+    } else {
+        objectStart = alignUp(section.data.size(), objectAlignment);
+        section.data.resize(static_cast<size_t>(objectStart), 0);
+    }
+    section.alignment = std::max(section.alignment, objectAlignment);
+    objectPlaced = true;
+
+    for (size_t i = objectLabels; i < labels.size(); i++) {
+        labels[i].section = current;
+        labels[i].offset = objectStart;
+    }
+}
+
+void DataBuilder::writePendingZeros() {
+    Section& section = sections[current];
+    if (section.type == SECTION_BSS) {
+        section.bssSize += pendingZeros;
+    } else {
+        section.data.resize(static_cast<size_t>(section.data.size() + pendingZeros), 0);
+    }
+    pendingZeros = 0;
+}
+
+std::vector<uint8_t>& DataBuilder::appendBytes() {
+    if (!objectPlaced) {
+        placeObject();
+    }
+    writePendingZeros();
+    return sections[current].data;
+}
+
+void DataBuilder::addZeros(uint64_t count) {
+    pendingZeros += count;
+}
+
+bool DataBuilder::padTo(uint64_t size) {
+    uint64_t objectSize = pendingZeros;
+    if (objectPlaced) {
+        objectSize += sections[current].size() - objectStart;
+    }
+
+    if (size < objectSize) {
+        return false;
+    }
+    pendingZeros += size - objectSize;
+    return true;
+}
+
+void DataBuilder::align(uint32_t alignment) {
+    Section& section = sections[current];
+    section.alignment = std::max(section.alignment, alignment);
+
+    // An object that has no place yet starts at its own alignment, so it
+    // is aligned as a whole and the padding inside it stays the same
+    // wherever it ends up
+    if (!objectPlaced) {
+        objectAlignment = std::max(objectAlignment, alignment);
+        pendingZeros = alignUp(pendingZeros, alignment);
+        return;
+    }
+
+    uint64_t end = section.size() + pendingZeros;
+    pendingZeros += alignUp(end, alignment) - end;
+}
+
+void DataBuilder::finishObject() {
+    if (current != NO_SECTION) {
+        uint64_t size = 0;
+        if (!objectPlaced && pendingZeros > 0) {
+            // Nothing but zeros: only the size is kept
+            size_t bss = findSection("bss", SECTION_BSS, SECTION_FLAG_ALLOC | SECTION_FLAG_WRITE);
+            Section& section = sections[bss];
+            uint64_t offset = alignUp(section.bssSize, objectAlignment);
+            section.bssSize = offset + pendingZeros;
+            section.alignment = std::max(section.alignment, objectAlignment);
+            for (size_t i = objectLabels; i < labels.size(); i++) {
+                labels[i].section = bss;
+                labels[i].offset = offset;
+            }
+            size = pendingZeros;
+            pendingZeros = 0;
+        } else if (objectPlaced) {
+            writePendingZeros();
+            size = sections[current].size() - objectStart;
+        } else if (objectLabels < labels.size()) {
+            // Labels with nothing after them point at the end of the section
+            placeObject();
+        }
+
+        for (size_t i = objectLabels; i < labels.size(); i++) {
+            labels[i].size = size;
+        }
+    }
+
+    objectLabels = labels.size();
+    objectAlignment = 1;
+    objectPlaced = false;
+    objectStart = 0;
+    pendingZeros = 0;
+}
+
+const std::vector<DataBuilder::Section>& DataBuilder::getSections() const {
+    return sections;
+}
+
+const std::vector<DataBuilder::Label>& DataBuilder::getLabels() const {
+    return labels;
+}
+
+} // namespace coil
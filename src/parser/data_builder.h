@@ -0,0 +1,168 @@
+#ifndef COIL_PARSER_DATA_BUILDER_H
+#define COIL_PARSER_DATA_BUILDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace coil {
+
+/**
+ * @brief Lays out the data sections of a module
+ *
+ * Data is built one object at a time: an object starts at a label and
+ * runs to the next label or section change. Initialized bytes go straight
+ * into their section, while zeros are only counted until something
+ * follows them. An object that ends up holding nothing but zeros (ZERO,
+ * PADD and the padding between them) is moved to the "bss" section, which
+ * records its size without storing any bytes.
+ */
+class DataBuilder {
+public:
+    static constexpr size_t NO_SECTION = SIZE_MAX;
+
+    /**
+     * @brief One data section
+     */
+    struct Section {
+        std::string name;          // Section name
+        uint32_t type;             // Section type
+        uint32_t flags;            // Section flags
+        uint32_t alignment;        // Largest alignment asked for
+        std::vector<uint8_t> data; // Contents (empty for BSS)
+        uint64_t bssSize;          // Size of a BSS section
+
+        uint64_t size() const;
+    };
+
+    /**
+     * @brief A label and the object it names
+     */
+    struct Label {
+        std::string name;          // Label name
+        size_t section;            // Section index
+        uint64_t offset;           // Offset of the object in the section
+        uint64_t size;             // Size of the object
+    };
+
+private:
+    std::vector<Section> sections;   // Sections in order of first use
+    std::vector<Label> labels;       // Labels in order of definition
+    std::unordered_map<std::string, size_t> sectionIndex; // Name -> section
+    std::unordered_map<std::string, size_t> labelIndex;   // Name -> label
+    size_t current;                  // Section data goes to (NO_SECTION for none)
+
+    // The object being built
+    size_t objectLabels;             // First label of the object (labels.size() if none)
+    uint32_t objectAlignment;        // Alignment of the object's start
+    bool objectPlaced;               // true once the object has a place in its section
+    uint64_t objectStart;            // Offset of the object, once placed
+    uint64_t pendingZeros;           // Zeros that follow the object's bytes
+
+    size_t findSection(const std::string& name, uint32_t type, uint32_t flags);
+    void placeObject();
+    void writePendingZeros();
+
+public:
+    DataBuilder();
+
+    /**
+     * @brief Continue in a section, creating it on first use
+     *
+     * Code sections hold functions, not data, so data directives have
+     * nowhere to go until a data section is selected.
+     *
+     * @param name Section name
+     * @param type Section type
+     * @param flags Section flags
+     */
+    void setSection(const std::string& name, uint32_t type, uint32_t flags);
+
+    /**
+     * @brief Check if there is a data section to add to
+     *
+     * @return true if data can be added
+     */
+    bool hasSection() const;
+
+    /**
+     * @brief Check if the current section is a BSS section
+     *
+     * @return true if only zeros can be added
+     */
+    bool inBss() const;
+
+    /**
+     * @brief Start a new object at a label
+     *
+     * A label right after another one names the same object.
+     *
+     * @param name Label name
+     * @return true if added, false if the name is already used
+     */
+    bool addLabel(const std::string& name);
+
+    /**
+     * @brief Get the buffer to append initialized bytes to
+     *
+     * Places the current object in its section first, so callers append
+     * straight into the section contents. Not for BSS sections.
+     *
+     * @return Section contents
+     */
+    std::vector<uint8_t>& appendBytes();
+
+    /**
+     * @brief Add zeros to the current object
+     *
+     * @param count Number of zero bytes
+     */
+    void addZeros(uint64_t count);
+
+    /**
+     * @brief Pad the current object with zeros up to a size
+     *
+     * @param size Size of the object after padding
+     * @return true on success, false if the object is already larger
+     */
+    bool padTo(uint64_t size);
+
+    /**
+     * @brief Align the next data to a boundary
+     *
+     * Until the object holds initialized bytes this aligns the object
+     * itself, so it can still move to the BSS section; after that, the
+     * object is padded in place.
+     *
+     * @param alignment Alignment boundary (a power of two)
+     */
+    void align(uint32_t alignment);
+
+    /**
+     * @brief Finish the current object
+     *
+     * Called on every label and section change, and once at the end.
+     */
+    void finishObject();
+
+    /**
+     * @brief Get the sections
+     *
+     * @return Sections in order of first use
+     */
+    const std::vector<Section>& getSections() const;
+
+    /**
+     * @brief Get the labels
+     *
+     * @return Labels in order of definition
+     */
+    const std::vector<Label>& getLabels() const;
+};
+
+} // namespace coil
+
+#endif // COIL_PARSER_DATA_BUILDER_H
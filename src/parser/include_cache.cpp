@@ -0,0 +1,67 @@
+#include "parser/include_cache.h"
+
+namespace coil {
+
+IncludeCache::IncludeCache() : hitCount(0) {
+}
+
+std::shared_ptr<const IncludedFile> IncludeCache::get(const std::string& path, DiagnosticEngine& diag) {
+    std::error_code error;
+    auto modified = std::filesystem::last_write_time(path, error);
+    if (error) {
+        return nullptr;
+    }
+
+    std::shared_ptr<const IncludedFile> file;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = files.find(path);
+        if (it != files.end() && it->second->modified == modified) {
+            hitCount++;
+            file = it->second;
+        }
+    }
+
+    if (!file) {
+        // Tokenize outside the lock; two threads including the same new
+        // file both do the work, and the last one stores its result
+        auto loaded = std::make_shared<IncludedFile>();
+        loaded->path = path;
+        loaded->modified = modified;
+        loaded->contents = MappedFile::open(path);
+        if (!loaded->contents) {
+            return nullptr;
+        }
+
+        DiagnosticEngine lexerDiag;
+        lexerDiag.setErrorLimit(diag.getErrorLimit());
+        Lexer lexer(loaded->contents->getContents(), path, lexerDiag);
+        for (Token token = lexer.next(); token.type != TOKEN_EOF; token = lexer.next()) {
+            loaded->tokens.push_back(token);
+        }
+        loaded->diagnostics = lexerDiag.getDiagnostics();
+
+        if (lexerDiag.hasErrorDiagnostics()) {
+            for (const auto& diagnostic : loaded->diagnostics) {
+                diag.report(diagnostic.severity, diagnostic.message, diagnostic.location);
+            }
+            return nullptr;
+        }
+
+        file = loaded;
+        std::lock_guard<std::mutex> lock(mutex);
+        files[path] = file;
+    }
+
+    for (const auto& diagnostic : file->diagnostics) {
+        diag.report(diagnostic.severity, diagnostic.message, diagnostic.location);
+    }
+    return file;
+}
+
+size_t IncludeCache::getHitCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hitCount;
+}
+
+} // namespace coil
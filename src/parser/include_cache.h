@@ -0,0 +1,68 @@
+#ifndef COIL_PARSER_INCLUDE_CACHE_H
+#define COIL_PARSER_INCLUDE_CACHE_H
+
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "parser/lexer.h"
+#include "util/diagnostic.h"
+#include "util/mapped_file.h"
+
+namespace coil {
+
+/**
+ * @brief Tokenized contents of an included file
+ */
+struct IncludedFile {
+    std::string path;                    // Normalized path of the file
+    std::unique_ptr<MappedFile> contents; // File contents (token text points into them)
+    std::vector<Token> tokens;           // Tokens, without the trailing EOF
+    std::vector<Diagnostic> diagnostics; // Lexer warnings, reported again on every include
+    std::filesystem::file_time_type modified; // Modification time when the file was read
+};
+
+/**
+ * @brief Tokenized include files shared between parsers
+ *
+ * A file is read and tokenized once and then handed to every parser that
+ * includes it, across all the inputs of a run. An entry is reused only
+ * while the file's modification time is unchanged. Files with lexer
+ * errors are not kept, so each input that includes one reports the
+ * errors. The cache is safe to use from several threads at once.
+ */
+class IncludeCache {
+private:
+    std::map<std::string, std::shared_ptr<const IncludedFile>> files; // Normalized path -> file
+    size_t hitCount;             // Lookups answered from the cache
+    mutable std::mutex mutex;    // Guards files and hitCount
+
+public:
+    IncludeCache();
+
+    /**
+     * @brief Get the tokens of a file
+     *
+     * Diagnostics from tokenizing the file are reported to the given
+     * engine, whether or not the file came from the cache.
+     *
+     * @param path Normalized path of the file
+     * @param diag Diagnostic engine of the including parser
+     * @return Included file, or nullptr if it cannot be read or has lexer errors
+     */
+    std::shared_ptr<const IncludedFile> get(const std::string& path, DiagnosticEngine& diag);
+
+    /**
+     * @brief Get the number of includes answered without reading the file
+     *
+     * @return Cache hit count
+     */
+    size_t getHitCount() const;
+};
+
+} // namespace coil
+
+#endif // COIL_PARSER_INCLUDE_CACHE_H
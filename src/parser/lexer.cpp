@@ -1,58 +1,251 @@
 #include "parser/lexer.h"
 #include <sstream>
-#include <cctype>
-#include <algorithm>
-#include <unordered_map>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include "core/defs.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace coil {
 
-// Utility functions
+// Character classes, indexed by byte value. Unlike <cctype> these don't
+// depend on the locale and bytes >= 0x80 are never identifier characters.
+enum CharClass : uint8_t {
+    CHAR_SPACE      = 0x01, // ' ', '\t', '\r', '\n'
+    CHAR_IDENT      = 0x02, // A-Z, a-z, _
+    CHAR_DIGIT      = 0x04, // 0-9
+    CHAR_HEX        = 0x08  // 0-9, A-F, a-f
+};
+
+static constexpr std::array<uint8_t, 256> makeCharClasses() {
+    std::array<uint8_t, 256> classes{};
+    classes[' '] = classes['\t'] = classes['\r'] = classes['\n'] = CHAR_SPACE;
+    for (int c = 'A'; c <= 'Z'; c++) {
+        classes[c] |= CHAR_IDENT;
+        classes[c + ('a' - 'A')] |= CHAR_IDENT;
+    }
+    for (int c = 'A'; c <= 'F'; c++) {
+        classes[c] |= CHAR_HEX;
+        classes[c + ('a' - 'A')] |= CHAR_HEX;
+    }
+    for (int c = '0'; c <= '9'; c++) {
+        classes[c] |= CHAR_DIGIT | CHAR_HEX;
+    }
+    classes['_'] |= CHAR_IDENT;
+    return classes;
+}
+
+static constexpr std::array<uint8_t, 256> charClasses = makeCharClasses();
+
+static bool hasClass(char c, uint8_t mask) {
+    return (charClasses[static_cast<unsigned char>(c)] & mask) != 0;
+}
+
 static bool isIdentifierStart(char c) {
-    return std::isalpha(c) || c == '_';
+    return hasClass(c, CHAR_IDENT);
 }
 
 static bool isIdentifierPart(char c) {
-    return std::isalnum(c) || c == '_';
-}
-
-// Static maps for categories, directives, and registers
-static const std::unordered_map<std::string, bool> categoryMap = {
-    {"CF", true},
-    {"MEM", true},
-    {"MATH", true},
-    {"BIT", true},
-    {"VEC", true},
-    {"ATM", true},
-    {"VAR", true},
-    {"FRAME", true}
-};
+    return hasClass(c, CHAR_IDENT | CHAR_DIGIT);
+}
 
-static const std::unordered_map<std::string, bool> directiveMap = {
-    {"DIR", true},
-    {"SECT", true},
-    {"LABEL", true},
-    {"HINT", true},
-    {"FUNC", true},
-    {"ENDFUNC", true},
-    {"GLOBAL", true},
-    {"LOCAL", true},
-    {"WEAK", true},
-    {"ALIGN", true},
-    {"ABI", true},
-    {"TARGET", true},
-    {"CONFIG", true},
-    {"INST", true},
-    {"ZERO", true},
-    {"ASCII", true},
-    {"UNICODE", true},
-    {"PADD", true},
-    {"INCLUDE", true},
-    {"MACRO", true},
-    {"ENDM", true},
-    {"STRUCT", true},
-    {"ENDSTRUCT", true},
-    {"CONST", true}
-};
+static bool isDigit(char c) {
+    return hasClass(c, CHAR_DIGIT);
+}
+
+static bool isHexDigit(char c) {
+    return hasClass(c, CHAR_HEX);
+}
+
+// Run scanners. Each returns the length of the run at the start of
+// [begin, end); with SSE2 they classify 16 bytes per step and fall back to
+// the class table for the tail.
+
+/**
+ * @brief Find the end of a run of whitespace
+ *
+ * @param newlines Number of newlines in the run (output parameter)
+ * @param lastNewline Last newline in the run, if any (output parameter)
+ */
+static size_t whitespaceRun(const char* begin, const char* end, int& newlines, const char*& lastNewline) {
+    const char* p = begin;
+    newlines = 0;
+    lastNewline = nullptr;
+    
+#if defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i isLf = _mm_cmpeq_epi8(chunk, lf);
+        __m128i isSpace = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+                                       _mm_or_si128(_mm_cmpeq_epi8(chunk, cr), isLf));
+        unsigned spaceMask = static_cast<unsigned>(_mm_movemask_epi8(isSpace));
+        unsigned lfMask = static_cast<unsigned>(_mm_movemask_epi8(isLf));
+        
+        // Number of leading whitespace bytes in this chunk
+        unsigned run = spaceMask == 0xFFFF ? 16 : static_cast<unsigned>(__builtin_ctz(~spaceMask));
+        lfMask &= (run == 16) ? 0xFFFF : ((1u << run) - 1);
+        
+        if (lfMask) {
+            newlines += __builtin_popcount(lfMask);
+            lastNewline = p + (31 - __builtin_clz(lfMask));
+        }
+        
+        p += run;
+        if (run < 16) {
+            return static_cast<size_t>(p - begin);
+        }
+    }
+#endif
+    
+    while (p < end && hasClass(*p, CHAR_SPACE)) {
+        if (*p == '\n') {
+            newlines++;
+            lastNewline = p;
+        }
+        p++;
+    }
+    
+    return static_cast<size_t>(p - begin);
+}
+
+/**
+ * @brief Find the end of a run of identifier characters (A-Z, a-z, 0-9, _)
+ */
+static size_t identifierRun(const char* begin, const char* end) {
+    const char* p = begin;
+    
+#if defined(__SSE2__)
+    // Signed compares; bytes >= 0x80 are negative and fail every range
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    const __m128i beforeA = _mm_set1_epi8('a' - 1);
+    const __m128i afterZ = _mm_set1_epi8('z' + 1);
+    const __m128i before0 = _mm_set1_epi8('0' - 1);
+    const __m128i after9 = _mm_set1_epi8('9' + 1);
+    const __m128i underscore = _mm_set1_epi8('_');
+    
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i lower = _mm_or_si128(chunk, caseBit);
+        __m128i isLetter = _mm_and_si128(_mm_cmpgt_epi8(lower, beforeA), _mm_cmplt_epi8(lower, afterZ));
+        __m128i isDigitByte = _mm_and_si128(_mm_cmpgt_epi8(chunk, before0), _mm_cmplt_epi8(chunk, after9));
+        __m128i isPart = _mm_or_si128(_mm_or_si128(isLetter, isDigitByte), _mm_cmpeq_epi8(chunk, underscore));
+        unsigned partMask = static_cast<unsigned>(_mm_movemask_epi8(isPart));
+        
+        if (partMask != 0xFFFF) {
+            return static_cast<size_t>(p - begin) + static_cast<unsigned>(__builtin_ctz(~partMask));
+        }
+        p += 16;
+    }
+#endif
+    
+    while (p < end && isIdentifierPart(*p)) {
+        p++;
+    }
+    
+    return static_cast<size_t>(p - begin);
+}
+
+// Keyword classification. The keyword set is fixed, so every lookup
+// switches on the length and first character and then compares at most a
+// couple of candidates; ordinary identifiers are usually rejected by the
+// first switch without touching their text.
+static bool keywordIs(std::string_view identifier, const char* keyword, size_t length) {
+    return std::memcmp(identifier.data(), keyword, length) == 0;
+}
+
+#define KEYWORD(text) keywordIs(identifier, text, sizeof(text) - 1)
+
+static bool lookupCategoryKeyword(std::string_view identifier, uint8_t& category) {
+    switch (identifier.size()) {
+        case 2:
+            if (KEYWORD("CF")) { category = CAT_CF; return true; }
+            break;
+        case 3:
+            switch (identifier[0]) {
+                case 'M': if (KEYWORD("MEM")) { category = CAT_MEM; return true; } break;
+                case 'B': if (KEYWORD("BIT")) { category = CAT_BIT; return true; } break;
+                case 'A': if (KEYWORD("ATM")) { category = CAT_ATM; return true; } break;
+                case 'V':
+                    if (KEYWORD("VEC")) { category = CAT_VEC; return true; }
+                    if (KEYWORD("VAR")) { category = CAT_VAR; return true; }
+                    break;
+            }
+            break;
+        case 4:
+            if (KEYWORD("MATH")) { category = CAT_MATH; return true; }
+            break;
+        case 5:
+            if (KEYWORD("FRAME")) { category = CAT_FRAME; return true; }
+            break;
+    }
+    return false;
+}
+
+static DirectiveId lookupDirectiveKeyword(std::string_view identifier) {
+    switch (identifier.size()) {
+        case 3:
+            switch (identifier[0]) {
+                case 'D': if (KEYWORD("DIR")) return DIRECTIVE_DIR; break;
+                case 'A': if (KEYWORD("ABI")) return DIRECTIVE_ABI; break;
+            }
+            break;
+        case 4:
+            switch (identifier[0]) {
+                case 'S': if (KEYWORD("SECT")) return DIRECTIVE_SECT; break;
+                case 'H': if (KEYWORD("HINT")) return DIRECTIVE_HINT; break;
+                case 'F': if (KEYWORD("FUNC")) return DIRECTIVE_FUNC; break;
+                case 'W': if (KEYWORD("WEAK")) return DIRECTIVE_WEAK; break;
+                case 'I': if (KEYWORD("INST")) return DIRECTIVE_INST; break;
+                case 'Z': if (KEYWORD("ZERO")) return DIRECTIVE_ZERO; break;
+                case 'P': if (KEYWORD("PADD")) return DIRECTIVE_PADD; break;
+                case 'E': if (KEYWORD("ENDM")) return DIRECTIVE_ENDM; break;
+            }
+            break;
+        case 5:
+            switch (identifier[0]) {
+                case 'L':
+                    if (KEYWORD("LABEL")) return DIRECTIVE_LABEL;
+                    if (KEYWORD("LOCAL")) return DIRECTIVE_LOCAL;
+                    break;
+                case 'A':
+                    if (KEYWORD("ALIGN")) return DIRECTIVE_ALIGN;
+                    if (KEYWORD("ASCII")) return DIRECTIVE_ASCII;
+                    break;
+                case 'C': if (KEYWORD("CONST")) return DIRECTIVE_CONST; break;
+                case 'M': if (KEYWORD("MACRO")) return DIRECTIVE_MACRO; break;
+            }
+            break;
+        case 6:
+            switch (identifier[0]) {
+                case 'G': if (KEYWORD("GLOBAL")) return DIRECTIVE_GLOBAL; break;
+                case 'T': if (KEYWORD("TARGET")) return DIRECTIVE_TARGET; break;
+                case 'C': if (KEYWORD("CONFIG")) return DIRECTIVE_CONFIG; break;
+                case 'S': if (KEYWORD("STRUCT")) return DIRECTIVE_STRUCT; break;
+            }
+            break;
+        case 7:
+            switch (identifier[0]) {
+                case 'E': if (KEYWORD("ENDFUNC")) return DIRECTIVE_ENDFUNC; break;
+                case 'U': if (KEYWORD("UNICODE")) return DIRECTIVE_UNICODE; break;
+                case 'I': if (KEYWORD("INCLUDE")) return DIRECTIVE_INCLUDE; break;
+            }
+            break;
+        case 9:
+            if (KEYWORD("ENDSTRUCT")) return DIRECTIVE_ENDSTRUCT;
+            break;
+    }
+    return DIRECTIVE_NONE;
+}
+
+#undef KEYWORD
 
 // Implementation of Token toString method
 std::string Token::toString() const {
@@ -99,34 +292,35 @@ std::string Token::toString() const {
 }
 
 // Lexer implementation
-Lexer::Lexer(const std::string& source, const std::string& file, DiagnosticEngine& diagnostics)
-    : sourceCode(source), filename(file), position(0), line(1), column(1), diag(diagnostics) {
+Lexer::Lexer(std::string_view source, std::string_view file, DiagnosticEngine& diagnostics)
+    : sourceCode(source), filename(SourceLocation::intern(file)), position(0), line(1), column(1), diag(diagnostics) {
 }
 
-std::vector<Token> Lexer::tokenize() {
-    std::vector<Token> tokens;
-    
-    while (!isAtEnd()) {
+Token Lexer::next() {
+    while (true) {
         skipWhitespace();
         
-        if (isAtEnd()) {
-            break;
+        // Past the error limit the rest of the source is not worth scanning
+        if (isAtEnd() || diag.hasReachedErrorLimit()) {
+            return Token(TOKEN_EOF, "", getCurrentLocation());
         }
         
         Token token = scanToken();
         
+        // Comments never reach the parser; errors are returned so the
+        // caller can keep going and report more than one of them
         if (token.type != TOKEN_COMMENT) {
-            tokens.push_back(token);
-        }
-        
-        if (token.type == TOKEN_ERROR) {
-            // Continue tokenizing even after an error to catch multiple errors
-        }
-        
-        if (token.type == TOKEN_EOF) {
-            break;
+            return token;
         }
     }
+}
+
+std::vector<Token> Lexer::tokenize() {
+    std::vector<Token> tokens;
+    
+    for (Token token = next(); token.type != TOKEN_EOF; token = next()) {
+        tokens.push_back(token);
+    }
     
     return tokens;
 }
@@ -135,79 +329,109 @@ SourceLocation Lexer::getCurrentLocation() const {
     return SourceLocation(filename, line, column);
 }
 
-bool Lexer::isCategory(const std::string& identifier) {
-    return categoryMap.find(identifier) != categoryMap.end();
+std::string_view Lexer::getSource() const {
+    return sourceCode;
 }
 
-bool Lexer::isDirective(const std::string& identifier) {
-    return directiveMap.find(identifier) != directiveMap.end();
+std::string_view Lexer::getFilename() const {
+    return filename;
 }
 
-bool Lexer::isRegister(const std::string& identifier, uint8_t& regId) {
-    // Check if the string matches a register pattern (R0-R15, F0-F15, V0-V15)
-    if (identifier.size() >= 2) {
-        char regClass = identifier[0];
-        std::string regNumStr = identifier.substr(1);
-        
-        // Try to parse the register number
-        try {
-            int regNum = std::stoi(regNumStr);
+LexerState Lexer::getState() const {
+    return LexerState{position, line, column};
+}
+
+void Lexer::setState(const LexerState& state) {
+    position = state.position;
+    line = state.line;
+    column = state.column;
+}
+
+bool Lexer::isCategory(std::string_view identifier) {
+    uint8_t category;
+    return lookupCategoryKeyword(identifier, category);
+}
+
+bool Lexer::lookupCategory(std::string_view identifier, uint8_t& category) {
+    return lookupCategoryKeyword(identifier, category);
+}
+
+bool Lexer::isDirective(std::string_view identifier) {
+    return lookupDirectiveKeyword(identifier) != DIRECTIVE_NONE;
+}
+
+DirectiveId Lexer::lookupDirective(std::string_view identifier) {
+    return lookupDirectiveKeyword(identifier);
+}
+
+bool Lexer::isRegister(std::string_view identifier, uint8_t& regId) {
+    size_t length = identifier.size();
+    if (length < 2 || length > 5) {
+        return false;
+    }
+    
+    // Numbered registers (R0-R15, F0-F15, V0-V15)
+    uint8_t base;
+    switch (identifier[0]) {
+        case 'R': base = REG_R0; break;
+        case 'F': base = REG_F0; break;
+        case 'V': base = REG_V0; break;
+        default: base = 0xFF; break;
+    }
+    
+    if (base != 0xFF && length <= 3) {
+        char d0 = identifier[1];
+        if (d0 >= '0' && d0 <= '9') {
+            if (length == 2) {
+                regId = static_cast<uint8_t>(base + (d0 - '0'));
+                return true;
+            }
             
-            // Check if it's a valid register ID
-            if (regNum >= 0 && regNum <= 15) {
-                if (regClass == 'R') {
-                    regId = static_cast<uint8_t>(regNum);
-                    return true;
-                } else if (regClass == 'F') {
-                    regId = static_cast<uint8_t>(0x10 + regNum);
-                    return true;
-                } else if (regClass == 'V') {
-                    regId = static_cast<uint8_t>(0x20 + regNum);
-                    return true;
-                }
+            // Two digits: 10-15 (no leading zeros)
+            char d1 = identifier[2];
+            if (d0 == '1' && d1 >= '0' && d1 <= '5') {
+                regId = static_cast<uint8_t>(base + 10 + (d1 - '0'));
+                return true;
             }
-        } catch (...) {
-            // Not a number
+            return false;
         }
     }
     
-    // Check for special registers
-    if (identifier == "PC") {
-        regId = 0x30;
-        return true;
-    } else if (identifier == "SP") {
-        regId = 0x31;
-        return true;
-    } else if (identifier == "FP") {
-        regId = 0x32;
-        return true;
-    } else if (identifier == "FLAGS") {
-        regId = 0x33;
-        return true;
-    } else if (identifier == "LR") {
-        regId = 0x34;
-        return true;
+    // Special registers
+    switch (length) {
+        case 2:
+            switch (identifier[0]) {
+                case 'P': if (identifier[1] == 'C') { regId = REG_PC; return true; } break;
+                case 'S': if (identifier[1] == 'P') { regId = REG_SP; return true; } break;
+                case 'F': if (identifier[1] == 'P') { regId = REG_FRAME_PTR; return true; } break;
+                case 'L': if (identifier[1] == 'R') { regId = REG_LR; return true; } break;
+            }
+            break;
+        case 5:
+            if (identifier == "FLAGS") {
+                regId = REG_FLAGS;
+                return true;
+            }
+            break;
     }
     
     return false;
 }
 
-bool Lexer::isVariable(const std::string& identifier, uint8_t& varId) {
+bool Lexer::isVariable(std::string_view identifier, uint8_t& varId) {
     // Check if the string matches a variable pattern ($0-$255)
     if (identifier.size() >= 2 && identifier[0] == '$') {
-        std::string varNumStr = identifier.substr(1);
+        const char* numBegin = identifier.data() + 1;
+        const char* numEnd = identifier.data() + identifier.size();
         
         // Try to parse the variable ID
-        try {
-            int varNum = std::stoi(varNumStr);
-            
-            // Check if it's a valid variable ID
-            if (varNum >= 0 && varNum <= 255) {
-                varId = static_cast<uint8_t>(varNum);
-                return true;
-            }
-        } catch (...) {
-            // Not a number
+        int varNum = -1;
+        auto result = std::from_chars(numBegin, numEnd, varNum);
+        
+        // Check if it's a valid variable ID
+        if (result.ec == std::errc() && result.ptr == numEnd && varNum >= 0 && varNum <= 255) {
+            varId = static_cast<uint8_t>(varNum);
+            return true;
         }
     }
     
@@ -222,6 +446,13 @@ char Lexer::peek() const {
     return sourceCode[position];
 }
 
+char Lexer::peekNext() const {
+    if (position + 1 >= sourceCode.size()) {
+        return '\0';
+    }
+    return sourceCode[position + 1];
+}
+
 char Lexer::advance() {
     char c = peek();
     position++;
@@ -245,22 +476,23 @@ bool Lexer::match(char expected) {
     return true;
 }
 
+void Lexer::advanceInLine(size_t count) {
+    position += count;
+    column += static_cast<int>(count);
+}
+
 void Lexer::skipWhitespace() {
-    while (!isAtEnd()) {
-        char c = peek();
-        
-        switch (c) {
-            case ' ':
-            case '\t':
-            case '\r':
-                advance();
-                break;
-            case '\n':
-                advance();
-                break;
-            default:
-                return;
-        }
+    const char* begin = sourceCode.data() + position;
+    int newlines;
+    const char* lastNewline;
+    size_t run = whitespaceRun(begin, sourceCode.data() + sourceCode.size(), newlines, lastNewline);
+    
+    position += run;
+    if (newlines) {
+        line += newlines;
+        column = static_cast<int>(begin + run - lastNewline);
+    } else {
+        column += static_cast<int>(run);
     }
 }
 
@@ -276,13 +508,13 @@ Token Lexer::scanToken() {
         return scanComment();
     }
     
-    // Check for identifiers (includes instructions and registers)
-    if (isIdentifierStart(c)) {
+    // Check for identifiers (includes instructions, registers and variables)
+    if (isIdentifierStart(c) || c == '$') {
         return scanIdentifier();
     }
     
     // Check for numbers
-    if (std::isdigit(c) || (c == '-' && std::isdigit(peek()))) {
+    if (isDigit(c) || (c == '-' && isDigit(peekNext()))) {
         return scanNumber();
     }
     
@@ -320,21 +552,30 @@ Token Lexer::scanToken() {
     
     // Unrecognized character
     SourceLocation errorLoc(filename, line, column - 1);
-    std::string errorMsg = "Unexpected character: '" + std::string(1, c) + "'";
-    diag.error(errorMsg, errorLoc);
+    diag.error("Unexpected character: '" + std::string(1, c) + "'", errorLoc);
     
-    return Token(TOKEN_ERROR, errorMsg, errorLoc);
+    return Token(TOKEN_ERROR, sourceCode.substr(position - 1, 1), errorLoc);
 }
 
 Token Lexer::scanIdentifier() {
     size_t startPos = position;
     int startColumn = column;
     
-    while (!isAtEnd() && isIdentifierPart(peek())) {
-        advance();
+    advanceInLine(1); // Consume the first character (may be '$')
+    
+    const char* sourceEnd = sourceCode.data() + sourceCode.size();
+    while (true) {
+        advanceInLine(identifierRun(sourceCode.data() + position, sourceEnd));
+        
+        // A '-' followed by a letter continues the name (abi-linux-x86_64)
+        if (peek() == '-' && isIdentifierStart(peekNext())) {
+            advanceInLine(1);
+            continue;
+        }
+        break;
     }
     
-    std::string identifier = sourceCode.substr(startPos, position - startPos);
+    std::string_view identifier = sourceCode.substr(startPos, position - startPos);
     SourceLocation location(filename, line, startColumn);
     
     // Check if this is a register
@@ -354,17 +595,19 @@ Token Lexer::scanIdentifier() {
     }
     
     // Check if this is a category or instruction
-    if (isCategory(identifier)) {
-        return Token(TOKEN_INSTRUCTION, identifier, location);
-    }
-    
-    // Check if this is a directive
-    if (isDirective(identifier)) {
-        return Token(TOKEN_DIRECTIVE, identifier, location);
+    uint8_t category;
+    if (lookupCategoryKeyword(identifier, category)) {
+        Token token(TOKEN_INSTRUCTION, identifier, location);
+        token.category = category;
+        return token;
     }
     
-    // General identifier
-    return Token(TOKEN_IDENTIFIER, identifier, location);
+    // Only DIR introduces a directive; the other directive keywords stay
+    // identifiers and carry their id so the parser can dispatch on it
+    DirectiveId directive = lookupDirectiveKeyword(identifier);
+    Token token(directive == DIRECTIVE_DIR ? TOKEN_DIRECTIVE : TOKEN_IDENTIFIER, identifier, location);
+    token.directive = directive;
+    return token;
 }
 
 Token Lexer::scanNumber() {
@@ -377,7 +620,39 @@ Token Lexer::scanNumber() {
         isNegative = true;
     }
     
-    while (!isAtEnd() && std::isdigit(peek())) {
+    // Hexadecimal (0x) and binary (0b) integers
+    if (peek() == '0' && (peekNext() == 'x' || peekNext() == 'X' ||
+                          peekNext() == 'b' || peekNext() == 'B')) {
+        int base = (peekNext() == 'x' || peekNext() == 'X') ? 16 : 2;
+        advance(); // Consume the '0'
+        advance(); // Consume the base prefix
+        
+        size_t digitsPos = position;
+        while (!isAtEnd() && (base == 16 ? isHexDigit(peek())
+                                         : (peek() == '0' || peek() == '1'))) {
+            advance();
+        }
+        
+        std::string_view numberText = sourceCode.substr(startPos, position - startPos);
+        SourceLocation location(filename, line, startColumn);
+        
+        // Parse as unsigned so 0xFFFFFFFFFFFFFFFF keeps its bit pattern
+        uint64_t value = 0;
+        const char* digitsBegin = sourceCode.data() + digitsPos;
+        const char* digitsEnd = sourceCode.data() + position;
+        auto result = std::from_chars(digitsBegin, digitsEnd, value, base);
+        if (digitsBegin == digitsEnd || result.ec != std::errc() || result.ptr != digitsEnd ||
+            (!isAtEnd() && isIdentifierPart(peek()))) {
+            diag.error("Invalid integer number: " + std::string(numberText), location);
+            return Token(TOKEN_ERROR, numberText, location);
+        }
+        
+        Token token(TOKEN_INTEGER, numberText, location);
+        token.intValue = static_cast<int64_t>(isNegative ? 0 - value : value);
+        return token;
+    }
+    
+    while (!isAtEnd() && isDigit(peek())) {
         advance();
     }
     
@@ -387,7 +662,7 @@ Token Lexer::scanNumber() {
         isFloat = true;
         advance(); // Consume the dot
         
-        while (!isAtEnd() && std::isdigit(peek())) {
+        while (!isAtEnd() && isDigit(peek())) {
             advance();
         }
     }
@@ -401,41 +676,36 @@ Token Lexer::scanNumber() {
             advance(); // Consume the sign
         }
         
-        if (!isAtEnd() && std::isdigit(peek())) {
-            while (!isAtEnd() && std::isdigit(peek())) {
+        if (!isAtEnd() && isDigit(peek())) {
+            while (!isAtEnd() && isDigit(peek())) {
                 advance();
             }
         } else {
             SourceLocation errorLoc(filename, line, column);
-            std::string errorMsg = "Expected digits after exponent";
-            diag.error(errorMsg, errorLoc);
-            return Token(TOKEN_ERROR, errorMsg, errorLoc);
+            diag.error("Expected digits after exponent", errorLoc);
+            return Token(TOKEN_ERROR, sourceCode.substr(startPos, position - startPos), errorLoc);
         }
     }
     
-    std::string numberText = sourceCode.substr(startPos, position - startPos);
+    std::string_view numberText = sourceCode.substr(startPos, position - startPos);
     SourceLocation location(filename, line, startColumn);
+    const char* numBegin = numberText.data();
+    const char* numEnd = numberText.data() + numberText.size();
     
     if (isFloat) {
         Token token(TOKEN_FLOAT, numberText, location);
-        try {
-            token.floatValue = std::stod(numberText);
-        } catch (...) {
-            SourceLocation errorLoc(filename, line, startColumn);
-            std::string errorMsg = "Invalid float number: " + numberText;
-            diag.error(errorMsg, errorLoc);
-            return Token(TOKEN_ERROR, errorMsg, errorLoc);
+        auto result = std::from_chars(numBegin, numEnd, token.floatValue);
+        if (result.ec != std::errc() || result.ptr != numEnd) {
+            diag.error("Invalid float number: " + std::string(numberText), location);
+            return Token(TOKEN_ERROR, numberText, location);
         }
         return token;
     } else {
         Token token(TOKEN_INTEGER, numberText, location);
-        try {
-            token.intValue = std::stoll(numberText);
-        } catch (...) {
-            SourceLocation errorLoc(filename, line, startColumn);
-            std::string errorMsg = "Invalid integer number: " + numberText;
-            diag.error(errorMsg, errorLoc);
-            return Token(TOKEN_ERROR, errorMsg, errorLoc);
+        auto result = std::from_chars(numBegin, numEnd, token.intValue);
+        if (result.ec != std::errc() || result.ptr != numEnd) {
+            diag.error("Invalid integer number: " + std::string(numberText), location);
+            return Token(TOKEN_ERROR, numberText, location);
         }
         return token;
     }
@@ -453,9 +723,8 @@ Token Lexer::scanString() {
             
             if (isAtEnd()) {
                 SourceLocation errorLoc(filename, line, column);
-                std::string errorMsg = "Unterminated escape sequence";
-                diag.error(errorMsg, errorLoc);
-                return Token(TOKEN_ERROR, errorMsg, errorLoc);
+                diag.error("Unterminated escape sequence", errorLoc);
+                return Token(TOKEN_ERROR, sourceCode.substr(startPos), errorLoc);
             }
             
             advance(); // Consume the escaped character
@@ -466,16 +735,15 @@ Token Lexer::scanString() {
     
     if (isAtEnd()) {
         SourceLocation errorLoc(filename, line, startColumn);
-        std::string errorMsg = "Unterminated string";
-        diag.error(errorMsg, errorLoc);
-        return Token(TOKEN_ERROR, errorMsg, errorLoc);
+        diag.error("Unterminated string", errorLoc);
+        return Token(TOKEN_ERROR, sourceCode.substr(startPos), errorLoc);
     }
     
     advance(); // Consume the closing quote
     
     size_t contentStart = startPos + 1;
     size_t contentLength = position - startPos - 2;
-    std::string stringContent = sourceCode.substr(contentStart, contentLength);
+    std::string_view stringContent = sourceCode.substr(contentStart, contentLength);
     SourceLocation location(filename, line, startColumn);
     
     return Token(TOKEN_STRING, stringContent, location);
@@ -485,13 +753,13 @@ Token Lexer::scanComment() {
     size_t startPos = position;
     int startColumn = column;
     
-    advance(); // Consume the semicolon
-    
-    while (!isAtEnd() && peek() != '\n') {
-        advance();
-    }
+    // A comment runs to the end of the line; memchr is vectorized by libc
+    const void* newline = std::memchr(sourceCode.data() + position, '\n', sourceCode.size() - position);
+    size_t endPos = newline ? static_cast<size_t>(static_cast<const char*>(newline) - sourceCode.data())
+                            : sourceCode.size();
+    advanceInLine(endPos - position);
     
-    std::string commentText = sourceCode.substr(startPos, position - startPos);
+    std::string_view commentText = sourceCode.substr(startPos, position - startPos);
     SourceLocation location(filename, line, startColumn);
     
     return Token(TOKEN_COMMENT, commentText, location);
@@ -2,6 +2,7 @@
 #define COIL_PARSER_LEXER_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
 #include "util/source_location.h"
@@ -38,19 +39,57 @@ enum TokenType {
     TOKEN_DOT,            // .
     TOKEN_ARROW,          // ->
     TOKEN_INSTRUCTION,    // Instruction category (CF, MEM, MATH, etc.)
-    TOKEN_DIRECTIVE,      // Directive (DIR, etc.)
+    TOKEN_DIRECTIVE,      // Directive introducer (DIR)
     TOKEN_LABEL,          // Label identifier
     TOKEN_COMMENT,        // Comment
     TOKEN_ERROR           // Error token
 };
 
+/**
+ * @brief Directive keywords
+ *
+ * Identifiers that name a directive keep TOKEN_IDENTIFIER (they are also
+ * valid as plain names) and carry one of these ids in Token::directive.
+ */
+enum DirectiveId : uint8_t {
+    DIRECTIVE_NONE = 0,   // Not a directive keyword
+    DIRECTIVE_DIR,        // DIR
+    DIRECTIVE_SECT,       // SECT
+    DIRECTIVE_LABEL,      // LABEL
+    DIRECTIVE_HINT,       // HINT
+    DIRECTIVE_FUNC,       // FUNC
+    DIRECTIVE_ENDFUNC,    // ENDFUNC
+    DIRECTIVE_GLOBAL,     // GLOBAL
+    DIRECTIVE_LOCAL,      // LOCAL
+    DIRECTIVE_WEAK,       // WEAK
+    DIRECTIVE_ALIGN,      // ALIGN
+    DIRECTIVE_ABI,        // ABI
+    DIRECTIVE_TARGET,     // TARGET
+    DIRECTIVE_CONFIG,     // CONFIG
+    DIRECTIVE_INST,       // INST
+    DIRECTIVE_ZERO,       // ZERO
+    DIRECTIVE_ASCII,      // ASCII
+    DIRECTIVE_UNICODE,    // UNICODE
+    DIRECTIVE_PADD,       // PADD
+    DIRECTIVE_INCLUDE,    // INCLUDE
+    DIRECTIVE_MACRO,      // MACRO
+    DIRECTIVE_ENDM,       // ENDM
+    DIRECTIVE_STRUCT,     // STRUCT
+    DIRECTIVE_ENDSTRUCT,  // ENDSTRUCT
+    DIRECTIVE_CONST       // CONST
+};
+
 /**
  * @brief Token in COIL assembly
+ *
+ * The token text is a view into the lexer's source buffer, so tokens
+ * must not outlive the buffer they were scanned from.
  */
 struct Token {
     TokenType type;         // Token type
-    std::string text;       // Token text
+    std::string_view text;  // Token text (view into the source)
     SourceLocation location; // Token location
+    uint32_t source;        // Expansion the token came out of (0 for the input itself)
     
     // Values for different token types
     union {
@@ -58,31 +97,48 @@ struct Token {
         double floatValue;   // Float value
         uint8_t regId;       // Register ID
         uint8_t varId;       // Variable ID
+        uint8_t category;    // Instruction category (InstructionCategory)
+        uint8_t directive;   // Directive keyword (DirectiveId)
     };
     
-    Token(TokenType t, const std::string& txt, const SourceLocation& loc)
-        : type(t), text(txt), location(loc), intValue(0) {}
+    Token()
+        : type(TOKEN_EOF), source(0), intValue(0) {}
+    
+    Token(TokenType t, std::string_view txt, const SourceLocation& loc)
+        : type(t), text(txt), location(loc), source(0), intValue(0) {}
         
     std::string toString() const;
 };
 
+/**
+ * @brief Position of a lexer in its source
+ */
+struct LexerState {
+    size_t position;         // Offset of the next character
+    int line;                // Line number of the next character
+    int column;              // Column number of the next character
+};
+
 /**
  * @brief Lexer for COIL assembly
  * 
- * Breaks a COIL assembly source into tokens.
+ * Breaks a COIL assembly source into tokens. The source is not copied;
+ * the caller keeps it alive for as long as the tokens are in use.
  */
 class Lexer {
 private:
-    std::string sourceCode;  // Source code
-    std::string filename;    // Source filename
-    size_t position;         // Current position in source
-    int line;                // Current line number
-    int column;              // Current column number
-    DiagnosticEngine& diag;  // Diagnostics
+    std::string_view sourceCode; // Source code
+    std::string_view filename;   // Source filename (interned)
+    size_t position;             // Current position in source
+    int line;                    // Current line number
+    int column;                  // Current column number
+    DiagnosticEngine& diag;      // Diagnostics
     
     // Helper methods
     char peek() const;
+    char peekNext() const;
     char advance();
+    void advanceInLine(size_t count);
     bool match(char expected);
     void skipWhitespace();
     Token scanToken();
@@ -97,16 +153,27 @@ public:
     /**
      * @brief Construct a new Lexer
      * 
-     * @param source Source code
+     * @param source Source code (must outlive the lexer and its tokens)
      * @param file Source filename
      * @param diagnostics Diagnostic engine
      */
-    Lexer(const std::string& source, const std::string& file, DiagnosticEngine& diagnostics);
+    Lexer(std::string_view source, std::string_view file, DiagnosticEngine& diagnostics);
     
     /**
-     * @brief Tokenize the source code
+     * @brief Scan the next token
      * 
-     * @return Vector of tokens
+     * Comments are skipped. Once the end of the source is reached, or the
+     * diagnostics reach their error limit, every further call returns a
+     * TOKEN_EOF token.
+     * 
+     * @return Next token
+     */
+    Token next();
+    
+    /**
+     * @brief Tokenize the whole source code
+     * 
+     * @return Vector of tokens (without the trailing EOF token)
      */
     std::vector<Token> tokenize();
     
@@ -117,13 +184,51 @@ public:
      */
     SourceLocation getCurrentLocation() const;
     
+    /**
+     * @brief Get the source code being scanned
+     * 
+     * @return Source code
+     */
+    std::string_view getSource() const;
+    
+    /**
+     * @brief Get the filename tokens are attributed to
+     * 
+     * @return Source filename (interned)
+     */
+    std::string_view getFilename() const;
+    
+    /**
+     * @brief Get the current position
+     * 
+     * @return Lexer state
+     */
+    LexerState getState() const;
+    
+    /**
+     * @brief Continue scanning from another position
+     * 
+     * @param state Position to continue from (must be the start of a token
+     *              or of whitespace)
+     */
+    void setState(const LexerState& state);
+    
     /**
      * @brief Check if an identifier is a category
      * 
      * @param identifier Identifier to check
      * @return true if it's a category, false otherwise
      */
-    static bool isCategory(const std::string& identifier);
+    static bool isCategory(std::string_view identifier);
+    
+    /**
+     * @brief Look up an instruction category keyword
+     * 
+     * @param identifier Identifier to check
+     * @param category Instruction category (output parameter)
+     * @return true if it's a category, false otherwise
+     */
+    static bool lookupCategory(std::string_view identifier, uint8_t& category);
     
     /**
      * @brief Check if an identifier is a directive
@@ -131,7 +236,15 @@ public:
      * @param identifier Identifier to check
      * @return true if it's a directive, false otherwise
      */
-    static bool isDirective(const std::string& identifier);
+    static bool isDirective(std::string_view identifier);
+    
+    /**
+     * @brief Look up a directive keyword
+     * 
+     * @param identifier Identifier to check
+     * @return Directive ID, or DIRECTIVE_NONE if it's not a directive
+     */
+    static DirectiveId lookupDirective(std::string_view identifier);
     
     /**
      * @brief Check if an identifier is a register
@@ -140,7 +253,7 @@ public:
      * @param regId Register ID (output parameter)
      * @return true if it's a register, false otherwise
      */
-    static bool isRegister(const std::string& identifier, uint8_t& regId);
+    static bool isRegister(std::string_view identifier, uint8_t& regId);
     
     /**
      * @brief Check if an identifier is a variable
@@ -149,7 +262,7 @@ public:
      * @param varId Variable ID (output parameter)
      * @return true if it's a variable, false otherwise
      */
-    static bool isVariable(const std::string& identifier, uint8_t& varId);
+    static bool isVariable(std::string_view identifier, uint8_t& varId);
 };
 
 } // namespace coil
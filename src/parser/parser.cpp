@@ -1,13 +1,235 @@
 #include "parser/parser.h"
+#include "core/type.h"
 #include "util/logger.h"
+#include "util/thread_pool.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
 #include <sstream>
 #include <unordered_map>
 
 namespace coil {
 
+// Operation mnemonics per instruction category
+struct OperationName {
+    std::string_view name; // Mnemonic
+    uint8_t operation;     // Operation within the category
+};
+
+static const OperationName controlFlowOps[] = {
+    {"BR", CF_BR}, {"BRC", CF_BRC}, {"CALL", CF_CALL}, {"RET", CF_RET},
+    {"INT", CF_INT}, {"IRET", CF_IRET}, {"HLT", CF_HLT}, {"SYSC", CF_SYSC},
+    {"TRAP", CF_TRAP}, {"WFE", CF_WFE}, {"SEV", CF_SEV}, {"FENCE", CF_FENCE},
+    {"YIELD", CF_YIELD}, {"SWITCH", CF_SWITCH}, {"NOP", CF_NOP}
+};
+
+static const OperationName memoryOps[] = {
+    {"MOV", MEM_MOV}, {"PUSH", MEM_PUSH}, {"POP", MEM_POP}, {"LOAD", MEM_LOAD},
+    {"STORE", MEM_STORE}, {"PREFETCH", MEM_PREFETCH}, {"EXCHANGE", MEM_EXCHANGE},
+    {"COMPARE", MEM_COMPARE}, {"TEST", MEM_TEST}, {"FILL", MEM_FILL},
+    {"COPY", MEM_COPY}, {"ZERO", MEM_ZERO}, {"PUSH_STATE", MEM_PUSH_STATE},
+    {"POP_STATE", MEM_POP_STATE}, {"OUT", MEM_OUT}, {"IN", MEM_IN}
+};
+
+static const OperationName arithmeticOps[] = {
+    {"ADD", MATH_ADD}, {"SUB", MATH_SUB}, {"MUL", MATH_MUL}, {"DIV", MATH_DIV},
+    {"MOD", MATH_MOD}, {"NEG", MATH_NEG}, {"INC", MATH_INC}, {"DEC", MATH_DEC},
+    {"ABS", MATH_ABS}, {"SQRT", MATH_SQRT}, {"MIN", MATH_MIN}, {"MAX", MATH_MAX},
+    {"FMA", MATH_FMA}, {"ROUND", MATH_ROUND}, {"FLOOR", MATH_FLOOR},
+    {"CEIL", MATH_CEIL}, {"TRUNC", MATH_TRUNC}
+};
+
+static const OperationName bitOps[] = {
+    {"AND", BIT_AND}, {"OR", BIT_OR}, {"XOR", BIT_XOR}, {"NOT", BIT_NOT},
+    {"ANDN", BIT_ANDN}, {"ORN", BIT_ORN}, {"XNOR", BIT_XNOR}, {"SHL", BIT_SHL},
+    {"SHR", BIT_SHR}, {"SAR", BIT_SAR}, {"ROL", BIT_ROL}, {"ROR", BIT_ROR},
+    {"RCL", BIT_RCL}, {"RCR", BIT_RCR}, {"BSWAP", BIT_BSWAP}, {"BITREV", BIT_BITREV},
+    {"CLZ", BIT_CLZ}, {"CTZ", BIT_CTZ}, {"POPCNT", BIT_POPCNT}, {"PARITY", BIT_PARITY},
+    {"EXTRACT", BIT_EXTRACT}, {"INSERT", BIT_INSERT}, {"SET", BIT_SET},
+    {"CLR", BIT_CLR}, {"TST", BIT_TST}, {"TGL", BIT_TGL}, {"CMP", BIT_CMP}
+};
+
+static const OperationName vectorOps[] = {
+    {"MOV", VEC_MOV}, {"LOAD", VEC_LOAD}, {"STORE", VEC_STORE}, {"SPLAT", VEC_SPLAT},
+    {"ADD", VEC_ADD}, {"SUB", VEC_SUB}, {"MUL", VEC_MUL}, {"DIV", VEC_DIV},
+    {"MIN", VEC_MIN}, {"MAX", VEC_MAX}, {"AND", VEC_AND}, {"OR", VEC_OR},
+    {"XOR", VEC_XOR}, {"SQRT", VEC_SQRT}, {"LANES", VEC_LANES}
+};
+
+static const OperationName variableOps[] = {
+    {"DECL", VAR_DECL}, {"PMT", VAR_PMT}, {"DMT", VAR_DMT}, {"DLT", VAR_DLT},
+    {"ALIAS", VAR_ALIAS}
+};
+
+static const OperationName frameOps[] = {
+    {"ENTER", FRAME_ENTER}, {"LEAVE", FRAME_LEAVE}, {"SAVE", FRAME_SAVE},
+    {"REST", FRAME_REST}
+};
+
+static const OperationName conditionCodes[] = {
+    {"EQ", COND_EQ}, {"NE", COND_NE}, {"LT", COND_LT}, {"LE", COND_LE},
+    {"GT", COND_GT}, {"GE", COND_GE}, {"Z", COND_Z}, {"NZ", COND_NZ},
+    {"CS", COND_CS}, {"CC", COND_CC}, {"VS", COND_VS}, {"VC", COND_VC},
+    {"NS", COND_NS}, {"NC", COND_NC}, {"PS", COND_PS}, {"PC", COND_PC}
+};
+
+// Element types of vector operations
+static const OperationName elementTypes[] = {
+    {"int8", TYPE_INT8}, {"int16", TYPE_INT16}, {"int32", TYPE_INT32}, {"int64", TYPE_INT64},
+    {"uint8", TYPE_UINT8}, {"uint16", TYPE_UINT16}, {"uint32", TYPE_UINT32}, {"uint64", TYPE_UINT64},
+    {"fp32", TYPE_FP32}, {"fp64", TYPE_FP64}
+};
+
+template <size_t N>
+static bool lookupName(const OperationName (&table)[N], std::string_view name, uint8_t& value) {
+    for (const auto& entry : table) {
+        if (entry.name == name) {
+            value = entry.operation;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool lookupOperation(uint8_t category, std::string_view name, uint8_t& operation) {
+    switch (category) {
+        case CAT_CF:    return lookupName(controlFlowOps, name, operation);
+        case CAT_MEM:   return lookupName(memoryOps, name, operation);
+        case CAT_MATH:  return lookupName(arithmeticOps, name, operation);
+        case CAT_BIT:   return lookupName(bitOps, name, operation);
+        case CAT_VEC:   return lookupName(vectorOps, name, operation);
+        case CAT_VAR:   return lookupName(variableOps, name, operation);
+        case CAT_FRAME: return lookupName(frameOps, name, operation);
+        default:        return false; // No ATM operations are defined yet
+    }
+}
+
+/**
+ * @brief Append a string literal's bytes, decoding its escapes
+ * 
+ * Runs without escapes are appended in one piece.
+ * 
+ * @param text Literal as written, without the quotes
+ * @param out Buffer to append to
+ * @param bad Offset of an invalid escape (output parameter)
+ * @return true on success, false on an invalid escape
+ */
+static bool appendStringBytes(std::string_view text, std::vector<uint8_t>& out, size_t& bad) {
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+    const char* p = begin;
+    
+    while (p < end) {
+        const char* escape = static_cast<const char*>(std::memchr(p, '\\', end - p));
+        const char* runEnd = escape ? escape : end;
+        out.insert(out.end(), reinterpret_cast<const uint8_t*>(p), reinterpret_cast<const uint8_t*>(runEnd));
+        if (!escape) {
+            break;
+        }
+        
+        // The lexer only ends a string on an unescaped quote, so a
+        // character always follows the backslash
+        p = escape + 2;
+        switch (escape[1]) {
+            case 'n':  out.push_back('\n'); break;
+            case 't':  out.push_back('\t'); break;
+            case 'r':  out.push_back('\r'); break;
+            case '0':  out.push_back('\0'); break;
+            case '\\': out.push_back('\\'); break;
+            case '"':  out.push_back('"'); break;
+            case '\'': out.push_back('\''); break;
+            case 'x': {
+                int value = 0;
+                int digits = 0;
+                while (digits < 2 && p < end && std::isxdigit(static_cast<unsigned char>(*p))) {
+                    char c = static_cast<char>(std::tolower(static_cast<unsigned char>(*p)));
+                    value = value * 16 + (c <= '9' ? c - '0' : c - 'a' + 10);
+                    digits++;
+                    p++;
+                }
+                if (digits == 0) {
+                    bad = static_cast<size_t>(escape - begin);
+                    return false;
+                }
+                out.push_back(static_cast<uint8_t>(value));
+                break;
+            }
+            default:
+                bad = static_cast<size_t>(escape - begin);
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Append UTF-8 text as UTF-16LE
+ * 
+ * @param text UTF-8 bytes
+ * @param size Number of bytes
+ * @param out Buffer to append to
+ * @return true on success, false if the text is not valid UTF-8
+ */
+static bool appendUtf16(const uint8_t* text, size_t size, std::vector<uint8_t>& out) {
+    out.reserve(out.size() + size * 2);
+    
+    size_t i = 0;
+    while (i < size) {
+        uint32_t lead = text[i];
+        uint32_t codePoint;
+        size_t length;
+        if (lead < 0x80) {
+            codePoint = lead;
+            length = 1;
+        } else if ((lead & 0xE0) == 0xC0) {
+            codePoint = lead & 0x1F;
+            length = 2;
+        } else if ((lead & 0xF0) == 0xE0) {
+            codePoint = lead & 0x0F;
+            length = 3;
+        } else if ((lead & 0xF8) == 0xF0) {
+            codePoint = lead & 0x07;
+            length = 4;
+        } else {
+            return false;
+        }
+        if (size - i < length) {
+            return false;
+        }
+        for (size_t j = 1; j < length; j++) {
+            if ((text[i + j] & 0xC0) != 0x80) {
+                return false;
+            }
+            codePoint = (codePoint << 6) | (text[i + j] & 0x3F);
+        }
+        
+        // Overlong forms, surrogates and values past the last code point
+        static const uint32_t smallest[] = {0, 0, 0x80, 0x800, 0x10000};
+        if (codePoint < smallest[length] || (codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF) {
+            return false;
+        }
+        i += length;
+        
+        if (codePoint >= 0x10000) {
+            codePoint -= 0x10000;
+            uint32_t high = 0xD800 | (codePoint >> 10);
+            uint32_t low = 0xDC00 | (codePoint & 0x3FF);
+            out.push_back(static_cast<uint8_t>(high));
+            out.push_back(static_cast<uint8_t>(high >> 8));
+            out.push_back(static_cast<uint8_t>(low));
+            out.push_back(static_cast<uint8_t>(low >> 8));
+        } else {
+            out.push_back(static_cast<uint8_t>(codePoint));
+            out.push_back(static_cast<uint8_t>(codePoint >> 8));
+        }
+    }
+    return true;
+}
+
 // Function implementation
 Function::Function(const std::string& funcName, uint16_t funcFlags)
-    : name(funcName), flags(funcFlags) {
+    : name(funcName), flags(funcFlags), cacheKey(0), cachedCode(nullptr) {
     // Initialize variable arrays with a reasonable capacity
     variableTypes.resize(16, 0);  // Space for 16 variables initially
     variableInitValues.resize(16);
@@ -31,6 +253,46 @@ const std::vector<std::unique_ptr<Instruction>>& Function::getInstructions() con
     return instructions;
 }
 
+void Function::replaceInstruction(size_t index, std::unique_ptr<Instruction> instruction) {
+    instructions[index] = std::move(instruction);
+}
+
+size_t Function::removeInstructions(const std::vector<bool>& removed) {
+    // New index of every old index; one past the end maps to the new end
+    std::vector<size_t> newIndex(instructions.size() + 1);
+    size_t kept = 0;
+    for (size_t i = 0; i < instructions.size(); i++) {
+        newIndex[i] = kept;
+        if (!removed[i]) {
+            instructions[kept++] = std::move(instructions[i]);
+        }
+    }
+    newIndex[instructions.size()] = kept;
+    
+    size_t removedCount = instructions.size() - kept;
+    if (removedCount == 0) {
+        return 0;
+    }
+    instructions.resize(kept);
+    
+    for (auto& [labelName, index] : labels) {
+        index = newIndex[index];
+    }
+    
+    // References from removed instructions go away with them
+    std::vector<std::pair<size_t, std::string>> keptRefs;
+    for (auto& ref : labelRefs) {
+        if (ref.first >= removed.size()) {
+            keptRefs.push_back({newIndex.back(), std::move(ref.second)});
+        } else if (!removed[ref.first]) {
+            keptRefs.push_back({newIndex[ref.first], std::move(ref.second)});
+        }
+    }
+    labelRefs = std::move(keptRefs);
+    
+    return removedCount;
+}
+
 bool Function::addLabel(const std::string& labelName, size_t instructionIndex) {
     auto result = labels.insert({labelName, instructionIndex});
     return result.second; // true if inserted, false if already exists
@@ -40,52 +302,91 @@ void Function::addLabelRef(size_t instructionIndex, const std::string& labelName
     labelRefs.push_back({instructionIndex, labelName});
 }
 
-bool Function::resolveLabels(const std::vector<std::unique_ptr<Symbol>>& symbols,
+const std::map<std::string, size_t>& Function::getLabels() const {
+    return labels;
+}
+
+bool Function::resolveLabels(const std::vector<std::unique_ptr<Symbol>>& symbols, const SymbolIndex& symbolIndex,
                            const std::map<std::string, std::string>& symbolOverrides) {
     bool success = true;
+    symbolReferences.clear();
     
-    // Build a map of global symbols for quick lookup
-    std::map<std::string, uint64_t> globalSymbols;
-    for (const auto& symbol : symbols) {
-        if (symbol->isGlobal() || symbol->isFunction()) {
-            globalSymbols[symbol->getName()] = symbol->getValue();
+    // Look a name up among the global symbols through the shared index
+    auto isGlobal = [&](const std::string& name) {
+        uint32_t index;
+        if (!symbolIndex.find(name, index)) {
+            return false;
         }
-    }
+        const Symbol& symbol = *symbols[index];
+        return symbol.isGlobal() || symbol.isFunction();
+    };
     
-    // Apply symbol overrides
-    for (const auto& [symName, replName] : symbolOverrides) {
-        auto it = globalSymbols.find(replName);
-        if (it != globalSymbols.end()) {
-            globalSymbols[symName] = it->second;
+    // An override redirects a name to its replacement when that exists
+    auto findGlobal = [&](const std::string& name, std::string& resolved) {
+        auto overrideIt = symbolOverrides.find(name);
+        if (overrideIt != symbolOverrides.end() && isGlobal(overrideIt->second)) {
+            resolved = overrideIt->second;
+            return true;
         }
-    }
+        return isGlobal(name);
+    };
     
     // Resolve label references
     for (const auto& [instIndex, labelName] : labelRefs) {
-        // Look for a local label first
-        auto localIt = labels.find(labelName);
-        if (localIt != labels.end()) {
-            // Local label found, update the instruction
-            // TODO: Update instruction operand with label address
+        if (instIndex >= instructions.size()) {
             continue;
         }
         
-        // Look for a global symbol
-        auto globalIt = globalSymbols.find(labelName);
-        if (globalIt != globalSymbols.end()) {
-            // Global symbol found, update the instruction
-            // TODO: Update instruction operand with symbol address
+        // Local labels are relocated against the function itself; the
+        // function's own label is just its symbol
+        const Instruction& inst = *instructions[instIndex];
+        std::string symbol = labelName;
+        size_t label = SIZE_MAX;
+        auto local = labels.find(labelName);
+        if (local != labels.end()) {
+            symbol = name;
+            if (labelName != name) {
+                label = local->second;
+            }
+        } else if (!findGlobal(labelName, symbol) && inst.getCategory() == CAT_CF &&
+                   (inst.getOperation() == CF_BR || inst.getOperation() == CF_BRC)) {
+            // Branches cannot leave the module; anything else not defined
+            // here is imported
+            LOG_ERROR("Unresolved label reference: {} in {}", labelName, name);
+            success = false;
             continue;
         }
         
-        // Label not found
-        LOG_ERROR("Unresolved label reference: " + labelName);
-        success = false;
+        // Record the operands that name the label, once each
+        for (size_t i = 0; i < inst.getOperandCount(); i++) {
+            const OperandValue& value = inst.getOperandValue(i);
+            if (value.getClass() != OPERAND_IMMEDIATE || value.getSubtype() != IMM_SYMBOL) {
+                continue;
+            }
+            size_t length;
+            const uint8_t* payload = inst.getOperandPayload(i, length);
+            if (length != labelName.size() + 1 || std::memcmp(payload, labelName.data(), labelName.size()) != 0) {
+                continue;
+            }
+            
+            bool recorded = false;
+            for (auto it = symbolReferences.rbegin();
+                 it != symbolReferences.rend() && it->instruction == instIndex; ++it) {
+                recorded = recorded || it->operand == i;
+            }
+            if (!recorded) {
+                symbolReferences.push_back({instIndex, i, symbol, label});
+            }
+        }
     }
     
     return success;
 }
 
+const std::vector<SymbolReference>& Function::getSymbolReferences() const {
+    return symbolReferences;
+}
+
 void Function::setVariableType(uint8_t varId, uint8_t typeId) {
     // Ensure the vector is large enough
     if (varId >= variableTypes.size()) {
@@ -123,9 +424,33 @@ const std::vector<uint8_t>& Function::getVariableInitValue(uint8_t varId) const
     return emptyValue;
 }
 
+void Function::setCacheKey(uint64_t key) {
+    cacheKey = key;
+}
+
+uint64_t Function::getCacheKey() const {
+    return cacheKey;
+}
+
+void Function::setCachedCode(const CachedFunction* code) {
+    cachedCode = code;
+}
+
+const CachedFunction* Function::getCachedCode() const {
+    return cachedCode;
+}
+
+void Function::setRegisterAllocation(RegisterAllocation allocation) {
+    registerAllocation = std::move(allocation);
+}
+
+const RegisterAllocation& Function::getRegisterAllocation() const {
+    return registerAllocation;
+}
+
 // Module implementation
 Module::Module(const std::string& moduleName)
-    : name(moduleName), currentSectionType(0), currentSectionFlags(0), currentTargetId(0) {
+    : name(moduleName), currentSectionType(0), currentSectionFlags(0), currentTargetId(0), coldFunctionCount(0) {
     // Set default section
     currentSection = "text";
 }
@@ -134,6 +459,10 @@ const std::string& Module::getName() const {
     return name;
 }
 
+Arena& Module::getArena() {
+    return arena;
+}
+
 bool Module::addFunction(std::unique_ptr<Function> function) {
     if (!function) {
         return false;
@@ -166,6 +495,37 @@ const std::vector<std::unique_ptr<Function>>& Module::getFunctions() const {
     return functions;
 }
 
+void Module::setFunctionOrder(const std::vector<size_t>& order, size_t coldCount) {
+    std::vector<std::unique_ptr<Function>> ordered;
+    ordered.reserve(functions.size());
+    for (size_t index : order) {
+        ordered.push_back(std::move(functions[index]));
+    }
+    functions = std::move(ordered);
+    
+    for (size_t i = 0; i < functions.size(); i++) {
+        functionMap[functions[i]->getName()] = i;
+    }
+    coldFunctionCount = std::min(coldCount, functions.size());
+}
+
+size_t Module::getColdFunctionCount() const {
+    return coldFunctionCount;
+}
+
+void Module::setFunctionHeat(const std::string& name, FunctionHeat heat) {
+    functionHeat[name] = heat;
+}
+
+FunctionHeat Module::getFunctionHeat(const std::string& name) const {
+    auto it = functionHeat.find(name);
+    return it != functionHeat.end() ? it->second : FUNCTION_HEAT_NORMAL;
+}
+
+bool Module::hasFunctionHeat() const {
+    return !functionHeat.empty();
+}
+
 bool Module::addAbiDefinition(const std::string& name, const AbiDefinition& def) {
     auto result = abiDefinitions.insert({name, def});
     return result.second; // true if inserted, false if already exists
@@ -195,6 +555,7 @@ void Module::setCurrentSection(const std::string& name, uint32_t type, uint32_t
     currentSection = name;
     currentSectionType = type;
     currentSectionFlags = flags;
+    dataBuilder.setSection(name, type, flags);
 }
 
 const std::string& Module::getCurrentSection() const {
@@ -217,56 +578,419 @@ uint32_t Module::getCurrentTargetId() const {
     return currentTargetId;
 }
 
-std::unique_ptr<CofFile> Module::generateCof() {
+DataBuilder& Module::getDataBuilder() {
+    return dataBuilder;
+}
+
+std::unique_ptr<CofFile> Module::generateCof(size_t jobs, FunctionCache* cache, InstructionEncoding encoding,
+                                             const std::vector<Target*>& targets, bool native, ThreadPool* pool) {
     // Create a new COF file
     auto cof = std::make_unique<CofFile>();
+    cof->setInstructionEncoding(encoding);
     
-    // Add target (use x86-64 for now)
-    uint32_t targetId = cof->addTarget(ARCH_X86_64, 0, "x86-64");
+    // Add targets (plain x86-64 unless any are given); the bytecode belongs
+    // to the first
+    std::vector<uint32_t> targetIds;
+    for (Target* target : targets) {
+        targetIds.push_back(cof->addTarget(target->getArchType(), target->getFeatures(), target->getName()));
+    }
+    if (targetIds.empty()) {
+        targetIds.push_back(cof->addTarget(ARCH_X86_64, 0, "x86-64"));
+    }
+    uint32_t targetId = targetIds.front();
     
-    // Add sections
+    // Add sections; a data section named "data" takes the place of the
+    // default one
+    const auto& dataSections = dataBuilder.getSections();
+    uint32_t dataFlags = SECTION_FLAG_ALLOC;
+    for (const auto& section : dataSections) {
+        if (section.name == "data") {
+            dataFlags = section.flags;
+        }
+    }
     Section& textSection = cof->addSection("text", SECTION_CODE, SECTION_FLAG_EXEC | SECTION_FLAG_ALLOC);
-    Section& dataSection = cof->addSection("data", SECTION_DATA, SECTION_FLAG_ALLOC);
+    cof->addSection("data", SECTION_DATA, dataFlags);
+    
+    // Copy the data sections; the module keeps its copy so that it can
+    // generate again
+    std::vector<uint32_t> dataIndices;
+    dataIndices.reserve(dataSections.size());
+    for (const auto& section : dataSections) {
+        uint32_t index = 1;
+        if (section.name != "data") {
+            cof->addSection(section.name, section.type, section.flags);
+            index = static_cast<uint32_t>(cof->getSectionCount() - 1);
+        }
+        dataIndices.push_back(index);
+        
+        Section& target = cof->getSection(index);
+        target.setAlignment(std::max(target.getAlignment(), section.alignment));
+        if (section.type == SECTION_BSS) {
+            target.fillZero(static_cast<size_t>(section.bssSize));
+        } else {
+            target.setData(section.data);
+        }
+    }
+    
+    // Cold functions come last and are moved to a section of their own
+    // once the code has been laid out
+    size_t hotCount = functions.size() - coldFunctionCount;
+    uint32_t coldIndex = 0;
+    if (hotCount < functions.size()) {
+        coldIndex = static_cast<uint32_t>(cof->getSectionCount());
+        cof->addSection("text.cold", SECTION_CODE, SECTION_FLAG_EXEC | SECTION_FLAG_ALLOC);
+    }
     
-    // Add symbols and code
+    // Add function symbols; their value and size are patched once the
+    // code has been laid out
+    std::vector<uint32_t> symbolIndices;
+    symbolIndices.reserve(functions.size());
+    for (size_t i = 0; i < functions.size(); i++) {
+        symbolIndices.push_back(cof->addSymbol(functions[i]->getName(), 
+                                               i < hotCount ? 0 : coldIndex, // Section index
+                                               0, // Value (offset) - patched below
+                                               0, // Size - patched below
+                                               SYMBOL_FUNCTION,
+                                               SYMBOL_FLAG_GLOBAL,
+                                               targetId));
+    }
+    
+    // Add data symbols, which functions can refer to as well
+    for (const auto& label : dataBuilder.getLabels()) {
+        if (functionMap.count(label.name)) {
+            LOG_ERROR("Data label has the name of a function: {}", label.name);
+            return nullptr;
+        }
+        cof->addSymbol(label.name, dataIndices[label.section], label.offset, label.size, SYMBOL_DATA,
+                       SYMBOL_FLAG_GLOBAL, targetId);
+    }
+    
+    // Every symbol a function refers to is known now
+    bool resolved = true;
     for (const auto& function : functions) {
-        // Add function symbol
-        uint32_t symbolIndex = cof->addSymbol(function->getName(), 
-                                             0, // textSection index
-                                             0, // Value (offset) - will be updated
-                                             0, // Size - will be updated
-                                             SYMBOL_FUNCTION,
-                                             SYMBOL_FLAG_GLOBAL,
-                                             targetId);
+        if (!function->getCachedCode() && !function->resolveLabels(cof->getSymbols(), cof->getSymbolIndex())) {
+            resolved = false;
+        }
+    }
+    if (!resolved) {
+        return nullptr;
+    }
+    
+    // Add function code
+    // For now, just add all instructions to the text section
+    // This should be more sophisticated based on sections in the future
+    std::vector<uint64_t> offsets(functions.size());
+    
+    if (jobs == 1 || functions.size() < 2) {
+        // Size the text section up front; functions are encoded straight
+        // into it rather than being copied into the section first
+        size_t codeSize = 0;
+        for (const auto& function : functions) {
+            if (function->getCachedCode()) {
+                codeSize += function->getCachedCode()->code.size();
+            }
+            for (const auto& instruction : function->getInstructions()) {
+                codeSize += instruction->encodedSize(encoding);
+            }
+        }
+        textSection.reserve(codeSize);
+        
+        for (size_t i = 0; i < functions.size(); i++) {
+            const CachedFunction* cached = functions[i]->getCachedCode();
+            offsets[i] = cached ? textSection.addData(cached->code)
+                                : textSection.addInstructions(functions[i]->getInstructions(), encoding);
+        }
+    } else {
+        // Functions are independent, so each is encoded into its own buffer
+        // on the pool and the buffers are then appended in module order
+        std::vector<std::vector<uint8_t>> buffers(functions.size());
+        {
+            std::unique_ptr<ThreadPool> ownPool;
+            ThreadPool* workers = pool;
+            if (!workers) {
+                ownPool = std::make_unique<ThreadPool>(jobs);
+                workers = ownPool.get();
+            }
+            for (size_t i = 0; i < functions.size(); i++) {
+                if (functions[i]->getCachedCode()) {
+                    continue;
+                }
+                workers->submit([this, &buffers, i, encoding] {
+                    const auto& instructions = functions[i]->getInstructions();
+                    
+                    size_t codeSize = 0;
+                    for (const auto& instruction : instructions) {
+                        codeSize += instruction->encodedSize(encoding);
+                    }
+                    
+                    ByteWriter writer(buffers[i]);
+                    writer.reserve(codeSize);
+                    for (const auto& instruction : instructions) {
+                        instruction->encodeInto(writer, encoding);
+                    }
+                });
+            }
+            workers->wait();
+        }
+        
+        size_t codeSize = 0;
+        for (size_t i = 0; i < functions.size(); i++) {
+            const CachedFunction* cached = functions[i]->getCachedCode();
+            codeSize += cached ? cached->code.size() : buffers[i].size();
+        }
+        textSection.reserve(codeSize);
+        
+        for (size_t i = 0; i < functions.size(); i++) {
+            const CachedFunction* cached = functions[i]->getCachedCode();
+            offsets[i] = textSection.addData(cached ? cached->code : buffers[i]);
+            std::vector<uint8_t>().swap(buffers[i]);
+        }
+    }
+    
+    // Patch the function symbols with their final location
+    uint64_t coldStart = hotCount < functions.size() ? offsets[hotCount] : textSection.getSize();
+    for (size_t i = 0; i < functions.size(); i++) {
+        uint64_t end = i + 1 < functions.size() ? offsets[i + 1] : textSection.getSize();
+        Symbol& symbol = cof->getSymbol(symbolIndices[i]);
+        symbol.setValue(i < hotCount ? offsets[i] : offsets[i] - coldStart);
+        symbol.setSize(end - offsets[i]);
+    }
+    
+    // Symbol operands are relocated against the symbol they name, and
+    // local labels against their function, so that the code can be
+    // followed without the source
+    for (size_t i = 0; i < functions.size(); i++) {
+        const auto& references = functions[i]->getSymbolReferences();
+        if (references.empty() || functions[i]->getCachedCode()) {
+            continue;
+        }
+        
+        const auto& instructions = functions[i]->getInstructions();
+        std::vector<uint64_t> instructionOffsets(instructions.size() + 1);
+        uint64_t offset = offsets[i];
+        for (size_t j = 0; j < instructions.size(); j++) {
+            instructionOffsets[j] = offset;
+            offset += instructions[j]->encodedSize(encoding);
+        }
+        instructionOffsets[instructions.size()] = offset;
+        
+        for (const auto& reference : references) {
+            uint32_t symbolIndex;
+            if (!cof->getSymbolIndex().find(reference.symbol, symbolIndex)) {
+                symbolIndex = cof->addSymbol(reference.symbol, 0, 0, 0, SYMBOL_NONE,
+                                             SYMBOL_FLAG_GLOBAL | SYMBOL_FLAG_UNDEFINED, targetId);
+            }
+            const Instruction& instruction = *instructions[reference.instruction];
+            uint64_t operandOffset = instructionOffsets[reference.instruction] +
+                                     instruction.operandOffset(reference.operand, encoding);
+            if (reference.label == SIZE_MAX) {
+                textSection.addRelocation(operandOffset, symbolIndex, RELOC_COIL_SYMBOL, 0, targetId);
+            } else {
+                textSection.addRelocation(operandOffset, symbolIndex, RELOC_COIL_LABEL,
+                                          static_cast<int64_t>(instructionOffsets[reference.label] - offsets[i]),
+                                          targetId);
+            }
+        }
+    }
+    
+    // Relocations of cached functions refer to their symbols by name
+    for (size_t i = 0; i < functions.size(); i++) {
+        const CachedFunction* cached = functions[i]->getCachedCode();
+        if (!cached) {
+            continue;
+        }
+        
+        for (const auto& relocation : cached->relocations) {
+            uint32_t symbolIndex;
+            if (!cof->getSymbolIndex().find(relocation.symbol, symbolIndex)) {
+                symbolIndex = cof->addSymbol(relocation.symbol, 0, 0, 0, SYMBOL_NONE,
+                                             SYMBOL_FLAG_GLOBAL | SYMBOL_FLAG_UNDEFINED, targetId);
+            }
+            textSection.addRelocation(offsets[i] + relocation.offset, symbolIndex, relocation.type,
+                                      relocation.addend, targetId);
+        }
+    }
+    
+    // Store the code of the functions that were encoded this time
+    if (cache) {
+        std::vector<CachedFunction> entries(functions.size());
+        for (size_t i = 0; i < functions.size(); i++) {
+            if (functions[i]->getCacheKey() != 0 && !functions[i]->getCachedCode()) {
+                uint64_t end = i + 1 < functions.size() ? offsets[i + 1] : textSection.getSize();
+                entries[i].code = textSection.getBytes(offsets[i], static_cast<size_t>(end - offsets[i]));
+            }
+        }
+        
+        // Hand each relocation to the function it lies in
+        for (const auto& relocation : textSection.getRelocations()) {
+            auto it = std::upper_bound(offsets.begin(), offsets.end(), relocation.offset);
+            if (it == offsets.begin()) {
+                continue;
+            }
+            size_t i = static_cast<size_t>(it - offsets.begin()) - 1;
+            entries[i].relocations.push_back({static_cast<uint32_t>(relocation.offset - offsets[i]),
+                                              relocation.type, relocation.addend,
+                                              cof->getSymbol(relocation.symbol_index).getName()});
+        }
         
-        // Add function code
-        for (const auto& instruction : function->getInstructions()) {
-            // For now, just add all instructions to the text section
-            // This should be more sophisticated based on sections in the future
-            textSection.addInstruction(instruction->clone());
+        for (size_t i = 0; i < functions.size(); i++) {
+            if (functions[i]->getCacheKey() != 0 && !functions[i]->getCachedCode()) {
+                cache->store(functions[i]->getCacheKey(), std::move(entries[i]));
+            }
         }
     }
     
-    // Finalize sections (convert instructions to binary)
-    textSection.finalize();
+    if (coldIndex != 0) {
+        textSection.moveTail(coldStart, cof->getSection(coldIndex));
+    }
+    
+    if (native && !targets.empty() && !generateNativeCode(*cof, targets, targetIds, jobs, pool)) {
+        return nullptr;
+    }
     
     return cof;
 }
 
+bool Module::generateNativeCode(CofFile& cof, const std::vector<Target*>& targets,
+                                const std::vector<uint32_t>& targetIds, size_t jobs, ThreadPool* pool) const {
+    // Calls and system calls may name any ABI the module defines
+    for (Target* target : targets) {
+        for (const auto& entry : abiDefinitions) {
+            target->addKnownAbi(&entry.second);
+        }
+    }
+    
+    // Every function is lowered for every target into its own buffer, all on
+    // one pool; errors are held back per function so that they are reported
+    // in target and module order
+    size_t count = targets.size() * functions.size();
+    std::vector<std::vector<uint8_t>> buffers(count);
+    std::vector<std::vector<CodeRelocation>> relocations(count);
+    std::vector<char> encoded(count, 0);
+    std::vector<BufferedLogger> loggers(count, BufferedLogger(LOG_DEBUG));
+    auto encodeOne = [this, &targets, &buffers, &relocations, &encoded, &loggers](size_t job) {
+        ThreadLoggerScope scope(&loggers[job]);
+        const Function& function = *functions[job % functions.size()];
+        encoded[job] = targets[job / functions.size()]->encodeFunction(function, buffers[job], relocations[job]);
+    };
+    
+    if (jobs == 1 || count < 2) {
+        for (size_t job = 0; job < count; job++) {
+            encodeOne(job);
+        }
+    } else {
+        std::unique_ptr<ThreadPool> ownPool;
+        if (!pool) {
+            ownPool = std::make_unique<ThreadPool>(jobs);
+            pool = ownPool.get();
+        }
+        for (size_t job = 0; job < count; job++) {
+            pool->submit([&encodeOne, job] { encodeOne(job); });
+        }
+        pool->wait();
+    }
+    
+    bool success = true;
+    for (size_t job = 0; job < count; job++) {
+        loggers[job].flush(GlobalLogger::getInstance());
+        success = success && encoded[job];
+    }
+    if (!success) {
+        return false;
+    }
+    
+    // Each target gets a section of its own, laid out in target order, and
+    // a second one for its cold functions
+    size_t hotCount = functions.size() - coldFunctionCount;
+    for (size_t t = 0; t < targets.size(); t++) {
+        uint32_t targetId = targetIds[t];
+        size_t first = t * functions.size();
+        std::string sectionName = "text." + targets[t]->getName();
+        uint32_t sectionIndex = static_cast<uint32_t>(cof.getSectionCount());
+        cof.addSection(sectionName, SECTION_CODE, SECTION_FLAG_EXEC | SECTION_FLAG_ALLOC, targetId);
+        uint32_t coldIndex = sectionIndex;
+        if (hotCount < functions.size()) {
+            coldIndex = static_cast<uint32_t>(cof.getSectionCount());
+            cof.addSection(sectionName + ".cold", SECTION_CODE, SECTION_FLAG_EXEC | SECTION_FLAG_ALLOC, targetId);
+        }
+        
+        // Each function gets a symbol of the same name in the section
+        std::vector<uint64_t> offsets(functions.size());
+        std::vector<uint32_t> sections(functions.size());
+        std::unordered_map<std::string, uint32_t> nativeSymbols;
+        for (size_t i = 0; i < functions.size(); i++) {
+            sections[i] = i < hotCount ? sectionIndex : coldIndex;
+            offsets[i] = cof.getSection(sections[i]).addData(buffers[first + i]);
+            nativeSymbols.emplace(functions[i]->getName(),
+                                  cof.addSymbol(functions[i]->getName(), sections[i], offsets[i],
+                                                buffers[first + i].size(), SYMBOL_FUNCTION, SYMBOL_FLAG_GLOBAL,
+                                                targetId));
+        }
+        
+        // References resolve to the target's own code first, then to other
+        // defined symbols; every target imports what is left on its own
+        for (size_t i = 0; i < functions.size(); i++) {
+            for (const auto& relocation : relocations[first + i]) {
+                uint32_t symbolIndex;
+                auto native = nativeSymbols.find(relocation.symbol);
+                if (native != nativeSymbols.end()) {
+                    symbolIndex = native->second;
+                } else if (!cof.getSymbolIndex().find(relocation.symbol, symbolIndex) ||
+                           ((cof.getSymbol(symbolIndex).getFlags() & SYMBOL_FLAG_UNDEFINED) &&
+                            cof.getSymbol(symbolIndex).getTargetId() != targetId)) {
+                    symbolIndex = cof.addSymbol(relocation.symbol, 0, 0, 0, SYMBOL_NONE,
+                                                SYMBOL_FLAG_GLOBAL | SYMBOL_FLAG_UNDEFINED, targetId);
+                    nativeSymbols.emplace(relocation.symbol, symbolIndex);
+                }
+                cof.getSection(sections[i]).addRelocation(offsets[i] + relocation.offset, symbolIndex,
+                                                          relocation.type, relocation.addend, targetId);
+            }
+        }
+    }
+    
+    return true;
+}
+
 // Parser implementation
 Parser::Parser(std::vector<Token> sourceTokens, DiagnosticEngine& diagnostics)
-    : tokens(std::move(sourceTokens)), position(0), diag(diagnostics) {
+    : tokens(std::move(sourceTokens)), lexer(nullptr), diag(diagnostics), currentFunction(nullptr),
+      functionCache(nullptr), contextHash(0), includeCache(nullptr) {
+    // Create a default module
+    module = std::make_unique<Module>("default");
+}
+
+Parser::Parser(Lexer& source, DiagnosticEngine& diagnostics)
+    : tokens(source), lexer(&source), diag(diagnostics), currentFunction(nullptr),
+      functionCache(nullptr), contextHash(0), includeCache(nullptr) {
     // Create a default module
     module = std::make_unique<Module>("default");
 }
 
+void Parser::setFunctionCache(FunctionCache* cache) {
+    // Skipping a cached function means moving the lexer past it
+    functionCache = lexer ? cache : nullptr;
+}
+
+void Parser::setIncludeCache(IncludeCache* cache) {
+    includeCache = cache;
+}
+
+void Parser::setTimeReport(const TimeReport* report) {
+    tokens.setTimeReport(report);
+}
+
+const ResourceSample& Parser::getLexingCost() const {
+    return tokens.getLexingCost();
+}
+
 std::unique_ptr<Module> Parser::parse() {
-    // Reset state
-    position = 0;
-    
     try {
+        // Instructions and operands built while parsing live in the module arena
+        ArenaScope arenaScope(module->getArena());
+        
         // Parse the module
         parseModule();
+        module->getDataBuilder().finishObject();
         
         // Check for errors
         if (diag.hasErrorDiagnostics()) {
@@ -276,35 +1000,24 @@ std::unique_ptr<Module> Parser::parse() {
         return std::move(module);
     } catch (const std::exception& e) {
         // Handle unexpected exceptions
-        diag.error(std::string("Parsing failed: ") + e.what(), tokens[position].location);
+        diag.error(std::string("Parsing failed: ") + e.what(), peek().location);
         return nullptr;
     }
 }
 
-Token Parser::peek() const {
-    if (isAtEnd()) {
-        // Return an EOF token if we're at the end
-        return Token(TOKEN_EOF, "", tokens.back().location);
-    }
-    return tokens[position];
+const Token& Parser::peek(size_t ahead) {
+    return tokens.peek(ahead);
 }
 
-Token Parser::previous() const {
-    if (position > 0) {
-        return tokens[position - 1];
-    }
-    // Return an error token if there's no previous token
-    return Token(TOKEN_ERROR, "", tokens[0].location);
+const Token& Parser::previous() const {
+    return tokens.previous();
 }
 
-Token Parser::advance() {
-    if (!isAtEnd()) {
-        position++;
-    }
-    return previous();
+const Token& Parser::advance() {
+    return tokens.advance();
 }
 
-bool Parser::check(TokenType type) const {
+bool Parser::check(TokenType type) {
     return peek().type == type;
 }
 
@@ -316,8 +1029,9 @@ bool Parser::match(TokenType type) {
     return false;
 }
 
-bool Parser::isAtEnd() const {
-    return position >= tokens.size() || tokens[position].type == TOKEN_EOF;
+bool Parser::isAtEnd() {
+    // Past the error limit parsing stops wherever it is
+    return tokens.isAtEnd() || diag.hasReachedErrorLimit();
 }
 
 void Parser::consume(TokenType type, const std::string& message) {
@@ -328,6 +1042,39 @@ void Parser::consume(TokenType type, const std::string& message) {
     }
 }
 
+int64_t Parser::statementLine(const Token& token) {
+    // Every macro expansion and included file has lines of its own, so a
+    // statement never runs into the one the expansion was pushed before
+    return (static_cast<int64_t>(token.source) << 32) | static_cast<uint32_t>(token.location.line);
+}
+
+void Parser::skipLine(int64_t line) {
+    while (!isAtEnd() && statementLine(peek()) == line) {
+        advance();
+    }
+}
+
+bool Parser::onLine(int64_t line) {
+    return !isAtEnd() && statementLine(peek()) == line;
+}
+
+bool Parser::matchInteger(int64_t& value) {
+    if (match(TOKEN_INTEGER)) {
+        value = previous().intValue;
+        return true;
+    }
+    
+    if (check(TOKEN_IDENTIFIER)) {
+        auto constant = constants.find(peek().text);
+        if (constant != constants.end() && constant->second.type == TOKEN_INTEGER) {
+            value = constant->second.intValue;
+            advance();
+            return true;
+        }
+    }
+    return false;
+}
+
 void Parser::error(const std::string& message) {
     diag.error(message, peek().location);
 }
@@ -340,15 +1087,9 @@ void Parser::parseModule() {
     // Parse top-level declarations
     while (!isAtEnd()) {
         if (match(TOKEN_DIRECTIVE)) {
-            if (previous().text == "DIR") {
-                parseDirective();
-            } else {
-                error(previous(), "Expected 'DIR' directive");
-                // Skip to the next line
-                while (!isAtEnd() && !check(TOKEN_DIRECTIVE)) {
-                    advance();
-                }
-            }
+            parseDirective();
+        } else if (checkMacro()) {
+            expandMacro();
         } else {
             error(peek(), "Expected 'DIR' directive");
             advance(); // Skip the unexpected token
@@ -357,43 +1098,86 @@ void Parser::parseModule() {
 }
 
 void Parser::parseDirective() {
+    int64_t line = statementLine(previous());
+    const char* directiveStart = previous().text.data();
+    bool fromInput = previous().source == 0;
+    
     if (match(TOKEN_IDENTIFIER)) {
-        std::string directive = previous().text;
-        
-        if (directive == "SECT") {
-            parseSection();
-        } else if (directive == "LABEL") {
-            parseLabel();
-        } else if (directive == "HINT") {
-            parseFunction();
-        } else if (directive == "ABI") {
-            parseAbi();
-        } else {
-            error(previous(), "Unknown directive: " + directive);
-            // Skip to the next line
-            while (!isAtEnd() && !check(TOKEN_DIRECTIVE)) {
-                advance();
-            }
+        uint8_t directive = previous().directive;
+        switch (directive) {
+            case DIRECTIVE_SECT:
+                parseSection();
+                break;
+            case DIRECTIVE_LABEL:
+                parseLabel();
+                break;
+            case DIRECTIVE_HINT:
+                // Only functions in the input itself can be looked up in the cache
+                parseFunction(fromInput ? directiveStart : nullptr);
+                break;
+            case DIRECTIVE_ABI:
+                parseAbi();
+                break;
+            case DIRECTIVE_INCLUDE:
+                parseInclude(line);
+                break;
+            case DIRECTIVE_MACRO:
+                parseMacro(line);
+                break;
+            case DIRECTIVE_CONST:
+                parseConst(line);
+                break;
+            case DIRECTIVE_STRUCT:
+                parseStruct(line);
+                break;
+            case DIRECTIVE_ASCII:
+            case DIRECTIVE_UNICODE:
+            case DIRECTIVE_ZERO:
+            case DIRECTIVE_PADD:
+            case DIRECTIVE_ALIGN:
+                parseData(directive, line);
+                break;
+            case DIRECTIVE_ENDM:
+            case DIRECTIVE_ENDSTRUCT:
+                error(previous(), "Unmatched directive: " + std::string(previous().text));
+                skipLine(line);
+                break;
+            case DIRECTIVE_NONE:
+                error(previous(), "Unknown directive: " + std::string(previous().text));
+                skipLine(line);
+                break;
+            default:
+                // Known directive without an implementation yet
+                diag.warning("Directive not supported yet, ignored: " + std::string(previous().text),
+                             previous().location);
+                skipLine(line);
+                break;
+        }
+        
+        // Cached functions are only valid for the same target, ABIs and
+        // definitions; directives out of macros and included files are
+        // covered by the macro definition or the file contents
+        if (fromInput && (directive == DIRECTIVE_TARGET || directive == DIRECTIVE_ABI ||
+                          directive == DIRECTIVE_INCLUDE || directive == DIRECTIVE_MACRO ||
+                          directive == DIRECTIVE_CONST || directive == DIRECTIVE_STRUCT)) {
+            addContext(directiveStart);
         }
     } else {
         error(peek(), "Expected directive identifier");
-        // Skip to the next line
-        while (!isAtEnd() && !check(TOKEN_DIRECTIVE)) {
-            advance();
-        }
+        skipLine(line);
     }
 }
 
 void Parser::parseSection() {
     if (match(TOKEN_IDENTIFIER)) {
-        std::string sectionName = previous().text;
+        std::string sectionName(previous().text);
         
         // Parse section flags
         uint32_t sectionType = SECTION_CODE; // Default to code section
         uint32_t sectionFlags = SECTION_FLAG_ALLOC; // Default to allocatable
         
         while (match(TOKEN_IDENTIFIER)) {
-            std::string flag = previous().text;
+            std::string_view flag = previous().text;
             
             if (flag == "READ") {
                 // All sections are readable
@@ -408,7 +1192,7 @@ void Parser::parseSection() {
             } else if (flag == "TLS") {
                 sectionFlags |= SECTION_FLAG_TLS;
             } else {
-                error(previous(), "Unknown section flag: " + flag);
+                error(previous(), "Unknown section flag: " + std::string(flag));
             }
         }
         
@@ -421,6 +1205,8 @@ void Parser::parseSection() {
             sectionType = SECTION_READONLY;
         } else if (sectionName == "bss") {
             sectionType = SECTION_BSS;
+        } else if (!(sectionFlags & SECTION_FLAG_EXEC)) {
+            sectionType = SECTION_DATA;
         }
         
         // Set the current section
@@ -432,36 +1218,544 @@ void Parser::parseSection() {
 
 void Parser::parseLabel() {
     if (match(TOKEN_IDENTIFIER)) {
-        std::string labelName = previous().text;
+        std::string labelName(previous().text);
         
-        // TODO: Add the label to the current function or section
-        // For now, just log it
-        LOG_INFO("Parsed label: " + labelName);
+        if (currentFunction) {
+            // Local label, points at the next instruction of the function
+            size_t index = currentFunction->getInstructions().size();
+            if (!currentFunction->addLabel(labelName, index)) {
+                error(previous(), "Duplicate label: " + labelName);
+            }
+        } else if (module->getDataBuilder().hasSection()) {
+            // Names the data that follows
+            if (!module->getDataBuilder().addLabel(labelName)) {
+                error(previous(), "Duplicate label: " + labelName);
+            }
+        } else {
+            // Code lives in functions, so there is nothing here to name
+            error(previous(), "Label outside a function or data section: " + labelName);
+        }
     } else {
         error(peek(), "Expected label name");
     }
 }
 
-void Parser::parseFunction() {
-    if (match(TOKEN_IDENTIFIER)) {
-        std::string functionName = previous().text;
-        
-        // Parse function attributes
-        uint16_t functionFlags = 0;
+void Parser::parseData(uint32_t directive, int64_t line) {
+    Token directiveToken = previous();
+    std::string name(directiveToken.text);
+    DataBuilder& data = module->getDataBuilder();
+    
+    if (currentFunction) {
+        error(directiveToken, name + " is not allowed inside a function");
+        skipLine(line);
+        return;
+    }
+    if (!data.hasSection()) {
+        error(directiveToken, name + " needs a data section");
+        skipLine(line);
+        return;
+    }
+    
+    if (directive == DIRECTIVE_ASCII || directive == DIRECTIVE_UNICODE) {
+        if (data.inBss()) {
+            error(directiveToken, name + " is not allowed in a BSS section");
+            skipLine(line);
+            return;
+        }
+        if (!onLine(line) || !check(TOKEN_STRING)) {
+            error(peek(), "Expected string after " + name);
+            skipLine(line);
+            return;
+        }
+        
+        // Each string goes straight into the section
+        std::vector<uint8_t> utf8;
+        while (onLine(line) && match(TOKEN_STRING)) {
+            const Token& string = previous();
+            std::vector<uint8_t>& out = directive == DIRECTIVE_ASCII ? data.appendBytes() : utf8;
+            size_t bad = 0;
+            utf8.clear();
+            if (!appendStringBytes(string.text, out, bad)) {
+                error(string, "Invalid escape sequence in string: " + std::string(string.text.substr(bad, 2)));
+                continue;
+            }
+            if (directive == DIRECTIVE_UNICODE && !appendUtf16(utf8.data(), utf8.size(), data.appendBytes())) {
+                error(string, "String is not valid UTF-8");
+            }
+        }
+    } else {
+        int64_t value;
+        if (!onLine(line) || !matchInteger(value)) {
+            error(peek(), "Expected size after " + name);
+            skipLine(line);
+            return;
+        }
+        
+        if (directive == DIRECTIVE_ALIGN) {
+            if (value <= 0 || value > UINT32_MAX || (value & (value - 1)) != 0) {
+                error(previous(), "Alignment must be a power of two: " + std::to_string(value));
+            } else {
+                data.align(static_cast<uint32_t>(value));
+            }
+        } else if (value < 0) {
+            error(previous(), name + " size must not be negative: " + std::to_string(value));
+        } else if (directive == DIRECTIVE_ZERO) {
+            data.addZeros(static_cast<uint64_t>(value));
+        } else if (!data.padTo(static_cast<uint64_t>(value))) {
+            error(previous(), "Data is already larger than the PADD size " + std::to_string(value));
+        }
+    }
+    
+    if (onLine(line)) {
+        error(peek(), "Unexpected token after " + name + ": " + std::string(peek().text));
+        skipLine(line);
+    }
+}
+
+void Parser::parseInclude(int64_t line) {
+    if (!onLine(line) || !check(TOKEN_STRING)) {
+        error(peek(), "Expected file name after INCLUDE");
+        skipLine(line);
+        return;
+    }
+    
+    Token pathToken = advance();
+    if (onLine(line)) {
+        error(peek(), "Unexpected token after INCLUDE: " + std::string(peek().text));
+        skipLine(line);
+    }
+    
+    // Relative paths are looked up next to the including file first
+    std::filesystem::path target(pathToken.text);
+    std::error_code fsError;
+    if (target.is_relative()) {
+        auto sibling = std::filesystem::path(pathToken.location.filename).parent_path() / target;
+        if (std::filesystem::exists(sibling, fsError)) {
+            target = sibling;
+        }
+    }
+    std::string path = std::filesystem::absolute(target, fsError).lexically_normal().string();
+    
+    // Each file is included once per module, which also ends include cycles
+    if (!includedPaths.insert(path).second) {
+        return;
+    }
+    
+    if (!includeCache) {
+        ownIncludeCache = std::make_unique<IncludeCache>();
+        includeCache = ownIncludeCache.get();
+    }
+    
+    size_t diagnosticCount = diag.getDiagnosticCount();
+    auto file = includeCache->get(path, diag);
+    if (!file) {
+        // Lexer errors have been reported already
+        if (diag.getDiagnosticCount() == diagnosticCount) {
+            error(pathToken, "Cannot read included file: " + std::string(pathToken.text));
+        }
+        return;
+    }
+    
+    if (functionCache) {
+        contextHash = FunctionCache::hash(file->contents->getData(), file->contents->getSize(), contextHash);
+    }
+    
+    // The token vector is shared with other parsers; macros and constants
+    // keep views into the file, so it stays alive until parsing is done
+    includedFiles.push_back(file);
+    tokens.push(std::shared_ptr<const std::vector<Token>>(file, &file->tokens), pathToken, false);
+}
+
+void Parser::parseMacro(int64_t line) {
+    uint32_t source = previous().source;
+    
+    if (!onLine(line) || !check(TOKEN_IDENTIFIER)) {
+        error(peek(), "Expected macro name");
+        skipLine(line);
+        return;
+    }
+    
+    Token nameToken = advance();
+    std::string name(nameToken.text);
+    
+    // Parameters: DIR MACRO name a, b, c
+    Macro macro;
+    while (onLine(line)) {
+        if (!match(TOKEN_IDENTIFIER)) {
+            error(peek(), "Expected macro parameter name");
+            skipLine(line);
+            break;
+        }
+        
+        std::string param(previous().text);
+        if (std::find(macro.params.begin(), macro.params.end(), param) != macro.params.end()) {
+            error(previous(), "Duplicate macro parameter: " + param);
+        }
+        macro.params.push_back(param);
+        
+        if (onLine(line) && !match(TOKEN_COMMA)) {
+            error(peek(), "Expected ',' between macro parameters");
+            skipLine(line);
+            break;
+        }
+    }
+    
+    // The body is every token up to DIR ENDM in the same file
+    bool closed = false;
+    while (!isAtEnd() && peek().source == source) {
+        if (check(TOKEN_DIRECTIVE) && peek(1).type == TOKEN_IDENTIFIER) {
+            if (peek(1).directive == DIRECTIVE_ENDM) {
+                int64_t endLine = statementLine(advance());
+                advance();
+                if (onLine(endLine)) {
+                    error(peek(), "Unexpected token after ENDM: " + std::string(peek().text));
+                    skipLine(endLine);
+                }
+                closed = true;
+                break;
+            }
+            if (peek(1).directive == DIRECTIVE_MACRO) {
+                error(peek(1), "Macros cannot be defined inside a macro");
+            }
+        }
+        macro.body.push_back(advance());
+    }
+    
+    if (!closed) {
+        error(nameToken, "Missing 'DIR ENDM' for macro " + name);
+        return;
+    }
+    
+    if (!macros.emplace(name, std::move(macro)).second) {
+        error(nameToken, "Duplicate macro: " + name);
+    }
+}
+
+bool Parser::checkMacro() {
+    return check(TOKEN_IDENTIFIER) && !macros.empty() && macros.find(peek().text) != macros.end();
+}
+
+void Parser::expandMacro() {
+    Token nameToken = advance();
+    int64_t line = statementLine(nameToken);
+    const Macro& macro = macros.find(nameToken.text)->second;
+    std::string name(nameToken.text);
+    
+    // Arguments are separated by commas outside brackets and parentheses
+    std::vector<std::vector<Token>> args;
+    int depth = 0;
+    while (onLine(line)) {
+        if (args.empty()) {
+            args.emplace_back();
+        }
+        
+        Token token = advance();
+        if (token.type == TOKEN_COMMA && depth == 0) {
+            args.emplace_back();
+            continue;
+        }
+        if (token.type == TOKEN_LPAREN || token.type == TOKEN_LBRACKET) {
+            depth++;
+        } else if ((token.type == TOKEN_RPAREN || token.type == TOKEN_RBRACKET) && depth > 0) {
+            depth--;
+        }
+        args.back().push_back(token);
+    }
+    
+    if (args.size() != macro.params.size()) {
+        error(nameToken, "Macro " + name + " expects " + std::to_string(macro.params.size()) +
+              " arguments, got " + std::to_string(args.size()));
+        return;
+    }
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i].empty()) {
+            error(nameToken, "Missing argument for parameter " + macro.params[i] + " of macro " + name);
+            return;
+        }
+    }
+    
+    if (tokens.getMacroDepth(nameToken) >= MAX_MACRO_DEPTH) {
+        error(nameToken, "Macro expansion nested too deeply: " + name);
+        return;
+    }
+    
+    // What the expansion defines depends on the arguments as well
+    if (nameToken.source == 0) {
+        addContext(nameToken.text.data());
+    }
+    
+    // Arguments take the place of the parameter, so they stay on its line
+    auto expansion = std::make_shared<std::vector<Token>>();
+    expansion->reserve(macro.body.size());
+    for (const Token& token : macro.body) {
+        if (token.type == TOKEN_IDENTIFIER) {
+            auto param = std::find(macro.params.begin(), macro.params.end(), token.text);
+            if (param != macro.params.end()) {
+                for (Token arg : args[param - macro.params.begin()]) {
+                    arg.location = token.location;
+                    expansion->push_back(arg);
+                }
+                continue;
+            }
+        }
+        expansion->push_back(token);
+    }
+    
+    tokens.push(std::move(expansion), nameToken, true);
+}
+
+void Parser::parseConst(int64_t line) {
+    if (!onLine(line) || !check(TOKEN_IDENTIFIER)) {
+        error(peek(), "Expected constant name");
+        skipLine(line);
+        return;
+    }
+    
+    Token nameToken = advance();
+    std::string name(nameToken.text);
+    
+    // DIR CONST name value, where the value is a literal or another constant
+    Token value;
+    if (onLine(line) && (check(TOKEN_INTEGER) || check(TOKEN_FLOAT) || check(TOKEN_STRING))) {
+        value = advance();
+    } else if (onLine(line) && check(TOKEN_IDENTIFIER) && constants.find(peek().text) != constants.end()) {
+        value = constants.find(advance().text)->second;
+    } else {
+        error(peek(), "Expected value for constant " + name);
+        skipLine(line);
+        return;
+    }
+    
+    if (onLine(line)) {
+        error(peek(), "Unexpected token after constant: " + std::string(peek().text));
+        skipLine(line);
+    }
+    
+    if (!constants.emplace(name, value).second) {
+        error(nameToken, "Duplicate constant: " + name);
+    }
+}
+
+void Parser::parseStruct(int64_t line) {
+    if (!onLine(line) || !check(TOKEN_IDENTIFIER)) {
+        error(peek(), "Expected structure name");
+        skipLine(line);
+        return;
+    }
+    
+    Token nameToken = advance();
+    std::string name(nameToken.text);
+    if (onLine(line)) {
+        error(peek(), "Unexpected token after structure name: " + std::string(peek().text));
+        skipLine(line);
+    }
+    
+    // One field per line: a name followed by a type or a size in bytes
+    std::vector<std::pair<Token, uint64_t>> fields;
+    uint64_t offset = 0;
+    uint64_t alignment = 1;
+    bool closed = false;
+    while (!isAtEnd()) {
+        int64_t fieldLine = statementLine(peek());
+        if (check(TOKEN_DIRECTIVE)) {
+            if (peek(1).type == TOKEN_IDENTIFIER && peek(1).directive == DIRECTIVE_ENDSTRUCT) {
+                advance();
+                advance();
+                if (onLine(fieldLine)) {
+                    error(peek(), "Unexpected token after ENDSTRUCT: " + std::string(peek().text));
+                    skipLine(fieldLine);
+                }
+                closed = true;
+            }
+            break;
+        }
+        
+        if (!match(TOKEN_IDENTIFIER)) {
+            error(peek(), "Expected field name");
+            skipLine(fieldLine);
+            continue;
+        }
+        Token fieldToken = previous();
+        if (fieldToken.text == "size") {
+            error(fieldToken, "Field name 'size' is reserved for the structure size");
+            skipLine(fieldLine);
+            continue;
+        }
+        
+        uint64_t size = 0;
+        uint64_t fieldAlignment = 1;
+        int64_t bytes;
+        if (!onLine(fieldLine)) {
+            error(fieldToken, "Expected type or size of field " + std::string(fieldToken.text));
+            continue;
+        } else if (matchInteger(bytes)) {
+            // Power-of-two sizes up to 8 bytes are aligned like integers
+            size = bytes > 0 ? static_cast<uint64_t>(bytes) : 0;
+            fieldAlignment = (size <= 8 && (size & (size - 1)) == 0) ? size : 1;
+        } else {
+            std::string_view typeName = peek().text;
+            uint16_t typeId = parseTypeSpecifier();
+            if (typeName == "ptr") {
+                size = 8;
+            } else if (typeName == "vec128") {
+                size = 16;
+            } else if (typeName == "vec256") {
+                size = 32;
+            } else if (typeName == "vec512") {
+                size = 64;
+            }
+            fieldAlignment = size;
+            
+            if (size == 0) {
+                Type type = Type::fromBasicType(typeId);
+                size = type.getSize();
+                fieldAlignment = type.getAlignment();
+            }
+        }
+        
+        if (size == 0) {
+            error(fieldToken, "Field " + std::string(fieldToken.text) + " has no size");
+            skipLine(fieldLine);
+            continue;
+        }
+        if (onLine(fieldLine)) {
+            error(peek(), "Unexpected token after field: " + std::string(peek().text));
+            skipLine(fieldLine);
+        }
+        
+        offset = (offset + fieldAlignment - 1) & ~(fieldAlignment - 1);
+        fields.emplace_back(fieldToken, offset);
+        offset += size;
+        alignment = std::max(alignment, fieldAlignment);
+    }
+    
+    if (!closed) {
+        error(nameToken, "Missing 'DIR ENDSTRUCT' for structure " + name);
+        return;
+    }
+    
+    // Fields become constants name-field holding their offsets, and
+    // name-size holds the size rounded up to the structure's alignment
+    fields.emplace_back(nameToken, (offset + alignment - 1) & ~(alignment - 1));
+    for (size_t i = 0; i < fields.size(); i++) {
+        Token value(TOKEN_INTEGER, fields[i].first.text, fields[i].first.location);
+        value.intValue = static_cast<int64_t>(fields[i].second);
+        
+        std::string constant = name + "-" + (i + 1 < fields.size() ? std::string(fields[i].first.text) : "size");
+        if (!constants.emplace(constant, value).second) {
+            error(fields[i].first, "Duplicate constant: " + constant);
+        }
+    }
+}
+
+void Parser::addContext(const char* directiveStart) {
+    if (!functionCache) {
+        return;
+    }
+    
+    const char* end = previous().text.data() + previous().text.size();
+    if (end > directiveStart) {
+        contextHash = FunctionCache::hash(directiveStart, static_cast<size_t>(end - directiveStart), contextHash);
+    }
+}
+
+const CachedFunction* Parser::findCachedFunction(const char* start, const std::string& functionName,
+                                                 uint64_t& key, const char*& end) {
+    key = 0;
+    
+    const Token& bodyStart = peek();
+    if (bodyStart.type == TOKEN_EOF) {
+        return nullptr;
+    }
+    
+    // Find the end of the function with a lexer of its own, so the token
+    // stream is left alone if the body has to be parsed after all
+    std::string_view source = lexer->getSource();
+    DiagnosticEngine scanDiag;
+    Lexer scanner(source, lexer->getFilename(), scanDiag);
+    scanner.setState(LexerState{static_cast<size_t>(bodyStart.text.data() - source.data()),
+                                bodyStart.location.line, bodyStart.location.column});
+    
+    // The last four tokens; the function ends with DIR HINT <name> ENDFUNC
+    Token recent[4];
+    size_t count = 0;
+    for (;; count++) {
+        Token& token = recent[count & 3];
+        token = scanner.next();
+        if (token.type == TOKEN_EOF || token.type == TOKEN_ERROR || scanDiag.hasErrorDiagnostics()) {
+            return nullptr;
+        }
+        
+        // Other directives in the body change module state (sections, ABIs)
+        // that skipping the function would lose, so such bodies are parsed
+        if (count >= 1 && recent[(count - 1) & 3].type == TOKEN_DIRECTIVE && token.type == TOKEN_IDENTIFIER &&
+            token.directive != DIRECTIVE_LABEL && token.directive != DIRECTIVE_HINT) {
+            return nullptr;
+        }
+        
+        // A macro invocation may define things later code depends on
+        if (token.type == TOKEN_IDENTIFIER && macros.find(token.text) != macros.end()) {
+            return nullptr;
+        }
+        
+        if (count < 3 || token.type != TOKEN_IDENTIFIER) {
+            continue;
+        }
+        
+        const Token& dir = recent[(count - 3) & 3];
+        const Token& hint = recent[(count - 2) & 3];
+        const Token& name = recent[(count - 1) & 3];
+        if (dir.type != TOKEN_DIRECTIVE || hint.type != TOKEN_IDENTIFIER || hint.directive != DIRECTIVE_HINT ||
+            name.type != TOKEN_IDENTIFIER) {
+            continue;
+        }
+        
+        if (token.directive == DIRECTIVE_ENDFUNC && name.text == functionName) {
+            break;
+        }
+        if (token.directive == DIRECTIVE_FUNC) {
+            // Unterminated function; the parser reports it
+            return nullptr;
+        }
+    }
+    
+    const Token& last = recent[count & 3];
+    end = last.text.data() + last.text.size();
+    
+    // Zero means "not cacheable"
+    key = FunctionCache::hash(start, static_cast<size_t>(end - start), contextHash);
+    if (key == 0) {
+        key = 1;
+    }
+    
+    const CachedFunction* cached = functionCache->find(key);
+    if (cached) {
+        tokens.skipTo(last, scanner.getState());
+    }
+    return cached;
+}
+
+void Parser::parseFunction(const char* directiveStart) {
+    if (match(TOKEN_IDENTIFIER)) {
+        std::string functionName(previous().text);
+        
+        // Parse function attributes
+        uint16_t functionFlags = 0;
         
         if (match(TOKEN_IDENTIFIER)) {
-            if (previous().text == "FUNC") {
+            if (previous().directive == DIRECTIVE_FUNC) {
                 // Function declaration
                 
                 // Parse function flags
                 while (match(TOKEN_IDENTIFIER)) {
-                    std::string flag = previous().text;
+                    std::string_view flag = previous().text;
+                    uint8_t directive = previous().directive;
                     
-                    if (flag == "GLOBAL") {
+                    if (directive == DIRECTIVE_GLOBAL) {
                         functionFlags |= SYMBOL_FLAG_GLOBAL;
-                    } else if (flag == "LOCAL") {
+                    } else if (directive == DIRECTIVE_LOCAL) {
                         functionFlags |= SYMBOL_FLAG_LOCAL;
-                    } else if (flag == "WEAK") {
+                    } else if (directive == DIRECTIVE_WEAK) {
                         functionFlags |= SYMBOL_FLAG_WEAK;
                     } else if (flag == "HIDDEN") {
                         functionFlags |= SYMBOL_FLAG_HIDDEN;
@@ -469,59 +1763,96 @@ void Parser::parseFunction() {
                         functionFlags |= SYMBOL_FLAG_PROTECTED;
                     } else if (flag == "EXPORTED") {
                         functionFlags |= SYMBOL_FLAG_EXPORTED;
-                    } else if (flag == "ENDFUNC") {
+                    } else if (flag == "HOT") {
+                        module->setFunctionHeat(functionName, FUNCTION_HEAT_HOT);
+                    } else if (flag == "COLD") {
+                        module->setFunctionHeat(functionName, FUNCTION_HEAT_COLD);
+                    } else if (directive == DIRECTIVE_ENDFUNC) {
                         // End of function (shouldn't be here, but handle it anyway)
                         return;
                     } else {
-                        error(previous(), "Unknown function flag: " + flag);
+                        error(previous(), "Unknown function flag: " + std::string(flag));
                     }
                 }
                 
                 // Create a new function
                 auto function = std::make_unique<Function>(functionName, functionFlags);
                 
+                // A function whose source is unchanged is taken from the cache
+                uint64_t cacheKey = 0;
+                const char* cacheEnd = nullptr;
+                if (functionCache && directiveStart && !tokens.isExpanding()) {
+                    const CachedFunction* cached = findCachedFunction(directiveStart, functionName, cacheKey, cacheEnd);
+                    if (cached) {
+                        function->setCachedCode(cached);
+                        if (!module->addFunction(std::move(function))) {
+                            error(previous(), "Duplicate function: " + functionName);
+                        }
+                        return;
+                    }
+                }
+                size_t diagnosticCount = diag.getDiagnosticCount();
+                
                 // Look for the function body (should start with DIR LABEL)
-                if (match(TOKEN_DIRECTIVE) && previous().text == "DIR") {
-                    if (match(TOKEN_IDENTIFIER) && previous().text == "LABEL") {
+                if (match(TOKEN_DIRECTIVE)) {
+                    if (match(TOKEN_IDENTIFIER) && previous().directive == DIRECTIVE_LABEL) {
                         if (match(TOKEN_IDENTIFIER) && previous().text == functionName) {
                             // Found the function label, now parse the body
+                            currentFunction = function.get();
+                            function->addLabel(functionName, 0);
+                            bool closed = false;
                             
                             // Parse function body (instructions until ENDFUNC)
                             while (!isAtEnd()) {
-                                // Check for end of function
-                                if (check(TOKEN_DIRECTIVE)) {
-                                    Token dir = advance();
-                                    if (dir.text == "DIR" && match(TOKEN_IDENTIFIER) && 
-                                        previous().text == "HINT" && match(TOKEN_IDENTIFIER) && 
-                                        previous().text == functionName && match(TOKEN_IDENTIFIER) && 
-                                        previous().text == "ENDFUNC") {
-                                        // End of function found
-                                        break;
-                                    } else {
-                                        // Not the end of function, continue parsing
-                                        // Go back to start of directive
-                                        position -= 3; // DIR HINT functionName
+                                // Check for end of function: DIR HINT <name> ENDFUNC
+                                if (check(TOKEN_DIRECTIVE) &&
+                                    peek(1).type == TOKEN_IDENTIFIER && peek(1).directive == DIRECTIVE_HINT &&
+                                    peek(2).type == TOKEN_IDENTIFIER && peek(2).text == functionName &&
+                                    peek(3).type == TOKEN_IDENTIFIER && peek(3).directive == DIRECTIVE_ENDFUNC) {
+                                    // End of function found
+                                    for (int i = 0; i < 4; i++) {
+                                        advance();
                                     }
+                                    closed = true;
+                                    break;
                                 }
                                 
-                                // Parse an instruction
-                                if (match(TOKEN_INSTRUCTION) || match(TOKEN_IDENTIFIER)) {
-                                    // An instruction or directive that we should handle
-                                    position--; // Go back to the category/identifier
-                                    
-                                    // TODO: Implement instruction parsing
-                                    // For now, just skip to the next line
-                                    while (!isAtEnd() && !check(TOKEN_DIRECTIVE) && !check(TOKEN_INSTRUCTION)) {
+                                if (check(TOKEN_INSTRUCTION)) {
+                                    parseInstruction();
+                                } else if (checkMacro()) {
+                                    expandMacro();
+                                } else if (check(TOKEN_DIRECTIVE)) {
+                                    if (peek(1).type == TOKEN_IDENTIFIER && peek(1).directive == DIRECTIVE_HINT) {
+                                        // Functions don't nest
+                                        error(peek(1), "Expected 'DIR HINT " + functionName + " ENDFUNC'");
+                                        skipLine(statementLine(peek()));
+                                    } else {
                                         advance();
+                                        parseDirective();
                                     }
                                 } else {
-                                    // Skip unexpected tokens
-                                    advance();
+                                    error(peek(), "Expected instruction or directive");
+                                    skipLine(statementLine(peek()));
                                 }
                             }
                             
+                            currentFunction = nullptr;
+                            
+                            if (!closed) {
+                                error(peek(), "Missing 'DIR HINT " + functionName + " ENDFUNC'");
+                            }
+                            
+                            // Only cache a body that parsed cleanly and ended
+                            // where the cache lookup expected it to
+                            if (cacheKey != 0 && closed && diag.getDiagnosticCount() == diagnosticCount &&
+                                previous().text.data() + previous().text.size() == cacheEnd) {
+                                function->setCacheKey(cacheKey);
+                            }
+                            
                             // Add the function to the module
-                            module->addFunction(std::move(function));
+                            if (!module->addFunction(std::move(function))) {
+                                error(previous(), "Duplicate function: " + functionName);
+                            }
                         } else {
                             error(previous(), "Function label doesn't match function name");
                         }
@@ -531,14 +1862,19 @@ void Parser::parseFunction() {
                 } else {
                     error(peek(), "Expected DIR LABEL after function declaration");
                 }
-            } else if (previous().text == "ENDFUNC") {
+            } else if (previous().directive == DIRECTIVE_ENDFUNC) {
                 // End of function
                 return;
+            } else if (previous().text == "HOT") {
+                // A hint on its own may come before or after the function
+                module->setFunctionHeat(functionName, FUNCTION_HEAT_HOT);
+            } else if (previous().text == "COLD") {
+                module->setFunctionHeat(functionName, FUNCTION_HEAT_COLD);
             } else {
-                error(previous(), "Expected FUNC or ENDFUNC");
+                error(previous(), "Expected FUNC, ENDFUNC, HOT or COLD");
             }
         } else {
-            error(peek(), "Expected FUNC or ENDFUNC");
+            error(peek(), "Expected FUNC, ENDFUNC, HOT or COLD");
         }
     } else {
         error(peek(), "Expected function name");
@@ -547,7 +1883,7 @@ void Parser::parseFunction() {
 
 void Parser::parseAbi() {
     if (match(TOKEN_IDENTIFIER)) {
-        std::string abiName = previous().text;
+        std::string abiName(previous().text);
         
         // Create a new ABI definition
         AbiDefinition abi(abiName);
@@ -557,7 +1893,7 @@ void Parser::parseAbi() {
             // Parse ABI definition
             while (!match(TOKEN_RBRACE) && !isAtEnd()) {
                 if (match(TOKEN_IDENTIFIER)) {
-                    std::string field = previous().text;
+                    std::string_view field = previous().text;
                     
                     if (match(TOKEN_EQUALS)) {
                         if (field == "args" && match(TOKEN_LBRACKET)) {
@@ -631,7 +1967,7 @@ void Parser::parseAbi() {
                                 error(peek(), "Expected integer for stack alignment");
                             }
                         } else {
-                            error(previous(), "Unknown ABI field: " + field);
+                            error(previous(), "Unknown ABI field: " + std::string(field));
                             // Skip to the next field
                             while (!isAtEnd() && !check(TOKEN_IDENTIFIER) && !check(TOKEN_RBRACE)) {
                                 advance();
@@ -657,120 +1993,313 @@ void Parser::parseAbi() {
 }
 
 void Parser::parseInstruction() {
-    // TODO: Implement instruction parsing
+    symbolRefs.clear();
+    
+    auto instruction = parseInstructionBody();
+    if (!instruction) {
+        return;
+    }
+    
+    size_t index = currentFunction->addInstruction(std::move(instruction));
+    
+    // Symbol operands are resolved once the whole module is known
+    for (const auto& symbol : symbolRefs) {
+        currentFunction->addLabelRef(index, symbol);
+    }
 }
 
 std::unique_ptr<Instruction> Parser::parseInstructionBody() {
-    // TODO: Implement instruction body parsing
-    return nullptr;
+    // CATEGORY OPERATION [operands] [-> outputs]
+    Token categoryToken = advance();
+    int64_t line = statementLine(categoryToken);
+    
+    if (!onLine(line) || !check(TOKEN_IDENTIFIER)) {
+        error(categoryToken, "Expected operation after '" + std::string(categoryToken.text) + "'");
+        skipLine(line);
+        return nullptr;
+    }
+    
+    Token opToken = advance();
+    uint8_t operation;
+    if (!lookupOperation(categoryToken.category, opToken.text, operation)) {
+        error(opToken, "Unknown operation: " + std::string(categoryToken.text) + " " +
+              std::string(opToken.text));
+        skipLine(line);
+        return nullptr;
+    }
+    
+    auto instruction = std::make_unique<Instruction>(categoryToken.category, operation);
+    std::vector<uint8_t> extendedData;
+    
+    if (categoryToken.category == CAT_CF && operation == CF_BRC) {
+        // Conditional branch: the condition code goes into the extended data
+        uint8_t condition;
+        if (onLine(line) && (check(TOKEN_IDENTIFIER) || check(TOKEN_REGISTER)) &&
+            lookupName(conditionCodes, peek().text, condition)) {
+            advance();
+            extendedData.push_back(condition);
+        } else {
+            error(peek(), "Expected condition code");
+            skipLine(line);
+            return nullptr;
+        }
+    } else if (categoryToken.category == CAT_VEC) {
+        // Vector operation: an optional element type goes into the extended data
+        uint8_t elementType;
+        if (onLine(line) && check(TOKEN_IDENTIFIER) && lookupName(elementTypes, peek().text, elementType)) {
+            advance();
+            extendedData.push_back(elementType);
+        }
+    } else if (categoryToken.category == CAT_VAR && operation == VAR_DECL) {
+        // Variable declaration: $id [: type] [= value]
+        if (!match(TOKEN_VARIABLE)) {
+            error(peek(), "Expected variable in declaration");
+            skipLine(line);
+            return nullptr;
+        }
+        
+        uint8_t varId = previous().varId;
+        instruction->addOperand(OperandValue::makeVariable(varId));
+        
+        if (match(TOKEN_COLON)) {
+            uint16_t typeId = parseTypeSpecifier();
+            extendedData.push_back(static_cast<uint8_t>(typeId & 0xFF));
+            extendedData.push_back(static_cast<uint8_t>(typeId >> 8));
+            currentFunction->setVariableType(varId, static_cast<uint8_t>(typeId));
+        }
+        
+        if (match(TOKEN_EQUALS)) {
+            if (!parseOperand(*instruction)) {
+                skipLine(line);
+                return nullptr;
+            }
+            
+            size_t valueIndex = instruction->getOperandCount() - 1;
+            if (instruction->getOperandValue(valueIndex).getClass() == OPERAND_IMMEDIATE) {
+                size_t length;
+                const uint8_t* initValue = instruction->getOperandPayload(valueIndex, length);
+                currentFunction->setVariableInitValue(varId, std::vector<uint8_t>(initValue, initValue + length));
+            }
+        }
+    }
+    
+    parseOperands(*instruction, line);
+    
+    // Output list; its length is recorded as the last extended data byte
+    if (match(TOKEN_ARROW)) {
+        size_t outputCount = parseOperands(*instruction, line);
+        extendedData.push_back(static_cast<uint8_t>(outputCount));
+    }
+    
+    if (onLine(line)) {
+        error(peek(), "Unexpected token after instruction: " + std::string(peek().text));
+        skipLine(line);
+    }
+    
+    if (!extendedData.empty()) {
+        instruction->setExtendedData(extendedData);
+    }
+    
+    return instruction;
 }
 
-std::unique_ptr<Operand> Parser::parseOperand() {
+size_t Parser::parseOperands(Instruction& instruction, int64_t line) {
+    size_t count = 0;
+    
+    while (onLine(line) && !check(TOKEN_ARROW)) {
+        if (match(TOKEN_LPAREN)) {
+            // Parenthesized group, e.g. syscall arguments: (0x01, R4)
+            while (!check(TOKEN_RPAREN) && onLine(line)) {
+                if (!parseOperand(instruction)) {
+                    skipLine(line);
+                    return count;
+                }
+                count++;
+                
+                if (!match(TOKEN_COMMA)) {
+                    break;
+                }
+            }
+            consume(TOKEN_RPAREN, "Expected ')' after operand list");
+        } else {
+            if (!parseOperand(instruction)) {
+                skipLine(line);
+                return count;
+            }
+            count++;
+        }
+        
+        match(TOKEN_COMMA);
+    }
+    
+    return count;
+}
+
+bool Parser::parseOperand(Instruction& instruction) {
     if (match(TOKEN_REGISTER)) {
-        return parseRegisterOperand();
+        return parseRegisterOperand(instruction);
     } else if (match(TOKEN_VARIABLE)) {
-        return parseVariableOperand();
+        return parseVariableOperand(instruction);
     } else if (match(TOKEN_INTEGER) || match(TOKEN_FLOAT) || match(TOKEN_STRING)) {
-        return parseImmediateOperand();
+        return parseImmediateOperand(instruction, previous());
     } else if (match(TOKEN_LBRACKET)) {
-        return parseMemoryOperand();
+        return parseMemoryOperand(instruction);
+    } else if (match(TOKEN_IDENTIFIER)) {
+        auto constant = constants.find(previous().text);
+        if (constant != constants.end()) {
+            return parseImmediateOperand(instruction, constant->second);
+        }
+        return parseSymbolOperand(instruction);
     } else {
         error(peek(), "Expected operand");
-        return nullptr;
+        return false;
     }
 }
 
-std::unique_ptr<Operand> Parser::parseRegisterOperand() {
+bool Parser::parseRegisterOperand(Instruction& instruction) {
     Token regToken = previous();
-    return std::make_unique<RegisterOperand>(REG_GP, regToken.regId);
+    
+    // The register class follows from the ID range
+    uint8_t regType = REG_GP;
+    if (regToken.regId >= REG_PC) {
+        regType = REG_SPECIAL;
+    } else if (regToken.regId >= REG_V0) {
+        regType = REG_VEC;
+    } else if (regToken.regId >= REG_F0) {
+        regType = REG_FP;
+    }
+    
+    instruction.addOperand(OperandValue::makeRegister(regType, regToken.regId));
+    return true;
 }
 
-std::unique_ptr<Operand> Parser::parseVariableOperand() {
+bool Parser::parseVariableOperand(Instruction& instruction) {
     Token varToken = previous();
-    return std::make_unique<VariableOperand>(varToken.varId);
+    instruction.addOperand(OperandValue::makeVariable(varToken.varId));
+    return true;
 }
 
-std::unique_ptr<Operand> Parser::parseImmediateOperand() {
-    Token immToken = previous();
-    
+bool Parser::parseImmediateOperand(Instruction& instruction, const Token& immToken) {
     if (immToken.type == TOKEN_INTEGER) {
-        return std::make_unique<ImmediateOperand>(immToken.intValue);
+        instruction.addOperand(OperandValue::makeImmediate(immToken.intValue));
+        return true;
     } else if (immToken.type == TOKEN_FLOAT) {
-        return std::make_unique<ImmediateOperand>(immToken.floatValue);
+        instruction.addOperand(OperandValue::makeImmediate(immToken.floatValue));
+        return true;
     } else if (immToken.type == TOKEN_STRING) {
-        return std::make_unique<ImmediateOperand>(immToken.text);
+        addSymbolOperand(instruction, immToken.text);
+        return true;
     } else {
         error(immToken, "Invalid immediate operand");
-        return nullptr;
+        return false;
+    }
+}
+
+void Parser::addSymbolOperand(Instruction& instruction, std::string_view symbol) {
+    // Symbols are encoded as null-terminated strings
+    std::string payload(symbol);
+    instruction.addOperand(OPERAND_IMMEDIATE | IMM_SYMBOL,
+                           reinterpret_cast<const uint8_t*>(payload.c_str()), payload.size() + 1);
+}
+
+bool Parser::parseSymbolOperand(Instruction& instruction) {
+    std::string symbol(previous().text);
+    
+    // ABI names select a calling convention and are not symbol references
+    if (!module->getAbiDefinition(symbol)) {
+        symbolRefs.push_back(symbol);
     }
+    
+    addSymbolOperand(instruction, symbol);
+    return true;
 }
 
-std::unique_ptr<Operand> Parser::parseMemoryOperand() {
+bool Parser::parseMemoryOperand(Instruction& instruction) {
     // [reg]
     if (match(TOKEN_REGISTER)) {
         Token regToken = previous();
         
         if (match(TOKEN_RBRACKET)) {
             // Simple [reg]
-            return std::make_unique<MemoryOperand>(regToken.regId);
+            instruction.addOperand(OperandValue::makeMemory(regToken.regId));
+            return true;
         } else if (match(TOKEN_PLUS)) {
             // [reg + ...]
+            int64_t disp;
             if (match(TOKEN_REGISTER)) {
                 // [reg + reg]
                 Token reg2Token = previous();
                 
                 if (match(TOKEN_STAR)) {
                     // [reg + reg*scale]
-                    if (match(TOKEN_INTEGER)) {
-                        Token scaleToken = previous();
-                        
+                    int64_t scale;
+                    if (matchInteger(scale)) {
                         if (match(TOKEN_RBRACKET)) {
-                            return std::make_unique<MemoryOperand>(
-                                regToken.regId, reg2Token.regId, 
-                                static_cast<uint8_t>(scaleToken.intValue));
+                            instruction.addOperand(OperandValue::makeMemory(regToken.regId, reg2Token.regId, static_cast<uint8_t>(scale)));
+                            return true;
                         } else {
                             error(peek(), "Expected ']' after memory operand");
-                            return nullptr;
+                            return false;
                         }
                     } else {
                         error(peek(), "Expected integer scale factor");
-                        return nullptr;
+                        return false;
                     }
                 } else if (match(TOKEN_RBRACKET)) {
                     // [reg + reg]
-                    return std::make_unique<MemoryOperand>(regToken.regId, reg2Token.regId);
+                    instruction.addOperand(OperandValue::makeMemory(regToken.regId, reg2Token.regId));
+                    return true;
                 } else {
                     error(peek(), "Expected '*' or ']' after register in memory operand");
-                    return nullptr;
+                    return false;
                 }
-            } else if (match(TOKEN_INTEGER)) {
+            } else if (matchInteger(disp)) {
                 // [reg + disp]
-                Token dispToken = previous();
-                
                 if (match(TOKEN_RBRACKET)) {
-                    return std::make_unique<MemoryOperand>(
-                        regToken.regId, static_cast<int32_t>(dispToken.intValue));
+                    instruction.addOperand(OperandValue::makeMemory(regToken.regId, static_cast<int32_t>(disp)));
+                    return true;
                 } else {
                     error(peek(), "Expected ']' after memory operand");
-                    return nullptr;
+                    return false;
                 }
             } else {
                 error(peek(), "Expected register or integer after '+' in memory operand");
-                return nullptr;
+                return false;
+            }
+        } else if (match(TOKEN_MINUS) || (check(TOKEN_INTEGER) && peek().intValue < 0)) {
+            // [reg - disp] or [reg -disp]
+            bool negate = previous().type == TOKEN_MINUS;
+            
+            int64_t disp;
+            if (matchInteger(disp)) {
+                if (negate) {
+                    disp = -disp;
+                }
+                
+                if (match(TOKEN_RBRACKET)) {
+                    instruction.addOperand(OperandValue::makeMemory(regToken.regId, static_cast<int32_t>(disp)));
+                    return true;
+                } else {
+                    error(peek(), "Expected ']' after memory operand");
+                    return false;
+                }
+            } else {
+                error(peek(), "Expected integer after '-' in memory operand");
+                return false;
             }
         } else {
-            error(peek(), "Expected ']' or '+' after register in memory operand");
-            return nullptr;
+            error(peek(), "Expected ']', '+' or '-' after register in memory operand");
+            return false;
         }
     } else {
         error(peek(), "Expected register in memory operand");
-        return nullptr;
+        return false;
     }
 }
 
 uint16_t Parser::parseTypeSpecifier() {
     if (match(TOKEN_IDENTIFIER)) {
-        std::string typeName = previous().text;
+        std::string_view typeName = previous().text;
         
         // Basic types
         if (typeName == "void") {
@@ -866,7 +2395,7 @@ uint16_t Parser::parseTypeSpecifier() {
                 return TYPE_VEC512;
             }
         } else {
-            error(previous(), "Unknown type name: " + typeName);
+            error(previous(), "Unknown type name: " + std::string(typeName));
             return TYPE_VOID;
         }
     } else {
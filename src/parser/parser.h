@@ -5,14 +5,32 @@
 #include <vector>
 #include <memory>
 #include <map>
+#include <set>
 #include "parser/lexer.h"
+#include "parser/token_stream.h"
+#include "parser/include_cache.h"
+#include "parser/data_builder.h"
 #include "core/instruction.h"
 #include "core/operand.h"
 #include "util/diagnostic.h"
+#include "util/arena.h"
 #include "binary/cof.h"
+#include "binary/function_cache.h"
+#include "target/register_allocator.h"
+#include "util/thread_pool.h"
 
 namespace coil {
 
+/**
+ * @brief Symbol operand that refers to something outside its function
+ */
+struct SymbolReference {
+    size_t instruction;      // Instruction index
+    size_t operand;          // Operand index
+    std::string symbol;      // Referenced symbol, after overrides
+    size_t label;            // Instruction a local label points at, or SIZE_MAX
+};
+
 /**
  * @brief Function definition
  */
@@ -24,7 +42,11 @@ private:
     std::vector<std::vector<uint8_t>> variableInitValues; // Variable initial values
     std::map<std::string, size_t> labels;   // Label -> instruction index mapping
     std::vector<std::pair<size_t, std::string>> labelRefs; // Instruction index -> label reference
+    std::vector<SymbolReference> symbolReferences; // References resolveLabels left to relocations
     uint16_t flags;          // Function flags
+    uint64_t cacheKey;       // Function cache key (0 if the function is not cacheable)
+    const CachedFunction* cachedCode; // Code reused from the function cache (replaces the instructions)
+    RegisterAllocation registerAllocation; // Registers assigned by the target
 
 public:
     /**
@@ -64,6 +86,24 @@ public:
      */
     const std::vector<std::unique_ptr<Instruction>>& getInstructions() const;
     
+    /**
+     * @brief Replace an instruction
+     * 
+     * @param index Instruction index
+     * @param instruction New instruction
+     */
+    void replaceInstruction(size_t index, std::unique_ptr<Instruction> instruction);
+    
+    /**
+     * @brief Remove instructions, keeping labels and label references in step
+     * 
+     * A label on a removed instruction moves to the next one that is kept.
+     * 
+     * @param removed One flag per instruction, true to remove it
+     * @return Number of instructions removed
+     */
+    size_t removeInstructions(const std::vector<bool>& removed);
+    
     /**
      * @brief Add a label
      * 
@@ -81,16 +121,36 @@ public:
      */
     void addLabelRef(size_t instructionIndex, const std::string& labelName);
     
+    /**
+     * @brief Get the local labels
+     * 
+     * @return Label -> instruction index mapping
+     */
+    const std::map<std::string, size_t>& getLabels() const;
+    
     /**
      * @brief Resolve all label references
      * 
+     * Every reference is recorded as a SymbolReference. A local label is
+     * referred to through the function's own symbol and the instruction
+     * the label points at. Branches have to stay within the module, while
+     * calls and addresses may name symbols defined elsewhere.
+     * 
      * @param symbols Symbol table (for global labels)
+     * @param symbolIndex Index over the symbol table's names
      * @param symbolOverrides Symbol overrides (for linking)
      * @return true if all references resolved, false otherwise
      */
-    bool resolveLabels(const std::vector<std::unique_ptr<Symbol>>& symbols, 
+    bool resolveLabels(const std::vector<std::unique_ptr<Symbol>>& symbols, const SymbolIndex& symbolIndex,
                       const std::map<std::string, std::string>& symbolOverrides = {});
     
+    /**
+     * @brief Get the references to symbols and local labels
+     * 
+     * @return References found by the last resolveLabels(), in instruction order
+     */
+    const std::vector<SymbolReference>& getSymbolReferences() const;
+    
     /**
      * @brief Set the type for a variable
      * 
@@ -122,6 +182,48 @@ public:
      * @return Initial value, or empty vector if not set
      */
     const std::vector<uint8_t>& getVariableInitValue(uint8_t varId) const;
+    
+    /**
+     * @brief Set the key to store the function's code under in the function cache
+     * 
+     * @param key Function cache key (0 for none)
+     */
+    void setCacheKey(uint64_t key);
+    
+    /**
+     * @brief Get the function cache key
+     * 
+     * @return Function cache key, or 0 if the function is not cacheable
+     */
+    uint64_t getCacheKey() const;
+    
+    /**
+     * @brief Use previously encoded code instead of instructions
+     * 
+     * @param code Cached code (must outlive the function)
+     */
+    void setCachedCode(const CachedFunction* code);
+    
+    /**
+     * @brief Get the cached code of the function
+     * 
+     * @return Cached code, or nullptr if the function has instructions
+     */
+    const CachedFunction* getCachedCode() const;
+    
+    /**
+     * @brief Set the registers assigned to the function by the target
+     * 
+     * @param allocation Register allocation
+     */
+    void setRegisterAllocation(RegisterAllocation allocation);
+    
+    /**
+     * @brief Get the registers assigned to the function
+     * 
+     * @return Register allocation (empty until the target allocates registers)
+     */
+    const RegisterAllocation& getRegisterAllocation() const;
 };
 
 /**
@@ -138,11 +240,21 @@ struct AbiDefinition {
     AbiDefinition(const std::string& abiName) : name(abiName), stackAlign(16) {}
 };
 
+/**
+ * @brief How often a function is expected to run, from DIR HINT
+ */
+enum FunctionHeat : uint8_t {
+    FUNCTION_HEAT_NORMAL = 0,  // No hint
+    FUNCTION_HEAT_HOT    = 1,  // HOT: placed first
+    FUNCTION_HEAT_COLD   = 2   // COLD: placed in the text.cold section
+};
+
 /**
  * @brief Module containing multiple functions and sections
  */
 class Module {
 private:
+    Arena arena;             // Backing store for instructions and operands (destroyed last)
     std::string name;        // Module name
     std::vector<std::unique_ptr<Function>> functions; // Functions
     std::map<std::string, size_t> functionMap; // Function name -> index mapping
@@ -152,6 +264,12 @@ private:
     uint32_t currentSectionType;     // Current section type
     uint32_t currentSectionFlags;    // Current section flags
     uint32_t currentTargetId;        // Current target architecture ID
+    DataBuilder dataBuilder;         // Contents of the data sections
+    std::map<std::string, FunctionHeat> functionHeat; // Function name -> HOT or COLD hint
+    size_t coldFunctionCount;        // Functions at the end that go to text.cold
+    
+    bool generateNativeCode(CofFile& cof, const std::vector<Target*>& targets,
+                            const std::vector<uint32_t>& targetIds, size_t jobs, ThreadPool* pool) const;
 
 public:
     /**
@@ -168,6 +286,13 @@ public:
      */
     const std::string& getName() const;
     
+    /**
+     * @brief Get the arena the module's instructions are allocated from
+     * 
+     * @return Module arena
+     */
+    Arena& getArena();
+    
     /**
      * @brief Add a function
      * 
@@ -191,6 +316,47 @@ public:
      */
     const std::vector<std::unique_ptr<Function>>& getFunctions() const;
     
+    /**
+     * @brief Reorder the functions
+     * 
+     * @param order Function indices in their new order (a permutation)
+     * @param coldCount Number of functions at the end of the order that
+     *                  go to the text.cold section
+     */
+    void setFunctionOrder(const std::vector<size_t>& order, size_t coldCount);
+    
+    /**
+     * @brief Get the number of functions that go to the text.cold section
+     * 
+     * @return Number of cold functions, which are the last ones
+     */
+    size_t getColdFunctionCount() const;
+    
+    /**
+     * @brief Record how often a function is expected to run
+     * 
+     * The function does not have to be defined yet.
+     * 
+     * @param name Function name
+     * @param heat HOT or COLD hint
+     */
+    void setFunctionHeat(const std::string& name, FunctionHeat heat);
+    
+    /**
+     * @brief Get how often a function is expected to run
+     * 
+     * @param name Function name
+     * @return Hint given for the function, FUNCTION_HEAT_NORMAL if none
+     */
+    FunctionHeat getFunctionHeat(const std::string& name) const;
+    
+    /**
+     * @brief Check if any function has a HOT or COLD hint
+     * 
+     * @return true if there are hints
+     */
+    bool hasFunctionHeat() const;
+    
     /**
      * @brief Add an ABI definition
      * 
@@ -227,6 +393,9 @@ public:
     /**
      * @brief Set the current section
      * 
+     * Data directives that follow go to this section unless it is a code
+     * section.
+     * 
      * @param name Section name
      * @param type Section type
      * @param flags Section flags
@@ -268,52 +437,124 @@ public:
      */
     uint32_t getCurrentTargetId() const;
     
+    /**
+     * @brief Get the contents of the data sections
+     * 
+     * @return Data builder
+     */
+    DataBuilder& getDataBuilder();
+    
     /**
      * @brief Generate a COF file from this module
      * 
-     * @return Generated COF file
+     * The output does not depend on the number of jobs. Functions taken
+     * from the function cache are copied in as they are; the code of the
+     * other cacheable functions is stored in the cache, so the cache's
+     * configuration has to include the encoding.
+     * 
+     * Functions are laid out in module order. The cold functions at the
+     * end (see setFunctionOrder) go to a text.cold section, and their
+     * machine code to a text.<target>.cold section of each target.
+     * 
+     * @param jobs Number of threads to encode functions on (0 picks one
+     *             per hardware thread)
+     * @param cache Function cache (nullptr for none)
+     * @param encoding Instruction encoding of the text section
+     * @param targets Targets the code is assembled for, recorded with their
+     *                features; the bytecode belongs to the first (empty for
+     *                plain x86-64)
+     * @param native Also generate machine code for each target, in a
+     *               section of its own; all targets are lowered on the
+     *               same jobs
+     * @param pool Pool to run the jobs on (nullptr to start one of jobs
+     *             threads for the call)
+     * @return Generated COF file, or nullptr if a target cannot lower a
+     *         function or a data label has the name of a function
      */
-    std::unique_ptr<CofFile> generateCof();
+    std::unique_ptr<CofFile> generateCof(size_t jobs = 1, FunctionCache* cache = nullptr,
+                                         InstructionEncoding encoding = ENCODING_STANDARD,
+                                         const std::vector<Target*>& targets = {}, bool native = false,
+                                         ThreadPool* pool = nullptr);
 };
 
 /**
  * @brief Parser for COIL assembly
  * 
- * Parses COIL assembly into a module.
+ * Parses COIL assembly into a module. MACRO, CONST and STRUCT definitions
+ * and INCLUDE directives are handled while parsing: macro invocations and
+ * included files are pushed onto the token stream, and constants are
+ * substituted where an operand is expected.
  */
 class Parser {
 private:
-    std::vector<Token> tokens;   // Tokens
-    size_t position;             // Current position in tokens
+    /**
+     * @brief Macro defined with DIR MACRO
+     */
+    struct Macro {
+        std::vector<std::string> params; // Parameter names
+        std::vector<Token> body;         // Tokens up to DIR ENDM
+    };
+    
+    static constexpr size_t MAX_MACRO_DEPTH = 64; // Deepest nesting of macro invocations
+    
+    TokenStream tokens;          // Token source with bounded lookahead
+    Lexer* lexer;                // Lexer behind the tokens (nullptr for pre-built tokens)
     DiagnosticEngine& diag;      // Diagnostics
     std::unique_ptr<Module> module; // Current module
+    Function* currentFunction;   // Function whose body is being parsed
+    std::vector<std::string> symbolRefs; // Symbols referenced by the current instruction
+    FunctionCache* functionCache; // Cache of encoded functions (nullptr for none)
+    uint64_t contextHash;        // Hash of the directives seen so far that change how code assembles
+    std::map<std::string, Macro, std::less<>> macros;     // Macro name -> definition
+    std::map<std::string, Token, std::less<>> constants;  // Constant name -> value token
+    IncludeCache* includeCache;  // Tokenized include files (ownIncludeCache unless set)
+    std::unique_ptr<IncludeCache> ownIncludeCache; // Cache used when none is shared
+    std::set<std::string> includedPaths; // Files included so far
+    std::vector<std::shared_ptr<const IncludedFile>> includedFiles; // Keep included tokens' text alive
     
     // Helper methods
-    Token peek() const;
-    Token previous() const;
-    Token advance();
-    bool check(TokenType type) const;
+    const Token& peek(size_t ahead = 0);
+    const Token& previous() const;
+    const Token& advance();
+    bool check(TokenType type);
     bool match(TokenType type);
-    bool isAtEnd() const;
+    bool isAtEnd();
     
     void consume(TokenType type, const std::string& message);
+    static int64_t statementLine(const Token& token);
+    void skipLine(int64_t line);
+    bool onLine(int64_t line);
+    bool matchInteger(int64_t& value);
     
     // Parsing methods
     void parseModule();
     void parseDirective();
+    void parseInclude(int64_t line);
+    void parseMacro(int64_t line);
+    bool checkMacro();
+    void expandMacro();
+    void parseConst(int64_t line);
+    void parseStruct(int64_t line);
     void parseSection();
-    void parseFunction();
+    void parseFunction(const char* directiveStart);
+    const CachedFunction* findCachedFunction(const char* start, const std::string& functionName,
+                                             uint64_t& key, const char*& end);
+    void addContext(const char* directiveStart);
     void parseAbi();
     void parseLabel();
+    void parseData(uint32_t directive, int64_t line);
     void parseInstruction();
     std::unique_ptr<Instruction> parseInstructionBody();
+    size_t parseOperands(Instruction& instruction, int64_t line);
     
-    // Operand parsing
-    std::unique_ptr<Operand> parseOperand();
-    std::unique_ptr<Operand> parseRegisterOperand();
-    std::unique_ptr<Operand> parseVariableOperand();
-    std::unique_ptr<Operand> parseImmediateOperand();
-    std::unique_ptr<Operand> parseMemoryOperand();
+    // Operand parsing (each appends the operand to the instruction)
+    bool parseOperand(Instruction& instruction);
+    bool parseRegisterOperand(Instruction& instruction);
+    bool parseVariableOperand(Instruction& instruction);
+    bool parseImmediateOperand(Instruction& instruction, const Token& immToken);
+    bool parseMemoryOperand(Instruction& instruction);
+    bool parseSymbolOperand(Instruction& instruction);
+    void addSymbolOperand(Instruction& instruction, std::string_view symbol);
     
     // Type parsing
     uint16_t parseTypeSpecifier();
@@ -323,13 +564,57 @@ private:
     
 public:
     /**
-     * @brief Construct a new Parser
+     * @brief Construct a new Parser over already tokenized input
      * 
      * @param sourceTokens Tokens to parse
      * @param diagnostics Diagnostic engine
      */
     Parser(std::vector<Token> sourceTokens, DiagnosticEngine& diagnostics);
     
+    /**
+     * @brief Construct a new Parser that pulls tokens from a lexer
+     * 
+     * Tokens are scanned on demand, so memory use does not grow with the
+     * size of the input.
+     * 
+     * @param lexer Lexer to pull tokens from (must outlive the parser)
+     * @param diagnostics Diagnostic engine
+     */
+    Parser(Lexer& lexer, DiagnosticEngine& diagnostics);
+    
+    /**
+     * @brief Reuse encoded functions from a cache
+     * 
+     * A function whose source text, TARGET and ABI directives, preceding
+     * definitions and included files are unchanged since it was stored is taken from the cache without being
+     * parsed. Only parsers that pull tokens from a lexer use the cache.
+     * 
+     * @param cache Function cache (must outlive the module; nullptr for none)
+     */
+    void setFunctionCache(FunctionCache* cache);
+    
+    /**
+     * @brief Share tokenized include files with other parsers
+     * 
+     * @param cache Include cache (must outlive the parser; nullptr for a
+     *              cache of the parser's own)
+     */
+    void setIncludeCache(IncludeCache* cache);
+    
+    /**
+     * @brief Measure how long pulling tokens from the lexer takes
+     * 
+     * @param report Report whose clocks to use (nullptr to stop measuring)
+     */
+    void setTimeReport(const TimeReport* report);
+    
+    /**
+     * @brief Get the time spent in the lexer while parsing
+     * 
+     * @return Wall time and allocations of the lexer (no CPU time)
+     */
+    const ResourceSample& getLexingCost() const;
+    
     /**
      * @brief Parse the tokens into a module
      * 
@@ -0,0 +1,141 @@
+#include "parser/token_stream.h"
+#include <cassert>
+#include <utility>
+
+namespace coil {
+
+TokenStream::TokenStream(Lexer& source)
+    : lexer(&source), tokenPos(0), position(0), end(0),
+      startToken(TOKEN_ERROR, "", source.getCurrentLocation()), macroDepths(1, 0),
+      timeReport(nullptr) {
+}
+
+TokenStream::TokenStream(std::vector<Token> sourceTokens)
+    : lexer(nullptr), tokens(std::move(sourceTokens)), tokenPos(0), position(0), end(0),
+      startToken(TOKEN_ERROR, "", tokens.empty() ? SourceLocation() : tokens.front().location),
+      macroDepths(1, 0), timeReport(nullptr) {
+}
+
+Token TokenStream::pull() {
+    // Pushed sequences come first, innermost one first
+    while (!expansions.empty()) {
+        Expansion& top = expansions.back();
+        if (top.next < top.tokens->size()) {
+            Token token = (*top.tokens)[top.next++];
+            if (top.source != KEEP_SOURCE) {
+                token.source = top.source;
+            }
+            return token;
+        }
+        expansions.pop_back();
+    }
+
+    if (lexer) {
+        if (!timeReport) {
+            return lexer->next();
+        }
+
+        ResourceSample begin = timeReport->sample(false);
+        Token token = lexer->next();
+        ResourceSample end = timeReport->sample(false);
+        lexingCost.wall += end.wall - begin.wall;
+        lexingCost.allocations += end.allocations - begin.allocations;
+        lexingCost.allocatedBytes += end.allocatedBytes - begin.allocatedBytes;
+        return token;
+    }
+
+    if (tokenPos < tokens.size()) {
+        return tokens[tokenPos++];
+    }
+
+    // Past the end of the vector, keep returning EOF at the last location
+    return Token(TOKEN_EOF, "", tokens.empty() ? SourceLocation() : tokens.back().location);
+}
+
+const Token& TokenStream::peek(size_t ahead) {
+    assert(ahead <= MAX_LOOKAHEAD && "lookahead exceeds the token ring");
+
+    // Fill the ring up to the requested token; the slot of the previous
+    // token is never overwritten because the ring keeps one spare entry
+    while (end <= position + ahead) {
+        ring[end & (CAPACITY - 1)] = pull();
+        end++;
+    }
+
+    return ring[(position + ahead) & (CAPACITY - 1)];
+}
+
+const Token& TokenStream::previous() const {
+    if (position == 0) {
+        return startToken;
+    }
+    return ring[(position - 1) & (CAPACITY - 1)];
+}
+
+const Token& TokenStream::advance() {
+    if (!isAtEnd()) {
+        position++;
+    }
+    return previous();
+}
+
+void TokenStream::skipTo(const Token& lastToken, const LexerState& state) {
+    assert(lexer && "skipping needs a lexer to resume");
+    assert(!isExpanding() && "cannot skip while reading pushed tokens");
+
+    lexer->setState(state);
+
+    // Make lastToken the previous token of an otherwise empty ring
+    ring[position & (CAPACITY - 1)] = lastToken;
+    position++;
+    end = position;
+}
+
+void TokenStream::push(std::shared_ptr<const std::vector<Token>> sequence, const Token& origin, bool macro) {
+    // Tokens already buffered past the current one are read after the
+    // sequence, keeping the sources they came from
+    if (end > position) {
+        auto pending = std::make_shared<std::vector<Token>>();
+        for (size_t i = position; i < end; i++) {
+            pending->push_back(ring[i & (CAPACITY - 1)]);
+        }
+        expansions.push_back(Expansion{std::move(pending), 0, KEEP_SOURCE});
+        end = position;
+    }
+
+    uint32_t source = static_cast<uint32_t>(macroDepths.size());
+    macroDepths.push_back(static_cast<uint32_t>(getMacroDepth(origin) + (macro ? 1 : 0)));
+    expansions.push_back(Expansion{std::move(sequence), 0, source});
+}
+
+bool TokenStream::isExpanding() const {
+    if (!expansions.empty()) {
+        return true;
+    }
+    for (size_t i = position; i < end; i++) {
+        if (ring[i & (CAPACITY - 1)].source != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t TokenStream::getMacroDepth(const Token& token) const {
+    return token.source < macroDepths.size() ? macroDepths[token.source] : 0;
+}
+
+void TokenStream::setTimeReport(const TimeReport* report) {
+    timeReport = report;
+    lexingCost = ResourceSample();
+    lexingCost.cpu = -1;
+}
+
+const ResourceSample& TokenStream::getLexingCost() const {
+    return lexingCost;
+}
+
+bool TokenStream::isAtEnd() {
+    return peek().type == TOKEN_EOF;
+}
+
+} // namespace coil
@@ -0,0 +1,156 @@
+#ifndef COIL_PARSER_TOKEN_STREAM_H
+#define COIL_PARSER_TOKEN_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "parser/lexer.h"
+#include "util/time_report.h"
+
+namespace coil {
+
+/**
+ * @brief Bounded lookahead buffer over a token source
+ *
+ * Pulls tokens on demand from a Lexer (or from a pre-built token vector)
+ * into a small ring buffer, so the parser never needs the whole token
+ * list in memory. The previous token and up to MAX_LOOKAHEAD tokens past
+ * the current one are addressable; returned references stay valid until
+ * the next call to advance().
+ *
+ * Macro expansions and included files are pushed as token sequences that
+ * are read before the rest of the input. Every pushed sequence gets its
+ * own source ID, which its tokens carry in Token::source.
+ */
+class TokenStream {
+public:
+    static constexpr size_t CAPACITY = 8;                // Ring size (power of two)
+    static constexpr size_t MAX_LOOKAHEAD = CAPACITY - 2; // Furthest peek() offset
+
+private:
+    /**
+     * @brief Pushed token sequence being read
+     */
+    struct Expansion {
+        std::shared_ptr<const std::vector<Token>> tokens; // Tokens to read
+        size_t next;         // Next token to read
+        uint32_t source;     // Source ID stamped on the tokens (KEEP_SOURCE to leave them)
+    };
+
+    static constexpr uint32_t KEEP_SOURCE = UINT32_MAX;
+
+    Lexer* lexer;                // Token source (nullptr when reading a vector)
+    std::vector<Token> tokens;   // Pre-built tokens (vector mode only)
+    size_t tokenPos;             // Next token to pull from the vector
+    Token ring[CAPACITY];        // Buffered tokens
+    size_t position;             // Absolute index of the current token
+    size_t end;                  // Absolute index one past the last buffered token
+    Token startToken;            // Returned by previous() before the first advance
+    std::vector<Expansion> expansions; // Pushed sequences, innermost last
+    std::vector<uint32_t> macroDepths; // Per source ID: macro expansions it is nested in
+    const TimeReport* timeReport; // Clock for lexer time (nullptr when not timing)
+    ResourceSample lexingCost;   // Time and allocations spent in the lexer
+
+    Token pull();
+
+public:
+    /**
+     * @brief Construct a stream that pulls from a lexer
+     *
+     * @param source Lexer to pull tokens from (must outlive the stream)
+     */
+    explicit TokenStream(Lexer& source);
+
+    /**
+     * @brief Construct a stream over already tokenized input
+     *
+     * @param sourceTokens Tokens to stream
+     */
+    explicit TokenStream(std::vector<Token> sourceTokens);
+
+    /**
+     * @brief Look at a token without consuming it
+     *
+     * @param ahead Offset from the current token (at most MAX_LOOKAHEAD)
+     * @return Token at the given offset
+     */
+    const Token& peek(size_t ahead = 0);
+
+    /**
+     * @brief Get the most recently consumed token
+     *
+     * @return Previous token
+     */
+    const Token& previous() const;
+
+    /**
+     * @brief Consume the current token
+     *
+     * @return The consumed token
+     */
+    const Token& advance();
+
+    /**
+     * @brief Check if the stream has reached the end of input
+     *
+     * @return true if the current token is EOF, false otherwise
+     */
+    bool isAtEnd();
+
+    /**
+     * @brief Measure the time spent pulling tokens from the lexer
+     *
+     * @param report Report whose clocks to use (nullptr to stop measuring)
+     */
+    void setTimeReport(const TimeReport* report);
+
+    /**
+     * @brief Get the time spent in the lexer
+     *
+     * @return Wall time and allocations of the lexer while measured (no CPU time)
+     */
+    const ResourceSample& getLexingCost() const;
+
+    /**
+     * @brief Drop the buffered tokens and continue at another position
+     *
+     * Used to skip input that was scanned separately. Only valid when the
+     * stream pulls from a lexer.
+     *
+     * @param lastToken Token to report as previous()
+     * @param state Lexer position just past lastToken
+     */
+    void skipTo(const Token& lastToken, const LexerState& state);
+
+    /**
+     * @brief Read a token sequence before the rest of the input
+     *
+     * Tokens already looked at but not consumed are read after the
+     * sequence.
+     *
+     * @param sequence Tokens to read (without an EOF token)
+     * @param origin Token the sequence replaces (macro name or INCLUDE directive)
+     * @param macro true for a macro expansion, false for an included file
+     */
+    void push(std::shared_ptr<const std::vector<Token>> sequence, const Token& origin, bool macro);
+
+    /**
+     * @brief Check whether pushed tokens are still to be read
+     *
+     * @return true while the stream reads pushed sequences
+     */
+    bool isExpanding() const;
+
+    /**
+     * @brief Get the number of macro expansions a token is nested in
+     *
+     * @param token Token read from this stream
+     * @return Macro expansion depth (0 for tokens outside macros)
+     */
+    size_t getMacroDepth(const Token& token) const;
+};
+
+} // namespace coil
+
+#endif // COIL_PARSER_TOKEN_STREAM_H
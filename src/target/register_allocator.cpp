@@ -0,0 +1,838 @@
+#include "target/register_allocator.h"
+#include "core/type.h"
+#include "parser/parser.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace coil {
+
+/**
+ * @brief How an instruction treats its first operand
+ */
+enum DestinationKind : uint8_t {
+    DEST_NONE,                   // Only read
+    DEST_WRITE,                  // Overwritten without being read
+    DEST_READ_WRITE              // Read, then written
+};
+
+/**
+ * @brief Basic block of a function's instruction stream
+ */
+struct BasicBlock {
+    size_t first;                // First instruction
+    size_t last;                 // One past the last instruction
+    size_t successors[2];        // Successor blocks
+    size_t successorCount;       // Number of successors
+    uint64_t use;                // Registers read before being written
+    uint64_t def;                // Registers written
+    uint64_t liveIn;             // Registers live on entry
+    uint64_t liveOut;            // Registers live on exit
+};
+
+static uint64_t vregBit(uint8_t vregId) {
+    return vregId < ALLOCATABLE_VREG_COUNT ? (1ull << vregId) : 0;
+}
+
+static uint8_t vregType(uint8_t vregId) {
+    if (vregId >= REG_V0) {
+        return REG_VEC;
+    } else if (vregId >= REG_F0) {
+        return REG_FP;
+    }
+    return REG_GP;
+}
+
+static bool isCall(const Instruction& inst) {
+    if (inst.getCategory() != CAT_CF) {
+        return false;
+    }
+    uint8_t operation = inst.getOperation();
+    return operation == CF_CALL || operation == CF_SYSC || operation == CF_INT;
+}
+
+static DestinationKind getDestinationKind(uint8_t category, uint8_t operation, size_t operandCount) {
+    switch (category) {
+        case CAT_MEM:
+            switch (operation) {
+                case MEM_MOV:
+                case MEM_LOAD:
+                case MEM_POP:
+                case MEM_IN:
+                    return DEST_WRITE;
+                case MEM_EXCHANGE:
+                    return DEST_READ_WRITE;
+                default:
+                    return DEST_NONE;
+            }
+
+        case CAT_MATH:
+            switch (operation) {
+                case MATH_ADD: case MATH_SUB: case MATH_MUL: case MATH_DIV:
+                case MATH_MOD: case MATH_MIN: case MATH_MAX:
+                    // Three-operand form: dest = src1 op src2
+                    return operandCount >= 3 ? DEST_WRITE : DEST_READ_WRITE;
+                case MATH_FMA:
+                    return operandCount >= 4 ? DEST_WRITE : DEST_READ_WRITE;
+                default:
+                    // Unary operations: dest = op src, or in place
+                    return operandCount >= 2 ? DEST_WRITE : DEST_READ_WRITE;
+            }
+
+        case CAT_BIT:
+            switch (operation) {
+                case BIT_AND: case BIT_OR: case BIT_XOR: case BIT_ANDN:
+                case BIT_ORN: case BIT_XNOR: case BIT_SHL: case BIT_SHR:
+                case BIT_SAR: case BIT_ROL: case BIT_ROR:
+                    return operandCount >= 3 ? DEST_WRITE : DEST_READ_WRITE;
+                case BIT_NOT: case BIT_BSWAP: case BIT_BITREV: case BIT_CLZ:
+                case BIT_CTZ: case BIT_POPCNT: case BIT_PARITY:
+                    return operandCount >= 2 ? DEST_WRITE : DEST_READ_WRITE;
+                case BIT_TST:
+                case BIT_CMP:
+                    return DEST_NONE;
+                default:
+                    return DEST_READ_WRITE;
+            }
+
+        case CAT_VEC:
+            switch (operation) {
+                case VEC_MOV: case VEC_LOAD: case VEC_SPLAT: case VEC_LANES:
+                    return DEST_WRITE;
+                case VEC_STORE:
+                    return DEST_NONE;
+                case VEC_SQRT:
+                    return operandCount >= 2 ? DEST_WRITE : DEST_READ_WRITE;
+                default:
+                    return operandCount >= 3 ? DEST_WRITE : DEST_READ_WRITE;
+            }
+
+        case CAT_ATM:
+            return DEST_READ_WRITE;
+
+        default:
+            return DEST_NONE;
+    }
+}
+
+/**
+ * @brief Collect the virtual registers an instruction reads and writes
+ *
+ * @param inst Instruction
+ * @param uses Registers read (output parameter)
+ * @param defs Registers written (output parameter)
+ */
+static void collectRegisters(const Instruction& inst, uint64_t& uses, uint64_t& defs) {
+    uses = 0;
+    defs = 0;
+
+    size_t count = inst.getOperandCount();
+    DestinationKind destination = getDestinationKind(inst.getCategory(), inst.getOperation(), count);
+
+    // Calls record their number of outputs in the last extended data byte
+    size_t firstOutput = count;
+    const auto& extended = inst.getExtendedData();
+    if (isCall(inst) && !extended.empty() && extended.back() <= count) {
+        firstOutput = count - extended.back();
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const OperandValue& value = inst.getOperandValue(i);
+
+        if (value.getClass() == OPERAND_REGISTER) {
+            uint64_t bit = vregBit(value.payload[0]);
+            if (i >= firstOutput || (i == 0 && destination == DEST_WRITE)) {
+                defs |= bit;
+            } else if (i == 0 && destination == DEST_READ_WRITE) {
+                uses |= bit;
+                defs |= bit;
+            } else {
+                uses |= bit;
+            }
+        } else if (value.getClass() == OPERAND_MEMORY) {
+            // Address registers are read, and updated by the increment forms
+            switch (value.getSubtype()) {
+                case MEM_REG:
+                case MEM_REG_DISP:
+                    uses |= vregBit(value.payload[0]);
+                    break;
+                case MEM_REG_REG:
+                case MEM_REG_REG_SCALE:
+                    uses |= vregBit(value.payload[0]) | vregBit(value.payload[1]);
+                    break;
+                case MEM_REG_PRE_INC:
+                case MEM_REG_PRE_DEC:
+                case MEM_REG_POST_INC:
+                case MEM_REG_POST_DEC:
+                    uses |= vregBit(value.payload[0]);
+                    defs |= vregBit(value.payload[0]);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Find the local label a branch jumps to
+ *
+ * @param inst Branch instruction
+ * @param labels Function labels
+ * @param target Index of the target instruction (output parameter)
+ * @return true if the branch targets a label of the function
+ */
+static bool findBranchTarget(const Instruction& inst, const std::map<std::string, size_t>& labels, size_t& target) {
+    for (size_t i = 0; i < inst.getOperandCount(); i++) {
+        const OperandValue& value = inst.getOperandValue(i);
+        if (value.getClass() != OPERAND_IMMEDIATE || value.getSubtype() != IMM_SYMBOL) {
+            continue;
+        }
+
+        size_t length;
+        const uint8_t* payload = inst.getOperandPayload(i, length);
+        std::string name(reinterpret_cast<const char*>(payload), length > 0 ? length - 1 : 0);
+        auto it = labels.find(name);
+        if (it != labels.end()) {
+            target = it->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t RegisterAllocation::getPhysicalRegister(uint8_t vregId) const {
+    for (const auto& mapping : mappings) {
+        if (mapping.vregId == vregId) {
+            return (mapping.flags & REG_MAPPING_SPILLED) ? PREG_NONE : mapping.pregId;
+        }
+    }
+    return PREG_NONE;
+}
+
+const SpillSlot* RegisterAllocation::getSpillSlot(uint8_t vregId) const {
+    for (const auto& slot : spillSlots) {
+        if (slot.vregId == vregId) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+const VariableSlot* RegisterAllocation::getVariableSlot(uint8_t varId) const {
+    auto it = std::lower_bound(variableSlots.begin(), variableSlots.end(), varId,
+                               [](const VariableSlot& slot, uint8_t id) { return slot.varId < id; });
+    return it != variableSlots.end() && it->varId == varId ? &*it : nullptr;
+}
+
+uint32_t RegisterAllocation::getVariableAreaOffset() const {
+    return (spillAreaSize + 15) & ~15u;
+}
+
+uint32_t RegisterAllocation::getFrameAreaSize() const {
+    return variableAreaSize > 0 ? getVariableAreaOffset() + variableAreaSize : spillAreaSize;
+}
+
+LinearScanAllocator::LinearScanAllocator() {
+    for (bool& present : hasPool) {
+        present = false;
+    }
+    std::memset(fixedRegisters, PREG_NONE, sizeof(fixedRegisters));
+    std::memset(entryRegisters, PREG_NONE, sizeof(entryRegisters));
+}
+
+void LinearScanAllocator::addPool(uint8_t regType, const RegisterPool& pool) {
+    if (regType > REG_VEC) {
+        return;
+    }
+    pools[regType] = pool;
+    hasPool[regType] = true;
+}
+
+void LinearScanAllocator::setFixedRegister(uint8_t vregId, uint8_t pregId) {
+    if (vregId < ALLOCATABLE_VREG_COUNT) {
+        fixedRegisters[vregId] = pregId;
+    }
+}
+
+void LinearScanAllocator::setEntryRegister(uint8_t vregId, uint8_t pregId) {
+    if (vregId < ALLOCATABLE_VREG_COUNT) {
+        entryRegisters[vregId] = pregId;
+    }
+}
+
+void LinearScanAllocator::addCallConvention(const std::string& abiName, const std::vector<uint8_t>& argRegs,
+                                            const std::vector<uint8_t>& retRegs) {
+    CallConvention convention = {abiName, 0, 0};
+    for (uint8_t vregId : argRegs) {
+        convention.uses |= vregBit(vregId);
+    }
+    for (uint8_t vregId : retRegs) {
+        convention.defs |= vregBit(vregId);
+    }
+    callConventions.push_back(convention);
+}
+
+void LinearScanAllocator::computeIntervals(const Function& func, std::vector<uint32_t>& callPositions) {
+    const auto& instructions = func.getInstructions();
+    const auto& labels = func.getLabels();
+    size_t count = instructions.size();
+
+    // Registers read and written by each instruction
+    std::vector<uint64_t> uses(count), defs(count);
+    for (size_t i = 0; i < count; i++) {
+        const Instruction& inst = *instructions[i];
+        collectRegisters(inst, uses[i], defs[i]);
+        if (!isCall(inst)) {
+            continue;
+        }
+        callPositions.push_back(static_cast<uint32_t>(i));
+
+        // A call naming an ABI also uses its argument and return registers
+        if (inst.getOperandCount() > 0 && inst.getOperandValue(0).getClass() == OPERAND_IMMEDIATE &&
+            inst.getOperandValue(0).getSubtype() == IMM_SYMBOL) {
+            size_t length;
+            const uint8_t* payload = inst.getOperandPayload(0, length);
+            std::string name(reinterpret_cast<const char*>(payload), length > 0 ? length - 1 : 0);
+            for (const auto& convention : callConventions) {
+                if (convention.abiName == name) {
+                    uses[i] |= convention.uses;
+                    defs[i] |= convention.defs;
+                }
+            }
+        }
+    }
+
+    // Blocks start at the entry, at branch targets and after control transfers
+    std::vector<bool> leaders(count + 1, false);
+    leaders[0] = true;
+    for (size_t i = 0; i < count; i++) {
+        const Instruction& inst = *instructions[i];
+        if (inst.getCategory() != CAT_CF) {
+            continue;
+        }
+
+        size_t target;
+        switch (inst.getOperation()) {
+            case CF_BR:
+            case CF_BRC:
+                if (findBranchTarget(inst, labels, target) && target < count) {
+                    leaders[target] = true;
+                }
+                leaders[i + 1] = true;
+                break;
+            case CF_RET:
+            case CF_IRET:
+            case CF_HLT:
+                leaders[i + 1] = true;
+                break;
+            default:
+                break;
+        }
+    }
+
+    std::vector<BasicBlock> blocks;
+    std::vector<size_t> blockOf(count + 1, SIZE_MAX);
+    for (size_t i = 0; i < count; i++) {
+        if (leaders[i]) {
+            if (!blocks.empty()) {
+                blocks.back().last = i;
+            }
+            BasicBlock block = {};
+            block.first = i;
+            blocks.push_back(block);
+        }
+        blockOf[i] = blocks.size() - 1;
+    }
+    if (!blocks.empty()) {
+        blocks.back().last = count;
+    }
+
+    for (auto& block : blocks) {
+        // Local use and def sets
+        for (size_t i = block.first; i < block.last; i++) {
+            block.use |= uses[i] & ~block.def;
+            block.def |= defs[i];
+        }
+
+        // Successors; a branch to a label past the last instruction leaves the function
+        const Instruction& lastInst = *instructions[block.last - 1];
+        bool fallsThrough = true;
+        size_t target;
+        if (lastInst.getCategory() == CAT_CF) {
+            switch (lastInst.getOperation()) {
+                case CF_BR:
+                    fallsThrough = false;
+                    [[fallthrough]];
+                case CF_BRC:
+                    if (findBranchTarget(lastInst, labels, target) && target < count) {
+                        block.successors[block.successorCount++] = blockOf[target];
+                    }
+                    break;
+                case CF_RET:
+                case CF_IRET:
+                case CF_HLT:
+                    fallsThrough = false;
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (fallsThrough && block.last < count) {
+            block.successors[block.successorCount++] = blockOf[block.last];
+        }
+    }
+
+    // Backward dataflow to a fixpoint
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t b = blocks.size(); b-- > 0;) {
+            BasicBlock& block = blocks[b];
+            uint64_t liveOut = 0;
+            for (size_t s = 0; s < block.successorCount; s++) {
+                liveOut |= blocks[block.successors[s]].liveIn;
+            }
+            uint64_t liveIn = block.use | (liveOut & ~block.def);
+            if (liveIn != block.liveIn || liveOut != block.liveOut) {
+                block.liveIn = liveIn;
+                block.liveOut = liveOut;
+                changed = true;
+            }
+        }
+    }
+
+    // Each register's interval covers every position it is live at
+    uint32_t starts[ALLOCATABLE_VREG_COUNT];
+    uint32_t ends[ALLOCATABLE_VREG_COUNT];
+    std::fill(std::begin(starts), std::end(starts), UINT32_MAX);
+    std::fill(std::begin(ends), std::end(ends), 0);
+
+    auto touch = [&](uint64_t registers, uint32_t position) {
+        while (registers) {
+            int vreg = __builtin_ctzll(registers);
+            registers &= registers - 1;
+            starts[vreg] = std::min(starts[vreg], position);
+            ends[vreg] = std::max(ends[vreg], position);
+        }
+    };
+
+    for (const auto& block : blocks) {
+        touch(block.liveIn, static_cast<uint32_t>(2 * block.first));
+        touch(block.liveOut, static_cast<uint32_t>(2 * (block.last - 1) + 1));
+        for (size_t i = block.first; i < block.last; i++) {
+            touch(uses[i], static_cast<uint32_t>(2 * i));
+            touch(defs[i], static_cast<uint32_t>(2 * i + 1));
+        }
+    }
+
+    // Registers read before they are written arrive in their entry register
+    uint64_t liveOnEntry = blocks.empty() ? 0 : blocks.front().liveIn;
+
+    for (uint8_t vreg = 0; vreg < ALLOCATABLE_VREG_COUNT; vreg++) {
+        if (starts[vreg] == UINT32_MAX) {
+            continue;
+        }
+
+        LiveInterval interval;
+        interval.vregId = vreg;
+        interval.pregId = fixedRegisters[vreg];
+        if (interval.pregId == PREG_NONE && (liveOnEntry & (1ull << vreg))) {
+            interval.pregId = entryRegisters[vreg];
+        }
+        interval.fixed = interval.pregId != PREG_NONE;
+        interval.start = starts[vreg];
+        interval.end = ends[vreg];
+
+        // Live across a call if live both before and after it
+        auto call = std::lower_bound(callPositions.begin(), callPositions.end(), (interval.start + 1) / 2);
+        interval.crossesCall = call != callPositions.end() && 2 * *call + 1 < interval.end;
+
+        intervals.push_back(interval);
+    }
+
+    std::sort(intervals.begin(), intervals.end(), [](const LiveInterval& a, const LiveInterval& b) {
+        return a.start != b.start ? a.start < b.start : a.vregId < b.vregId;
+    });
+}
+
+RegisterAllocation LinearScanAllocator::allocate(const Function& func) {
+    intervals.clear();
+    std::vector<uint32_t> callPositions;
+    computeIntervals(func, callPositions);
+
+    // Checks whether a precolored interval claims a register during [start, end]
+    auto fixedOverlap = [&](uint8_t pregId, const LiveInterval& current) {
+        for (const auto& interval : intervals) {
+            if (interval.fixed && interval.pregId == pregId &&
+                interval.start <= current.end && interval.end >= current.start) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::vector<size_t> active;
+    uint64_t occupied = 0;
+
+    for (size_t index = 0; index < intervals.size(); index++) {
+        LiveInterval& current = intervals[index];
+
+        // Release the registers of intervals that have ended
+        for (size_t a = 0; a < active.size();) {
+            const LiveInterval& interval = intervals[active[a]];
+            if (interval.end < current.start) {
+                if (interval.pregId < 64) {
+                    occupied &= ~(1ull << interval.pregId);
+                }
+                active[a] = active.back();
+                active.pop_back();
+            } else {
+                a++;
+            }
+        }
+
+        if (current.fixed) {
+            if (current.pregId < 64) {
+                occupied |= 1ull << current.pregId;
+            }
+            active.push_back(index);
+            continue;
+        }
+
+        uint8_t type = vregType(current.vregId);
+        if (!hasPool[type]) {
+            continue;
+        }
+        const RegisterPool& pool = pools[type];
+
+        auto eligible = [&](uint8_t pregId) {
+            return pregId < 64 && !(current.crossesCall && (pool.volatileMask & (1ull << pregId)));
+        };
+
+        // Prefer volatile registers unless the interval has to survive a call
+        uint8_t chosen = PREG_NONE;
+        for (int pass = current.crossesCall ? 1 : 0; pass < 2 && chosen == PREG_NONE; pass++) {
+            for (uint8_t pregId : pool.registers) {
+                if (!eligible(pregId) || (occupied & (1ull << pregId))) {
+                    continue;
+                }
+                bool isVolatile = (pool.volatileMask & (1ull << pregId)) != 0;
+                if ((pass == 0) != isVolatile) {
+                    continue;
+                }
+                if (!fixedOverlap(pregId, current)) {
+                    chosen = pregId;
+                    break;
+                }
+            }
+        }
+
+        if (chosen != PREG_NONE) {
+            current.pregId = chosen;
+            occupied |= 1ull << chosen;
+            active.push_back(index);
+            continue;
+        }
+
+        // No register free: spill whichever interval ends last
+        size_t victim = SIZE_MAX;
+        for (size_t a = 0; a < active.size(); a++) {
+            const LiveInterval& interval = intervals[active[a]];
+            if (interval.fixed || !eligible(interval.pregId) ||
+                std::find(pool.registers.begin(), pool.registers.end(), interval.pregId) == pool.registers.end() ||
+                fixedOverlap(interval.pregId, current)) {
+                continue;
+            }
+            if (victim == SIZE_MAX || interval.end > intervals[active[victim]].end) {
+                victim = a;
+            }
+        }
+
+        if (victim != SIZE_MAX && intervals[active[victim]].end > current.end) {
+            LiveInterval& spilled = intervals[active[victim]];
+            current.pregId = spilled.pregId;
+            spilled.pregId = PREG_NONE;
+            active[victim] = index;
+        }
+    }
+
+    RegisterAllocation allocation;
+
+    // Spilled intervals share a slot when they do not overlap
+    struct Slot {
+        uint8_t size;
+        uint32_t offset;
+        uint32_t freeAfter;
+    };
+    std::vector<Slot> slots;
+
+    for (const auto& interval : intervals) {
+        uint8_t type = vregType(interval.vregId);
+        const RegisterPool* pool = hasPool[type] ? &pools[type] : nullptr;
+        if (!pool && !interval.fixed) {
+            continue;
+        }
+        uint8_t registerClass = pool ? pool->registerClass : 0;
+
+        if (interval.pregId != PREG_NONE) {
+            allocation.mappings.push_back({interval.vregId, interval.pregId, registerClass});
+
+            // Preserved registers the function writes are saved by its prologue
+            if (pool && !(pool->volatileMask & (1ull << interval.pregId)) &&
+                std::find(pool->registers.begin(), pool->registers.end(), interval.pregId) != pool->registers.end() &&
+                std::find(allocation.savedRegisters.begin(), allocation.savedRegisters.end(), interval.pregId) ==
+                    allocation.savedRegisters.end()) {
+                allocation.savedRegisters.push_back(interval.pregId);
+            }
+            continue;
+        }
+
+        allocation.mappings.push_back({interval.vregId, PREG_NONE, registerClass, REG_MAPPING_SPILLED});
+
+        Slot* slot = nullptr;
+        for (auto& candidate : slots) {
+            if (candidate.size == pool->slotSize && candidate.freeAfter < interval.start) {
+                slot = &candidate;
+                break;
+            }
+        }
+        if (!slot) {
+            uint32_t offset = (allocation.spillAreaSize + pool->slotSize - 1) / pool->slotSize * pool->slotSize;
+            slots.push_back({pool->slotSize, offset, 0});
+            slot = &slots.back();
+            allocation.spillAreaSize = offset + pool->slotSize;
+        }
+        slot->freeAfter = interval.end;
+        allocation.spillSlots.push_back({interval.vregId, slot->size, slot->offset});
+    }
+
+    std::sort(allocation.mappings.begin(), allocation.mappings.end(),
+              [](const RegisterMapping& a, const RegisterMapping& b) { return a.vregId < b.vregId; });
+    std::sort(allocation.savedRegisters.begin(), allocation.savedRegisters.end());
+
+    return allocation;
+}
+
+const std::vector<LiveInterval>& LinearScanAllocator::getIntervals() const {
+    return intervals;
+}
+
+/**
+ * @brief Work out how much storage a variable of a type needs
+ *
+ * Variables without a type hold a 64-bit value, as do pointers.
+ *
+ * @param typeId Variable type, as recorded by VAR DECL
+ * @param interval Interval to fill in the size, alignment and scalar flag of
+ */
+static void setVariableStorage(uint8_t typeId, VariableInterval& interval) {
+    if (typeId >= TYPE_VEC128 && typeId <= TYPE_VEC512) {
+        interval.size = 16u << (typeId - TYPE_VEC128);
+        interval.alignment = interval.size;
+        interval.scalar = false;
+        return;
+    }
+
+    Type type = Type::fromBasicType(typeId);
+    if ((typeId & TYPE_PTR) || type.getSize() == 0) {
+        interval.size = 8;
+        interval.alignment = 8;
+        interval.scalar = true;
+        return;
+    }
+
+    interval.size = type.getSize();
+    interval.alignment = type.getAlignment();
+    interval.scalar = (typeId >= TYPE_INT8 && typeId <= TYPE_INT64) || (typeId >= TYPE_UINT8 && typeId <= TYPE_UINT64);
+}
+
+FrameLayout::FrameLayout(uint32_t minimumSlotSize, uint32_t stackAlignment)
+    : minSlotSize(minimumSlotSize ? minimumSlotSize : 1), maxAlignment(stackAlignment ? stackAlignment : 1) {
+}
+
+void FrameLayout::computeIntervals(const Function& func, std::vector<uint32_t>& callPositions) {
+    const auto& instructions = func.getInstructions();
+    const auto& labels = func.getLabels();
+    uint32_t last = instructions.empty() ? 0 : static_cast<uint32_t>(instructions.size() - 1);
+
+    // Where each variable is named, and the loops the code contains
+    std::vector<int> index(256, -1);
+    std::vector<std::pair<uint32_t, uint32_t>> loops;
+    for (size_t i = 0; i < instructions.size(); i++) {
+        const Instruction& inst = *instructions[i];
+        uint32_t position = static_cast<uint32_t>(i);
+        if (isCall(inst)) {
+            callPositions.push_back(position);
+        }
+
+        size_t target;
+        if (inst.getCategory() == CAT_CF && (inst.getOperation() == CF_BR || inst.getOperation() == CF_BRC) &&
+            findBranchTarget(inst, labels, target) && target <= i) {
+            loops.push_back({static_cast<uint32_t>(target), position});
+        }
+
+        for (size_t o = 0; o < inst.getOperandCount(); o++) {
+            const OperandValue& value = inst.getOperandValue(o);
+            if (value.getClass() != OPERAND_VARIABLE) {
+                continue;
+            }
+
+            uint8_t varId = value.payload[0];
+            if (index[varId] < 0) {
+                VariableInterval interval = {};
+                interval.varId = varId;
+                interval.start = position;
+                setVariableStorage(func.getVariableType(varId), interval);
+                index[varId] = static_cast<int>(intervals.size());
+                intervals.push_back(interval);
+            }
+
+            VariableInterval& interval = intervals[index[varId]];
+            interval.end = position;
+            if (value.getSubtype() != VAR_DIRECT) {
+                interval.addressTaken = true;
+            }
+            if (inst.getCategory() == CAT_VAR && inst.getOperation() == VAR_PMT) {
+                interval.end = last;
+            }
+        }
+    }
+
+    for (auto& interval : intervals) {
+        // Once its address is out, a variable may be reached at any time
+        if (interval.addressTaken) {
+            interval.start = 0;
+            interval.end = last;
+        }
+
+        // A value live anywhere in a loop is live for the whole loop, which
+        // may bring it into an enclosing one
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (const auto& loop : loops) {
+                if (interval.start <= loop.second && interval.end >= loop.first &&
+                    (interval.start > loop.first || interval.end < loop.second)) {
+                    interval.start = std::min(interval.start, loop.first);
+                    interval.end = std::max(interval.end, loop.second);
+                    changed = true;
+                }
+            }
+        }
+
+        // Live across a call if live both before and after it
+        auto call = std::upper_bound(callPositions.begin(), callPositions.end(), interval.start);
+        interval.crossesCall = call != callPositions.end() && *call < interval.end;
+    }
+
+    std::sort(intervals.begin(), intervals.end(), [](const VariableInterval& a, const VariableInterval& b) {
+        return a.start != b.start ? a.start < b.start : a.varId < b.varId;
+    });
+}
+
+void FrameLayout::layout(const Function& func, const RegisterPool* pool, RegisterAllocation& allocation) {
+    intervals.clear();
+    allocation.variableSlots.clear();
+    allocation.variableAreaSize = 0;
+    std::vector<uint32_t> callPositions;
+    computeIntervals(func, callPositions);
+
+    // Registers no virtual register of the function uses are free for variables
+    uint64_t taken = 0;
+    for (const auto& mapping : allocation.mappings) {
+        if (!(mapping.flags & REG_MAPPING_SPILLED) && mapping.pregId < 64) {
+            taken |= 1ull << mapping.pregId;
+        }
+    }
+
+    // Linear scan over the scalar variables; those left over go to the stack
+    std::vector<uint8_t> assigned(intervals.size(), PREG_NONE);
+    std::vector<uint32_t> busyUntil(64, 0);
+    uint64_t used = 0;
+    for (size_t i = 0; pool && i < intervals.size(); i++) {
+        const VariableInterval& interval = intervals[i];
+        if (!interval.scalar || interval.addressTaken) {
+            continue;
+        }
+
+        // Prefer volatile registers unless the variable has to survive a call
+        for (int pass = interval.crossesCall ? 1 : 0; pass < 2 && assigned[i] == PREG_NONE; pass++) {
+            for (uint8_t pregId : pool->registers) {
+                bool isVolatile = (pool->volatileMask & (1ull << pregId)) != 0;
+                if (pregId >= 64 || (taken & (1ull << pregId)) || (pass == 0) != isVolatile ||
+                    ((used & (1ull << pregId)) && busyUntil[pregId] >= interval.start)) {
+                    continue;
+                }
+                assigned[i] = pregId;
+                busyUntil[pregId] = interval.end;
+                used |= 1ull << pregId;
+                break;
+            }
+        }
+    }
+
+    // Stack slots, largest alignment first, each at the lowest offset that
+    // no variable live at the same time occupies
+    std::vector<size_t> order;
+    for (size_t i = 0; i < intervals.size(); i++) {
+        if (assigned[i] == PREG_NONE) {
+            VariableInterval& interval = intervals[i];
+            interval.size = std::max(interval.size, minSlotSize);
+            interval.alignment = std::min(std::max(interval.alignment, minSlotSize), maxAlignment);
+            order.push_back(i);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        const VariableInterval& first = intervals[a];
+        const VariableInterval& second = intervals[b];
+        return first.alignment != second.alignment ? first.alignment > second.alignment : first.size > second.size;
+    });
+
+    std::vector<uint32_t> offsets(intervals.size(), 0);
+    for (size_t placed = 0; placed < order.size(); placed++) {
+        const VariableInterval& current = intervals[order[placed]];
+        uint32_t offset = 0;
+        bool moved = true;
+        while (moved) {
+            moved = false;
+            for (size_t p = 0; p < placed; p++) {
+                const VariableInterval& other = intervals[order[p]];
+                uint32_t otherOffset = offsets[order[p]];
+                if (other.start <= current.end && other.end >= current.start &&
+                    otherOffset < offset + current.size && offset < otherOffset + other.size) {
+                    offset = (otherOffset + other.size + current.alignment - 1) / current.alignment * current.alignment;
+                    moved = true;
+                }
+            }
+        }
+        offsets[order[placed]] = offset;
+        allocation.variableAreaSize = std::max(allocation.variableAreaSize, offset + current.size);
+    }
+
+    for (size_t i = 0; i < intervals.size(); i++) {
+        uint8_t pregId = assigned[i];
+        if (pregId == PREG_NONE) {
+            allocation.variableSlots.push_back({intervals[i].varId, PREG_NONE, intervals[i].size, offsets[i]});
+            continue;
+        }
+        allocation.variableSlots.push_back({intervals[i].varId, pregId, 0, 0});
+
+        // Preserved registers the variables use are saved by the prologue
+        if (!(pool->volatileMask & (1ull << pregId)) &&
+            std::find(allocation.savedRegisters.begin(), allocation.savedRegisters.end(), pregId) ==
+                allocation.savedRegisters.end()) {
+            allocation.savedRegisters.push_back(pregId);
+        }
+    }
+
+    std::sort(allocation.variableSlots.begin(), allocation.variableSlots.end(),
+              [](const VariableSlot& a, const VariableSlot& b) { return a.varId < b.varId; });
+    std::sort(allocation.savedRegisters.begin(), allocation.savedRegisters.end());
+}
+
+const std::vector<VariableInterval>& FrameLayout::getIntervals() const {
+    return intervals;
+}
+
+} // namespace coil
@@ -0,0 +1,297 @@
+#ifndef COIL_TARGET_REGISTER_ALLOCATOR_H
+#define COIL_TARGET_REGISTER_ALLOCATOR_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "core/defs.h"
+#include "target/target.h"
+
+namespace coil {
+
+class Function;
+
+/**
+ * @brief Number of virtual registers tracked by the allocator (R, F and V)
+ */
+constexpr uint8_t ALLOCATABLE_VREG_COUNT = 0x30;
+
+/**
+ * @brief Physical register ID of a spilled virtual register
+ */
+constexpr uint8_t PREG_NONE = 0xFF;
+
+/**
+ * @brief Stack slot holding a spilled virtual register
+ */
+struct SpillSlot {
+    uint8_t vregId;              // Spilled virtual register
+    uint8_t size;                // Slot size in bytes
+    uint32_t offset;             // Offset of the slot within the spill area
+};
+
+/**
+ * @brief Register or stack slot holding a VAR variable
+ */
+struct VariableSlot {
+    uint8_t varId;               // Variable ID
+    uint8_t pregId;              // Physical register, or PREG_NONE for a stack slot
+    uint32_t size;               // Slot size in bytes (0 in a register)
+    uint32_t offset;             // Offset of the slot within the variable area
+};
+
+/**
+ * @brief Result of allocating registers for one function
+ */
+struct RegisterAllocation {
+    std::vector<RegisterMapping> mappings;  // One mapping per live virtual register
+    std::vector<SpillSlot> spillSlots;      // Slots of the spilled registers
+    std::vector<VariableSlot> variableSlots; // Locations of the variables, by variable ID
+    std::vector<uint8_t> savedRegisters;    // Preserved physical registers the function writes
+    uint32_t spillAreaSize;                 // Bytes needed for the spill slots
+    uint32_t variableAreaSize;              // Bytes needed for the variables' stack slots
+
+    RegisterAllocation() : spillAreaSize(0), variableAreaSize(0) {}
+
+    /**
+     * @brief Get the physical register assigned to a virtual register
+     *
+     * @param vregId Virtual register ID
+     * @return Physical register ID, or PREG_NONE if it is spilled or unused
+     */
+    uint8_t getPhysicalRegister(uint8_t vregId) const;
+
+    /**
+     * @brief Get the spill slot of a virtual register
+     *
+     * @param vregId Virtual register ID
+     * @return Spill slot, or nullptr if the register is not spilled
+     */
+    const SpillSlot* getSpillSlot(uint8_t vregId) const;
+
+    /**
+     * @brief Get the location of a variable
+     *
+     * @param varId Variable ID
+     * @return Location, or nullptr if the function does not use the variable
+     */
+    const VariableSlot* getVariableSlot(uint8_t varId) const;
+
+    /**
+     * @brief Get the offset of the variable area within the frame area
+     *
+     * The variable area follows the spill slots, 16-byte aligned.
+     *
+     * @return Offset in bytes
+     */
+    uint32_t getVariableAreaOffset() const;
+
+    /**
+     * @brief Get the size of the spill slots and variable slots together
+     *
+     * @return Size in bytes
+     */
+    uint32_t getFrameAreaSize() const;
+};
+
+/**
+ * @brief Physical registers available to one class of virtual registers
+ */
+struct RegisterPool {
+    uint8_t registerClass;                  // Physical register class
+    std::vector<uint8_t> registers;         // Allocatable registers, in order of preference
+    uint64_t volatileMask;                  // Bit per physical register clobbered by calls
+    uint8_t slotSize;                       // Spill slot size in bytes
+
+    RegisterPool() : registerClass(0), volatileMask(0), slotSize(8) {}
+};
+
+/**
+ * @brief Registers a call reads and writes because of the ABI it names
+ */
+struct CallConvention {
+    std::string abiName;                    // ABI named by the call's first operand
+    uint64_t uses;                          // Bit per argument register
+    uint64_t defs;                          // Bit per return register
+};
+
+/**
+ * @brief Live range of a virtual register
+ *
+ * Positions count two per instruction: instruction i reads its operands
+ * at 2i and writes its results at 2i+1. Holes are not tracked, so the
+ * interval runs from the first to the last position the register is live.
+ */
+struct LiveInterval {
+    uint8_t vregId;              // Virtual register ID
+    uint8_t pregId;              // Assigned physical register, or PREG_NONE
+    bool fixed;                  // Precolored to pregId
+    bool crossesCall;            // Live across an instruction that clobbers volatile registers
+    uint32_t start;              // First live position
+    uint32_t end;                // Last live position
+};
+
+/**
+ * @brief Liveness-based linear-scan register allocator
+ *
+ * Computes virtual register liveness over the function's control flow
+ * graph, then walks the live intervals in order of their start, giving
+ * each a free register from its class's pool and spilling the interval
+ * that ends last when none is free. Intervals live across a call only
+ * get registers the pool does not mark volatile, and the others prefer
+ * volatile registers so that preserved ones need saving less often.
+ *
+ * Physical register IDs must be below 64. Pools may share registers
+ * (FP and vector registers both use XMM on x86-64).
+ */
+class LinearScanAllocator {
+private:
+    RegisterPool pools[REG_VEC + 1];        // Pools by virtual register type
+    bool hasPool[REG_VEC + 1];              // Whether a pool was added for the type
+    uint8_t fixedRegisters[ALLOCATABLE_VREG_COUNT]; // Precolored registers, or PREG_NONE
+    uint8_t entryRegisters[ALLOCATABLE_VREG_COUNT]; // Registers that hold values live on entry, or PREG_NONE
+    std::vector<CallConvention> callConventions;    // ABIs that calls may name
+    std::vector<LiveInterval> intervals;    // Intervals of the last allocation
+
+    void computeIntervals(const Function& func, std::vector<uint32_t>& callPositions);
+
+public:
+    /**
+     * @brief Construct an allocator without pools
+     */
+    LinearScanAllocator();
+
+    /**
+     * @brief Set the registers for a type of virtual register
+     *
+     * @param regType Virtual register type (REG_GP, REG_FP or REG_VEC)
+     * @param pool Physical registers to allocate from
+     */
+    void addPool(uint8_t regType, const RegisterPool& pool);
+
+    /**
+     * @brief Require a virtual register to live in a given physical register
+     *
+     * Used for registers whose location is fixed by the ABI or the
+     * target, such as the stack and frame pointers and call arguments.
+     *
+     * @param vregId Virtual register ID
+     * @param pregId Physical register ID
+     */
+    void setFixedRegister(uint8_t vregId, uint8_t pregId);
+
+    /**
+     * @brief Say where a virtual register is if it is live on entry
+     *
+     * A register the function reads before writing it is an input, so it
+     * is precolored to the register the caller left it in. Registers that
+     * are not live on entry are allocated normally.
+     *
+     * @param vregId Virtual register ID
+     * @param pregId Physical register ID
+     */
+    void setEntryRegister(uint8_t vregId, uint8_t pregId);
+
+    /**
+     * @brief Treat an ABI's argument and return registers as operands of
+     *        the calls that name it
+     *
+     * Calls such as CF SYSC abi (0x01) -> (R0) pass their arguments in
+     * registers that the instruction does not list.
+     *
+     * @param abiName ABI name
+     * @param argRegs Argument registers
+     * @param retRegs Return registers
+     */
+    void addCallConvention(const std::string& abiName, const std::vector<uint8_t>& argRegs,
+                           const std::vector<uint8_t>& retRegs);
+
+    /**
+     * @brief Allocate registers for a function
+     *
+     * @param func Function to allocate registers for
+     * @return Register assignment and spill slots
+     */
+    RegisterAllocation allocate(const Function& func);
+
+    /**
+     * @brief Get the live intervals of the last allocation
+     *
+     * @return Intervals ordered by start
+     */
+    const std::vector<LiveInterval>& getIntervals() const;
+};
+
+/**
+ * @brief Live range of a VAR variable
+ *
+ * Positions are instruction indices. The range runs from the first to the
+ * last instruction that names the variable, and takes in every loop it
+ * overlaps; VAR PMT keeps a variable to the end of the function.
+ */
+struct VariableInterval {
+    uint8_t varId;               // Variable ID
+    uint32_t size;               // Slot size in bytes
+    uint32_t alignment;          // Slot alignment in bytes
+    bool scalar;                 // Integer or pointer that fits a general-purpose register
+    bool addressTaken;           // Referenced other than directly, so it lives in memory throughout
+    bool crossesCall;            // Live across an instruction that clobbers volatile registers
+    uint32_t start;              // First live position
+    uint32_t end;                // Last live position
+};
+
+/**
+ * @brief Lays out the VAR variables of a function
+ *
+ * Runs after register allocation. Integer and pointer variables get a
+ * general-purpose register that no virtual register of the function uses,
+ * shared between variables whose live ranges do not overlap. The others
+ * get stack slots, placed largest alignment first at the lowest offset
+ * that no overlapping variable occupies, so variables that are never live
+ * at the same time share memory and the frame stays small.
+ */
+class FrameLayout {
+private:
+    uint32_t minSlotSize;                   // Smallest slot size and alignment
+    uint32_t maxAlignment;                  // Largest alignment the frame provides
+    std::vector<VariableInterval> intervals; // Intervals of the last layout
+
+    void computeIntervals(const Function& func, std::vector<uint32_t>& callPositions);
+
+public:
+    /**
+     * @brief Construct a frame layout
+     *
+     * @param minimumSlotSize Smallest slot, for targets that always access
+     *                        variables at a given width
+     * @param stackAlignment Alignment of the frame; slots are aligned to at
+     *                       most this
+     */
+    explicit FrameLayout(uint32_t minimumSlotSize = 1, uint32_t stackAlignment = 16);
+
+    /**
+     * @brief Lay out the variables of a function
+     *
+     * Fills in the variable slots and variable area size of the allocation,
+     * and adds the preserved registers that variables use to its saved
+     * registers.
+     *
+     * @param func Function whose variables to lay out
+     * @param pool Registers variables may use (nullptr to keep every
+     *             variable on the stack)
+     * @param allocation Register allocation of the function (updated)
+     */
+    void layout(const Function& func, const RegisterPool* pool, RegisterAllocation& allocation);
+
+    /**
+     * @brief Get the variable intervals of the last layout
+     *
+     * @return Intervals ordered by start
+     */
+    const std::vector<VariableInterval>& getIntervals() const;
+};
+
+} // namespace coil
+
+#endif // COIL_TARGET_REGISTER_ALLOCATOR_H
@@ -1,11 +1,13 @@
 #include "target/target.h"
 #include "target/x86_64.h"
+#include "parser/parser.h"
+#include "util/logger.h"
 #include <algorithm>
 
 namespace coil {
 
 Target::Target(uint32_t targetId, uint8_t aClass, uint8_t aType, uint8_t wSize, uint8_t end, const std::string& targetName)
-    : id(targetId), archClass(aClass), archType(aType), wordSize(wSize), endianness(end), features(0), extensions(0), defaultAbiId(0), name(targetName) {
+    : id(targetId), archClass(aClass), archType(aType), wordSize(wSize), endianness(end), features(0), extensions(0), defaultAbiId(0), abi(nullptr), name(targetName) {
 }
 
 uint32_t Target::getId() const {
@@ -60,10 +62,46 @@ uint32_t Target::getDefaultAbiId() const {
     return defaultAbiId;
 }
 
+void Target::setAbi(const AbiDefinition* abiDef) {
+    abi = abiDef;
+}
+
+const AbiDefinition* Target::getAbi() const {
+    return abi;
+}
+
+void Target::addKnownAbi(const AbiDefinition* abiDef) {
+    // A later definition with the same name replaces the earlier one
+    for (const AbiDefinition*& known : knownAbis) {
+        if (known->name == abiDef->name) {
+            known = abiDef;
+            return;
+        }
+    }
+    knownAbis.push_back(abiDef);
+}
+
+const AbiDefinition* Target::findAbi(const std::string& abiName) const {
+    for (const AbiDefinition* known : knownAbis) {
+        if (known->name == abiName) {
+            return known;
+        }
+    }
+    return nullptr;
+}
+
 const std::string& Target::getName() const {
     return name;
 }
 
+bool Target::encodeFunction(const Function& func, std::vector<uint8_t>& code,
+                            std::vector<CodeRelocation>& relocations) const {
+    (void)code;
+    (void)relocations;
+    LOG_ERROR("Target {} cannot generate machine code for {}", name, func.getName());
+    return false;
+}
+
 uint8_t Target::getPhysicalRegister(uint8_t vregId) const {
     // Find the mapping for the virtual register
     auto it = std::find_if(regMappings.begin(), regMappings.end(),
@@ -98,4 +136,30 @@ std::unique_ptr<Target> Target::createFromArchType(uint32_t targetId, uint8_t ar
     }
 }
 
+std::unique_ptr<Target> Target::createFromName(uint32_t targetId, const std::string& targetName) {
+    // Features follow the architecture, separated by '+' (x86-64+avx2+bmi2)
+    size_t plus = targetName.find('+');
+    std::string arch = targetName.substr(0, plus);
+    
+    // SSE2 is part of the x86-64 baseline; the microarchitecture levels
+    // (x86-64-v2 to v4) add the features their psABI level requires
+    uint32_t features = X86_64_FEATURE_SSE | X86_64_FEATURE_SSE2;
+    if (arch == "x86-64" || arch == "x86_64") {
+        // Baseline only
+    } else if (arch == "x86-64-v2") {
+        X86_64Target::parseFeatures("sse4.2+popcnt", features);
+    } else if (arch == "x86-64-v3") {
+        X86_64Target::parseFeatures("avx2+bmi1+bmi2+fma+lzcnt+movbe+popcnt", features);
+    } else if (arch == "x86-64-v4") {
+        X86_64Target::parseFeatures("avx512f+bmi1+bmi2+lzcnt+movbe+popcnt", features);
+    } else {
+        return nullptr;
+    }
+    
+    if (plus != std::string::npos && !X86_64Target::parseFeatures(targetName.substr(plus + 1), features)) {
+        return nullptr;
+    }
+    return std::make_unique<X86_64Target>(targetId, features, targetName);
+}
+
 } // namespace coil
\ No newline at end of file
@@ -14,6 +14,14 @@ namespace coil {
 
 class Instruction;
 class Function;
+struct AbiDefinition;
+
+/**
+ * @brief Register mapping flags
+ */
+enum RegisterMappingFlag : uint8_t {
+    REG_MAPPING_SPILLED = 0x01      // Register lives in a stack slot
+};
 
 /**
  * @brief Register mapping
@@ -28,6 +36,16 @@ struct RegisterMapping {
         : vregId(vId), pregId(pId), pregClass(pClass), flags(flg) {}
 };
 
+/**
+ * @brief Relocation in code generated for a function
+ */
+struct CodeRelocation {
+    uint32_t offset;        // Offset of the patched field within the function's code
+    uint32_t type;          // Target-specific relocation type
+    int64_t addend;         // Constant added to the symbol's address
+    std::string symbol;     // Referenced symbol
+};
+
 /**
  * @brief Target architecture base class
  * 
@@ -44,6 +62,8 @@ protected:
     uint32_t extensions;            // Extension flags
     std::vector<RegisterMapping> regMappings; // Register mappings
     uint32_t defaultAbiId;          // Default ABI ID
+    const AbiDefinition* abi;       // Calling convention of the code being compiled, or nullptr
+    std::vector<const AbiDefinition*> knownAbis; // ABIs that calls and system calls may name
     std::string name;               // Target name
     
 public:
@@ -155,6 +175,35 @@ public:
      */
     uint32_t getDefaultAbiId() const;
     
+    /**
+     * @brief Set the calling convention to allocate registers for
+     * 
+     * @param abiDef ABI definition (must outlive its use), or nullptr for the target's default
+     */
+    void setAbi(const AbiDefinition* abiDef);
+    
+    /**
+     * @brief Get the calling convention to allocate registers for
+     * 
+     * @return ABI definition, or nullptr if none was set
+     */
+    const AbiDefinition* getAbi() const;
+    
+    /**
+     * @brief Make an ABI available to calls that name it
+     * 
+     * @param abiDef ABI definition (must outlive its use)
+     */
+    void addKnownAbi(const AbiDefinition* abiDef);
+    
+    /**
+     * @brief Find an ABI by name
+     * 
+     * @param abiName ABI name
+     * @return ABI definition, or nullptr if it was not added
+     */
+    const AbiDefinition* findAbi(const std::string& abiName) const;
+    
     /**
      * @brief Get the target name
      * 
@@ -192,6 +241,20 @@ public:
      */
     virtual std::vector<std::unique_ptr<Instruction>> generateEpilogue(Function& func) = 0;
     
+    /**
+     * @brief Generate machine code for a function
+     * 
+     * Safe to call for several functions at once.
+     * 
+     * @param func Function to generate code for
+     * @param code Machine code (output parameter)
+     * @param relocations Relocations against the code (output parameter)
+     * @return true on success, false if the target has no code generator or
+     *         the function uses something it cannot lower
+     */
+    virtual bool encodeFunction(const Function& func, std::vector<uint8_t>& code,
+                                std::vector<CodeRelocation>& relocations) const;
+    
     /**
      * @brief Get the physical register ID for a virtual register
      * 
@@ -217,6 +280,17 @@ public:
      * @return Target object
      */
     static std::unique_ptr<Target> createFromArchType(uint32_t targetId, uint8_t archType);
+    
+    /**
+     * @brief Create a target from its command-line name
+     * 
+     * @param targetId Target ID
+     * @param targetName Target name, optionally followed by '+'-separated
+     *                   features (e.g. "x86-64", "x86-64-v3" or
+     *                   "x86-64+avx2+bmi2")
+     * @return Target object, or nullptr if the name or a feature is unknown
+     */
+    static std::unique_ptr<Target> createFromName(uint32_t targetId, const std::string& targetName);
 };
 
 } // namespace coil
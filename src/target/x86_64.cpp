@@ -1,11 +1,14 @@
 #include "target/x86_64.h"
 #include "core/instruction.h"
+#include "parser/parser.h"
+#include "target/register_allocator.h"
+#include "target/x86_64_encoder.h"
 #include "util/logger.h"
 
 namespace coil {
 
-X86_64Target::X86_64Target(uint32_t targetId, uint32_t features)
-    : Target(targetId, 0, ARCH_X86_64, 64, 0, "x86-64") {
+X86_64Target::X86_64Target(uint32_t targetId, uint32_t features, const std::string& name)
+    : Target(targetId, 0, ARCH_X86_64, 64, 0, name) {
     
     // Set features
     this->features = features;
@@ -14,6 +17,89 @@ X86_64Target::X86_64Target(uint32_t targetId, uint32_t features)
     initRegisterMappings();
 }
 
+bool X86_64Target::parseFeatures(const std::string& spec, uint32_t& features) {
+    // Each feature with the features it implies
+    static const struct {
+        const char* name;
+        uint32_t flags;
+    } featureNames[] = {
+        {"sse",     X86_64_FEATURE_SSE},
+        {"sse2",    X86_64_FEATURE_SSE2},
+        {"sse3",    X86_64_FEATURE_SSE3},
+        {"ssse3",   X86_64_FEATURE_SSSE3},
+        {"sse4.1",  X86_64_FEATURE_SSE4_1},
+        {"sse4.2",  X86_64_FEATURE_SSE4_2},
+        {"avx",     X86_64_FEATURE_AVX},
+        {"avx2",    X86_64_FEATURE_AVX2},
+        {"avx512f", X86_64_FEATURE_AVX512F},
+        {"bmi1",    X86_64_FEATURE_BMI1},
+        {"bmi2",    X86_64_FEATURE_BMI2},
+        {"fma",     X86_64_FEATURE_FMA},
+        {"popcnt",  X86_64_FEATURE_POPCNT},
+        {"lzcnt",   X86_64_FEATURE_LZCNT},
+        {"movbe",   X86_64_FEATURE_MOVBE},
+        {"aes",     X86_64_FEATURE_AES},
+        {"pclmul",  X86_64_FEATURE_PCLMUL},
+        {"rdrand",  X86_64_FEATURE_RDRAND}
+    };
+    
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t end = spec.find('+', start);
+        if (end == std::string::npos) {
+            end = spec.size();
+        }
+        std::string name = spec.substr(start, end - start);
+        
+        bool found = false;
+        for (const auto& entry : featureNames) {
+            if (name == entry.name) {
+                features |= entry.flags;
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+        start = end + 1;
+    }
+    
+    // Close over the implied features, widest first
+    if (features & X86_64_FEATURE_AVX512F) {
+        features |= X86_64_FEATURE_AVX2 | X86_64_FEATURE_FMA;
+    }
+    if (features & X86_64_FEATURE_AVX2) {
+        features |= X86_64_FEATURE_AVX;
+    }
+    if (features & X86_64_FEATURE_AVX) {
+        features |= X86_64_FEATURE_SSE4_2;
+    }
+    if (features & X86_64_FEATURE_SSE4_2) {
+        features |= X86_64_FEATURE_SSE4_1;
+    }
+    if (features & X86_64_FEATURE_SSE4_1) {
+        features |= X86_64_FEATURE_SSSE3;
+    }
+    if (features & X86_64_FEATURE_SSSE3) {
+        features |= X86_64_FEATURE_SSE3;
+    }
+    if (features & X86_64_FEATURE_SSE3) {
+        features |= X86_64_FEATURE_SSE2;
+    }
+    if (features & X86_64_FEATURE_SSE2) {
+        features |= X86_64_FEATURE_SSE;
+    }
+    return true;
+}
+
+uint32_t X86_64Target::getVectorWidth() const {
+    if (hasFeature(X86_64_FEATURE_AVX512F)) {
+        return 64;
+    }
+    return hasFeature(X86_64_FEATURE_AVX2) ? 32 : 16;
+}
+
 void X86_64Target::initRegisterMappings() {
     // Register mappings based on the COIL specification
     
@@ -63,41 +149,192 @@ void X86_64Target::initRegisterMappings() {
 }
 
 void X86_64Target::transformInstruction(Instruction& inst) {
-    switch (inst.getCategory()) {
-        case CAT_MATH:
-            implementMathInstruction(inst);
-            break;
-        case CAT_MEM:
-            implementMemoryInstruction(inst);
-            break;
-        case CAT_CF:
-            implementControlFlowInstruction(inst);
-            break;
-        case CAT_BIT:
-            implementBitInstruction(inst);
-            break;
-        case CAT_VEC:
-            implementVectorInstruction(inst);
-            break;
-        case CAT_VAR:
-            implementVariableInstruction(inst);
-            break;
-        case CAT_FRAME:
-            implementFrameInstruction(inst);
-            break;
-        default:
-            // Unknown category, leave as-is
-            LOG_WARNING("Unknown instruction category: " + std::to_string(inst.getCategory()));
-            break;
+    // Instructions are lowered when the function is encoded (X86_64Encoder),
+    // so there is nothing to rewrite ahead of that
+    (void)inst;
+}
+
+/**
+ * @brief Check whether a physical register is one of the encoder's scratch registers
+ * 
+ * R10 and R11 hold address and value temporaries, XMM14 and XMM15 vector
+ * temporaries. They are never allocated or given a fixed location.
+ */
+static bool isScratchRegister(uint8_t pregId) {
+    return pregId == X86_64_R10 || pregId == X86_64_R11 || pregId == X86_64_XMM14 || pregId == X86_64_XMM15;
+}
+
+/**
+ * @brief Build the pool of one x86-64 register class for an ABI
+ * 
+ * @param target Target (for the fixed virtual -> physical mapping)
+ * @param abi ABI definition, or nullptr
+ * @param registerClass X86_64_REG_CLASS_GP or X86_64_REG_CLASS_XMM
+ * @return Register pool
+ */
+static RegisterPool buildRegisterPool(const Target& target, const AbiDefinition* abi, uint8_t registerClass) {
+    RegisterPool pool;
+    pool.registerClass = registerClass;
+    pool.slotSize = registerClass == X86_64_REG_CLASS_GP ? 8 : 16;
+    
+    auto inClass = [registerClass](uint8_t pregId) {
+        if (registerClass == X86_64_REG_CLASS_GP) {
+            // The stack and frame pointers are never allocated
+            return pregId <= X86_64_R15 && pregId != X86_64_RSP && pregId != X86_64_RBP &&
+                   !isScratchRegister(pregId);
+        }
+        return pregId >= X86_64_XMM0 && pregId <= X86_64_XMM15 && !isScratchRegister(pregId);
+    };
+    
+    std::vector<uint8_t> volatileRegs, preservedRegs;
+    if (abi) {
+        // ABI register lists name COIL registers; translate them through the fixed mapping
+        for (uint8_t vregId : abi->volatileRegs) {
+            uint8_t pregId = target.getPhysicalRegister(vregId);
+            if (inClass(pregId)) {
+                volatileRegs.push_back(pregId);
+            }
+        }
+        for (uint8_t vregId : abi->preservedRegs) {
+            uint8_t pregId = target.getPhysicalRegister(vregId);
+            if (inClass(pregId)) {
+                preservedRegs.push_back(pregId);
+            }
+        }
+    }
+    
+    // Without ABI information for the class, use the System V conventions
+    if (volatileRegs.empty() && preservedRegs.empty()) {
+        if (registerClass == X86_64_REG_CLASS_GP) {
+            volatileRegs = {X86_64_RAX, X86_64_RCX, X86_64_RDX, X86_64_RSI, X86_64_RDI,
+                            X86_64_R8, X86_64_R9};
+            preservedRegs = {X86_64_RBX, X86_64_R12, X86_64_R13, X86_64_R14, X86_64_R15};
+        } else {
+            for (uint8_t pregId = X86_64_XMM0; pregId <= X86_64_XMM15; pregId++) {
+                if (inClass(pregId)) {
+                    volatileRegs.push_back(pregId);
+                }
+            }
+        }
+    }
+    
+    for (uint8_t pregId : volatileRegs) {
+        pool.registers.push_back(pregId);
+        pool.volatileMask |= 1ull << pregId;
+    }
+    for (uint8_t pregId : preservedRegs) {
+        if (!(pool.volatileMask & (1ull << pregId))) {
+            pool.registers.push_back(pregId);
+        }
     }
+    
+    return pool;
 }
 
 void X86_64Target::allocateRegisters(Function& func) {
-    // TODO: Implement register allocation
-    // For now, just use the fixed mapping
+    func.setRegisterAllocation(computeRegisterAllocation(func));
+}
+
+RegisterAllocation X86_64Target::computeRegisterAllocation(const Function& func) const {
+    LinearScanAllocator allocator;
+    
+    // FP and vector registers share the XMM file; vector registers spill
+    // whole YMM or ZMM registers when the features widen them
+    RegisterPool gpPool = buildRegisterPool(*this, abi, X86_64_REG_CLASS_GP);
+    RegisterPool xmmPool = buildRegisterPool(*this, abi, X86_64_REG_CLASS_XMM);
+    allocator.addPool(REG_GP, gpPool);
+    allocator.addPool(REG_FP, xmmPool);
+    xmmPool.slotSize = static_cast<uint8_t>(getVectorWidth());
+    allocator.addPool(REG_VEC, xmmPool);
+    
+    // Registers with a fixed location keep their mapping: the stack and frame
+    // pointers, the function's inputs, and the registers that calls naming
+    // an ABI pass values in without listing them. Listed call operands and
+    // return values are moved into place by the code generator. The
+    // registers mapped to the encoder's scratch registers (R8, R9, F14, F15,
+    // V14 and V15) never get a fixed location.
+    auto fix = [&](uint8_t vregId) {
+        uint8_t pregId = getPhysicalRegister(vregId);
+        if (!isScratchRegister(pregId)) {
+            allocator.setFixedRegister(vregId, pregId);
+        }
+    };
+    
+    fix(REG_R14);
+    fix(REG_R15);
+    
+    for (uint8_t vregId = 0; vregId < ALLOCATABLE_VREG_COUNT; vregId++) {
+        uint8_t pregId = getPhysicalRegister(vregId);
+        if (!isScratchRegister(pregId)) {
+            allocator.setEntryRegister(vregId, pregId);
+        }
+    }
+    
+    for (const AbiDefinition* known : knownAbis) {
+        allocator.addCallConvention(known->name, known->argRegs, known->retRegs);
+    }
+    
+    for (const auto& inst : func.getInstructions()) {
+        if (inst->getCategory() != CAT_CF ||
+            (inst->getOperation() != CF_CALL && inst->getOperation() != CF_SYSC) ||
+            inst->getOperandCount() == 0) {
+            continue;
+        }
+        const OperandValue& value = inst->getOperandValue(0);
+        if (value.getClass() != OPERAND_IMMEDIATE || value.getSubtype() != IMM_SYMBOL) {
+            continue;
+        }
+        
+        size_t length;
+        const uint8_t* payload = inst->getOperandPayload(0, length);
+        const AbiDefinition* callAbi =
+            findAbi(std::string(reinterpret_cast<const char*>(payload), length > 0 ? length - 1 : 0));
+        if (callAbi) {
+            for (uint8_t vregId : callAbi->argRegs) {
+                fix(vregId);
+            }
+            for (uint8_t vregId : callAbi->retRegs) {
+                fix(vregId);
+            }
+        }
+    }
+    
+    // Variables take the general purpose registers left over, or share
+    // stack slots; integer operations access whole 64-bit slots
+    RegisterAllocation allocation = allocator.allocate(func);
+    FrameLayout(8).layout(func, &gpPool, allocation);
+    return allocation;
+}
+
+std::vector<uint8_t> X86_64Target::getSavedRegisters(const RegisterAllocation& allocation) const {
+    // The prologue names registers through the fixed mapping, so translate back
+    std::vector<uint8_t> saved;
+    for (uint8_t pregId : allocation.savedRegisters) {
+        if (pregId == X86_64_RSP || pregId == X86_64_RBP) {
+            continue;
+        }
+        for (const auto& mapping : regMappings) {
+            if (mapping.pregId == pregId && mapping.vregId <= REG_R15) {
+                saved.push_back(mapping.vregId);
+                break;
+            }
+        }
+    }
+    return saved;
+}
+
+uint32_t X86_64Target::getFrameSize(const RegisterAllocation& allocation) const {
+    // RSP is 16-byte aligned once RBP has been pushed
+    uint32_t savedSize = static_cast<uint32_t>(getSavedRegisters(allocation).size()) * 8;
+    uint32_t total = (savedSize + allocation.getFrameAreaSize() + 15) & ~15u;
+    return total - savedSize;
 }
 
 std::vector<std::unique_ptr<Instruction>> X86_64Target::generatePrologue(Function& func) {
+    return generatePrologue(func.getRegisterAllocation());
+}
+
+std::vector<std::unique_ptr<Instruction>> X86_64Target::generatePrologue(const RegisterAllocation& allocation) const {
     // Generate standard x86-64 function prologue
     std::vector<std::unique_ptr<Instruction>> prologue;
     
@@ -111,25 +348,54 @@ std::vector<std::unique_ptr<Instruction>> X86_64Target::generatePrologue(Functio
     movRbpRsp->addOperand(std::make_unique<RegisterOperand>(REG_GP, REG_R14));
     prologue.push_back(std::move(movRbpRsp));
     
-    // If there are callee-saved registers, push them
-    // TODO: Add register saving based on function needs
+    // Save the preserved registers the function writes
+    for (uint8_t vregId : getSavedRegisters(allocation)) {
+        auto push = std::make_unique<Instruction>(CAT_MEM, MEM_PUSH);
+        push->addOperand(std::make_unique<RegisterOperand>(REG_GP, vregId));
+        prologue.push_back(std::move(push));
+    }
+    
+    // Reserve the spill area: sub rsp, size
+    uint32_t frameSize = getFrameSize(allocation);
+    if (frameSize > 0) {
+        auto subRsp = std::make_unique<Instruction>(CAT_MATH, MATH_SUB);
+        subRsp->addOperand(std::make_unique<RegisterOperand>(REG_GP, REG_R14));
+        subRsp->addOperand(std::make_unique<ImmediateOperand>(static_cast<int64_t>(frameSize)));
+        prologue.push_back(std::move(subRsp));
+    }
     
     return prologue;
 }
 
 std::vector<std::unique_ptr<Instruction>> X86_64Target::generateEpilogue(Function& func) {
+    return generateEpilogue(func.getRegisterAllocation());
+}
+
+std::vector<std::unique_ptr<Instruction>> X86_64Target::generateEpilogue(const RegisterAllocation& allocation) const {
     // Generate standard x86-64 function epilogue
     std::vector<std::unique_ptr<Instruction>> epilogue;
+    std::vector<uint8_t> saved = getSavedRegisters(allocation);
     
-    // If there are callee-saved registers, pop them
-    // TODO: Add register restoring based on function needs
-    
-    // FRAME LEAVE -> leave (equivalent to: mov rsp, rbp; pop rbp)
+    // mov rsp, rbp, then point RSP back at the saved registers
     auto movRspRbp = std::make_unique<Instruction>(CAT_MEM, MEM_MOV);
     movRspRbp->addOperand(std::make_unique<RegisterOperand>(REG_GP, REG_R14));
     movRspRbp->addOperand(std::make_unique<RegisterOperand>(REG_GP, REG_R15));
     epilogue.push_back(std::move(movRspRbp));
     
+    if (!saved.empty()) {
+        auto subRsp = std::make_unique<Instruction>(CAT_MATH, MATH_SUB);
+        subRsp->addOperand(std::make_unique<RegisterOperand>(REG_GP, REG_R14));
+        subRsp->addOperand(std::make_unique<ImmediateOperand>(static_cast<int64_t>(saved.size() * 8)));
+        epilogue.push_back(std::move(subRsp));
+    }
+    
+    // Restore the preserved registers in reverse order
+    for (auto it = saved.rbegin(); it != saved.rend(); ++it) {
+        auto pop = std::make_unique<Instruction>(CAT_MEM, MEM_POP);
+        pop->addOperand(std::make_unique<RegisterOperand>(REG_GP, *it));
+        epilogue.push_back(std::move(pop));
+    }
+    
     auto popRbp = std::make_unique<Instruction>(CAT_MEM, MEM_POP);
     popRbp->addOperand(std::make_unique<RegisterOperand>(REG_GP, REG_R15));
     epilogue.push_back(std::move(popRbp));
@@ -141,39 +407,18 @@ std::vector<std::unique_ptr<Instruction>> X86_64Target::generateEpilogue(Functio
     return epilogue;
 }
 
-void X86_64Target::implementMathInstruction(Instruction& inst) {
-    // For now, just a simple implementation
-    // TODO: Implement full math instruction handling
-}
-
-void X86_64Target::implementMemoryInstruction(Instruction& inst) {
-    // For now, just a simple implementation
-    // TODO: Implement full memory instruction handling
-}
-
-void X86_64Target::implementControlFlowInstruction(Instruction& inst) {
-    // For now, just a simple implementation
-    // TODO: Implement full control flow instruction handling
-}
-
-void X86_64Target::implementBitInstruction(Instruction& inst) {
-    // For now, just a simple implementation
-    // TODO: Implement full bit instruction handling
-}
-
-void X86_64Target::implementVectorInstruction(Instruction& inst) {
-    // For now, just a simple implementation
-    // TODO: Implement full vector instruction handling
-}
-
-void X86_64Target::implementVariableInstruction(Instruction& inst) {
-    // For now, just a simple implementation
-    // TODO: Implement full variable instruction handling
-}
-
-void X86_64Target::implementFrameInstruction(Instruction& inst) {
-    // For now, just a simple implementation
-    // TODO: Implement full frame instruction handling
+bool X86_64Target::encodeFunction(const Function& func, std::vector<uint8_t>& code,
+                                  std::vector<CodeRelocation>& relocations) const {
+    // Functions only get an allocation stored when allocateRegisters() ran
+    RegisterAllocation computed;
+    const RegisterAllocation* allocation = &func.getRegisterAllocation();
+    if (allocation->mappings.empty()) {
+        computed = computeRegisterAllocation(func);
+        allocation = &computed;
+    }
+    
+    X86_64Encoder encoder(*this, func, *allocation, code, relocations);
+    return encoder.encode();
 }
 
 } // namespace coil
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define COIL_TARGET_X86_64_H
 
 #include "target/target.h"
+#include "target/register_allocator.h"
 
 namespace coil {
 
@@ -82,28 +83,60 @@ enum X86_64Feature : uint32_t {
     X86_64_FEATURE_RDRAND = (1 << 17)
 };
 
+/**
+ * @brief x86-64 relocation types (numbered as in the ELF x86-64 psABI)
+ */
+enum X86_64RelocationType : uint32_t {
+    X86_64_RELOC_NONE = 0,       // No relocation
+    X86_64_RELOC_64   = 1,       // 64-bit absolute address: S + A
+    X86_64_RELOC_PC32 = 2        // 32-bit PC-relative displacement: S + A - P
+};
+
 /**
  * @brief x86-64 target implementation
  */
 class X86_64Target : public Target {
-private:
-    // Helper methods for instruction implementation
-    void implementMathInstruction(Instruction& inst);
-    void implementMemoryInstruction(Instruction& inst);
-    void implementControlFlowInstruction(Instruction& inst);
-    void implementBitInstruction(Instruction& inst);
-    void implementVectorInstruction(Instruction& inst);
-    void implementVariableInstruction(Instruction& inst);
-    void implementFrameInstruction(Instruction& inst);
-
 public:
     /**
      * @brief Construct a new X86_64Target
      * 
      * @param targetId Target ID
      * @param features Feature flags (default: basic x86-64)
+     * @param name Target name (default: "x86-64")
+     */
+    X86_64Target(uint32_t targetId, uint32_t features = 0, const std::string& name = "x86-64");
+    
+    /**
+     * @brief Parse a list of feature names
+     * 
+     * Names are separated by '+' (e.g. "avx2+bmi2") and are lower case
+     * versions of X86_64Feature (sse4.1, avx512f, popcnt, ...). A feature
+     * brings in the features it extends, so "avx2" also enables AVX and
+     * the SSE levels below it.
+     * 
+     * @param spec Feature list
+     * @param features Feature flags, added to (output parameter)
+     * @return true on success, false if a name is unknown
+     */
+    static bool parseFeatures(const std::string& spec, uint32_t& features);
+    
+    /**
+     * @brief Check whether a feature is enabled
+     * 
+     * @param feature X86_64Feature flag
+     * @return true if the target has the feature
      */
-    X86_64Target(uint32_t targetId, uint32_t features = 0);
+    bool hasFeature(uint32_t feature) const { return (features & feature) != 0; }
+    
+    /**
+     * @brief Get the size of a vector register
+     * 
+     * VEC instructions operate on whole registers of the widest kind the
+     * features allow: ZMM with AVX-512F, YMM with AVX2, XMM otherwise.
+     * 
+     * @return Size in bytes (16, 32 or 64)
+     */
+    uint32_t getVectorWidth() const;
     
     /**
      * @brief Initialize register mappings
@@ -113,6 +146,9 @@ public:
     /**
      * @brief Transform an instruction for x86-64
      * 
+     * A no-op: instructions are lowered to machine code by X86_64Encoder
+     * when their function is encoded.
+     * 
      * @param inst Instruction to transform
      */
     void transformInstruction(Instruction& inst) override;
@@ -124,6 +160,32 @@ public:
      */
     void allocateRegisters(Function& func) override;
     
+    /**
+     * @brief Compute the register allocation for a function without storing it
+     * 
+     * @param func Function to allocate registers for
+     * @return Register allocation
+     */
+    RegisterAllocation computeRegisterAllocation(const Function& func) const;
+    
+    /**
+     * @brief Get the stack space the prologue reserves below the saved registers
+     * 
+     * Covers the spill slots and keeps RSP 16-byte aligned after the prologue.
+     * 
+     * @param allocation Register allocation of the function
+     * @return Size in bytes
+     */
+    uint32_t getFrameSize(const RegisterAllocation& allocation) const;
+    
+    /**
+     * @brief Get the preserved registers the prologue saves
+     * 
+     * @param allocation Register allocation of the function
+     * @return Virtual registers, in the order they are pushed
+     */
+    std::vector<uint8_t> getSavedRegisters(const RegisterAllocation& allocation) const;
+    
     /**
      * @brief Generate function prologue for x86-64
      * 
@@ -132,6 +194,18 @@ public:
      */
     std::vector<std::unique_ptr<Instruction>> generatePrologue(Function& func) override;
     
+    /**
+     * @brief Generate the prologue for a register allocation
+     * 
+     * Sets up RBP, saves the preserved registers the function writes and
+     * reserves the spill area. Registers are named through the fixed
+     * mapping (R14 is RSP, R15 is RBP).
+     * 
+     * @param allocation Register allocation of the function
+     * @return Generated instructions
+     */
+    std::vector<std::unique_ptr<Instruction>> generatePrologue(const RegisterAllocation& allocation) const;
+    
     /**
      * @brief Generate function epilogue for x86-64
      * 
@@ -139,6 +213,31 @@ public:
      * @return Generated instructions
      */
     std::vector<std::unique_ptr<Instruction>> generateEpilogue(Function& func) override;
+    
+    /**
+     * @brief Generate the epilogue for a register allocation
+     * 
+     * Undoes generatePrologue() and returns.
+     * 
+     * @param allocation Register allocation of the function
+     * @return Generated instructions
+     */
+    std::vector<std::unique_ptr<Instruction>> generateEpilogue(const RegisterAllocation& allocation) const;
+    
+    /**
+     * @brief Generate x86-64 machine code for a function
+     * 
+     * Uses the function's register allocation, or computes one if
+     * allocateRegisters() has not been called.
+     * 
+     * @param func Function to generate code for
+     * @param code Machine code (output parameter)
+     * @param relocations Relocations against the code (output parameter)
+     * @return true on success, false if the function uses something the
+     *         encoder cannot lower
+     */
+    bool encodeFunction(const Function& func, std::vector<uint8_t>& code,
+                        std::vector<CodeRelocation>& relocations) const override;
 };
 
 } // namespace coil
@@ -0,0 +1,2157 @@
+#include "target/x86_64_encoder.h"
+#include "target/x86_64.h"
+#include "parser/parser.h"
+#include "util/logger.h"
+#include <algorithm>
+#include <cstring>
+
+namespace coil {
+
+/**
+ * @brief Hardware register numbers (ModRM/REX encoding)
+ */
+enum HardwareRegister : uint8_t {
+    HW_RAX = 0,
+    HW_RCX = 1,
+    HW_RDX = 2,
+    HW_RBX = 3,
+    HW_RSP = 4,
+    HW_RBP = 5,
+    HW_RSI = 6,
+    HW_RDI = 7,
+    HW_R8  = 8,
+    HW_R9  = 9,
+    HW_R10 = 10,
+    HW_R11 = 11
+};
+
+// Hardware number of each general-purpose X86_64Register
+static const uint8_t hardwareRegisters[X86_64_R15 + 1] = {
+    HW_RAX, HW_RBX, HW_RCX, HW_RDX, HW_RSI, HW_RDI, HW_RSP, HW_RBP,
+    8, 9, 10, 11, 12, 13, 14, 15
+};
+
+// Argument and result registers of calls that follow no known ABI (System V)
+static const uint8_t defaultArgRegisters[] = {HW_RDI, HW_RSI, HW_RDX, HW_RCX, HW_R8, HW_R9};
+static const uint8_t defaultRetRegisters[] = {HW_RAX, HW_RDX};
+
+/**
+ * @brief Get the x86-64 condition (low nibble of Jcc/CMOVcc) for a COIL condition
+ */
+static bool conditionCode(uint8_t condition, uint8_t& result) {
+    static const uint8_t codes[] = {
+        0x4, // COND_EQ -> E
+        0x5, // COND_NE -> NE
+        0xC, // COND_LT -> L
+        0xE, // COND_LE -> LE
+        0xF, // COND_GT -> G
+        0xD, // COND_GE -> GE
+        0x4, // COND_Z  -> Z
+        0x5, // COND_NZ -> NZ
+        0x2, // COND_CS -> B
+        0x3, // COND_CC -> AE
+        0x0, // COND_VS -> O
+        0x1, // COND_VC -> NO
+        0x8, // COND_NS -> S
+        0x9, // COND_NC -> NS
+        0xA, // COND_PS -> P
+        0xB  // COND_PC -> NP
+    };
+    if (condition >= sizeof(codes)) {
+        return false;
+    }
+    result = codes[condition];
+    return true;
+}
+
+static bool fitsInt8(int64_t value) {
+    return value >= INT8_MIN && value <= INT8_MAX;
+}
+
+static bool fitsInt32(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static int64_t readImmediate(const uint8_t* payload, size_t length) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < length; i++) {
+        value |= static_cast<uint64_t>(payload[i]) << (i * 8);
+    }
+    if (length > 0 && length < 8 && (payload[length - 1] & 0x80)) {
+        value |= ~0ull << (length * 8);
+    }
+    return static_cast<int64_t>(value);
+}
+
+/**
+ * @brief Element type of a VEC instruction
+ */
+struct VectorElement {
+    uint8_t size;     // Element size in bytes
+    bool isFloat;     // fp32 or fp64
+    bool isSigned;    // Signed integer
+};
+
+/**
+ * @brief Get the element type of a VEC instruction (64-bit integers if it names none)
+ */
+static bool vectorElement(const Instruction& inst, VectorElement& result) {
+    const auto& extended = inst.getExtendedData();
+    uint8_t type = extended.empty() ? static_cast<uint8_t>(TYPE_INT64) : extended[0];
+    if (type >= TYPE_INT8 && type <= TYPE_INT64) {
+        result = {static_cast<uint8_t>(1 << (type - TYPE_INT8)), false, true};
+    } else if (type >= TYPE_UINT8 && type <= TYPE_UINT64) {
+        result = {static_cast<uint8_t>(1 << (type - TYPE_UINT8)), false, false};
+    } else if (type == TYPE_FP32 || type == TYPE_FP64) {
+        result = {static_cast<uint8_t>(type == TYPE_FP32 ? 4 : 8), true, true};
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Integer form of an element-wise operation
+ */
+struct IntegerVectorForm {
+    uint8_t map;      // Opcode map (0: no such instruction)
+    uint8_t opcode;   // Opcode byte (with a 66 prefix)
+    uint32_t feature; // Feature the instruction needs beyond SSE2 (0 for none)
+};
+
+/**
+ * @brief Get the integer form of an element-wise operation
+ *
+ * @param operation VectorOp
+ * @param element Element type
+ * @return Form, with map 0 if there is no instruction for the element type
+ */
+static IntegerVectorForm integerVectorForm(uint8_t operation, const VectorElement& element) {
+    static const uint32_t SSE41 = X86_64_FEATURE_SSE4_1;
+    static const uint32_t AVX512 = X86_64_FEATURE_AVX512F;
+
+    // Columns are 8-, 16-, 32- and 64-bit elements
+    static const IntegerVectorForm add[] = {{1, 0xFC, 0}, {1, 0xFD, 0}, {1, 0xFE, 0}, {1, 0xD4, 0}};
+    static const IntegerVectorForm sub[] = {{1, 0xF8, 0}, {1, 0xF9, 0}, {1, 0xFA, 0}, {1, 0xFB, 0}};
+    static const IntegerVectorForm mul[] = {{0, 0, 0}, {1, 0xD5, 0}, {2, 0x40, SSE41}, {0, 0, 0}};
+    static const IntegerVectorForm minSigned[] = {{2, 0x38, SSE41}, {1, 0xEA, 0}, {2, 0x39, SSE41}, {2, 0x39, AVX512}};
+    static const IntegerVectorForm minUnsigned[] = {{1, 0xDA, 0}, {2, 0x3A, SSE41}, {2, 0x3B, SSE41}, {2, 0x3B, AVX512}};
+    static const IntegerVectorForm maxSigned[] = {{2, 0x3C, SSE41}, {1, 0xEE, 0}, {2, 0x3D, SSE41}, {2, 0x3D, AVX512}};
+    static const IntegerVectorForm maxUnsigned[] = {{1, 0xDE, 0}, {2, 0x3E, SSE41}, {2, 0x3F, SSE41}, {2, 0x3F, AVX512}};
+
+    size_t column = element.size == 1 ? 0 : element.size == 2 ? 1 : element.size == 4 ? 2 : 3;
+    switch (operation) {
+        case VEC_ADD: return add[column];
+        case VEC_SUB: return sub[column];
+        case VEC_MUL: return mul[column];
+        case VEC_MIN: return element.isSigned ? minSigned[column] : minUnsigned[column];
+        case VEC_MAX: return element.isSigned ? maxSigned[column] : maxUnsigned[column];
+        default:      return {0, 0, 0};
+    }
+}
+
+static std::string symbolName(const Instruction& inst, size_t index) {
+    size_t length;
+    const uint8_t* payload = inst.getOperandPayload(index, length);
+    return std::string(reinterpret_cast<const char*>(payload), length > 0 ? length - 1 : 0);
+}
+
+/**
+ * @brief Get the REX.R, REX.X and REX.B bits (0100 0RXB) for a ModRM operand pair
+ */
+static uint8_t extensionBits(uint8_t regField, const MachineOperand& rm) {
+    uint8_t bits = (regField & 8) ? 0x04 : 0;
+    if (rm.kind == MachineOperand::REG || rm.kind == MachineOperand::VEC) {
+        bits |= (rm.reg & 8) ? 0x01 : 0;
+    } else {
+        if (rm.index != MachineOperand::NO_REGISTER && (rm.index & 8)) {
+            bits |= 0x02;
+        }
+        if (rm.reg != MachineOperand::NO_REGISTER && (rm.reg & 8)) {
+            bits |= 0x01;
+        }
+    }
+    return bits;
+}
+
+/**
+ * @brief Get the VEX/EVEX pp field for a mandatory prefix
+ */
+static uint8_t prefixBits(uint8_t prefix) {
+    switch (prefix) {
+        case 0x66: return 1;
+        case 0xF3: return 2;
+        case 0xF2: return 3;
+        default:   return 0;
+    }
+}
+
+/**
+ * @brief Replace a register wherever an operand uses it
+ */
+static MachineOperand replaceRegister(MachineOperand operand, uint8_t from, uint8_t to) {
+    if ((operand.kind == MachineOperand::REG || operand.kind == MachineOperand::MEM) && operand.reg == from) {
+        operand.reg = to;
+    }
+    if (operand.kind == MachineOperand::MEM && operand.index == from) {
+        operand.index = to;
+    }
+    return operand;
+}
+
+// MachineOperand implementation
+MachineOperand MachineOperand::makeRegister(uint8_t hwReg) {
+    MachineOperand operand;
+    operand.kind = REG;
+    operand.reg = hwReg;
+    return operand;
+}
+
+MachineOperand MachineOperand::makeVector(uint8_t vectorReg) {
+    MachineOperand operand;
+    operand.kind = VEC;
+    operand.reg = vectorReg;
+    return operand;
+}
+
+MachineOperand MachineOperand::makeMemory(uint8_t base, int32_t displacement, uint8_t indexReg, uint8_t indexScale) {
+    MachineOperand operand;
+    operand.kind = MEM;
+    operand.reg = base;
+    operand.disp = displacement;
+    operand.index = indexReg;
+    operand.scale = indexScale;
+    return operand;
+}
+
+MachineOperand MachineOperand::makeImmediate(int64_t value) {
+    MachineOperand operand;
+    operand.kind = IMM;
+    operand.imm = value;
+    return operand;
+}
+
+MachineOperand MachineOperand::makeSymbol(const std::string& name) {
+    MachineOperand operand;
+    operand.kind = SYMBOL;
+    operand.symbol = name;
+    return operand;
+}
+
+bool MachineOperand::uses(uint8_t hwReg) const {
+    if (kind == REG) {
+        return reg == hwReg;
+    }
+    if (kind == MEM) {
+        return reg == hwReg || index == hwReg;
+    }
+    return false;
+}
+
+bool MachineOperand::operator==(const MachineOperand& other) const {
+    if (kind != other.kind) {
+        return false;
+    }
+    switch (kind) {
+        case REG:
+        case VEC:
+            return reg == other.reg;
+        case MEM:
+            return reg == other.reg && index == other.index && disp == other.disp &&
+                   (index == NO_REGISTER || scale == other.scale);
+        case IMM:
+            return imm == other.imm;
+        case SYMBOL:
+            return symbol == other.symbol;
+        default:
+            return true;
+    }
+}
+
+// X86_64Encoder implementation
+X86_64Encoder::X86_64Encoder(const X86_64Target& x86Target, const Function& function,
+                             const RegisterAllocation& registerAllocation, std::vector<uint8_t>& output,
+                             std::vector<CodeRelocation>& outputRelocations)
+    : target(x86Target), func(function), allocation(registerAllocation), code(output),
+      relocations(outputRelocations), codeStart(0), hasFrame(false), fixedMapping(false), spillBase(0),
+      variableBase(0), nextAddressScratch(HW_R10), vectorWidth(x86Target.getVectorWidth()), wideVectors(false) {
+}
+
+bool X86_64Encoder::fail(const std::string& message) {
+    // Keep the innermost reason
+    if (failure.empty()) {
+        failure = message;
+    }
+    return false;
+}
+
+bool X86_64Encoder::resolveRegister(uint8_t vregId, MachineOperand& result) {
+    uint8_t pregId;
+    if (vregId == REG_SP) {
+        pregId = X86_64_RSP;
+    } else if (vregId == REG_FRAME_PTR) {
+        pregId = X86_64_RBP;
+    } else if (vregId > REG_V15) {
+        return fail("register is not supported");
+    } else if (fixedMapping) {
+        pregId = target.getPhysicalRegister(vregId);
+    } else {
+        pregId = allocation.getPhysicalRegister(vregId);
+        if (pregId == PREG_NONE) {
+            const SpillSlot* slot = allocation.getSpillSlot(vregId);
+            if (slot) {
+                result = MachineOperand::makeMemory(HW_RBP, spillBase + static_cast<int32_t>(slot->offset));
+                return true;
+            }
+
+            // Registers that are never live were not allocated
+            pregId = target.getPhysicalRegister(vregId);
+        }
+    }
+
+    if (pregId >= X86_64_XMM0 && pregId <= X86_64_XMM15) {
+        result = MachineOperand::makeVector(static_cast<uint8_t>(pregId - X86_64_XMM0));
+        return true;
+    }
+    if (pregId > X86_64_R15) {
+        return fail("register has no physical register");
+    }
+    result = MachineOperand::makeRegister(hardwareRegisters[pregId]);
+    return true;
+}
+
+bool X86_64Encoder::resolveAddressRegister(uint8_t vregId, uint8_t& hwReg) {
+    MachineOperand location;
+    if (!resolveRegister(vregId, location)) {
+        return false;
+    }
+    if (location.kind == MachineOperand::REG) {
+        hwReg = location.reg;
+        return true;
+    }
+    if (location.kind == MachineOperand::VEC) {
+        return fail("vector registers cannot hold addresses");
+    }
+
+    // A spilled address register is loaded into a scratch register first
+    if (nextAddressScratch > HW_R11) {
+        return fail("too many spilled address registers");
+    }
+    hwReg = nextAddressScratch++;
+    return move(MachineOperand::makeRegister(hwReg), location);
+}
+
+bool X86_64Encoder::resolve(const Instruction& inst, size_t index, MachineOperand& result) {
+    const OperandValue& value = inst.getOperandValue(index);
+    size_t length;
+    const uint8_t* payload = inst.getOperandPayload(index, length);
+
+    switch (value.getClass()) {
+        case OPERAND_REGISTER:
+            return resolveRegister(payload[0], result);
+
+        case OPERAND_IMMEDIATE:
+            switch (value.getSubtype()) {
+                case IMM_INT8:
+                case IMM_INT16:
+                case IMM_INT32:
+                case IMM_INT64:
+                    result = MachineOperand::makeImmediate(readImmediate(payload, length));
+                    return true;
+                case IMM_SYMBOL:
+                    result = MachineOperand::makeSymbol(symbolName(inst, index));
+                    return true;
+                default:
+                    return fail("floating-point immediates are not supported");
+            }
+
+        case OPERAND_MEMORY: {
+            uint8_t base = MachineOperand::NO_REGISTER;
+            uint8_t indexReg = MachineOperand::NO_REGISTER;
+            uint8_t scale = 1;
+            int32_t disp = 0;
+
+            switch (value.getSubtype()) {
+                case MEM_DIRECT: {
+                    uint32_t address = static_cast<uint32_t>(readImmediate(payload, 4)) ;
+                    if (address > INT32_MAX) {
+                        return fail("absolute address out of range");
+                    }
+                    disp = static_cast<int32_t>(address);
+                    break;
+                }
+                case MEM_REG:
+                    if (!resolveAddressRegister(payload[0], base)) {
+                        return false;
+                    }
+                    break;
+                case MEM_REG_DISP:
+                    if (!resolveAddressRegister(payload[0], base)) {
+                        return false;
+                    }
+                    disp = static_cast<int32_t>(readImmediate(payload + 1, 4));
+                    break;
+                case MEM_REG_REG_SCALE:
+                    scale = payload[2];
+                    if (scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+                        return fail("index scale must be 1, 2, 4 or 8");
+                    }
+                    [[fallthrough]];
+                case MEM_REG_REG:
+                    if (!resolveAddressRegister(payload[0], base) || !resolveAddressRegister(payload[1], indexReg)) {
+                        return false;
+                    }
+                    if (indexReg == HW_RSP) {
+                        return fail("the stack pointer cannot be an index register");
+                    }
+                    break;
+                default:
+                    return fail("increment and decrement addressing is not supported");
+            }
+
+            result = MachineOperand::makeMemory(base, disp, indexReg, scale);
+            return true;
+        }
+
+        case OPERAND_VARIABLE: {
+            if (value.getSubtype() != VAR_DIRECT) {
+                return fail("only direct variable references are supported");
+            }
+            const VariableSlot* slot = allocation.getVariableSlot(payload[0]);
+            if (!slot) {
+                return fail("variable has no storage");
+            }
+            if (slot->pregId != PREG_NONE) {
+                result = MachineOperand::makeRegister(hardwareRegisters[slot->pregId]);
+            } else {
+                result = MachineOperand::makeMemory(HW_RBP, variableBase + static_cast<int32_t>(slot->offset));
+            }
+            return true;
+        }
+
+        default:
+            return fail("operand class is not supported");
+    }
+}
+
+bool X86_64Encoder::resolveAll(const Instruction& inst, size_t count, std::vector<MachineOperand>& result) {
+    if (inst.getOperandCount() < count) {
+        return fail("expected " + std::to_string(count) + " operands");
+    }
+
+    result.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        if (!resolve(inst, i, result[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool X86_64Encoder::resolveAddress(const Instruction& inst, size_t index, MachineOperand& result) {
+    // A register operand holds the address
+    const OperandValue& value = inst.getOperandValue(index);
+    if (value.getClass() == OPERAND_REGISTER) {
+        uint8_t base;
+        if (!resolveAddressRegister(value.payload[0], base)) {
+            return false;
+        }
+        result = MachineOperand::makeMemory(base, 0);
+        return true;
+    }
+
+    if (!resolve(inst, index, result)) {
+        return false;
+    }
+    return result.kind == MachineOperand::MEM || fail("expected an address");
+}
+
+bool X86_64Encoder::resolveVector(const Instruction& inst, size_t index, MachineOperand& result) {
+    // FP or vector registers, or the spill slots they live in
+    const OperandValue& value = inst.getOperandValue(index);
+    if (value.getClass() != OPERAND_REGISTER || value.payload[0] < REG_F0 || value.payload[0] > REG_V15) {
+        return fail("expected a vector register");
+    }
+    return resolve(inst, index, result);
+}
+
+void X86_64Encoder::emit8(uint8_t value) {
+    code.push_back(value);
+}
+
+void X86_64Encoder::emit32(uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        code.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+void X86_64Encoder::emit64(uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        code.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+void X86_64Encoder::emitModRM(std::initializer_list<uint8_t> opcode, uint8_t regField, const MachineOperand& rm,
+                              bool wide, uint8_t prefix) {
+    if (prefix) {
+        emit8(prefix);
+    }
+
+    // REX: 0100WRXB
+    uint8_t rex = 0x40 | (wide ? 0x08 : 0) | extensionBits(regField, rm);
+    if (rex != 0x40) {
+        emit8(rex);
+    }
+
+    for (uint8_t byte : opcode) {
+        emit8(byte);
+    }
+    emitOperand(regField, rm);
+}
+
+void X86_64Encoder::emitOperand(uint8_t regField, const MachineOperand& rm, int32_t dispScale) {
+    uint8_t reg = static_cast<uint8_t>((regField & 7) << 3);
+    if (rm.kind == MachineOperand::REG || rm.kind == MachineOperand::VEC) {
+        emit8(0xC0 | reg | (rm.reg & 7));
+        return;
+    }
+
+    uint8_t scaleBits = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+    uint8_t indexBits = rm.index == MachineOperand::NO_REGISTER ? 4 : (rm.index & 7);
+
+    // No base: SIB with base 101 and a 32-bit displacement
+    if (rm.reg == MachineOperand::NO_REGISTER) {
+        emit8(reg | 0x04);
+        emit8(static_cast<uint8_t>(scaleBits << 6 | indexBits << 3 | 0x05));
+        emit32(static_cast<uint32_t>(rm.disp));
+        return;
+    }
+
+    // RSP and R12 as base need a SIB byte; RBP and R13 always need a
+    // displacement. EVEX scales 8-bit displacements by the access size.
+    bool needsSib = rm.index != MachineOperand::NO_REGISTER || (rm.reg & 7) == 4;
+    bool shortDisp = rm.disp % dispScale == 0 && fitsInt8(rm.disp / dispScale);
+    uint8_t mod = (rm.disp == 0 && (rm.reg & 7) != 5) ? 0 : shortDisp ? 1 : 2;
+    emit8(static_cast<uint8_t>(mod << 6 | reg | (needsSib ? 4 : (rm.reg & 7))));
+    if (needsSib) {
+        emit8(static_cast<uint8_t>(scaleBits << 6 | indexBits << 3 | (rm.reg & 7)));
+    }
+    if (mod == 1) {
+        emit8(static_cast<uint8_t>(rm.disp / dispScale));
+    } else if (mod == 2) {
+        emit32(static_cast<uint32_t>(rm.disp));
+    }
+}
+
+void X86_64Encoder::emitVex(const VectorOpcode& op, uint8_t regField, uint8_t vvvv, const MachineOperand& rm,
+                            bool wideVector) {
+    // The register extension bits and vvvv are stored inverted
+    uint8_t extension = extensionBits(regField, rm);
+    uint8_t source = vvvv == MachineOperand::NO_REGISTER ? 0 : vvvv;
+    uint8_t last = static_cast<uint8_t>((op.wide ? 0x80 : 0) | (~source & 15) << 3 | (wideVector ? 0x04 : 0) |
+                                        prefixBits(op.prefix));
+
+    // The two-byte form leaves out X, B, W and the map, and means 0F
+    if (!(extension & 0x03) && !op.wide && op.map == 1) {
+        emit8(0xC5);
+        emit8(static_cast<uint8_t>(((extension & 0x04) ? 0 : 0x80) | (last & 0x7F)));
+    } else {
+        emit8(0xC4);
+        emit8(static_cast<uint8_t>((~extension & 7) << 5 | op.map));
+        emit8(last);
+    }
+    emit8(op.opcode);
+    emitOperand(regField, rm);
+}
+
+void X86_64Encoder::emitEvex(const VectorOpcode& op, uint8_t regField, uint8_t vvvv, const MachineOperand& rm) {
+    // 62, then R X B R' 0 0 m m, W v v v v 1 p p, and z L'L b V' a a a for a
+    // 512-bit operation without masking; only registers 0-15 are used, so
+    // R' and V' are always set
+    uint8_t extension = extensionBits(regField, rm);
+    uint8_t source = vvvv == MachineOperand::NO_REGISTER ? 0 : vvvv;
+    emit8(0x62);
+    emit8(static_cast<uint8_t>((~extension & 7) << 5 | 0x10 | op.map));
+    emit8(static_cast<uint8_t>((op.wide ? 0x80 : 0) | (~source & 15) << 3 | 0x04 | prefixBits(op.prefix)));
+    emit8(0x48);
+    emit8(op.opcode);
+    emitOperand(regField, rm, 64);
+}
+
+void X86_64Encoder::emitVector(const VectorOpcode& op, uint8_t regField, uint8_t vvvv, const MachineOperand& rm,
+                               uint32_t size) {
+    if (size == 64) {
+        emitEvex(op, regField, vvvv, rm);
+        return;
+    }
+    if (target.hasFeature(X86_64_FEATURE_AVX)) {
+        emitVex(op, regField, vvvv, rm, size == 32);
+        return;
+    }
+
+    // SSE: the destination is also the first source, so vvvv does not exist
+    if (op.prefix) {
+        emit8(op.prefix);
+    }
+    uint8_t rex = 0x40 | (op.wide ? 0x08 : 0) | extensionBits(regField, rm);
+    if (rex != 0x40) {
+        emit8(rex);
+    }
+    emit8(0x0F);
+    if (op.map == 2) {
+        emit8(0x38);
+    } else if (op.map == 3) {
+        emit8(0x3A);
+    }
+    emit8(op.opcode);
+    emitOperand(regField, rm);
+}
+
+void X86_64Encoder::emitVzeroupper() {
+    // Clearing the upper halves avoids the SSE/AVX transition penalty in
+    // code that uses SSE
+    emit8(0xC5);
+    emit8(0xF8);
+    emit8(0x77);
+}
+
+void X86_64Encoder::emitRegisterOp(uint8_t opcode, uint8_t hwReg, bool wide) {
+    if (wide || (hwReg & 8)) {
+        emit8(0x40 | (wide ? 0x08 : 0) | ((hwReg & 8) ? 0x01 : 0));
+    }
+    emit8(opcode | (hwReg & 7));
+}
+
+void X86_64Encoder::emitRel32(const std::string& symbol, size_t opcodeSize, uint8_t shortOpcode, bool call) {
+    size_t fieldOffset = code.size() - codeStart;
+    
+    // Calls always go through the symbol, whose value is the entry before
+    // the prologue; a function's own name is also the label of its first
+    // body instruction, and a recursive call must not skip the prologue
+    if (!call && func.getLabels().count(symbol)) {
+        labelFixups.push_back({fieldOffset - opcodeSize, fieldOffset, symbol, shortOpcode});
+    } else {
+        // The displacement is relative to the end of the field
+        relocations.push_back({static_cast<uint32_t>(fieldOffset), X86_64_RELOC_PC32, -4, symbol});
+    }
+    emit32(0);
+}
+
+uint8_t X86_64Encoder::pickScratch(const MachineOperand& a, const MachineOperand& b, const MachineOperand& c) const {
+    for (uint8_t scratch : {HW_R11, HW_R10}) {
+        if (!a.uses(scratch) && !b.uses(scratch) && !c.uses(scratch)) {
+            return scratch;
+        }
+    }
+    return MachineOperand::NO_REGISTER;
+}
+
+bool X86_64Encoder::materialize(const MachineOperand& source, uint8_t scratch, MachineOperand& result) {
+    if (source.kind == MachineOperand::REG) {
+        result = source;
+        return true;
+    }
+    if (scratch == MachineOperand::NO_REGISTER) {
+        return fail("out of scratch registers");
+    }
+    result = MachineOperand::makeRegister(scratch);
+    return move(result, source);
+}
+
+bool X86_64Encoder::move(const MachineOperand& dest, const MachineOperand& source) {
+    if (dest == source) {
+        return true;
+    }
+    if (dest.kind == MachineOperand::VEC || source.kind == MachineOperand::VEC) {
+        return fail("vector registers are only accessed by VEC instructions");
+    }
+
+    if (dest.kind == MachineOperand::REG) {
+        switch (source.kind) {
+            case MachineOperand::REG:
+                emitModRM({0x89}, source.reg, dest);
+                return true;
+            case MachineOperand::MEM:
+                emitModRM({0x8B}, dest.reg, source);
+                return true;
+            case MachineOperand::IMM:
+                // mov r32, imm32 zero-extends; none of the forms touches the flags
+                if (source.imm >= 0 && source.imm <= UINT32_MAX) {
+                    emitRegisterOp(0xB8, dest.reg, false);
+                    emit32(static_cast<uint32_t>(source.imm));
+                } else if (fitsInt32(source.imm)) {
+                    emitModRM({0xC7}, 0, dest);
+                    emit32(static_cast<uint32_t>(source.imm));
+                } else {
+                    emitRegisterOp(0xB8, dest.reg, true);
+                    emit64(static_cast<uint64_t>(source.imm));
+                }
+                return true;
+            case MachineOperand::SYMBOL:
+                // movabs r64, imm64 with the symbol's address
+                emitRegisterOp(0xB8, dest.reg, true);
+                relocations.push_back({static_cast<uint32_t>(code.size() - codeStart), X86_64_RELOC_64, 0,
+                                       source.symbol});
+                emit64(0);
+                return true;
+            default:
+                return fail("missing source operand");
+        }
+    }
+
+    if (dest.kind != MachineOperand::MEM) {
+        return fail("destination must be a register or memory");
+    }
+
+    if (source.kind == MachineOperand::IMM && fitsInt32(source.imm)) {
+        emitModRM({0xC7}, 0, dest);
+        emit32(static_cast<uint32_t>(source.imm));
+        return true;
+    }
+
+    MachineOperand value;
+    if (!materialize(source, pickScratch(dest, source), value)) {
+        return false;
+    }
+    emitModRM({0x89}, value.reg, dest);
+    return true;
+}
+
+bool X86_64Encoder::arithmetic(uint8_t extension, const MachineOperand& dest, const MachineOperand& source) {
+    if (dest.kind != MachineOperand::REG && dest.kind != MachineOperand::MEM) {
+        return fail("destination must be a register or memory");
+    }
+
+    if (source.kind == MachineOperand::IMM && fitsInt32(source.imm)) {
+        if (fitsInt8(source.imm)) {
+            emitModRM({0x83}, extension, dest);
+            emit8(static_cast<uint8_t>(source.imm));
+        } else {
+            emitModRM({0x81}, extension, dest);
+            emit32(static_cast<uint32_t>(source.imm));
+        }
+        return true;
+    }
+
+    // op r/m, r is extension * 8 + 1; op r, r/m is extension * 8 + 3
+    uint8_t opcode = static_cast<uint8_t>(extension * 8);
+    if (source.kind == MachineOperand::MEM && dest.kind == MachineOperand::REG) {
+        emitModRM({static_cast<uint8_t>(opcode + 3)}, dest.reg, source);
+        return true;
+    }
+
+    MachineOperand value;
+    if (!materialize(source, pickScratch(dest, source), value)) {
+        return false;
+    }
+    emitModRM({static_cast<uint8_t>(opcode + 1)}, value.reg, dest);
+    return true;
+}
+
+bool X86_64Encoder::test(const MachineOperand& a, const MachineOperand& b) {
+    // TEST is commutative, so a constant can go on either side
+    if (a.kind == MachineOperand::IMM || a.kind == MachineOperand::SYMBOL) {
+        return b.kind != MachineOperand::IMM && b.kind != MachineOperand::SYMBOL
+            ? test(b, a) : fail("cannot test two constants");
+    }
+
+    if (b.kind == MachineOperand::IMM && fitsInt32(b.imm)) {
+        emitModRM({0xF7}, 0, a);
+        emit32(static_cast<uint32_t>(b.imm));
+        return true;
+    }
+    if (b.kind == MachineOperand::MEM && a.kind == MachineOperand::REG) {
+        emitModRM({0x85}, a.reg, b);
+        return true;
+    }
+
+    MachineOperand value;
+    if (!materialize(b, pickScratch(a, b), value)) {
+        return false;
+    }
+    emitModRM({0x85}, value.reg, a);
+    return true;
+}
+
+bool X86_64Encoder::unary(uint8_t opcode, uint8_t extension, const MachineOperand& dest) {
+    if (dest.kind != MachineOperand::REG && dest.kind != MachineOperand::MEM) {
+        return fail("destination must be a register or memory");
+    }
+    emitModRM({opcode}, extension, dest);
+    return true;
+}
+
+bool X86_64Encoder::multiply(const MachineOperand& dest, const MachineOperand& source) {
+    if (dest.kind == MachineOperand::MEM) {
+        // IMUL only writes registers
+        uint8_t scratch = pickScratch(dest, source);
+        if (scratch == MachineOperand::NO_REGISTER) {
+            return fail("out of scratch registers");
+        }
+        MachineOperand product = MachineOperand::makeRegister(scratch);
+        return move(product, dest) && multiply(product, source) && move(dest, product);
+    }
+    if (dest.kind != MachineOperand::REG) {
+        return fail("destination must be a register or memory");
+    }
+
+    if (source.kind == MachineOperand::IMM && fitsInt32(source.imm)) {
+        // imul r, r/m, imm32
+        emitModRM({0x69}, dest.reg, dest);
+        emit32(static_cast<uint32_t>(source.imm));
+        return true;
+    }
+
+    MachineOperand value = source;
+    if (source.kind != MachineOperand::MEM && !materialize(source, pickScratch(dest, source), value)) {
+        return false;
+    }
+    emitModRM({0x0F, 0xAF}, dest.reg, value);
+    return true;
+}
+
+bool X86_64Encoder::divide(const MachineOperand& dest, const MachineOperand& dividend, const MachineOperand& divisor,
+                           bool remainder) {
+    // IDIV divides RDX:RAX; both are saved around it unless they receive the
+    // result. The dividend goes through R10 and the divisor through R11.
+    MachineOperand r10 = MachineOperand::makeRegister(HW_R10);
+    MachineOperand r11 = MachineOperand::makeRegister(HW_R11);
+    bool divisorFirst = divisor.uses(HW_R10);
+    if ((divisorFirst && dividend.uses(HW_R11)) || dest.uses(HW_R10) || dest.uses(HW_R11)) {
+        return fail("out of scratch registers");
+    }
+
+    if (divisorFirst && !move(r11, divisor)) {
+        return false;
+    }
+    if (!move(r10, dividend) || (!divisorFirst && !move(r11, divisor))) {
+        return false;
+    }
+
+    bool intoRax = dest.kind == MachineOperand::REG && dest.reg == HW_RAX;
+    bool intoRdx = dest.kind == MachineOperand::REG && dest.reg == HW_RDX;
+    if (!intoRax) {
+        emit8(0x50); // push rax
+    }
+    if (!intoRdx) {
+        emit8(0x52); // push rdx
+    }
+
+    MachineOperand result = MachineOperand::makeRegister(remainder ? HW_RDX : HW_RAX);
+    move(MachineOperand::makeRegister(HW_RAX), r10);
+    emit8(0x48);
+    emit8(0x99); // cqo
+    emitModRM({0xF7}, 7, r11); // idiv r11
+    move(intoRax || intoRdx ? dest : r10, result);
+
+    if (!intoRdx) {
+        emit8(0x5A); // pop rdx
+    }
+    if (!intoRax) {
+        emit8(0x58); // pop rax
+    }
+    return intoRax || intoRdx || move(dest, r10);
+}
+
+bool X86_64Encoder::shift(uint8_t extension, const MachineOperand& dest, const MachineOperand& count) {
+    if (dest.kind != MachineOperand::REG && dest.kind != MachineOperand::MEM) {
+        return fail("destination must be a register or memory");
+    }
+
+    if (count.kind == MachineOperand::IMM) {
+        uint8_t amount = static_cast<uint8_t>(count.imm & 63);
+        if (amount == 1) {
+            emitModRM({0xD1}, extension, dest);
+        } else {
+            emitModRM({0xC1}, extension, dest);
+            emit8(amount);
+        }
+        return true;
+    }
+
+    if (count.kind == MachineOperand::REG && count.reg == HW_RCX) {
+        emitModRM({0xD3}, extension, dest);
+        return true;
+    }
+
+    // The count has to be in CL: RCX is parked in R11 meanwhile, and the
+    // destination uses R11 wherever it used RCX
+    if (dest.uses(HW_R11) || count.uses(HW_R11)) {
+        return fail("out of scratch registers");
+    }
+    MachineOperand rcx = MachineOperand::makeRegister(HW_RCX);
+    MachineOperand r11 = MachineOperand::makeRegister(HW_R11);
+    if (!move(r11, rcx) || !move(rcx, count)) {
+        return false;
+    }
+    emitModRM({0xD3}, extension, replaceRegister(dest, HW_RCX, HW_R11));
+    return move(rcx, r11);
+}
+
+bool X86_64Encoder::bitTest(uint8_t extension, uint8_t opcode, const MachineOperand& dest, const MachineOperand& bit) {
+    if (dest.kind != MachineOperand::REG && dest.kind != MachineOperand::MEM) {
+        return fail("destination must be a register or memory");
+    }
+
+    if (bit.kind == MachineOperand::IMM) {
+        // bt/bts/btr/btc r/m, imm8
+        emitModRM({0x0F, 0xBA}, extension, dest);
+        emit8(static_cast<uint8_t>(bit.imm & 63));
+        return true;
+    }
+
+    MachineOperand value;
+    if (!materialize(bit, pickScratch(dest, bit), value)) {
+        return false;
+    }
+    emitModRM({0x0F, opcode}, value.reg, dest);
+    return true;
+}
+
+bool X86_64Encoder::bitScan(uint8_t opcode, const MachineOperand& dest, const MachineOperand& source, bool leading) {
+    // BSR and BSF leave the result undefined and set ZF for zero, so the
+    // count for zero (64) is moved in with CMOVZ; for leading zeros the bit
+    // index is turned into a count with XOR 63 (127 ^ 63 = 64)
+    if (dest.uses(HW_R10) || dest.uses(HW_R11) || source.uses(HW_R10) || source.uses(HW_R11)) {
+        return fail("out of scratch registers");
+    }
+    MachineOperand result = MachineOperand::makeRegister(HW_R11);
+    MachineOperand zeroCount = MachineOperand::makeRegister(HW_R10);
+
+    MachineOperand value = source;
+    if (source.kind != MachineOperand::REG && source.kind != MachineOperand::MEM) {
+        if (!move(result, source)) {
+            return false;
+        }
+        value = result;
+    }
+    emitModRM({0x0F, opcode}, HW_R11, value);
+    move(zeroCount, MachineOperand::makeImmediate(leading ? 127 : 64));
+    conditionalMove(0x4, HW_R11, zeroCount);
+    if (leading) {
+        arithmetic(6, result, MachineOperand::makeImmediate(63));
+    }
+    return move(dest, result);
+}
+
+bool X86_64Encoder::conditionalMove(uint8_t condition, uint8_t hwReg, const MachineOperand& source) {
+    if (source.kind != MachineOperand::REG && source.kind != MachineOperand::MEM) {
+        return fail("conditional move source must be a register or memory");
+    }
+    emitModRM({0x0F, static_cast<uint8_t>(0x40 | condition)}, hwReg, source);
+    return true;
+}
+
+bool X86_64Encoder::push(const MachineOperand& source) {
+    switch (source.kind) {
+        case MachineOperand::REG:
+            emitRegisterOp(0x50, source.reg, false);
+            return true;
+        case MachineOperand::MEM:
+            emitModRM({0xFF}, 6, source, false);
+            return true;
+        case MachineOperand::IMM:
+            if (fitsInt32(source.imm)) {
+                emit8(0x68);
+                emit32(static_cast<uint32_t>(source.imm));
+                return true;
+            }
+            [[fallthrough]];
+        default: {
+            MachineOperand value;
+            return materialize(source, HW_R11, value) && push(value);
+        }
+    }
+}
+
+bool X86_64Encoder::pop(const MachineOperand& dest) {
+    switch (dest.kind) {
+        case MachineOperand::REG:
+            emitRegisterOp(0x58, dest.reg, false);
+            return true;
+        case MachineOperand::MEM:
+            emitModRM({0x8F}, 0, dest, false);
+            return true;
+        default:
+            return fail("destination must be a register or memory");
+    }
+}
+
+bool X86_64Encoder::parallelMove(std::vector<std::pair<MachineOperand, MachineOperand>> moves) {
+    for (size_t i = 0; i < moves.size();) {
+        if (moves[i].first == moves[i].second) {
+            moves.erase(moves.begin() + static_cast<std::ptrdiff_t>(i));
+        } else {
+            i++;
+        }
+    }
+
+    while (!moves.empty()) {
+        // Emit a move whose destination no other move still reads
+        bool progress = false;
+        for (size_t i = 0; i < moves.size() && !progress; i++) {
+            const MachineOperand& dest = moves[i].first;
+            bool blocked = false;
+            for (size_t j = 0; j < moves.size() && !blocked; j++) {
+                blocked = j != i && dest.kind == MachineOperand::REG && moves[j].second.uses(dest.reg);
+            }
+            if (!blocked) {
+                if (!move(dest, moves[i].second)) {
+                    return false;
+                }
+                moves.erase(moves.begin() + static_cast<std::ptrdiff_t>(i));
+                progress = true;
+            }
+        }
+        if (progress) {
+            continue;
+        }
+
+        // Only cycles are left: break one by parking a register in R11
+        for (const auto& pending : moves) {
+            if (pending.first.uses(HW_R11) || pending.second.uses(HW_R11)) {
+                return fail("out of scratch registers");
+            }
+        }
+        uint8_t parked = moves.front().first.reg;
+        move(MachineOperand::makeRegister(HW_R11), MachineOperand::makeRegister(parked));
+        for (auto& pending : moves) {
+            pending.second = replaceRegister(pending.second, parked, HW_R11);
+        }
+    }
+    return true;
+}
+
+bool X86_64Encoder::bitCount(uint8_t opcode, const MachineOperand& dest, const MachineOperand& source) {
+    // popcnt, lzcnt and tzcnt (F3 0F opcode) write a register
+    uint8_t scratch = pickScratch(dest, source);
+    MachineOperand value = source;
+    if (source.kind != MachineOperand::REG && source.kind != MachineOperand::MEM &&
+        !materialize(source, scratch, value)) {
+        return false;
+    }
+    if (dest.kind != MachineOperand::REG && scratch == MachineOperand::NO_REGISTER) {
+        return fail("out of scratch registers");
+    }
+    MachineOperand result = dest.kind == MachineOperand::REG ? dest : MachineOperand::makeRegister(scratch);
+    emitModRM({0x0F, opcode}, result.reg, value, true, 0xF3);
+    return move(dest, result);
+}
+
+bool X86_64Encoder::populationCount(const MachineOperand& dest, const MachineOperand& source) {
+    if (target.hasFeature(X86_64_FEATURE_POPCNT)) {
+        return bitCount(0xB8, dest, source);
+    }
+
+    // Without POPCNT, shift the bits out of R11 one at a time and add the
+    // carries up in R10
+    if (dest.uses(HW_R10) || dest.uses(HW_R11) || source.uses(HW_R10) || source.uses(HW_R11)) {
+        return fail("out of scratch registers");
+    }
+    MachineOperand value = MachineOperand::makeRegister(HW_R11);
+    MachineOperand count = MachineOperand::makeRegister(HW_R10);
+    if (!move(value, source) || !move(count, MachineOperand::makeImmediate(0))) {
+        return false;
+    }
+    size_t loop = code.size();
+    emitModRM({0xD1}, 5, value);                          // shr r11, 1
+    arithmetic(2, count, MachineOperand::makeImmediate(0)); // adc r10, 0
+    test(value, value);
+    emit8(0x75); // jnz loop
+    emit8(static_cast<uint8_t>(loop - (code.size() + 1)));
+    return move(dest, count);
+}
+
+bool X86_64Encoder::vectorMove(const MachineOperand& dest, const MachineOperand& source) {
+    if (dest == source) {
+        return true;
+    }
+
+    // movdqu (vmovdqu64 with EVEX); vector memory need not be aligned
+    bool evex = vectorWidth == 64;
+    const VectorOpcode load = {0xF3, 1, 0x6F, evex};
+    const VectorOpcode store = {0xF3, 1, 0x7F, evex};
+    if (dest.kind == MachineOperand::VEC && (source.kind == MachineOperand::VEC || source.kind == MachineOperand::MEM)) {
+        emitVector(load, dest.reg, MachineOperand::NO_REGISTER, source, vectorWidth);
+        return true;
+    }
+    if (dest.kind == MachineOperand::MEM && source.kind == MachineOperand::VEC) {
+        emitVector(store, source.reg, MachineOperand::NO_REGISTER, dest, vectorWidth);
+        return true;
+    }
+    if (dest.kind == MachineOperand::MEM && source.kind == MachineOperand::MEM) {
+        MachineOperand value = MachineOperand::makeVector(15);
+        return vectorMove(value, source) && vectorMove(dest, value);
+    }
+    return fail("vector operands must be vector registers or memory");
+}
+
+bool X86_64Encoder::vectorBinary(const VectorOpcode& op, bool commutative, const MachineOperand& dest,
+                                 const MachineOperand& a, const MachineOperand& b) {
+    // VEX and EVEX take the first source in vvvv and leave it intact; spilled
+    // operands go through XMM14 (first source) and XMM15 (result)
+    if (target.hasFeature(X86_64_FEATURE_AVX)) {
+        MachineOperand first = a;
+        if (a.kind != MachineOperand::VEC) {
+            first = MachineOperand::makeVector(14);
+            if (!vectorMove(first, a)) {
+                return false;
+            }
+        }
+        MachineOperand result = dest.kind == MachineOperand::VEC ? dest : MachineOperand::makeVector(15);
+        emitVector(op, result.reg, first.reg, b, vectorWidth);
+        return vectorMove(dest, result);
+    }
+
+    // SSE computes dest op= source, as binary() does for integer registers
+    if (dest.kind == MachineOperand::VEC) {
+        if (dest == a) {
+            emitVector(op, dest.reg, dest.reg, b, vectorWidth);
+            return true;
+        }
+        if (commutative && dest == b) {
+            emitVector(op, dest.reg, dest.reg, a, vectorWidth);
+            return true;
+        }
+        if (dest != b) {
+            if (!vectorMove(dest, a)) {
+                return false;
+            }
+            emitVector(op, dest.reg, dest.reg, b, vectorWidth);
+            return true;
+        }
+    }
+    MachineOperand result = MachineOperand::makeVector(15);
+    if (!vectorMove(result, a)) {
+        return false;
+    }
+    emitVector(op, result.reg, result.reg, b, vectorWidth);
+    return vectorMove(dest, result);
+}
+
+bool X86_64Encoder::vectorSplat(uint8_t elementSize, const MachineOperand& dest, const MachineOperand& scalar) {
+    // Get the scalar into the low element of an XMM register: FP registers
+    // already hold it, anything else is copied in with movq xmm15, r/m64
+    MachineOperand low = scalar;
+    if (scalar.kind != MachineOperand::VEC) {
+        MachineOperand value = scalar;
+        if (scalar.kind != MachineOperand::REG && scalar.kind != MachineOperand::MEM &&
+            !materialize(scalar, HW_R11, value)) {
+            return false;
+        }
+        low = MachineOperand::makeVector(15);
+        emitVector({0x66, 1, 0x6E, true}, low.reg, MachineOperand::NO_REGISTER, value, 16);
+    }
+
+    MachineOperand result = dest.kind == MachineOperand::VEC ? dest : MachineOperand::makeVector(15);
+    if (target.hasFeature(X86_64_FEATURE_AVX2)) {
+        // vpbroadcastb/w/d/q
+        if (vectorWidth == 64 && elementSize < 4) {
+            return fail("8- and 16-bit elements require AVX-512BW");
+        }
+        uint8_t opcode = elementSize == 1 ? 0x78 : elementSize == 2 ? 0x79 : elementSize == 4 ? 0x58 : 0x59;
+        emitVector({0x66, 2, opcode, vectorWidth == 64 && elementSize == 8}, result.reg, MachineOperand::NO_REGISTER,
+                   low, vectorWidth);
+        return vectorMove(dest, result);
+    }
+
+    // SSE2 shuffles: double bytes into words (punpcklbw), spread the low
+    // word over the low quadword (pshuflw), then spread the low dword or
+    // quadword over the register (pshufd)
+    const VectorOpcode unpackBytes = {0x66, 1, 0x60, false};
+    const VectorOpcode shuffleLow = {0xF2, 1, 0x70, false};
+    const VectorOpcode shuffle = {0x66, 1, 0x70, false};
+    MachineOperand source = low;
+    if (elementSize == 1) {
+        if (!vectorMove(result, low)) {
+            return false;
+        }
+        emitVector(unpackBytes, result.reg, result.reg, result, 16);
+        source = result;
+    }
+    if (elementSize <= 2) {
+        emitVector(shuffleLow, result.reg, MachineOperand::NO_REGISTER, source, 16);
+        emit8(0x00);
+        source = result;
+    }
+    emitVector(shuffle, result.reg, MachineOperand::NO_REGISTER, source, 16);
+    emit8(elementSize == 8 ? 0x44 : 0x00);
+    return vectorMove(dest, result);
+}
+
+template <typename Operation>
+bool X86_64Encoder::binary(const Instruction& inst, bool commutative, Operation operation) {
+    size_t count = inst.getOperandCount();
+    if (count != 2 && count != 3) {
+        return fail("expected two or three operands");
+    }
+    std::vector<MachineOperand> operands;
+    if (!resolveAll(inst, count, operands)) {
+        return false;
+    }
+
+    const MachineOperand& dest = operands[0];
+    if (count == 2) {
+        return operation(dest, operands[1]);
+    }
+
+    const MachineOperand& a = operands[1];
+    const MachineOperand& b = operands[2];
+    if (dest == a) {
+        return operation(dest, b);
+    }
+    if (commutative && dest == b) {
+        return operation(dest, a);
+    }
+    if (dest != b && !(dest.kind == MachineOperand::REG && b.uses(dest.reg))) {
+        return move(dest, a) && operation(dest, b);
+    }
+
+    // Writing dest first would clobber b
+    uint8_t scratch = pickScratch(dest, a, b);
+    if (scratch == MachineOperand::NO_REGISTER) {
+        return fail("out of scratch registers");
+    }
+    MachineOperand result = MachineOperand::makeRegister(scratch);
+    return move(result, a) && operation(result, b) && move(dest, result);
+}
+
+template <typename Operation>
+bool X86_64Encoder::inPlace(const Instruction& inst, Operation operation) {
+    size_t count = inst.getOperandCount();
+    if (count != 1 && count != 2) {
+        return fail("expected one or two operands");
+    }
+    std::vector<MachineOperand> operands;
+    if (!resolveAll(inst, count, operands)) {
+        return false;
+    }
+
+    if (count == 2 && !move(operands[0], operands[1])) {
+        return false;
+    }
+    return operation(operands[0]);
+}
+
+bool X86_64Encoder::encodeInstruction(const Instruction& inst) {
+    nextAddressScratch = HW_R10;
+
+    switch (inst.getCategory()) {
+        case CAT_CF:
+            return encodeControlFlow(inst);
+        case CAT_MEM:
+            return encodeMemory(inst);
+        case CAT_MATH:
+            return encodeMath(inst);
+        case CAT_BIT:
+            return encodeBit(inst);
+        case CAT_VEC:
+            return encodeVector(inst);
+        case CAT_FRAME:
+            return encodeFrame(inst);
+        case CAT_VAR:
+            return encodeVariable(inst);
+        default:
+            return fail("instruction category is not supported");
+    }
+}
+
+bool X86_64Encoder::encodeMemory(const Instruction& inst) {
+    std::vector<MachineOperand> operands;
+    MachineOperand dest;
+    MachineOperand source;
+
+    switch (inst.getOperation()) {
+        case MEM_MOV:
+            return resolveAll(inst, 2, operands) && move(operands[0], operands[1]);
+
+        case MEM_LOAD:
+            if (inst.getOperandCount() != 2) {
+                return fail("expected two operands");
+            }
+            return resolve(inst, 0, dest) && resolveAddress(inst, 1, source) && move(dest, source);
+
+        case MEM_STORE:
+            if (inst.getOperandCount() != 2) {
+                return fail("expected two operands");
+            }
+            return resolveAddress(inst, 0, dest) && resolve(inst, 1, source) && move(dest, source);
+
+        case MEM_PUSH:
+            for (size_t i = 0; i < inst.getOperandCount(); i++) {
+                nextAddressScratch = HW_R10;
+                if (!resolve(inst, i, source) || !push(source)) {
+                    return false;
+                }
+            }
+            return true;
+
+        case MEM_POP:
+            for (size_t i = 0; i < inst.getOperandCount(); i++) {
+                nextAddressScratch = HW_R10;
+                if (!resolve(inst, i, dest) || !pop(dest)) {
+                    return false;
+                }
+            }
+            return true;
+
+        case MEM_EXCHANGE: {
+            if (!resolveAll(inst, 2, operands)) {
+                return false;
+            }
+            const MachineOperand& a = operands[0];
+            const MachineOperand& b = operands[1];
+            if (a.kind == MachineOperand::REG && (b.kind == MachineOperand::REG || b.kind == MachineOperand::MEM)) {
+                emitModRM({0x87}, a.reg, b);
+                return true;
+            }
+            if (b.kind == MachineOperand::REG && a.kind == MachineOperand::MEM) {
+                emitModRM({0x87}, b.reg, a);
+                return true;
+            }
+            if (a.kind != MachineOperand::MEM || b.kind != MachineOperand::MEM) {
+                return fail("operands must be registers or memory");
+            }
+
+            // Two memory operands go through a scratch register
+            uint8_t scratch = pickScratch(a, b);
+            if (scratch == MachineOperand::NO_REGISTER) {
+                return fail("out of scratch registers");
+            }
+            MachineOperand value = MachineOperand::makeRegister(scratch);
+            if (!move(value, a)) {
+                return false;
+            }
+            emitModRM({0x87}, scratch, b);
+            return move(a, value);
+        }
+
+        case MEM_COMPARE: {
+            if (!resolveAll(inst, 2, operands)) {
+                return false;
+            }
+            MachineOperand left = operands[0];
+            if (left.kind == MachineOperand::IMM || left.kind == MachineOperand::SYMBOL) {
+                if (!materialize(operands[0], pickScratch(operands[1]), left)) {
+                    return false;
+                }
+            }
+            return arithmetic(7, left, operands[1]);
+        }
+
+        case MEM_TEST:
+            return resolveAll(inst, 2, operands) && test(operands[0], operands[1]);
+
+        case MEM_PREFETCH:
+            if (inst.getOperandCount() != 1) {
+                return fail("expected one operand");
+            }
+            if (!resolveAddress(inst, 0, source)) {
+                return false;
+            }
+            emitModRM({0x0F, 0x18}, 1, source, false); // prefetcht0
+            return true;
+
+        default:
+            return fail("memory operation is not supported");
+    }
+}
+
+bool X86_64Encoder::encodeMath(const Instruction& inst) {
+    auto minMax = [this](uint8_t condition) {
+        // Replace dest with src when the comparison says src wins
+        return [this, condition](const MachineOperand& dest, const MachineOperand& source) {
+            if (dest.kind != MachineOperand::REG) {
+                uint8_t scratch = pickScratch(dest, source);
+                if (scratch == MachineOperand::NO_REGISTER) {
+                    return fail("out of scratch registers");
+                }
+                MachineOperand value = MachineOperand::makeRegister(scratch);
+                return move(value, dest) && arithmetic(7, value, source) &&
+                       conditionalMove(condition, scratch, source) && move(dest, value);
+            }
+            MachineOperand value = source;
+            if (source.kind != MachineOperand::MEM && !materialize(source, pickScratch(dest, source), value)) {
+                return false;
+            }
+            return arithmetic(7, dest, value) && conditionalMove(condition, dest.reg, value);
+        };
+    };
+
+    switch (inst.getOperation()) {
+        case MATH_ADD:
+            return binary(inst, true, [this](const MachineOperand& dest, const MachineOperand& source) {
+                return arithmetic(0, dest, source);
+            });
+        case MATH_SUB:
+            return binary(inst, false, [this](const MachineOperand& dest, const MachineOperand& source) {
+                return arithmetic(5, dest, source);
+            });
+        case MATH_MUL:
+            return binary(inst, true, [this](const MachineOperand& dest, const MachineOperand& source) {
+                return multiply(dest, source);
+            });
+        case MATH_DIV:
+        case MATH_MOD: {
+            size_t count = inst.getOperandCount();
+            std::vector<MachineOperand> operands;
+            if (count != 2 && count != 3) {
+                return fail("expected two or three operands");
+            }
+            if (!resolveAll(inst, count, operands)) {
+                return false;
+            }
+            return divide(operands[0], operands[count - 2], operands[count - 1], inst.getOperation() == MATH_MOD);
+        }
+        case MATH_NEG:
+            return inPlace(inst, [this](const MachineOperand& dest) { return unary(0xF7, 3, dest); });
+        case MATH_INC:
+            return inPlace(inst, [this](const MachineOperand& dest) { return unary(0xFF, 0, dest); });
+        case MATH_DEC:
+            return inPlace(inst, [this](const MachineOperand& dest) { return unary(0xFF, 1, dest); });
+        case MATH_ABS: {
+            size_t count = inst.getOperandCount();
+            std::vector<MachineOperand> operands;
+            if (count != 1 && count != 2) {
+                return fail("expected one or two operands");
+            }
+            if (!resolveAll(inst, count, operands)) {
+                return false;
+            }
+            const MachineOperand& dest = operands[0];
+            const MachineOperand& source = operands[count - 1];
+            if (source.kind == MachineOperand::IMM) {
+                return move(dest, MachineOperand::makeImmediate(source.imm < 0 ? -source.imm : source.imm));
+            }
+
+            // neg, then take the original back if the negation came out negative
+            uint8_t scratch = pickScratch(dest, source);
+            if (scratch == MachineOperand::NO_REGISTER) {
+                return fail("out of scratch registers");
+            }
+            MachineOperand value = MachineOperand::makeRegister(scratch);
+            return move(value, source) && unary(0xF7, 3, value) && conditionalMove(0x8, scratch, source) &&
+                   move(dest, value);
+        }
+        case MATH_MIN:
+            return binary(inst, true, minMax(0xF)); // cmovg
+        case MATH_MAX:
+            return binary(inst, true, minMax(0xC)); // cmovl
+        default:
+            return fail("floating-point arithmetic is not supported");
+    }
+}
+
+bool X86_64Encoder::encodeBit(const Instruction& inst) {
+    auto logical = [this](uint8_t extension) {
+        return [this, extension](const MachineOperand& dest, const MachineOperand& source) {
+            return arithmetic(extension, dest, source);
+        };
+    };
+    auto negated = [this](uint8_t extension) {
+        // dest op= ~source
+        return [this, extension](const MachineOperand& dest, const MachineOperand& source) {
+            if (extension == 4 && target.hasFeature(X86_64_FEATURE_BMI1) &&
+                dest.kind == MachineOperand::REG && source.kind == MachineOperand::REG) {
+                // andn dest, source, dest
+                emitVex({0, 2, 0xF2, true}, dest.reg, source.reg, dest, false);
+                return true;
+            }
+            uint8_t scratch = pickScratch(dest, source);
+            if (scratch == MachineOperand::NO_REGISTER) {
+                return fail("out of scratch registers");
+            }
+            MachineOperand value = MachineOperand::makeRegister(scratch);
+            return move(value, source) && unary(0xF7, 2, value) && arithmetic(extension, dest, value);
+        };
+    };
+    auto shifter = [this](uint8_t extension) {
+        return [this, extension](const MachineOperand& dest, const MachineOperand& count) {
+            // BMI2 shifts (shlx, shrx, sarx) take the count in any register
+            bool bmi2Form = extension == 4 || extension == 5 || extension == 7;
+            if (bmi2Form && target.hasFeature(X86_64_FEATURE_BMI2) && dest.kind == MachineOperand::REG &&
+                count.kind == MachineOperand::REG && count.reg != HW_RCX) {
+                uint8_t prefix = extension == 4 ? 0x66 : extension == 5 ? 0xF2 : 0xF3;
+                emitVex({prefix, 2, 0xF7, true}, dest.reg, count.reg, dest, false);
+                return true;
+            }
+            return shift(extension, dest, count);
+        };
+    };
+    auto bitOp = [this, &inst](uint8_t extension, uint8_t opcode) {
+        std::vector<MachineOperand> operands;
+        return resolveAll(inst, 2, operands) && bitTest(extension, opcode, operands[0], operands[1]);
+    };
+    auto scan = [this, &inst](uint8_t opcode, bool leading, uint32_t countFeature) {
+        size_t count = inst.getOperandCount();
+        std::vector<MachineOperand> operands;
+        if (count != 1 && count != 2) {
+            return fail("expected one or two operands");
+        }
+        if (!resolveAll(inst, count, operands)) {
+            return false;
+        }
+        // lzcnt and tzcnt share the opcodes of bsr and bsf, and count 64 for zero
+        if (target.hasFeature(countFeature)) {
+            return bitCount(opcode, operands[0], operands[count - 1]);
+        }
+        return bitScan(opcode, operands[0], operands[count - 1], leading);
+    };
+
+    switch (inst.getOperation()) {
+        case BIT_AND:
+            return binary(inst, true, logical(4));
+        case BIT_OR:
+            return binary(inst, true, logical(1));
+        case BIT_XOR:
+            return binary(inst, true, logical(6));
+        case BIT_NOT:
+            return inPlace(inst, [this](const MachineOperand& dest) { return unary(0xF7, 2, dest); });
+        case BIT_ANDN:
+            return binary(inst, false, negated(4));
+        case BIT_ORN:
+            return binary(inst, false, negated(1));
+        case BIT_XNOR:
+            return binary(inst, true, [this](const MachineOperand& dest, const MachineOperand& source) {
+                return arithmetic(6, dest, source) && unary(0xF7, 2, dest);
+            });
+        case BIT_SHL:
+            return binary(inst, false, shifter(4));
+        case BIT_SHR:
+            return binary(inst, false, shifter(5));
+        case BIT_SAR:
+            return binary(inst, false, shifter(7));
+        case BIT_ROL:
+            return binary(inst, false, shifter(0));
+        case BIT_ROR:
+            return binary(inst, false, shifter(1));
+        case BIT_RCL:
+            return binary(inst, false, shifter(2));
+        case BIT_RCR:
+            return binary(inst, false, shifter(3));
+        case BIT_BSWAP:
+            return inPlace(inst, [this](const MachineOperand& dest) {
+                if (dest.kind == MachineOperand::REG) {
+                    emit8(0x48 | ((dest.reg & 8) ? 0x01 : 0));
+                    emit8(0x0F);
+                    emit8(0xC8 | (dest.reg & 7));
+                    return true;
+                }
+                uint8_t scratch = pickScratch(dest);
+                MachineOperand value = MachineOperand::makeRegister(scratch);
+                if (scratch == MachineOperand::NO_REGISTER || !move(value, dest)) {
+                    return fail("out of scratch registers");
+                }
+                emit8(0x48 | ((scratch & 8) ? 0x01 : 0));
+                emit8(0x0F);
+                emit8(0xC8 | (scratch & 7));
+                return move(dest, value);
+            });
+        case BIT_CLZ:
+            return scan(0xBD, true, X86_64_FEATURE_LZCNT);  // lzcnt or bsr
+        case BIT_CTZ:
+            return scan(0xBC, false, X86_64_FEATURE_BMI1);  // tzcnt or bsf
+        case BIT_POPCNT: {
+            size_t count = inst.getOperandCount();
+            std::vector<MachineOperand> operands;
+            if (count != 1 && count != 2) {
+                return fail("expected one or two operands");
+            }
+            return resolveAll(inst, count, operands) && populationCount(operands[0], operands[count - 1]);
+        }
+        case BIT_SET:
+            return bitOp(5, 0xAB); // bts
+        case BIT_CLR:
+            return bitOp(6, 0xB3); // btr
+        case BIT_TGL:
+            return bitOp(7, 0xBB); // btc
+        case BIT_TST:
+            return bitOp(4, 0xA3); // bt
+        case BIT_CMP: {
+            std::vector<MachineOperand> operands;
+            if (!resolveAll(inst, 2, operands)) {
+                return false;
+            }
+            MachineOperand left = operands[0];
+            if (left.kind == MachineOperand::IMM || left.kind == MachineOperand::SYMBOL) {
+                if (!materialize(operands[0], pickScratch(operands[1]), left)) {
+                    return false;
+                }
+            }
+            return arithmetic(7, left, operands[1]);
+        }
+        default:
+            return fail("bit operation is not supported");
+    }
+}
+
+bool X86_64Encoder::encodeVector(const Instruction& inst) {
+    VectorElement element;
+    if (!vectorElement(inst, element)) {
+        return fail("unknown vector element type");
+    }
+    bool evex = vectorWidth == 64;
+    bool wide = evex && element.size == 8;
+    uint8_t operation = inst.getOperation();
+    size_t count = inst.getOperandCount();
+    std::vector<MachineOperand> operands(3);
+
+    switch (operation) {
+        case VEC_MOV:
+            if (count != 2) {
+                return fail("expected two operands");
+            }
+            return resolveVector(inst, 0, operands[0]) && resolveVector(inst, 1, operands[1]) &&
+                   vectorMove(operands[0], operands[1]);
+
+        case VEC_LOAD:
+            if (count != 2) {
+                return fail("expected two operands");
+            }
+            return resolveVector(inst, 0, operands[0]) && resolveAddress(inst, 1, operands[1]) &&
+                   vectorMove(operands[0], operands[1]);
+
+        case VEC_STORE:
+            if (count != 2) {
+                return fail("expected two operands");
+            }
+            return resolveAddress(inst, 0, operands[0]) && resolveVector(inst, 1, operands[1]) &&
+                   vectorMove(operands[0], operands[1]);
+
+        case VEC_SPLAT:
+            if (count != 2) {
+                return fail("expected two operands");
+            }
+            return resolveVector(inst, 0, operands[0]) && resolve(inst, 1, operands[1]) &&
+                   vectorSplat(element.size, operands[0], operands[1]);
+
+        case VEC_LANES:
+            if (count != 1) {
+                return fail("expected one operand");
+            }
+            return resolve(inst, 0, operands[0]) &&
+                   move(operands[0], MachineOperand::makeImmediate(vectorWidth / element.size));
+
+        case VEC_SQRT: {
+            if (count != 1 && count != 2) {
+                return fail("expected one or two operands");
+            }
+            if (!element.isFloat) {
+                return fail("square root needs a floating-point element type");
+            }
+            if (!resolveVector(inst, 0, operands[0]) || !resolveVector(inst, count - 1, operands[1])) {
+                return false;
+            }
+            // sqrtps/sqrtpd do not read their destination
+            MachineOperand result = operands[0].kind == MachineOperand::VEC ? operands[0]
+                                                                             : MachineOperand::makeVector(15);
+            emitVector({static_cast<uint8_t>(element.size == 8 ? 0x66 : 0), 1, 0x51, wide}, result.reg,
+                       MachineOperand::NO_REGISTER, operands[1], vectorWidth);
+            return vectorMove(operands[0], result);
+        }
+
+        default:
+            break;
+    }
+
+    // Element-wise and bitwise operations: dest = a op b, or dest op= b
+    if (count != 2 && count != 3) {
+        return fail("expected two or three operands");
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!resolveVector(inst, i, operands[i])) {
+            return false;
+        }
+    }
+    const MachineOperand& a = operands[count - 2];
+    const MachineOperand& b = operands[count - 1];
+
+    // Bitwise operations ignore the element type
+    switch (operation) {
+        case VEC_AND:
+            return vectorBinary({0x66, 1, 0xDB, wide}, true, operands[0], a, b); // pand
+        case VEC_OR:
+            return vectorBinary({0x66, 1, 0xEB, wide}, true, operands[0], a, b); // por
+        case VEC_XOR:
+            return vectorBinary({0x66, 1, 0xEF, wide}, true, operands[0], a, b); // pxor
+        default:
+            break;
+    }
+
+    bool commutative = operation == VEC_ADD || operation == VEC_MUL;
+    if (element.isFloat) {
+        // addps/addpd and friends; minps and maxps return the second operand
+        // for NaNs, so they do not commute
+        uint8_t opcode;
+        switch (operation) {
+            case VEC_ADD: opcode = 0x58; break;
+            case VEC_SUB: opcode = 0x5C; break;
+            case VEC_MUL: opcode = 0x59; break;
+            case VEC_DIV: opcode = 0x5E; break;
+            case VEC_MIN: opcode = 0x5D; break;
+            case VEC_MAX: opcode = 0x5F; break;
+            default:
+                return fail("vector operation is not supported");
+        }
+        return vectorBinary({static_cast<uint8_t>(element.size == 8 ? 0x66 : 0), 1, opcode, wide}, commutative,
+                            operands[0], a, b);
+    }
+
+    IntegerVectorForm form = integerVectorForm(operation, element);
+    if (form.map == 0) {
+        return fail("no vector instruction for " + std::to_string(element.size * 8) + "-bit integer elements");
+    }
+    if (form.feature != 0 && !target.hasFeature(form.feature)) {
+        return fail(std::string("vector instruction requires ") +
+                    (form.feature == X86_64_FEATURE_SSE4_1 ? "SSE4.1" : "AVX-512F"));
+    }
+    if (evex && element.size < 4) {
+        return fail("8- and 16-bit elements require AVX-512BW");
+    }
+    commutative = commutative || operation == VEC_MIN || operation == VEC_MAX;
+    return vectorBinary({0x66, form.map, form.opcode, wide}, commutative, operands[0], a, b);
+}
+
+bool X86_64Encoder::encodeControlFlow(const Instruction& inst) {
+    MachineOperand destination;
+
+    switch (inst.getOperation()) {
+        case CF_BR:
+            if (inst.getOperandCount() < 1 || !resolve(inst, 0, destination)) {
+                return fail("expected a branch target");
+            }
+            if (destination.kind == MachineOperand::SYMBOL) {
+                emit8(0xE9); // jmp rel32
+                emitRel32(destination.symbol, 1, 0xEB);
+                return true;
+            }
+            if (destination.kind != MachineOperand::REG && destination.kind != MachineOperand::MEM) {
+                return fail("branch target must be a symbol, register or memory");
+            }
+            emitModRM({0xFF}, 4, destination, false); // jmp r/m64
+            return true;
+
+        case CF_BRC: {
+            const auto& extended = inst.getExtendedData();
+            uint8_t condition;
+            if (extended.empty() || !conditionCode(extended[0], condition)) {
+                return fail("missing or unknown condition code");
+            }
+            if (inst.getOperandCount() < 1 || !resolve(inst, 0, destination)) {
+                return fail("expected a branch target");
+            }
+            if (destination.kind == MachineOperand::SYMBOL) {
+                emit8(0x0F);
+                emit8(0x80 | condition); // jcc rel32
+                emitRel32(destination.symbol, 2, 0x70 | condition);
+                return true;
+            }
+            if (destination.kind != MachineOperand::REG && destination.kind != MachineOperand::MEM) {
+                return fail("branch target must be a symbol, register or memory");
+            }
+
+            // Skip an indirect jmp when the inverse condition holds
+            emit8(0x70 | (condition ^ 1));
+            size_t skip = code.size();
+            emit8(0);
+            emitModRM({0xFF}, 4, destination, false);
+            code[skip] = static_cast<uint8_t>(code.size() - skip - 1);
+            return true;
+        }
+
+        case CF_CALL:
+        case CF_SYSC:
+            return encodeCall(inst);
+
+        case CF_RET: {
+            if (fixedMapping) {
+                emit8(0xC3);
+                return true;
+            }
+
+            // Return values go into the function ABI's result registers
+            const AbiDefinition* abi = target.getAbi();
+            std::vector<uint8_t> retRegs;
+            if (abi) {
+                for (uint8_t vregId : abi->retRegs) {
+                    uint8_t pregId = target.getPhysicalRegister(vregId);
+                    if (pregId > X86_64_R15) {
+                        return fail("ABI result register is not a general-purpose register");
+                    }
+                    retRegs.push_back(hardwareRegisters[pregId]);
+                }
+            } else {
+                retRegs.assign(std::begin(defaultRetRegisters), std::end(defaultRetRegisters));
+            }
+
+            size_t count = inst.getOperandCount();
+            if (count > retRegs.size()) {
+                return fail("too many return values");
+            }
+            std::vector<MachineOperand> operands;
+            if (!resolveAll(inst, count, operands)) {
+                return false;
+            }
+            std::vector<std::pair<MachineOperand, MachineOperand>> moves;
+            for (size_t i = 0; i < count; i++) {
+                moves.push_back({MachineOperand::makeRegister(retRegs[i]), operands[i]});
+            }
+            if (!parallelMove(std::move(moves))) {
+                return false;
+            }
+            if (wideVectors) {
+                emitVzeroupper();
+            }
+
+            if (!hasFrame) {
+                emit8(0xC3);
+                return true;
+            }
+            return encodeSequence(target.generateEpilogue(allocation));
+        }
+
+        case CF_INT: {
+            if (inst.getOperandCount() != 1 || !resolve(inst, 0, destination) ||
+                destination.kind != MachineOperand::IMM || destination.imm < 0 || destination.imm > 0xFF) {
+                return fail("expected an interrupt number");
+            }
+            if (destination.imm == 3) {
+                emit8(0xCC); // int3
+            } else {
+                emit8(0xCD);
+                emit8(static_cast<uint8_t>(destination.imm));
+            }
+            return true;
+        }
+
+        case CF_IRET:
+            emit8(0x48);
+            emit8(0xCF); // iretq
+            return true;
+        case CF_HLT:
+            emit8(0xF4);
+            return true;
+        case CF_TRAP:
+            emit8(0x0F);
+            emit8(0x0B); // ud2
+            return true;
+        case CF_FENCE:
+            emit8(0x0F);
+            emit8(0xAE);
+            emit8(0xF0); // mfence
+            return true;
+        case CF_YIELD:
+            emit8(0xF3);
+            emit8(0x90); // pause
+            return true;
+        case CF_NOP:
+            emit8(0x90);
+            return true;
+        default:
+            return fail("control flow operation is not supported");
+    }
+}
+
+bool X86_64Encoder::encodeCall(const Instruction& inst) {
+    // CF CALL [abi] callee [args] [-> results]
+    // CF SYSC [abi] number [args] [-> results]
+    size_t count = inst.getOperandCount();
+    size_t firstOutput = count;
+    const auto& extended = inst.getExtendedData();
+    if (!extended.empty() && extended.back() <= count) {
+        firstOutput = count - extended.back();
+    }
+
+    size_t next = 0;
+    const AbiDefinition* abi = nullptr;
+    if (count > 0 && inst.getOperandValue(0).getClass() == OPERAND_IMMEDIATE &&
+        inst.getOperandValue(0).getSubtype() == IMM_SYMBOL) {
+        abi = target.findAbi(symbolName(inst, 0));
+        if (abi) {
+            next = 1;
+        }
+    }
+    if (!abi) {
+        abi = target.getAbi();
+    }
+
+    std::vector<uint8_t> argRegs;
+    std::vector<uint8_t> retRegs;
+    if (abi) {
+        for (const auto* list : {&abi->argRegs, &abi->retRegs}) {
+            for (uint8_t vregId : *list) {
+                uint8_t pregId = target.getPhysicalRegister(vregId);
+                if (pregId > X86_64_R15) {
+                    return fail("ABI register is not a general-purpose register");
+                }
+                (list == &abi->argRegs ? argRegs : retRegs).push_back(hardwareRegisters[pregId]);
+            }
+        }
+    } else {
+        argRegs.assign(std::begin(defaultArgRegisters), std::end(defaultArgRegisters));
+        retRegs.assign(std::begin(defaultRetRegisters), std::end(defaultRetRegisters));
+    }
+
+    if (next >= firstOutput) {
+        return fail(inst.getOperation() == CF_SYSC ? "expected a system call number" : "expected a call target");
+    }
+    if (firstOutput - next - 1 > argRegs.size() || count - firstOutput > retRegs.size()) {
+        return fail("more arguments or results than the ABI has registers");
+    }
+
+    std::vector<MachineOperand> operands;
+    if (!resolveAll(inst, count, operands)) {
+        return false;
+    }
+
+    // Arguments, the system call number (RAX) and an indirect target (R10)
+    // are moved into place together
+    std::vector<std::pair<MachineOperand, MachineOperand>> moves;
+    for (size_t i = next + 1; i < firstOutput; i++) {
+        moves.push_back({MachineOperand::makeRegister(argRegs[i - next - 1]), operands[i]});
+    }
+
+    const MachineOperand& callee = operands[next];
+    if (inst.getOperation() == CF_SYSC) {
+        moves.push_back({MachineOperand::makeRegister(HW_RAX), callee});
+    } else if (callee.kind != MachineOperand::SYMBOL) {
+        for (const auto& pending : moves) {
+            if (pending.first.uses(HW_R10)) {
+                return fail("out of scratch registers");
+            }
+        }
+        moves.push_back({MachineOperand::makeRegister(HW_R10), callee});
+    }
+    if (!parallelMove(std::move(moves))) {
+        return false;
+    }
+    if (wideVectors) {
+        emitVzeroupper();
+    }
+
+    if (inst.getOperation() == CF_SYSC) {
+        emit8(0x0F);
+        emit8(0x05); // syscall
+    } else if (callee.kind == MachineOperand::SYMBOL) {
+        emit8(0xE8); // call rel32 (there is no shorter form)
+        emitRel32(callee.symbol, 1, 0, true);
+    } else {
+        emitModRM({0xFF}, 2, MachineOperand::makeRegister(HW_R10), false); // call r10
+    }
+
+    // Results come back in the ABI's result registers
+    moves.clear();
+    for (size_t i = firstOutput; i < count; i++) {
+        moves.push_back({operands[i], MachineOperand::makeRegister(retRegs[i - firstOutput])});
+    }
+    return parallelMove(std::move(moves));
+}
+
+bool X86_64Encoder::encodeVariable(const Instruction& inst) {
+    std::vector<MachineOperand> operands;
+
+    switch (inst.getOperation()) {
+        case VAR_DECL:
+            // Storage is laid out ahead of time; only the initial value is code
+            if (inst.getOperandCount() < 2) {
+                return true;
+            }
+            return resolveAll(inst, 2, operands) && move(operands[0], operands[1]);
+
+        case VAR_PMT:
+        case VAR_DMT:
+        case VAR_DLT:
+            // Only change how long the variable lives
+            return true;
+
+        default:
+            return fail("variable operation is not supported");
+    }
+}
+
+bool X86_64Encoder::encodeFrame(const Instruction& inst) {
+    MachineOperand operand;
+
+    switch (inst.getOperation()) {
+        case FRAME_ENTER:
+        case FRAME_LEAVE:
+            // The prologue runs on entry and the epilogue at each return
+            return true;
+
+        case FRAME_SAVE:
+            for (size_t i = 0; i < inst.getOperandCount(); i++) {
+                nextAddressScratch = HW_R10;
+                if (!resolve(inst, i, operand) || !push(operand)) {
+                    return false;
+                }
+            }
+            return true;
+
+        case FRAME_REST:
+            for (size_t i = inst.getOperandCount(); i-- > 0;) {
+                nextAddressScratch = HW_R10;
+                if (!resolve(inst, i, operand) || !pop(operand)) {
+                    return false;
+                }
+            }
+            return true;
+
+        default:
+            return fail("frame operation is not supported");
+    }
+}
+
+bool X86_64Encoder::encodeSequence(const std::vector<std::unique_ptr<Instruction>>& instructions) {
+    bool wasFixed = fixedMapping;
+    fixedMapping = true;
+
+    bool success = true;
+    for (const auto& inst : instructions) {
+        if (!encodeInstruction(*inst)) {
+            success = false;
+            break;
+        }
+    }
+
+    fixedMapping = wasFixed;
+    return success;
+}
+
+bool X86_64Encoder::resolveLabelFixups(std::vector<size_t>& offsets, size_t firstRelocation) {
+    const auto& labels = func.getLabels();
+    size_t count = labelFixups.size();
+
+    // Offset of the instruction each branch goes to
+    std::vector<size_t> targets(count);
+    for (size_t i = 0; i < count; i++) {
+        size_t targetIndex = labels.at(labelFixups[i].label);
+        if (targetIndex >= offsets.size()) {
+            LOG_ERROR("Label {} lies outside {}", labelFixups[i].label, func.getName());
+            return false;
+        }
+        targets[i] = offsets[targetIndex];
+    }
+
+    // Every branch was emitted with a rel32 field. Shortening one only
+    // brings the others closer to their labels, so branches whose label
+    // is in reach of a rel8 field are shortened until none is left
+    std::vector<char> shortened(count, 0);
+    std::vector<size_t> removed(count + 1, 0); // Bytes saved by the branches before each one
+    auto relocate = [this, &removed](size_t offset) {
+        auto it = std::upper_bound(labelFixups.begin(), labelFixups.end(), offset,
+                                   [](size_t value, const LabelFixup& fixup) { return value < fixup.field + 4; });
+        return offset - removed[static_cast<size_t>(it - labelFixups.begin())];
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < count; i++) {
+            const LabelFixup& fixup = labelFixups[i];
+            removed[i + 1] = removed[i] + (shortened[i] ? fixup.field + 2 - fixup.start : 0);
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (shortened[i] || labelFixups[i].shortOpcode == 0) {
+                continue;
+            }
+            int64_t displacement = static_cast<int64_t>(relocate(targets[i])) -
+                                   static_cast<int64_t>(relocate(labelFixups[i].start) + 2);
+            if (displacement >= -128 && displacement <= 127) {
+                shortened[i] = 1;
+                changed = true;
+            }
+        }
+    }
+
+    // Rewrite the code with the short branches, then move everything that
+    // refers to an offset in it
+    if (removed[count] > 0) {
+        std::vector<uint8_t> relaxed;
+        relaxed.reserve(code.size() - codeStart - removed[count]);
+        size_t copied = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (!shortened[i]) {
+                continue;
+            }
+            const LabelFixup& fixup = labelFixups[i];
+            relaxed.insert(relaxed.end(), code.begin() + codeStart + copied, code.begin() + codeStart + fixup.start);
+            relaxed.push_back(fixup.shortOpcode);
+            relaxed.push_back(static_cast<uint8_t>(relocate(targets[i]) - (relocate(fixup.start) + 2)));
+            copied = fixup.field + 4;
+        }
+        relaxed.insert(relaxed.end(), code.begin() + codeStart + copied, code.end());
+
+        for (size_t& offset : offsets) {
+            offset = relocate(offset);
+        }
+        for (size_t i = firstRelocation; i < relocations.size(); i++) {
+            relocations[i].offset = static_cast<uint32_t>(relocate(relocations[i].offset));
+        }
+        for (size_t i = 0; i < count; i++) {
+            targets[i] = relocate(targets[i]);
+            if (!shortened[i]) {
+                labelFixups[i].field = relocate(labelFixups[i].field);
+            }
+        }
+
+        code.resize(codeStart);
+        code.insert(code.end(), relaxed.begin(), relaxed.end());
+    }
+
+    // The remaining branches keep their rel32 field
+    for (size_t i = 0; i < count; i++) {
+        if (!shortened[i]) {
+            uint32_t displacement = static_cast<uint32_t>(targets[i] - (labelFixups[i].field + 4));
+            std::memcpy(&code[codeStart + labelFixups[i].field], &displacement, sizeof(displacement));
+        }
+    }
+    return true;
+}
+
+bool X86_64Encoder::encode() {
+    codeStart = code.size();
+    labelFixups.clear();
+    failure.clear();
+
+    const auto& instructions = func.getInstructions();
+    size_t firstRelocation = relocations.size();
+
+    // The frame holds the saved registers and spill slots, and keeps RSP
+    // aligned for calls
+    size_t savedCount = target.getSavedRegisters(allocation).size();
+    hasFrame = savedCount > 0 || allocation.getFrameAreaSize() > 0;
+    wideVectors = false;
+    for (const auto& inst : instructions) {
+        if ((inst->getCategory() == CAT_FRAME && inst->getOperation() == FRAME_ENTER) ||
+            (inst->getCategory() == CAT_CF && inst->getOperation() == CF_CALL)) {
+            hasFrame = true;
+        }
+        if (inst->getCategory() == CAT_VEC && vectorWidth > 16) {
+            wideVectors = true;
+        }
+    }
+    spillBase = -static_cast<int32_t>(savedCount * 8 + target.getFrameSize(allocation));
+    variableBase = spillBase + static_cast<int32_t>(allocation.getVariableAreaOffset());
+
+    if (hasFrame && !encodeSequence(target.generatePrologue(allocation))) {
+        LOG_ERROR("Cannot encode the prologue of {} for {}: {}", func.getName(), target.getName(), failure);
+        return false;
+    }
+
+    // Offset of each instruction, for local branch targets
+    std::vector<size_t> offsets(instructions.size() + 1);
+    for (size_t i = 0; i < instructions.size(); i++) {
+        offsets[i] = code.size() - codeStart;
+        if (!encodeInstruction(*instructions[i])) {
+            LOG_ERROR("Cannot encode '{}' in {} for {}: {}", instructions[i]->toString(), func.getName(),
+                      target.getName(), failure.empty() ? "operands cannot be encoded" : failure);
+            return false;
+        }
+    }
+    offsets[instructions.size()] = code.size() - codeStart;
+
+    // Resolve and relax branches to local labels
+    return resolveLabelFixups(offsets, firstRelocation);
+}
+
+} // namespace coil
@@ -0,0 +1,233 @@
+#ifndef COIL_TARGET_X86_64_ENCODER_H
+#define COIL_TARGET_X86_64_ENCODER_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <utility>
+#include <vector>
+#include "target/target.h"
+#include "target/register_allocator.h"
+
+namespace coil {
+
+class X86_64Target;
+
+/**
+ * @brief Operand resolved to an x86-64 register, memory location or constant
+ *
+ * Registers are hardware register numbers (the encoding used in ModRM and
+ * REX), not X86_64Register values. Vector registers are numbered apart
+ * from general-purpose ones (XMM3 is 3).
+ */
+struct MachineOperand {
+    enum Kind : uint8_t {
+        NONE,     // No operand
+        REG,      // General-purpose register
+        VEC,      // Vector register (XMM, YMM or ZMM)
+        MEM,      // Memory at [base + index * scale + disp]
+        IMM,      // Integer constant
+        SYMBOL    // Address of a symbol
+    };
+
+    static constexpr uint8_t NO_REGISTER = 0xFF;
+
+    Kind kind;          // Operand kind
+    uint8_t reg;        // Register (REG, VEC) or base register (MEM, NO_REGISTER for none)
+    uint8_t index;      // Index register (MEM, NO_REGISTER for none)
+    uint8_t scale;      // Index scale (MEM: 1, 2, 4 or 8)
+    int32_t disp;       // Displacement (MEM)
+    int64_t imm;        // Constant (IMM)
+    std::string symbol; // Symbol name (SYMBOL)
+
+    MachineOperand() : kind(NONE), reg(NO_REGISTER), index(NO_REGISTER), scale(1), disp(0), imm(0) {}
+
+    static MachineOperand makeRegister(uint8_t hwReg);
+    static MachineOperand makeVector(uint8_t vectorReg);
+    static MachineOperand makeMemory(uint8_t base, int32_t disp, uint8_t index = NO_REGISTER, uint8_t scale = 1);
+    static MachineOperand makeImmediate(int64_t value);
+    static MachineOperand makeSymbol(const std::string& name);
+
+    /**
+     * @brief Check whether the operand reads a general-purpose register,
+     *        directly or as an address
+     *
+     * @param hwReg Hardware register number
+     * @return true if the operand uses the register
+     */
+    bool uses(uint8_t hwReg) const;
+
+    bool operator==(const MachineOperand& other) const;
+    bool operator!=(const MachineOperand& other) const { return !(*this == other); }
+};
+
+/**
+ * @brief Lowers the instructions of one function to x86-64 machine code
+ *
+ * All integer operations work on 64-bit registers. Virtual registers are
+ * resolved through the function's register allocation; spilled registers
+ * become slots in the frame that the prologue sets up. Variables live in
+ * the registers or frame slots FrameLayout gave them, and VAR DECL only
+ * stores the initial value. R10 and R11 are
+ * scratch registers for address and value temporaries, XMM14 and XMM15
+ * for vector temporaries; none of them is handed out by the register
+ * allocator.
+ *
+ * VEC instructions work on whole vector registers of the target's vector
+ * width, encoded as SSE, VEX (AVX/AVX2) or EVEX (AVX-512F) instructions by
+ * the target's features. Bit counts and shifts use POPCNT, LZCNT, BMI1 and
+ * BMI2 instructions when the features include them.
+ *
+ * The prologue is emitted on entry when the function has a frame (it uses
+ * FRAME ENTER, calls out, or needs spill slots, variable slots or saved
+ * registers), and the epilogue at every CF RET. Calls pass their arguments
+ * and results in the registers of the ABI they name, or of the function's
+ * ABI.
+ *
+ * Branches to local labels are resolved in place, and jumps whose label
+ * is close enough are relaxed to their 8-bit displacement forms; all other
+ * symbol references are left as relocations.
+ */
+class X86_64Encoder {
+private:
+    /**
+     * @brief rel32 field that refers to a local label
+     */
+    struct LabelFixup {
+        size_t start;         // Offset of the branch instruction in the function
+        size_t field;         // Offset of its rel32 field
+        std::string label;    // Target label
+        uint8_t shortOpcode;  // Opcode of the rel8 form (0 if there is none)
+    };
+
+    const X86_64Target& target;                 // Target (register mapping and ABIs)
+    const Function& func;                       // Function being encoded
+    const RegisterAllocation& allocation;       // Registers assigned to the function
+    std::vector<uint8_t>& code;                 // Machine code (output)
+    std::vector<CodeRelocation>& relocations;   // Relocations against the code (output)
+    std::vector<LabelFixup> labelFixups;        // Branches to local labels, in code order
+    std::string failure;                        // Why the last instruction could not be encoded
+    size_t codeStart;                           // Offset of the function in the code buffer
+    bool hasFrame;                              // true if the prologue sets up RBP
+    bool fixedMapping;                          // true while encoding the prologue or epilogue
+    int32_t spillBase;                          // RBP-relative offset of the spill area
+    int32_t variableBase;                       // RBP-relative offset of the variable area
+    uint8_t nextAddressScratch;                 // Scratch register for the next spilled address register
+    uint32_t vectorWidth;                       // Size of a vector register in bytes
+    bool wideVectors;                           // true if the function writes YMM or ZMM registers
+
+    /**
+     * @brief SSE, AVX or BMI instruction without its encoding prefixes
+     */
+    struct VectorOpcode {
+        uint8_t prefix;   // Mandatory prefix (0, 0x66, 0xF3 or 0xF2)
+        uint8_t map;      // Opcode map: 1 is 0F, 2 is 0F 38, 3 is 0F 3A
+        uint8_t opcode;   // Opcode byte
+        bool wide;        // REX.W, VEX.W or EVEX.W
+    };
+
+    bool fail(const std::string& message);
+
+    // Operand resolution
+    bool resolveRegister(uint8_t vregId, MachineOperand& result);
+    bool resolveAddressRegister(uint8_t vregId, uint8_t& hwReg);
+    bool resolve(const Instruction& inst, size_t index, MachineOperand& result);
+    bool resolveAll(const Instruction& inst, size_t count, std::vector<MachineOperand>& result);
+    bool resolveAddress(const Instruction& inst, size_t index, MachineOperand& result);
+    bool resolveVector(const Instruction& inst, size_t index, MachineOperand& result);
+
+    // Raw encoding
+    void emit8(uint8_t value);
+    void emit32(uint32_t value);
+    void emit64(uint64_t value);
+    void emitModRM(std::initializer_list<uint8_t> opcode, uint8_t regField, const MachineOperand& rm,
+                   bool wide = true, uint8_t prefix = 0);
+    void emitOperand(uint8_t regField, const MachineOperand& rm, int32_t dispScale = 1);
+    void emitVex(const VectorOpcode& op, uint8_t regField, uint8_t vvvv, const MachineOperand& rm, bool wideVector);
+    void emitEvex(const VectorOpcode& op, uint8_t regField, uint8_t vvvv, const MachineOperand& rm);
+    void emitVector(const VectorOpcode& op, uint8_t regField, uint8_t vvvv, const MachineOperand& rm,
+                    uint32_t size);
+    void emitVzeroupper();
+    void emitRegisterOp(uint8_t opcode, uint8_t hwReg, bool wide);
+    void emitRel32(const std::string& symbol, size_t opcodeSize, uint8_t shortOpcode = 0, bool call = false);
+
+    // Operation helpers (operands are already resolved)
+    uint8_t pickScratch(const MachineOperand& a, const MachineOperand& b = MachineOperand(),
+                        const MachineOperand& c = MachineOperand()) const;
+    bool materialize(const MachineOperand& source, uint8_t scratch, MachineOperand& result);
+    bool move(const MachineOperand& dest, const MachineOperand& source);
+    bool arithmetic(uint8_t extension, const MachineOperand& dest, const MachineOperand& source);
+    bool test(const MachineOperand& a, const MachineOperand& b);
+    bool unary(uint8_t opcode, uint8_t extension, const MachineOperand& dest);
+    bool multiply(const MachineOperand& dest, const MachineOperand& source);
+    bool divide(const MachineOperand& dest, const MachineOperand& dividend, const MachineOperand& divisor,
+                bool remainder);
+    bool shift(uint8_t extension, const MachineOperand& dest, const MachineOperand& count);
+    bool bitTest(uint8_t extension, uint8_t opcode, const MachineOperand& dest, const MachineOperand& bit);
+    bool bitScan(uint8_t opcode, const MachineOperand& dest, const MachineOperand& source, bool leading);
+    bool bitCount(uint8_t opcode, const MachineOperand& dest, const MachineOperand& source);
+    bool populationCount(const MachineOperand& dest, const MachineOperand& source);
+    bool conditionalMove(uint8_t condition, uint8_t hwReg, const MachineOperand& source);
+    bool push(const MachineOperand& source);
+    bool pop(const MachineOperand& dest);
+    bool parallelMove(std::vector<std::pair<MachineOperand, MachineOperand>> moves);
+    bool vectorMove(const MachineOperand& dest, const MachineOperand& source);
+    bool vectorBinary(const VectorOpcode& op, bool commutative, const MachineOperand& dest,
+                      const MachineOperand& a, const MachineOperand& b);
+    bool vectorSplat(uint8_t elementSize, const MachineOperand& dest, const MachineOperand& scalar);
+
+    /**
+     * @brief Lower a two- or three-operand instruction to an in-place operation
+     *
+     * dest = a op b is lowered to dest = a; dest op= b, going through a
+     * scratch register when dest overlaps b.
+     */
+    template <typename Operation>
+    bool binary(const Instruction& inst, bool commutative, Operation operation);
+
+    /**
+     * @brief Lower a one- or two-operand instruction to an in-place operation
+     *
+     * dest = op src is lowered to dest = src; op dest.
+     */
+    template <typename Operation>
+    bool inPlace(const Instruction& inst, Operation operation);
+
+    // Instruction lowering
+    bool encodeInstruction(const Instruction& inst);
+    bool encodeMemory(const Instruction& inst);
+    bool encodeMath(const Instruction& inst);
+    bool encodeBit(const Instruction& inst);
+    bool encodeVector(const Instruction& inst);
+    bool encodeControlFlow(const Instruction& inst);
+    bool encodeFrame(const Instruction& inst);
+    bool encodeVariable(const Instruction& inst);
+    bool encodeCall(const Instruction& inst);
+    bool encodeSequence(const std::vector<std::unique_ptr<Instruction>>& instructions);
+    bool resolveLabelFixups(std::vector<size_t>& offsets, size_t firstRelocation);
+
+public:
+    /**
+     * @brief Construct an encoder for one function
+     *
+     * @param x86Target Target
+     * @param function Function to encode
+     * @param registerAllocation Registers assigned to the function
+     * @param output Machine code (output parameter)
+     * @param outputRelocations Relocations against the code (output parameter)
+     */
+    X86_64Encoder(const X86_64Target& x86Target, const Function& function,
+                  const RegisterAllocation& registerAllocation, std::vector<uint8_t>& output,
+                  std::vector<CodeRelocation>& outputRelocations);
+
+    /**
+     * @brief Encode the function
+     *
+     * @return true on success, false if an instruction cannot be lowered
+     */
+    bool encode();
+};
+
+} // namespace coil
+
+#endif // COIL_TARGET_X86_64_ENCODER_H
@@ -0,0 +1,33 @@
+#include "util/allocation_counter.h"
+#include <atomic>
+
+namespace coil {
+
+static std::atomic<bool> counting(false);
+static std::atomic<uint64_t> processCount(0);
+static std::atomic<uint64_t> processBytes(0);
+static thread_local uint64_t threadCount = 0;
+static thread_local uint64_t threadBytes = 0;
+
+void AllocationCounter::enable() {
+    counting.store(true, std::memory_order_relaxed);
+}
+
+AllocationCount AllocationCounter::process() {
+    return {processCount.load(std::memory_order_relaxed), processBytes.load(std::memory_order_relaxed)};
+}
+
+AllocationCount AllocationCounter::thread() {
+    return {threadCount, threadBytes};
+}
+
+void AllocationCounter::record(uint64_t size) {
+    if (counting.load(std::memory_order_relaxed)) {
+        processCount.fetch_add(1, std::memory_order_relaxed);
+        processBytes.fetch_add(size, std::memory_order_relaxed);
+        threadCount++;
+        threadBytes += size;
+    }
+}
+
+} // namespace coil
@@ -0,0 +1,56 @@
+#ifndef COIL_UTIL_ALLOCATION_COUNTER_H
+#define COIL_UTIL_ALLOCATION_COUNTER_H
+
+#include <cstdint>
+
+namespace coil {
+
+/**
+ * @brief Number and total size of heap allocations
+ */
+struct AllocationCount {
+    uint64_t count;   // Allocations made
+    uint64_t bytes;   // Bytes requested
+};
+
+/**
+ * @brief Counts the allocations made through operator new
+ *
+ * Programs that link allocation_hooks.cpp replace the global operator new
+ * so that, once counting is enabled, every allocation is added to a
+ * process-wide total and to a total for the allocating thread. Until then
+ * the only cost is one relaxed load. The library leaves operator new to
+ * the program it is linked into, where the counts stay at zero.
+ */
+class AllocationCounter {
+public:
+    /**
+     * @brief Start counting allocations
+     */
+    static void enable();
+
+    /**
+     * @brief Get the allocations made by all threads since counting started
+     *
+     * @return Process-wide allocation count
+     */
+    static AllocationCount process();
+
+    /**
+     * @brief Get the allocations made by the calling thread since counting started
+     *
+     * @return Allocation count of the calling thread
+     */
+    static AllocationCount thread();
+
+    /**
+     * @brief Count an allocation if counting is enabled
+     *
+     * @param size Bytes requested
+     */
+    static void record(uint64_t size);
+};
+
+} // namespace coil
+
+#endif // COIL_UTIL_ALLOCATION_COUNTER_H
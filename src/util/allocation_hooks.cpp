@@ -0,0 +1,146 @@
+// Replaces the global operator new and delete so that AllocationCounter
+// sees every allocation. Linked into the programs only, never into the
+// library, which must not take over its host's allocator. Every form is
+// replaced, nothrow and aligned ones included, so that no allocation
+// reaches a default operator new whose memory a replaced delete frees.
+
+#include "util/allocation_counter.h"
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace coil {
+
+static void* allocate(std::size_t size, std::size_t alignment = 0) {
+    AllocationCounter::record(size);
+
+    // Same contract as the default operator new
+    if (size == 0) {
+        size = 1;
+    }
+    for (;;) {
+        void* memory;
+        if (alignment == 0) {
+            memory = std::malloc(size);
+        } else {
+#ifdef _WIN32
+            memory = _aligned_malloc(size, alignment);
+#else
+            // aligned_alloc wants a multiple of the alignment
+            memory = std::aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+#endif
+        }
+        if (memory) {
+            return memory;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+static void* allocateNothrow(std::size_t size, std::size_t alignment = 0) noexcept {
+    try {
+        return allocate(size, alignment);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+static void release(void* memory) noexcept {
+    std::free(memory);
+}
+
+static void releaseAligned(void* memory) noexcept {
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+
+} // namespace coil
+
+void* operator new(std::size_t size) {
+    return coil::allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return coil::allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return coil::allocateNothrow(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return coil::allocateNothrow(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return coil::allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return coil::allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return coil::allocateNothrow(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return coil::allocateNothrow(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* memory) noexcept {
+    coil::release(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    coil::release(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    coil::release(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+    coil::release(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+    coil::release(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+    coil::release(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    coil::releaseAligned(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept {
+    coil::releaseAligned(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+    coil::releaseAligned(memory);
+}
+
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept {
+    coil::releaseAligned(memory);
+}
+
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+    coil::releaseAligned(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+    coil::releaseAligned(memory);
+}
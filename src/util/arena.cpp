@@ -0,0 +1,77 @@
+#include "util/arena.h"
+#include <new>
+
+namespace coil {
+
+// Arena that new allocations on this thread go to
+static thread_local Arena* currentArena = nullptr;
+
+// ArenaObject blocks start with a one-word header recording where they
+// came from, which keeps the object pointer-aligned
+static constexpr size_t OBJECT_HEADER_SIZE = sizeof(size_t);
+static constexpr size_t OBJECT_ALIGNMENT = alignof(size_t);
+
+enum ObjectOrigin : size_t {
+    ORIGIN_HEAP = 0,
+    ORIGIN_ARENA = 1
+};
+
+Arena::Arena(size_t initialSize)
+    : resource(initialSize) {
+}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+    return resource.allocate(size, alignment);
+}
+
+std::pmr::memory_resource* Arena::getResource() {
+    return &resource;
+}
+
+Arena* Arena::current() {
+    return currentArena;
+}
+
+std::pmr::memory_resource* Arena::currentResource() {
+    return currentArena ? currentArena->getResource() : std::pmr::get_default_resource();
+}
+
+ArenaScope::ArenaScope(Arena& arena)
+    : previous(currentArena) {
+    currentArena = &arena;
+}
+
+ArenaScope::~ArenaScope() {
+    currentArena = previous;
+}
+
+void* ArenaObject::operator new(size_t size) {
+    void* block;
+    ObjectOrigin origin;
+    
+    if (currentArena) {
+        block = currentArena->allocate(size + OBJECT_HEADER_SIZE, OBJECT_ALIGNMENT);
+        origin = ORIGIN_ARENA;
+    } else {
+        block = ::operator new(size + OBJECT_HEADER_SIZE);
+        origin = ORIGIN_HEAP;
+    }
+    
+    *static_cast<size_t*>(block) = origin;
+    return static_cast<char*>(block) + OBJECT_HEADER_SIZE;
+}
+
+void ArenaObject::operator delete(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    
+    void* block = static_cast<char*>(ptr) - OBJECT_HEADER_SIZE;
+    
+    // Arena memory is released in bulk when the arena is destroyed
+    if (*static_cast<size_t*>(block) == ORIGIN_HEAP) {
+        ::operator delete(block);
+    }
+}
+
+} // namespace coil
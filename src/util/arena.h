@@ -0,0 +1,97 @@
+#ifndef COIL_UTIL_ARENA_H
+#define COIL_UTIL_ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace coil {
+
+/**
+ * @brief Bump allocator for objects that share one lifetime
+ *
+ * Memory is handed out from large chunks and only returned when the arena
+ * itself is destroyed, so freeing millions of small objects costs nothing.
+ * An arena is not thread-safe; each thread builds into its own.
+ */
+class Arena {
+private:
+    std::pmr::monotonic_buffer_resource resource; // Chunked bump allocator
+
+public:
+    /**
+     * @brief Construct a new Arena
+     *
+     * @param initialSize Size of the first chunk in bytes
+     */
+    explicit Arena(size_t initialSize = 64 * 1024);
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /**
+     * @brief Allocate memory from the arena
+     *
+     * @param size Number of bytes
+     * @param alignment Required alignment
+     * @return Pointer to the memory (never null)
+     */
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    /**
+     * @brief Get the arena as a memory resource (for pmr containers)
+     *
+     * @return Memory resource
+     */
+    std::pmr::memory_resource* getResource();
+
+    /**
+     * @brief Get the arena allocations on this thread go to
+     *
+     * @return Current arena, or nullptr outside an ArenaScope
+     */
+    static Arena* current();
+
+    /**
+     * @brief Get the memory resource allocations on this thread go to
+     *
+     * @return Resource of the current arena, or the default resource
+     */
+    static std::pmr::memory_resource* currentResource();
+};
+
+/**
+ * @brief Makes an arena the current one on this thread for a scope
+ *
+ * Scopes nest; the previous arena is restored on destruction.
+ */
+class ArenaScope {
+private:
+    Arena* previous; // Arena that was current before this scope
+
+public:
+    explicit ArenaScope(Arena& arena);
+    ~ArenaScope();
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+};
+
+/**
+ * @brief Base for classes whose instances may be placed in an arena
+ *
+ * Inside an ArenaScope, new allocates from the current arena and delete
+ * only runs the destructor; the memory goes away with the arena. Outside
+ * a scope objects live on the heap as usual. Either way they are owned
+ * through std::unique_ptr, so callers don't need to know which it is.
+ * Arena objects must not outlive their arena, and derived classes must not
+ * need more than pointer alignment.
+ */
+class ArenaObject {
+public:
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr);
+};
+
+} // namespace coil
+
+#endif // COIL_UTIL_ARENA_H
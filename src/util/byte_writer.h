@@ -0,0 +1,128 @@
+#ifndef COIL_UTIL_BYTE_WRITER_H
+#define COIL_UTIL_BYTE_WRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace coil {
+
+/**
+ * @brief Appends little-endian binary data to an existing byte buffer
+ *
+ * The writer does not own the buffer; encoders write straight into the
+ * final destination (e.g. a section's data) instead of building and
+ * concatenating temporary vectors. The write methods are inline because
+ * they are called once or more per encoded byte field.
+ */
+class ByteWriter {
+private:
+    std::vector<uint8_t>& buffer; // Destination buffer
+
+public:
+    /**
+     * @brief Construct a new Byte Writer that appends to a buffer
+     *
+     * @param target Destination buffer (must outlive the writer)
+     */
+    explicit ByteWriter(std::vector<uint8_t>& target) : buffer(target) {}
+
+    /**
+     * @brief Get the number of bytes in the destination buffer
+     *
+     * @return Buffer size, which is also the offset of the next write
+     */
+    size_t size() const { return buffer.size(); }
+
+    /**
+     * @brief Make room for more bytes without reallocating on each write
+     *
+     * @param additional Number of bytes about to be written
+     */
+    void reserve(size_t additional) { buffer.reserve(buffer.size() + additional); }
+
+    /**
+     * @brief Append a byte
+     *
+     * @param value Byte to append
+     */
+    void writeU8(uint8_t value) { buffer.push_back(value); }
+
+    /**
+     * @brief Append a 16-bit value (little-endian)
+     *
+     * @param value Value to append
+     */
+    void writeU16(uint16_t value) {
+        buffer.push_back(value & 0xFF);
+        buffer.push_back((value >> 8) & 0xFF);
+    }
+
+    /**
+     * @brief Append a 32-bit value (little-endian)
+     *
+     * @param value Value to append
+     */
+    void writeU32(uint32_t value) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            buffer.push_back((value >> shift) & 0xFF);
+        }
+    }
+
+    /**
+     * @brief Append a 64-bit value (little-endian)
+     *
+     * @param value Value to append
+     */
+    void writeU64(uint64_t value) {
+        writeU32(static_cast<uint32_t>(value));
+        writeU32(static_cast<uint32_t>(value >> 32));
+    }
+
+    /**
+     * @brief Append an unsigned LEB128 value
+     *
+     * @param value Value to append
+     */
+    void writeULEB128(uint64_t value) {
+        while (value >= 0x80) {
+            buffer.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back(static_cast<uint8_t>(value));
+    }
+
+    /**
+     * @brief Append a signed LEB128 value
+     *
+     * @param value Value to append
+     */
+    void writeSLEB128(int64_t value) {
+        while (value < -64 || value >= 64) {
+            buffer.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back(static_cast<uint8_t>(value & 0x7F));
+    }
+
+    /**
+     * @brief Append raw bytes
+     *
+     * @param bytes Bytes to append
+     * @param count Number of bytes
+     */
+    void writeBytes(const uint8_t* bytes, size_t count) {
+        buffer.insert(buffer.end(), bytes, bytes + count);
+    }
+
+    /**
+     * @brief Append zero bytes
+     *
+     * @param count Number of bytes
+     */
+    void writeZeros(size_t count) { buffer.resize(buffer.size() + count, 0); }
+};
+
+} // namespace coil
+
+#endif // COIL_UTIL_BYTE_WRITER_H
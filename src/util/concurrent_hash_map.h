@@ -0,0 +1,122 @@
+#ifndef COIL_UTIL_CONCURRENT_HASH_MAP_H
+#define COIL_UTIL_CONCURRENT_HASH_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace coil {
+
+/**
+ * @brief Hash map that many threads can update at once
+ *
+ * Keys are spread over a fixed number of shards by hash, each a plain
+ * unordered_map behind its own mutex, so threads only wait for each other
+ * when they touch the same shard. Lookups take the shard's lock too;
+ * once every writer is done, forEach() and find() see a stable map.
+ *
+ * @tparam Key Key type
+ * @tparam Value Value type
+ * @tparam Hash Hash of the key
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class ConcurrentHashMap {
+private:
+    static constexpr size_t SHARD_COUNT = 64; // Picked by the top 6 bits of the hash
+
+    /**
+     * @brief One shard, on a cache line of its own
+     */
+    struct alignas(64) Shard {
+        std::mutex mutex;                            // Guards entries
+        std::unordered_map<Key, Value, Hash> entries; // Keys of this shard
+    };
+
+    Hash hasher;                  // Hash of the key
+    Shard shards[SHARD_COUNT];    // Shards, picked by hash
+
+    Shard& shardFor(const Key& key) {
+        // Mixed first, as std::hash of an integer is the integer itself;
+        // the low bits pick the bucket inside the shard, so use the high ones
+        uint64_t hash = static_cast<uint64_t>(hasher(key)) * 0x9E3779B97F4A7C15ull;
+        return shards[hash >> 58];
+    }
+
+public:
+    ConcurrentHashMap() = default;
+
+    ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+    ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+    /**
+     * @brief Insert a key or update its value, under the shard's lock
+     *
+     * @param key Key
+     * @param update Called as update(value, inserted), where inserted is
+     *        true if the key was not in the map and value was just
+     *        default-constructed
+     */
+    template <typename Update>
+    void update(const Key& key, Update update) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto result = shard.entries.try_emplace(key);
+        update(result.first->second, result.second);
+    }
+
+    /**
+     * @brief Find a key
+     *
+     * @param key Key
+     * @param value Value of the key (output parameter)
+     * @return true if found, false otherwise
+     */
+    bool find(const Key& key, Value& value) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it == shard.entries.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+
+    /**
+     * @brief Call a function for every entry, shard by shard
+     *
+     * The order is unspecified. The function must not use the map.
+     *
+     * @param visit Called as visit(key, value)
+     */
+    template <typename Visit>
+    void forEach(Visit visit) {
+        for (Shard& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (auto& entry : shard.entries) {
+                visit(entry.first, entry.second);
+            }
+        }
+    }
+
+    /**
+     * @brief Get the number of entries
+     *
+     * @return Number of entries
+     */
+    size_t size() {
+        size_t count = 0;
+        for (Shard& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            count += shard.entries.size();
+        }
+        return count;
+    }
+};
+
+} // namespace coil
+
+#endif // COIL_UTIL_CONCURRENT_HASH_MAP_H
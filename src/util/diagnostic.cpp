@@ -34,24 +34,75 @@ std::string DiagnosticEngine::formatDiagnostic(const Diagnostic& diagnostic) {
 }
 
 DiagnosticEngine::DiagnosticEngine(Logger* log)
-    : hasErrors(false), logger(log) {
+    : count(0), errorCount(0), limitReached(false), errorLimit(0), logger(log) {
+    for (auto& segment : segments) {
+        segment.store(nullptr, std::memory_order_relaxed);
+    }
 }
 
-void DiagnosticEngine::report(DiagnosticSeverity severity, const std::string& message, const SourceLocation& location) {
-    // Create diagnostic
-    Diagnostic diagnostic(severity, message, location);
-    
-    // Add to collection
-    diagnostics.push_back(diagnostic);
+DiagnosticEngine::~DiagnosticEngine() {
+    for (auto& segment : segments) {
+        delete[] segment.load(std::memory_order_relaxed);
+    }
+}
+
+DiagnosticEngine::Slot& DiagnosticEngine::getSlot(size_t index) {
+    // Segment k holds FIRST_SEGMENT_SIZE << k slots
+    size_t biased = index + FIRST_SEGMENT_SIZE;
+    size_t segmentIndex = 0;
+    while ((biased >> segmentIndex) >= 2 * FIRST_SEGMENT_SIZE) {
+        segmentIndex++;
+    }
+    size_t offset = biased - (FIRST_SEGMENT_SIZE << segmentIndex);
     
-    // Update error flag
-    if (severity >= DIAG_ERROR) {
-        hasErrors = true;
+    Slot* segment = segments[segmentIndex].load(std::memory_order_acquire);
+    if (!segment) {
+        // Threads that reach a new segment together each allocate one;
+        // the first to publish it wins and the others free theirs
+        Slot* fresh = new Slot[FIRST_SEGMENT_SIZE << segmentIndex];
+        if (segments[segmentIndex].compare_exchange_strong(segment, fresh, std::memory_order_acq_rel)) {
+            segment = fresh;
+        } else {
+            delete[] fresh;
+        }
     }
     
+    return segment[offset];
+}
+
+void DiagnosticEngine::store(DiagnosticSeverity severity, const std::string& message, const SourceLocation& location) {
+    Slot& slot = getSlot(count.fetch_add(1, std::memory_order_relaxed));
+    slot.diagnostic = Diagnostic(severity, message, location);
+    slot.ready.store(true, std::memory_order_release);
+    
     // Log the diagnostic
     if (logger) {
-        logger->log(severityToLogLevel(severity), formatDiagnostic(diagnostic));
+        logger->log(severityToLogLevel(severity), formatDiagnostic(slot.diagnostic));
+    }
+}
+
+void DiagnosticEngine::report(DiagnosticSeverity severity, const std::string& message, const SourceLocation& location) {
+    if (hasReachedErrorLimit()) {
+        return;
+    }
+    
+    if (severity < DIAG_ERROR) {
+        store(severity, message, location);
+        return;
+    }
+    
+    // Errors past the limit are dropped; the one that reaches it is kept
+    // and followed by a fatal error
+    size_t errors = errorCount.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (errorLimit != 0 && errors > errorLimit) {
+        return;
+    }
+    
+    store(severity, message, location);
+    
+    if (errors == errorLimit) {
+        limitReached.store(true, std::memory_order_relaxed);
+        store(DIAG_FATAL, "too many errors emitted, stopping now", location);
     }
 }
 
@@ -72,19 +123,38 @@ void DiagnosticEngine::fatal(const std::string& message, const SourceLocation& l
 }
 
 bool DiagnosticEngine::hasDiagnostics() const {
-    return !diagnostics.empty();
+    return count.load(std::memory_order_relaxed) != 0;
 }
 
 bool DiagnosticEngine::hasErrorDiagnostics() const {
-    return hasErrors;
+    return errorCount.load(std::memory_order_relaxed) != 0;
 }
 
-const std::vector<Diagnostic>& DiagnosticEngine::getDiagnostics() const {
-    return diagnostics;
+size_t DiagnosticEngine::getDiagnosticCount() const {
+    return count.load(std::memory_order_relaxed);
+}
+
+std::vector<Diagnostic> DiagnosticEngine::getDiagnostics() const {
+    std::vector<Diagnostic> result;
+    size_t total = count.load(std::memory_order_acquire);
+    result.reserve(total);
+    
+    size_t index = 0;
+    for (size_t segmentIndex = 0; index < total && segmentIndex < SEGMENT_COUNT; segmentIndex++) {
+        const Slot* segment = segments[segmentIndex].load(std::memory_order_acquire);
+        size_t size = FIRST_SEGMENT_SIZE << segmentIndex;
+        for (size_t offset = 0; offset < size && index < total; offset++, index++) {
+            if (segment && segment[offset].ready.load(std::memory_order_acquire)) {
+                result.push_back(segment[offset].diagnostic);
+            }
+        }
+    }
+    
+    return result;
 }
 
 void DiagnosticEngine::printDiagnostics() const {
-    for (const auto& diagnostic : diagnostics) {
+    for (const auto& diagnostic : getDiagnostics()) {
         // Format and print the diagnostic
         std::string formatted = formatDiagnostic(diagnostic);
         
@@ -98,8 +168,31 @@ void DiagnosticEngine::printDiagnostics() const {
 }
 
 void DiagnosticEngine::clear() {
-    diagnostics.clear();
-    hasErrors = false;
+    // The segments are kept for the diagnostics to come
+    size_t total = count.load(std::memory_order_relaxed);
+    size_t index = 0;
+    for (size_t segmentIndex = 0; index < total && segmentIndex < SEGMENT_COUNT; segmentIndex++) {
+        Slot* segment = segments[segmentIndex].load(std::memory_order_relaxed);
+        size_t size = FIRST_SEGMENT_SIZE << segmentIndex;
+        for (size_t offset = 0; offset < size && index < total; offset++, index++) {
+            if (segment) {
+                segment[offset].diagnostic = Diagnostic();
+                segment[offset].ready.store(false, std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    count.store(0, std::memory_order_relaxed);
+    errorCount.store(0, std::memory_order_relaxed);
+    limitReached.store(false, std::memory_order_relaxed);
+}
+
+void DiagnosticEngine::setErrorLimit(size_t limit) {
+    errorLimit = limit;
+}
+
+size_t DiagnosticEngine::getErrorLimit() const {
+    return errorLimit;
 }
 
 void DiagnosticEngine::setLogger(Logger* log) {
@@ -1,8 +1,9 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
 #include <string>
 #include <vector>
-#include "parser/lexer.h"
 #include "util/logger.h"
 #include "util/source_location.h"
 
@@ -26,6 +27,7 @@ struct Diagnostic {
     std::string message;         // Message
     SourceLocation location;     // Source location
     
+    Diagnostic() : severity(DIAG_NOTE) {}
     Diagnostic(DiagnosticSeverity sev, const std::string& msg, const SourceLocation& loc)
         : severity(sev), message(msg), location(loc) {}
 };
@@ -33,13 +35,51 @@ struct Diagnostic {
 /**
  * @brief Diagnostic engine
  * 
- * Collects and reports diagnostic messages.
+ * Collects and reports diagnostic messages. Diagnostics can be reported
+ * from several threads at once without locking: each report claims the
+ * next slot with an atomic counter, and the slots live in segments that
+ * double in size and never move.
+ * 
+ * With an error limit, the engine stops collecting once that many errors
+ * have been reported, adds one fatal error saying so, and the lexer and
+ * parser stop early.
  */
 class DiagnosticEngine {
 private:
-    std::vector<Diagnostic> diagnostics; // Collected diagnostics
-    bool hasErrors;                      // Has error diagnostics
-    Logger* logger;                      // Logger for reporting
+    /**
+     * @brief Collected diagnostic
+     */
+    struct Slot {
+        Diagnostic diagnostic;          // Diagnostic
+        std::atomic<bool> ready{false}; // true once the diagnostic is filled in
+    };
+    
+    static constexpr size_t FIRST_SEGMENT_SIZE = 64; // Slots in the first segment
+    static constexpr size_t SEGMENT_COUNT = 48;      // Segments (enough for any count)
+    
+    std::atomic<Slot*> segments[SEGMENT_COUNT]; // Slot segments, allocated on first use
+    std::atomic<size_t> count;                  // Slots claimed
+    std::atomic<size_t> errorCount;             // Errors reported, including dropped ones
+    std::atomic<bool> limitReached;             // true once the error limit is hit
+    size_t errorLimit;                          // Errors to collect (0 for no limit)
+    Logger* logger;                             // Logger for reporting
+    
+    /**
+     * @brief Get a slot, allocating its segment if needed
+     * 
+     * @param index Slot index
+     * @return Slot
+     */
+    Slot& getSlot(size_t index);
+    
+    /**
+     * @brief Store and log a diagnostic
+     * 
+     * @param severity Severity
+     * @param message Message
+     * @param location Source location
+     */
+    void store(DiagnosticSeverity severity, const std::string& message, const SourceLocation& location);
     
     /**
      * @brief Convert severity to log level
@@ -65,6 +105,14 @@ public:
      */
     explicit DiagnosticEngine(Logger* log = nullptr);
     
+    /**
+     * @brief Destroy the Diagnostic Engine
+     */
+    ~DiagnosticEngine();
+    
+    DiagnosticEngine(const DiagnosticEngine&) = delete;
+    DiagnosticEngine& operator=(const DiagnosticEngine&) = delete;
+    
     /**
      * @brief Report a diagnostic
      * 
@@ -120,12 +168,21 @@ public:
      */
     bool hasErrorDiagnostics() const;
     
+    /**
+     * @brief Get the number of diagnostics reported so far
+     * 
+     * @return Number of diagnostics
+     */
+    size_t getDiagnosticCount() const;
+    
     /**
      * @brief Get all diagnostics
      * 
-     * @return Vector of diagnostics
+     * Diagnostics still being reported by other threads are left out.
+     * 
+     * @return Copy of the diagnostics, in the order they were reported
      */
-    const std::vector<Diagnostic>& getDiagnostics() const;
+    std::vector<Diagnostic> getDiagnostics() const;
     
     /**
      * @brief Print all diagnostics
@@ -134,9 +191,36 @@ public:
     
     /**
      * @brief Clear all diagnostics
+     * 
+     * Not to be called while other threads report diagnostics.
      */
     void clear();
     
+    /**
+     * @brief Set the number of errors after which to stop
+     * 
+     * @param limit Error limit (0 for no limit)
+     */
+    void setErrorLimit(size_t limit);
+    
+    /**
+     * @brief Get the number of errors after which to stop
+     * 
+     * @return Error limit (0 for no limit)
+     */
+    size_t getErrorLimit() const;
+    
+    /**
+     * @brief Check if the error limit has been reached
+     * 
+     * Once it has, further diagnostics are dropped.
+     * 
+     * @return true if the error limit has been reached, false otherwise
+     */
+    bool hasReachedErrorLimit() const {
+        return limitReached.load(std::memory_order_relaxed);
+    }
+    
     /**
      * @brief Set the logger
      * 
@@ -0,0 +1,171 @@
+#ifndef COIL_UTIL_LEB128_H
+#define COIL_UTIL_LEB128_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace coil {
+
+/**
+ * @brief Get the encoded size of an unsigned LEB128 value
+ *
+ * @param value Value to encode
+ * @return Number of bytes ByteWriter::writeULEB128 appends
+ */
+inline size_t uleb128Size(uint64_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+/**
+ * @brief Get the encoded size of a signed LEB128 value
+ *
+ * @param value Value to encode
+ * @return Number of bytes ByteWriter::writeSLEB128 appends
+ */
+inline size_t sleb128Size(int64_t value) {
+    size_t size = 1;
+    while (value < -64 || value >= 64) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+/**
+ * @brief Read an unsigned LEB128 value
+ *
+ * @param data Binary data pointer
+ * @param offset Offset into data (updated on return)
+ * @return Decoded value (bits past 64 are dropped)
+ */
+inline uint64_t readULEB128(const uint8_t* data, size_t& offset) {
+    // Most values fit in one byte
+    if (!(data[offset] & 0x80)) {
+        return data[offset++];
+    }
+
+    uint64_t value = 0;
+    unsigned shift = 0;
+    uint8_t byte;
+    do {
+        byte = data[offset++];
+        if (shift < 64) {
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        }
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
+/**
+ * @brief Read a signed LEB128 value
+ *
+ * @param data Binary data pointer
+ * @param offset Offset into data (updated on return)
+ * @return Decoded value (bits past 64 are dropped)
+ */
+inline int64_t readSLEB128(const uint8_t* data, size_t& offset) {
+    // Most values fit in one byte
+    if (!(data[offset] & 0x80)) {
+        uint8_t byte = data[offset++];
+        return (byte & 0x40) ? static_cast<int64_t>(byte) - 0x80 : byte;
+    }
+
+    uint64_t value = 0;
+    unsigned shift = 0;
+    uint8_t byte;
+    do {
+        byte = data[offset++];
+        if (shift < 64) {
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        }
+        shift += 7;
+    } while (byte & 0x80);
+
+    // Sign-extend from the last byte's sign bit
+    if (shift < 64 && (byte & 0x40)) {
+        value |= ~0ull << shift;
+    }
+    return static_cast<int64_t>(value);
+}
+
+/**
+ * @brief Read an unsigned LEB128 value without reading past the end
+ *
+ * @param data Binary data pointer
+ * @param size Size of the data
+ * @param offset Offset into data (updated on success)
+ * @param value Decoded value (output parameter)
+ * @return true on success, false if the value is truncated or longer
+ *         than 10 bytes
+ */
+inline bool readULEB128(const uint8_t* data, size_t size, size_t& offset, uint64_t& value) {
+    // Most values fit in one byte
+    if (offset < size && !(data[offset] & 0x80)) {
+        value = data[offset++];
+        return true;
+    }
+
+    uint64_t result = 0;
+    size_t position = offset;
+    for (unsigned shift = 0; shift < 70; shift += 7) {
+        if (position >= size) {
+            return false;
+        }
+        uint8_t byte = data[position++];
+        result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            value = result;
+            offset = position;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Read a signed LEB128 value without reading past the end
+ *
+ * @param data Binary data pointer
+ * @param size Size of the data
+ * @param offset Offset into data (updated on success)
+ * @param value Decoded value (output parameter)
+ * @return true on success, false if the value is truncated or longer
+ *         than 10 bytes
+ */
+inline bool readSLEB128(const uint8_t* data, size_t size, size_t& offset, int64_t& value) {
+    // Most values fit in one byte
+    if (offset < size && !(data[offset] & 0x80)) {
+        uint8_t byte = data[offset++];
+        value = (byte & 0x40) ? static_cast<int64_t>(byte) - 0x80 : byte;
+        return true;
+    }
+
+    uint64_t result = 0;
+    size_t position = offset;
+    for (unsigned shift = 0; shift < 70; shift += 7) {
+        if (position >= size) {
+            return false;
+        }
+        uint8_t byte = data[position++];
+        result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            if (shift + 7 < 64 && (byte & 0x40)) {
+                result |= ~0ull << (shift + 7);
+            }
+            value = static_cast<int64_t>(result);
+            offset = position;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace coil
+
+#endif // COIL_UTIL_LEB128_H
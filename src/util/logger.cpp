@@ -2,11 +2,16 @@
 #include <iostream>
 #include <iomanip>
 #include <ctime>
+#include <sstream>
 
 namespace coil {
 
 // Global logger instance
 std::unique_ptr<Logger> GlobalLogger::instance = std::make_unique<ConsoleLogger>();
+thread_local Logger* GlobalLogger::threadInstance = nullptr;
+
+// Console output is shared by every console logger
+static std::mutex consoleMutex;
 
 // Console logger implementation
 ConsoleLogger::ConsoleLogger(LogLevel level)
@@ -44,8 +49,13 @@ void ConsoleLogger::log(LogLevel level, const std::string& message) {
         case LOG_FATAL:   levelStr = "FATAL"; break;
     }
     
+    // Format the whole line first so it is written in one piece
+    std::ostringstream line;
+    line << "[" << timeBuffer << "] " << std::setw(7) << std::left << levelStr << " " << message << "\n";
+    
     // Output the log message
-    stream << "[" << timeBuffer << "] " << std::setw(7) << std::left << levelStr << " " << message << std::endl;
+    std::lock_guard<std::mutex> lock(consoleMutex);
+    stream << line.str() << std::flush;
 }
 
 bool ConsoleLogger::isEnabled(LogLevel level) const {
@@ -58,74 +68,203 @@ void ConsoleLogger::setMinLevel(LogLevel level) {
 
 // File logger implementation
 FileLogger::FileLogger(const std::string& filename, LogLevel level)
-    : minLevel(level), file(filename) {
+    : minLevel(level), file(filename), open(file.is_open()), writing(false), stopping(false) {
+    if (open) {
+        writer = std::thread(&FileLogger::writeLoop, this);
+    }
 }
 
 FileLogger::~FileLogger() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    
+    if (writer.joinable()) {
+        writer.join();
+    }
     if (file.is_open()) {
         file.close();
     }
 }
 
 void FileLogger::log(LogLevel level, const std::string& message) {
-    if (level < minLevel || !file.is_open()) {
+    if (level < minLevel || !open) {
         return;
     }
     
-    // Get current time
-    std::time_t now = std::time(nullptr);
-    std::tm tm_now;
+    bool first;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        first = pending.empty();
+        pending.push_back({level, std::time(nullptr), message});
+    }
+    
+    // The writer only sleeps on an empty queue
+    if (first) {
+        wake.notify_one();
+    }
+    
+    // The process may not outlive a fatal message
+    if (level == LOG_FATAL) {
+        flush();
+    }
+}
+
+void FileLogger::writeLoop() {
+    std::vector<Record> batch;
+    std::unique_lock<std::mutex> lock(mutex);
     
+    for (;;) {
+        wake.wait(lock, [this] { return stopping || !pending.empty(); });
+        if (pending.empty()) {
+            return;
+        }
+        
+        batch.swap(pending);
+        writing = true;
+        lock.unlock();
+        
+        for (const Record& record : batch) {
+            // Get the time the message was logged
+            std::tm tm_logged;
+            
 #ifdef _WIN32
-    localtime_s(&tm_now, &now);
+            localtime_s(&tm_logged, &record.time);
 #else
-    localtime_r(&now, &tm_now);
+            localtime_r(&record.time, &tm_logged);
 #endif
-    
-    // Format time
-    char timeBuffer[20];
-    std::strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%d %H:%M:%S", &tm_now);
-    
-    // Select log level prefix
-    const char* levelStr = "";
-    
-    switch (level) {
-        case LOG_DEBUG:   levelStr = "DEBUG"; break;
-        case LOG_INFO:    levelStr = "INFO"; break;
-        case LOG_WARNING: levelStr = "WARNING"; break;
-        case LOG_ERROR:   levelStr = "ERROR"; break;
-        case LOG_FATAL:   levelStr = "FATAL"; break;
+            
+            // Format time
+            char timeBuffer[20];
+            std::strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%d %H:%M:%S", &tm_logged);
+            
+            // Select log level prefix
+            const char* levelStr = "";
+            
+            switch (record.level) {
+                case LOG_DEBUG:   levelStr = "DEBUG"; break;
+                case LOG_INFO:    levelStr = "INFO"; break;
+                case LOG_WARNING: levelStr = "WARNING"; break;
+                case LOG_ERROR:   levelStr = "ERROR"; break;
+                case LOG_FATAL:   levelStr = "FATAL"; break;
+            }
+            
+            file << "[" << timeBuffer << "] " << std::setw(7) << std::left << levelStr << " " << record.message
+                 << "\n";
+        }
+        file.flush();
+        batch.clear();
+        
+        lock.lock();
+        writing = false;
+        drained.notify_all();
     }
-    
-    // Output the log message
-    file << "[" << timeBuffer << "] " << std::setw(7) << std::left << levelStr << " " << message << std::endl;
 }
 
 bool FileLogger::isEnabled(LogLevel level) const {
-    return level >= minLevel && file.is_open();
+    return level >= minLevel && open;
 }
 
 void FileLogger::setMinLevel(LogLevel level) {
     minLevel = level;
 }
 
+void FileLogger::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    drained.wait(lock, [this] { return (pending.empty() && !writing) || !writer.joinable(); });
+}
+
+// Buffered logger implementation
+BufferedLogger::BufferedLogger(LogLevel level)
+    : minLevel(level) {
+}
+
+void BufferedLogger::log(LogLevel level, const std::string& message) {
+    if (level < minLevel) {
+        return;
+    }
+    
+    messages.emplace_back(level, message);
+}
+
+bool BufferedLogger::isEnabled(LogLevel level) const {
+    return level >= minLevel;
+}
+
+void BufferedLogger::setMinLevel(LogLevel level) {
+    minLevel = level;
+}
+
+void BufferedLogger::flush(Logger* target) {
+    if (target) {
+        for (const auto& entry : messages) {
+            target->log(entry.first, entry.second);
+        }
+    }
+    
+    messages.clear();
+}
+
+// Log message formatting
+bool detail::appendLogFormat(std::string& out, std::string_view& format) {
+    for (;;) {
+        // Copy the text up to the next brace in one piece
+        size_t brace = format.find_first_of("{}");
+        out.append(format.data(), brace == std::string_view::npos ? format.size() : brace);
+        if (brace == std::string_view::npos) {
+            format = std::string_view();
+            return false;
+        }
+        
+        char c = format[brace];
+        char next = brace + 1 < format.size() ? format[brace + 1] : '\0';
+        if (c == '{' && next == '}') {
+            format.remove_prefix(brace + 2);
+            return true;
+        }
+        
+        // {{ and }} are literal braces; a lone brace is kept as it is
+        out += c;
+        format.remove_prefix(brace + (next == c ? 2 : 1));
+    }
+}
+
 // Global logger implementation
 void GlobalLogger::setInstance(std::unique_ptr<Logger> logger) {
     instance = std::move(logger);
 }
 
 Logger* GlobalLogger::getInstance() {
-    return instance.get();
+    return threadInstance ? threadInstance : instance.get();
+}
+
+Logger* GlobalLogger::setThreadInstance(Logger* logger) {
+    Logger* previous = threadInstance;
+    threadInstance = logger;
+    return previous;
 }
 
 void GlobalLogger::log(LogLevel level, const std::string& message) {
-    if (instance) {
-        instance->log(level, message);
+    Logger* logger = getInstance();
+    if (logger) {
+        logger->log(level, message);
     }
 }
 
 bool GlobalLogger::isEnabled(LogLevel level) {
-    return instance && instance->isEnabled(level);
+    Logger* logger = getInstance();
+    return logger && logger->isEnabled(level);
+}
+
+// Thread logger scope implementation
+ThreadLoggerScope::ThreadLoggerScope(Logger* logger)
+    : previous(GlobalLogger::setThreadInstance(logger)) {
+}
+
+ThreadLoggerScope::~ThreadLoggerScope() {
+    GlobalLogger::setThreadInstance(previous);
 }
 
 } // namespace coil
\ No newline at end of file
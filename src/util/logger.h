@@ -2,9 +2,32 @@
 #define COIL_UTIL_LOGGER_H
 
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <ctime>
+#include <type_traits>
+#include <vector>
+#include <utility>
+
+/**
+ * @brief Lowest log level compiled in (0 is LOG_DEBUG, 4 is LOG_FATAL)
+ *
+ * Logging below this level is removed at compile time, message formatting
+ * included. Release builds (NDEBUG) leave out debug logging by default.
+ */
+#ifndef COIL_LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define COIL_LOG_MIN_LEVEL 1
+#else
+#define COIL_LOG_MIN_LEVEL 0
+#endif
+#endif
 
 namespace coil {
 
@@ -19,6 +42,16 @@ enum LogLevel {
     LOG_FATAL    // Fatal error messages
 };
 
+/**
+ * @brief Check whether logging at a level is compiled in
+ * 
+ * @param level Log level
+ * @return true if the level is at or above COIL_LOG_MIN_LEVEL
+ */
+constexpr bool isLogLevelCompiled(LogLevel level) {
+    return static_cast<int>(level) >= COIL_LOG_MIN_LEVEL;
+}
+
 /**
  * @brief Logger interface
  */
@@ -56,7 +89,8 @@ public:
 /**
  * @brief Console logger
  * 
- * Logs messages to the console.
+ * Logs messages to the console. Messages from different threads are
+ * written whole, never interleaved.
  */
 class ConsoleLogger : public Logger {
 private:
@@ -78,12 +112,34 @@ public:
 /**
  * @brief File logger
  * 
- * Logs messages to a file.
+ * Logs messages to a file. Logging only queues the message; a writer
+ * thread formats the queued messages and writes them in batches, so the
+ * logging thread never waits for the file. Fatal messages are written
+ * before log() returns.
  */
 class FileLogger : public Logger {
 private:
-    LogLevel minLevel;  // Minimum log level
-    std::ofstream file; // Output file
+    /**
+     * @brief Message waiting to be written
+     */
+    struct Record {
+        LogLevel level;       // Log level
+        std::time_t time;     // Time the message was logged
+        std::string message;  // Message text
+    };
+    
+    LogLevel minLevel;                 // Minimum log level
+    std::ofstream file;                // Output file
+    bool open;                         // true if the file could be opened
+    std::mutex mutex;                  // Guards the queue
+    std::condition_variable wake;      // Signals the writer (new messages or stop)
+    std::condition_variable drained;   // Signals that the queue has been written
+    std::vector<Record> pending;       // Messages not yet taken by the writer
+    bool writing;                      // true while the writer has a batch in hand
+    bool stopping;                     // true once the logger is being destroyed
+    std::thread writer;                // Writes queued messages to the file
+    
+    void writeLoop();
 
 public:
     /**
@@ -95,23 +151,62 @@ public:
     FileLogger(const std::string& filename, LogLevel level = LOG_INFO);
     
     /**
-     * @brief Destroy the File Logger
+     * @brief Destroy the File Logger, writing any queued messages
      */
     ~FileLogger() override;
     
     void log(LogLevel level, const std::string& message) override;
     bool isEnabled(LogLevel level) const override;
     void setMinLevel(LogLevel level) override;
+    
+    /**
+     * @brief Wait until every message logged so far is written
+     */
+    void flush();
+};
+
+/**
+ * @brief Buffered logger
+ * 
+ * Keeps messages in memory until they are flushed to another logger, so
+ * work running on different threads can report its output in a fixed
+ * order. A buffered logger is used by one thread at a time.
+ */
+class BufferedLogger : public Logger {
+private:
+    LogLevel minLevel;  // Minimum log level
+    std::vector<std::pair<LogLevel, std::string>> messages; // Buffered messages
+
+public:
+    /**
+     * @brief Construct a new Buffered Logger
+     * 
+     * @param level Minimum log level
+     */
+    explicit BufferedLogger(LogLevel level = LOG_INFO);
+    
+    void log(LogLevel level, const std::string& message) override;
+    bool isEnabled(LogLevel level) const override;
+    void setMinLevel(LogLevel level) override;
+    
+    /**
+     * @brief Pass the buffered messages on, in the order they were logged
+     * 
+     * @param target Logger to pass the messages to
+     */
+    void flush(Logger* target);
 };
 
 /**
  * @brief Global logger
  * 
- * Provides access to the global logger instance.
+ * Provides access to the global logger instance. A thread can redirect
+ * its own logging to another logger with a ThreadLoggerScope.
  */
 class GlobalLogger {
 private:
     static std::unique_ptr<Logger> instance;
+    static thread_local Logger* threadInstance; // Per-thread override
 
 public:
     /**
@@ -128,6 +223,14 @@ public:
      */
     static Logger* getInstance();
     
+    /**
+     * @brief Set the logger used by the calling thread
+     * 
+     * @param logger Logger for this thread, or nullptr for the global one
+     * @return Previous logger for this thread
+     */
+    static Logger* setThreadInstance(Logger* logger);
+    
     /**
      * @brief Log a message
      * 
@@ -145,12 +248,123 @@ public:
     static bool isEnabled(LogLevel level);
 };
 
-// Helper macros for logging
-#define LOG_DEBUG(message) if (coil::GlobalLogger::isEnabled(coil::LOG_DEBUG)) coil::GlobalLogger::log(coil::LOG_DEBUG, message)
-#define LOG_INFO(message) if (coil::GlobalLogger::isEnabled(coil::LOG_INFO)) coil::GlobalLogger::log(coil::LOG_INFO, message)
-#define LOG_WARNING(message) if (coil::GlobalLogger::isEnabled(coil::LOG_WARNING)) coil::GlobalLogger::log(coil::LOG_WARNING, message)
-#define LOG_ERROR(message) if (coil::GlobalLogger::isEnabled(coil::LOG_ERROR)) coil::GlobalLogger::log(coil::LOG_ERROR, message)
-#define LOG_FATAL(message) if (coil::GlobalLogger::isEnabled(coil::LOG_FATAL)) coil::GlobalLogger::log(coil::LOG_FATAL, message)
+/**
+ * @brief Redirects the calling thread's logging for a scope
+ */
+class ThreadLoggerScope {
+private:
+    Logger* previous;  // Logger to restore on exit
+
+public:
+    /**
+     * @brief Log to a logger until the end of the scope
+     * 
+     * @param logger Logger for this thread
+     */
+    explicit ThreadLoggerScope(Logger* logger);
+    
+    /**
+     * @brief Restore the previous logger
+     */
+    ~ThreadLoggerScope();
+    
+    ThreadLoggerScope(const ThreadLoggerScope&) = delete;
+    ThreadLoggerScope& operator=(const ThreadLoggerScope&) = delete;
+};
+
+namespace detail {
+
+/**
+ * @brief Append format text up to the next {} placeholder
+ * 
+ * {{ and }} stand for literal braces.
+ * 
+ * @param out Message being built
+ * @param format Remaining format text, advanced past the placeholder
+ * @return true if a placeholder was found, false at the end of the format
+ */
+bool appendLogFormat(std::string& out, std::string_view& format);
+
+inline void appendLogArgument(std::string& out, std::string_view value) {
+    out.append(value.data(), value.size());
+}
+
+inline void appendLogArgument(std::string& out, const std::string& value) {
+    out += value;
+}
+
+inline void appendLogArgument(std::string& out, const char* value) {
+    out += value;
+}
+
+inline void appendLogArgument(std::string& out, char value) {
+    out += value;
+}
+
+template <typename T>
+void appendLogArgument(std::string& out, const T& value) {
+    if constexpr (std::is_enum_v<T>) {
+        appendLogArgument(out, static_cast<std::underlying_type_t<T>>(value));
+    } else if constexpr (std::is_integral_v<T>) {
+        out += std::to_string(+value);
+    } else {
+        std::ostringstream stream;
+        stream << value;
+        out += stream.str();
+    }
+}
+
+} // namespace detail
+
+/**
+ * @brief Message that needs no formatting
+ */
+inline const std::string& formatLog(const std::string& message) {
+    return message;
+}
+
+inline std::string formatLog(const char* message) {
+    return message;
+}
+
+/**
+ * @brief Format a log message
+ * 
+ * Each {} in the format is replaced with the next argument: strings as
+ * they are, integers in decimal, anything else through operator<<.
+ * 
+ * @param format Format text
+ * @param args Arguments for the placeholders
+ * @return Formatted message
+ */
+template <typename... Args>
+std::string formatLog(std::string_view format, const Args&... args) {
+    std::string message;
+    message.reserve(format.size() + 16 * sizeof...(Args));
+    ((detail::appendLogFormat(message, format) ? detail::appendLogArgument(message, args) : void()), ...);
+    detail::appendLogFormat(message, format);
+    return message;
+}
+
+// Helper macros for logging. Levels below COIL_LOG_MIN_LEVEL compile to
+// nothing; otherwise the message is only formatted when the level is
+// enabled. Either a ready message or a format and its arguments:
+//   LOG_INFO("Processing input file: " + inputFile);
+//   LOG_DEBUG("Loaded {} cached functions from {}", entries.size(), path);
+#define COIL_LOG(level, ...) \
+    do { \
+        if constexpr (coil::isLogLevelCompiled(level)) { \
+            if (coil::GlobalLogger::isEnabled(level)) { \
+                coil::GlobalLogger::log(level, coil::formatLog(__VA_ARGS__)); \
+            } \
+        } \
+    } while (0)
+
+#define LOG_DEBUG(...) COIL_LOG(coil::LOG_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) COIL_LOG(coil::LOG_INFO, __VA_ARGS__)
+#define LOG_WARNING(...) COIL_LOG(coil::LOG_WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) COIL_LOG(coil::LOG_ERROR, __VA_ARGS__)
+#define LOG_FATAL(...) COIL_LOG(coil::LOG_FATAL, __VA_ARGS__)
 
 } // namespace coil
 
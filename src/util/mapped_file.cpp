@@ -0,0 +1,88 @@
+#include "util/mapped_file.h"
+#include <fstream>
+#include <iterator>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace coil {
+
+MappedFile::MappedFile()
+    : data(""), size(0), mapped(false) {
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (mapped) {
+        munmap(const_cast<char*>(data), size);
+    }
+#endif
+}
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string& filename) {
+    std::unique_ptr<MappedFile> file(new MappedFile());
+
+#ifndef _WIN32
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            // Nothing to map, an empty view is enough
+            ::close(fd);
+            return file;
+        }
+
+        void* addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            ::close(fd);
+
+            // The lexer walks the input front to back exactly once
+            madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+            file->data = static_cast<const char*>(addr);
+            file->size = static_cast<size_t>(st.st_size);
+            file->mapped = true;
+            return file;
+        }
+    }
+
+    // Not a regular file or mapping failed, fall back to reading it
+    ::close(fd);
+#endif
+
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        return nullptr;
+    }
+
+    file->buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    file->data = file->buffer.data();
+    file->size = file->buffer.size();
+    return file;
+}
+
+const char* MappedFile::getData() const {
+    return data;
+}
+
+size_t MappedFile::getSize() const {
+    return size;
+}
+
+std::string_view MappedFile::getContents() const {
+    return std::string_view(data, size);
+}
+
+bool MappedFile::isMapped() const {
+    return mapped;
+}
+
+} // namespace coil
@@ -0,0 +1,75 @@
+#ifndef COIL_UTIL_MAPPED_FILE_H
+#define COIL_UTIL_MAPPED_FILE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace coil {
+
+/**
+ * @brief Read-only view of a file's contents
+ *
+ * Maps the file into memory when the platform and file type allow it,
+ * otherwise reads it into an owned buffer. Views handed out by the
+ * object (e.g. token text) stay valid for as long as it is alive.
+ */
+class MappedFile {
+private:
+    const char* data;      // Start of the file contents
+    size_t size;           // Size of the file contents in bytes
+    bool mapped;           // true if data points into a memory mapping
+    std::string buffer;    // Owned contents when the file is not mapped
+
+    MappedFile();
+
+public:
+    /**
+     * @brief Destroy the Mapped File, unmapping the contents
+     */
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Open a file for reading
+     *
+     * @param filename File to open
+     * @return Mapped file, or nullptr if the file could not be read
+     */
+    static std::unique_ptr<MappedFile> open(const std::string& filename);
+
+    /**
+     * @brief Get the file contents
+     *
+     * @return Pointer to the first byte of the file
+     */
+    const char* getData() const;
+
+    /**
+     * @brief Get the file size
+     *
+     * @return Size in bytes
+     */
+    size_t getSize() const;
+
+    /**
+     * @brief Get the file contents as a string view
+     *
+     * @return View over the whole file
+     */
+    std::string_view getContents() const;
+
+    /**
+     * @brief Check if the contents are memory-mapped
+     *
+     * @return true if mapped, false if read into a buffer
+     */
+    bool isMapped() const;
+};
+
+} // namespace coil
+
+#endif // COIL_UTIL_MAPPED_FILE_H
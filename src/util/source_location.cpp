@@ -1,5 +1,7 @@
 #include "util/source_location.h"
+#include <mutex>
 #include <sstream>
+#include <unordered_set>
 
 namespace coil {
 
@@ -9,4 +11,24 @@ std::string SourceLocation::toString() const {
     return oss.str();
 }
 
-} // namespace coil
\ No newline at end of file
+std::string_view SourceLocation::intern(std::string_view file) {
+    if (file.empty()) {
+        return std::string_view();
+    }
+    
+    // The name this thread interned last is recognized without the lock
+    thread_local std::string_view last;
+    if (file.data() == last.data() && file.size() == last.size()) {
+        return last;
+    }
+    
+    // The set never shrinks and its nodes never move, so names stay valid
+    static std::mutex mutex;
+    static std::unordered_set<std::string>* names = new std::unordered_set<std::string>();
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    last = *names->emplace(file).first;
+    return last;
+}
+
+} // namespace coil
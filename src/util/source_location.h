@@ -2,23 +2,39 @@
 #define COIL_UTIL_SOURCE_LOCATION_H
 
 #include <string>
+#include <string_view>
 
 namespace coil {
 
 /**
  * @brief Token position in source code
+ * 
+ * The filename is interned: every location in the same file refers to one
+ * copy of the name, which lives until the process exits, so locations are
+ * cheap to copy.
  */
 struct SourceLocation {
-    std::string filename;  // Source filename
-    int line;              // Line number (1-based)
-    int column;            // Column number (1-based)
+    std::string_view filename;  // Source filename (interned)
+    int line;                   // Line number (1-based)
+    int column;                 // Column number (1-based)
     
-    SourceLocation(const std::string& file = "", int l = 1, int c = 1)
-        : filename(file), line(l), column(c) {}
+    SourceLocation(std::string_view file = std::string_view(), int l = 1, int c = 1)
+        : filename(intern(file)), line(l), column(c) {}
         
     std::string toString() const;
+    
+    /**
+     * @brief Get the interned copy of a filename
+     * 
+     * Passing the name the calling thread interned last takes no lock,
+     * which is the common case of a lexer making its tokens' locations.
+     * 
+     * @param file Filename
+     * @return Interned filename, valid until the process exits
+     */
+    static std::string_view intern(std::string_view file);
 };
 
 } // namespace coil
 
-#endif // COIL_UTIL_SOURCE_LOCATION_H
\ No newline at end of file
+#endif // COIL_UTIL_SOURCE_LOCATION_H
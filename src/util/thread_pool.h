@@ -0,0 +1,78 @@
+#ifndef COIL_UTIL_THREAD_POOL_H
+#define COIL_UTIL_THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace coil {
+
+/**
+ * @brief Fixed-size pool of worker threads
+ *
+ * Tasks are run in submission order by whichever worker is free. A pool
+ * with a single thread runs every task on the calling thread inside
+ * submit(), so serial builds do not pay for thread startup.
+ */
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;  // Worker threads (empty when serial)
+    std::deque<std::function<void()>> tasks; // Tasks waiting for a worker
+    std::mutex mutex;                  // Guards tasks, pending and stopping
+    std::condition_variable taskReady; // Signalled when a task is queued
+    std::condition_variable allDone;   // Signalled when pending drops to 0
+    size_t pending;                    // Tasks queued or running
+    bool stopping;                     // Set when the pool is destroyed
+
+    void workerLoop();
+
+public:
+    /**
+     * @brief Construct a new Thread Pool
+     *
+     * @param threadCount Number of threads (0 picks one per hardware thread)
+     */
+    explicit ThreadPool(size_t threadCount);
+
+    /**
+     * @brief Destroy the Thread Pool after finishing all queued tasks
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Queue a task
+     *
+     * @param task Task to run
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * @brief Wait until every submitted task has finished
+     */
+    void wait();
+
+    /**
+     * @brief Get the number of threads tasks run on
+     *
+     * @return Thread count (1 when tasks run on the calling thread)
+     */
+    size_t getThreadCount() const;
+
+    /**
+     * @brief Get the number of hardware threads
+     *
+     * @return Hardware thread count (at least 1)
+     */
+    static size_t hardwareThreads();
+};
+
+} // namespace coil
+
+#endif // COIL_UTIL_THREAD_POOL_H
@@ -0,0 +1,182 @@
+#include "util/time_report.h"
+#include "util/allocation_counter.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+
+namespace coil {
+
+/**
+ * @brief Read the CPU clock of the process or of the calling thread
+ */
+static double cpuSeconds(bool threadOnly) {
+#ifndef _WIN32
+    timespec now;
+    if (clock_gettime(threadOnly ? CLOCK_THREAD_CPUTIME_ID : CLOCK_PROCESS_CPUTIME_ID, &now) == 0) {
+        return static_cast<double>(now.tv_sec) + static_cast<double>(now.tv_nsec) / 1e9;
+    }
+#else
+    (void)threadOnly;
+#endif
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+}
+
+/**
+ * @brief Quote a string for JSON
+ */
+static std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned>(c));
+            quoted += escape;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+TimeReport::Scope::Scope(TimeReport* timeReport, const std::string& phaseName)
+    : report(timeReport), name(phaseName) {
+    if (report) {
+        begin = report->sample();
+    }
+}
+
+TimeReport::Scope::~Scope() {
+    end();
+}
+
+void TimeReport::Scope::end() {
+    if (report) {
+        report->add(name, begin, report->sample());
+        report = nullptr;
+    }
+}
+
+TimeReport::TimeReport(const std::string& reportLabel, Clock::time_point startTime, bool callingThreadOnly)
+    : label(reportLabel), epoch(startTime), threadOnly(callingThreadOnly) {
+}
+
+ResourceSample TimeReport::sample(bool withCpu) const {
+    ResourceSample result;
+    result.wall = std::chrono::duration<double>(Clock::now() - epoch).count();
+    result.cpu = withCpu ? cpuSeconds(threadOnly) : -1;
+
+    AllocationCount allocations = threadOnly ? AllocationCounter::thread() : AllocationCounter::process();
+    result.allocations = allocations.count;
+    result.allocatedBytes = allocations.bytes;
+    return result;
+}
+
+void TimeReport::add(const std::string& name, const ResourceSample& begin, const ResourceSample& end) {
+    Phase phase;
+    phase.name = name;
+    phase.start = begin.wall;
+    phase.span = end.wall - begin.wall;
+    phase.cost.wall = phase.span;
+    phase.cost.cpu = begin.cpu >= 0 && end.cpu >= 0 ? end.cpu - begin.cpu : -1;
+    phase.cost.allocations = end.allocations - begin.allocations;
+    phase.cost.allocatedBytes = end.allocatedBytes - begin.allocatedBytes;
+    phases.push_back(phase);
+}
+
+void TimeReport::splitLast(const std::string& name, const ResourceSample& cost) {
+    if (phases.empty()) {
+        return;
+    }
+
+    Phase& outer = phases.back();
+    Phase inner;
+    inner.name = name;
+    inner.start = outer.start;
+    inner.span = cost.wall;
+    inner.cost = cost;
+    if (inner.cost.cpu < 0) {
+        inner.cost.cpu = cost.wall;
+    }
+
+    outer.cost.wall = std::max(0.0, outer.cost.wall - inner.cost.wall);
+    if (outer.cost.cpu >= 0) {
+        outer.cost.cpu = std::max(0.0, outer.cost.cpu - inner.cost.cpu);
+    }
+    outer.cost.allocations -= std::min(outer.cost.allocations, inner.cost.allocations);
+    outer.cost.allocatedBytes -= std::min(outer.cost.allocatedBytes, inner.cost.allocatedBytes);
+
+    phases.insert(phases.end() - 1, inner);
+}
+
+const std::string& TimeReport::getLabel() const {
+    return label;
+}
+
+const std::vector<TimeReport::Phase>& TimeReport::getPhases() const {
+    return phases;
+}
+
+void TimeReport::print(std::ostream& out) const {
+    char line[128];
+    out << "Time report for " << label << ":\n";
+    snprintf(line, sizeof(line), "  %-12s %10s %10s %12s %14s\n", "Phase", "Wall ms", "CPU ms", "Allocations",
+             "Bytes");
+    out << line;
+
+    ResourceSample total;
+    for (const auto& phase : phases) {
+        snprintf(line, sizeof(line), "  %-12s %10.3f %10.3f %12llu %14llu\n", phase.name.c_str(),
+                 phase.cost.wall * 1e3, std::max(0.0, phase.cost.cpu) * 1e3,
+                 static_cast<unsigned long long>(phase.cost.allocations),
+                 static_cast<unsigned long long>(phase.cost.allocatedBytes));
+        out << line;
+
+        total.wall += phase.cost.wall;
+        total.cpu += std::max(0.0, phase.cost.cpu);
+        total.allocations += phase.cost.allocations;
+        total.allocatedBytes += phase.cost.allocatedBytes;
+    }
+
+    snprintf(line, sizeof(line), "  %-12s %10.3f %10.3f %12llu %14llu\n", "total", total.wall * 1e3,
+             total.cpu * 1e3, static_cast<unsigned long long>(total.allocations),
+             static_cast<unsigned long long>(total.allocatedBytes));
+    out << line;
+}
+
+bool TimeReport::writeTrace(const std::string& filename, const std::vector<const TimeReport*>& reports) {
+    std::ofstream out(filename);
+    if (!out) {
+        return false;
+    }
+
+    // Complete ("X") events in microseconds; an inner phase starts with its
+    // outer one, so viewers nest it there
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    char event[256];
+    for (size_t i = 0; i < reports.size(); i++) {
+        size_t tid = i + 1;
+        out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+            << ",\"args\":{\"name\":" << jsonString(reports[i]->label) << "}}";
+        first = false;
+
+        for (const auto& phase : reports[i]->phases) {
+            snprintf(event, sizeof(event),
+                     ",\n{\"name\":%s,\"cat\":\"coilasm\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,"
+                     "\"dur\":%.3f,\"args\":{\"cpu_ms\":%.3f,\"allocations\":%llu,\"allocated_bytes\":%llu}}",
+                     jsonString(phase.name).c_str(), tid, phase.start * 1e6, phase.span * 1e6,
+                     std::max(0.0, phase.cost.cpu) * 1e3, static_cast<unsigned long long>(phase.cost.allocations),
+                     static_cast<unsigned long long>(phase.cost.allocatedBytes));
+            out << event;
+        }
+    }
+    out << "\n]}\n";
+
+    return static_cast<bool>(out);
+}
+
+} // namespace coil
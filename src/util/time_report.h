@@ -0,0 +1,152 @@
+#ifndef COIL_UTIL_TIME_REPORT_H
+#define COIL_UTIL_TIME_REPORT_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace coil {
+
+/**
+ * @brief Resources used up to a point in time, or between two points
+ */
+struct ResourceSample {
+    double wall;              // Wall-clock seconds
+    double cpu;               // CPU seconds (negative if not measured)
+    uint64_t allocations;     // Heap allocations
+    uint64_t allocatedBytes;  // Heap bytes requested
+
+    ResourceSample() : wall(0), cpu(0), allocations(0), allocatedBytes(0) {}
+};
+
+/**
+ * @brief Wall time, CPU time and allocations of the phases of one input
+ *
+ * A report measures either the whole process, which includes worker
+ * threads a phase hands work to, or only the calling thread, for inputs
+ * assembled side by side. Allocations are only counted once
+ * AllocationCounter::enable() has been called.
+ */
+class TimeReport {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Measured phase
+     */
+    struct Phase {
+        std::string name;      // Phase name
+        double start;          // Start, in seconds since the report's epoch
+        double span;           // Wall-clock extent, including inner phases
+        ResourceSample cost;   // Resources used by the phase itself
+    };
+
+    /**
+     * @brief Measures a phase from construction until end() or destruction
+     *
+     * Does nothing when constructed without a report.
+     */
+    class Scope {
+    private:
+        TimeReport* report;    // Report to add the phase to (nullptr once ended)
+        std::string name;      // Phase name
+        ResourceSample begin;  // Resources used when the phase started
+
+    public:
+        Scope(TimeReport* timeReport, const std::string& phaseName);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        /**
+         * @brief End the phase early
+         */
+        void end();
+    };
+
+private:
+    std::string label;           // What the report is about (the input file)
+    Clock::time_point epoch;     // Time zero of the report
+    bool threadOnly;             // true to measure the calling thread only
+    std::vector<Phase> phases;   // Phases in the order they ended
+
+public:
+    /**
+     * @brief Construct a new Time Report
+     *
+     * @param reportLabel What the report is about
+     * @param startTime Time zero, shared by reports that go into one trace
+     * @param callingThreadOnly true to measure only the calling thread
+     */
+    TimeReport(const std::string& reportLabel, Clock::time_point startTime, bool callingThreadOnly);
+
+    /**
+     * @brief Sample the resources used so far
+     *
+     * @param withCpu false to skip reading the CPU clock, which is slower
+     *                than the others
+     * @return Resources used since the epoch
+     */
+    ResourceSample sample(bool withCpu = true) const;
+
+    /**
+     * @brief Add a phase
+     *
+     * @param name Phase name
+     * @param begin Sample taken when the phase started
+     * @param end Sample taken when the phase ended
+     */
+    void add(const std::string& name, const ResourceSample& begin, const ResourceSample& end);
+
+    /**
+     * @brief Split part of the last phase off into a phase of its own
+     *
+     * For work interleaved with another phase, such as lexing that happens
+     * token by token while parsing. The inner phase is listed before the
+     * outer one, whose cost is reduced by the inner cost; an inner phase
+     * without CPU time is taken to have spent its wall time on the CPU.
+     *
+     * @param name Inner phase name
+     * @param cost Resources used by the inner work
+     */
+    void splitLast(const std::string& name, const ResourceSample& cost);
+
+    /**
+     * @brief Get the label
+     *
+     * @return Report label
+     */
+    const std::string& getLabel() const;
+
+    /**
+     * @brief Get the measured phases
+     *
+     * @return Phases in pipeline order
+     */
+    const std::vector<Phase>& getPhases() const;
+
+    /**
+     * @brief Print the phases as a table with a total
+     *
+     * @param out Output stream
+     */
+    void print(std::ostream& out) const;
+
+    /**
+     * @brief Write reports in the Chrome trace event format
+     *
+     * Each report becomes a thread of its own, named after its label.
+     *
+     * @param filename Output file
+     * @param reports Reports to write
+     * @return true if the file was written
+     */
+    static bool writeTrace(const std::string& filename, const std::vector<const TimeReport*>& reports);
+};
+
+} // namespace coil
+
+#endif // COIL_UTIL_TIME_REPORT_H
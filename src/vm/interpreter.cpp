@@ -0,0 +1,1540 @@
+#include "vm/interpreter.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "binary/cof.h"
+#include "core/instruction.h"
+#include "core/instruction_decoder.h"
+#include "util/logger.h"
+
+namespace coil {
+
+// Handlers, in the order of the dispatch table
+#define COIL_VM_OPS(X)                                                                                      \
+    X(END) X(NOP) X(HALT) X(TRAP) X(BR) X(BR_INDIRECT) X(BRC) X(BRC_INDIRECT) X(CALL) X(CALL_INDIRECT)     \
+    X(RET) X(SYSC) X(MOV) X(MOV_S) X(LOAD) X(STORE) X(PUSH) X(POP) X(POP_REVERSE) X(EXCHANGE) X(CMP)       \
+    X(CMP_S) X(CMP_BRC_S) X(TEST) X(ADD) X(ADD_S) X(SUB) X(SUB_S) X(MUL) X(MUL_S) X(DIV) X(MOD) X(NEG)     \
+    X(INC) X(DEC) X(ABS) X(MIN) X(MAX) X(AND) X(AND_S) X(OR) X(OR_S) X(XOR) X(XOR_S) X(ANDN) X(ORN)      \
+    X(XNOR) X(NOT) X(SHL) X(SHL_S) X(SHR) X(SHR_S) X(SAR) X(ROL) X(ROR) X(BSWAP) X(CLZ) X(CTZ) X(POPCNT) \
+    X(BT) X(BTS) X(BTR) X(BTC)
+
+/**
+ * @brief Handlers of pre-decoded instructions
+ *
+ * The _S forms only take registers and constants, so they skip the
+ * operand kind checks; CMP_BRC_S is a register compare fused with the
+ * conditional branch after it.
+ */
+enum VmOp : uint8_t {
+#define COIL_VM_ENUM(name) VM_##name,
+    COIL_VM_OPS(COIL_VM_ENUM)
+#undef COIL_VM_ENUM
+    VM_OP_COUNT
+};
+
+/**
+ * @brief How the flags were last set
+ *
+ * Flags are kept as the operands and result of the operation that set
+ * them, and only worked out when a branch asks for them.
+ */
+enum VmFlags : uint8_t {
+    VM_FLAGS_LOGIC, // Zero, negative and parity from the result; carry and overflow clear
+    VM_FLAGS_ADD,   // result = a + b
+    VM_FLAGS_SUB,   // result = a - b
+    VM_FLAGS_CARRY  // Bit test: carry is a, the rest from the result
+};
+
+// Default convention, as COIL registers
+static const uint8_t argumentRegisters[] = {REG_R4, REG_R5, REG_R3, REG_R2, REG_R6, REG_R7};
+static const uint8_t resultRegisters[] = {REG_R0, REG_R3};
+
+// Linux x86-64 system call arguments (RDI, RSI, RDX, R10, R8, R9)
+static const uint8_t systemArgumentRegisters[] = {REG_R4, REG_R5, REG_R3, REG_R8, REG_R6, REG_R7};
+
+static constexpr uint32_t SLOT_SP = 16;            // Slot of the stack pointer
+static constexpr uint32_t SLOT_FRAME_PTR = 17;     // Slot of the frame pointer
+static constexpr uint64_t ADDRESS_ABI = UINT64_MAX; // Symbol operand without a relocation
+
+static constexpr uint64_t SYS_WRITE = 1;
+static constexpr uint64_t SYS_EXIT = 60;
+static constexpr uint64_t SYS_EXIT_GROUP = 231;
+static constexpr int64_t ERROR_BADF = -9;
+static constexpr int64_t ERROR_FAULT = -14;
+static constexpr int64_t ERROR_NOSYS = -38;
+
+/**
+ * @brief Get the slot of a COIL register
+ *
+ * @param vregId COIL register
+ * @param slot Slot (output parameter)
+ * @return true if the register has a slot
+ */
+static bool registerSlot(uint8_t vregId, uint32_t& slot) {
+    if (vregId <= REG_R15) {
+        slot = vregId;
+        return true;
+    }
+    if (vregId == REG_SP || vregId == REG_FRAME_PTR) {
+        slot = vregId == REG_SP ? SLOT_SP : SLOT_FRAME_PTR;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Read a little-endian signed integer
+ *
+ * @param bytes Bytes
+ * @param length Number of bytes (1 to 8)
+ * @return Sign-extended value
+ */
+static uint64_t readSigned(const uint8_t* bytes, size_t length) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < length; i++) {
+        value |= static_cast<uint64_t>(bytes[i]) << (i * 8);
+    }
+    if (length < 8 && (bytes[length - 1] & 0x80)) {
+        value |= ~0ULL << (length * 8);
+    }
+    return value;
+}
+
+/**
+ * @brief Check whether an operand can be written
+ */
+static bool isWritable(const VmOperand& operand) {
+    return operand.kind != VM_OPERAND_SLOT || operand.slot < BytecodeProgram::REGISTER_SLOTS;
+}
+
+/**
+ * @brief Check whether an operand is a register or constant
+ */
+static bool isSlot(const VmOperand& operand) {
+    return operand.kind == VM_OPERAND_SLOT;
+}
+
+/**
+ * @brief Work out whether a condition holds
+ *
+ * @param condition Condition code
+ * @param kind How the flags were set (VmFlags)
+ * @param a First operand
+ * @param b Second operand
+ * @param result Result
+ * @return true if the condition holds
+ */
+static inline bool conditionHolds(uint8_t condition, uint8_t kind, uint64_t a, uint64_t b, uint64_t result) {
+    bool zero = result == 0;
+    bool negative = static_cast<int64_t>(result) < 0;
+    bool carry = false;
+    bool overflow = false;
+    if (kind == VM_FLAGS_SUB) {
+        carry = a < b;
+        overflow = (((a ^ b) & (a ^ result)) >> 63) != 0;
+    } else if (kind == VM_FLAGS_ADD) {
+        carry = result < a;
+        overflow = ((~(a ^ b) & (a ^ result)) >> 63) != 0;
+    } else if (kind == VM_FLAGS_CARRY) {
+        carry = a != 0;
+    }
+
+    switch (condition) {
+        case COND_EQ:
+        case COND_Z:
+            return zero;
+        case COND_NE:
+        case COND_NZ:
+            return !zero;
+        case COND_LT:
+            return negative != overflow;
+        case COND_LE:
+            return zero || negative != overflow;
+        case COND_GT:
+            return !zero && negative == overflow;
+        case COND_GE:
+            return negative == overflow;
+        case COND_CS:
+            return carry;
+        case COND_CC:
+            return !carry;
+        case COND_VS:
+            return overflow;
+        case COND_VC:
+            return !overflow;
+        case COND_NS:
+            return negative;
+        case COND_NC:
+            return !negative;
+        case COND_PS:
+            return (__builtin_popcountll(result & 0xFF) & 1) == 0;
+        default:
+            return (__builtin_popcountll(result & 0xFF) & 1) != 0;
+    }
+}
+
+/**
+ * @brief State of the function being pre-decoded
+ */
+struct BytecodeProgram::LoadState {
+    CofFile& cof;                                   // File being loaded
+    InstructionDecoder decoder;                     // Decoder for its code sections
+    std::vector<uint64_t> addresses;                // Section -> address (0 if not loaded)
+    std::vector<std::unordered_map<uint64_t, const RelocationEntry*>> relocations; // Section -> offset -> relocation
+    uint32_t section;                               // Section of the function
+    uint32_t function;                              // Function index
+    std::string failure;                            // Why an instruction cannot be run
+
+    LoadState(CofFile& file) : cof(file), decoder(file.getInstructionEncoding()), section(0), function(0) {}
+
+    bool fail(const std::string& reason) {
+        failure = reason;
+        return false;
+    }
+};
+
+BytecodeProgram::BytecodeProgram() : variableCount(0) {}
+
+uint32_t BytecodeProgram::addConstant(uint64_t value) {
+    auto it = constantAt.find(value);
+    if (it != constantAt.end()) {
+        return it->second;
+    }
+    uint32_t slot = REGISTER_SLOTS + static_cast<uint32_t>(constants.size());
+    constants.push_back(value);
+    constantAt.emplace(value, slot);
+    return slot;
+}
+
+bool BytecodeProgram::translateOperand(LoadState& state, const DecodedInstruction& decoded, size_t index,
+                                       VmOperand& result, uint64_t& address) {
+    const OperandValue& value = state.decoder.getOperand(decoded, index);
+    size_t length;
+    const uint8_t* payload = state.decoder.getOperandPayload(decoded, index, length);
+
+    result = VmOperand{};
+    result.kind = VM_OPERAND_SLOT;
+    result.index = VM_NO_REGISTER;
+    result.scale = 1;
+    address = 0;
+
+    switch (value.getClass()) {
+        case OPERAND_REGISTER:
+            if (length < 1 || !registerSlot(payload[0], result.slot)) {
+                return state.fail("only general-purpose registers, SP and the frame pointer are supported");
+            }
+            return true;
+
+        case OPERAND_IMMEDIATE: {
+            if (value.getSubtype() <= IMM_INT64 && length >= 1 && length <= 8) {
+                result.slot = addConstant(readSigned(payload, length));
+                return true;
+            }
+            if (value.getSubtype() != IMM_SYMBOL) {
+                return state.fail("floating-point immediates are not supported");
+            }
+
+            // Symbols without a relocation name ABIs
+            InstructionEncoding encoding = state.cof.getInstructionEncoding();
+            uint64_t offset = functions[state.function].offset + decoded.offset +
+                              state.decoder.toInstruction(decoded)->operandOffset(index, encoding);
+            auto it = state.relocations[state.section].find(offset);
+            if (it == state.relocations[state.section].end()) {
+                address = ADDRESS_ABI;
+                result.slot = addConstant(0);
+                return true;
+            }
+            const RelocationEntry& relocation = *it->second;
+            const Symbol& symbol = state.cof.getSymbol(relocation.symbol_index);
+            if (symbol.isUndefined() || symbol.getSectionIndex() >= state.addresses.size() ||
+                state.addresses[symbol.getSectionIndex()] == 0) {
+                return state.fail("undefined symbol " + symbol.getName());
+            }
+            address = state.addresses[symbol.getSectionIndex()] + symbol.getValue() + relocation.addend;
+            result.slot = addConstant(address);
+            return true;
+        }
+
+        case OPERAND_MEMORY:
+            result.kind = VM_OPERAND_MEMORY;
+            result.slot = VM_NO_SLOT;
+            switch (value.getSubtype()) {
+                case MEM_DIRECT:
+                    if (length < 4 || (payload[3] & 0x80)) {
+                        return state.fail("absolute address out of range");
+                    }
+                    result.disp = static_cast<int32_t>(readSigned(payload, 4));
+                    return true;
+                case MEM_REG:
+                case MEM_REG_DISP:
+                    if (length < 1 || !registerSlot(payload[0], result.slot)) {
+                        return state.fail("address registers must be general-purpose registers or SP");
+                    }
+                    if (value.getSubtype() == MEM_REG_DISP) {
+                        if (length < 5) {
+                            return state.fail("malformed memory operand");
+                        }
+                        result.disp = static_cast<int32_t>(readSigned(payload + 1, 4));
+                    }
+                    return true;
+                case MEM_REG_REG:
+                case MEM_REG_REG_SCALE: {
+                    uint32_t indexSlot;
+                    if (length < 2 || !registerSlot(payload[0], result.slot) || !registerSlot(payload[1], indexSlot)) {
+                        return state.fail("address registers must be general-purpose registers or SP");
+                    }
+                    result.index = static_cast<uint8_t>(indexSlot);
+                    if (value.getSubtype() == MEM_REG_REG_SCALE) {
+                        if (length < 3 || (payload[2] != 1 && payload[2] != 2 && payload[2] != 4 && payload[2] != 8)) {
+                            return state.fail("scale must be 1, 2, 4 or 8");
+                        }
+                        result.scale = payload[2];
+                    }
+                    return true;
+                }
+                default:
+                    return state.fail("increment and decrement addressing is not supported");
+            }
+
+        default:
+            if (value.getSubtype() != VAR_DIRECT || length < 1) {
+                return state.fail("only direct variable references are supported");
+            }
+            result.kind = VM_OPERAND_VARIABLE;
+            result.slot = payload[0];
+            variableCount = std::max<uint32_t>(variableCount, payload[0] + 1);
+            return true;
+    }
+}
+
+bool BytecodeProgram::translateInstruction(LoadState& state, const DecodedInstruction& decoded,
+                                           VmInstruction& result) {
+    size_t count = decoded.operandCount;
+    std::vector<VmOperand> operands(count);
+    std::vector<uint64_t> addresses(count);
+    for (size_t i = 0; i < count; i++) {
+        if (!translateOperand(state, decoded, i, operands[i], addresses[i])) {
+            return false;
+        }
+    }
+    const uint8_t* extended = state.decoder.getExtendedData(decoded);
+    size_t extendedSize = decoded.extendedSize;
+
+    // Operands as the handler reads them
+    std::vector<VmOperand> list;
+    uint8_t op = VM_NOP;
+
+    auto slotsOnly = [&list]() {
+        return std::all_of(list.begin(), list.end(), isSlot);
+    };
+    // dest = dest op source, or dest = a op b
+    auto binary = [&](uint8_t handler, uint8_t slotHandler) {
+        if (count != 2 && count != 3) {
+            return state.fail("expected two or three operands");
+        }
+        list = {operands[0], operands[count - 2], operands[count - 1]};
+        op = slotHandler != VM_NOP && slotsOnly() ? slotHandler : handler;
+        return true;
+    };
+    // dest = op dest, or dest = op source
+    auto unary = [&](uint8_t handler) {
+        if (count != 1 && count != 2) {
+            return state.fail("expected one or two operands");
+        }
+        list = {operands[0], operands[count - 1]};
+        op = handler;
+        return true;
+    };
+    auto exact = [&](size_t expected, uint8_t handler) {
+        if (count != expected) {
+            return state.fail(expected == 1 ? "expected one operand" : "expected two operands");
+        }
+        list = operands;
+        op = handler;
+        return true;
+    };
+    // Branches to a symbol or label carry the index of their target; a
+    // target just past the function is its guard
+    auto branch = [&](uint8_t direct, uint8_t indirect) {
+        if (count < 1 || addresses[0] == ADDRESS_ABI) {
+            return state.fail("expected a branch target");
+        }
+        if (addresses[0] == 0) {
+            list = {operands[0]};
+            op = indirect;
+            return true;
+        }
+        const VmFunction& function = functions[state.function];
+        uint64_t end = function.address + instructions[function.end].offset - function.offset;
+        auto it = instructionAt.find(addresses[0]);
+        if (addresses[0] == end) {
+            result.target = function.end;
+        } else if (it != instructionAt.end()) {
+            result.target = it->second;
+        } else {
+            return state.fail("branch target is not an instruction");
+        }
+        op = direct;
+        return true;
+    };
+    // CALL [abi] callee [args] [-> results]; SYSC [abi] number [args] [-> results]
+    auto call = [&](bool system) {
+        size_t results = 0;
+        if (extendedSize > 0 && extended[extendedSize - 1] <= count) {
+            results = extended[extendedSize - 1];
+        }
+        size_t first = count > 0 && addresses[0] == ADDRESS_ABI ? 1 : 0;
+        if (first + results >= count) {
+            return state.fail(system ? "expected a system call number" : "expected a call target");
+        }
+        if (count - results - first - 1 > 6 || results > 2) {
+            return state.fail("more arguments or results than the convention has registers");
+        }
+        list.assign(operands.begin() + first, operands.end());
+        result.condition = static_cast<uint8_t>(results);
+        if (system) {
+            op = VM_SYSC;
+            return true;
+        }
+        if (addresses[first] == 0) {
+            op = VM_CALL_INDIRECT;
+            return true;
+        }
+        auto it = functionAt.find(addresses[first]);
+        if (it == functionAt.end()) {
+            return state.fail("call target is not a function");
+        }
+        result.target = it->second;
+        op = VM_CALL;
+        return true;
+    };
+
+    bool translated = false;
+    uint8_t operation = decoded.getOperation();
+    switch (decoded.getCategory()) {
+        case CAT_CF:
+            switch (operation) {
+                case CF_BR:
+                    translated = branch(VM_BR, VM_BR_INDIRECT);
+                    break;
+                case CF_BRC:
+                    if (extendedSize < 1 || extended[0] > COND_PC) {
+                        return state.fail("missing or unknown condition code");
+                    }
+                    result.condition = extended[0];
+                    translated = branch(VM_BRC, VM_BRC_INDIRECT);
+                    break;
+                case CF_CALL:
+                case CF_SYSC:
+                    translated = call(operation == CF_SYSC);
+                    break;
+                case CF_RET:
+                    if (count > 2) {
+                        return state.fail("too many return values");
+                    }
+                    list = operands;
+                    op = VM_RET;
+                    translated = true;
+                    break;
+                case CF_HLT:
+                    op = VM_HALT;
+                    translated = true;
+                    break;
+                case CF_TRAP:
+                    op = VM_TRAP;
+                    translated = true;
+                    break;
+                case CF_FENCE:
+                case CF_YIELD:
+                case CF_NOP:
+                    translated = true;
+                    break;
+                default:
+                    return state.fail("control flow operation is not supported");
+            }
+            break;
+
+        case CAT_MEM:
+            switch (operation) {
+                case MEM_MOV:
+                    translated = exact(2, VM_MOV);
+                    if (slotsOnly()) {
+                        op = VM_MOV_S;
+                    }
+                    break;
+                case MEM_LOAD:
+                    translated = exact(2, VM_LOAD);
+                    break;
+                case MEM_STORE:
+                    translated = exact(2, VM_STORE);
+                    break;
+                case MEM_PUSH:
+                case MEM_POP:
+                    list = operands;
+                    op = operation == MEM_PUSH ? VM_PUSH : VM_POP;
+                    translated = true;
+                    break;
+                case MEM_EXCHANGE:
+                    translated = exact(2, VM_EXCHANGE);
+                    break;
+                case MEM_COMPARE:
+                    translated = exact(2, VM_CMP);
+                    if (slotsOnly()) {
+                        op = VM_CMP_S;
+                    }
+                    break;
+                case MEM_TEST:
+                    translated = exact(2, VM_TEST);
+                    break;
+                case MEM_PREFETCH:
+                    translated = exact(1, VM_NOP);
+                    list.clear();
+                    break;
+                default:
+                    return state.fail("memory operation is not supported");
+            }
+            break;
+
+        case CAT_MATH:
+            switch (operation) {
+                case MATH_ADD:
+                    translated = binary(VM_ADD, VM_ADD_S);
+                    break;
+                case MATH_SUB:
+                    translated = binary(VM_SUB, VM_SUB_S);
+                    break;
+                case MATH_MUL:
+                    translated = binary(VM_MUL, VM_MUL_S);
+                    break;
+                case MATH_DIV:
+                    translated = binary(VM_DIV, VM_NOP);
+                    break;
+                case MATH_MOD:
+                    translated = binary(VM_MOD, VM_NOP);
+                    break;
+                case MATH_MIN:
+                    translated = binary(VM_MIN, VM_NOP);
+                    break;
+                case MATH_MAX:
+                    translated = binary(VM_MAX, VM_NOP);
+                    break;
+                case MATH_NEG:
+                    translated = unary(VM_NEG);
+                    break;
+                case MATH_INC:
+                    translated = unary(VM_INC);
+                    break;
+                case MATH_DEC:
+                    translated = unary(VM_DEC);
+                    break;
+                case MATH_ABS:
+                    translated = unary(VM_ABS);
+                    break;
+                default:
+                    return state.fail("floating-point arithmetic is not supported");
+            }
+            break;
+
+        case CAT_BIT:
+            switch (operation) {
+                case BIT_AND:
+                    translated = binary(VM_AND, VM_AND_S);
+                    break;
+                case BIT_OR:
+                    translated = binary(VM_OR, VM_OR_S);
+                    break;
+                case BIT_XOR:
+                    translated = binary(VM_XOR, VM_XOR_S);
+                    break;
+                case BIT_ANDN:
+                    translated = binary(VM_ANDN, VM_NOP);
+                    break;
+                case BIT_ORN:
+                    translated = binary(VM_ORN, VM_NOP);
+                    break;
+                case BIT_XNOR:
+                    translated = binary(VM_XNOR, VM_NOP);
+                    break;
+                case BIT_SHL:
+                    translated = binary(VM_SHL, VM_SHL_S);
+                    break;
+                case BIT_SHR:
+                    translated = binary(VM_SHR, VM_SHR_S);
+                    break;
+                case BIT_SAR:
+                    translated = binary(VM_SAR, VM_NOP);
+                    break;
+                case BIT_ROL:
+                    translated = binary(VM_ROL, VM_NOP);
+                    break;
+                case BIT_ROR:
+                    translated = binary(VM_ROR, VM_NOP);
+                    break;
+                case BIT_NOT:
+                    translated = unary(VM_NOT);
+                    break;
+                case BIT_BSWAP:
+                    translated = unary(VM_BSWAP);
+                    break;
+                case BIT_CLZ:
+                    translated = unary(VM_CLZ);
+                    break;
+                case BIT_CTZ:
+                    translated = unary(VM_CTZ);
+                    break;
+                case BIT_POPCNT:
+                    translated = unary(VM_POPCNT);
+                    break;
+                case BIT_SET:
+                    translated = exact(2, VM_BTS);
+                    break;
+                case BIT_CLR:
+                    translated = exact(2, VM_BTR);
+                    break;
+                case BIT_TGL:
+                    translated = exact(2, VM_BTC);
+                    break;
+                case BIT_TST:
+                    translated = exact(2, VM_BT);
+                    break;
+                case BIT_CMP:
+                    translated = exact(2, VM_CMP);
+                    if (slotsOnly()) {
+                        op = VM_CMP_S;
+                    }
+                    break;
+                default:
+                    return state.fail("bit operation is not supported");
+            }
+            break;
+
+        case CAT_VAR:
+            switch (operation) {
+                case VAR_DECL:
+                    // Storage is in the frame already; only the initial value is code
+                    if (count >= 2) {
+                        list = {operands[0], operands[1]};
+                        op = VM_MOV;
+                    }
+                    translated = true;
+                    break;
+                case VAR_PMT:
+                case VAR_DMT:
+                case VAR_DLT:
+                    translated = true;
+                    break;
+                default:
+                    return state.fail("variable operation is not supported");
+            }
+            break;
+
+        case CAT_FRAME:
+            switch (operation) {
+                case FRAME_ENTER:
+                case FRAME_LEAVE:
+                    translated = true;
+                    break;
+                case FRAME_SAVE:
+                case FRAME_REST:
+                    list = operands;
+                    op = operation == FRAME_SAVE ? VM_PUSH : VM_POP_REVERSE;
+                    translated = true;
+                    break;
+                default:
+                    return state.fail("frame operation is not supported");
+            }
+            break;
+
+        default:
+            return state.fail("vector and atomic operations are not supported");
+    }
+    if (!translated) {
+        return false;
+    }
+
+    // Destinations have to be writable
+    size_t firstWritten = 0;
+    size_t endWritten = list.empty() ? 0 : 1;
+    switch (op) {
+        case VM_POP:
+        case VM_POP_REVERSE:
+        case VM_EXCHANGE:
+            endWritten = list.size();
+            break;
+        case VM_CALL:
+        case VM_CALL_INDIRECT:
+        case VM_SYSC:
+            firstWritten = list.size() - result.condition;
+            endWritten = list.size();
+            break;
+        case VM_PUSH:
+        case VM_RET:
+        case VM_CMP:
+        case VM_CMP_S:
+        case VM_TEST:
+        case VM_STORE:
+        case VM_BR_INDIRECT:
+        case VM_BRC_INDIRECT:
+            endWritten = 0;
+            break;
+        default:
+            break;
+    }
+    for (size_t i = firstWritten; i < endWritten; i++) {
+        if (!isWritable(list[i])) {
+            return state.fail("destination must be a register, variable or memory");
+        }
+    }
+
+    result.op = op;
+    result.operandCount = static_cast<uint8_t>(list.size());
+    if (list.size() > 3) {
+        result.pooled = static_cast<uint32_t>(pool.size());
+        pool.insert(pool.end(), list.begin(), list.end());
+    } else {
+        std::copy(list.begin(), list.end(), result.operands);
+    }
+    return true;
+}
+
+bool BytecodeProgram::load(CofFile& cof) {
+    instructions.clear();
+    pool.clear();
+    functions.clear();
+    constants.clear();
+    image.clear();
+    instructionAt.clear();
+    functionAt.clear();
+    constantAt.clear();
+    variableCount = 0;
+
+    LoadState state(cof);
+    size_t sectionCount = cof.getSectionCount();
+    state.addresses.assign(sectionCount, 0);
+    state.relocations.resize(sectionCount);
+
+    // Lay out the sections that occupy memory, COIL code included so that
+    // functions have addresses; native code is not loaded
+    std::vector<bool> bytecode(sectionCount, false);
+    for (size_t i = 0; i < sectionCount; i++) {
+        Section& section = cof.getSection(i);
+        bool code = section.getType() == SECTION_CODE;
+        if (!(section.getFlags() & SECTION_FLAG_ALLOC) || (code && section.getTargetId() != 0)) {
+            continue;
+        }
+        // Sizes and alignments come from the file; a corrupt one must not
+        // make the image grow without bound
+        uint64_t alignment = std::max<uint64_t>(section.getAlignment(), 8);
+        size_t size = section.getSize();
+        uint64_t start = alignment > MAX_IMAGE_SIZE ? MAX_IMAGE_SIZE + 1
+                                                    : (image.size() + alignment - 1) / alignment * alignment;
+        if (start > MAX_IMAGE_SIZE || size > MAX_IMAGE_SIZE - start) {
+            LOG_ERROR("Section {} does not fit in the memory image: {} bytes aligned to {}, limit {}",
+                      section.getName(), size, alignment, MAX_IMAGE_SIZE);
+            return false;
+        }
+        image.resize(start, 0);
+        state.addresses[i] = IMAGE_BASE + image.size();
+
+        const auto& data = section.getData();
+        image.insert(image.end(), data.begin(), data.begin() + std::min(size, data.size()));
+        image.resize(state.addresses[i] - IMAGE_BASE + size, 0);
+
+        if (code) {
+            bytecode[i] = true;
+            for (const auto& relocation : section.getRelocations()) {
+                if (relocation.type != RELOC_COIL_SYMBOL && relocation.type != RELOC_COIL_LABEL) {
+                    continue;
+                }
+                if (relocation.symbol_index >= cof.getSymbols().size() || relocation.offset >= size) {
+                    LOG_ERROR("Malformed relocation at offset {} of section {}: symbol {} of {}", relocation.offset,
+                              section.getName(), relocation.symbol_index, cof.getSymbols().size());
+                    return false;
+                }
+                state.relocations[i][relocation.offset] = &relocation;
+            }
+        }
+    }
+
+    // Defined symbols have to lie in a section of the file
+    for (const auto& symbol : cof.getSymbols()) {
+        if (!symbol->isUndefined() && symbol->getSectionIndex() >= sectionCount) {
+            LOG_ERROR("Symbol {} names section {}, but the file has {}", symbol->getName(),
+                      symbol->getSectionIndex(), sectionCount);
+            return false;
+        }
+    }
+
+    // Functions are the defined function symbols in COIL code; one that
+    // has no size runs up to the next, or to the end of its section
+    struct Candidate {
+        VmFunction function; // Function
+        uint32_t section;    // Its section
+        uint64_t size;       // Symbol size (0 if not known)
+    };
+    std::vector<Candidate> candidates;
+    for (size_t i = 0; i < cof.getSymbols().size(); i++) {
+        const Symbol& symbol = cof.getSymbol(i);
+        uint32_t sectionIndex = symbol.getSectionIndex();
+        if (!symbol.isFunction() || symbol.isUndefined() || sectionIndex >= sectionCount || !bytecode[sectionIndex]) {
+            continue;
+        }
+        Candidate candidate;
+        candidate.function.name = symbol.getName();
+        candidate.function.entry = 0;
+        candidate.function.end = 0;
+        candidate.function.offset = symbol.getValue();
+        candidate.function.address = state.addresses[sectionIndex] + symbol.getValue();
+        candidate.section = sectionIndex;
+        candidate.size = symbol.getSize();
+        candidates.push_back(candidate);
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.function.address < b.function.address;
+    });
+    candidates.erase(std::unique(candidates.begin(), candidates.end(),
+                                 [](const Candidate& a, const Candidate& b) {
+                                     return a.function.address == b.function.address;
+                                 }),
+                     candidates.end());
+
+    std::vector<uint32_t> sections;
+    std::vector<uint64_t> ends;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        const Candidate& candidate = candidates[i];
+        uint64_t sectionSize = cof.getSection(candidate.section).getSize();
+        uint64_t end = candidate.function.offset + candidate.size;
+        if (candidate.size == 0) {
+            end = sectionSize;
+            if (i + 1 < candidates.size() && candidates[i + 1].section == candidate.section) {
+                end = candidates[i + 1].function.offset;
+            }
+        }
+        if (end > sectionSize) {
+            LOG_ERROR("Function {} lies outside its section", candidate.function.name);
+            return false;
+        }
+        functionAt.emplace(candidate.function.address, static_cast<uint32_t>(functions.size()));
+        functions.push_back(candidate.function);
+        sections.push_back(candidate.section);
+        ends.push_back(end);
+    }
+
+    // First pass: give every instruction its index, so branches forward
+    // can be resolved, with a guard after each function
+    for (size_t i = 0; i < functions.size(); i++) {
+        VmFunction& function = functions[i];
+        const uint8_t* code = cof.getSection(sections[i]).getData().data();
+        if (!state.decoder.decode(code + function.offset, code + ends[i])) {
+            LOG_ERROR("Malformed instruction at offset {} of {}", state.decoder.getErrorOffset(), function.name);
+            return false;
+        }
+        function.entry = static_cast<uint32_t>(instructions.size());
+        for (const auto& decoded : state.decoder.getInstructions()) {
+            VmInstruction instruction{};
+            instruction.offset = static_cast<uint32_t>(function.offset + decoded.offset);
+            instructionAt.emplace(function.address + decoded.offset, static_cast<uint32_t>(instructions.size()));
+            instructions.push_back(instruction);
+        }
+        VmInstruction guard{};
+        guard.op = VM_END;
+        guard.offset = static_cast<uint32_t>(ends[i]);
+        function.end = static_cast<uint32_t>(instructions.size());
+        instructions.push_back(guard);
+    }
+
+    // Second pass: pre-decode each instruction, then fuse register
+    // compares with the conditional branch that follows
+    for (size_t i = 0; i < functions.size(); i++) {
+        const VmFunction& function = functions[i];
+        const uint8_t* code = cof.getSection(sections[i]).getData().data();
+        state.decoder.decode(code + function.offset, code + ends[i]);
+        state.section = sections[i];
+        state.function = static_cast<uint32_t>(i);
+
+        const auto& decodedInstructions = state.decoder.getInstructions();
+        for (size_t j = 0; j < decodedInstructions.size(); j++) {
+            VmInstruction& instruction = instructions[function.entry + j];
+            instruction.target = VM_NO_TARGET;
+            if (!translateInstruction(state, decodedInstructions[j], instruction)) {
+                LOG_ERROR("Cannot run instruction at offset {} of {}: {}", decodedInstructions[j].offset,
+                          function.name, state.failure);
+                return false;
+            }
+        }
+        for (uint32_t j = function.entry; j + 1 < function.end; j++) {
+            if (instructions[j].op == VM_CMP_S && instructions[j + 1].op == VM_BRC) {
+                instructions[j].op = VM_CMP_BRC_S;
+                instructions[j].condition = instructions[j + 1].condition;
+                instructions[j].target = instructions[j + 1].target;
+            }
+        }
+    }
+
+    constantAt.clear();
+    return true;
+}
+
+bool BytecodeProgram::findFunction(const std::string& name, uint32_t& index) const {
+    for (size_t i = 0; i < functions.size(); i++) {
+        if (functions[i].name == name) {
+            index = static_cast<uint32_t>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t BytecodeProgram::functionOf(uint32_t instruction) const {
+    auto it = std::upper_bound(functions.begin(), functions.end(), instruction,
+                               [](uint32_t index, const VmFunction& function) { return index < function.entry; });
+    return static_cast<uint32_t>(it - functions.begin()) - 1;
+}
+
+bool BytecodeProgram::findFunctionAt(uint64_t address, uint32_t& index) const {
+    auto it = functionAt.find(address);
+    if (it == functionAt.end()) {
+        return false;
+    }
+    index = it->second;
+    return true;
+}
+
+bool BytecodeProgram::findInstructionAt(uint64_t address, uint32_t& index) const {
+    auto it = instructionAt.find(address);
+    if (it == instructionAt.end()) {
+        return false;
+    }
+    index = it->second;
+    return true;
+}
+
+const std::vector<VmInstruction>& BytecodeProgram::getInstructions() const {
+    return instructions;
+}
+
+const std::vector<VmOperand>& BytecodeProgram::getPool() const {
+    return pool;
+}
+
+const std::vector<VmFunction>& BytecodeProgram::getFunctions() const {
+    return functions;
+}
+
+const std::vector<uint64_t>& BytecodeProgram::getConstants() const {
+    return constants;
+}
+
+const std::vector<uint8_t>& BytecodeProgram::getImage() const {
+    return image;
+}
+
+uint32_t BytecodeProgram::getVariableCount() const {
+    return variableCount;
+}
+
+Interpreter::Interpreter(const BytecodeProgram& bytecode, size_t stackBytes)
+    : program(bytecode), stackSize(std::max<size_t>((stackBytes + 15) & ~size_t(15), 64)), executed(0),
+      output(nullptr) {}
+
+bool Interpreter::run(uint32_t function, int64_t& result) {
+    executed = 0;
+    if (function >= program.getFunctions().size()) {
+        LOG_ERROR("No function {} to run", function);
+        return false;
+    }
+
+    // Fresh registers, memory and stack, which grows down from the top
+    const auto& constants = program.getConstants();
+    slots.assign(BytecodeProgram::REGISTER_SLOTS, 0);
+    slots.insert(slots.end(), constants.begin(), constants.end());
+    memory = program.getImage();
+    memory.resize(((memory.size() + 15) & ~size_t(15)) + stackSize, 0);
+    slots[SLOT_SP] = BytecodeProgram::IMAGE_BASE + memory.size();
+    slots[SLOT_FRAME_PTR] = slots[SLOT_SP];
+
+    frames.clear();
+    variables.assign(std::max<size_t>(program.getVariableCount(), 1) * 16, 0);
+    return execute(function, result);
+}
+
+// Each handler ends by jumping straight to the next one's label
+#define DISPATCH()              \
+    do {                        \
+        count++;                \
+        goto* handlers[ip->op]; \
+    } while (0)
+#define NEXT()      \
+    do {            \
+        ip++;       \
+        DISPATCH(); \
+    } while (0)
+
+// Operands of the running instruction
+#define OPERANDS() (ip->operandCount <= 3 ? ip->operands : pool + ip->pooled)
+
+// dest = a op b, through any kind of operand
+#define BINARY(expression, flags)                                           \
+    {                                                                       \
+        uint64_t a, b;                                                      \
+        if (!read(ip->operands[1], a) || !read(ip->operands[2], b)) {       \
+            goto fault;                                                     \
+        }                                                                   \
+        uint64_t value = (expression);                                      \
+        flags;                                                              \
+        if (!write(ip->operands[0], value)) {                               \
+            goto fault;                                                     \
+        }                                                                   \
+        NEXT();                                                             \
+    }
+
+// dest = a op b, registers and constants only
+#define BINARY_S(expression, flags)                         \
+    {                                                       \
+        uint64_t a = r[ip->operands[1].slot];               \
+        uint64_t b = r[ip->operands[2].slot];               \
+        uint64_t value = (expression);                      \
+        flags;                                              \
+        r[ip->operands[0].slot] = value;                    \
+        NEXT();                                             \
+    }
+
+// dest = op a
+#define UNARY(expression, flags)                            \
+    {                                                       \
+        uint64_t a;                                         \
+        if (!read(ip->operands[1], a)) {                    \
+            goto fault;                                     \
+        }                                                   \
+        uint64_t value = (expression);                      \
+        flags;                                              \
+        if (!write(ip->operands[0], value)) {               \
+            goto fault;                                     \
+        }                                                   \
+        NEXT();                                             \
+    }
+
+#define SET_FLAGS(kind, first, second, value) \
+    (flagKind = (kind), flagA = (first), flagB = (second), flagResult = (value))
+
+// Label addresses are a GNU extension
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+bool Interpreter::execute(uint32_t function, int64_t& result) {
+    static void* const handlers[VM_OP_COUNT] = {
+#define COIL_VM_LABEL(name) &&op_##name,
+        COIL_VM_OPS(COIL_VM_LABEL)
+#undef COIL_VM_LABEL
+    };
+
+    const VmInstruction* code = program.getInstructions().data();
+    const VmOperand* pool = program.getPool().data();
+    const auto& functions = program.getFunctions();
+    const size_t window = std::max<size_t>(program.getVariableCount(), 1);
+    uint64_t* r = slots.data();
+    uint8_t* mem = memory.data();
+    const uint64_t memorySize = memory.size();
+    uint64_t* v = variables.data();
+    uint64_t count = 0;
+    std::string failure;
+
+    uint8_t flagKind = VM_FLAGS_LOGIC;
+    uint64_t flagA = 0;
+    uint64_t flagB = 0;
+    uint64_t flagResult = 0;
+
+    auto address = [&](const VmOperand& operand) {
+        uint64_t value = static_cast<uint64_t>(static_cast<int64_t>(operand.disp));
+        if (operand.slot != BytecodeProgram::VM_NO_SLOT) {
+            value += r[operand.slot];
+        }
+        if (operand.index != BytecodeProgram::VM_NO_REGISTER) {
+            value += r[operand.index] * operand.scale;
+        }
+        return value;
+    };
+    auto load = [&](uint64_t at, uint64_t& value) {
+        if (at < BytecodeProgram::IMAGE_BASE || at - BytecodeProgram::IMAGE_BASE > memorySize - 8) {
+            failure = "Memory access out of bounds at address " + std::to_string(at);
+            return false;
+        }
+        std::memcpy(&value, mem + (at - BytecodeProgram::IMAGE_BASE), sizeof(value));
+        return true;
+    };
+    auto store = [&](uint64_t at, uint64_t value) {
+        if (at < BytecodeProgram::IMAGE_BASE || at - BytecodeProgram::IMAGE_BASE > memorySize - 8) {
+            failure = "Memory access out of bounds at address " + std::to_string(at);
+            return false;
+        }
+        std::memcpy(mem + (at - BytecodeProgram::IMAGE_BASE), &value, sizeof(value));
+        return true;
+    };
+    auto read = [&](const VmOperand& operand, uint64_t& value) {
+        if (operand.kind == VM_OPERAND_SLOT) {
+            value = r[operand.slot];
+            return true;
+        }
+        if (operand.kind == VM_OPERAND_VARIABLE) {
+            value = v[operand.slot];
+            return true;
+        }
+        return load(address(operand), value);
+    };
+    auto write = [&](const VmOperand& operand, uint64_t value) {
+        if (operand.kind == VM_OPERAND_SLOT) {
+            r[operand.slot] = value;
+            return true;
+        }
+        if (operand.kind == VM_OPERAND_VARIABLE) {
+            v[operand.slot] = value;
+            return true;
+        }
+        return store(address(operand), value);
+    };
+    // LOAD and STORE take the address from a register, constant or variable
+    auto addressOf = [&](const VmOperand& operand) {
+        if (operand.kind == VM_OPERAND_MEMORY) {
+            return address(operand);
+        }
+        return operand.kind == VM_OPERAND_VARIABLE ? v[operand.slot] : r[operand.slot];
+    };
+    auto jump = [&](uint64_t to, const VmInstruction*& next) {
+        uint32_t index;
+        if (!program.findInstructionAt(to, index)) {
+            failure = "Branch to an address that is not an instruction";
+            return false;
+        }
+        next = code + index;
+        return true;
+    };
+    // Results go from the result registers to the last operands
+    auto takeResults = [&](const VmInstruction* call) {
+        const VmOperand* operands = call->operandCount <= 3 ? call->operands : pool + call->pooled;
+        uint64_t values[2] = {r[resultRegisters[0]], r[resultRegisters[1]]};
+        for (size_t i = 0; i < call->condition; i++) {
+            if (!write(operands[call->operandCount - call->condition + i], values[i])) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    frames.push_back({nullptr, 0});
+    const VmInstruction* ip = code + functions[function].entry;
+    DISPATCH();
+
+op_END:
+    failure = "Execution ran past the end of the function";
+    goto fault;
+op_NOP:
+    NEXT();
+op_HALT:
+    result = static_cast<int64_t>(r[REG_R0]);
+    executed = count;
+    return true;
+op_TRAP:
+    failure = "Trap";
+    goto fault;
+
+op_BR:
+    ip = code + ip->target;
+    DISPATCH();
+op_BR_INDIRECT: {
+    uint64_t to;
+    if (!read(ip->operands[0], to) || !jump(to, ip)) {
+        goto fault;
+    }
+    DISPATCH();
+}
+op_BRC:
+    if (conditionHolds(ip->condition, flagKind, flagA, flagB, flagResult)) {
+        ip = code + ip->target;
+        DISPATCH();
+    }
+    NEXT();
+op_BRC_INDIRECT: {
+    if (!conditionHolds(ip->condition, flagKind, flagA, flagB, flagResult)) {
+        NEXT();
+    }
+    uint64_t to;
+    if (!read(ip->operands[0], to) || !jump(to, ip)) {
+        goto fault;
+    }
+    DISPATCH();
+}
+
+op_CALL:
+op_CALL_INDIRECT: {
+    const VmOperand* operands = OPERANDS();
+    uint32_t callee = ip->target;
+    if (ip->op == VM_CALL_INDIRECT) {
+        uint64_t to;
+        if (!read(operands[0], to)) {
+            goto fault;
+        }
+        if (!program.findFunctionAt(to, callee)) {
+            failure = "Call to an address that is not a function";
+            goto fault;
+        }
+    }
+
+    // Arguments are all read before any is written, as they may name
+    // each other's registers
+    uint64_t args[6];
+    size_t argCount = ip->operandCount - 1 - ip->condition;
+    for (size_t i = 0; i < argCount; i++) {
+        if (!read(operands[1 + i], args[i])) {
+            goto fault;
+        }
+    }
+    for (size_t i = 0; i < argCount; i++) {
+        r[argumentRegisters[i]] = args[i];
+    }
+
+    if (frames.size() >= MAX_CALL_DEPTH) {
+        failure = "Call stack overflow";
+        goto fault;
+    }
+    size_t base = frames.back().variableBase + window;
+    frames.push_back({ip, base});
+    if (variables.size() < base + window) {
+        variables.resize(std::max(base + window, variables.size() * 2), 0);
+    }
+    v = variables.data() + base;
+    ip = code + functions[callee].entry;
+    DISPATCH();
+}
+op_RET: {
+    const VmOperand* operands = OPERANDS();
+    uint64_t values[2];
+    for (size_t i = 0; i < ip->operandCount; i++) {
+        if (!read(operands[i], values[i])) {
+            goto fault;
+        }
+    }
+    for (size_t i = 0; i < ip->operandCount; i++) {
+        r[resultRegisters[i]] = values[i];
+    }
+
+    const VmInstruction* call = frames.back().call;
+    frames.pop_back();
+    if (!call) {
+        result = static_cast<int64_t>(r[REG_R0]);
+        executed = count;
+        return true;
+    }
+    v = variables.data() + frames.back().variableBase;
+    if (!takeResults(call)) {
+        goto fault;
+    }
+    ip = call + 1;
+    DISPATCH();
+}
+op_SYSC: {
+    const VmOperand* operands = OPERANDS();
+    uint64_t number;
+    uint64_t args[6];
+    size_t argCount = ip->operandCount - 1 - ip->condition;
+    if (!read(operands[0], number)) {
+        goto fault;
+    }
+    for (size_t i = 0; i < argCount; i++) {
+        if (!read(operands[1 + i], args[i])) {
+            goto fault;
+        }
+    }
+    for (size_t i = 0; i < argCount; i++) {
+        r[systemArgumentRegisters[i]] = args[i];
+    }
+    for (size_t i = 0; i < 6; i++) {
+        args[i] = r[systemArgumentRegisters[i]];
+    }
+
+    bool exited = false;
+    int64_t value = systemCall(number, args, exited);
+    if (exited) {
+        result = value;
+        executed = count;
+        return true;
+    }
+    r[REG_R0] = static_cast<uint64_t>(value);
+    if (!takeResults(ip)) {
+        goto fault;
+    }
+    NEXT();
+}
+
+op_MOV: {
+    uint64_t value;
+    if (!read(ip->operands[1], value) || !write(ip->operands[0], value)) {
+        goto fault;
+    }
+    NEXT();
+}
+op_MOV_S:
+    r[ip->operands[0].slot] = r[ip->operands[1].slot];
+    NEXT();
+op_LOAD: {
+    uint64_t value;
+    if (!load(addressOf(ip->operands[1]), value) || !write(ip->operands[0], value)) {
+        goto fault;
+    }
+    NEXT();
+}
+op_STORE: {
+    uint64_t value;
+    if (!read(ip->operands[1], value) || !store(addressOf(ip->operands[0]), value)) {
+        goto fault;
+    }
+    NEXT();
+}
+op_PUSH: {
+    const VmOperand* operands = OPERANDS();
+    for (size_t i = 0; i < ip->operandCount; i++) {
+        uint64_t value;
+        if (!read(operands[i], value) || !store(r[SLOT_SP] - 8, value)) {
+            goto fault;
+        }
+        r[SLOT_SP] -= 8;
+    }
+    NEXT();
+}
+op_POP:
+op_POP_REVERSE: {
+    const VmOperand* operands = OPERANDS();
+    for (size_t n = 0; n < ip->operandCount; n++) {
+        size_t i = ip->op == VM_POP ? n : ip->operandCount - 1 - n;
+        uint64_t value;
+        if (!load(r[SLOT_SP], value)) {
+            goto fault;
+        }
+        r[SLOT_SP] += 8;
+        if (!write(operands[i], value)) {
+            goto fault;
+        }
+    }
+    NEXT();
+}
+op_EXCHANGE: {
+    uint64_t a, b;
+    if (!read(ip->operands[0], a) || !read(ip->operands[1], b) || !write(ip->operands[0], b) ||
+        !write(ip->operands[1], a)) {
+        goto fault;
+    }
+    NEXT();
+}
+
+op_CMP: {
+    uint64_t a, b;
+    if (!read(ip->operands[0], a) || !read(ip->operands[1], b)) {
+        goto fault;
+    }
+    SET_FLAGS(VM_FLAGS_SUB, a, b, a - b);
+    NEXT();
+}
+op_CMP_S: {
+    uint64_t a = r[ip->operands[0].slot];
+    uint64_t b = r[ip->operands[1].slot];
+    SET_FLAGS(VM_FLAGS_SUB, a, b, a - b);
+    NEXT();
+}
+op_CMP_BRC_S: {
+    uint64_t a = r[ip->operands[0].slot];
+    uint64_t b = r[ip->operands[1].slot];
+    SET_FLAGS(VM_FLAGS_SUB, a, b, a - b);
+    count++;
+    if (conditionHolds(ip->condition, VM_FLAGS_SUB, a, b, a - b)) {
+        ip = code + ip->target;
+        DISPATCH();
+    }
+    ip += 2;
+    DISPATCH();
+}
+op_TEST: {
+    uint64_t a, b;
+    if (!read(ip->operands[0], a) || !read(ip->operands[1], b)) {
+        goto fault;
+    }
+    SET_FLAGS(VM_FLAGS_LOGIC, a, b, a & b);
+    NEXT();
+}
+
+op_ADD:
+    BINARY(a + b, SET_FLAGS(VM_FLAGS_ADD, a, b, value));
+op_ADD_S:
+    BINARY_S(a + b, SET_FLAGS(VM_FLAGS_ADD, a, b, value));
+op_SUB:
+    BINARY(a - b, SET_FLAGS(VM_FLAGS_SUB, a, b, value));
+op_SUB_S:
+    BINARY_S(a - b, SET_FLAGS(VM_FLAGS_SUB, a, b, value));
+op_MUL:
+    BINARY(a * b, (void)0);
+op_MUL_S:
+    BINARY_S(a * b, (void)0);
+op_DIV:
+op_MOD: {
+    uint64_t a, b;
+    if (!read(ip->operands[1], a) || !read(ip->operands[2], b)) {
+        goto fault;
+    }
+    int64_t dividend = static_cast<int64_t>(a);
+    int64_t divisor = static_cast<int64_t>(b);
+    if (divisor == 0) {
+        failure = "Division by zero";
+        goto fault;
+    }
+    if (dividend == INT64_MIN && divisor == -1) {
+        failure = "Division overflow";
+        goto fault;
+    }
+    int64_t value = ip->op == VM_DIV ? dividend / divisor : dividend % divisor;
+    if (!write(ip->operands[0], static_cast<uint64_t>(value))) {
+        goto fault;
+    }
+    NEXT();
+}
+op_NEG:
+    UNARY(0 - a, SET_FLAGS(VM_FLAGS_SUB, 0, a, value));
+op_INC:
+    UNARY(a + 1, SET_FLAGS(VM_FLAGS_ADD, a, 1, value));
+op_DEC:
+    UNARY(a - 1, SET_FLAGS(VM_FLAGS_SUB, a, 1, value));
+op_ABS:
+    UNARY(static_cast<int64_t>(a) < 0 ? 0 - a : a, (void)0);
+op_MIN:
+    BINARY(static_cast<int64_t>(b) < static_cast<int64_t>(a) ? b : a, (void)0);
+op_MAX:
+    BINARY(static_cast<int64_t>(b) > static_cast<int64_t>(a) ? b : a, (void)0);
+
+op_AND:
+    BINARY(a & b, SET_FLAGS(VM_FLAGS_LOGIC, a, b, value));
+op_AND_S:
+    BINARY_S(a & b, SET_FLAGS(VM_FLAGS_LOGIC, a, b, value));
+op_OR:
+    BINARY(a | b, SET_FLAGS(VM_FLAGS_LOGIC, a, b, value));
+op_OR_S:
+    BINARY_S(a | b, SET_FLAGS(VM_FLAGS_LOGIC, a, b, value));
+op_XOR:
+    BINARY(a ^ b, SET_FLAGS(VM_FLAGS_LOGIC, a, b, value));
+op_XOR_S:
+    BINARY_S(a ^ b, SET_FLAGS(VM_FLAGS_LOGIC, a, b, value));
+op_ANDN:
+    BINARY(a & ~b, SET_FLAGS(VM_FLAGS_LOGIC, a, b, value));
+op_ORN:
+    BINARY(a | ~b, SET_FLAGS(VM_FLAGS_LOGIC, a, b, value));
+op_XNOR:
+    BINARY(~(a ^ b), SET_FLAGS(VM_FLAGS_LOGIC, a, b, value));
+op_NOT:
+    UNARY(~a, (void)0);
+op_SHL:
+    BINARY(a << (b & 63), (void)0);
+op_SHL_S:
+    BINARY_S(a << (b & 63), (void)0);
+op_SHR:
+    BINARY(a >> (b & 63), (void)0);
+op_SHR_S:
+    BINARY_S(a >> (b & 63), (void)0);
+op_SAR:
+    BINARY(static_cast<uint64_t>(static_cast<int64_t>(a) >> (b & 63)), (void)0);
+op_ROL:
+    BINARY((b & 63) ? (a << (b & 63)) | (a >> (64 - (b & 63))) : a, (void)0);
+op_ROR:
+    BINARY((b & 63) ? (a >> (b & 63)) | (a << (64 - (b & 63))) : a, (void)0);
+op_BSWAP:
+    UNARY(__builtin_bswap64(a), (void)0);
+op_CLZ:
+    UNARY(a ? static_cast<uint64_t>(__builtin_clzll(a)) : 64, (void)0);
+op_CTZ:
+    UNARY(a ? static_cast<uint64_t>(__builtin_ctzll(a)) : 64, (void)0);
+op_POPCNT:
+    UNARY(static_cast<uint64_t>(__builtin_popcountll(a)), (void)0);
+
+// Bit tests: dest, bit; carry is the bit before the change
+op_BT:
+op_BTS:
+op_BTR:
+op_BTC: {
+    uint64_t a, b;
+    if (!read(ip->operands[0], a) || !read(ip->operands[1], b)) {
+        goto fault;
+    }
+    uint64_t bit = 1ULL << (b & 63);
+    uint64_t carry = (a & bit) ? 1 : 0;
+    SET_FLAGS(VM_FLAGS_CARRY, carry, b, carry);
+    if (ip->op != VM_BT) {
+        uint64_t value = ip->op == VM_BTS ? a | bit : ip->op == VM_BTR ? a & ~bit : a ^ bit;
+        if (!write(ip->operands[0], value)) {
+            goto fault;
+        }
+    }
+    NEXT();
+}
+
+fault: {
+    executed = count;
+    const VmFunction& faulting = functions[program.functionOf(static_cast<uint32_t>(ip - code))];
+    LOG_ERROR("{} at offset {} of {}", failure, ip->offset - faulting.offset, faulting.name);
+    return false;
+}
+}
+
+#pragma GCC diagnostic pop
+
+#undef DISPATCH
+#undef NEXT
+#undef OPERANDS
+#undef BINARY
+#undef BINARY_S
+#undef UNARY
+#undef SET_FLAGS
+
+int64_t Interpreter::systemCall(uint64_t number, const uint64_t* args, bool& exited) {
+    switch (number) {
+        case SYS_WRITE: {
+            uint64_t fd = args[0];
+            uint64_t buffer = args[1];
+            uint64_t size = args[2];
+            if (fd != 1 && fd != 2) {
+                return ERROR_BADF;
+            }
+            if (buffer < BytecodeProgram::IMAGE_BASE || buffer - BytecodeProgram::IMAGE_BASE > memory.size() ||
+                size > memory.size() - (buffer - BytecodeProgram::IMAGE_BASE)) {
+                return ERROR_FAULT;
+            }
+            const char* bytes = reinterpret_cast<const char*>(memory.data() + (buffer - BytecodeProgram::IMAGE_BASE));
+            if (fd == 1 && output) {
+                output->append(bytes, size);
+            } else {
+                fwrite(bytes, 1, size, fd == 1 ? stdout : stderr);
+            }
+            return static_cast<int64_t>(size);
+        }
+
+        case SYS_EXIT:
+        case SYS_EXIT_GROUP:
+            exited = true;
+            return static_cast<int64_t>(args[0]);
+
+        default:
+            return ERROR_NOSYS;
+    }
+}
+
+void Interpreter::setOutput(std::string* buffer) {
+    output = buffer;
+}
+
+uint64_t Interpreter::getInstructionCount() const {
+    return executed;
+}
+
+uint64_t Interpreter::getRegister(uint8_t vregId) const {
+    uint32_t slot;
+    if (!registerSlot(vregId, slot) || slot >= slots.size()) {
+        return 0;
+    }
+    return slots[slot];
+}
+
+} // namespace coil
@@ -0,0 +1,339 @@
+#ifndef COIL_VM_INTERPRETER_H
+#define COIL_VM_INTERPRETER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "core/defs.h"
+
+namespace coil {
+
+class CofFile;
+struct DecodedInstruction;
+
+/**
+ * @brief Kinds of pre-decoded operands
+ */
+enum VmOperandKind : uint8_t {
+    VM_OPERAND_SLOT,     // Register or constant
+    VM_OPERAND_VARIABLE, // Variable of the running function
+    VM_OPERAND_MEMORY    // 64-bit value at [base + index * scale + disp]
+};
+
+/**
+ * @brief Operand of a pre-decoded instruction
+ *
+ * Registers and constants share one array of slots, so reading either
+ * is a single load; variables live in the frame of the running function.
+ */
+struct VmOperand {
+    uint32_t slot;     // Register or constant slot, variable, or base register slot (VM_NO_SLOT for none)
+    uint8_t kind;      // VmOperandKind
+    uint8_t index;     // Index register slot (VM_NO_REGISTER for none)
+    uint8_t scale;     // Index scale
+    uint8_t reserved;  // Padding
+    int32_t disp;      // Displacement
+};
+
+/**
+ * @brief Pre-decoded instruction
+ *
+ * Operands are stored inline when there are at most three of them, and
+ * in the program's operand pool otherwise. Two-operand arithmetic is
+ * stored in its three-operand form (dest = dest op source), so each
+ * handler reads its operands in one way.
+ */
+struct VmInstruction {
+    uint8_t op;             // Handler
+    uint8_t operandCount;   // Number of operands
+    uint8_t condition;      // Condition code (branches) or result count (calls)
+    uint8_t reserved;       // Padding
+    uint32_t target;        // Branch target instruction or callee function (VM_NO_TARGET if indirect)
+    uint32_t pooled;        // First operand in the operand pool (more than three operands)
+    uint32_t offset;        // Offset of the encoded instruction in its section
+    VmOperand operands[3];  // Operands (at most three)
+};
+
+/**
+ * @brief Function of a pre-decoded program
+ */
+struct VmFunction {
+    std::string name;       // Symbol name
+    uint32_t entry;         // First instruction
+    uint32_t end;           // Guard instruction after the last one
+    uint64_t offset;        // Offset of the function in its section
+    uint64_t address;       // Address of the function's code
+};
+
+/**
+ * @brief COIL bytecode decoded once into a form that is quick to run
+ *
+ * Loading decodes the functions of every COIL code section, text.cold
+ * included, into flat instruction arrays. Symbol and label operands are
+ * resolved through their relocations, so branches and direct calls
+ * carry the index of their target, and immediates and symbol addresses
+ * become constant slots. Code that cannot be run is reported here, not
+ * when it is reached.
+ *
+ * The loadable sections are laid out in one memory image from
+ * IMAGE_BASE, so that symbols have addresses; native code sections are
+ * not loaded. A file whose sections need more than MAX_IMAGE_SIZE bytes
+ * is rejected.
+ */
+class BytecodeProgram {
+public:
+    static constexpr uint64_t IMAGE_BASE = 0x10000;   // Address of the first loaded section
+    static constexpr uint64_t MAX_IMAGE_SIZE = 1ull << 30; // Largest memory image a program may load
+    static constexpr uint32_t REGISTER_SLOTS = 18;    // R0-R15, SP and the frame pointer
+    static constexpr uint32_t VM_NO_SLOT = UINT32_MAX; // No base register
+    static constexpr uint8_t VM_NO_REGISTER = 0xFF;   // No index register
+    static constexpr uint32_t VM_NO_TARGET = UINT32_MAX; // Target known only when run
+
+private:
+    std::vector<VmInstruction> instructions;         // Instructions of every function
+    std::vector<VmOperand> pool;                     // Operands of instructions with more than three
+    std::vector<VmFunction> functions;               // Functions in address order
+    std::vector<uint64_t> constants;                 // Values of the slots after the registers
+    std::vector<uint8_t> image;                      // Loaded sections, from IMAGE_BASE
+    std::unordered_map<uint64_t, uint32_t> instructionAt; // Address -> instruction
+    std::unordered_map<uint64_t, uint32_t> functionAt;    // Entry address -> function
+    std::unordered_map<uint64_t, uint32_t> constantAt;    // Constant value -> slot
+    uint32_t variableCount;                          // Variables every frame has room for
+
+    struct LoadState; // Function being pre-decoded
+
+    /**
+     * @brief Get the slot of a constant, adding it if it is new
+     *
+     * @param value Constant value
+     * @return Slot index
+     */
+    uint32_t addConstant(uint64_t value);
+
+    /**
+     * @brief Pre-decode one operand
+     *
+     * @param state Function being loaded
+     * @param decoded Instruction
+     * @param index Operand index
+     * @param result Pre-decoded operand (output parameter)
+     * @param address Address of a relocated symbol operand, or UINT64_MAX
+     *                for a symbol without a relocation (an ABI name) and 0
+     *                for anything else (output parameter)
+     * @return true on success, false with the reason in the state
+     */
+    bool translateOperand(LoadState& state, const DecodedInstruction& decoded, size_t index, VmOperand& result,
+                          uint64_t& address);
+
+    /**
+     * @brief Pre-decode one instruction
+     *
+     * @param state Function being loaded
+     * @param decoded Instruction
+     * @param result Pre-decoded instruction (output parameter)
+     * @return true on success, false with the reason in the state
+     */
+    bool translateInstruction(LoadState& state, const DecodedInstruction& decoded, VmInstruction& result);
+
+public:
+    /**
+     * @brief Construct an empty program
+     */
+    BytecodeProgram();
+
+    /**
+     * @brief Load and pre-decode a COF file
+     *
+     * Replaces anything loaded before.
+     *
+     * @param cof COF file (not needed once loaded)
+     * @return true on success, false if the file has code that cannot be run
+     */
+    bool load(CofFile& cof);
+
+    /**
+     * @brief Find a function by name
+     *
+     * @param name Function name
+     * @param index Function index (output parameter)
+     * @return true if found
+     */
+    bool findFunction(const std::string& name, uint32_t& index) const;
+
+    /**
+     * @brief Find the function an instruction belongs to
+     *
+     * @param instruction Instruction index
+     * @return Function index
+     */
+    uint32_t functionOf(uint32_t instruction) const;
+
+    /**
+     * @brief Find the function that starts at an address
+     *
+     * @param address Code address
+     * @param index Function index (output parameter)
+     * @return true if a function starts there
+     */
+    bool findFunctionAt(uint64_t address, uint32_t& index) const;
+
+    /**
+     * @brief Find the instruction at an address
+     *
+     * @param address Code address
+     * @param index Instruction index (output parameter)
+     * @return true if an instruction starts there
+     */
+    bool findInstructionAt(uint64_t address, uint32_t& index) const;
+
+    /**
+     * @brief Get the instructions of every function
+     *
+     * @return Instructions, each function followed by its guard
+     */
+    const std::vector<VmInstruction>& getInstructions() const;
+
+    /**
+     * @brief Get the operands of instructions with more than three
+     *
+     * @return Operand pool
+     */
+    const std::vector<VmOperand>& getPool() const;
+
+    /**
+     * @brief Get the functions
+     *
+     * @return Functions in address order
+     */
+    const std::vector<VmFunction>& getFunctions() const;
+
+    /**
+     * @brief Get the values of the constant slots
+     *
+     * @return Constants, the first at slot REGISTER_SLOTS
+     */
+    const std::vector<uint64_t>& getConstants() const;
+
+    /**
+     * @brief Get the loaded sections
+     *
+     * @return Memory image, from IMAGE_BASE
+     */
+    const std::vector<uint8_t>& getImage() const;
+
+    /**
+     * @brief Get the number of variables a frame has room for
+     *
+     * @return One past the highest variable number any function uses
+     */
+    uint32_t getVariableCount() const;
+};
+
+/**
+ * @brief Runs a pre-decoded COIL program
+ *
+ * Each handler jumps straight to the next one through a table of label
+ * addresses (threaded dispatch), so there is no central dispatch branch
+ * for the host to mispredict. Registers are 64 bits wide, all memory
+ * accesses are 64-bit little-endian, and the stack lies above the
+ * program's image.
+ *
+ * Calls follow the COIL registers of the default x86-64 convention:
+ * arguments go in R4, R5, R3, R2, R6 and R7, and results come back in R0
+ * and R3. ABIs named by calls are not recorded in a COF file, so they
+ * select nothing here. System calls use Linux x86-64 numbers; write and
+ * exit are supported, and any other returns -ENOSYS.
+ *
+ * Comparisons, tests, addition, subtraction, negation, increment,
+ * decrement and the logical operations set the flags; bit tests set the
+ * carry flag to the bit.
+ */
+class Interpreter {
+public:
+    static constexpr size_t DEFAULT_STACK_SIZE = 1 << 20; // Stack bytes
+    static constexpr size_t MAX_CALL_DEPTH = 1 << 16;     // Calls that may be active at once
+
+private:
+    /**
+     * @brief Active call
+     */
+    struct Frame {
+        const VmInstruction* call; // Call to return to (nullptr for the entry function)
+        size_t variableBase;       // First variable of the frame
+    };
+
+    const BytecodeProgram& program; // Program to run
+    size_t stackSize;               // Stack bytes
+    std::vector<uint64_t> slots;    // Registers, then the program's constants
+    std::vector<uint8_t> memory;    // Image, then the stack
+    std::vector<uint64_t> variables; // Variables of every active frame
+    std::vector<Frame> frames;      // Active calls
+    uint64_t executed;              // Instructions executed by the last run
+    std::string* output;            // Captured standard output (nullptr to write it)
+
+    /**
+     * @brief Run from the entry of a function until it returns
+     *
+     * @param function Function index
+     * @param result Result (output parameter)
+     * @return true if the program ended, false on a fault
+     */
+    bool execute(uint32_t function, int64_t& result);
+
+    /**
+     * @brief Perform a system call
+     *
+     * @param number Linux x86-64 system call number
+     * @param args The six argument registers
+     * @param exited Set if the program exits (output parameter)
+     * @return Result, or the exit status
+     */
+    int64_t systemCall(uint64_t number, const uint64_t* args, bool& exited);
+
+public:
+    /**
+     * @brief Construct an interpreter
+     *
+     * @param bytecode Program to run (must outlive the interpreter)
+     * @param stackBytes Stack size
+     */
+    explicit Interpreter(const BytecodeProgram& bytecode, size_t stackBytes = DEFAULT_STACK_SIZE);
+
+    /**
+     * @brief Run a function from a fresh machine state
+     *
+     * @param function Function index
+     * @param result R0 when the function returns or halts, or the exit
+     *               status (output parameter)
+     * @return true if the program ended, false on a fault
+     */
+    bool run(uint32_t function, int64_t& result);
+
+    /**
+     * @brief Capture what the program writes to standard output
+     *
+     * @param buffer Buffer to append to (nullptr to write to the real one)
+     */
+    void setOutput(std::string* buffer);
+
+    /**
+     * @brief Get the number of instructions the last run executed
+     *
+     * @return Instruction count
+     */
+    uint64_t getInstructionCount() const;
+
+    /**
+     * @brief Get a register after a run
+     *
+     * @param vregId COIL register (R0-R15, SP or the frame pointer)
+     * @return Register value (0 for other registers)
+     */
+    uint64_t getRegister(uint8_t vregId) const;
+};
+
+} // namespace coil
+
+#endif // COIL_VM_INTERPRETER_H
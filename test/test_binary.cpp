@@ -0,0 +1,419 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include "driver/assembler.h"
+#include "binary/cof.h"
+#include "binary/cof_view.h"
+#include "binary/compression.h"
+#include "util/diagnostic.h"
+#include "util/logger.h"
+
+using namespace coil;
+
+static const char* const TEST_SOURCE = "DIR SECT text READ EXEC\n"
+                                       "DIR HINT main FUNC GLOBAL\n"
+                                       "DIR LABEL main\n"
+                                       "  MEM MOV R0, 42\n"
+                                       "  CF RET\n"
+                                       "DIR HINT main ENDFUNC\n"
+                                       "DIR HINT helper FUNC GLOBAL\n"
+                                       "DIR LABEL helper\n"
+                                       "  MATH ADD R0, R0, 1\n"
+                                       "  CF RET\n"
+                                       "DIR HINT helper ENDFUNC\n";
+
+/**
+ * @brief Test that section and symbol entries survive a write and read
+ */
+bool test_binary_round_trip() {
+    CofFile cof;
+    cof.addSection("text", SECTION_CODE, SECTION_FLAG_EXEC | SECTION_FLAG_ALLOC).addData({ 0x01, 0x02, 0x03, 0x04 });
+    cof.addSymbol("main", 0, 0, 4, SYMBOL_FUNCTION, SYMBOL_FLAG_GLOBAL);
+
+    std::string filename = "test_binary_round_trip.cof";
+    if (!cof.write(filename)) {
+        std::cout << "Failed to write the COF file\n";
+        return false;
+    }
+    auto read = CofFile::read(filename);
+    std::remove(filename.c_str());
+    if (!read) {
+        std::cout << "Failed to read the COF file back\n";
+        return false;
+    }
+
+    if (read->getSectionCount() != cof.getSectionCount() || read->getSection(0).getName() != "text" ||
+        read->getSection(0).getSize() != 4) {
+        std::cout << "Expected the text section to read back\n";
+        return false;
+    }
+
+    if (read->getSymbolCount() != 1 || read->getSymbol(0).getSectionIndex() != 0 ||
+        read->getSymbol(0).getSize() != 4) {
+        std::cout << "Expected the main symbol to read back\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test that a source held in memory assembles to COF bytes
+ */
+bool test_binary_assemble_memory() {
+    AssemblyOptions options;
+    options.hashSection = true;
+    Assembler assembler(options);
+
+    DiagnosticEngine diag(GlobalLogger::getInstance());
+    std::vector<uint8_t> bytes;
+    if (!assembler.assemble(TEST_SOURCE, "memory.coil", bytes, diag)) {
+        std::cout << "Failed to assemble a source held in memory\n";
+        diag.printDiagnostics();
+        return false;
+    }
+
+    auto view = CofView::fromBuffer(bytes.data(), bytes.size());
+    if (!view) {
+        std::cout << "Expected the COF bytes to read back\n";
+        return false;
+    }
+
+    size_t index;
+    if (!view->hasHashSection() || !view->findSymbol("helper", index) || view->getSymbolName(index) != "helper") {
+        std::cout << "Expected the symbols to be found through the hash section\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test that an assembler can be reused and matches its byte output
+ */
+bool test_binary_assembler_reuse() {
+    AssemblyOptions options;
+    options.jobs = 2;
+    Assembler assembler(options);
+
+    // The same source twice gives the same sections, as a CofFile or as
+    // bytes; only the header's UUID and timestamp differ
+    std::vector<uint8_t> first;
+    DiagnosticEngine firstDiag(GlobalLogger::getInstance());
+    if (!assembler.assemble(TEST_SOURCE, "reuse.coil", first, firstDiag)) {
+        std::cout << "Failed to assemble with a reused assembler\n";
+        return false;
+    }
+
+    DiagnosticEngine secondDiag(GlobalLogger::getInstance());
+    auto cof = assembler.assemble(TEST_SOURCE, "reuse.coil", secondDiag);
+    if (!cof) {
+        std::cout << "Failed to assemble twice with the same assembler\n";
+        return false;
+    }
+    std::vector<uint8_t> second = cof->serialize();
+    auto firstView = CofView::fromBuffer(first.data(), first.size());
+    auto secondView = CofView::fromBuffer(second.data(), second.size());
+    bool same = firstView && secondView && first.size() == second.size() &&
+                firstView->getSectionCount() == secondView->getSectionCount();
+    for (size_t i = 0; same && i < firstView->getSectionCount(); i++) {
+        ByteSpan a = firstView->getSectionData(i);
+        ByteSpan b = secondView->getSectionData(i);
+        same = a.size == b.size && std::equal(a.begin(), a.end(), b.begin());
+    }
+    if (!same) {
+        std::cout << "Expected a reused assembler to give the same output\n";
+        return false;
+    }
+
+    // Errors come back through the diagnostics, not as a file
+    DiagnosticEngine badDiag;
+    if (assembler.assemble("MEM MOV R0, R1\n", "bad.coil", badDiag) || !badDiag.hasErrorDiagnostics()) {
+        std::cout << "Expected a source outside any directive to fail\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test that deterministic output depends only on the source
+ */
+bool test_binary_deterministic() {
+    AssemblyOptions options;
+    options.deterministic = true;
+    options.timestamp = 1700000000;
+    Assembler assembler(options);
+
+    std::vector<uint8_t> first, second, other;
+    DiagnosticEngine diag(GlobalLogger::getInstance());
+    if (!assembler.assemble(TEST_SOURCE, "first.coil", first, diag) ||
+        !assembler.assemble(TEST_SOURCE, "second.coil", second, diag) ||
+        !assembler.assemble("DIR SECT text READ EXEC\n", "other.coil", other, diag)) {
+        std::cout << "Failed to assemble deterministically\n";
+        return false;
+    }
+    if (first != second) {
+        std::cout << "Expected identical sources to give identical bytes\n";
+        return false;
+    }
+
+    auto firstView = CofView::fromBuffer(first.data(), first.size());
+    auto otherView = CofView::fromBuffer(other.data(), other.size());
+    if (!firstView || !otherView || firstView->getHeader().timestamp != 1700000000 ||
+        (firstView->getHeader().uuid[6] & 0xF0) != 0x80 ||
+        std::equal(std::begin(firstView->getHeader().uuid), std::end(firstView->getHeader().uuid),
+                   std::begin(otherView->getHeader().uuid))) {
+        std::cout << "Expected a content-derived UUID and the given timestamp\n";
+        return false;
+    }
+
+    // By default every file gets a random UUID when it is laid out
+    CofFile randomFirst, randomSecond;
+    randomFirst.serialize();
+    randomSecond.serialize();
+    if ((randomFirst.getHeader().uuid[6] & 0xF0) != 0x40 ||
+        std::equal(std::begin(randomFirst.getHeader().uuid), std::end(randomFirst.getHeader().uuid),
+                   std::begin(randomSecond.getHeader().uuid))) {
+        std::cout << "Expected random UUIDs by default\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Check that a section compressed with a format reads back intact
+ *
+ * @param type Compression format
+ * @return true if the section round trips through the bytes and a file
+ */
+static bool checkCompressedRoundTrip(uint32_t type) {
+    const char* name = Compression::getName(type);
+
+    // Repetitive contents, so every format makes them smaller
+    std::vector<uint8_t> contents(4096);
+    for (size_t i = 0; i < contents.size(); i++) {
+        contents[i] = static_cast<uint8_t>(i % 16);
+    }
+
+    CofFile cof;
+    cof.addSection("data", SECTION_DATA, SECTION_FLAG_WRITE | SECTION_FLAG_ALLOC).addData(contents);
+    if (!cof.setCompression(type)) {
+        std::cout << "Expected " << name << " compression to be supported\n";
+        return false;
+    }
+
+    std::vector<uint8_t> bytes = cof.serialize();
+    auto view = CofView::fromBuffer(bytes.data(), bytes.size());
+    if (!view || !view->isSectionCompressed(0) || view->getStoredSectionData(0).size >= contents.size() ||
+        view->getSectionSize(0) != contents.size()) {
+        std::cout << "Expected the section to be stored compressed with " << name << "\n";
+        return false;
+    }
+    ByteSpan data = view->getSectionData(0);
+    if (data.size != contents.size() || !std::equal(data.begin(), data.end(), contents.begin())) {
+        std::cout << "Expected the " << name << " section to decompress to its contents\n";
+        return false;
+    }
+
+    // Reading the file keeps the format, so writing it again compresses
+    std::string filename = std::string("test_binary_") + name + ".cof";
+    if (!cof.write(filename)) {
+        std::cout << "Failed to write the " << name << " COF file\n";
+        return false;
+    }
+    auto read = CofFile::read(filename);
+    std::remove(filename.c_str());
+    if (!read || read->getSection(0).getData() != contents || read->getSection(0).getCompression() != type) {
+        std::cout << "Expected the " << name << " section to read back from a file\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test compressed sections with every format built in
+ */
+bool test_binary_compression() {
+    bool success = true;
+
+#ifdef COIL_HAVE_ZLIB
+    success &= checkCompressedRoundTrip(COMPRESSION_ZLIB);
+#endif
+#ifdef COIL_HAVE_ZSTD
+    success &= checkCompressedRoundTrip(COMPRESSION_ZSTD);
+#endif
+#ifdef COIL_HAVE_LZ4
+    success &= checkCompressedRoundTrip(COMPRESSION_LZ4);
+#endif
+
+    // Formats left out of the build are refused rather than ignored
+    CofFile cof;
+    cof.addSection("data", SECTION_DATA, SECTION_FLAG_ALLOC).addData({ 0x01 });
+    if (cof.setCompression(0x100)) {
+        std::cout << "Expected an unknown compression format to be refused\n";
+        success = false;
+    }
+#ifndef COIL_HAVE_ZSTD
+    if (cof.setCompression(COMPRESSION_ZSTD)) {
+        std::cout << "Expected zstd to be refused when it is not built in\n";
+        success = false;
+    }
+#endif
+#ifndef COIL_HAVE_LZ4
+    if (cof.setCompression(COMPRESSION_LZ4)) {
+        std::cout << "Expected lz4 to be refused when it is not built in\n";
+        success = false;
+    }
+#endif
+
+    return success;
+}
+
+/**
+ * @brief Check that corrupt data compressed with a format is rejected
+ *
+ * @param type Compression format
+ * @return true if every corruption fails to decompress
+ */
+static bool checkCorruptCompression(uint32_t type) {
+    const char* name = Compression::getName(type);
+    std::vector<uint8_t> contents(1024, 0x5A);
+    std::vector<uint8_t> stored;
+    std::vector<uint8_t> output;
+    if (!Compression::compress(type, 0, contents.data(), contents.size(), stored) ||
+        !Compression::decompress(stored.data(), stored.size(), output) || output != contents) {
+        std::cout << "Expected " << name << " to compress and decompress\n";
+        return false;
+    }
+
+    CompressionHeader header;
+    std::memcpy(&header, stored.data(), sizeof(header));
+
+    struct Case {
+        const char* description;
+        std::vector<uint8_t> data;
+    };
+    std::vector<Case> cases;
+
+    cases.push_back({ "a truncated header", std::vector<uint8_t>(stored.begin(), stored.begin() + 8) });
+    cases.push_back({ "a truncated payload", std::vector<uint8_t>(stored.begin(), stored.end() - 4) });
+
+    CompressionHeader reserved = header;
+    reserved.reserved = 1;
+    CompressionHeader none = header;
+    none.type = COMPRESSION_NONE;
+    CompressionHeader unknown = header;
+    unknown.type = 0x100;
+    CompressionHeader larger = header;
+    larger.size = header.size + 1;
+    CompressionHeader smaller = header;
+    smaller.size = header.size - 1;
+    CompressionHeader huge = header;
+    huge.size = UINT64_MAX / 2;
+    const std::pair<const char*, CompressionHeader> headers[] = {
+        { "a nonzero reserved field", reserved },
+        { "no compression format", none },
+        { "an unknown compression format", unknown },
+        { "a size one too large", larger },
+        { "a size one too small", smaller },
+        { "an implausible size", huge },
+    };
+    for (const auto& [description, corrupt] : headers) {
+        std::vector<uint8_t> data = stored;
+        std::memcpy(data.data(), &corrupt, sizeof(corrupt));
+        cases.push_back({ description, std::move(data) });
+    }
+
+    bool success = true;
+    for (const auto& test : cases) {
+        if (Compression::decompress(test.data.data(), test.data.size(), output)) {
+            std::cout << "Expected " << name << " data with " << test.description << " to be rejected\n";
+            success = false;
+        }
+    }
+    return success;
+}
+
+/**
+ * @brief Test that corrupt compressed sections are rejected
+ */
+bool test_binary_compression_corrupt() {
+    bool success = true;
+
+#ifdef COIL_HAVE_ZLIB
+    success &= checkCorruptCompression(COMPRESSION_ZLIB);
+#endif
+#ifdef COIL_HAVE_ZSTD
+    success &= checkCorruptCompression(COMPRESSION_ZSTD);
+#endif
+#ifdef COIL_HAVE_LZ4
+    success &= checkCorruptCompression(COMPRESSION_LZ4);
+#endif
+
+#if defined(COIL_HAVE_ZLIB) || defined(COIL_HAVE_ZSTD) || defined(COIL_HAVE_LZ4)
+    uint32_t type = COMPRESSION_LZ4;
+#ifdef COIL_HAVE_ZSTD
+    type = COMPRESSION_ZSTD;
+#endif
+#ifdef COIL_HAVE_ZLIB
+    type = COMPRESSION_ZLIB;
+#endif
+
+    CofFile cof;
+    cof.addSection("data", SECTION_DATA, SECTION_FLAG_ALLOC).addData(std::vector<uint8_t>(1024, 0x5A));
+    cof.setCompression(type);
+    std::vector<uint8_t> bytes = cof.serialize();
+    auto view = CofView::fromBuffer(bytes.data(), bytes.size());
+    if (!view) {
+        std::cout << "Failed to read a compressed COF file\n";
+        return false;
+    }
+    size_t offset = static_cast<size_t>(view->getSection(0).offset);
+
+    // A malformed header fails validation of the whole file
+    std::vector<uint8_t> reserved = bytes;
+    reserved[offset + offsetof(CompressionHeader, reserved)] = 1;
+    if (CofView::fromBuffer(reserved.data(), reserved.size())) {
+        std::cout << "Expected a malformed compression header to be rejected\n";
+        success = false;
+    }
+
+    // An implausible size only fails once the section is decompressed
+    std::vector<uint8_t> huge = bytes;
+    huge[offset + offsetof(CompressionHeader, size) + 7] = 0x40;
+    auto hugeView = CofView::fromBuffer(huge.data(), huge.size());
+    if (!hugeView || !hugeView->getSectionData(0).empty()) {
+        std::cout << "Expected an implausible uncompressed size to be rejected\n";
+        success = false;
+    }
+#endif
+
+    return success;
+}
+
+bool test_binary() {
+    bool success = true;
+
+    success &= test_binary_round_trip();
+    success &= test_binary_assemble_memory();
+    success &= test_binary_assembler_reuse();
+    success &= test_binary_deterministic();
+    success &= test_binary_compression();
+    success &= test_binary_compression_corrupt();
+
+    if (success) {
+        std::cout << "All binary tests passed.\n";
+    } else {
+        std::cout << "Some binary tests failed.\n";
+    }
+
+    return success;
+}
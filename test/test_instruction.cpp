@@ -2,7 +2,9 @@
 #include <cassert>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include "core/instruction.h"
+#include "core/instruction_decoder.h"
 #include "core/operand.h"
 #include "util/logger.h"
 
@@ -222,6 +224,190 @@ bool test_instruction_extended_data() {
     return true;
 }
 
+/**
+ * @brief Test encoding an instruction into an existing buffer
+ */
+bool test_instruction_encode_into() {
+    // Use a symbol long enough to be stored out of line
+    Instruction inst(CAT_CF, CF_CALL);
+    inst.addOperand(std::make_unique<ImmediateOperand>("a_rather_long_function_name"));
+    inst.addOperand(std::make_unique<RegisterOperand>(REG_GP, REG_R1));
+    inst.addOperand(std::make_unique<MemoryOperand>(REG_R2, -8));
+    inst.setExtendedData({ 0x01 });
+    
+    std::vector<uint8_t> encoded = inst.encode();
+    if (inst.encodedSize() != encoded.size()) {
+        std::cout << "Expected encoded size " << encoded.size() << ", got " << inst.encodedSize() << "\n";
+        return false;
+    }
+    
+    // Encoding into a buffer appends after the existing contents
+    std::vector<uint8_t> buffer = { 0xAA, 0xBB };
+    ByteWriter writer(buffer);
+    inst.encodeInto(writer);
+    
+    if (buffer.size() != 2 + encoded.size() ||
+        !std::equal(encoded.begin(), encoded.end(), buffer.begin() + 2)) {
+        std::cout << "Expected encodeInto to append the same bytes as encode\n";
+        return false;
+    }
+    
+    // Operands report their own size the same way
+    ImmediateOperand symbol("name");
+    if (symbol.encodedSize() != symbol.encode().size()) {
+        std::cout << "Expected operand encoded size to match its encoding\n";
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Test the compact instruction encoding
+ */
+bool test_instruction_compact() {
+    Instruction inst(CAT_MEM, MEM_MOV);
+    inst.addOperand(std::make_unique<RegisterOperand>(REG_GP, REG_R3));
+    inst.addOperand(std::make_unique<RegisterOperand>(REG_FP, REG_R1, 0x05));
+    inst.addOperand(OperandValue::makeImmediate(static_cast<int64_t>(-3)));
+    inst.addOperand(std::make_unique<ImmediateOperand>(static_cast<int32_t>(100000)));
+    inst.addOperand(std::make_unique<MemoryOperand>(REG_R2, static_cast<int32_t>(-16)));
+    inst.addOperand(std::make_unique<ImmediateOperand>(std::string("a_symbol_longer_than_inline")));
+    inst.setExtendedData({0xAA, 0xBB});
+    
+    std::vector<uint8_t> standard = inst.encode();
+    std::vector<uint8_t> compact = inst.encode(ENCODING_COMPACT);
+    
+    if (compact.size() != inst.encodedSize(ENCODING_COMPACT) || compact.size() >= standard.size()) {
+        std::cout << "Expected a smaller compact encoding of the reported size, got " << compact.size()
+                  << " bytes (standard " << standard.size() << ")\n";
+        return false;
+    }
+    
+    // Operand count and the extended data bit share one byte
+    if (compact[0] != inst.getOpcode() || compact[1] != ((6 << 1) | 1)) {
+        std::cout << "Expected the compact header to pack the operand count\n";
+        return false;
+    }
+    
+    // Decoding the compact form gives back the same instruction
+    size_t offset = 0;
+    auto decoded = Instruction::decode(compact.data(), offset, ENCODING_COMPACT);
+    if (!decoded || offset != compact.size() || decoded->encode() != standard) {
+        std::cout << "Expected the compact encoding to decode to the original instruction\n";
+        return false;
+    }
+    
+    // Operands decode from either form
+    RegisterOperand reg(REG_FP, REG_R1, 0x05);
+    std::vector<uint8_t> encodedReg = reg.encode(ENCODING_COMPACT);
+    offset = 0;
+    auto decodedReg = Operand::decode(encodedReg.data(), offset, ENCODING_COMPACT);
+    auto* regOperand = dynamic_cast<RegisterOperand*>(decodedReg.get());
+    if (!regOperand || offset != encodedReg.size() || regOperand->getRegType() != REG_FP ||
+        regOperand->getRegId() != REG_R1 || regOperand->getFlags() != 0x05) {
+        std::cout << "Expected a compact register operand to keep its flags\n";
+        return false;
+    }
+    
+    // Default register flags are omitted
+    if (RegisterOperand(REG_GP, REG_R0).encode(ENCODING_COMPACT).size() != 2) {
+        std::cout << "Expected a compact register without flags to take two bytes\n";
+        return false;
+    }
+    
+    ImmediateOperand imm(static_cast<int64_t>(INT64_MIN));
+    std::vector<uint8_t> encodedImm = imm.encode(ENCODING_COMPACT);
+    offset = 0;
+    auto decodedImm = Operand::decode(encodedImm.data(), offset, ENCODING_COMPACT);
+    auto* immOperand = dynamic_cast<ImmediateOperand*>(decodedImm.get());
+    if (!immOperand || immOperand->getImmType() != IMM_INT64 || immOperand->getInt64Value() != INT64_MIN) {
+        std::cout << "Expected a compact immediate to round-trip\n";
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Test decoding whole sections with InstructionDecoder
+ */
+bool test_instruction_decoder() {
+    std::vector<std::unique_ptr<Instruction>> code;
+    code.push_back(std::make_unique<Instruction>(CAT_MATH, MATH_ADD));
+    code.back()->addOperand(OperandValue::makeRegister(REG_GP, REG_R0));
+    code.back()->addOperand(OperandValue::makeRegister(REG_GP, REG_R1, 0x02));
+    code.back()->addOperand(OperandValue::makeImmediate(static_cast<int64_t>(-1000)));
+    code.push_back(std::make_unique<Instruction>(CAT_CF, CF_CALL));
+    code.back()->addOperand(std::make_unique<ImmediateOperand>(std::string("a_function_with_a_long_name")));
+    code.push_back(std::make_unique<Instruction>(CAT_MEM, MEM_LOAD));
+    code.back()->addOperand(OperandValue::makeRegister(REG_GP, REG_R2));
+    code.back()->addOperand(OperandValue::makeMemory(REG_R3, -8));
+    code.back()->setExtendedData({1, 2, 3});
+    code.push_back(std::make_unique<Instruction>(CAT_CF, CF_RET));
+    
+    for (InstructionEncoding encoding : {ENCODING_STANDARD, ENCODING_COMPACT}) {
+        std::vector<uint8_t> data;
+        ByteWriter writer(data);
+        std::vector<size_t> offsets;
+        for (const auto& instruction : code) {
+            offsets.push_back(data.size());
+            instruction->encodeInto(writer, encoding);
+        }
+        
+        InstructionDecoder decoder(encoding);
+        if (!decoder.decode(data.data(), data.data() + data.size()) ||
+            decoder.getInstructions().size() != code.size()) {
+            std::cout << "Expected the decoder to decode every instruction\n";
+            return false;
+        }
+        
+        for (size_t i = 0; i < code.size(); i++) {
+            const DecodedInstruction& decoded = decoder.getInstructions()[i];
+            if (decoded.offset != offsets[i] || decoded.opcode != code[i]->getOpcode() ||
+                decoder.toInstruction(decoded)->encode() != code[i]->encode()) {
+                std::cout << "Expected decoded instruction " << i << " to match the original\n";
+                return false;
+            }
+        }
+        
+        // Every truncation stops at the instruction it cuts, without
+        // reading past the end of the (exactly sized) buffer
+        for (size_t size = 0; size < data.size(); size++) {
+            std::vector<uint8_t> prefix(data.begin(), data.begin() + size);
+            size_t complete = 0;
+            while (complete < offsets.size() &&
+                   (complete + 1 < offsets.size() ? offsets[complete + 1] : data.size()) <= size) {
+                complete++;
+            }
+            
+            bool whole = decoder.decode(prefix.data(), prefix.data() + prefix.size());
+            if (whole != (complete < offsets.size() && offsets[complete] == size) ||
+                decoder.getInstructions().size() != complete ||
+                (!whole && decoder.getErrorOffset() != offsets[complete])) {
+                std::cout << "Expected a truncated section to decode up to the cut, size " << size << "\n";
+                return false;
+            }
+            
+            size_t offset = offsets[std::min(complete, offsets.size() - 1)];
+            if (!whole && Instruction::decode(prefix.data(), prefix.size(), offset, encoding)) {
+                std::cout << "Expected Instruction::decode to reject a truncated instruction\n";
+                return false;
+            }
+        }
+    }
+    
+    // Unknown operand types are rejected
+    const uint8_t unknown[] = {0x40, 1, 0, 0, OPERAND_IMMEDIATE | 0x3F, 0};
+    InstructionDecoder decoder;
+    if (decoder.decode(unknown, unknown + sizeof(unknown)) || decoder.getErrorOffset() != 0) {
+        std::cout << "Expected an unknown operand type to stop decoding\n";
+        return false;
+    }
+    
+    return true;
+}
+
 /**
  * @brief Run all instruction tests
  */
@@ -234,6 +420,9 @@ bool test_instruction() {
     success &= test_instruction_decode();
     success &= test_operands();
     success &= test_instruction_extended_data();
+    success &= test_instruction_encode_into();
+    success &= test_instruction_compact();
+    success &= test_instruction_decoder();
     
     if (success) {
         std::cout << "All instruction tests passed.\n";
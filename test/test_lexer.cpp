@@ -63,7 +63,7 @@ bool test_lexer_basic() {
         return false;
     }
     
-    if (tokens[16].type != TOKEN_INSTRUCTION || tokens[16].text != "CF") {
+    if (tokens[17].type != TOKEN_INSTRUCTION || tokens[17].text != "CF") {
         std::cout << "Expected CF instruction\n";
         return false;
     }
@@ -101,12 +101,12 @@ bool test_lexer_registers_variables() {
         return false;
     }
     
-    if (tokens[8].type != TOKEN_REGISTER || tokens[8].text != "F1" || tokens[8].regId != 0x11) {
+    if (tokens[7].type != TOKEN_REGISTER || tokens[7].text != "F1" || tokens[7].regId != 0x11) {
         std::cout << "Expected F1 register\n";
         return false;
     }
     
-    if (tokens[14].type != TOKEN_REGISTER || tokens[14].text != "V2" || tokens[14].regId != 0x22) {
+    if (tokens[12].type != TOKEN_REGISTER || tokens[12].text != "V2" || tokens[12].regId != 0x22) {
         std::cout << "Expected V2 register\n";
         return false;
     }
@@ -117,18 +117,18 @@ bool test_lexer_registers_variables() {
         return false;
     }
     
-    if (tokens[10].type != TOKEN_VARIABLE || tokens[10].text != "$10" || tokens[10].varId != 10) {
+    if (tokens[9].type != TOKEN_VARIABLE || tokens[9].text != "$10" || tokens[9].varId != 10) {
         std::cout << "Expected $10 variable\n";
         return false;
     }
     
     // Check memory operand tokens
-    if (tokens[18].type != TOKEN_LBRACKET) {
+    if (tokens[16].type != TOKEN_LBRACKET) {
         std::cout << "Expected [\n";
         return false;
     }
     
-    if (tokens[19].type != TOKEN_REGISTER || tokens[19].text != "R4") {
+    if (tokens[17].type != TOKEN_REGISTER || tokens[17].text != "R4") {
         std::cout << "Expected R4 register\n";
         return false;
     }
@@ -167,19 +167,19 @@ bool test_lexer_literals() {
         return false;
     }
     
-    if (tokens[10].type != TOKEN_INTEGER || tokens[10].intValue != -100) {
+    if (tokens[9].type != TOKEN_INTEGER || tokens[9].intValue != -100) {
         std::cout << "Expected integer -100\n";
         return false;
     }
     
     // Check float literal
-    if (tokens[16].type != TOKEN_FLOAT || std::abs(tokens[16].floatValue - 3.14159) > 1e-5) {
+    if (tokens[14].type != TOKEN_FLOAT || std::abs(tokens[14].floatValue - 3.14159) > 1e-5) {
         std::cout << "Expected float 3.14159\n";
         return false;
     }
     
     // Check string literal
-    if (tokens[20].type != TOKEN_STRING || tokens[20].text != "Hello, World!") {
+    if (tokens[17].type != TOKEN_STRING || tokens[17].text != "Hello, World!") {
         std::cout << "Expected string \"Hello, World!\"\n";
         return false;
     }
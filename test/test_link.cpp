@@ -0,0 +1,217 @@
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "driver/assembler.h"
+#include "link/linker.h"
+#include "target/x86_64.h"
+#include "util/diagnostic.h"
+#include "util/logger.h"
+
+using namespace coil;
+
+static const char* const CALLER_SOURCE = "DIR SECT text READ EXEC\n"
+                                         "DIR HINT main FUNC GLOBAL\n"
+                                         "DIR LABEL main\n"
+                                         "  MEM MOV R0, 42\n"
+                                         "  CF CALL helper\n"
+                                         "  CF RET\n"
+                                         "DIR HINT main ENDFUNC\n";
+
+static const char* const CALLEE_SOURCE = "DIR SECT text READ EXEC\n"
+                                         "DIR HINT helper FUNC GLOBAL\n"
+                                         "DIR LABEL helper\n"
+                                         "  MATH ADD R0, R0, 1\n"
+                                         "  CF RET\n"
+                                         "DIR HINT helper ENDFUNC\n";
+
+/**
+ * @brief Assemble a source with x86-64 machine code
+ *
+ * @param source Source code
+ * @param name Source name
+ * @return COF file, or nullptr on error
+ */
+static std::unique_ptr<CofFile> assembleObject(const char* source, const std::string& name) {
+    AssemblyOptions options;
+    options.native = true;
+    Assembler assembler(options);
+    DiagnosticEngine diag(GlobalLogger::getInstance());
+    return assembler.assemble(source, name, diag);
+}
+
+/**
+ * @brief Find a symbol defined in a section
+ *
+ * @param cof COF file
+ * @param name Symbol name
+ * @param sectionIndex Section index
+ * @return Symbol, or nullptr if not found
+ */
+static const Symbol* findDefinition(const CofFile& cof, const std::string& name, uint32_t sectionIndex) {
+    for (const auto& symbol : cof.getSymbols()) {
+        if (symbol->getName() == name && !symbol->isUndefined() && symbol->getSectionIndex() == sectionIndex) {
+            return symbol.get();
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Find a section by name
+ *
+ * @param cof COF file
+ * @param name Section name
+ * @param index Section index (output parameter)
+ * @return true if found, false otherwise
+ */
+static bool findSection(CofFile& cof, const std::string& name, uint32_t& index) {
+    for (size_t i = 0; i < cof.getSectionCount(); i++) {
+        if (cof.getSection(i).getName() == name) {
+            index = static_cast<uint32_t>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Test that a call into another object is resolved and relocated
+ */
+bool test_link_resolve() {
+    auto caller = assembleObject(CALLER_SOURCE, "caller.coil");
+    auto callee = assembleObject(CALLEE_SOURCE, "callee.coil");
+    if (!caller || !callee) {
+        std::cout << "Failed to assemble the objects to link\n";
+        return false;
+    }
+
+    // The call in the caller's machine code, before linking
+    uint32_t nativeIndex;
+    if (!findSection(*caller, "text.x86-64", nativeIndex) || caller->getSection(nativeIndex).getRelocations().empty()) {
+        std::cout << "Expected the caller's machine code to call through a relocation\n";
+        return false;
+    }
+    RelocationEntry call = caller->getSection(nativeIndex).getRelocations().front();
+
+    LinkOptions options;
+    options.jobs = 2;
+    Linker linker(options);
+    linker.addObject("caller.cof", std::move(caller));
+    linker.addObject("callee.cof", std::move(callee));
+    auto linked = linker.link();
+    if (!linked) {
+        std::cout << "Failed to link the objects\n";
+        return false;
+    }
+
+    // Code comes before data, and each section is merged once
+    uint32_t textIndex;
+    uint32_t dataIndex;
+    if (!findSection(*linked, "text", textIndex) || !findSection(*linked, "text.x86-64", nativeIndex) ||
+        !findSection(*linked, "data", dataIndex) || linked->getSectionCount() != 3 || dataIndex != 2) {
+        std::cout << "Expected text, text.x86-64 and data in the linked file\n";
+        return false;
+    }
+
+    for (const auto& symbol : linked->getSymbols()) {
+        if (symbol->isUndefined()) {
+            std::cout << "Expected no undefined symbols, found " << symbol->getName() << "\n";
+            return false;
+        }
+    }
+
+    // The machine code calls the machine code of the callee
+    const Section& native = linked->getSection(nativeIndex);
+    const Symbol* helper = findDefinition(*linked, "helper", nativeIndex);
+    if (!helper || !native.getRelocations().empty() || call.type != X86_64_RELOC_PC32) {
+        std::cout << "Expected the machine code relocation to be applied\n";
+        return false;
+    }
+    std::vector<uint8_t> field = native.getBytes(call.offset, 4);
+    int32_t displacement = static_cast<int32_t>(field[0] | (field[1] << 8) | (field[2] << 16) |
+                                                (static_cast<uint32_t>(field[3]) << 24));
+    int64_t expected = static_cast<int64_t>(helper->getValue()) + call.addend - static_cast<int64_t>(call.offset);
+    if (displacement != expected) {
+        std::cout << "Expected the call displacement " << expected << ", found " << displacement << "\n";
+        return false;
+    }
+
+    // The bytecode keeps naming its callee, now defined in the same file
+    const Section& text = linked->getSection(textIndex);
+    if (text.getRelocations().size() != 1 || text.getRelocations()[0].type != RELOC_COIL_SYMBOL ||
+        linked->getSymbol(text.getRelocations()[0].symbol_index).getName() != "helper" ||
+        linked->getSymbol(text.getRelocations()[0].symbol_index).getSectionIndex() != textIndex) {
+        std::cout << "Expected the bytecode call to refer to the linked helper\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test that undefined and duplicate symbols are reported
+ */
+bool test_link_errors() {
+    // Twice the same definition
+    {
+        Linker linker{LinkOptions()};
+        linker.addObject("first.cof", assembleObject(CALLEE_SOURCE, "first.coil"));
+        linker.addObject("second.cof", assembleObject(CALLEE_SOURCE, "second.coil"));
+        if (linker.link()) {
+            std::cout << "Expected a duplicate symbol to fail the link\n";
+            return false;
+        }
+    }
+
+    // A call to nothing
+    {
+        Linker linker{LinkOptions()};
+        linker.addObject("caller.cof", assembleObject(CALLER_SOURCE, "caller.coil"));
+        if (linker.link()) {
+            std::cout << "Expected an undefined symbol to fail the link\n";
+            return false;
+        }
+    }
+
+    // A corrupt section alignment
+    for (uint32_t alignment : {0u, 24u, 2298478596u}) {
+        Linker linker{LinkOptions()};
+        auto object = assembleObject(CALLEE_SOURCE, "callee.coil");
+        object->getSection(0).setAlignment(alignment);
+        linker.addObject("callee.cof", std::move(object));
+        if (linker.link()) {
+            std::cout << "Expected alignment " << alignment << " to fail the link\n";
+            return false;
+        }
+    }
+
+    // ...which a relocatable link keeps for later
+    LinkOptions options;
+    options.relocatable = true;
+    Linker linker(options);
+    linker.addObject("caller.cof", assembleObject(CALLER_SOURCE, "caller.coil"));
+    auto linked = linker.link();
+    Symbol* helper = linked ? linked->getSymbolByName("helper") : nullptr;
+    if (!helper || !helper->isUndefined()) {
+        std::cout << "Expected a relocatable link to keep the undefined symbol\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool test_link() {
+    bool success = true;
+
+    success &= test_link_resolve();
+    success &= test_link_errors();
+
+    if (success) {
+        std::cout << "All link tests passed.\n";
+    } else {
+        std::cout << "Some link tests failed.\n";
+    }
+
+    return success;
+}
@@ -7,7 +7,11 @@
 bool test_lexer();
 bool test_parser();
 bool test_instruction();
+bool test_target();
+bool test_opt();
 bool test_binary();
+bool test_link();
+bool test_vm();
 
 int main(int argc, char** argv) {
     // Define test functions
@@ -15,9 +19,14 @@ int main(int argc, char** argv) {
         { "lexer", test_lexer },
         { "parser", test_parser },
         { "instruction", test_instruction },
+        { "target", test_target },
+        { "opt", test_opt },
         { "binary", test_binary },
+        { "link", test_link },
+        { "vm", test_vm },
         { "all", []() { 
-            return test_lexer() && test_parser() && test_instruction() && test_binary();
+            return test_lexer() && test_parser() && test_instruction() && test_target() && test_opt() && test_binary() &&
+                   test_link() && test_vm();
         }}
     };
     
@@ -0,0 +1,316 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include "parser/parser.h"
+#include "binary/cof.h"
+#include "opt/function_order.h"
+#include "opt/pass.h"
+#include "opt/passes.h"
+
+using namespace coil;
+
+namespace {
+
+/**
+ * @brief Operand for building test instructions
+ */
+struct TestOperand {
+    OperandValue value;
+
+    TestOperand(uint8_t regId) : value(OperandValue::makeRegister(REG_GP, regId)) {}
+    static TestOperand imm(int64_t number) {
+        TestOperand operand(0);
+        operand.value = OperandValue::makeImmediate(number);
+        return operand;
+    }
+    static TestOperand mem(uint8_t regId) {
+        TestOperand operand(0);
+        operand.value = OperandValue::makeMemory(regId);
+        return operand;
+    }
+};
+
+} // namespace
+
+static void emit(Function& func, uint8_t category, uint8_t operation, std::vector<TestOperand> operands = {}) {
+    auto inst = std::make_unique<Instruction>(category, operation);
+    for (const auto& operand : operands) {
+        inst->addOperand(operand.value);
+    }
+    func.addInstruction(std::move(inst));
+}
+
+static bool expectMove(const Function& func, size_t index, uint8_t regId, int64_t value) {
+    const auto& instructions = func.getInstructions();
+    if (index >= instructions.size()) {
+        return false;
+    }
+    const Instruction& inst = *instructions[index];
+    OperandValue expected = OperandValue::makeImmediate(value);
+    return inst.getCategory() == CAT_MEM && inst.getOperation() == MEM_MOV && inst.getOperandCount() == 2 &&
+           inst.getOperandValue(0).payload[0] == regId &&
+           inst.getOperandValue(1).type == expected.type &&
+           std::equal(expected.payload, expected.payload + 8, inst.getOperandValue(1).payload);
+}
+
+/**
+ * @brief Test NOP removal and that labels follow the instructions they mark
+ */
+bool test_opt_nop() {
+    Function func("nops");
+    emit(func, CAT_CF, CF_NOP);
+    func.addLabel("body", 1);
+    emit(func, CAT_CF, CF_NOP);
+    emit(func, CAT_MEM, MEM_MOV, {REG_R0, TestOperand::imm(1)});
+    func.addLabel("end", 3);
+    emit(func, CAT_CF, CF_RET);
+
+    NopEliminationPass pass;
+    if (!pass.run(func) || func.getInstructions().size() != 2) {
+        std::cout << "Expected both NOPs to be removed\n";
+        return false;
+    }
+    if (func.getLabels().at("body") != 0 || func.getLabels().at("end") != 1) {
+        std::cout << "Labels not moved with their instructions\n";
+        return false;
+    }
+    if (pass.run(func)) {
+        std::cout << "Expected nothing left to remove\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test removal of moves without effect
+ */
+bool test_opt_moves() {
+    Function func("moves");
+    emit(func, CAT_MEM, MEM_MOV, {REG_R0, REG_R0});                    // removed: to itself
+    emit(func, CAT_MEM, MEM_MOV, {REG_R1, REG_R2});
+    emit(func, CAT_MEM, MEM_MOV, {REG_R2, REG_R1});                    // removed: copies back
+    emit(func, CAT_MEM, MEM_MOV, {REG_R3, TestOperand::imm(1)});       // removed: overwritten
+    emit(func, CAT_MEM, MEM_MOV, {REG_R3, TestOperand::imm(2)});
+    emit(func, CAT_MEM, MEM_MOV, {REG_R3, TestOperand::mem(REG_R3)});  // kept: next one reads it
+    emit(func, CAT_MEM, MEM_MOV, {REG_R4, REG_R3});
+    emit(func, CAT_CF, CF_RET);
+
+    RedundantMoveEliminationPass pass;
+    pass.run(func);
+    if (func.getInstructions().size() != 5 || !expectMove(func, 1, REG_R3, 2)) {
+        std::cout << "Expected 5 instructions after move elimination, got "
+                  << func.getInstructions().size() << "\n";
+        return false;
+    }
+
+    // A copy back that a branch can reach on its own is kept
+    Function branched("branched");
+    emit(branched, CAT_MEM, MEM_MOV, {REG_R1, REG_R2});
+    branched.addLabel("again", 1);
+    emit(branched, CAT_MEM, MEM_MOV, {REG_R2, REG_R1});
+    emit(branched, CAT_CF, CF_RET);
+    if (pass.run(branched)) {
+        std::cout << "Expected a branch target to be kept\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test folding of arithmetic on immediates
+ */
+bool test_opt_folding() {
+    Function func("fold");
+    emit(func, CAT_MATH, MATH_ADD, {REG_R0, TestOperand::imm(2), TestOperand::imm(3)});
+    emit(func, CAT_MATH, MATH_MUL, {REG_R1, TestOperand::imm(-4), TestOperand::imm(5)});
+    emit(func, CAT_MATH, MATH_NEG, {REG_R2, TestOperand::imm(7)});
+    emit(func, CAT_MATH, MATH_DIV, {REG_R3, TestOperand::imm(7), TestOperand::imm(0)});
+    emit(func, CAT_MATH, MATH_ADD, {REG_R4, REG_R4, TestOperand::imm(1)});
+
+    ConstantFoldingPass pass;
+    pass.run(func);
+    if (!expectMove(func, 0, REG_R0, 5) || !expectMove(func, 1, REG_R1, -20) || !expectMove(func, 2, REG_R2, -7)) {
+        std::cout << "Constants not folded\n";
+        return false;
+    }
+    if (func.getInstructions()[3]->getCategory() != CAT_MATH || func.getInstructions()[4]->getCategory() != CAT_MATH) {
+        std::cout << "Division by zero and register operands must not be folded\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test that arithmetic whose flags a branch may read is not folded
+ */
+bool test_opt_folding_flags() {
+    Function func("flags");
+    emit(func, CAT_MEM, MEM_COMPARE, {REG_R1, TestOperand::imm(1)});
+    emit(func, CAT_MATH, MATH_SUB, {REG_R0, TestOperand::imm(5), TestOperand::imm(5)}); // BRC reads its flags
+    emit(func, CAT_CF, CF_BRC, {REG_R2});
+    emit(func, CAT_MATH, MATH_SUB, {REG_R3, TestOperand::imm(5), TestOperand::imm(5)}); // flags set again
+    emit(func, CAT_MEM, MEM_COMPARE, {REG_R3, TestOperand::imm(0)});
+    emit(func, CAT_CF, CF_BRC, {REG_R2});
+    func.getInstructions()[2]->setExtendedData({COND_EQ});
+    func.getInstructions()[5]->setExtendedData({COND_EQ});
+
+    ConstantFoldingPass pass;
+    pass.run(func);
+    if (func.getInstructions()[1]->getCategory() != CAT_MATH) {
+        std::cout << "Arithmetic folded although a branch reads its flags\n";
+        return false;
+    }
+    if (!expectMove(func, 3, REG_R3, 0)) {
+        std::cout << "Arithmetic whose flags are overwritten not folded\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test removal of code after jumps and returns
+ */
+bool test_opt_unreachable() {
+    Function func("unreachable");
+    emit(func, CAT_MEM, MEM_MOV, {REG_R0, TestOperand::imm(1)});
+    emit(func, CAT_CF, CF_RET);
+    emit(func, CAT_MEM, MEM_MOV, {REG_R0, TestOperand::imm(2)});       // removed
+    func.addLabel("reached", 3);
+    emit(func, CAT_MEM, MEM_MOV, {REG_R0, TestOperand::imm(3)});
+    emit(func, CAT_CF, CF_RET);
+    emit(func, CAT_CF, CF_NOP);                                         // removed
+
+    UnreachableCodeEliminationPass pass;
+    pass.run(func);
+    if (func.getInstructions().size() != 4 || func.getLabels().at("reached") != 2 ||
+        !expectMove(func, 2, REG_R0, 3)) {
+        std::cout << "Unreachable code not removed\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test that -O2 runs the passes until nothing changes
+ */
+bool test_opt_pipeline() {
+    Function func("pipeline");
+    emit(func, CAT_MATH, MATH_SUB, {REG_R0, TestOperand::imm(9), TestOperand::imm(4)});
+    emit(func, CAT_CF, CF_NOP);
+    emit(func, CAT_MEM, MEM_MOV, {REG_R0, TestOperand::imm(6)});
+    emit(func, CAT_MEM, MEM_MOV, {REG_R1, REG_R0});
+    emit(func, CAT_CF, CF_RET);
+
+    PassManager level1;
+    level1.addStandardPasses(1);
+    PassManager level2;
+    level2.addStandardPasses(2);
+    if (level1.getPassCount() != 3 || level2.getPassCount() != 4) {
+        std::cout << "Unexpected standard pass counts\n";
+        return false;
+    }
+
+    // SUB folds to a move, the NOP goes, and then the move is overwritten
+    level2.run(func);
+    if (func.getInstructions().size() != 3 || !expectMove(func, 0, REG_R0, 6)) {
+        std::cout << "Expected 3 instructions after -O2, got " << func.getInstructions().size() << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Run all optimization tests
+ */
+/**
+ * @brief Test profile-guided function ordering and the text.cold section
+ */
+bool test_opt_function_order() {
+    FunctionProfile profile;
+    if (profile.parse("main 1 2 3\n", "bad.profile") ||
+        !profile.parse("# entries\nmain 100\nhot 90\n\nmain hot 90\nutil 5\n", "test.profile")) {
+        std::cout << "Expected only well-formed profiles to parse\n";
+        return false;
+    }
+
+    Module module("order");
+    for (const char* name : {"unused", "leaf", "main", "util", "hot"}) {
+        auto function = std::make_unique<Function>(name);
+        emit(*function, CAT_MEM, MEM_MOV, {REG_R0, TestOperand::imm(1)});
+        emit(*function, CAT_CF, CF_RET);
+        module.addFunction(std::move(function));
+    }
+    module.setFunctionHeat("unused", FUNCTION_HEAT_COLD);
+
+    // main pulls its hottest callee into its cluster; leaf never ran
+    if (!FunctionOrder(&profile, ENCODING_STANDARD).run(module)) {
+        std::cout << "Expected the functions to be reordered\n";
+        return false;
+    }
+    std::vector<std::string> names;
+    for (const auto& function : module.getFunctions()) {
+        names.push_back(function->getName());
+    }
+    const std::vector<std::string> expected = {"main", "hot", "util", "unused", "leaf"};
+    if (names != expected || module.getColdFunctionCount() != 2 || module.getFunctionByName("util") !=
+        module.getFunctions()[2].get()) {
+        std::cout << "Wrong function order\n";
+        return false;
+    }
+
+    // Cold functions have a code section of their own
+    auto cof = module.generateCof();
+    if (!cof || cof->getSectionCount() != 3 || cof->getSection(2).getName() != "text.cold") {
+        std::cout << "Expected a text.cold section\n";
+        return false;
+    }
+    size_t functionSize = cof->getSymbolByName("main")->getSize();
+    const Symbol* unused = cof->getSymbolByName("unused");
+    const Symbol* leaf = cof->getSymbolByName("leaf");
+    if (cof->getSection(0).getSize() != 3 * functionSize || cof->getSection(2).getSize() != 2 * functionSize ||
+        unused->getSectionIndex() != 2 || unused->getValue() != 0 || leaf->getValue() != functionSize) {
+        std::cout << "Wrong placement of the cold functions\n";
+        return false;
+    }
+
+    // Without a profile or hints, nothing moves
+    Module plain("plain");
+    plain.addFunction(std::make_unique<Function>("b"));
+    plain.addFunction(std::make_unique<Function>("a"));
+    if (FunctionOrder(nullptr, ENCODING_STANDARD).run(plain)) {
+        std::cout << "Expected a module without hints to keep its order\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool test_opt() {
+    std::cout << "Testing optimization passes...\n";
+
+    bool success = true;
+
+    success &= test_opt_nop();
+    success &= test_opt_moves();
+    success &= test_opt_folding();
+    success &= test_opt_folding_flags();
+    success &= test_opt_unreachable();
+    success &= test_opt_pipeline();
+    success &= test_opt_function_order();
+
+    if (success) {
+        std::cout << "All optimization tests passed.\n";
+    } else {
+        std::cout << "Some optimization tests failed.\n";
+    }
+
+    return success;
+}
@@ -2,8 +2,14 @@
 #include <cassert>
 #include <string>
 #include <vector>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
 #include "parser/lexer.h"
 #include "parser/parser.h"
+#include "core/operand.h"
+#include "binary/cof_view.h"
+#include "binary/function_cache.h"
 #include "util/logger.h"
 #include "util/diagnostic.h"
 
@@ -218,9 +224,686 @@ bool test_parser_sections() {
     return true;
 }
 
+/**
+ * @brief Lex and parse a source
+ *
+ * @param input Source code
+ * @param diag Diagnostics to report to
+ * @return Module, or nullptr if the source has errors
+ */
+static std::unique_ptr<Module> parseSource(const std::string& input, DiagnosticEngine& diag) {
+    Lexer lexer(input, "test.coil", diag);
+    std::vector<Token> tokens = lexer.tokenize();
+    
+    Parser parser(tokens, diag);
+    auto module = parser.parse();
+    
+    return diag.hasErrorDiagnostics() ? nullptr : std::move(module);
+}
+
+/**
+ * @brief Test that instruction bodies are parsed into operations and operands
+ */
+bool test_parser_instructions() {
+    GlobalLogger::setInstance(std::make_unique<ConsoleLogger>(LOG_DEBUG));
+    DiagnosticEngine diag(GlobalLogger::getInstance());
+    
+    auto module = parseSource("DIR SECT text READ EXEC\n"
+                              "DIR HINT main FUNC GLOBAL\n"
+                              "DIR LABEL main\n"
+                              "  MEM MOV R1, 0x10\n"
+                              "  MATH ADD R0, R1, -3\n"
+                              "  MEM LOAD R2, [R1-8]\n"
+                              "  VAR DECL $0 : int64 = 0b101\n"
+                              "DIR LABEL again\n"
+                              "  MEM COMPARE R0, $0\n"
+                              "  CF BRC NE again\n"
+                              "  CF SYSC (1) (R0, R1) -> (R2)\n"
+                              "  CF RET\n"
+                              "DIR HINT main ENDFUNC\n",
+                              diag);
+    if (!module) {
+        std::cout << "Parser reported errors:\n";
+        diag.printDiagnostics();
+        return false;
+    }
+    
+    Function* func = module->getFunctionByName("main");
+    if (!func || func->getInstructions().size() != 8) {
+        std::cout << "Expected 'main' to have 8 instructions\n";
+        return false;
+    }
+    const auto& instructions = func->getInstructions();
+    
+    // Hexadecimal and negative immediates
+    const auto* hex = dynamic_cast<const ImmediateOperand*>(instructions[0]->getOperands()[1].get());
+    if (instructions[0]->getCategory() != CAT_MEM || instructions[0]->getOperation() != MEM_MOV ||
+        !hex || hex->getInt64Value() != 0x10) {
+        std::cout << "Expected MEM MOV R1, 0x10\n";
+        return false;
+    }
+    
+    const auto& add = instructions[1]->getOperands();
+    const auto* negative = add.size() == 3 ? dynamic_cast<const ImmediateOperand*>(add[2].get()) : nullptr;
+    if (instructions[1]->getOperation() != MATH_ADD || !negative || negative->getInt64Value() != -3) {
+        std::cout << "Expected MATH ADD R0, R1, -3\n";
+        return false;
+    }
+    
+    // Register minus displacement
+    const auto* memory = dynamic_cast<const MemoryOperand*>(instructions[2]->getOperands()[1].get());
+    if (!memory || memory->getMemType() != MEM_REG_DISP) {
+        std::cout << "Expected [R1-8] to be a register and displacement\n";
+        return false;
+    }
+    
+    // Declarations record the type in the extended data and the function
+    const auto& decl = instructions[3]->getOperands();
+    const auto* variable = decl.empty() ? nullptr : dynamic_cast<const VariableOperand*>(decl[0].get());
+    if (instructions[3]->getCategory() != CAT_VAR || !variable || variable->getVarId() != 0 || decl.size() != 2 ||
+        instructions[3]->getExtendedData().size() != 2 || func->getVariableType(0) != TYPE_INT64) {
+        std::cout << "Expected VAR DECL $0 : int64 = 0b101\n";
+        return false;
+    }
+    
+    // The condition code goes into the extended data, the label is a symbol
+    const auto& branch = instructions[5]->getOperands();
+    const auto* target = branch.size() == 1 ? dynamic_cast<const ImmediateOperand*>(branch[0].get()) : nullptr;
+    if (instructions[5]->getOperation() != CF_BRC || instructions[5]->getExtendedData().size() != 1 ||
+        instructions[5]->getExtendedData()[0] != COND_NE || !target || target->getImmType() != IMM_SYMBOL) {
+        std::cout << "Expected CF BRC NE again\n";
+        return false;
+    }
+    
+    // Grouped operands, with the output count as the last extended byte
+    if (instructions[6]->getOperation() != CF_SYSC || instructions[6]->getOperands().size() != 4 ||
+        instructions[6]->getExtendedData().size() != 1 || instructions[6]->getExtendedData()[0] != 1) {
+        std::cout << "Expected CF SYSC (1) (R0, R1) -> (R2)\n";
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Test that malformed instructions and labels are reported
+ */
+bool test_parser_instruction_errors() {
+    static const char* const sources[] = {
+        // Unknown operation
+        "DIR SECT text READ EXEC\nDIR HINT f FUNC\nDIR LABEL f\n  MATH FOO R0\nDIR HINT f ENDFUNC\n",
+        // Branch without a condition code
+        "DIR SECT text READ EXEC\nDIR HINT f FUNC\nDIR LABEL f\n  CF BRC f\nDIR HINT f ENDFUNC\n",
+        // Stray token after the operands
+        "DIR SECT text READ EXEC\nDIR HINT f FUNC\nDIR LABEL f\n  CF RET ]\nDIR HINT f ENDFUNC\n",
+        // Duplicate local label
+        "DIR SECT text READ EXEC\nDIR HINT f FUNC\nDIR LABEL f\nDIR LABEL a\nDIR LABEL a\n  CF RET\n"
+        "DIR HINT f ENDFUNC\n",
+        // Missing end of function
+        "DIR SECT text READ EXEC\nDIR HINT f FUNC\nDIR LABEL f\n  CF RET\n",
+        // Label in code outside any function
+        "DIR SECT text READ EXEC\nDIR LABEL stray\n"
+    };
+    
+    for (const char* source : sources) {
+        DiagnosticEngine diag;
+        if (parseSource(source, diag)) {
+            std::cout << "Expected an error for:\n" << source;
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Test that generating a COF file encodes the module's code in place
+ */
+bool test_parser_generate_cof() {
+    // Set up logger and diagnostics
+    GlobalLogger::setInstance(std::make_unique<ConsoleLogger>(LOG_DEBUG));
+    DiagnosticEngine diag(GlobalLogger::getInstance());
+    
+    std::string input = "DIR SECT text READ EXEC\n"
+                        "DIR HINT first FUNC GLOBAL\n"
+                        "DIR LABEL first\n"
+                        "  MATH ADD R0, R0, 1\n"
+                        "  CF RET\n"
+                        "DIR HINT first ENDFUNC\n"
+                        "DIR HINT second FUNC GLOBAL\n"
+                        "DIR LABEL second\n"
+                        "  MEM LOAD R1, [R2 + 8]\n"
+                        "  CF RET\n"
+                        "DIR HINT second ENDFUNC";
+    
+    Lexer lexer(input, "test.coil", diag);
+    Parser parser(lexer, diag);
+    auto module = parser.parse();
+    
+    if (diag.hasErrorDiagnostics() || !module) {
+        std::cout << "Parser reported errors:\n";
+        diag.printDiagnostics();
+        return false;
+    }
+    
+    // The text section holds every function's instructions, in order
+    std::vector<uint8_t> expected;
+    for (const auto& function : module->getFunctions()) {
+        for (const auto& instruction : function->getInstructions()) {
+            std::vector<uint8_t> encoded = instruction->encode();
+            expected.insert(expected.end(), encoded.begin(), encoded.end());
+        }
+    }
+    
+    auto cof = module->generateCof();
+    if (!cof || cof->getSection(0).getData() != expected) {
+        std::cout << "Expected text section to contain the encoded functions\n";
+        return false;
+    }
+    
+    // Function symbols point at their code
+    Symbol* second = cof->getSymbolByName("second");
+    size_t firstSize = 0;
+    for (const auto& instruction : module->getFunctionByName("first")->getInstructions()) {
+        firstSize += instruction->encodedSize();
+    }
+    if (!second || second->getValue() != firstSize || second->getSize() != expected.size() - firstSize) {
+        std::cout << "Expected symbol 'second' to cover its code\n";
+        return false;
+    }
+    
+    // Encoding on several threads gives the same result
+    auto parallelCof = module->generateCof(4);
+    if (!parallelCof || parallelCof->getSection(0).getData() != expected ||
+        parallelCof->getSymbolByName("second")->getValue() != firstSize) {
+        std::cout << "Expected parallel code generation to match serial output\n";
+        return false;
+    }
+    
+    // The module keeps its instructions
+    if (module->getFunctionByName("second")->getInstructions().size() != 2) {
+        std::cout << "Expected function 'second' to keep its instructions\n";
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Test that unchanged functions are reused from the function cache
+ */
+bool test_parser_function_cache() {
+    GlobalLogger::setInstance(std::make_unique<ConsoleLogger>(LOG_DEBUG));
+    
+    std::string first = "DIR HINT first FUNC GLOBAL\n"
+                        "DIR LABEL first\n"
+                        "  MATH ADD R0, R0, 1\n"
+                        "  CF RET\n"
+                        "DIR HINT first ENDFUNC\n";
+    std::string second = "DIR HINT second FUNC GLOBAL\n"
+                         "DIR LABEL second\n"
+                         "  MEM LOAD R1, [R2 + 8]\n"
+                         "  CF RET\n"
+                         "DIR HINT second ENDFUNC\n";
+    std::string changed = "DIR HINT second FUNC GLOBAL\n"
+                          "DIR LABEL second\n"
+                          "  MEM LOAD R1, [R2 + 16]\n"
+                          "  MATH SUB R1, R1, 1\n"
+                          "  CF RET\n"
+                          "DIR HINT second ENDFUNC\n";
+    
+    std::string path = (std::filesystem::temp_directory_path() / "coil_test_function_cache.fcache").string();
+    std::remove(path.c_str());
+    
+    // Assemble a source, optionally through a cache, and return its code
+    auto assemble = [](const std::string& input, FunctionCache* cache, std::vector<uint8_t>& code) {
+        DiagnosticEngine diag(GlobalLogger::getInstance());
+        Lexer lexer(input, "test.coil", diag);
+        Parser parser(lexer, diag);
+        parser.setFunctionCache(cache);
+        auto module = parser.parse();
+        if (diag.hasErrorDiagnostics() || !module) {
+            diag.printDiagnostics();
+            return false;
+        }
+        
+        auto cof = module->generateCof(1, cache);
+        if (!cof || !cof->getSymbolByName("second")) {
+            return false;
+        }
+        code = cof->getSection(0).getData();
+        return true;
+    };
+    
+    std::vector<uint8_t> expected, code;
+    
+    // A cold cache parses and stores every function
+    {
+        FunctionCache cache(path, 1);
+        if (cache.load() || !assemble(first + second, &cache, code) || cache.getHitCount() != 0 || !cache.save()) {
+            std::cout << "Expected a cold cache to store the functions\n";
+            return false;
+        }
+    }
+    
+    // After reloading, only the changed function is parsed again
+    FunctionCache cache(path, 1);
+    if (!cache.load() || !assemble(first + changed, &cache, code) || !assemble(first + changed, nullptr, expected)) {
+        std::cout << "Expected the cache to load and assembly to succeed\n";
+        return false;
+    }
+    if (cache.getHitCount() != 1 || cache.getMissCount() != 1 || code != expected) {
+        std::cout << "Expected the unchanged function to be reused\n";
+        return false;
+    }
+    
+    // A different configuration ignores the file
+    FunctionCache otherConfig(path, 2);
+    if (otherConfig.load()) {
+        std::cout << "Expected a cache for another configuration to be ignored\n";
+        return false;
+    }
+    
+    std::remove(path.c_str());
+    return true;
+}
+
+/**
+ * @brief Test that vector operations carry their element type
+ */
+bool test_parser_vector() {
+    DiagnosticEngine diag(GlobalLogger::getInstance());
+    std::string input = "DIR SECT text READ EXEC\n"
+                        "DIR HINT vec FUNC GLOBAL\n"
+                        "DIR LABEL vec\n"
+                        "  VEC ADD fp32 V0, V1, V2\n"
+                        "  VEC XOR V0, V1\n"
+                        "  CF RET\n"
+                        "DIR HINT vec ENDFUNC";
+    
+    Lexer lexer(input, "vector.coil", diag);
+    Parser parser(lexer.tokenize(), diag);
+    auto module = parser.parse();
+    if (!module || diag.hasErrorDiagnostics()) {
+        std::cout << "Failed to parse vector operations\n";
+        diag.printDiagnostics();
+        return false;
+    }
+    
+    const auto& instructions = module->getFunctionByName("vec")->getInstructions();
+    const Instruction& add = *instructions[0];
+    if (add.getCategory() != CAT_VEC || add.getOperation() != VEC_ADD || add.getOperandCount() != 3 ||
+        add.getExtendedData().size() != 1 || add.getExtendedData()[0] != TYPE_FP32) {
+        std::cout << "Expected VEC ADD with an fp32 element type\n";
+        return false;
+    }
+    
+    // The element type is optional
+    const Instruction& bitwise = *instructions[1];
+    if (bitwise.getOperation() != VEC_XOR || bitwise.getOperandCount() != 2 || !bitwise.getExtendedData().empty()) {
+        std::cout << "Expected VEC XOR without an element type\n";
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Test that references leaving a function become relocations
+ */
+bool test_parser_relocations() {
+    DiagnosticEngine diag(GlobalLogger::getInstance());
+    std::string input = "DIR SECT text READ EXEC\n"
+                        "DIR HINT loop FUNC GLOBAL\n"
+                        "DIR LABEL loop\n"
+                        "DIR LABEL again\n"
+                        "  MATH DEC R0\n"
+                        "  CF BRC NE again\n"
+                        "  CF CALL puts\n"
+                        "  CF RET\n"
+                        "DIR HINT loop ENDFUNC\n"
+                        "DIR HINT main FUNC GLOBAL\n"
+                        "DIR LABEL main\n"
+                        "  CF CALL loop\n"
+                        "  CF RET\n"
+                        "DIR HINT main ENDFUNC";
+    
+    Lexer lexer(input, "relocations.coil", diag);
+    Parser parser(lexer.tokenize(), diag);
+    auto module = parser.parse();
+    if (!module || diag.hasErrorDiagnostics()) {
+        std::cout << "Failed to parse calls and branches\n";
+        diag.printDiagnostics();
+        return false;
+    }
+    
+    // The local branch is relocated against its function, with the label's
+    // offset as the addend; both calls get one pointing at their symbol
+    // operand, puts as an undefined symbol
+    auto cof = module->generateCof();
+    const auto& relocations = cof ? cof->getSection(0).getRelocations() : std::vector<RelocationEntry>();
+    if (relocations.size() != 3) {
+        std::cout << "Expected a relocation for the branch and each call\n";
+        return false;
+    }
+    
+    const auto& instructions = module->getFunctionByName("loop")->getInstructions();
+    uint64_t branchOffset = instructions[0]->encodedSize();
+    const Symbol& branchTarget = cof->getSymbol(relocations[0].symbol_index);
+    if (relocations[0].offset != branchOffset + instructions[1]->operandOffset(0) ||
+        relocations[0].type != RELOC_COIL_LABEL || relocations[0].addend != 0 ||
+        branchTarget.getName() != "loop") {
+        std::cout << "Wrong relocation for the local branch\n";
+        return false;
+    }
+    
+    uint64_t callOffset = branchOffset + instructions[1]->encodedSize();
+    const Symbol& puts = cof->getSymbol(relocations[1].symbol_index);
+    const Symbol& loop = cof->getSymbol(relocations[2].symbol_index);
+    const auto& text = cof->getSection(0).getData();
+    if (relocations[1].offset != callOffset + instructions[2]->operandOffset(0) ||
+        relocations[1].type != RELOC_COIL_SYMBOL || puts.getName() != "puts" ||
+        !(puts.getFlags() & SYMBOL_FLAG_UNDEFINED) || loop.getName() != "loop" || !loop.isFunction() ||
+        text[relocations[1].offset] != (OPERAND_IMMEDIATE | IMM_SYMBOL) ||
+        text[relocations[2].offset] != (OPERAND_IMMEDIATE | IMM_SYMBOL)) {
+        std::cout << "Wrong relocations for calls\n";
+        return false;
+    }
+    
+    // A branch to a label that does not exist is an error
+    DiagnosticEngine badDiag(GlobalLogger::getInstance());
+    Lexer badLexer("DIR HINT f FUNC GLOBAL\nDIR LABEL f\n  CF BR nowhere\nDIR HINT f ENDFUNC", "bad.coil", badDiag);
+    Parser badParser(badLexer.tokenize(), badDiag);
+    auto badModule = badParser.parse();
+    if (!badModule || badModule->generateCof()) {
+        std::cout << "Expected an unresolved branch to fail\n";
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Test that macros, constants and structures expand to plain instructions
+ */
+bool test_parser_macros() {
+    std::string input = "DIR CONST STEP 8\n"
+                        "DIR STRUCT point\n"
+                        "  x int32\n"
+                        "  tag 1\n"
+                        "  y int64\n"
+                        "DIR ENDSTRUCT\n"
+                        "DIR MACRO bump dst, amount\n"
+                        "  MATH ADD dst, dst, amount\n"
+                        "  MATH SUB dst, dst, 1\n"
+                        "DIR ENDM\n"
+                        "DIR SECT text READ EXEC\n"
+                        "DIR HINT f FUNC GLOBAL\n"
+                        "DIR LABEL f\n"
+                        "  bump R0, STEP\n"
+                        "  MEM LOAD R1, [R2 + point-y]\n"
+                        "  MEM MOV R3, point-size\n"
+                        "  CF RET\n"
+                        "DIR HINT f ENDFUNC\n";
+    std::string expanded = "DIR SECT text READ EXEC\n"
+                           "DIR HINT f FUNC GLOBAL\n"
+                           "DIR LABEL f\n"
+                           "  MATH ADD R0, R0, 8\n"
+                           "  MATH SUB R0, R0, 1\n"
+                           "  MEM LOAD R1, [R2 + 8]\n"
+                           "  MEM MOV R3, 16\n"
+                           "  CF RET\n"
+                           "DIR HINT f ENDFUNC\n";
+    
+    auto assemble = [](const std::string& source, std::vector<uint8_t>& code) {
+        DiagnosticEngine diag(GlobalLogger::getInstance());
+        Lexer lexer(source, "macros.coil", diag);
+        Parser parser(lexer, diag);
+        auto module = parser.parse();
+        if (!module || diag.hasErrorDiagnostics()) {
+            diag.printDiagnostics();
+            return false;
+        }
+        auto cof = module->generateCof();
+        if (!cof) {
+            return false;
+        }
+        code = cof->getSection(0).getData();
+        return true;
+    };
+    
+    std::vector<uint8_t> code, expected;
+    if (!assemble(input, code) || !assemble(expanded, expected) || code != expected) {
+        std::cout << "Expected macros, constants and structures to match the expanded source\n";
+        return false;
+    }
+    
+    // An invocation has to pass every parameter
+    DiagnosticEngine diag(GlobalLogger::getInstance());
+    Lexer lexer("DIR MACRO two a, b\n  MATH ADD a, a, b\nDIR ENDM\n"
+                "DIR HINT g FUNC GLOBAL\nDIR LABEL g\n  two R0\n  CF RET\nDIR HINT g ENDFUNC\n",
+                "macros.coil", diag);
+    Parser parser(lexer, diag);
+    if (parser.parse() || !diag.hasErrorDiagnostics()) {
+        std::cout << "Expected a missing macro argument to be an error\n";
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Test that included files are tokenized once and shared between parsers
+ */
+bool test_parser_include() {
+    std::string header = (std::filesystem::temp_directory_path() / "coil_test_include.coil").string();
+    {
+        std::ofstream out(header);
+        out << "DIR CONST LIMIT 100\n"
+               "DIR MACRO clamp dst\n"
+               "  MATH MIN dst, dst, LIMIT\n"
+               "DIR ENDM\n";
+    }
+    
+    // The second include of the same file is skipped
+    std::string input = "DIR INCLUDE \"" + header + "\"\n"
+                        "DIR INCLUDE \"" + header + "\"\n"
+                        "DIR HINT f FUNC GLOBAL\n"
+                        "DIR LABEL f\n"
+                        "  clamp R0\n"
+                        "  CF RET\n"
+                        "DIR HINT f ENDFUNC\n";
+    
+    IncludeCache cache;
+    for (int run = 0; run < 2; run++) {
+        DiagnosticEngine diag(GlobalLogger::getInstance());
+        Lexer lexer(input, "main.coil", diag);
+        Parser parser(lexer, diag);
+        parser.setIncludeCache(&cache);
+        auto module = parser.parse();
+        if (!module || diag.hasErrorDiagnostics()) {
+            std::cout << "Failed to parse a module with an include\n";
+            diag.printDiagnostics();
+            std::remove(header.c_str());
+            return false;
+        }
+        
+        const auto& instructions = module->getFunctionByName("f")->getInstructions();
+        if (instructions.size() != 2 || instructions[0]->getOperation() != MATH_MIN ||
+            instructions[0]->getOperandCount() != 3) {
+            std::cout << "Expected the included macro to expand\n";
+            std::remove(header.c_str());
+            return false;
+        }
+    }
+    std::remove(header.c_str());
+    
+    if (cache.getHitCount() != 1) {
+        std::cout << "Expected the second parser to reuse the included tokens\n";
+        return false;
+    }
+    
+    return true;
+}
+
 /**
  * @brief Run all parser tests
  */
+/**
+ * @brief Test that parsing stops at the error limit
+ */
+bool test_parser_error_limit() {
+    std::string input;
+    for (int i = 0; i < 1000; i++) {
+        input += "garbage @\n";
+    }
+    
+    DiagnosticEngine diag;
+    diag.setErrorLimit(5);
+    Lexer lexer(input, "errors.coil", diag);
+    Parser parser(lexer, diag);
+    if (parser.parse()) {
+        std::cout << "Expected a module with errors to fail\n";
+        return false;
+    }
+    
+    // Five errors, then the fatal error that ends parsing
+    auto diagnostics = diag.getDiagnostics();
+    if (!diag.hasReachedErrorLimit() || diagnostics.size() != 6 || diagnostics.back().severity != DIAG_FATAL) {
+        std::cout << "Expected parsing to stop after five errors, got " << diagnostics.size() << " diagnostics\n";
+        return false;
+    }
+    
+    // Every location refers to the same interned filename
+    if (diagnostics[0].location.filename != "errors.coil" ||
+        diagnostics[0].location.filename.data() != diagnostics[4].location.filename.data()) {
+        std::cout << "Expected locations to share one filename\n";
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Find a section by name
+ * 
+ * @param cof COF file
+ * @param name Section name
+ * @return Section, or nullptr if not found
+ */
+static const Section* findSection(CofFile& cof, const std::string& name) {
+    for (size_t i = 0; i < cof.getSectionCount(); i++) {
+        if (cof.getSection(i).getName() == name) {
+            return &cof.getSection(i);
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Test that data directives fill the data sections, and that
+ *        objects of only zeros are kept as a size in the BSS section
+ */
+bool test_parser_data() {
+    DiagnosticEngine diag;
+    std::string input = "DIR SECT data READ WRITE\n"
+                        "DIR LABEL greeting\n"
+                        "DIR ASCII \"Hi\\n\" \"\\x41\\0\"\n"
+                        "DIR LABEL wide\n"
+                        "DIR ALIGN 4\n"
+                        "DIR UNICODE \"A\xF0\x9F\x98\x80\"\n"
+                        "DIR LABEL table\n"
+                        "DIR ALIGN 16\n"
+                        "DIR ZERO 4096\n"
+                        "DIR PADD 65536\n"
+                        "DIR LABEL padded\n"
+                        "DIR ASCII \"x\"\n"
+                        "DIR PADD 8\n"
+                        "DIR SECT text READ EXEC\n"
+                        "DIR HINT main FUNC GLOBAL\n"
+                        "DIR LABEL main\n"
+                        "  CF RET\n"
+                        "DIR HINT main ENDFUNC\n";
+    
+    Lexer lexer(input, "data.coil", diag);
+    Parser parser(lexer, diag);
+    auto module = parser.parse();
+    auto cof = module ? module->generateCof() : nullptr;
+    if (diag.hasErrorDiagnostics() || !cof) {
+        std::cout << "Failed to assemble data directives:\n";
+        diag.printDiagnostics();
+        return false;
+    }
+    
+    // Strings with their escapes decoded, then UTF-16 with a surrogate pair
+    // at the next multiple of 4, then the padded object
+    std::vector<uint8_t> expected = {'H', 'i', '\n', 'A', 0, 0, 0, 0,
+                                     'A', 0, 0x3D, 0xD8, 0x00, 0xDE,
+                                     'x', 0, 0, 0, 0, 0, 0, 0};
+    const Section* data = findSection(*cof, "data");
+    if (!data || data->getData() != expected || data->getAlignment() < 4 ||
+        !(data->getFlags() & SECTION_FLAG_WRITE)) {
+        std::cout << "Expected the data section to hold the initialized objects\n";
+        return false;
+    }
+    
+    // The table is nothing but zeros, so only its size is kept
+    const Section* bss = findSection(*cof, "bss");
+    Symbol* table = cof->getSymbolByName("table");
+    if (!bss || bss->getType() != SECTION_BSS || bss->getSize() != 65536 || !bss->getData().empty() ||
+        bss->getAlignment() < 16 || !table || &cof->getSection(table->getSectionIndex()) != bss ||
+        table->getValue() != 0 || table->getSize() != 65536) {
+        std::cout << "Expected the zero table in a BSS section without stored bytes\n";
+        return false;
+    }
+    
+    Symbol* wide = cof->getSymbolByName("wide");
+    Symbol* padded = cof->getSymbolByName("padded");
+    if (!wide || wide->getValue() != 8 || wide->getSize() != 6 || wide->getType() != SYMBOL_DATA ||
+        !padded || padded->getValue() != 14 || padded->getSize() != 8) {
+        std::cout << "Expected the data labels to cover their objects\n";
+        return false;
+    }
+    
+    // The BSS section takes no room in the file and reads back as a size
+    std::vector<uint8_t> bytes = cof->serialize();
+    auto view = CofView::fromBuffer(bytes.data(), bytes.size());
+    if (bytes.size() >= 4096 || !view) {
+        std::cout << "Expected the zero table not to be stored in the file\n";
+        return false;
+    }
+    for (size_t i = 0; i < view->getSectionCount(); i++) {
+        if (view->getSectionName(i) == "bss" &&
+            (view->getSectionSize(i) != 65536 || !view->getSectionData(i).empty())) {
+            std::cout << "Expected the BSS section to read back as a size\n";
+            return false;
+        }
+    }
+    
+    // Data out of place is reported
+    const char* const invalid[] = {
+        "DIR ASCII \"no section\"\n",
+        "DIR SECT bss READ WRITE\nDIR ASCII \"not zero\"\n",
+        "DIR SECT data\nDIR ALIGN 3\n",
+        "DIR SECT data\nDIR ZERO -1\n",
+        "DIR SECT data\nDIR LABEL a\nDIR ASCII \"abc\"\nDIR PADD 2\n",
+        "DIR SECT data\nDIR ASCII \"\\q\"\n",
+        "DIR SECT data\nDIR UNICODE \"\\xFF\"\n",
+        "DIR SECT data\nDIR LABEL a\nDIR LABEL a\n",
+    };
+    for (const char* source : invalid) {
+        DiagnosticEngine errors;
+        Lexer invalidLexer(source, "invalid.coil", errors);
+        Parser invalidParser(invalidLexer, errors);
+        if (invalidParser.parse()) {
+            std::cout << "Expected an error for: " << source;
+            return false;
+        }
+    }
+    
+    return true;
+}
+
 bool test_parser() {
     std::cout << "Testing parser...\n";
     
@@ -229,6 +912,16 @@ bool test_parser() {
     success &= test_parser_basic();
     success &= test_parser_abi();
     success &= test_parser_sections();
+    success &= test_parser_instructions();
+    success &= test_parser_instruction_errors();
+    success &= test_parser_generate_cof();
+    success &= test_parser_function_cache();
+    success &= test_parser_vector();
+    success &= test_parser_relocations();
+    success &= test_parser_macros();
+    success &= test_parser_include();
+    success &= test_parser_error_limit();
+    success &= test_parser_data();
     
     if (success) {
         std::cout << "All parser tests passed.\n";
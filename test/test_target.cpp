@@ -0,0 +1,637 @@
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include "parser/parser.h"
+#include "target/register_allocator.h"
+#include "target/x86_64.h"
+
+using namespace coil;
+
+/**
+ * @brief Append an instruction with register and immediate operands
+ */
+static void emit(Function& func, uint8_t category, uint8_t operation, std::vector<int> operands) {
+    auto inst = std::make_unique<Instruction>(category, operation);
+    for (int operand : operands) {
+        // Negative numbers stand for immediates, the rest are register IDs
+        if (operand < 0) {
+            inst->addOperand(OperandValue::makeImmediate(static_cast<int64_t>(-operand)));
+        } else {
+            uint8_t regId = static_cast<uint8_t>(operand);
+            uint8_t regType = regId >= REG_V0 ? REG_VEC : regId >= REG_F0 ? REG_FP : REG_GP;
+            inst->addOperand(OperandValue::makeRegister(regType, regId));
+        }
+    }
+    func.addInstruction(std::move(inst));
+}
+
+/**
+ * @brief Append a branch or call to a symbol
+ */
+static void emitBranch(Function& func, uint8_t operation, const std::string& symbol, int condition = -1) {
+    auto inst = std::make_unique<Instruction>(CAT_CF, operation);
+    inst->addOperand(std::make_unique<ImmediateOperand>(symbol));
+    if (condition >= 0) {
+        inst->setExtendedData({static_cast<uint8_t>(condition)});
+    }
+    func.addInstruction(std::move(inst));
+}
+
+/**
+ * @brief Append a variable instruction on one variable, with an optional register operand
+ */
+static void emitVariable(Function& func, uint8_t operation, uint8_t varId, int reg = -1,
+                         uint8_t subtype = VAR_DIRECT) {
+    auto inst = std::make_unique<Instruction>(CAT_VAR, operation);
+    inst->addOperand(OperandValue::makeVariable(varId, subtype));
+    if (reg >= 0) {
+        inst->addOperand(OperandValue::makeRegister(REG_GP, static_cast<uint8_t>(reg)));
+    }
+    func.addInstruction(std::move(inst));
+}
+
+static const LiveInterval* findInterval(const LinearScanAllocator& allocator, uint8_t vregId) {
+    for (const auto& interval : allocator.getIntervals()) {
+        if (interval.vregId == vregId) {
+            return &interval;
+        }
+    }
+    return nullptr;
+}
+
+static RegisterPool makePool(std::vector<uint8_t> registers, uint64_t volatileMask = 0) {
+    RegisterPool pool;
+    pool.registers = registers;
+    pool.volatileMask = volatileMask;
+    return pool;
+}
+
+/**
+ * @brief Test live intervals in straight-line code and around a loop
+ */
+bool test_target_liveness() {
+    Function straight("straight");
+    emit(straight, CAT_MEM, MEM_MOV, {REG_R0, -1});         // 0
+    emit(straight, CAT_MEM, MEM_MOV, {REG_R1, -2});         // 1
+    emit(straight, CAT_MATH, MATH_ADD, {REG_R2, REG_R0, REG_R1}); // 2
+    emit(straight, CAT_CF, CF_RET, {REG_R2});               // 3
+
+    LinearScanAllocator allocator;
+    allocator.addPool(REG_GP, makePool({0, 1, 2, 3}));
+    allocator.allocate(straight);
+
+    const LiveInterval* r0 = findInterval(allocator, REG_R0);
+    const LiveInterval* r2 = findInterval(allocator, REG_R2);
+    if (!r0 || r0->start != 1 || r0->end != 4 || !r2 || r2->start != 5 || r2->end != 6) {
+        std::cout << "Wrong intervals for straight-line code\n";
+        return false;
+    }
+
+    // R0 is read at the top of the loop, so it stays live through the back edge
+    Function loop("loop");
+    emit(loop, CAT_MEM, MEM_MOV, {REG_R0, -100});           // 0
+    emit(loop, CAT_MEM, MEM_MOV, {REG_R1, -10});            // 1
+    loop.addLabel("top", 2);
+    emit(loop, CAT_MATH, MATH_ADD, {REG_R0, REG_R0, -1});   // 2
+    emit(loop, CAT_BIT, BIT_CMP, {REG_R0, REG_R1});         // 3
+    emitBranch(loop, CF_BRC, "top", COND_NE);        // 4
+    emit(loop, CAT_CF, CF_RET, {});                         // 5
+
+    allocator.allocate(loop);
+    const LiveInterval* r1 = findInterval(allocator, REG_R1);
+    if (!r1 || r1->start != 3 || r1->end != 9) {
+        std::cout << "Expected R1 to be live until the loop's back edge\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test that registers are reused once their interval ends
+ */
+bool test_target_reuse() {
+    Function func("reuse");
+    emit(func, CAT_MEM, MEM_MOV, {REG_R0, -1});
+    emit(func, CAT_MEM, MEM_MOV, {REG_R1, REG_R0});
+    emit(func, CAT_MEM, MEM_MOV, {REG_R2, REG_R1});
+    emit(func, CAT_CF, CF_RET, {REG_R2});
+
+    LinearScanAllocator allocator;
+    allocator.addPool(REG_GP, makePool({5, 6}));
+    RegisterAllocation allocation = allocator.allocate(func);
+
+    if (allocation.getPhysicalRegister(REG_R0) != 5 || allocation.getPhysicalRegister(REG_R1) != 5 ||
+        allocation.getPhysicalRegister(REG_R2) != 5 || !allocation.spillSlots.empty()) {
+        std::cout << "Expected a chain of moves to share one register\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test spilling when more registers are live than the pool holds
+ */
+bool test_target_spill() {
+    Function func("spill");
+    emit(func, CAT_MEM, MEM_MOV, {REG_R0, -1});             // 0
+    emit(func, CAT_MEM, MEM_MOV, {REG_R1, -2});             // 1
+    emit(func, CAT_MEM, MEM_MOV, {REG_R2, -3});             // 2
+    emit(func, CAT_MATH, MATH_ADD, {REG_R3, REG_R1, REG_R2}); // 3
+    emit(func, CAT_MEM, MEM_MOV, {REG_R4, -4});             // 4
+    emit(func, CAT_MEM, MEM_MOV, {REG_R5, -5});             // 5
+    emit(func, CAT_MATH, MATH_ADD, {REG_R6, REG_R4, REG_R5}); // 6
+    emit(func, CAT_CF, CF_RET, {REG_R0, REG_R3, REG_R6});   // 7
+
+    LinearScanAllocator allocator;
+    allocator.addPool(REG_GP, makePool({0, 1}));
+    RegisterAllocation allocation = allocator.allocate(func);
+
+    // R0 lives longest, so it goes to memory first
+    const SpillSlot* slot = allocation.getSpillSlot(REG_R0);
+    if (!slot || slot->size != 8 || allocation.getPhysicalRegister(REG_R0) != PREG_NONE) {
+        std::cout << "Expected R0 to be spilled\n";
+        return false;
+    }
+
+    // No two registers live at the same time share a location
+    for (const auto& a : allocator.getIntervals()) {
+        for (const auto& b : allocator.getIntervals()) {
+            if (a.vregId >= b.vregId || a.end < b.start || b.end < a.start) {
+                continue;
+            }
+            if (a.pregId != PREG_NONE && a.pregId == b.pregId) {
+                std::cout << "Overlapping intervals share a register\n";
+                return false;
+            }
+            const SpillSlot* slotA = allocation.getSpillSlot(a.vregId);
+            const SpillSlot* slotB = allocation.getSpillSlot(b.vregId);
+            if (slotA && slotB && slotA->offset == slotB->offset) {
+                std::cout << "Overlapping intervals share a spill slot\n";
+                return false;
+            }
+        }
+    }
+
+    if (allocation.spillAreaSize != allocation.spillSlots.size() * 8 || allocation.spillSlots.size() < 2) {
+        std::cout << "Unexpected spill area size " << allocation.spillAreaSize << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test that values live across calls get preserved registers
+ */
+bool test_target_calls() {
+    Function func("caller");
+    emit(func, CAT_MEM, MEM_MOV, {REG_R7, -1});
+    emit(func, CAT_MEM, MEM_MOV, {REG_R8, -2});
+    emitBranch(func, CF_CALL, "callee");
+    emit(func, CAT_MATH, MATH_ADD, {REG_R8, REG_R8, REG_R7});
+    emit(func, CAT_CF, CF_RET, {REG_R8});
+
+    X86_64Target target(0);
+    target.allocateRegisters(func);
+    const RegisterAllocation& allocation = func.getRegisterAllocation();
+
+    for (uint8_t vregId : {REG_R7, REG_R8}) {
+        uint8_t pregId = allocation.getPhysicalRegister(vregId);
+        bool preserved = pregId == X86_64_RBX || (pregId >= X86_64_R12 && pregId <= X86_64_R15);
+        if (!preserved) {
+            std::cout << "Expected a preserved register across the call, got " << static_cast<int>(pregId) << "\n";
+            return false;
+        }
+    }
+
+    if (allocation.savedRegisters.size() != 2) {
+        std::cout << "Expected the two preserved registers to be saved\n";
+        return false;
+    }
+
+    // Without a call in between the volatile registers come first
+    Function leaf("leaf");
+    emit(leaf, CAT_MEM, MEM_MOV, {REG_R7, -1});
+    emit(leaf, CAT_CF, CF_RET, {REG_R7});
+    target.allocateRegisters(leaf);
+    if (leaf.getRegisterAllocation().getPhysicalRegister(REG_R7) != X86_64_RAX ||
+        !leaf.getRegisterAllocation().savedRegisters.empty()) {
+        std::cout << "Expected a leaf function to use RAX\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test that GP and XMM registers come from separate pools
+ */
+bool test_target_register_classes() {
+    Function func("classes");
+    emit(func, CAT_MEM, MEM_MOV, {REG_R0, -1});
+    emit(func, CAT_MEM, MEM_MOV, {REG_F0, REG_R0});
+    emit(func, CAT_MEM, MEM_MOV, {REG_V0, REG_F0});
+    emit(func, CAT_CF, CF_RET, {REG_R0, REG_F0, REG_V0});
+
+    X86_64Target target(0);
+    target.allocateRegisters(func);
+    const RegisterAllocation& allocation = func.getRegisterAllocation();
+
+    uint8_t r0 = allocation.getPhysicalRegister(REG_R0);
+    uint8_t f0 = allocation.getPhysicalRegister(REG_F0);
+    uint8_t v0 = allocation.getPhysicalRegister(REG_V0);
+    if (r0 > X86_64_R15 || f0 < X86_64_XMM0 || f0 > X86_64_XMM15 ||
+        v0 < X86_64_XMM0 || v0 > X86_64_XMM15 || f0 == v0) {
+        std::cout << "Registers allocated from the wrong class\n";
+        return false;
+    }
+
+    for (const auto& mapping : allocation.mappings) {
+        uint8_t expected = mapping.vregId == REG_R0 ? X86_64_REG_CLASS_GP : X86_64_REG_CLASS_XMM;
+        if (mapping.pregClass != expected) {
+            std::cout << "Wrong register class in mapping\n";
+            return false;
+        }
+    }
+
+    // The ABI's volatile list replaces the default one
+    AbiDefinition abi("test");
+    abi.volatileRegs = {REG_R2};
+    abi.preservedRegs = {REG_R1};
+    target.setAbi(&abi);
+    target.allocateRegisters(func);
+    if (func.getRegisterAllocation().getPhysicalRegister(REG_R0) != X86_64_RCX) {
+        std::cout << "Expected the ABI's volatile register\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test machine code for a leaf function, a call and a loop
+ */
+bool test_target_encode() {
+    X86_64Target target(0);
+
+    // R4 is an input, so it stays in RDI; R0 goes to the first volatile register
+    Function leaf("leaf");
+    emit(leaf, CAT_MEM, MEM_MOV, {REG_R0, -1});
+    emit(leaf, CAT_MATH, MATH_ADD, {REG_R0, REG_R0, REG_R4});
+    emit(leaf, CAT_CF, CF_RET, {REG_R0});
+
+    std::vector<uint8_t> code;
+    std::vector<CodeRelocation> relocations;
+    const std::vector<uint8_t> leafCode = {
+        0xB8, 0x01, 0x00, 0x00, 0x00, // mov eax, 1
+        0x48, 0x01, 0xF8,             // add rax, rdi
+        0xC3                          // ret
+    };
+    if (!target.encodeFunction(leaf, code, relocations) || code != leafCode || !relocations.empty()) {
+        std::cout << "Wrong machine code for a leaf function\n";
+        return false;
+    }
+
+    // A call needs a frame and leaves a relocation against the callee
+    Function caller("caller");
+    emitBranch(caller, CF_CALL, "callee");
+    emit(caller, CAT_CF, CF_RET, {});
+
+    code.clear();
+    const std::vector<uint8_t> callerCode = {
+        0x55,                         // push rbp
+        0x48, 0x89, 0xE5,             // mov rbp, rsp
+        0xE8, 0x00, 0x00, 0x00, 0x00, // call callee
+        0x48, 0x89, 0xEC,             // mov rsp, rbp
+        0x5D,                         // pop rbp
+        0xC3                          // ret
+    };
+    if (!target.encodeFunction(caller, code, relocations) || code != callerCode || relocations.size() != 1 ||
+        relocations[0].offset != 5 || relocations[0].type != X86_64_RELOC_PC32 ||
+        relocations[0].addend != -4 || relocations[0].symbol != "callee") {
+        std::cout << "Wrong machine code or relocation for a call\n";
+        return false;
+    }
+
+    // Branches to local labels are resolved in place, short when in reach
+    Function loop("loop");
+    loop.addLabel("top", 0);
+    emit(loop, CAT_MATH, MATH_DEC, {REG_R4});
+    emitBranch(loop, CF_BRC, "top", COND_NE);
+    emit(loop, CAT_CF, CF_RET, {});
+
+    code.clear();
+    relocations.clear();
+    const std::vector<uint8_t> loopCode = {
+        0x48, 0xFF, 0xCF, // dec rdi
+        0x75, 0xFB,       // jne top
+        0xC3              // ret
+    };
+    if (!target.encodeFunction(loop, code, relocations) || code != loopCode || !relocations.empty()) {
+        std::cout << "Wrong machine code for a loop\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test that only branches whose label is out of rel8 reach keep a rel32 field
+ */
+bool test_target_relax_branches() {
+    // A jump over a long block and a conditional branch over a call
+    Function func("relax");
+    emitBranch(func, CF_BR, "end");
+    emitBranch(func, CF_BRC, "skip", COND_NE);
+    emitBranch(func, CF_CALL, "callee");
+    func.addLabel("skip", 3);
+    for (int i = 0; i < 30; i++) {
+        emit(func, CAT_MATH, MATH_ADD, {REG_R0, REG_R0, -1000});
+    }
+    func.addLabel("end", func.getInstructions().size());
+    emit(func, CAT_CF, CF_RET, {});
+
+    X86_64Target target(0);
+    std::vector<uint8_t> code;
+    std::vector<CodeRelocation> relocations;
+    if (!target.encodeFunction(func, code, relocations) || code.size() < 16) {
+        std::cout << "Cannot encode branches to local labels\n";
+        return false;
+    }
+
+    // jmp end (rel32); jne skip (rel8); call callee, after the prologue
+    if (relocations.size() != 1 || relocations[0].symbol != "callee" || relocations[0].offset < 9) {
+        std::cout << "Expected a relocation against the callee\n";
+        return false;
+    }
+    size_t call = relocations[0].offset - 1;
+    int32_t jump;
+    std::memcpy(&jump, &code[call - 6], sizeof(jump));
+    if (code[call - 7] != 0xE9 || code[call - 2] != 0x75 || code[call - 1] != 5 || code[call] != 0xE8) {
+        std::cout << "Wrong branch forms after relaxation\n";
+        return false;
+    }
+
+    // The long jump lands past the block of 7-byte adds
+    if (static_cast<size_t>(call - 2 + jump) != call + 5 + 30 * 7) {
+        std::cout << "Wrong displacement after relaxation\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Test target feature strings
+ */
+bool test_target_features() {
+    auto avx2 = Target::createFromName(0, "x86-64+avx2+bmi2");
+    if (!avx2 || avx2->getName() != "x86-64+avx2+bmi2") {
+        std::cout << "Expected a target for x86-64+avx2+bmi2\n";
+        return false;
+    }
+
+    // AVX2 brings in AVX and the SSE levels, but not AVX-512
+    uint32_t features = avx2->getFeatures();
+    uint32_t implied = X86_64_FEATURE_AVX | X86_64_FEATURE_SSE4_2 | X86_64_FEATURE_SSE4_1 | X86_64_FEATURE_SSE2;
+    if ((features & implied) != implied || !(features & X86_64_FEATURE_BMI2) ||
+        (features & X86_64_FEATURE_AVX512F)) {
+        std::cout << "Wrong features for x86-64+avx2+bmi2\n";
+        return false;
+    }
+    if (static_cast<X86_64Target*>(avx2.get())->getVectorWidth() != 32) {
+        std::cout << "Expected 32-byte vectors with AVX2\n";
+        return false;
+    }
+
+    if (Target::createFromName(0, "x86-64+avx3") || Target::createFromName(0, "x86-64+")) {
+        std::cout << "Unknown features should be rejected\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Test that VEC and BIT instructions use the widest encoding the features allow
+ */
+bool test_target_encode_vector() {
+    // V0 and V1 are inputs, so they stay in XMM0 and XMM1
+    Function func("vector");
+    emit(func, CAT_VEC, VEC_ADD, {REG_V0, REG_V0, REG_V1});
+    func.getInstructions().back()->setExtendedData({TYPE_INT32});
+    emit(func, CAT_CF, CF_RET, {});
+
+    struct {
+        uint32_t features;
+        std::vector<uint8_t> code;
+    } cases[] = {
+        {0, {0x66, 0x0F, 0xFE, 0xC1, 0xC3}},                              // paddd xmm0, xmm1
+        {X86_64_FEATURE_AVX | X86_64_FEATURE_AVX2,
+         {0xC5, 0xFD, 0xFE, 0xC1, 0xC5, 0xF8, 0x77, 0xC3}},               // vpaddd ymm0, ymm0, ymm1; vzeroupper
+        {X86_64_FEATURE_AVX | X86_64_FEATURE_AVX2 | X86_64_FEATURE_AVX512F,
+         {0x62, 0xF1, 0x7D, 0x48, 0xFE, 0xC1, 0xC5, 0xF8, 0x77, 0xC3}}    // vpaddd zmm0, zmm0, zmm1; vzeroupper
+    };
+    for (const auto& testCase : cases) {
+        X86_64Target target(0, testCase.features);
+        std::vector<uint8_t> code;
+        std::vector<CodeRelocation> relocations;
+        if (!target.encodeFunction(func, code, relocations) || code != testCase.code) {
+            std::cout << "Wrong machine code for a vector addition at width " << target.getVectorWidth() << "\n";
+            return false;
+        }
+    }
+
+    // POPCNT replaces the shift loop
+    Function count("count");
+    emit(count, CAT_BIT, BIT_POPCNT, {REG_R0, REG_R4});
+    emit(count, CAT_CF, CF_RET, {REG_R0});
+
+    X86_64Target target(0, X86_64_FEATURE_POPCNT);
+    std::vector<uint8_t> code;
+    std::vector<CodeRelocation> relocations;
+    const std::vector<uint8_t> countCode = {
+        0xF3, 0x48, 0x0F, 0xB8, 0xC7, // popcnt rax, rdi
+        0xC3                          // ret
+    };
+    if (!target.encodeFunction(count, code, relocations) || code != countCode) {
+        std::cout << "Expected POPCNT\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test that a COF file for several targets carries a code section for each
+ */
+bool test_target_fat_cof() {
+    auto v2 = Target::createFromName(1, "x86-64-v2");
+    auto v3 = Target::createFromName(2, "x86-64-v3");
+    if (!v2 || !v3 || !(v2->getFeatures() & X86_64_FEATURE_POPCNT) || (v2->getFeatures() & X86_64_FEATURE_AVX) ||
+        !(v3->getFeatures() & X86_64_FEATURE_BMI2) || static_cast<X86_64Target*>(v3.get())->getVectorWidth() != 32) {
+        std::cout << "Wrong features for the x86-64 microarchitecture levels\n";
+        return false;
+    }
+
+    auto func = std::make_unique<Function>("vector");
+    emit(*func, CAT_VEC, VEC_ADD, {REG_V0, REG_V0, REG_V1});
+    func->getInstructions().back()->setExtendedData({TYPE_INT32});
+    emit(*func, CAT_CF, CF_RET, {});
+    Module module("fat");
+    module.addFunction(std::move(func));
+
+    auto cof = module.generateCof(2, nullptr, ENCODING_STANDARD, {v2.get(), v3.get()}, true);
+    if (!cof || cof->getTargetCount() != 2 || cof->getSectionCount() != 4) {
+        std::cout << "Expected one code section per target\n";
+        return false;
+    }
+
+    const std::vector<uint8_t> sseCode = {0x66, 0x0F, 0xFE, 0xC1, 0xC3};
+    const std::vector<uint8_t> avxCode = {0xC5, 0xFD, 0xFE, 0xC1, 0xC5, 0xF8, 0x77, 0xC3};
+    const Section& sseSection = cof->getSection(2);
+    const Section& avxSection = cof->getSection(3);
+    if (sseSection.getName() != "text.x86-64-v2" || sseSection.getData() != sseCode ||
+        avxSection.getName() != "text.x86-64-v3" || avxSection.getData() != avxCode ||
+        sseSection.getTargetId() == avxSection.getTargetId()) {
+        std::cout << "Wrong code sections for x86-64-v2 and x86-64-v3\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Test that variables share stack slots when they are not live together
+ */
+bool test_target_frame_layout() {
+    Function func("locals");
+    func.setVariableType(0, TYPE_INT64);
+    func.setVariableType(1, TYPE_INT64);
+    func.setVariableType(2, TYPE_INT8);
+    func.setVariableType(3, TYPE_INT16);
+    emitVariable(func, VAR_DECL, 2, REG_R0); // 0
+    emitVariable(func, VAR_DECL, 3, REG_R0); // 1
+    emitVariable(func, VAR_DECL, 0, REG_R0); // 2
+    emitVariable(func, VAR_DLT, 0);          // 3
+    emitVariable(func, VAR_DECL, 1, REG_R0); // 4
+    emitVariable(func, VAR_DLT, 1);          // 5
+    emitVariable(func, VAR_DLT, 2);          // 6
+    emitVariable(func, VAR_DLT, 3);          // 7
+
+    // Largest alignment first: $0 and $1 share offset 0, then $3 and $2
+    RegisterAllocation allocation;
+    FrameLayout(1).layout(func, nullptr, allocation);
+    const uint32_t expected[4][2] = {{0, 8}, {0, 8}, {10, 1}, {8, 2}};
+    for (uint8_t varId = 0; varId < 4; varId++) {
+        const VariableSlot* slot = allocation.getVariableSlot(varId);
+        if (!slot || slot->pregId != PREG_NONE || slot->offset != expected[varId][0] ||
+            slot->size != expected[varId][1]) {
+            std::cout << "Wrong stack slot for variable " << static_cast<int>(varId) << "\n";
+            return false;
+        }
+    }
+    if (allocation.variableAreaSize != 11) {
+        std::cout << "Unexpected variable area size " << allocation.variableAreaSize << "\n";
+        return false;
+    }
+
+    // The variable area starts 16-byte aligned after the spill slots
+    allocation.spillAreaSize = 8;
+    if (allocation.getVariableAreaOffset() != 16 || allocation.getFrameAreaSize() != 27) {
+        std::cout << "Wrong variable area placement\n";
+        return false;
+    }
+
+    // Scalars take free registers, preserved ones across calls; a variable
+    // whose address is taken stays in memory
+    Function calls("calls");
+    calls.setVariableType(0, TYPE_INT64);
+    calls.setVariableType(1, TYPE_INT32);
+    calls.setVariableType(2, TYPE_INT64);
+    emitVariable(calls, VAR_DECL, 0, REG_R0);
+    emitVariable(calls, VAR_DECL, 1, REG_R0);
+    emitVariable(calls, VAR_DECL, 2, REG_R0);
+    emitBranch(calls, CF_CALL, "callee");
+    emitVariable(calls, VAR_DLT, 0);
+    emitVariable(calls, VAR_DLT, 2, -1, VAR_ADDR);
+    emit(calls, CAT_CF, CF_RET, {REG_R0});
+
+    LinearScanAllocator allocator;
+    RegisterPool pool = makePool({0, 1, 2}, 0x1);
+    allocator.addPool(REG_GP, pool);
+    allocation = allocator.allocate(calls);
+    FrameLayout(8).layout(calls, &pool, allocation);
+
+    const VariableSlot* acrossCall = allocation.getVariableSlot(0);
+    const VariableSlot* beforeCall = allocation.getVariableSlot(1);
+    const VariableSlot* addressed = allocation.getVariableSlot(2);
+    uint8_t r0 = allocation.getPhysicalRegister(REG_R0);
+    if (!acrossCall || acrossCall->pregId == PREG_NONE || (pool.volatileMask & (1ull << acrossCall->pregId)) ||
+        acrossCall->pregId == r0 || !beforeCall || beforeCall->pregId == PREG_NONE ||
+        beforeCall->pregId == r0 || beforeCall->pregId == acrossCall->pregId) {
+        std::cout << "Wrong registers for variables\n";
+        return false;
+    }
+    if (!addressed || addressed->pregId != PREG_NONE || addressed->size != 8 || allocation.variableAreaSize != 8) {
+        std::cout << "Expected a variable whose address is taken in memory\n";
+        return false;
+    }
+    if (std::find(allocation.savedRegisters.begin(), allocation.savedRegisters.end(), acrossCall->pregId) ==
+        allocation.savedRegisters.end()) {
+        std::cout << "Expected the preserved register of a variable to be saved\n";
+        return false;
+    }
+
+    // A declaration with an initial value is a move into the variable
+    X86_64Target target(0);
+    Function leaf("leaf");
+    leaf.setVariableType(0, TYPE_INT64);
+    emitVariable(leaf, VAR_DECL, 0, REG_R4);
+    emit(leaf, CAT_MATH, MATH_ADD, {REG_R0, REG_R4, REG_R4});
+    emitVariable(leaf, VAR_DLT, 0);
+    emit(leaf, CAT_CF, CF_RET, {REG_R0});
+
+    RegisterAllocation leafAllocation = target.computeRegisterAllocation(leaf);
+    const VariableSlot* local = leafAllocation.getVariableSlot(0);
+    std::vector<uint8_t> code;
+    std::vector<CodeRelocation> relocations;
+    if (!local || local->pregId == PREG_NONE || !target.encodeFunction(leaf, code, relocations) ||
+        code.size() < 3 || code[0] == 0x55 || code[1] != 0x89 || (code[2] & 0xF8) != 0xF8) {
+        std::cout << "Wrong machine code for a variable declaration\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Run all target tests
+ */
+bool test_target() {
+    std::cout << "Testing targets...\n";
+
+    bool success = true;
+
+    success &= test_target_liveness();
+    success &= test_target_reuse();
+    success &= test_target_spill();
+    success &= test_target_calls();
+    success &= test_target_register_classes();
+    success &= test_target_encode();
+    success &= test_target_relax_branches();
+    success &= test_target_features();
+    success &= test_target_encode_vector();
+    success &= test_target_fat_cof();
+    success &= test_target_frame_layout();
+
+    if (success) {
+        std::cout << "All target tests passed.\n";
+    } else {
+        std::cout << "Some target tests failed.\n";
+    }
+
+    return success;
+}
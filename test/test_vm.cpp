@@ -0,0 +1,420 @@
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "driver/assembler.h"
+#include "binary/cof.h"
+#include "util/diagnostic.h"
+#include "util/logger.h"
+#include "vm/interpreter.h"
+#include "target/x86_64.h"
+#if defined(__x86_64__) && !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+using namespace coil;
+
+static const char* const LOOP_SOURCE = "DIR SECT text READ EXEC\n"
+                                       "DIR HINT fact FUNC GLOBAL\n"
+                                       "DIR LABEL fact\n"
+                                       "  MEM COMPARE R4, 1\n"
+                                       "  CF BRC LE base\n"
+                                       "  MEM PUSH R4\n"
+                                       "  MATH SUB R4, R4, 1\n"
+                                       "  CF CALL fact (R4) -> (R1)\n"
+                                       "  MEM POP R4\n"
+                                       "  MATH MUL R0, R1, R4\n"
+                                       "  CF RET R0\n"
+                                       "DIR LABEL base\n"
+                                       "  CF RET 1\n"
+                                       "DIR HINT fact ENDFUNC\n"
+                                       "DIR HINT main FUNC GLOBAL\n"
+                                       "DIR LABEL main\n"
+                                       "  MEM MOV R0, 0\n"
+                                       "  MEM MOV R1, 0\n"
+                                       "DIR LABEL loop\n"
+                                       "  MATH ADD R0, R1\n"
+                                       "  MATH INC R1\n"
+                                       "  MEM COMPARE R1, 100\n"
+                                       "  CF BRC LT loop\n"
+                                       "  MEM MOV R2, R0\n"
+                                       "  CF CALL fact (10) -> (R3)\n"
+                                       "  CF RET R2, R3\n"
+                                       "DIR HINT main ENDFUNC\n";
+
+/**
+ * @brief Assemble a source and load it for the interpreter
+ *
+ * @param source Source code
+ * @param program Program to load into
+ * @param encoding Encoding of the text section
+ * @return true if the program loaded
+ */
+static bool loadSource(const std::string& source, BytecodeProgram& program,
+                       InstructionEncoding encoding = ENCODING_STANDARD) {
+    AssemblyOptions options;
+    options.encoding = encoding;
+    Assembler assembler(options);
+
+    DiagnosticEngine diag(GlobalLogger::getInstance());
+    auto cof = assembler.assemble(source, "vm.coil", diag);
+    if (!cof) {
+        diag.printDiagnostics();
+        return false;
+    }
+    return program.load(*cof);
+}
+
+/**
+ * @brief Run a function of a loaded program
+ *
+ * @param program Program
+ * @param name Function name
+ * @param interpreter Interpreter to run on
+ * @param result Result (output parameter)
+ * @return true if the program ended
+ */
+static bool runFunction(const BytecodeProgram& program, const std::string& name, Interpreter& interpreter,
+                        int64_t& result) {
+    uint32_t function;
+    return program.findFunction(name, function) && interpreter.run(function, result);
+}
+
+/**
+ * @brief Test loops through local labels and recursive calls
+ */
+bool test_vm_loop() {
+    BytecodeProgram program;
+    if (!loadSource(LOOP_SOURCE, program)) {
+        std::cout << "Failed to load the loop program\n";
+        return false;
+    }
+
+    Interpreter interpreter(program);
+    int64_t result;
+    if (!runFunction(program, "main", interpreter, result) || result != 4950 ||
+        interpreter.getRegister(REG_R3) != 3628800) {
+        std::cout << "Wrong sum or factorial: " << result << ", " << interpreter.getRegister(REG_R3) << "\n";
+        return false;
+    }
+
+    // The loop runs 100 times, four instructions each
+    if (interpreter.getInstructionCount() < 400 || interpreter.getInstructionCount() > 500) {
+        std::cout << "Unexpected instruction count: " << interpreter.getInstructionCount() << "\n";
+        return false;
+    }
+
+    // Each run starts afresh
+    if (!runFunction(program, "main", interpreter, result) || result != 4950) {
+        std::cout << "Expected a second run to give the same result\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test that the compact encoding runs the same
+ */
+bool test_vm_compact() {
+    BytecodeProgram program;
+    if (!loadSource(LOOP_SOURCE, program, ENCODING_COMPACT)) {
+        std::cout << "Failed to load the compact loop program\n";
+        return false;
+    }
+
+    Interpreter interpreter(program);
+    int64_t result;
+    if (!runFunction(program, "main", interpreter, result) || result != 4950 ||
+        interpreter.getRegister(REG_R3) != 3628800) {
+        std::cout << "Wrong result from compact code: " << result << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test loads and stores through symbols, registers and variables
+ */
+bool test_vm_memory() {
+    BytecodeProgram program;
+    if (!loadSource("DIR SECT text READ EXEC\n"
+                    "DIR HINT main FUNC GLOBAL\n"
+                    "DIR LABEL main\n"
+                    "  MEM LOAD R1, bytes\n"
+                    "  MEM MOV R2, buffer\n"
+                    "  MEM STORE [R2+8], R1\n"
+                    "  MEM MOV R3, 1\n"
+                    "  MEM MOV R0, [R2+R3*8]\n"
+                    "  VAR DECL $0 : int64 = R0\n"
+                    "  BIT SHR $0, 8\n"
+                    "  MEM MOV R0, $0\n"
+                    "  CF RET R0\n"
+                    "DIR HINT main ENDFUNC\n"
+                    "DIR SECT data READ WRITE\n"
+                    "DIR LABEL bytes\n"
+                    "DIR ASCII \"ABCDEFGH\"\n"
+                    "DIR LABEL buffer\n"
+                    "DIR ZERO 16\n",
+                    program)) {
+        std::cout << "Failed to load the memory program\n";
+        return false;
+    }
+
+    Interpreter interpreter(program);
+    int64_t result;
+    if (!runFunction(program, "main", interpreter, result) || result != 0x0048474645444342) {
+        std::cout << "Wrong value through memory: " << std::hex << result << std::dec << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test calls into functions placed in text.cold
+ */
+bool test_vm_cold() {
+    BytecodeProgram program;
+    if (!loadSource("DIR SECT text READ EXEC\n"
+                    "DIR HINT rare FUNC GLOBAL COLD\n"
+                    "DIR LABEL rare\n"
+                    "  MATH ADD R0, R4, R5\n"
+                    "  CF RET R0\n"
+                    "DIR HINT rare ENDFUNC\n"
+                    "DIR HINT main FUNC GLOBAL\n"
+                    "DIR LABEL main\n"
+                    "  CF CALL rare (40, 2) -> (R1)\n"
+                    "  CF RET R1\n"
+                    "DIR HINT main ENDFUNC\n",
+                    program)) {
+        std::cout << "Failed to load the program with a cold function\n";
+        return false;
+    }
+
+    Interpreter interpreter(program);
+    int64_t result;
+    if (program.getFunctions().size() != 2 || !runFunction(program, "main", interpreter, result) || result != 42) {
+        std::cout << "Wrong result through a cold function\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test system calls and faults
+ */
+bool test_vm_system() {
+    BytecodeProgram program;
+    if (!loadSource("DIR SECT text READ EXEC\n"
+                    "DIR HINT main FUNC GLOBAL\n"
+                    "DIR LABEL main\n"
+                    "  CF SYSC (1) (1, message, 3) -> (R1)\n"
+                    "  CF SYSC (60) (R1)\n"
+                    "  CF TRAP\n"
+                    "DIR HINT main ENDFUNC\n"
+                    "DIR HINT divide FUNC GLOBAL\n"
+                    "DIR LABEL divide\n"
+                    "  MATH DIV R0, R4, R5\n"
+                    "  CF RET R0\n"
+                    "DIR HINT divide ENDFUNC\n"
+                    "DIR SECT data READ\n"
+                    "DIR LABEL message\n"
+                    "DIR ASCII \"ok\\n\"\n",
+                    program)) {
+        std::cout << "Failed to load the system call program\n";
+        return false;
+    }
+
+    Interpreter interpreter(program);
+    std::string output;
+    interpreter.setOutput(&output);
+    int64_t result;
+    if (!runFunction(program, "main", interpreter, result) || result != 3 || output != "ok\n") {
+        std::cout << "Expected the write to be captured and its result to be the exit status\n";
+        return false;
+    }
+
+    // R4 and R5 start out zero
+    if (runFunction(program, "divide", interpreter, result)) {
+        std::cout << "Expected division by zero to fault\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test that code which cannot be run is rejected when loaded
+ */
+bool test_vm_unsupported() {
+    BytecodeProgram program;
+    if (loadSource("DIR SECT text READ EXEC\n"
+                   "DIR HINT main FUNC GLOBAL\n"
+                   "DIR LABEL main\n"
+                   "  MATH SQRT R0, R1\n"
+                   "  CF RET\n"
+                   "DIR HINT main ENDFUNC\n",
+                   program)) {
+        std::cout << "Expected floating-point arithmetic to be rejected\n";
+        return false;
+    }
+    if (loadSource("DIR SECT text READ EXEC\n"
+                   "DIR HINT main FUNC GLOBAL\n"
+                   "DIR LABEL main\n"
+                   "  CF CALL missing\n"
+                   "  CF RET\n"
+                   "DIR HINT main ENDFUNC\n",
+                   program)) {
+        std::cout << "Expected a call to an undefined function to be rejected\n";
+        return false;
+    }
+
+    // A corrupt relocation is reported, not thrown on
+    AssemblyOptions options;
+    Assembler assembler(options);
+    DiagnosticEngine diag(GlobalLogger::getInstance());
+    auto cof = assembler.assemble(LOOP_SOURCE, "vm.coil", diag);
+    if (!cof) {
+        std::cout << "Failed to assemble the loop program\n";
+        return false;
+    }
+    cof->getSection(0).addRelocation(0, static_cast<uint32_t>(cof->getSymbols().size()), RELOC_COIL_SYMBOL, 0, 0);
+    if (program.load(*cof)) {
+        std::cout << "Expected a relocation naming a missing symbol to be rejected\n";
+        return false;
+    }
+
+    // So is a section too large for the memory image
+    cof = assembler.assemble(LOOP_SOURCE, "vm.coil", diag);
+    if (!cof) {
+        std::cout << "Failed to assemble the loop program\n";
+        return false;
+    }
+    cof->addSection("bss", SECTION_BSS, SECTION_FLAG_ALLOC | SECTION_FLAG_WRITE).fillZero(SIZE_MAX / 2);
+    if (program.load(*cof)) {
+        std::cout << "Expected a section larger than the memory image to be rejected\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Test that native code computes what the interpreter does
+ *
+ * The x86-64 section is relocated in place and called; this only runs on
+ * x86-64 hosts.
+ */
+bool test_vm_native() {
+#if defined(__x86_64__) && !defined(_WIN32)
+    AssemblyOptions options;
+    options.native = true;
+    Assembler assembler(options);
+    DiagnosticEngine diag(GlobalLogger::getInstance());
+    auto cof = assembler.assemble(LOOP_SOURCE, "vm.coil", diag);
+    BytecodeProgram program;
+    if (!cof || !program.load(*cof)) {
+        std::cout << "Failed to assemble the loop program with native code\n";
+        return false;
+    }
+
+    Interpreter interpreter(program);
+    int64_t result;
+    if (!runFunction(program, "main", interpreter, result)) {
+        std::cout << "Failed to interpret the loop program\n";
+        return false;
+    }
+
+    size_t sectionIndex = cof->getSectionCount();
+    for (size_t i = 0; i < cof->getSectionCount(); i++) {
+        if (cof->getSection(i).getName() == "text.x86-64") {
+            sectionIndex = i;
+        }
+    }
+    if (sectionIndex == cof->getSectionCount()) {
+        std::cout << "Expected an x86-64 code section\n";
+        return false;
+    }
+    const Section& section = cof->getSection(sectionIndex);
+    std::vector<uint8_t> code = section.getData();
+
+    // Every call is to a function in the same section
+    uint64_t entry = code.size();
+    for (const auto& symbol : cof->getSymbols()) {
+        if (symbol->getName() == "main" && symbol->getSectionIndex() == sectionIndex) {
+            entry = symbol->getValue();
+        }
+    }
+    for (const auto& relocation : section.getRelocations()) {
+        const Symbol& symbol = cof->getSymbol(relocation.symbol_index);
+        if (relocation.type != X86_64_RELOC_PC32 || symbol.getSectionIndex() != sectionIndex) {
+            std::cout << "Unexpected relocation to " << symbol.getName() << "\n";
+            return false;
+        }
+        int32_t field = static_cast<int32_t>(symbol.getValue() + relocation.addend - relocation.offset);
+        std::memcpy(code.data() + relocation.offset, &field, sizeof(field));
+    }
+    if (entry >= code.size()) {
+        std::cout << "Expected native code for main\n";
+        return false;
+    }
+
+    void* memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        std::cout << "Could not map memory for native code\n";
+        return false;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    bool ran = mprotect(memory, code.size(), PROT_READ | PROT_EXEC) == 0;
+
+    // main returns R2 and R3, which the System V convention puts in RAX
+    // and RDX, as it does a pair of integers
+    struct Results {
+        int64_t sum;
+        int64_t factorial;
+    };
+    Results native = {0, 0};
+    if (ran) {
+        auto function = reinterpret_cast<Results (*)()>(static_cast<uint8_t*>(memory) + entry);
+        native = function();
+    }
+    munmap(memory, code.size());
+
+    if (!ran || native.sum != result || native.factorial != static_cast<int64_t>(interpreter.getRegister(REG_R3))) {
+        std::cout << "Native code returned " << native.sum << ", " << native.factorial << ", expected " << result
+                  << ", " << interpreter.getRegister(REG_R3) << "\n";
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+/**
+ * @brief Run all interpreter tests
+ */
+bool test_vm() {
+    std::cout << "Testing the bytecode interpreter...\n";
+
+    bool success = true;
+
+    success &= test_vm_loop();
+    success &= test_vm_compact();
+    success &= test_vm_memory();
+    success &= test_vm_cold();
+    success &= test_vm_system();
+    success &= test_vm_unsupported();
+    success &= test_vm_native();
+
+    if (success) {
+        std::cout << "All interpreter tests passed.\n";
+    } else {
+        std::cout << "Some interpreter tests failed.\n";
+    }
+
+    return success;
+}
@@ -0,0 +1,134 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "link/linker.h"
+#include "util/logger.h"
+
+using namespace coil;
+
+/**
+ * @brief Print usage information
+ *
+ * @param programName Name of the program
+ */
+static void printUsage(const char* programName) {
+    std::cout << "COIL linker (coil-ld)\n";
+    std::cout << "Usage: " << programName << " [options] <object>...\n";
+    std::cout << "Options:\n";
+    std::cout << "  -o <output_file>   Specify output file (default: a.cof)\n";
+    std::cout << "  -e <symbol>        Entry point symbol (default: main, if defined)\n";
+    std::cout << "  -r                 Relocatable output: keep relocations and undefined\n";
+    std::cout << "                     symbols for a later link\n";
+    std::cout << "  -j <jobs>          Read and relocate objects on <jobs> threads\n";
+    std::cout << "                     (0: one per core, default: 0)\n";
+    std::cout << "  --hash             Add a symbol hash section for fast lookups by name\n";
+    std::cout << "  --deterministic    Derive the UUID from the contents and record the timestamp\n";
+    std::cout << "                     from SOURCE_DATE_EPOCH (default: 0)\n";
+    std::cout << "  -v                 Enable verbose output\n";
+    std::cout << "  -h, --help         Display this help message\n";
+}
+
+/**
+ * @brief Main entry point
+ *
+ * @param argc Argument count
+ * @param argv Argument values
+ * @return 0 on success, non-zero on error
+ */
+int main(int argc, char** argv) {
+    std::vector<std::string> inputFiles;
+    std::string outputFile = "a.cof";
+    LinkOptions options;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 < argc) {
+                outputFile = argv[++i];
+            } else {
+                std::cerr << "Error: Missing output file after -o\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-e") == 0) {
+            if (i + 1 < argc) {
+                options.entry = argv[++i];
+            } else {
+                std::cerr << "Error: Missing symbol after -e\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (i + 1 < argc) {
+                char* end = nullptr;
+                unsigned long value = strtoul(argv[++i], &end, 10);
+                if (*argv[i] == '\0' || *end != '\0') {
+                    std::cerr << "Error: Invalid job count: " << argv[i] << "\n";
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                options.jobs = static_cast<size_t>(value);
+            } else {
+                std::cerr << "Error: Missing job count after -j\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-r") == 0) {
+            options.relocatable = true;
+        } else if (strcmp(argv[i], "--hash") == 0) {
+            options.hashSection = true;
+        } else if (strcmp(argv[i], "--deterministic") == 0) {
+            options.deterministic = true;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printUsage(argv[0]);
+            return 0;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            std::cerr << "Error: Unexpected argument: " << argv[i] << "\n";
+            printUsage(argv[0]);
+            return 1;
+        } else {
+            inputFiles.push_back(argv[i]);
+        }
+    }
+
+    if (inputFiles.empty()) {
+        std::cerr << "Error: No objects specified\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (options.relocatable && !options.entry.empty()) {
+        std::cerr << "Error: -e cannot be used with -r\n";
+        return 1;
+    }
+    if (options.deterministic && getenv("SOURCE_DATE_EPOCH") &&
+        !CofFile::getSourceDateEpoch(options.timestamp)) {
+        std::cerr << "Error: Invalid SOURCE_DATE_EPOCH: " << getenv("SOURCE_DATE_EPOCH") << "\n";
+        return 1;
+    }
+
+    GlobalLogger::setInstance(std::make_unique<ConsoleLogger>(verbose ? LOG_DEBUG : LOG_INFO));
+
+    Linker linker(options);
+    if (!linker.addFiles(inputFiles)) {
+        return 1;
+    }
+
+    auto cof = linker.link();
+    if (!cof) {
+        return 1;
+    }
+
+    if (!cof->write(outputFile)) {
+        LOG_ERROR("Failed to write output file: {}", outputFile);
+        return 1;
+    }
+
+    LOG_DEBUG("Linked {} objects into {}: {} sections, {} symbols", linker.getObjectCount(), outputFile,
+              cof->getSectionCount(), cof->getSymbolCount());
+    return 0;
+}
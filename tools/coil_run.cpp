@@ -0,0 +1,154 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "binary/cof.h"
+#include "util/logger.h"
+#include "vm/interpreter.h"
+
+using namespace coil;
+
+/**
+ * @brief Print usage information
+ *
+ * @param programName Name of the program
+ */
+static void printUsage(const char* programName) {
+    std::cout << "COIL bytecode interpreter (coilrun)\n";
+    std::cout << "Usage: " << programName << " [options] <file.cof>\n";
+    std::cout << "Options:\n";
+    std::cout << "  -e <symbol>        Function to run (default: main, else _start)\n";
+    std::cout << "  --bench <runs>     Run <runs> times and report the fastest run's\n";
+    std::cout << "                     instructions per second on stderr\n";
+    std::cout << "  -v                 Enable verbose output\n";
+    std::cout << "  -h, --help         Display this help message\n";
+    std::cout << "The exit status is the program's result (R0, or its exit status).\n";
+}
+
+/**
+ * @brief Main entry point
+ *
+ * @param argc Argument count
+ * @param argv Argument values
+ * @return The program's result, or 1 if it could not be run
+ */
+int main(int argc, char** argv) {
+    std::string inputFile;
+    std::string entry;
+    unsigned long runs = 0;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-e") == 0) {
+            if (i + 1 < argc) {
+                entry = argv[++i];
+            } else {
+                std::cerr << "Error: Missing symbol after -e\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            if (i + 1 < argc) {
+                char* end = nullptr;
+                runs = strtoul(argv[++i], &end, 10);
+                if (*argv[i] == '\0' || *end != '\0' || runs == 0) {
+                    std::cerr << "Error: Invalid run count: " << argv[i] << "\n";
+                    printUsage(argv[0]);
+                    return 1;
+                }
+            } else {
+                std::cerr << "Error: Missing run count after --bench\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printUsage(argv[0]);
+            return 0;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            std::cerr << "Error: Unexpected argument: " << argv[i] << "\n";
+            printUsage(argv[0]);
+            return 1;
+        } else if (inputFile.empty()) {
+            inputFile = argv[i];
+        } else {
+            std::cerr << "Error: Only one file can be run\n";
+            return 1;
+        }
+    }
+
+    if (inputFile.empty()) {
+        std::cerr << "Error: No file specified\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    GlobalLogger::setInstance(std::make_unique<ConsoleLogger>(verbose ? LOG_DEBUG : LOG_INFO));
+
+    auto cof = CofFile::read(inputFile);
+    if (!cof) {
+        LOG_ERROR("Could not read COF file: {}", inputFile);
+        return 1;
+    }
+
+    // Decode everything up front; the file is not needed after that
+    BytecodeProgram program;
+    if (!program.load(*cof)) {
+        return 1;
+    }
+    cof.reset();
+
+    uint32_t function;
+    if (entry.empty()) {
+        if (!program.findFunction("main", function) && !program.findFunction("_start", function)) {
+            LOG_ERROR("No main or _start function to run");
+            return 1;
+        }
+    } else if (!program.findFunction(entry, function)) {
+        LOG_ERROR("No function to run: {}", entry);
+        return 1;
+    }
+    LOG_DEBUG("Loaded {} functions, {} instructions, {} constants", program.getFunctions().size(),
+              program.getInstructions().size(), program.getConstants().size());
+
+    Interpreter interpreter(program);
+    int64_t result = 0;
+    if (runs == 0) {
+        if (!interpreter.run(function, result)) {
+            return 1;
+        }
+        LOG_DEBUG("Executed {} instructions", interpreter.getInstructionCount());
+        return static_cast<int>(result & 0xFF);
+    }
+
+    // Only the first run's output is shown, so the timings are of the
+    // interpreter rather than the terminal
+    std::string output;
+    std::string discarded;
+    double fastest = 0;
+    for (unsigned long run = 0; run < runs; run++) {
+        interpreter.setOutput(run == 0 ? &output : &discarded);
+        discarded.clear();
+        auto start = std::chrono::steady_clock::now();
+        bool ended = interpreter.run(function, result);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!ended) {
+            return 1;
+        }
+        if (run == 0 || seconds < fastest) {
+            fastest = seconds;
+        }
+    }
+    fwrite(output.data(), 1, output.size(), stdout);
+    fflush(stdout);
+
+    uint64_t instructions = interpreter.getInstructionCount();
+    fprintf(stderr, "%s: %llu instructions, fastest of %lu runs %.6f s, %.1f M instructions/s\n",
+            program.getFunctions()[function].name.c_str(), static_cast<unsigned long long>(instructions), runs,
+            fastest, fastest > 0 ? instructions / fastest / 1e6 : 0.0);
+    return static_cast<int>(result & 0xFF);
+}